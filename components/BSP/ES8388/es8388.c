@@ -10,8 +10,14 @@
 const char* es8388_tag = "es8388";
 i2c_master_dev_handle_t es8388_handle = NULL;
 
+static uint8_t s_reg_cache[ES8388_REG_NUM];     /* 最近写入各寄存器的值 */
+static uint64_t s_reg_valid;                    /* 每位对应一个寄存器,1:缓存值与芯片一致 */
+static uint32_t s_reg_writes;                   /* 实际发出的寄存器写次数 */
+static uint32_t s_reg_skips;                    /* 值未改变而省去的寄存器写次数 */
+
 /**
  * @brief       ES8388写寄存器
+ * @note        总是发出I2C写,并记录到寄存器缓存;软复位(R0 bit7)使缓存失效
  * @param       reg_addr:寄存器地址
  * @param       data:写入的数据
  * @retval      无
@@ -19,15 +25,7 @@ i2c_master_dev_handle_t es8388_handle = NULL;
 esp_err_t es8388_write_reg(uint8_t reg_addr, uint8_t data)
 {
     esp_err_t ret;
-    uint8_t *buf = malloc(2);
-    if (buf == NULL)
-    {
-        ESP_LOGE(es8388_tag, "%s memory failed", __func__);
-        return ESP_ERR_NO_MEM;      /* 分配内存失败 */
-    }
-
-    buf[0] = reg_addr;
-    buf[1] = data;                  /* 拷贝数据至存储区当中 */
+    uint8_t buf[2] = {reg_addr, data};  /* 同步传输,发送完成才返回 */
 
     do
     {
@@ -35,11 +33,62 @@ esp_err_t es8388_write_reg(uint8_t reg_addr, uint8_t data)
         ret = i2c_master_transmit(es8388_handle, buf, 2, 1000);
     } while (ret != ESP_OK);
 
-    free(buf);                      /* 发送完成释放内存 */
+    s_reg_writes++;
+
+    if (reg_addr == 0 && (data & 0x80))
+    {
+        s_reg_valid = 0;                /* 软复位后寄存器恢复默认值 */
+    }
+    else if (reg_addr < ES8388_REG_NUM)
+    {
+        s_reg_cache[reg_addr] = data;
+        s_reg_valid |= 1ULL << reg_addr;
+    }
 
     return ret;
 }
 
+/**
+ * @brief       ES8388更新寄存器
+ * @note        寄存器缓存中的值与data相同时不发出I2C写
+ * @param       reg_addr:寄存器地址
+ * @param       data:写入的数据
+ * @retval      ESP_OK:成功; 其他:失败
+ */
+esp_err_t es8388_update_reg(uint8_t reg_addr, uint8_t data)
+{
+    if (reg_addr < ES8388_REG_NUM && (s_reg_valid & (1ULL << reg_addr)) && s_reg_cache[reg_addr] == data)
+    {
+        s_reg_skips++;
+        return ESP_OK;
+    }
+
+    return es8388_write_reg(reg_addr, data);
+}
+
+/**
+ * @brief       使寄存器缓存失效
+ * @note        芯片掉电或被其他途径改写后调用,之后的es8388_update_reg都会写入
+ * @param       无
+ * @retval      无
+ */
+void es8388_cache_invalidate(void)
+{
+    s_reg_valid = 0;
+}
+
+/**
+ * @brief       获取寄存器写统计
+ * @param       writes : 实际发出的寄存器写次数,可为NULL
+ * @param       skips  : 值未改变而省去的寄存器写次数,可为NULL
+ * @retval      无
+ */
+void es8388_get_reg_stats(uint32_t *writes, uint32_t *skips)
+{
+    if (writes) *writes = s_reg_writes;
+    if (skips) *skips = s_reg_skips;
+}
+
 /**
  * @brief       ES8388读寄存器
  * @param       reg_add:寄存器地址
@@ -158,7 +207,7 @@ void es8388_i2s_cfg(uint8_t fmt, uint8_t len)
 {
     fmt &= 0x03;
     len &= 0x07;    /* 限定范围 */
-    es8388_write_reg(23, (fmt << 1) | (len << 3));  /* R23,ES8388工作模式设置 */
+    es8388_update_reg(23, (fmt << 1) | (len << 3));  /* R23,ES8388工作模式设置 */
 }
 
 /**
@@ -173,8 +222,8 @@ void es8388_hpvol_set(uint8_t volume)
         volume = 33;
     }
 
-    es8388_write_reg(0x2E, volume);
-    es8388_write_reg(0x2F, volume);
+    es8388_update_reg(0x2E, volume);
+    es8388_update_reg(0x2F, volume);
 }
 
 /**
@@ -189,8 +238,8 @@ void es8388_spkvol_set(uint8_t volume)
         volume = 33;
     }
 
-    es8388_write_reg(0x30, volume);
-    es8388_write_reg(0x31, volume);
+    es8388_update_reg(0x30, volume);
+    es8388_update_reg(0x31, volume);
 }
 
 /**
@@ -201,7 +250,7 @@ void es8388_spkvol_set(uint8_t volume)
 void es8388_3d_set(uint8_t depth)
 {
     depth &= 0x7;       /* 限定范围 */
-    es8388_write_reg(0x1D, depth << 2);    /* R7,3D环绕设置 */
+    es8388_update_reg(0x1D, depth << 2);  /* R7,3D环绕设置 */
 }
 
 /**
@@ -218,7 +267,7 @@ void es8388_adda_cfg(uint8_t dacen, uint8_t adcen)
     tempreg |= !adcen << 1;
     tempreg |= !dacen << 2;
     tempreg |= !adcen << 3;
-    es8388_write_reg(0x02, tempreg);
+    es8388_update_reg(0x02, tempreg);
 }
 
 /**
@@ -232,7 +281,7 @@ void es8388_output_cfg(uint8_t o1en, uint8_t o2en)
     uint8_t tempreg = 0;
     tempreg |= o1en * (3 << 4);
     tempreg |= o2en * (3 << 2);
-    es8388_write_reg(0x04, tempreg);
+    es8388_update_reg(0x04, tempreg);
 }
 
 /**
@@ -244,7 +293,7 @@ void es8388_mic_gain(uint8_t gain)
 {
     gain &= 0x0F;
     gain |= gain << 4;
-    es8388_write_reg(0x09, gain);       /* R9,左右通道PGA增益设置 */
+    es8388_update_reg(0x09, gain);     /* R9,左右通道PGA增益设置 */
 }
 
 /**
@@ -264,7 +313,7 @@ void es8388_alc_ctrl(uint8_t sel, uint8_t maxgain, uint8_t mingain)
     tempreg = sel << 6;
     tempreg |= (maxgain & 0x07) << 3;
     tempreg |= mingain & 0x07;
-    es8388_write_reg(0x12, tempreg);     /* R18,ALC设置 */
+    es8388_update_reg(0x12, tempreg);   /* R18,ALC设置 */
 }
 
 /**
@@ -276,5 +325,5 @@ void es8388_alc_ctrl(uint8_t sel, uint8_t maxgain, uint8_t mingain)
  */
 void es8388_input_cfg(uint8_t in)
 {
-    es8388_write_reg(0x0A, (5 * in) << 4);   /* ADC1 输入通道选择L/R INPUT1 */
+    es8388_update_reg(0x0A, (5 * in) << 4); /* ADC1 输入通道选择L/R INPUT1 */
 }
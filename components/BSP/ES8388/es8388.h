@@ -18,12 +18,16 @@
 #include "string.h"
 
 #define ES8388_ADDR             0x10                                    /* ES8388的器件地址,固定为0x10 */
+#define ES8388_REG_NUM          53                                      /* 寄存器数量(R0~R52),写入的值缓存在本地 */
 
 /* 声明函数 */
 uint8_t es8388_init(void);                                              /* ES8388初始化 */
 esp_err_t es8388_deinit(void);                                          /* 复位或者暂停ES8388初始化 */
 esp_err_t es8388_write_reg(uint8_t reg, uint8_t val);                   /* ES8388写寄存器 */
 esp_err_t es8388_read_reg(uint8_t reg_add, uint8_t *p_data);            /* ES8388读寄存器 */
+esp_err_t es8388_update_reg(uint8_t reg, uint8_t val);                  /* ES8388更新寄存器,值未改变时不写 */
+void es8388_cache_invalidate(void);                                     /* 使寄存器缓存失效 */
+void es8388_get_reg_stats(uint32_t *writes, uint32_t *skips);           /* 获取寄存器写统计 */
 void es8388_i2s_cfg(uint8_t fmt, uint8_t len);                          /* 设置ES8388工作模式 */
 void es8388_hpvol_set(uint8_t volume);                                  /* 设置耳机音量 */
 void es8388_spkvol_set(uint8_t volume);                                 /* 设置喇叭音量 */
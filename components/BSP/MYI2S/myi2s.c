@@ -1,24 +1,189 @@
 /**
  ****************************************************************************************************
  * @file        i2s.c
+ * @note        TX和RX两个通道在同一个I2S上,共用BCLK和WS,由本模块统一创建和卸载.
+ *              播放和录音分别按方向打开/关闭(引用计数),一个方向关闭时另一个方向不受影响,
+ *              两个方向都关闭后才卸载;RX关闭后停止RX通道,只播放时不接收也不产生接收溢出;
+ *              采样率和位宽两个方向共用,另一方向正在使用时不能修改.
+ *              时间戳:DMA每收完/发完一个缓冲区时在中断中记下esp_timer时间和累计帧数,
+ *              两个方向的帧数从同一时刻开始计,读写时按采样率换算出第一帧采集/播出的时刻,
+ *              双工时两者在同一时基上,相减即为往返延迟
  */
 
 #include "myi2s.h"
+#include "audio_prof.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "myi2s";
 
 
 i2s_chan_handle_t tx_handle = NULL;     /* I2S发送通道句柄 */
 i2s_chan_handle_t rx_handle = NULL;     /* I2S接收通道句柄 */
 i2s_std_config_t my_std_cfg;            /* 标准模式配置结构体 */
+static volatile bool s_tx_watch;        /* 是否统计DMA欠载 */
+static volatile uint32_t s_rx_overflows;/* RX DMA接收队列溢出次数 */
 
-/*
- * @brief       初始化I2S
+static uint8_t s_refs[2];               /* TX/RX打开次数 */
+static bool s_rx_enabled;               /* RX通道是否已启用,RX关闭后停止 */
+static uint32_t s_frame_bytes = 4;      /* 每帧字节数,立体声 */
+
+/* DMA时间线,单位都是帧,在中断和任务中访问 */
+static portMUX_TYPE s_ts_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint64_t s_tx_dma;               /* DMA已发完的帧数 */
+static int64_t s_tx_dma_us;             /* 最近一次发完的时刻 */
+static uint64_t s_tx_pos;               /* 下一次写入的数据在时间线上的位置 */
+static uint64_t s_rx_dma;               /* DMA已收完的帧数 */
+static int64_t s_rx_dma_us;             /* 最近一次收完的时刻 */
+static uint64_t s_rx_pos;               /* 下一次读取的数据在时间线上的位置 */
+
+/**
+ * @brief       打开/关闭和修改格式用的互斥锁,第一次使用时创建
+ */
+static SemaphoreHandle_t i2s_lock(void)
+{
+    static StaticSemaphore_t buf;
+    static SemaphoreHandle_t lock;
+    static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+    taskENTER_CRITICAL(&mux);
+
+    if (!lock)
+    {
+        lock = xSemaphoreCreateMutexStatic(&buf);
+    }
+
+    taskEXIT_CRITICAL(&mux);
+    return lock;
+}
+
+/**
+ * @brief       TX DMA发完一个缓冲区回调(中断中运行)
+ */
+static IRAM_ATTR bool i2s_tx_sent_cb(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+    portENTER_CRITICAL_ISR(&s_ts_lock);
+    s_tx_dma += event->size / s_frame_bytes;
+    s_tx_dma_us = esp_timer_get_time();
+    portEXIT_CRITICAL_ISR(&s_ts_lock);
+
+    return false;
+}
+
+/**
+ * @brief       TX DMA发送队列溢出回调(中断中运行)
+ * @note        DMA发完一个缓冲区时应用还没有写入新数据,即欠载;
+ *              空闲时DMA持续发送静音也会触发,所以只在i2s_tx_watch打开时计数
+ */
+static IRAM_ATTR bool i2s_tx_ovf_cb(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+    if (s_tx_watch)
+    {
+        audio_prof_count(AUDIO_PROF_UNDERRUNS, 1);
+    }
+
+    return false;
+}
+
+/**
+ * @brief       RX DMA收完一个缓冲区回调(中断中运行)
+ */
+static IRAM_ATTR bool i2s_rx_recv_cb(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+    portENTER_CRITICAL_ISR(&s_ts_lock);
+    s_rx_dma += event->size / s_frame_bytes;
+    s_rx_dma_us = esp_timer_get_time();
+    portEXIT_CRITICAL_ISR(&s_ts_lock);
+
+    return false;
+}
+
+/**
+ * @brief       RX DMA接收队列溢出回调(中断中运行)
+ * @note        应用没有及时读取,最早收到的一个DMA缓冲区被覆盖.RX关闭时通道已停止,不会触发
+ */
+static IRAM_ATTR bool i2s_rx_ovf_cb(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+    s_rx_overflows++;
+
+    portENTER_CRITICAL_ISR(&s_ts_lock);
+    s_rx_pos += event->size / s_frame_bytes;    /* 被覆盖的数据不会读到 */
+    portEXIT_CRITICAL_ISR(&s_ts_lock);
+
+    return false;
+}
+
+/**
+ * @brief       启用TX通道,rx为true时同时启用RX通道,两个方向的时间线从这里开始
+ * @param       rx : true:RX已打开,同时启用
+ * @retval      无
+ */
+static void i2s_enable(bool rx)
+{
+    portENTER_CRITICAL(&s_ts_lock);
+    s_tx_dma = s_tx_pos = s_rx_dma = s_rx_pos = 0;
+    s_tx_dma_us = s_rx_dma_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&s_ts_lock);
+
+    ESP_ERROR_CHECK(i2s_channel_enable(tx_handle));                     /* 启用TX通道 */
+
+    if (rx)
+    {
+        ESP_ERROR_CHECK(i2s_channel_enable(rx_handle));                 /* 启用RX通道 */
+    }
+
+    s_rx_enabled = rx;
+}
+
+/**
+ * @brief       TX正在运行时启用RX通道,RX的时间线从这里开始
+ * @note        时刻都是esp_timer时间,与TX仍在同一时基上
  * @param       无
+ * @retval      无
+ */
+static void i2s_rx_enable(void)
+{
+    portENTER_CRITICAL(&s_ts_lock);
+    s_rx_dma = s_rx_pos = 0;
+    s_rx_dma_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&s_ts_lock);
+
+    ESP_ERROR_CHECK(i2s_channel_enable(rx_handle));
+    s_rx_enabled = true;
+}
+
+/**
+ * @brief       停止RX通道,没有人读取时DMA不再接收,也不再产生接收溢出
+ * @param       无
+ * @retval      无
+ */
+static void i2s_rx_disable(void)
+{
+    if (s_rx_enabled)
+    {
+        ESP_ERROR_CHECK(i2s_channel_disable(rx_handle));
+        s_rx_enabled = false;
+    }
+}
+
+/*
+ * @brief       创建两个通道,启动TX,rx为true时同时启动RX
+ * @param       low_latency : true:使用双工的低延迟DMA配置
+ * @param       rx          : true:打开的方向包括RX
  * @retval      ESP_OK:初始化成功;其他:失败
  */
-esp_err_t myi2s_init(void)
+static esp_err_t i2s_create(bool low_latency, bool rx)
 {
     i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM, I2S_ROLE_MASTER);  /* 默认的通道配置(I2S0,主机) */
     chan_cfg.auto_clear = true;                                             /* 自动清除DMA缓冲区遗留的数据 */
+
+    if (low_latency)
+    {
+        chan_cfg.dma_desc_num = I2S_DUPLEX_DMA_DESC;
+        chan_cfg.dma_frame_num = I2S_DUPLEX_DMA_FRAME;
+    }
+
     ESP_ERROR_CHECK(i2s_new_channel(&chan_cfg, &tx_handle, &rx_handle));    /* 分配新的I2S通道 */
 
     i2s_std_config_t std_cfg = {    /* 标准通信模式配置 */
@@ -56,62 +221,176 @@ esp_err_t myi2s_init(void)
     };
 
     my_std_cfg = std_cfg;
+    s_frame_bytes = 4;
 
     ESP_ERROR_CHECK(i2s_channel_init_std_mode(tx_handle, &std_cfg));    /* 初始化TX通道 */
     ESP_ERROR_CHECK(i2s_channel_init_std_mode(rx_handle, &std_cfg));    /* 初始化RX通道 */
-    ESP_ERROR_CHECK(i2s_channel_enable(tx_handle));                     /* 启用TX通道 */
-    ESP_ERROR_CHECK(i2s_channel_enable(rx_handle));                     /* 启用RX通道 */
+
+    i2s_event_callbacks_t cbs = {
+        .on_sent = i2s_tx_sent_cb,
+        .on_send_q_ovf = i2s_tx_ovf_cb,
+    };
+    ESP_ERROR_CHECK(i2s_channel_register_event_callback(tx_handle, &cbs, NULL));    /* 统计DMA欠载,须在启用通道前注册 */
+    i2s_event_callbacks_t rx_cbs = {
+        .on_recv = i2s_rx_recv_cb,
+        .on_recv_q_ovf = i2s_rx_ovf_cb,
+    };
+    ESP_ERROR_CHECK(i2s_channel_register_event_callback(rx_handle, &rx_cbs, NULL)); /* 统计接收溢出(录音丢数据) */
+    s_tx_watch = false;
+    i2s_enable(rx);
 
     return ESP_OK;
 }
 
 /**
- * @brief       I2S TRX启动
- * @param       无
- * @retval      无
+ * @brief       按方向打开I2S
+ * @note        两个方向都没有打开时创建两个通道并启动TX,之后只增加引用计数;RX在打开时启动.
+ *              以I2S_DIR_DUPLEX创建时DMA缓冲区小,用于对讲和回环;
+ *              先打开一个方向再打开另一个方向时沿用原来的DMA配置
+ * @param       dir : I2S_DIR_TX/I2S_DIR_RX/I2S_DIR_DUPLEX
+ * @retval      ESP_OK:成功;其他:失败
  */
-void i2s_trx_start(void)
+esp_err_t i2s_open(uint8_t dir)
 {
-    ESP_ERROR_CHECK(i2s_channel_enable(tx_handle));
-    ESP_ERROR_CHECK(i2s_channel_enable(rx_handle));
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(i2s_lock(), portMAX_DELAY);
+
+    if (!s_refs[0] && !s_refs[1])
+    {
+        ret = i2s_create(dir == I2S_DIR_DUPLEX, (dir & I2S_DIR_RX) != 0);
+    }
+    else if ((dir & I2S_DIR_RX) && !s_rx_enabled)
+    {
+        i2s_rx_enable();                                                /* 只在播放,开始录音 */
+    }
+
+    if (ret == ESP_OK)
+    {
+        s_refs[0] += (dir & I2S_DIR_TX) ? 1 : 0;
+        s_refs[1] += (dir & I2S_DIR_RX) ? 1 : 0;
+    }
+
+    xSemaphoreGive(i2s_lock());
+    return ret;
 }
 
 /**
- * @brief       I2S TRX停止
- * @param       无
+ * @brief       按方向关闭I2S
+ * @note        只有两个方向都关闭后才卸载通道,另一方向正在播放或录音时不受影响;
+ *              RX关闭而TX仍在播放时停止RX通道
+ * @param       dir : 与i2s_open相同
  * @retval      无
  */
-void i2s_trx_stop(void)
+void i2s_close(uint8_t dir)
 {
-    ESP_ERROR_CHECK(i2s_channel_disable(tx_handle));
-    ESP_ERROR_CHECK(i2s_channel_disable(rx_handle));
+    xSemaphoreTake(i2s_lock(), portMAX_DELAY);
+
+    if ((dir & I2S_DIR_TX) && s_refs[0])
+    {
+        s_refs[0]--;
+    }
+
+    if ((dir & I2S_DIR_RX) && s_refs[1])
+    {
+        s_refs[1]--;
+    }
+
+    if (!s_refs[0] && !s_refs[1] && tx_handle)
+    {
+        ESP_ERROR_CHECK(i2s_channel_disable(tx_handle));
+        i2s_rx_disable();
+        ESP_ERROR_CHECK(i2s_del_channel(tx_handle));
+        ESP_ERROR_CHECK(i2s_del_channel(rx_handle));
+        tx_handle = NULL;
+        rx_handle = NULL;
+    }
+    else if (!s_refs[1] && tx_handle)
+    {
+        i2s_rx_disable();
+    }
+
+    xSemaphoreGive(i2s_lock());
 }
 
 /**
- * @brief       I2S卸载
- * @param       无
- * @retval      无
+ * @brief       该方向是否已打开
+ * @note        用于配置ES8388时保留另一方向的DAC/ADC
+ * @param       dir : I2S_DIR_TX/I2S_DIR_RX
+ * @retval      true:已打开
  */
-void i2s_deinit(void)
+bool i2s_is_open(uint8_t dir)
 {
-    ESP_ERROR_CHECK(i2s_del_channel(tx_handle));
-    ESP_ERROR_CHECK(i2s_del_channel(rx_handle));
+    return ((dir & I2S_DIR_TX) && s_refs[0]) || ((dir & I2S_DIR_RX) && s_refs[1]);
 }
 
 /**
  * @brief       设置采样率和位宽
- * @param       sampleRate  :采样率
- * @param       bits_sample :位宽
+ * @note        两个方向共用时钟和位宽:另一方向正在使用且格式不同时返回ESP_ERR_INVALID_STATE,
+ *              不修改;格式相同时直接返回.修改时短暂停止两个通道,时间线重新开始
+ * @param       dir         :调用者打开的方向
+ * @param       samplerate  :采样率
+ * @param       bits        :位宽
+ * @retval      ESP_OK:成功;ESP_ERR_INVALID_STATE:与另一方向冲突或没有打开
+ */
+esp_err_t i2s_set_format(uint8_t dir, uint32_t samplerate, i2s_data_bit_width_t bits)
+{
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(i2s_lock(), portMAX_DELAY);
+
+    if (!tx_handle)
+    {
+        ret = ESP_ERR_INVALID_STATE;
+    }
+    else if (my_std_cfg.clk_cfg.sample_rate_hz != samplerate || my_std_cfg.slot_cfg.data_bit_width != bits)
+    {
+        uint8_t other = dir ^ I2S_DIR_DUPLEX;
+
+        if (i2s_is_open(other))
+        {
+            ret = ESP_ERR_INVALID_STATE;
+        }
+        else
+        {
+            /* 如果需要更新声道或时钟配置,需要在更新前先禁用通道 */
+            ESP_ERROR_CHECK(i2s_channel_disable(tx_handle));
+            i2s_rx_disable();
+            my_std_cfg.slot_cfg.data_bit_width = bits;          /* 数据位宽,24位数据使用32位(左对齐) */
+            my_std_cfg.slot_cfg.ws_width = bits;                /* 位宽 */
+            ESP_ERROR_CHECK(i2s_channel_reconfig_std_slot(tx_handle, &my_std_cfg.slot_cfg));
+            ESP_ERROR_CHECK(i2s_channel_reconfig_std_slot(rx_handle, &my_std_cfg.slot_cfg));
+            my_std_cfg.clk_cfg.sample_rate_hz = samplerate;     /* 设置采样率 */
+            ESP_ERROR_CHECK(i2s_channel_reconfig_std_clock(tx_handle, &my_std_cfg.clk_cfg));
+            s_frame_bytes = bits / 8 * 2;
+            i2s_enable(s_refs[1] != 0);
+        }
+    }
+
+    xSemaphoreGive(i2s_lock());
+    return ret;
+}
+
+/**
+ * @brief       开启/关闭DMA欠载统计
+ * @note        在写入第一块数据后开启,停止写入(播放结束、暂停)前关闭
+ * @param       enable : true:开启
  * @retval      无
  */
-void i2s_set_samplerate_bits_sample(int samplerate, int bits_sample)
+void i2s_tx_watch(bool enable)
+{
+    s_tx_watch = enable;
+}
+
+/**
+ * @brief       获取RX DMA接收队列溢出次数
+ * @note        累计值,录音时取开始和结束时的差
+ * @param       无
+ * @retval      溢出次数
+ */
+uint32_t i2s_rx_overflows(void)
 {
-    i2s_trx_stop();
-    /* 如果需要更新声道或时钟配置,需要在更新前先禁用通道 */
-    my_std_cfg.slot_cfg.ws_width = bits_sample;        /* 位宽 */
-    ESP_ERROR_CHECK(i2s_channel_reconfig_std_slot(tx_handle, &my_std_cfg.slot_cfg));
-    my_std_cfg.clk_cfg.sample_rate_hz = samplerate;    /* 设置采样率 */
-    ESP_ERROR_CHECK(i2s_channel_reconfig_std_clock(tx_handle, &my_std_cfg.clk_cfg));
+    return s_rx_overflows;
 }
 
 /**
@@ -122,8 +401,62 @@ void i2s_set_samplerate_bits_sample(int samplerate, int bits_sample)
  */
 size_t i2s_tx_write(uint8_t *buffer, uint32_t frame_size)
 {
-    size_t bytes_written;
-    ESP_ERROR_CHECK(i2s_channel_write(tx_handle, buffer, frame_size, &bytes_written, 1000));
+    return i2s_tx_write_ts(buffer, frame_size, NULL);
+}
+
+/**
+ * @brief       读写出错时记录日志,不中止程序,由调用者按返回的长度处理
+ * @note        超时已经阻塞了1s;通道未启用等错误立即返回,让出一个节拍,调用者的读写循环不会占满CPU
+ */
+static void i2s_io_error(const char *op, esp_err_t err)
+{
+    ESP_LOGE(TAG, "I2S %s failed: %s", op, esp_err_to_name(err));
+
+    if (err != ESP_ERR_TIMEOUT)
+    {
+        vTaskDelay(1);
+    }
+}
+
+/**
+ * @brief       I2S传输数据,并给出第一帧播出的时刻
+ * @note        数据接在上一次写入之后;DMA已经发到更后面(欠载)时,接在正在发送的缓冲区之后.
+ *              时刻由最近一次DMA发完的时刻和帧数之差换算,误差在一个DMA缓冲区以内
+ * @param       buffer: 数据存储区的首地址
+ * @param       frame_size: 数据大小
+ * @param       ts: 第一帧播出的esp_timer时刻(us),可为NULL
+ * @retval      发送的数据长度,出错时为出错前已发送的部分(可能为0)
+ */
+size_t i2s_tx_write_ts(uint8_t *buffer, uint32_t frame_size, int64_t *ts)
+{
+    size_t bytes_written = 0;
+
+    portENTER_CRITICAL(&s_ts_lock);
+
+    if (s_tx_pos < s_tx_dma)
+    {
+        s_tx_pos = s_tx_dma;
+    }
+
+    int64_t first_us = s_tx_dma_us + (int64_t)(s_tx_pos - s_tx_dma) * 1000000 / my_std_cfg.clk_cfg.sample_rate_hz;
+    portEXIT_CRITICAL(&s_ts_lock);
+
+    esp_err_t ret = i2s_channel_write(tx_handle, buffer, frame_size, &bytes_written, 1000);
+
+    if (ret != ESP_OK)
+    {
+        i2s_io_error("write", ret);
+    }
+
+    portENTER_CRITICAL(&s_ts_lock);
+    s_tx_pos += bytes_written / s_frame_bytes;
+    portEXIT_CRITICAL(&s_ts_lock);
+
+    if (ts)
+    {
+        *ts = first_us;
+    }
+
     return bytes_written;
 }
 
@@ -135,7 +468,37 @@ size_t i2s_tx_write(uint8_t *buffer, uint32_t frame_size)
  */
 size_t i2s_rx_read(uint8_t *buffer, uint32_t frame_size)
 {
-    size_t bytes_written;
-    ESP_ERROR_CHECK(i2s_channel_read(rx_handle, buffer, frame_size, &bytes_written, 1000));
-    return bytes_written;
+    return i2s_rx_read_ts(buffer, frame_size, NULL);
+}
+
+/**
+ * @brief       I2S读取数据,并给出第一帧采集的时刻
+ * @note        时刻由最近一次DMA收完的时刻和帧数之差换算,接收溢出丢掉的数据已跳过
+ * @param       buffer: 读取数据存储区的首地址
+ * @param       frame_size: 读取数据大小
+ * @param       ts: 第一帧采集的esp_timer时刻(us),可为NULL
+ * @retval      接收的数据长度,出错时为出错前已接收的部分(可能为0)
+ */
+size_t i2s_rx_read_ts(uint8_t *buffer, uint32_t frame_size, int64_t *ts)
+{
+    size_t bytes_read = 0;
+    esp_err_t ret = i2s_channel_read(rx_handle, buffer, frame_size, &bytes_read, 1000);
+
+    if (ret != ESP_OK)
+    {
+        i2s_io_error("read", ret);
+    }
+
+    portENTER_CRITICAL(&s_ts_lock);
+    uint64_t first = s_rx_pos;
+    s_rx_pos += bytes_read / s_frame_bytes;
+    int64_t first_us = s_rx_dma_us - (int64_t)(s_rx_dma - first) * 1000000 / my_std_cfg.clk_cfg.sample_rate_hz;
+    portEXIT_CRITICAL(&s_ts_lock);
+
+    if (ts)
+    {
+        *ts = first_us;
+    }
+
+    return bytes_read;
 }
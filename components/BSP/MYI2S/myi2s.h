@@ -22,17 +22,27 @@
 #define I2S_RECV_BUF_SIZE       (2400)                      /* 接收大小 */
 #define I2S_SAMPLE_RATE         (44100)                     /* 采样率 */
 #define I2S_MCLK_MULTIPLE       (256)                       /* 如果不使用24位数据宽度，256应该足够了 */
+#define I2S_DUPLEX_DMA_DESC     (4)                         /* 双工打开时的DMA缓冲区个数 */
+#define I2S_DUPLEX_DMA_FRAME    (120)                       /* 双工打开时每个DMA缓冲区的帧数,48kHz为2.5ms,往返延迟约为(个数+1)倍 */
+
+/* 打开方向,TX和RX分别引用计数,两个通道共用BCLK和WS */
+#define I2S_DIR_TX              (0x01)                      /* 播放 */
+#define I2S_DIR_RX              (0x02)                      /* 录音 */
+#define I2S_DIR_DUPLEX          (I2S_DIR_TX | I2S_DIR_RX)   /* 同时打开,未打开时使用低延迟的DMA配置 */
 
 extern i2s_chan_handle_t tx_handle;
 extern i2s_chan_handle_t rx_handle;
 
 /* 函数声明 */
-esp_err_t myi2s_init(void);                                         /* I2S初始化 */
-void i2s_trx_start(void);                                           /* 启动I2S */
-void i2s_trx_stop(void);                                            /* 停止I2S */
-void i2s_deinit(void);                                              /* 卸载I2S */
+esp_err_t i2s_open(uint8_t dir);                                    /* 按方向打开I2S,第一次打开时创建并启动两个通道 */
+void i2s_close(uint8_t dir);                                        /* 按方向关闭I2S,两个方向都关闭后卸载 */
+bool i2s_is_open(uint8_t dir);                                      /* 该方向是否已打开 */
+esp_err_t i2s_set_format(uint8_t dir, uint32_t samplerate, i2s_data_bit_width_t bits); /* 设置采样率和位宽 */
 size_t i2s_tx_write(uint8_t *buffer, uint32_t frame_size);          /* I2S传输数据 */
+size_t i2s_tx_write_ts(uint8_t *buffer, uint32_t frame_size, int64_t *ts);  /* 传输数据,给出第一帧播出的时刻 */
+void i2s_tx_watch(bool enable);                                     /* 开启/关闭DMA欠载统计 */
+uint32_t i2s_rx_overflows(void);                                    /* RX DMA接收溢出次数(累计) */
 size_t i2s_rx_read(uint8_t *buffer, uint32_t frame_size);           /* I2S接收数据 */
-void i2s_set_samplerate_bits_sample(int samplerate,int bits_sample);/* 设置采样率和位宽 */
+size_t i2s_rx_read_ts(uint8_t *buffer, uint32_t frame_size, int64_t *ts);   /* 接收数据,给出第一帧采集的时刻 */
 
 #endif
@@ -4,6 +4,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "esp_http_client.h"
 
 #define HTTP_TAG "HTTP"
@@ -11,24 +12,11 @@
 #define MAX_MP3_FILES 10
 #define MAX_FILENAME_LEN 128
 #define HTML_BUF_SIZE 4096
-#define RINGBUF_SIZE (8 * 1024)
-
-typedef enum {
-    HTTP_TASK_TYPE_HTML,
-    HTTP_TASK_TYPE_MP3
-} http_task_type_t;
-
-static uint8_t ringbuf[RINGBUF_SIZE];
-static int write_pos = 0;
-static int read_pos = 0;
-
-static SemaphoreHandle_t data_sem;
-static SemaphoreHandle_t ringbuf_mutex;
 
 static char mp3_filenames[MAX_MP3_FILES][MAX_FILENAME_LEN];
 static int mp3_file_count = 0;
 
-static http_task_type_t current_http_task_type = HTTP_TASK_TYPE_HTML;
+static QueueHandle_t mp3_url_queue = NULL;    // 解析出的 MP3 地址, 由应用任务取出后加入播放
 
 static char html_buf[HTML_BUF_SIZE];
 static int html_buf_offset = 0;
@@ -98,40 +86,35 @@ void parse_mp3_file_list(const char *html, int len)
     }
 }
 
-// MP3 文件下载任务
-void http_download_mp3_task(void *pvParameters)
+// 取出一个 MP3 地址, 在应用任务中调用, 加入播放(可能要初始化音频引擎)不在 HTTP 客户端的回调中进行
+bool http_take_mp3_url(char *url, size_t len, TickType_t wait)
 {
-    for (int i = 0; i < mp3_file_count; i++) {
-        current_http_task_type = HTTP_TASK_TYPE_MP3;
-
-        char full_url[256];
-        snprintf(full_url, sizeof(full_url), "http://192.168.0.25:8000/%.127s", mp3_filenames[i]);
+    char full_url[HTTP_MP3_URL_LEN];
 
+    if (!mp3_url_queue) {
+        vTaskDelay(wait);
+        return false;
+    }
 
-        ESP_LOGI("MP3", "准备下载: %s", full_url);
+    if (xQueueReceive(mp3_url_queue, full_url, wait) != pdTRUE) {
+        return false;
+    }
 
-        esp_http_client_config_t config = {
-            .url = full_url,
-            .event_handler = _http_event_handler,
-            .timeout_ms = 5000,
-        };
+    snprintf(url, len, "%s", full_url);
+    return true;
+}
 
-        esp_http_client_handle_t client = esp_http_client_init(&config);
-        esp_err_t err = esp_http_client_perform(client);
+// 把列表中的 MP3 地址复制到队列, 回调中只做这些, 不等待
+static void http_post_mp3_list(void)
+{
+    for (int i = 0; i < mp3_file_count; i++) {
+        char full_url[HTTP_MP3_URL_LEN];
+        snprintf(full_url, sizeof(full_url), HTTP_MP3_SERVER_URL "%.127s", mp3_filenames[i]);
 
-        if (err == ESP_OK) {
-            int status = esp_http_client_get_status_code(client);
-            int content_length = esp_http_client_get_content_length(client);
-            ESP_LOGI("MP3", "下载完成: Status = %d, length = %d", status, content_length);
-        } else {
-            ESP_LOGE("MP3", "下载失败: %s", esp_err_to_name(err));
+        if (xQueueSend(mp3_url_queue, full_url, 0) != pdTRUE) {
+            ESP_LOGE("MP3", "地址队列已满,忽略: %s", full_url);
         }
-
-        esp_http_client_cleanup(client);
-        vTaskDelay(pdMS_TO_TICKS(200));
     }
-
-    vTaskDelete(NULL);
 }
 
 // HTTP 事件处理
@@ -153,27 +136,18 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt)
             if (!esp_http_client_is_chunked_response(evt->client)) {
                 const uint8_t *data = (const uint8_t *)evt->data;
 
-                if (current_http_task_type == HTTP_TASK_TYPE_HTML) {
-                    if (html_buf_offset + evt->data_len < HTML_BUF_SIZE) {
-                        memcpy(html_buf + html_buf_offset, data, evt->data_len);
-                        html_buf_offset += evt->data_len;
-                    }
-                } else if (current_http_task_type == HTTP_TASK_TYPE_MP3) {
-                    int written = ringbuf_write(data, evt->data_len);
-                    if (written > 0) {
-                        xSemaphoreGive(data_sem);
-                    }
+                if (html_buf_offset + evt->data_len < HTML_BUF_SIZE) {
+                    memcpy(html_buf + html_buf_offset, data, evt->data_len);
+                    html_buf_offset += evt->data_len;
                 }
             }
             break;
 
         case HTTP_EVENT_ON_FINISH:
-            if (current_http_task_type == HTTP_TASK_TYPE_HTML) {
-                html_buf[html_buf_offset] = '\0';
-                parse_mp3_file_list(html_buf, html_buf_offset);
-                html_buf_offset = 0;
-                xTaskCreate(http_download_mp3_task, "http_mp3_task", 8192, NULL, 5, NULL);
-            }
+            html_buf[html_buf_offset] = '\0';
+            parse_mp3_file_list(html_buf, html_buf_offset);
+            html_buf_offset = 0;
+            http_post_mp3_list();
             break;
 
         default:
@@ -185,14 +159,18 @@ esp_err_t _http_event_handler(esp_http_client_event_t *evt)
 // 启动 HTML 获取任务
 void http_get_task(void *pvParameters)
 {
-    data_sem = xSemaphoreCreateBinary();
-    ringbuf_mutex = xSemaphoreCreateMutex();
-
-    current_http_task_type = HTTP_TASK_TYPE_HTML;
     html_buf_offset = 0;
 
+    if (!mp3_url_queue) {
+        mp3_url_queue = xQueueCreate(MAX_MP3_FILES, HTTP_MP3_URL_LEN);
+        if (!mp3_url_queue) {
+            ESP_LOGE(HTTP_TAG, "无法创建地址队列");
+            vTaskDelete(NULL);
+        }
+    }
+
     esp_http_client_config_t config = {
-        .url = "http://192.168.0.25:8000/",
+        .url = HTTP_MP3_SERVER_URL,
         .event_handler = _http_event_handler,
         .user_data = html_buf,
         .timeout_ms = 5000,
@@ -208,58 +186,3 @@ void http_get_task(void *pvParameters)
     esp_http_client_cleanup(client);
     vTaskDelete(NULL);
 }
-
-// 解码任务（仅作为示例）
-void decode_mp3_task(void *pvParameters)
-{
-    uint8_t buffer[256];
-    int len;
-
-    while (1) {
-        if (xSemaphoreTake(data_sem, portMAX_DELAY) == pdTRUE) {
-            while ((len = ringbuf_read(buffer, sizeof(buffer))) > 0) {
-                // 在此处理 buffer 数据，如解码播放等
-            }
-        }
-    }
-}
-
-// 写入环形缓冲区
-static int ringbuf_write(const uint8_t *data, int len)
-{
-    xSemaphoreTake(ringbuf_mutex, portMAX_DELAY);
-
-    int free_space = (write_pos >= read_pos)
-                     ? RINGBUF_SIZE - (write_pos - read_pos) - 1
-                     : (read_pos - write_pos) - 1;
-
-    if (len > free_space) len = free_space;
-
-    for (int i = 0; i < len; i++) {
-        ringbuf[write_pos] = data[i];
-        write_pos = (write_pos + 1) % RINGBUF_SIZE;
-    }
-
-    xSemaphoreGive(ringbuf_mutex);
-    return len;
-}
-
-// 读取环形缓冲区
-static int ringbuf_read(uint8_t *buf, int len)
-{
-    xSemaphoreTake(ringbuf_mutex, portMAX_DELAY);
-
-    int data_len = (write_pos >= read_pos)
-                   ? (write_pos - read_pos)
-                   : (RINGBUF_SIZE - (read_pos - write_pos));
-
-    if (len > data_len) len = data_len;
-
-    for (int i = 0; i < len; i++) {
-        buf[i] = ringbuf[read_pos];
-        read_pos = (read_pos + 1) % RINGBUF_SIZE;
-    }
-
-    xSemaphoreGive(ringbuf_mutex);
-    return len;
-}
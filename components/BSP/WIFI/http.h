@@ -2,21 +2,25 @@
 #define HTTP_H
 
 #include "esp_err.h"
+#include "sdkconfig.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_wifi.h"
 #include "esp_log.h"
+#include <stdbool.h>
 #include <string.h>
 #include "esp_netif_ip_addr.h"  // 提供 esp_ip4addr_ntoa()
 #include "esp_http_client.h"
 
 
-void http_get_task(void *pvParameters);
-void decode_mp3_task(void *pvParameters);
+/* MP3 文件服务器,PC 上在音乐目录执行 "python3 -m http.server 8000" 即可;
+ * 地址在 menuconfig 的 "BSP WiFi" 中设置(CONFIG_BSP_HTTP_MP3_SERVER_URL),默认值只是示例,需要改成 PC 的地址 */
+#define HTTP_MP3_SERVER_URL CONFIG_BSP_HTTP_MP3_SERVER_URL
 
+#define HTTP_MP3_URL_LEN    256     /* 队列中每个 MP3 地址的最大长度 */
 
-static int ringbuf_write(const uint8_t *data, int len);
-static int ringbuf_read(uint8_t *buf, int len);
+void http_get_task(void *pvParameters);
+bool http_take_mp3_url(char *url, size_t len, TickType_t wait);    /* 取出服务器列表中的 MP3 地址,应用任务中调用 */
 
 
 #endif
\ No newline at end of file
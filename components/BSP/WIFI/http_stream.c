@@ -0,0 +1,480 @@
+/**
+ ****************************************************************************************************
+ * @file        http_stream.c
+ * @brief       HTTP拉流数据源
+ * @note        下载任务通过spsc_ring的reserve/commit把socket数据直接收进抖动缓冲区,
+ *              读者按绝对偏移读取,数据通路不需要加锁.读者只释放比读位置早
+ *              HTTP_STREAM_HISTORY以上的数据,格式探测时的向回seek可以直接命中;
+ *              向前seek则跳过尚未读取的数据,由下载任务继续追赶
+ ****************************************************************************************************
+ */
+
+#include "http_stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_http_client.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "spsc_ring.h"
+
+static const char *TAG = "http_stream";
+
+static BaseType_t s_task_core = tskNO_AFFINITY;                 /* 下载任务所在核心 */
+static UBaseType_t s_task_prio = HTTP_STREAM_TASK_PRIO;         /* 下载任务优先级 */
+
+struct http_stream
+{
+    char *url;
+    spsc_ring_t ring;               /* 抖动缓冲区,读索引即base */
+    uint32_t base;                  /* 缓冲区中最早数据的绝对偏移(仅读者修改) */
+    uint32_t pos;                   /* 读位置(绝对偏移,仅读者修改) */
+    bool started;                   /* 已完成首次预缓冲 */
+    uint32_t underruns;             /* 欠载次数 */
+    atomic_bool eof;                /* 下载结束,failed在此之前写入 */
+    bool failed;                    /* 下载出错 */
+    volatile bool abort;            /* 请求停止下载 */
+    TickType_t open_tick;           /* 打开时刻 */
+    uint32_t first_data_ms;         /* 收到第一个数据块的时间 */
+    int64_t length;                 /* 文件总长度,未知时为-1,由lock保护 */
+    SemaphoreHandle_t lock;         /* 保护length */
+    SemaphoreHandle_t data_sem;     /* 有新数据或下载结束 */
+    SemaphoreHandle_t space_sem;    /* 读者释放了空间 */
+    SemaphoreHandle_t exit_sem;     /* 下载任务已退出 */
+};
+
+/**
+ * @brief       释放数据源占用的资源
+ */
+static void http_stream_free(http_stream_t *s)
+{
+    if (s->lock) vSemaphoreDelete(s->lock);
+    if (s->data_sem) vSemaphoreDelete(s->data_sem);
+    if (s->space_sem) vSemaphoreDelete(s->space_sem);
+    if (s->exit_sem) vSemaphoreDelete(s->exit_sem);
+    spsc_ring_delete(&s->ring);
+    free(s->url);
+    free(s);
+}
+
+/**
+ * @brief       从socket读取数据写入抖动缓冲区,直到下载完成或被终止
+ * @retval      true:完整下载; false:出错或被终止
+ */
+static bool http_stream_download(http_stream_t *s, esp_http_client_handle_t client)
+{
+    bool first = true;
+
+    while (!s->abort)
+    {
+        uint32_t chunk = HTTP_STREAM_CHUNK;
+        char *dst = spsc_ring_reserve(&s->ring, &chunk);
+
+        if (chunk == 0)
+        {
+            xSemaphoreTake(s->space_sem, pdMS_TO_TICKS(100));   /* 缓冲区已满,等待读者消费 */
+            continue;
+        }
+
+        int len = esp_http_client_read(client, dst, chunk);
+        if (len < 0)
+        {
+            ESP_LOGE(TAG, "read failed: %d", len);
+            return false;
+        }
+
+        if (len == 0)
+        {
+            return (http_stream_size(s) < 0) || esp_http_client_is_complete_data_received(client);
+        }
+
+        if (first)
+        {
+            s->first_data_ms = pdTICKS_TO_MS(xTaskGetTickCount() - s->open_tick);
+            first = false;
+        }
+
+        spsc_ring_commit(&s->ring, len);
+        xSemaphoreGive(s->data_sem);
+    }
+
+    return false;
+}
+
+/**
+ * @brief       下载任务
+ */
+static void http_stream_task(void *pvParameters)
+{
+    http_stream_t *s = (http_stream_t *)pvParameters;
+    bool ok = false;
+
+    esp_http_client_config_t config = {
+        .url = s->url,
+        .timeout_ms = 5000,
+        .buffer_size = 2048,
+    };
+
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+
+    if (client && esp_http_client_open(client, 0) == ESP_OK)
+    {
+        int64_t content_length = esp_http_client_fetch_headers(client);
+        int status = esp_http_client_get_status_code(client);
+
+        if (content_length >= 0 && status == 200)
+        {
+            xSemaphoreTake(s->lock, portMAX_DELAY);
+            s->length = (content_length > 0 && !esp_http_client_is_chunked_response(client)) ? content_length : -1;
+            xSemaphoreGive(s->lock);
+
+            ok = http_stream_download(s, client);
+        }
+        else
+        {
+            ESP_LOGE(TAG, "%s: status %d", s->url, status);
+        }
+    }
+    else
+    {
+        ESP_LOGE(TAG, "%s: connect failed", s->url);
+    }
+
+    if (client)
+    {
+        esp_http_client_close(client);
+        esp_http_client_cleanup(client);
+    }
+
+    s->failed = !ok && !s->abort;
+    atomic_store_explicit(&s->eof, true, memory_order_release);
+
+    xSemaphoreGive(s->data_sem);
+    xSemaphoreGive(s->exit_sem);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief       设置之后打开的数据源的下载任务所在核心和优先级
+ * @note        下载任务应和WiFi/LwIP在同一核心,不与解码任务争抢CPU
+ * @param       core : 核心,tskNO_AFFINITY表示不绑定
+ * @param       prio : 优先级
+ * @retval      无
+ */
+void http_stream_set_task(BaseType_t core, UBaseType_t prio)
+{
+    s_task_core = core;
+    s_task_prio = prio;
+}
+
+/**
+ * @brief       打开URL,在后台开始下载
+ * @note        立即返回,首次读取时等待预缓冲
+ * @param       url : 文件地址,如"http://192.168.0.25:8000/a.mp3"
+ * @retval      数据源句柄; NULL:失败
+ */
+http_stream_t *http_stream_open(const char *url)
+{
+    http_stream_t *s = calloc(1, sizeof(http_stream_t));
+    if (!s)
+    {
+        return NULL;
+    }
+
+    if (spsc_ring_create(&s->ring, HTTP_STREAM_BUF_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) != ESP_OK &&
+        spsc_ring_create(&s->ring, HTTP_STREAM_BUF_SIZE, MALLOC_CAP_8BIT) != ESP_OK)
+    {
+        free(s);
+        return NULL;
+    }
+
+    atomic_init(&s->eof, false);
+    s->url = strdup(url);
+    s->length = -1;
+    s->lock = xSemaphoreCreateMutex();
+    s->data_sem = xSemaphoreCreateBinary();
+    s->space_sem = xSemaphoreCreateBinary();
+    s->exit_sem = xSemaphoreCreateBinary();
+
+    if (!s->url || !s->lock || !s->data_sem || !s->space_sem || !s->exit_sem)
+    {
+        ESP_LOGE(TAG, "no memory for stream");
+        http_stream_free(s);
+        return NULL;
+    }
+
+    s->open_tick = xTaskGetTickCount();
+
+    if (xTaskCreatePinnedToCore(http_stream_task, "http_stream", HTTP_STREAM_TASK_STACK, s, s_task_prio, NULL, s_task_core) != pdPASS)
+    {
+        http_stream_free(s);
+        return NULL;
+    }
+
+    return s;
+}
+
+/**
+ * @brief       已下载数据的绝对偏移(仅读者调用)
+ */
+static uint32_t http_stream_head(http_stream_t *s)
+{
+    return s->base + spsc_ring_used(&s->ring);
+}
+
+/**
+ * @brief       释放比读位置早HTTP_STREAM_HISTORY以上的数据,让下载任务继续写入(仅读者调用)
+ */
+static void http_stream_trim(http_stream_t *s)
+{
+    uint32_t head = http_stream_head(s);
+    uint32_t keep = (s->pos > HTTP_STREAM_HISTORY) ? s->pos - HTTP_STREAM_HISTORY : 0;
+
+    if (keep > head) keep = head;       /* 向前seek超过已下载的位置 */
+
+    if (keep > s->base)
+    {
+        spsc_ring_release(&s->ring, keep - s->base);
+        s->base = keep;
+        xSemaphoreGive(s->space_sem);
+    }
+}
+
+/**
+ * @brief       读取数据
+ * @note        首次读取等待HTTP_STREAM_PREFILL字节(最长HTTP_STREAM_START_MS);
+ *              缓冲区读空后等待重新缓冲HTTP_STREAM_REBUFFER字节,避免断断续续地播放
+ * @param       stream : 数据源句柄
+ * @param       buf    : 数据缓冲区
+ * @param       len    : 最大读取长度
+ * @retval      读取的字节数; 0:已读完; -1:下载出错或长时间无数据
+ */
+int http_stream_read(http_stream_t *stream, void *buf, size_t len)
+{
+    http_stream_t *s = stream;
+    int64_t need = 1;
+    bool prefill = false;
+    bool eof = atomic_load_explicit(&s->eof, memory_order_acquire);
+
+    if (!s->started)
+    {
+        prefill = true;
+        need = HTTP_STREAM_PREFILL;
+        s->started = true;
+    }
+    else if ((int64_t)http_stream_head(s) - s->pos <= 0 && !eof)
+    {
+        s->underruns++;
+        need = HTTP_STREAM_REBUFFER;
+        ESP_LOGW(TAG, "underrun #%lu, rebuffering", s->underruns);
+    }
+
+    TickType_t progress = xTaskGetTickCount();
+    uint32_t seen = http_stream_head(s);
+
+    while (!eof && (int64_t)http_stream_head(s) - s->pos < need)
+    {
+        TickType_t now = xTaskGetTickCount();
+        uint32_t head = http_stream_head(s);
+
+        if (prefill && (int64_t)head - s->pos > 0 && now - s->open_tick >= pdMS_TO_TICKS(HTTP_STREAM_START_MS))
+        {
+            break;                  /* 起播时间优先,有数据即开始 */
+        }
+
+        if (head != seen)
+        {
+            seen = head;
+            progress = now;
+        }
+        else if (now - progress >= pdMS_TO_TICKS(HTTP_STREAM_STALL_MS))
+        {
+            ESP_LOGE(TAG, "stream stalled");
+            return -1;
+        }
+
+        http_stream_trim(s);        /* 向前seek后要腾出空间,下载才能追上 */
+        xSemaphoreTake(s->data_sem, pdMS_TO_TICKS(50));
+        eof = atomic_load_explicit(&s->eof, memory_order_acquire);
+    }
+
+    int64_t avail = (int64_t)http_stream_head(s) - s->pos;
+    if (avail <= 0)
+    {
+        return s->failed ? -1 : 0;
+    }
+
+    /* 数据区内的连续块直接拷贝,回绕时分两段 */
+    size_t n = (len < avail) ? len : (size_t)avail;
+    size_t done = 0;
+
+    while (done < n)
+    {
+        uint32_t chunk = n - done;
+        const uint8_t *src = spsc_ring_peek(&s->ring, s->pos + done - s->base, &chunk);
+        memcpy((uint8_t *)buf + done, src, chunk);
+        done += chunk;
+    }
+
+    s->pos += n;
+    http_stream_trim(s);
+
+    return n;
+}
+
+/**
+ * @brief       定位读位置
+ * @note        可以向前跳转到任意位置;向回只能跳转到仍在缓冲区中的数据.
+ *              跳转时不释放数据,格式探测用SEEK_END取得长度后还能跳回开头,下次读取时再释放
+ * @param       stream : 数据源句柄
+ * @param       offset : 偏移,返回新的读位置
+ * @param       whence : SEEK_SET/SEEK_CUR/SEEK_END
+ * @retval      0:成功; -1:失败
+ */
+int http_stream_seek(http_stream_t *stream, int64_t *offset, int whence)
+{
+    http_stream_t *s = stream;
+    int64_t target;
+
+    switch (whence)
+    {
+        case SEEK_SET:
+            target = *offset;
+            break;
+
+        case SEEK_CUR:
+            target = s->pos + *offset;
+            break;
+
+        case SEEK_END:
+            target = http_stream_size(s);
+            target = (target >= 0) ? target + *offset : -1;
+            break;
+
+        default:
+            target = -1;
+            break;
+    }
+
+    if (target < s->base || target > UINT32_MAX)
+    {
+        return -1;
+    }
+
+    s->pos = target;
+    *offset = target;
+
+    return 0;
+}
+
+/**
+ * @brief       获取文件总长度
+ * @param       stream : 数据源句柄
+ * @retval      字节数; -1:未知(分块传输或尚未收到响应头)
+ */
+int64_t http_stream_size(http_stream_t *stream)
+{
+    xSemaphoreTake(stream->lock, portMAX_DELAY);
+    int64_t length = stream->length;
+    xSemaphoreGive(stream->lock);
+
+    return length;
+}
+
+/**
+ * @brief       获取下载统计信息
+ * @param       stream : 数据源句柄
+ * @param       stats  : 统计信息
+ * @retval      无
+ */
+void http_stream_get_stats(http_stream_t *stream, http_stream_stats_t *stats)
+{
+    stats->length = http_stream_size(stream);
+    stats->downloaded = http_stream_head(stream);
+    stats->first_data_ms = stream->first_data_ms;
+    stats->underruns = stream->underruns;
+}
+
+/**
+ * @brief       停止下载并释放资源
+ * @note        最长等待一个socket超时时间
+ * @param       stream : 数据源句柄
+ * @retval      无
+ */
+void http_stream_close(http_stream_t *stream)
+{
+    if (!stream)
+    {
+        return;
+    }
+
+    stream->abort = true;
+    xSemaphoreGive(stream->space_sem);
+    xSemaphoreTake(stream->exit_sem, portMAX_DELAY);
+
+    http_stream_free(stream);
+}
+
+/**
+ * @brief       下载测试,可配合PC上的"python3 -m http.server 8000"使用
+ * @note        检查向回seek,并打印起播延时、吞吐量和欠载次数
+ * @param       url : 文件地址
+ * @retval      ESP_OK:成功; ESP_FAIL:失败
+ */
+esp_err_t http_stream_test(const char *url)
+{
+    uint8_t head[64];
+    uint8_t again[64];
+    http_stream_stats_t stats;
+    esp_err_t ret = ESP_OK;
+
+    uint8_t *buf = malloc(HTTP_STREAM_CHUNK);
+    http_stream_t *s = http_stream_open(url);
+    if (!buf || !s)
+    {
+        free(buf);
+        http_stream_close(s);
+        return ESP_FAIL;
+    }
+
+    TickType_t start = xTaskGetTickCount();
+    int len = http_stream_read(s, head, sizeof(head));
+    uint32_t start_ms = pdTICKS_TO_MS(xTaskGetTickCount() - start);
+    int64_t total = (len > 0) ? len : 0;
+    int64_t zero = 0;
+
+    /* 格式探测会读取文件头后回到开头 */
+    if (len > 0 && (http_stream_seek(s, &zero, SEEK_SET) != 0 ||
+                    http_stream_read(s, again, len) != len || memcmp(head, again, len) != 0))
+    {
+        ESP_LOGE(TAG, "seek back failed");
+        ret = ESP_FAIL;
+    }
+
+    while ((len = http_stream_read(s, buf, HTTP_STREAM_CHUNK)) > 0)
+    {
+        total += len;
+    }
+
+    uint32_t elapsed_ms = pdTICKS_TO_MS(xTaskGetTickCount() - start);
+    http_stream_get_stats(s, &stats);
+    http_stream_close(s);
+    free(buf);
+
+    if (len < 0 || (stats.length >= 0 && total != stats.length))
+    {
+        ret = ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "%s: %lld/%lld bytes, first data %lu ms, first read %lu ms, %lu KB/s, %lu underruns, %s",
+             url, (long long)total, (long long)stats.length, stats.first_data_ms, start_ms,
+             (uint32_t)(total / (elapsed_ms ? elapsed_ms : 1)), stats.underruns,
+             (ret == ESP_OK) ? "OK" : "FAIL");
+
+    return ret;
+}
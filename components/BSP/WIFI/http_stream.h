@@ -0,0 +1,47 @@
+/**
+ ****************************************************************************************************
+ * @file        http_stream.h
+ * @brief       HTTP拉流数据源:后台任务边下载边写入抖动缓冲区,播放器按需读取
+ ****************************************************************************************************
+ */
+
+#ifndef HTTP_STREAM_H
+#define HTTP_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#define HTTP_STREAM_BUF_SIZE        (128 * 1024)    /* 抖动缓冲区大小(优先放在PSRAM) */
+#define HTTP_STREAM_HISTORY         (4 * 1024)      /* 保留已读数据,允许格式探测时向回seek */
+#define HTTP_STREAM_CHUNK           (4 * 1024)      /* 每次从socket读取的最大字节数 */
+#define HTTP_STREAM_PREFILL         (8 * 1024)      /* 首次读取前的预缓冲量,决定起播延时 */
+#define HTTP_STREAM_REBUFFER        (32 * 1024)     /* 欠载后恢复播放前需要重新缓冲的数据量 */
+#define HTTP_STREAM_START_MS        400             /* 预缓冲最长等待时间,保证500ms内起播 */
+#define HTTP_STREAM_STALL_MS        10000           /* 持续无数据超过该时间视为连接中断 */
+#define HTTP_STREAM_TASK_PRIO       6               /* 下载任务默认优先级,高于播放器任务 */
+#define HTTP_STREAM_TASK_STACK      4096            /* 下载任务堆栈大小 */
+
+typedef struct http_stream http_stream_t;
+
+/* 下载统计信息 */
+typedef struct
+{
+    int64_t length;             /* Content-Length,未知时为-1 */
+    int64_t downloaded;         /* 已下载字节数 */
+    uint32_t first_data_ms;     /* 从打开到收到第一个数据块的时间 */
+    uint32_t underruns;         /* 读取时缓冲区为空的次数 */
+} http_stream_stats_t;
+
+/* 函数声明 */
+void http_stream_set_task(BaseType_t core, UBaseType_t prio);           /* 设置下载任务的核心和优先级 */
+http_stream_t *http_stream_open(const char *url);                       /* 打开URL,后台开始下载 */
+int http_stream_read(http_stream_t *stream, void *buf, size_t len);     /* 读取数据,缓冲区为空时阻塞 */
+int http_stream_seek(http_stream_t *stream, int64_t *offset, int whence);/* 在已缓冲范围内定位 */
+int64_t http_stream_size(http_stream_t *stream);                        /* 获取文件总长度 */
+void http_stream_get_stats(http_stream_t *stream, http_stream_stats_t *stats);  /* 获取下载统计信息 */
+void http_stream_close(http_stream_t *stream);                          /* 停止下载并释放资源 */
+esp_err_t http_stream_test(const char *url);                            /* 下载测试:起播延时、吞吐量、欠载次数 */
+
+#endif
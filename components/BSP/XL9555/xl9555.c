@@ -8,6 +8,8 @@
 
 const char *xl9555_tag = "xl9555";
 i2c_master_dev_handle_t xl9555_handle = NULL;
+static uint16_t s_out_cache;            /* 输出寄存器的值 */
+static bool s_out_valid = false;        /* s_out_cache与芯片一致 */
 
 /**
  * @brief       读取XL9555的IO值
@@ -52,6 +54,7 @@ esp_err_t xl9555_write_byte(uint8_t reg, uint8_t *data, size_t len)
 
 /**
  * @brief       控制某个IO的电平
+ * @note        输出寄存器的值缓存在本地,只在第一次读取;电平不变时不访问I2C
  * @param       pin     : 控制的IO
  * @param       val     : 电平
  * @retval      返回所有IO状态
@@ -59,36 +62,28 @@ esp_err_t xl9555_write_byte(uint8_t reg, uint8_t *data, size_t len)
 uint16_t xl9555_pin_write(uint16_t pin, int val)
 {
     uint8_t w_data[2];
-    uint16_t temp = 0x0000;
 
-    xl9555_read_byte(w_data, 2);
-
-    if (pin <= 0x0080)
+    if (!s_out_valid)
     {
-        if (val)
-        {
-            w_data[0] |= (uint8_t)(0xFF & pin);
-        }
-        else
-        {
-            w_data[0] &= ~(uint8_t)(0xFF & pin);
-        }
+        xl9555_read_byte(w_data, 2);        /* 第一次从IO电平得到输出值 */
+        s_out_cache = ((uint16_t)w_data[1] << 8) | w_data[0];
     }
-    else
+
+    uint16_t temp = val ? (s_out_cache | pin) : (s_out_cache & ~pin);
+
+    if (s_out_valid && temp == s_out_cache)
     {
-        if (val)
-        {
-            w_data[1] |= (uint8_t)(0xFF & (pin >> 8));
-        }
-        else
-        {
-            w_data[1] &= ~(uint8_t)(0xFF & (pin >> 8));
-        }
+        return temp;
     }
 
-    temp = ((uint16_t)w_data[1] << 8) | w_data[0];
+    w_data[0] = (uint8_t)(0xFF & temp);
+    w_data[1] = (uint8_t)(0xFF & (temp >> 8));
 
-    xl9555_write_byte(XL9555_OUTPUT_PORT0_REG, w_data, 2);
+    if (xl9555_write_byte(XL9555_OUTPUT_PORT0_REG, w_data, 2) == ESP_OK)
+    {
+        s_out_cache = temp;
+        s_out_valid = true;
+    }
 
     return temp;
 }
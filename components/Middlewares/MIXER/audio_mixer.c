@@ -0,0 +1,899 @@
+/**
+ ****************************************************************************************************
+ * @file        audio_mixer.c
+ * @brief       多输入软件混音器
+ ****************************************************************************************************
+ */
+
+#include "audio_mixer.h"
+#include <stdlib.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "spsc_ring.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_check.h"
+
+static const char *TAG = "audio_mixer";
+
+#if CONFIG_IDF_TARGET_ESP32S3
+#define MIXER_PIE           1                       /* 使用ESP32-S3的PIE SIMD指令 */
+#else
+#define MIXER_PIE           0
+#endif
+
+#define MIXER_FRAME_BYTES   4                       /* 16位立体声一帧的字节数 */
+#define MIXER_BLOCK_BYTES   (AUDIO_MIXER_BLOCK_FRAMES * MIXER_FRAME_BYTES)
+#define MIXER_CONV_FRAMES   128                     /* 格式转换时每次处理的帧数 */
+#define MIXER_RATE_DRAIN_MS 500                     /* 修改采样率前最多等待输入播完的时间 */
+#define MIXER_TASK_STACK    3072                    /* 混音任务栈大小 */
+
+#define MIXER_RATE_BIT      (1 << AUDIO_MIXER_INPUT_MAX)        /* 新采样率已生效 */
+#define MIXER_EXIT_BIT      (1 << (AUDIO_MIXER_INPUT_MAX + 1))  /* 混音任务已退出 */
+#define MIXER_INPUT_BITS    ((1 << AUDIO_MIXER_INPUT_MAX) - 1)  /* 各输入缓冲区有空闲空间 */
+
+struct audio_mixer_input
+{
+    bool used;                          /* 输入槽已分配 */
+    uint8_t index;                      /* 输入槽序号,即事件组中的位 */
+    uint8_t priority;                   /* 优先级 */
+    uint8_t bits;                       /* 写入数据的位宽 */
+    uint8_t channels;                   /* 写入数据的声道数 */
+    uint32_t rate;                      /* 写入数据的采样率,0:与输出相同 */
+    resampler_t *rs;                    /* 重采样器,采样率与输出相同时为NULL */
+    int16_t *rs_buf;                    /* 重采样输出 */
+    size_t rs_cap;                      /* rs_buf的帧数 */
+    const char *name;                   /* 名称 */
+    spsc_ring_t ring;                   /* 16位立体声PCM */
+    volatile uint16_t gain;             /* 设置的增益 */
+    uint16_t cur_gain;                  /* 当前增益,只由混音任务修改 */
+    volatile bool flush;                /* 请求丢弃缓冲的数据 */
+    volatile bool draining;             /* 生产者已写完,最后不满一块的数据不算欠载 */
+    bool active;                        /* 本块有数据 */
+    uint32_t hold;                      /* 没有数据后继续压低其他输入的剩余块数 */
+};
+
+static bool s_running = false;                                          /* 混音器是否已初始化 */
+static audio_mixer_config_t s_config;                                   /* 配置 */
+static audio_mixer_input_t s_inputs[AUDIO_MIXER_INPUT_MAX];             /* 输入 */
+static SemaphoreHandle_t s_lock;                                        /* 保护输入的添加/删除 */
+static EventGroupHandle_t s_events;                                     /* 混音器事件组 */
+static TaskHandle_t s_task;                                             /* 混音任务 */
+static volatile bool s_exit;                                            /* 请求混音任务退出 */
+static volatile uint32_t s_rate;                                        /* 输出采样率 */
+static volatile uint32_t s_new_rate;                                    /* 待生效的采样率,0:无 */
+static uint32_t s_rate_wait;                                            /* 等待输入播完的块数 */
+static uint32_t s_ramp_step;                                            /* 每块增益的最大变化量 */
+static uint32_t s_hold_blocks;                                          /* AUDIO_MIXER_DUCK_HOLD_MS对应的块数 */
+static uint32_t s_idle_blocks;                                          /* AUDIO_MIXER_IDLE_MS对应的块数 */
+static audio_mixer_stats_t s_stats;                                     /* 统计信息 */
+
+static int16_t s_mix[AUDIO_MIXER_BLOCK_FRAMES * 2] __attribute__((aligned(AUDIO_MIXER_ALIGN)));    /* 混音结果 */
+static int16_t s_in[AUDIO_MIXER_BLOCK_FRAMES * 2] __attribute__((aligned(AUDIO_MIXER_ALIGN)));     /* 输入数据 */
+
+/**
+ * @brief       饱和到16位
+ */
+static inline int16_t mixer_sat16(int32_t v)
+{
+    return (v > INT16_MAX) ? INT16_MAX : (v < INT16_MIN) ? INT16_MIN : v;
+}
+
+/**
+ * @brief       固定增益混音,C参考实现
+ * @param       acc     : 混音结果,acc[n] = sat16(acc[n] + (in[n] * gain >> 15))
+ * @param       in      : 输入
+ * @param       samples : 采样点数
+ * @param       gain    : 增益,Q15格式,不大于AUDIO_MIXER_GAIN_UNITY
+ * @retval      无
+ */
+void audio_mixer_mix_s16_ref(int16_t *acc, const int16_t *in, size_t samples, uint16_t gain)
+{
+    for (size_t n = 0; n < samples; n++)
+    {
+        acc[n] = mixer_sat16(acc[n] + (((int32_t)in[n] * gain) >> 15));
+    }
+}
+
+/**
+ * @brief       固定增益混音
+ * @note        acc和in都按AUDIO_MIXER_ALIGN对齐时,每条指令处理8个采样点:
+ *              EE.VMUL.S16按SAR右移15位实现Q15乘法,EE.VADDS.S16饱和相加;
+ *              单位增益时省去乘法.不对齐的缓冲区和剩余的采样点使用参考实现,结果完全一致
+ * @param       参数同audio_mixer_mix_s16_ref
+ * @retval      无
+ */
+void audio_mixer_mix_s16(int16_t *acc, const int16_t *in, size_t samples, uint16_t gain)
+{
+    size_t done = 0;
+
+    if (gain == 0)
+    {
+        return;
+    }
+
+#if MIXER_PIE
+    if ((((uintptr_t)acc | (uintptr_t)in) & (AUDIO_MIXER_ALIGN - 1)) == 0)
+    {
+        const int16_t *src = in;
+        const int16_t *ld = acc;
+        int16_t *st = acc;
+        size_t blocks = samples / 8;
+
+        if (gain == AUDIO_MIXER_GAIN_UNITY)
+        {
+            for (size_t b = 0; b < blocks; b++)
+            {
+                __asm__ volatile(
+                    "ee.vld.128.ip  q0, %0, 16  \n"
+                    "ee.vld.128.ip  q1, %1, 16  \n"
+                    "ee.vadds.s16   q0, q0, q1  \n"
+                    "ee.vst.128.ip  q0, %2, 16  \n"
+                    : "+r"(ld), "+r"(src), "+r"(st) :: "memory");
+            }
+        }
+        else
+        {
+            int16_t g = (int16_t)gain;
+
+            for (size_t b = 0; b < blocks; b++)
+            {
+                /* SAR也被编译器用于移位运算,每次都重新设置 */
+                __asm__ volatile(
+                    "wsr.sar        %3          \n"
+                    "ee.vldbc.16    q2, %4      \n"
+                    "ee.vld.128.ip  q0, %0, 16  \n"
+                    "ee.vld.128.ip  q1, %1, 16  \n"
+                    "ee.vmul.s16    q1, q1, q2  \n"
+                    "ee.vadds.s16   q0, q0, q1  \n"
+                    "ee.vst.128.ip  q0, %2, 16  \n"
+                    : "+r"(ld), "+r"(src), "+r"(st) : "r"(15), "r"(&g) : "memory");
+            }
+        }
+
+        done = blocks * 8;
+    }
+#endif
+
+    audio_mixer_mix_s16_ref(acc + done, in + done, samples - done, gain);
+}
+
+/**
+ * @brief       渐变增益混音
+ * @note        增益从gain_start逐帧线性变化到gain_end,左右声道使用相同的增益
+ * @param       acc        : 混音结果
+ * @param       in         : 16位立体声输入
+ * @param       frames     : 帧数
+ * @param       gain_start : 起始增益,Q15格式
+ * @param       gain_end   : 结束增益,Q15格式
+ * @retval      无
+ */
+void audio_mixer_mix_ramp_s16(int16_t *acc, const int16_t *in, size_t frames,
+                              uint16_t gain_start, uint16_t gain_end)
+{
+    if (frames == 0)
+    {
+        return;
+    }
+
+    int32_t gain = (int32_t)gain_start << 8;                            /* Q15再左移8位,减小步进的舍入误差 */
+    int32_t step = (((int32_t)gain_end - gain_start) << 8) / (int32_t)frames;
+
+    for (size_t n = 0; n < frames; n++)
+    {
+        int32_t g = gain >> 8;
+
+        acc[2 * n] = mixer_sat16(acc[2 * n] + (((int32_t)in[2 * n] * g) >> 15));
+        acc[2 * n + 1] = mixer_sat16(acc[2 * n + 1] + (((int32_t)in[2 * n + 1] * g) >> 15));
+        gain += step;
+    }
+}
+
+/**
+ * @brief       根据采样率计算渐变、压低保持和空闲的块数
+ */
+static void mixer_update_timing(void)
+{
+    uint32_t block_ms_x1000 = AUDIO_MIXER_BLOCK_FRAMES * 1000;         /* 一块的时长 * 采样率 */
+    uint32_t ramp_blocks = (uint32_t)s_config.ramp_ms * s_rate / block_ms_x1000;
+
+    s_ramp_step = AUDIO_MIXER_GAIN_UNITY / (ramp_blocks ? ramp_blocks : 1);
+    s_hold_blocks = AUDIO_MIXER_DUCK_HOLD_MS * s_rate / block_ms_x1000 + 1;
+    s_idle_blocks = AUDIO_MIXER_IDLE_MS * s_rate / block_ms_x1000 + 1;
+}
+
+/**
+ * @brief       计算输入的目标增益
+ * @note        有更高优先级的输入在播放(或刚播完)时,在设置的增益上再乘以duck_gain
+ */
+static uint16_t mixer_target_gain(const audio_mixer_input_t *input)
+{
+    uint32_t gain = input->gain;
+
+    for (int i = 0; i < AUDIO_MIXER_INPUT_MAX; i++)
+    {
+        const audio_mixer_input_t *other = &s_inputs[i];
+
+        if (other->used && other->priority > input->priority && (other->active || other->hold))
+        {
+            gain = gain * s_config.duck_gain >> 15;
+            break;
+        }
+    }
+
+    return gain;
+}
+
+/**
+ * @brief       增益向目标值变化一步
+ */
+static uint16_t mixer_ramp_gain(uint16_t cur, uint16_t target)
+{
+    if (cur < target)
+    {
+        return (target - cur > s_ramp_step) ? cur + s_ramp_step : target;
+    }
+
+    return (cur - target > s_ramp_step) ? cur - s_ramp_step : target;
+}
+
+/**
+ * @brief       混合一块数据到s_mix
+ * @note        调用者需持有s_lock
+ * @retval      true:有输入数据; false:输出为静音
+ */
+static bool mixer_mix_block(void)
+{
+    bool busy = false;
+
+    memset(s_mix, 0, sizeof(s_mix));
+
+    /* 先确定各输入本块是否有数据,压低判断需要用到 */
+    for (int i = 0; i < AUDIO_MIXER_INPUT_MAX; i++)
+    {
+        audio_mixer_input_t *input = &s_inputs[i];
+
+        if (!input->used)
+        {
+            continue;
+        }
+
+        if (input->flush)
+        {
+            input->flush = false;
+            spsc_ring_release(&input->ring, spsc_ring_used(&input->ring));
+            input->active = false;      /* 主动丢弃,不算欠载 */
+            xEventGroupSetBits(s_events, 1 << input->index);
+        }
+
+        uint32_t used = spsc_ring_used(&input->ring);
+
+        if (input->active && used < MIXER_BLOCK_BYTES && !input->draining)
+        {
+            s_stats.underruns++;
+        }
+
+        input->active = used != 0;
+        input->hold = input->active ? s_hold_blocks : (input->hold ? input->hold - 1 : 0);
+    }
+
+    for (int i = 0; i < AUDIO_MIXER_INPUT_MAX; i++)
+    {
+        audio_mixer_input_t *input = &s_inputs[i];
+
+        if (!input->used)
+        {
+            continue;
+        }
+
+        uint16_t target = mixer_target_gain(input);
+
+        if (!input->active)
+        {
+            input->cur_gain = target;   /* 没有声音时直接跳到目标增益 */
+            continue;
+        }
+
+        uint16_t gain_start = input->cur_gain;
+        uint16_t gain_end = mixer_ramp_gain(gain_start, target);
+        uint32_t frames = spsc_ring_read(&input->ring, s_in, MIXER_BLOCK_BYTES) / MIXER_FRAME_BYTES;
+
+        input->cur_gain = gain_end;
+        xEventGroupSetBits(s_events, 1 << input->index);
+
+        if (gain_start == gain_end)
+        {
+            audio_mixer_mix_s16(s_mix, s_in, frames * 2, gain_end);
+        }
+        else
+        {
+            audio_mixer_mix_ramp_s16(s_mix, s_in, frames, gain_start, gain_end);
+        }
+
+        busy = true;
+    }
+
+    return busy;
+}
+
+/**
+ * @brief       应用新的采样率
+ * @note        等各输入中旧采样率的数据播完(最多MIXER_RATE_DRAIN_MS)后再修改输出
+ */
+static void mixer_apply_rate(void)
+{
+    uint32_t rate = s_new_rate;
+
+    if (!rate)
+    {
+        return;
+    }
+
+    bool drained = true;
+
+    for (int i = 0; i < AUDIO_MIXER_INPUT_MAX; i++)
+    {
+        if (s_inputs[i].used && spsc_ring_used(&s_inputs[i].ring))
+        {
+            drained = false;
+        }
+    }
+
+    if (!drained && ++s_rate_wait * AUDIO_MIXER_BLOCK_FRAMES * 1000 < MIXER_RATE_DRAIN_MS * s_rate)
+    {
+        return;
+    }
+
+    if (s_config.rate_fn && s_config.rate_fn(rate) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to set output rate %lu", rate);
+    }
+
+    s_rate = rate;
+    s_new_rate = 0;
+    s_rate_wait = 0;
+    mixer_update_timing();
+    xEventGroupSetBits(s_events, MIXER_RATE_BIT);
+}
+
+/**
+ * @brief       混音任务
+ * @note        输出阻塞写入决定了混音节奏;所有输入没有数据AUDIO_MIXER_IDLE_MS后停止输出,
+ *              等待写入数据的通知
+ */
+static void mixer_task(void *arg)
+{
+    bool active = false;
+    uint32_t silent = 0;
+    uint32_t period_blocks = 0;
+    int64_t busy_us = 0;
+
+    while (!s_exit)
+    {
+        mixer_apply_rate();
+
+        int64_t start = esp_timer_get_time();
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        bool busy = mixer_mix_block();
+        xSemaphoreGive(s_lock);
+        busy_us += esp_timer_get_time() - start;
+
+        silent = busy ? 0 : silent + 1;
+
+        if (silent > s_idle_blocks)
+        {
+            if (active)
+            {
+                active = false;
+                if (s_config.active_fn) s_config.active_fn(false);
+            }
+
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        if (!active)
+        {
+            active = true;
+            if (s_config.active_fn) s_config.active_fn(true);
+        }
+
+        size_t written = 0;
+        s_config.write_fn(s_mix, sizeof(s_mix), &written, portMAX_DELAY);
+        s_stats.blocks++;
+
+        /* 每秒统计一次混音占用的CPU */
+        if (++period_blocks * AUDIO_MIXER_BLOCK_FRAMES >= s_rate)
+        {
+            s_stats.load_permille = busy_us * s_rate / ((int64_t)period_blocks * AUDIO_MIXER_BLOCK_FRAMES * 1000);
+            period_blocks = 0;
+            busy_us = 0;
+        }
+    }
+
+    if (active && s_config.active_fn)
+    {
+        s_config.active_fn(false);
+    }
+
+    xEventGroupSetBits(s_events, MIXER_EXIT_BIT);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief       初始化混音器,创建混音任务
+ * @param       config : 配置
+ * @retval      ESP_OK:成功; 其他:失败
+ */
+esp_err_t audio_mixer_init(const audio_mixer_config_t *config)
+{
+    if (s_running)
+    {
+        return ESP_OK;
+    }
+
+    ESP_RETURN_ON_FALSE(config && config->write_fn && config->sample_rate, ESP_ERR_INVALID_ARG, TAG, "invalid config");
+
+    if (!s_lock)
+    {
+        s_lock = xSemaphoreCreateMutex();
+        s_events = xEventGroupCreate();
+        ESP_RETURN_ON_FALSE(s_lock && s_events, ESP_ERR_NO_MEM, TAG, "Failed to create mixer sync objects");
+    }
+
+    s_config = *config;
+    s_rate = config->sample_rate;
+    s_new_rate = 0;
+    s_rate_wait = 0;
+    s_exit = false;
+    memset(s_inputs, 0, sizeof(s_inputs));
+    memset(&s_stats, 0, sizeof(s_stats));
+    mixer_update_timing();
+    xEventGroupClearBits(s_events, MIXER_INPUT_BITS | MIXER_RATE_BIT | MIXER_EXIT_BIT);
+
+    if (config->rate_fn)
+    {
+        ESP_RETURN_ON_ERROR(config->rate_fn(s_rate), TAG, "Failed to set output rate");
+    }
+
+    BaseType_t ret = xTaskCreatePinnedToCore(mixer_task, "audio_mixer", MIXER_TASK_STACK, NULL,
+                                             config->priority, &s_task, config->core);
+    ESP_RETURN_ON_FALSE(ret == pdPASS, ESP_ERR_NO_MEM, TAG, "Failed to create mixer task");
+
+    s_running = true;
+    ESP_LOGI(TAG, "mixer ready, %lu Hz", s_rate);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief       停止混音任务并删除所有输入
+ * @note        调用前应先停止所有输入的生产者
+ * @param       无
+ * @retval      无
+ */
+void audio_mixer_deinit(void)
+{
+    if (!s_running)
+    {
+        return;
+    }
+
+    s_running = false;
+    s_exit = true;
+    xEventGroupSetBits(s_events, MIXER_INPUT_BITS);     /* 唤醒等待空间的生产者 */
+    xTaskNotifyGive(s_task);
+    xEventGroupWaitBits(s_events, MIXER_EXIT_BIT, pdTRUE, pdTRUE, portMAX_DELAY);
+    s_task = NULL;
+
+    for (int i = 0; i < AUDIO_MIXER_INPUT_MAX; i++)
+    {
+        audio_mixer_input_remove(&s_inputs[i]);
+    }
+}
+
+/**
+ * @brief       添加输入
+ * @param       config : 输入配置
+ * @retval      输入句柄; NULL:失败
+ */
+audio_mixer_input_t *audio_mixer_input_add(const audio_mixer_input_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(s_running && config, NULL, TAG, "mixer not running");
+    ESP_RETURN_ON_FALSE(config->buf_size >= MIXER_BLOCK_BYTES, NULL, TAG, "input buffer too small");
+
+    audio_mixer_input_t *input = NULL;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    for (int i = 0; i < AUDIO_MIXER_INPUT_MAX; i++)
+    {
+        if (!s_inputs[i].used)
+        {
+            input = &s_inputs[i];
+            input->index = i;
+            break;
+        }
+    }
+
+    if (input && spsc_ring_create(&input->ring, config->buf_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) == ESP_OK)
+    {
+        input->name = config->name;
+        input->priority = config->priority;
+        input->bits = 16;
+        input->channels = 2;
+        input->rate = 0;
+        input->rs = NULL;
+        input->rs_buf = NULL;
+        input->gain = AUDIO_MIXER_GAIN_UNITY;
+        input->cur_gain = AUDIO_MIXER_GAIN_UNITY;
+        input->flush = false;
+        input->draining = false;
+        input->active = false;
+        input->hold = 0;
+        input->used = true;
+    }
+    else
+    {
+        ESP_LOGE(TAG, "Failed to add input %s", config->name ? config->name : "");
+        input = NULL;
+    }
+
+    xSemaphoreGive(s_lock);
+
+    return input;
+}
+
+/**
+ * @brief       删除输入
+ * @note        调用前应先停止该输入的生产者
+ * @param       input : 输入句柄
+ * @retval      无
+ */
+void audio_mixer_input_remove(audio_mixer_input_t *input)
+{
+    if (!input || !input->used)
+    {
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    input->used = false;
+    spsc_ring_delete(&input->ring);
+    xSemaphoreGive(s_lock);
+
+    resampler_delete(input->rs);
+    free(input->rs_buf);
+    input->rs = NULL;
+    input->rs_buf = NULL;
+}
+
+/**
+ * @brief       设置写入数据的格式
+ * @note        写入时转换为16位立体声:32位取高16位,单声道复制到两个声道
+ * @param       input    : 输入句柄
+ * @param       bits     : 位宽,16或32
+ * @param       channels : 声道数,1或2
+ * @retval      ESP_OK:成功; ESP_ERR_NOT_SUPPORTED:格式不支持
+ */
+esp_err_t audio_mixer_input_set_format(audio_mixer_input_t *input, uint8_t bits, uint8_t channels)
+{
+    ESP_RETURN_ON_FALSE(input && input->used, ESP_ERR_INVALID_ARG, TAG, "invalid input");
+    ESP_RETURN_ON_FALSE((bits == 16 || bits == 32) && (channels == 1 || channels == 2),
+                        ESP_ERR_NOT_SUPPORTED, TAG, "%d bit %d channel audio not supported", bits, channels);
+
+    input->bits = bits;
+    input->channels = channels;
+
+    return ESP_OK;
+}
+
+/**
+ * @brief       设置写入数据的采样率
+ * @note        与输出采样率不同时,写入的数据按resample_quality重采样
+ * @param       input       : 输入句柄
+ * @param       sample_rate : 采样率,0表示与输出相同
+ * @retval      ESP_OK:成功; 其他:失败
+ */
+esp_err_t audio_mixer_input_set_rate(audio_mixer_input_t *input, uint32_t sample_rate)
+{
+    ESP_RETURN_ON_FALSE(input && input->used, ESP_ERR_INVALID_ARG, TAG, "invalid input");
+
+    input->rate = sample_rate;
+
+    return ESP_OK;
+}
+
+/**
+ * @brief       按输入和输出采样率准备重采样器(在生产者任务中调用)
+ * @note        输出采样率改变后也会在这里重建
+ */
+static esp_err_t mixer_prepare_resampler(audio_mixer_input_t *input)
+{
+    uint32_t out_rate = s_rate;
+    bool need = input->rate && input->rate != out_rate;
+
+    if (input->rs && (!need || resampler_in_rate(input->rs) != input->rate ||
+                      resampler_out_rate(input->rs) != out_rate))
+    {
+        resampler_delete(input->rs);
+        free(input->rs_buf);
+        input->rs = NULL;
+        input->rs_buf = NULL;
+    }
+
+    if (!need || input->rs)
+    {
+        return ESP_OK;
+    }
+
+    input->rs = resampler_create(input->rate, out_rate, s_config.resample_quality);
+    ESP_RETURN_ON_FALSE(input->rs, ESP_ERR_NOT_SUPPORTED, TAG, "Failed to resample %lu -> %lu Hz", input->rate, out_rate);
+
+    input->rs_cap = resampler_max_out(input->rs, MIXER_CONV_FRAMES);
+    input->rs_buf = malloc(input->rs_cap * MIXER_FRAME_BYTES);
+    if (!input->rs_buf)
+    {
+        resampler_delete(input->rs);
+        input->rs = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "%s: resampling %lu -> %lu Hz", input->name, input->rate, out_rate);
+    return ESP_OK;
+}
+
+/**
+ * @brief       转换为16位立体声
+ */
+static void mixer_convert(const audio_mixer_input_t *input, int16_t *out, const uint8_t *in, size_t frames)
+{
+    uint8_t ch = input->channels;
+
+    for (size_t n = 0; n < frames; n++)
+    {
+        if (input->bits == 16)
+        {
+            const int16_t *p = (const int16_t *)in + n * ch;
+            out[2 * n] = p[0];
+            out[2 * n + 1] = p[ch - 1];
+        }
+        else
+        {
+            const int32_t *p = (const int32_t *)in + n * ch;
+            out[2 * n] = p[0] >> 16;
+            out[2 * n + 1] = p[ch - 1] >> 16;
+        }
+    }
+}
+
+/**
+ * @brief       把16位立体声数据写入输入缓冲区,空间不足时等待混音任务取走数据
+ * @param       input      : 输入句柄
+ * @param       data       : 数据
+ * @param       len        : 字节数,4的倍数
+ * @param       put        : 输出实际写入的字节数
+ * @param       timeout_ms : 每次等待的超时时间(ms)
+ * @retval      ESP_OK:成功; ESP_ERR_TIMEOUT:超时; ESP_ERR_INVALID_STATE:混音器已停止
+ */
+static esp_err_t mixer_put(audio_mixer_input_t *input, const uint8_t *data, uint32_t len,
+                           uint32_t *put, uint32_t timeout_ms)
+{
+    EventBits_t bit = 1 << input->index;
+    TickType_t ticks = (timeout_ms == portMAX_DELAY) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+
+    *put = 0;
+
+    while (len)
+    {
+        ESP_RETURN_ON_FALSE(s_running, ESP_ERR_INVALID_STATE, TAG, "mixer stopped");
+
+        /* 先清除再写入,混音任务在这之后取走数据一定会再次置位 */
+        xEventGroupClearBits(s_events, bit);
+        uint32_t n = spsc_ring_write(&input->ring, data, len);
+
+        if (n)
+        {
+            data += n;
+            len -= n;
+            *put += n;
+            xTaskNotifyGive(s_task);
+        }
+
+        if (len && !(xEventGroupWaitBits(s_events, bit, pdTRUE, pdTRUE, ticks) & bit))
+        {
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief       写入PCM数据
+ * @note        每个输入只能有一个生产者;缓冲区满时阻塞
+ * @param       input         : 输入句柄
+ * @param       data          : audio_mixer_input_set_format设置格式的PCM数据
+ * @param       len           : 字节数
+ * @param       bytes_written : 输出实际写入的字节数,可为NULL
+ * @param       timeout_ms    : 缓冲区满时等待的超时时间(ms)
+ * @retval      ESP_OK:成功; 其他:失败
+ */
+esp_err_t audio_mixer_write(audio_mixer_input_t *input, const void *data, size_t len,
+                            size_t *bytes_written, uint32_t timeout_ms)
+{
+    ESP_RETURN_ON_FALSE(s_running && input && input->used, ESP_ERR_INVALID_STATE, TAG, "input not available");
+
+    size_t frame_bytes = input->bits / 8 * input->channels;
+    size_t frames = len / frame_bytes;
+    const uint8_t *src = data;
+    uint32_t put;
+    esp_err_t ret = ESP_OK;
+
+    ESP_RETURN_ON_ERROR(mixer_prepare_resampler(input), TAG, "resampler not available");
+
+    if (len)
+    {
+        input->draining = false;    /* 又有数据,之后不足一块算欠载 */
+    }
+
+    if (input->bits == 16 && input->channels == 2 && !input->rs)
+    {
+        ret = mixer_put(input, src, frames * MIXER_FRAME_BYTES, &put, timeout_ms);
+        frames = put / MIXER_FRAME_BYTES;
+    }
+    else
+    {
+        int16_t conv[MIXER_CONV_FRAMES * 2];
+        size_t done = 0;
+
+        while (done < frames && ret == ESP_OK)
+        {
+            size_t n = frames - done;
+
+            if (n > MIXER_CONV_FRAMES) n = MIXER_CONV_FRAMES;
+
+            mixer_convert(input, conv, src + done * frame_bytes, n);
+
+            if (input->rs)
+            {
+                /* 按MIXER_CONV_FRAMES申请的输出缓冲区足够一次转换完 */
+                size_t used = n;
+                size_t out = resampler_process(input->rs, conv, &used, input->rs_buf, input->rs_cap);
+                ret = mixer_put(input, (const uint8_t *)input->rs_buf, out * MIXER_FRAME_BYTES, &put, timeout_ms);
+            }
+            else
+            {
+                ret = mixer_put(input, (const uint8_t *)conv, n * MIXER_FRAME_BYTES, &put, timeout_ms);
+            }
+
+            done += n;
+        }
+
+        frames = (ret == ESP_OK) ? frames : done;
+    }
+
+    if (bytes_written)
+    {
+        *bytes_written = frames * frame_bytes;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief       丢弃输入中还没播放的数据
+ * @note        由混音任务在下一块开始时执行
+ * @param       input : 输入句柄
+ * @retval      无
+ */
+void audio_mixer_input_flush(audio_mixer_input_t *input)
+{
+    if (s_running && input && input->used)
+    {
+        input->flush = true;
+        xTaskNotifyGive(s_task);
+    }
+}
+
+/**
+ * @brief       生产者已写完一段数据(曲目、提示音)
+ * @note        最后不满一块的数据播完后输入停止,不计入欠载;下一次写入后恢复统计.
+ *              应在最后一次写入之后立即调用,缓冲区中的数据在这之前就已播到结尾的话仍会计入
+ * @param       input : 输入句柄
+ * @retval      无
+ */
+void audio_mixer_input_drain(audio_mixer_input_t *input)
+{
+    if (s_running && input && input->used)
+    {
+        input->draining = true;
+    }
+}
+
+/**
+ * @brief       输入是否还有未播放的数据
+ * @param       input : 输入句柄
+ * @retval      true:有
+ */
+bool audio_mixer_input_busy(audio_mixer_input_t *input)
+{
+    return input && input->used && (input->flush || spsc_ring_used(&input->ring) != 0);
+}
+
+/**
+ * @brief       输入缓冲区的填充程度
+ * @param       input : 输入句柄
+ * @retval      已缓冲的数据占缓冲区的百分比
+ */
+uint8_t audio_mixer_input_fill(audio_mixer_input_t *input)
+{
+    uint32_t used = spsc_ring_used(&input->ring);
+    uint32_t size = used + spsc_ring_free(&input->ring);
+
+    return size ? used * 100 / size : 0;
+}
+
+/**
+ * @brief       设置输入增益
+ * @note        在ramp_ms内渐变到新增益;被压低时实际增益为gain * duck_gain
+ * @param       input : 输入句柄
+ * @param       gain  : 增益,Q15格式,最大AUDIO_MIXER_GAIN_UNITY
+ * @retval      无
+ */
+void audio_mixer_set_gain(audio_mixer_input_t *input, uint16_t gain)
+{
+    if (input && input->used)
+    {
+        input->gain = (gain > AUDIO_MIXER_GAIN_UNITY) ? AUDIO_MIXER_GAIN_UNITY : gain;
+    }
+}
+
+/**
+ * @brief       修改输出采样率
+ * @note        等待已缓冲的数据播完后通过rate_fn修改输出,调用后写入的数据按新采样率播放
+ * @param       sample_rate : 采样率
+ * @retval      ESP_OK:成功; ESP_ERR_TIMEOUT:超时
+ */
+esp_err_t audio_mixer_set_rate(uint32_t sample_rate)
+{
+    ESP_RETURN_ON_FALSE(s_running && sample_rate, ESP_ERR_INVALID_STATE, TAG, "mixer not running");
+
+    if (sample_rate == s_rate && !s_new_rate)
+    {
+        return ESP_OK;
+    }
+
+    xEventGroupClearBits(s_events, MIXER_RATE_BIT);
+    s_new_rate = sample_rate;
+    xTaskNotifyGive(s_task);
+
+    EventBits_t bits = xEventGroupWaitBits(s_events, MIXER_RATE_BIT, pdTRUE, pdTRUE,
+                                           pdMS_TO_TICKS(MIXER_RATE_DRAIN_MS * 2));
+
+    return (bits & MIXER_RATE_BIT) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+/**
+ * @brief       当前输出采样率
+ * @param       无
+ * @retval      采样率
+ */
+uint32_t audio_mixer_get_rate(void)
+{
+    return s_rate;
+}
+
+/**
+ * @brief       获取统计信息
+ * @param       stats : 统计信息
+ * @retval      无
+ */
+void audio_mixer_get_stats(audio_mixer_stats_t *stats)
+{
+    *stats = s_stats;
+}
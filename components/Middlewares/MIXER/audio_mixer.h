@@ -0,0 +1,96 @@
+/**
+ ****************************************************************************************************
+ * @file        audio_mixer.h
+ * @brief       多输入软件混音器
+ * @note        每个输入有独立的spsc_ring缓冲区和增益,混音任务每次取AUDIO_MIXER_BLOCK_FRAMES帧,
+ *              按增益饱和叠加后输出16位立体声PCM.
+ *              增益变化(设置音量、压低)在audio_mixer_config_t.ramp_ms内线性渐变,避免爆音;
+ *              有数据的高优先级输入(提示音)会把所有低优先级输入(音乐)压低到duck_gain.
+ *              采样率与输出不同的输入在写入时用多相滤波器重采样(audio_mixer_input_set_rate)
+ ****************************************************************************************************
+ */
+
+#ifndef __AUDIO_MIXER_H
+#define __AUDIO_MIXER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "resampler.h"
+
+#define AUDIO_MIXER_INPUT_MAX       4           /* 最大输入数 */
+#define AUDIO_MIXER_BLOCK_FRAMES    256         /* 每次混音的帧数 */
+#define AUDIO_MIXER_GAIN_UNITY      32768       /* 增益1.0,Q15格式 */
+#define AUDIO_MIXER_DUCK_HOLD_MS    250         /* 高优先级输入没有数据后继续压低的时间,避免提示音间隙音乐忽大忽小 */
+#define AUDIO_MIXER_IDLE_MS         50          /* 所有输入没有数据后继续输出静音的时间,让DMA中的数据播完 */
+#define AUDIO_MIXER_ALIGN           16          /* 混音缓冲区对齐,对齐的缓冲区用SIMD指令处理 */
+
+/* 输出回调,与i2s_channel_write参数相同,数据为16位立体声 */
+typedef esp_err_t (*audio_mixer_write_fn_t)(void *buf, size_t len, size_t *bytes_written, uint32_t timeout_ms);
+
+/* 修改输出采样率 */
+typedef esp_err_t (*audio_mixer_rate_fn_t)(uint32_t sample_rate);
+
+/* 输出开始/停止通知,可用于控制功放 */
+typedef void (*audio_mixer_active_fn_t)(bool active);
+
+typedef struct
+{
+    audio_mixer_write_fn_t write_fn;    /* 输出,必须提供 */
+    audio_mixer_rate_fn_t rate_fn;      /* 修改输出采样率,可为NULL */
+    audio_mixer_active_fn_t active_fn;  /* 输出开始/停止通知,可为NULL */
+    uint32_t sample_rate;               /* 初始输出采样率 */
+    uint16_t ramp_ms;                   /* 增益渐变时间 */
+    uint16_t duck_gain;                 /* 被压低的输入的增益,Q15格式 */
+    resampler_quality_t resample_quality;   /* 输入重采样质量 */
+    UBaseType_t priority;               /* 混音任务优先级,应高于各输入的生产者 */
+    BaseType_t core;                    /* 混音任务所在核心 */
+} audio_mixer_config_t;
+
+typedef struct
+{
+    const char *name;                   /* 输入名称,用于日志 */
+    uint8_t priority;                   /* 优先级,有数据时压低所有更低优先级的输入 */
+    uint32_t buf_size;                  /* 缓冲区大小(字节),必须是2的幂 */
+} audio_mixer_input_config_t;
+
+typedef struct
+{
+    uint32_t blocks;                    /* 已输出的块数 */
+    uint32_t underruns;                 /* 输入数据不足一块的次数,不含写完后的结尾和丢弃 */
+    uint16_t load_permille;             /* 最近1秒混音占用的CPU(千分比) */
+} audio_mixer_stats_t;
+
+typedef struct audio_mixer_input audio_mixer_input_t;
+
+/* 函数声明 */
+esp_err_t audio_mixer_init(const audio_mixer_config_t *config);                             /* 创建混音任务 */
+void audio_mixer_deinit(void);                                                              /* 停止混音任务并释放所有输入 */
+audio_mixer_input_t *audio_mixer_input_add(const audio_mixer_input_config_t *config);       /* 添加输入 */
+void audio_mixer_input_remove(audio_mixer_input_t *input);                                  /* 删除输入 */
+esp_err_t audio_mixer_input_set_format(audio_mixer_input_t *input, uint8_t bits, uint8_t channels); /* 设置写入数据格式 */
+esp_err_t audio_mixer_input_set_rate(audio_mixer_input_t *input, uint32_t sample_rate);    /* 设置写入数据的采样率 */
+esp_err_t audio_mixer_write(audio_mixer_input_t *input, const void *data, size_t len,
+                            size_t *bytes_written, uint32_t timeout_ms);                    /* 写入PCM数据 */
+void audio_mixer_input_flush(audio_mixer_input_t *input);                                   /* 丢弃缓冲的数据 */
+void audio_mixer_input_drain(audio_mixer_input_t *input);                                   /* 数据已写完,结尾不满一块不算欠载 */
+bool audio_mixer_input_busy(audio_mixer_input_t *input);                                    /* 是否还有未播放的数据 */
+uint8_t audio_mixer_input_fill(audio_mixer_input_t *input);                                 /* 缓冲区填充百分比 */
+void audio_mixer_set_gain(audio_mixer_input_t *input, uint16_t gain);                       /* 设置增益(Q15),渐变生效 */
+esp_err_t audio_mixer_set_rate(uint32_t sample_rate);                                       /* 修改输出采样率 */
+uint32_t audio_mixer_get_rate(void);                                                        /* 当前输出采样率 */
+void audio_mixer_get_stats(audio_mixer_stats_t *stats);                                     /* 获取统计信息 */
+
+/* 混音内核,acc += in * gain,结果饱和到16位 */
+void audio_mixer_mix_s16(int16_t *acc, const int16_t *in, size_t samples, uint16_t gain);  /* 固定增益,对齐时使用SIMD */
+void audio_mixer_mix_s16_ref(int16_t *acc, const int16_t *in, size_t samples, uint16_t gain);  /* 固定增益,C参考实现 */
+void audio_mixer_mix_ramp_s16(int16_t *acc, const int16_t *in, size_t frames,
+                              uint16_t gain_start, uint16_t gain_end);                     /* 立体声逐帧渐变增益 */
+
+/* 测试 */
+bool audio_mixer_selftest(void);                                                            /* 检查SIMD内核与参考实现结果一致 */
+void audio_mixer_bench(void);                                                               /* 测量48kHz立体声混音的CPU占用 */
+
+#endif
@@ -0,0 +1,172 @@
+/**
+ ****************************************************************************************************
+ * @file        audio_mixer_bench.c
+ * @brief       混音内核的正确性与CPU占用测试
+ * @note        模拟提示音叠加在被压低的音乐上:每块从环形缓冲区读出两路输入,
+ *              音乐按duck增益混入,提示音按单位增益混入,只测量混音本身的开销
+ ****************************************************************************************************
+ */
+
+#include "audio_mixer.h"
+#include <string.h>
+#include "spsc_ring.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "audio_mixer";
+
+#define BENCH_RATE          48000                               /* 测试采样率 */
+#define BENCH_SECONDS       10                                  /* 测试的音频时长 */
+#define BENCH_DUCK_GAIN     8192                                /* 压低到1/4(-12dB) */
+#define BENCH_RING_SIZE     (16 * 1024)
+
+typedef void (*bench_mix_fn_t)(int16_t *acc, const int16_t *in, size_t samples, uint16_t gain);
+
+/**
+ * @brief       填充伪随机数据,幅度足够大以覆盖饱和
+ */
+static void bench_fill(int16_t *buf, size_t samples, uint32_t *seed)
+{
+    for (size_t n = 0; n < samples; n++)
+    {
+        *seed = *seed * 1664525 + 1013904223;
+        buf[n] = (int16_t)(*seed >> 16);
+    }
+}
+
+/**
+ * @brief       检查SIMD内核与参考实现结果一致
+ * @note        覆盖对齐/不对齐、不是8的倍数的长度以及0、单位增益等特殊增益
+ * @param       无
+ * @retval      true:结果一致
+ */
+bool audio_mixer_selftest(void)
+{
+    static const size_t lengths[] = { 0, 1, 7, 8, 9, 255, 512 };
+    static const uint16_t gains[] = { 0, 1, 8192, 12345, 32767, AUDIO_MIXER_GAIN_UNITY };
+    static int16_t in[520] __attribute__((aligned(AUDIO_MIXER_ALIGN)));
+    static int16_t acc[520] __attribute__((aligned(AUDIO_MIXER_ALIGN)));
+    static int16_t ref[520] __attribute__((aligned(AUDIO_MIXER_ALIGN)));
+    uint32_t seed = 12345;
+    bool ok = true;
+
+    bench_fill(in, 520, &seed);
+
+    /* 偏移0使用SIMD,偏移1使用参考实现的回退路径 */
+    for (size_t offset = 0; offset < 2; offset++)
+    {
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+        {
+            for (size_t g = 0; g < sizeof(gains) / sizeof(gains[0]); g++)
+            {
+                bench_fill(acc, 520, &seed);
+                memcpy(ref, acc, sizeof(ref));
+
+                audio_mixer_mix_s16(acc + offset, in + offset, lengths[l], gains[g]);
+                audio_mixer_mix_s16_ref(ref + offset, in + offset, lengths[l], gains[g]);
+                ok &= memcmp(acc, ref, sizeof(ref)) == 0;
+            }
+        }
+    }
+
+    /* 起止增益相同的渐变应与固定增益结果一致 */
+    bench_fill(acc, 520, &seed);
+    memcpy(ref, acc, sizeof(ref));
+    audio_mixer_mix_ramp_s16(acc, in, 256, 12345, 12345);
+    audio_mixer_mix_s16_ref(ref, in, 512, 12345);
+    ok &= memcmp(acc, ref, sizeof(ref)) == 0;
+
+    return ok;
+}
+
+/**
+ * @brief       测量一种混音方式处理BENCH_SECONDS秒音频的时间
+ * @retval      耗时(us)
+ */
+static int64_t bench_run(spsc_ring_t *music, spsc_ring_t *prompt, int16_t *mix, int16_t *in,
+                         bench_mix_fn_t mix_fn, bool ramp)
+{
+    const uint32_t block_bytes = AUDIO_MIXER_BLOCK_FRAMES * 4;
+    const uint32_t blocks = BENCH_RATE * BENCH_SECONDS / AUDIO_MIXER_BLOCK_FRAMES;
+    int64_t total = 0;
+
+    for (uint32_t b = 0; b < blocks; b++)
+    {
+        /* 生产者写入不计时 */
+        uint32_t len = block_bytes;
+        spsc_ring_reserve(music, &len);
+        spsc_ring_commit(music, len);
+        len = block_bytes;
+        spsc_ring_reserve(prompt, &len);
+        spsc_ring_commit(prompt, len);
+
+        int64_t start = esp_timer_get_time();
+
+        memset(mix, 0, block_bytes);
+
+        uint32_t frames = spsc_ring_read(music, in, block_bytes) / 4;
+        if (ramp)
+        {
+            audio_mixer_mix_ramp_s16(mix, in, frames, AUDIO_MIXER_GAIN_UNITY, BENCH_DUCK_GAIN);
+        }
+        else
+        {
+            mix_fn(mix, in, frames * 2, BENCH_DUCK_GAIN);
+        }
+
+        frames = spsc_ring_read(prompt, in, block_bytes) / 4;
+        mix_fn(mix, in, frames * 2, AUDIO_MIXER_GAIN_UNITY);
+
+        total += esp_timer_get_time() - start;
+    }
+
+    return total;
+}
+
+/**
+ * @brief       打印CPU占用
+ */
+static void bench_report(const char *name, int64_t us)
+{
+    uint32_t load = us / (BENCH_SECONDS * 100);                     /* 占一个核心的万分比 */
+    ESP_LOGI(TAG, "%-20s %3lu.%02lu%% of one core", name, load / 100, load % 100);
+}
+
+/**
+ * @brief       测量48kHz立体声混音的CPU占用
+ * @note        两路输入,结果应低于一个核心的5%
+ * @param       无
+ * @retval      无
+ */
+void audio_mixer_bench(void)
+{
+    spsc_ring_t music = { 0 };
+    spsc_ring_t prompt = { 0 };
+    size_t block_bytes = AUDIO_MIXER_BLOCK_FRAMES * 4;
+    int16_t *mix = heap_caps_aligned_alloc(AUDIO_MIXER_ALIGN, block_bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    int16_t *in = heap_caps_aligned_alloc(AUDIO_MIXER_ALIGN, block_bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+
+    if (!mix || !in ||
+        spsc_ring_create(&music, BENCH_RING_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) != ESP_OK ||
+        spsc_ring_create(&prompt, BENCH_RING_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "bench: no memory");
+        goto out;
+    }
+
+    uint32_t seed = 1;
+    bench_fill((int16_t *)music.buf, BENCH_RING_SIZE / 2, &seed);
+    bench_fill((int16_t *)prompt.buf, BENCH_RING_SIZE / 2, &seed);
+
+    ESP_LOGI(TAG, "kernels %s", audio_mixer_selftest() ? "match reference" : "MISMATCH");
+    bench_report("reference", bench_run(&music, &prompt, mix, in, audio_mixer_mix_s16_ref, false));
+    bench_report("simd", bench_run(&music, &prompt, mix, in, audio_mixer_mix_s16, false));
+    bench_report("simd, ramping duck", bench_run(&music, &prompt, mix, in, audio_mixer_mix_s16, true));
+
+out:
+    spsc_ring_delete(&music);
+    spsc_ring_delete(&prompt);
+    heap_caps_free(mix);
+    heap_caps_free(in);
+}
@@ -0,0 +1,403 @@
+/**
+ ****************************************************************************************************
+ * @file        resampler.c
+ * @brief       多相FIR采样率转换(16位立体声)
+ ****************************************************************************************************
+ */
+
+#include "resampler.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sdkconfig.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_check.h"
+
+static const char *TAG = "resampler";
+
+#if CONFIG_IDF_TARGET_ESP32S3
+#define RESAMPLER_PIE       1                   /* 使用ESP32-S3的PIE SIMD指令 */
+#else
+#define RESAMPLER_PIE       0
+#endif
+
+struct resampler
+{
+    uint32_t in_rate;                           /* 输入采样率 */
+    uint32_t out_rate;                          /* 输出采样率 */
+    uint32_t up;                                /* 插值倍数,即相位数 */
+    uint32_t down;                              /* 抽取倍数 */
+    uint32_t taps;                              /* 每相位抽头数 */
+    int16_t *coeffs;                            /* [up][taps],Q15,每相位倒序存放 */
+    int16_t *hist;                              /* [2声道][RESAMPLER_COPIES][hist_len],副本k的第i个点为x[i + k] */
+    uint32_t hist_len;                          /* 每个副本的长度 */
+    uint32_t fill;                              /* 历史缓冲区中的帧数 */
+    uint32_t pos;                               /* 下一个输出点用到的最新输入帧 */
+    uint32_t phase;                             /* 下一个输出点的相位 */
+};
+
+/* 各质量等级的抽头数、Kaiser窗beta和通带截止(相对较低的奈奎斯特频率) */
+static const struct
+{
+    uint16_t taps;
+    float beta;
+    float rolloff;
+} s_quality[RESAMPLER_QUALITY_MAX] = {
+    {  8, 5.0f, 0.80f },
+    { 16, 7.0f, 0.88f },
+    { 32, 9.0f, 0.92f },
+};
+
+/**
+ * @brief       最大公约数
+ */
+static uint32_t resampler_gcd(uint32_t a, uint32_t b)
+{
+    while (b)
+    {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+/**
+ * @brief       第一类零阶修正贝塞尔函数,用于Kaiser窗
+ */
+static float resampler_i0(float x)
+{
+    float sum = 1.0f;
+    float term = 1.0f;
+
+    for (int k = 1; k < 32; k++)
+    {
+        float t = x / (2.0f * k);
+        term *= t * t;
+        sum += term;
+    }
+
+    return sum;
+}
+
+/**
+ * @brief       设计原型滤波器并按相位拆分
+ * @note        每个相位的系数单独归一化,直流增益与相位无关
+ */
+static esp_err_t resampler_design(resampler_t *rs, float beta, float rolloff)
+{
+    uint32_t len = rs->up * rs->taps;
+    float center = (len - 1) * 0.5f;
+    float ratio = (rs->up < rs->down) ? (float)rs->up / rs->down : 1.0f;
+    float wc = rolloff * ratio / (2.0f * rs->up);                   /* 截止频率,相对插值后的采样率 */
+    float i0_beta = resampler_i0(beta);
+    float *h = malloc(rs->taps * sizeof(float));
+
+    ESP_RETURN_ON_FALSE(h, ESP_ERR_NO_MEM, TAG, "no memory");
+
+    for (uint32_t p = 0; p < rs->up; p++)
+    {
+        float sum = 0.0f;
+
+        for (uint32_t k = 0; k < rs->taps; k++)
+        {
+            float x = (float)(k * rs->up + p) - center;
+            float r = x / (len * 0.5f);
+            float arg = 2.0f * (float)M_PI * wc * x;
+            float sinc = (fabsf(arg) < 1e-6f) ? 1.0f : sinf(arg) / arg;
+            float win = (r * r < 1.0f) ? resampler_i0(beta * sqrtf(1.0f - r * r)) / i0_beta : 0.0f;
+
+            h[k] = sinc * win;
+            sum += h[k];
+        }
+
+        int16_t *c = rs->coeffs + p * rs->taps;
+        int32_t total = 0;
+        uint32_t peak = 0;
+
+        for (uint32_t k = 0; k < rs->taps; k++)
+        {
+            int32_t q = (int32_t)lrintf(h[k] / sum * 32768.0f);
+
+            q = (q > INT16_MAX) ? INT16_MAX : (q < INT16_MIN) ? INT16_MIN : q;
+            c[rs->taps - 1 - k] = q;
+            total += q;
+            peak = (abs(q) > abs(c[peak])) ? rs->taps - 1 - k : peak;
+        }
+
+        /* 量化误差补到最大的系数上,使直流增益精确为1 */
+        int32_t v = c[peak] + 32768 - total;
+        c[peak] = (v > INT16_MAX) ? INT16_MAX : v;
+    }
+
+    free(h);
+    return ESP_OK;
+}
+
+/**
+ * @brief       创建采样率转换器
+ * @param       in_rate  : 输入采样率
+ * @param       out_rate : 输出采样率
+ * @param       quality  : 质量等级
+ * @retval      转换器; NULL:参数错误或内存不足
+ */
+resampler_t *resampler_create(uint32_t in_rate, uint32_t out_rate, resampler_quality_t quality)
+{
+    ESP_RETURN_ON_FALSE(in_rate && out_rate && quality < RESAMPLER_QUALITY_MAX, NULL, TAG, "invalid argument");
+
+    uint32_t g = resampler_gcd(in_rate, out_rate);
+    uint32_t up = out_rate / g;
+
+    ESP_RETURN_ON_FALSE(up <= RESAMPLER_PHASES_MAX, NULL, TAG, "%lu -> %lu Hz not supported", in_rate, out_rate);
+
+    resampler_t *rs = calloc(1, sizeof(resampler_t));
+    ESP_RETURN_ON_FALSE(rs, NULL, TAG, "no memory");
+
+    rs->in_rate = in_rate;
+    rs->out_rate = out_rate;
+    rs->up = up;
+    rs->down = in_rate / g;
+    rs->taps = s_quality[quality].taps;
+
+    /* 降采样时滤波器按输出采样率截止,抽头数随抽取比例增加 */
+    if (rs->down > rs->up)
+    {
+        rs->taps = (rs->taps * rs->down / rs->up + 7) & ~7;
+        rs->taps = (rs->taps > RESAMPLER_TAPS_MAX) ? RESAMPLER_TAPS_MAX : rs->taps;
+    }
+
+    rs->hist_len = rs->taps + RESAMPLER_CHUNK + RESAMPLER_COPIES;
+
+    size_t coeff_size = rs->up * rs->taps * sizeof(int16_t);
+    size_t hist_size = 2 * RESAMPLER_COPIES * rs->hist_len * sizeof(int16_t);
+
+    /* 系数表较大时(高质量、up很大)放到PSRAM */
+    rs->coeffs = heap_caps_aligned_alloc(16, coeff_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!rs->coeffs)
+    {
+        rs->coeffs = heap_caps_aligned_alloc(16, coeff_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+
+    rs->hist = heap_caps_aligned_alloc(16, hist_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+
+    if (!rs->coeffs || !rs->hist ||
+        resampler_design(rs, s_quality[quality].beta, s_quality[quality].rolloff) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "no memory for %lu phases", rs->up);
+        resampler_delete(rs);
+        return NULL;
+    }
+
+    resampler_reset(rs);
+
+    return rs;
+}
+
+/**
+ * @brief       删除采样率转换器
+ * @param       rs : 转换器
+ * @retval      无
+ */
+void resampler_delete(resampler_t *rs)
+{
+    if (rs)
+    {
+        heap_caps_free(rs->coeffs);
+        heap_caps_free(rs->hist);
+        free(rs);
+    }
+}
+
+/**
+ * @brief       清空历史数据,用于不连续的新数据
+ * @param       rs : 转换器
+ * @retval      无
+ */
+void resampler_reset(resampler_t *rs)
+{
+    memset(rs->hist, 0, 2 * RESAMPLER_COPIES * rs->hist_len * sizeof(int16_t));
+    rs->fill = rs->taps - 1;                    /* 以taps - 1个0开始 */
+    rs->pos = rs->taps - 1;
+    rs->phase = 0;
+}
+
+uint32_t resampler_in_rate(const resampler_t *rs)
+{
+    return rs->in_rate;
+}
+
+uint32_t resampler_out_rate(const resampler_t *rs)
+{
+    return rs->out_rate;
+}
+
+/**
+ * @brief       in_frames帧输入最多产生的输出帧数
+ * @param       rs        : 转换器
+ * @param       in_frames : 输入帧数
+ * @retval      输出帧数
+ */
+size_t resampler_max_out(const resampler_t *rs, size_t in_frames)
+{
+    return (uint64_t)in_frames * rs->up / rs->down + 1;
+}
+
+/**
+ * @brief       点积,C参考实现
+ */
+int32_t resampler_dot_ref(const int16_t *x, const int16_t *c, uint32_t taps)
+{
+    int64_t sum = 0;
+
+    for (uint32_t i = 0; i < taps; i++)
+    {
+        sum += (int32_t)x[i] * c[i];
+    }
+
+    return (sum > INT32_MAX) ? INT32_MAX : (sum < INT32_MIN) ? INT32_MIN : (int32_t)sum;
+}
+
+/**
+ * @brief       点积
+ * @note        EE.VMULAS.S16.ACCX把8组乘积累加到40位的ACCX,最后饱和到32位读出
+ */
+int32_t resampler_dot(const int16_t *x, const int16_t *c, uint32_t taps)
+{
+#if RESAMPLER_PIE
+    int32_t acc;
+
+    __asm__ volatile("ee.zero.accx");
+
+    for (uint32_t i = 0; i < taps; i += 8)
+    {
+        __asm__ volatile(
+            "ee.vld.128.ip      q0, %0, 16  \n"
+            "ee.vld.128.ip      q1, %1, 16  \n"
+            "ee.vmulas.s16.accx q0, q1      \n"
+            : "+r"(x), "+r"(c) :: "memory");
+    }
+
+    __asm__ volatile("ee.srs.accx %0, %1, 0" : "=r"(acc) : "r"(0));
+
+    return acc;
+#else
+    return resampler_dot_ref(x, c, taps);
+#endif
+}
+
+/**
+ * @brief       Q15点积结果舍入到16位
+ */
+static inline int16_t resampler_round(int32_t acc)
+{
+    int32_t v = (int32_t)(((int64_t)acc + (1 << 14)) >> 15);
+
+    return (v > INT16_MAX) ? INT16_MAX : (v < INT16_MIN) ? INT16_MIN : v;
+}
+
+/**
+ * @brief       丢弃不再需要的历史数据
+ * @note        丢弃量取8的倍数,副本之间的对齐关系不变
+ */
+static void resampler_compact(resampler_t *rs)
+{
+    uint32_t oldest = (rs->pos + 1 > rs->taps) ? rs->pos + 1 - rs->taps : 0;
+    uint32_t drop = oldest & ~(RESAMPLER_COPIES - 1);
+
+    if (drop > rs->fill)
+    {
+        drop = rs->fill & ~(RESAMPLER_COPIES - 1);
+    }
+
+    if (drop == 0)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0; i < 2 * RESAMPLER_COPIES; i++)
+    {
+        int16_t *h = rs->hist + i * rs->hist_len;
+        memmove(h, h + drop, (rs->fill - drop) * sizeof(int16_t));
+    }
+
+    rs->fill -= drop;
+    rs->pos -= drop;
+}
+
+/**
+ * @brief       追加输入数据到历史缓冲区的所有副本
+ */
+static void resampler_push(resampler_t *rs, const int16_t *in, uint32_t frames)
+{
+    for (uint32_t n = 0; n < frames; n++, rs->fill++)
+    {
+        for (uint32_t ch = 0; ch < 2; ch++)
+        {
+            int16_t v = in[2 * n + ch];
+            int16_t *h = rs->hist + ch * RESAMPLER_COPIES * rs->hist_len + rs->fill;
+            uint32_t copies = (rs->fill < RESAMPLER_COPIES) ? rs->fill + 1 : RESAMPLER_COPIES;
+
+            for (uint32_t k = 0; k < copies; k++)
+            {
+                h[k * rs->hist_len - k] = v;
+            }
+        }
+    }
+}
+
+/**
+ * @brief       转换16位立体声数据
+ * @note        输出缓冲区满或输入用完时返回,未用完的输入由调用者下次再传入
+ * @param       rs         : 转换器
+ * @param       in         : 输入数据
+ * @param       in_frames  : 输入帧数,返回实际消耗的帧数
+ * @param       out        : 输出缓冲区
+ * @param       out_frames : 输出缓冲区帧数
+ * @retval      输出帧数
+ */
+size_t resampler_process(resampler_t *rs, const int16_t *in, size_t *in_frames,
+                         int16_t *out, size_t out_frames)
+{
+    size_t used = 0;
+    size_t produced = 0;
+
+    while (produced < out_frames)
+    {
+        if (rs->pos >= rs->fill)
+        {
+            if (used == *in_frames)
+            {
+                break;
+            }
+
+            resampler_compact(rs);
+
+            size_t n = *in_frames - used;
+            if (n > rs->hist_len - rs->fill) n = rs->hist_len - rs->fill;
+
+            resampler_push(rs, in + 2 * used, n);
+            used += n;
+            continue;
+        }
+
+        /* 窗口x[start .. pos],从错开start % 8个点的副本读取,起点按16字节对齐 */
+        uint32_t start = rs->pos + 1 - rs->taps;
+        uint32_t k = start & (RESAMPLER_COPIES - 1);
+        const int16_t *c = rs->coeffs + rs->phase * rs->taps;
+        const int16_t *xl = rs->hist + k * rs->hist_len + (start - k);
+        const int16_t *xr = xl + RESAMPLER_COPIES * rs->hist_len;
+
+        out[2 * produced] = resampler_round(resampler_dot(xl, c, rs->taps));
+        out[2 * produced + 1] = resampler_round(resampler_dot(xr, c, rs->taps));
+        produced++;
+
+        rs->phase += rs->down;
+        rs->pos += rs->phase / rs->up;
+        rs->phase %= rs->up;
+    }
+
+    *in_frames = used;
+    return produced;
+}
@@ -0,0 +1,53 @@
+/**
+ ****************************************************************************************************
+ * @file        resampler.h
+ * @brief       多相FIR采样率转换(16位立体声)
+ * @note        输出/输入采样率化简为up/down,原型滤波器为Kaiser窗sinc,按相位拆成up组,
+ *              每个输出点只计算一组taps个系数的点积.
+ *              历史数据保存RESAMPLER_COPIES份依次错开一个采样点的副本,任意起点的窗口都能
+ *              从16字节对齐的地址读取,ESP32-S3上点积用PIE指令每条处理8个采样点
+ ****************************************************************************************************
+ */
+
+#ifndef __RESAMPLER_H
+#define __RESAMPLER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define RESAMPLER_PHASES_MAX    1024        /* 最大相位数(化简后的up),覆盖8k~96k常用采样率之间的转换 */
+#define RESAMPLER_CHUNK         256         /* 每次追加到历史缓冲区的最大帧数 */
+#define RESAMPLER_COPIES        8           /* 历史数据的错位副本数 */
+#define RESAMPLER_TAPS_MAX      128         /* 降采样时每相位的最大抽头数 */
+
+typedef enum
+{
+    RESAMPLER_QUALITY_LOW = 0,              /* 每相位8抽头(降采样时按比例增加,下同) */
+    RESAMPLER_QUALITY_MEDIUM,               /* 每相位16抽头 */
+    RESAMPLER_QUALITY_HIGH,                 /* 每相位32抽头 */
+    RESAMPLER_QUALITY_MAX,
+} resampler_quality_t;
+
+typedef struct resampler resampler_t;
+
+/* 函数声明 */
+resampler_t *resampler_create(uint32_t in_rate, uint32_t out_rate, resampler_quality_t quality);  /* 创建 */
+void resampler_delete(resampler_t *rs);                                                 /* 删除 */
+void resampler_reset(resampler_t *rs);                                                  /* 清空历史数据 */
+uint32_t resampler_in_rate(const resampler_t *rs);                                      /* 输入采样率 */
+uint32_t resampler_out_rate(const resampler_t *rs);                                     /* 输出采样率 */
+size_t resampler_max_out(const resampler_t *rs, size_t in_frames);                      /* in_frames帧输入最多产生的输出帧数 */
+size_t resampler_process(resampler_t *rs, const int16_t *in, size_t *in_frames,
+                         int16_t *out, size_t out_frames);                              /* 转换 */
+
+/* 点积内核,x和c须16字节对齐,taps为8的倍数,返回Q15乘积之和(饱和到32位) */
+int32_t resampler_dot(const int16_t *x, const int16_t *c, uint32_t taps);               /* ESP32-S3上使用SIMD */
+int32_t resampler_dot_ref(const int16_t *x, const int16_t *c, uint32_t taps);           /* C参考实现 */
+
+/* 测试 */
+bool resampler_selftest(void);                                                          /* 检查SIMD内核与参考实现一致,以及直流增益 */
+void resampler_bench(void);                                                             /* 测量各质量等级的CPU占用 */
+
+#endif
@@ -0,0 +1,152 @@
+/**
+ ****************************************************************************************************
+ * @file        resampler_bench.c
+ * @brief       采样率转换的正确性与CPU占用测试
+ * @note        测量各质量等级把常见音乐采样率转换到48kHz立体声的耗时
+ ****************************************************************************************************
+ */
+
+#include "resampler.h"
+#include <stdlib.h>
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "resampler";
+
+#define BENCH_OUT_RATE      48000                               /* 输出采样率 */
+#define BENCH_SECONDS       5                                   /* 每项测试的输出时长 */
+#define BENCH_IN_FRAMES     1152                                /* 每次输入的帧数,与一帧MP3相同 */
+
+static const char *const s_quality_name[RESAMPLER_QUALITY_MAX] = { "low", "medium", "high" };
+
+/**
+ * @brief       检查SIMD点积与参考实现一致,以及各质量等级的直流增益
+ * @param       无
+ * @retval      true:通过
+ */
+bool resampler_selftest(void)
+{
+    static int16_t x[64] __attribute__((aligned(16)));
+    static int16_t c[64] __attribute__((aligned(16)));
+    static int16_t in[BENCH_IN_FRAMES * 2];
+    static int16_t out[BENCH_IN_FRAMES * 2 * 3];
+    uint32_t seed = 12345;
+    bool ok = true;
+
+    for (uint32_t taps = 8; taps <= 64; taps += 8)
+    {
+        for (uint32_t i = 0; i < 64; i++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            x[i] = (int16_t)(seed >> 16);
+            c[i] = (int16_t)(seed >> 3);
+        }
+
+        ok &= resampler_dot(x, c, taps) == resampler_dot_ref(x, c, taps);
+    }
+
+    /* 直流输入经过滤波器建立时间后,输出应与输入相同(误差1个LSB) */
+    for (int i = 0; i < BENCH_IN_FRAMES * 2; i++)
+    {
+        in[i] = (i & 1) ? -12000 : 12000;
+    }
+
+    for (int q = 0; q < RESAMPLER_QUALITY_MAX; q++)
+    {
+        resampler_t *rs = resampler_create(22050, BENCH_OUT_RATE, q);
+
+        if (!rs)
+        {
+            return false;
+        }
+
+        size_t used = BENCH_IN_FRAMES;
+        size_t n = resampler_process(rs, in, &used, out, BENCH_IN_FRAMES * 3);
+
+        ok &= used == BENCH_IN_FRAMES && n > BENCH_IN_FRAMES * 2;
+
+        for (size_t i = 128; i < n; i++)
+        {
+            ok &= abs(out[2 * i] - 12000) <= 1 && abs(out[2 * i + 1] + 12000) <= 1;
+        }
+
+        resampler_delete(rs);
+    }
+
+    return ok;
+}
+
+/**
+ * @brief       测量一项转换输出BENCH_SECONDS秒音频的时间
+ * @retval      耗时(us); <0:失败
+ */
+static int64_t bench_run(uint32_t in_rate, resampler_quality_t quality, const int16_t *in, int16_t *out)
+{
+    resampler_t *rs = resampler_create(in_rate, BENCH_OUT_RATE, quality);
+
+    if (!rs)
+    {
+        return -1;
+    }
+
+    size_t out_cap = resampler_max_out(rs, BENCH_IN_FRAMES);
+    size_t total = 0;
+    int64_t start = esp_timer_get_time();
+
+    while (total < BENCH_OUT_RATE * BENCH_SECONDS)
+    {
+        size_t used = BENCH_IN_FRAMES;
+        total += resampler_process(rs, in, &used, out, out_cap);
+    }
+
+    int64_t us = esp_timer_get_time() - start;
+    resampler_delete(rs);
+
+    return us;
+}
+
+/**
+ * @brief       测量各质量等级的CPU占用
+ * @note        输出48kHz立体声,每项输出BENCH_SECONDS秒
+ * @param       无
+ * @retval      无
+ */
+void resampler_bench(void)
+{
+    static const uint32_t rates[] = { 44100, 22050, 32000 };
+    int16_t *in = malloc(BENCH_IN_FRAMES * 2 * sizeof(int16_t));
+    int16_t *out = malloc((BENCH_IN_FRAMES * 3 + 1) * 2 * sizeof(int16_t));
+
+    if (!in || !out)
+    {
+        ESP_LOGE(TAG, "bench: no memory");
+        goto out;
+    }
+
+    uint32_t seed = 1;
+    for (int i = 0; i < BENCH_IN_FRAMES * 2; i++)
+    {
+        seed = seed * 1664525 + 1013904223;
+        in[i] = (int16_t)(seed >> 17);
+    }
+
+    ESP_LOGI(TAG, "selftest %s", resampler_selftest() ? "passed" : "FAILED");
+
+    for (int r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+    {
+        for (int q = 0; q < RESAMPLER_QUALITY_MAX; q++)
+        {
+            int64_t us = bench_run(rates[r], q, in, out);
+            uint32_t load = (us < 0) ? 0 : us / (BENCH_SECONDS * 100);     /* 占一个核心的万分比 */
+
+            ESP_LOGI(TAG, "%5lu -> %lu Hz %-6s %3lu.%02lu%% of one core",
+                     rates[r], (uint32_t)BENCH_OUT_RATE, s_quality_name[q], load / 100, load % 100);
+        }
+    }
+
+out:
+    free(in);
+    free(out);
+}
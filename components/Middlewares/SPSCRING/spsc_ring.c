@@ -0,0 +1,255 @@
+/**
+ ****************************************************************************************************
+ * @file        spsc_ring.c
+ * @brief       单生产者/单消费者无锁字节环形缓冲区
+ ****************************************************************************************************
+ */
+
+#include "spsc_ring.h"
+#include <string.h>
+#include "esp_heap_caps.h"
+
+
+/**
+ * @brief       使用外部数据区初始化环形缓冲区
+ * @param       ring : 环形缓冲区
+ * @param       buf  : 数据区
+ * @param       size : 数据区大小,必须是2的幂
+ * @retval      ESP_OK:成功; ESP_ERR_INVALID_ARG:参数错误
+ */
+esp_err_t spsc_ring_init(spsc_ring_t *ring, uint8_t *buf, uint32_t size)
+{
+    if (!ring || !buf || size < 2 || (size & (size - 1)) || size > 0x80000000)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ring->buf = buf;
+    ring->size = size;
+    ring->mask = size - 1;
+    ring->owned = false;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief       申请数据区并初始化环形缓冲区
+ * @param       ring : 环形缓冲区
+ * @param       size : 容量,必须是2的幂
+ * @param       caps : heap_caps属性,如MALLOC_CAP_SPIRAM
+ * @retval      ESP_OK:成功; ESP_ERR_NO_MEM:内存不足; ESP_ERR_INVALID_ARG:参数错误
+ */
+esp_err_t spsc_ring_create(spsc_ring_t *ring, uint32_t size, uint32_t caps)
+{
+    if (!ring || size < 2 || (size & (size - 1)))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint8_t *buf = heap_caps_malloc(size, caps);
+    if (!buf)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = spsc_ring_init(ring, buf, size);
+    if (ret != ESP_OK)
+    {
+        heap_caps_free(buf);
+        return ret;
+    }
+
+    ring->owned = true;
+    return ESP_OK;
+}
+
+/**
+ * @brief       释放spsc_ring_create申请的数据区
+ * @param       ring : 环形缓冲区
+ * @retval      无
+ */
+void spsc_ring_delete(spsc_ring_t *ring)
+{
+    if (ring && ring->owned)
+    {
+        heap_caps_free(ring->buf);
+    }
+
+    if (ring)
+    {
+        ring->buf = NULL;
+        ring->owned = false;
+    }
+}
+
+/**
+ * @brief       清空环形缓冲区
+ * @note        不是线程安全的,调用时生产者和消费者都不能访问
+ * @param       ring : 环形缓冲区
+ * @retval      无
+ */
+void spsc_ring_reset(spsc_ring_t *ring)
+{
+    atomic_store_explicit(&ring->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, 0, memory_order_relaxed);
+}
+
+/**
+ * @brief       清空环形缓冲区,读写索引从index开始
+ * @note        不是线程安全的,调用时生产者和消费者都不能访问.
+ *              index取外部数据的位置(如文件偏移)时,数据在缓冲区内的偏移和它的位置对齐
+ * @param       ring  : 环形缓冲区
+ * @param       index : 读写索引的初值
+ * @retval      无
+ */
+void spsc_ring_reset_at(spsc_ring_t *ring, uint32_t index)
+{
+    atomic_store_explicit(&ring->head, index, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, index, memory_order_relaxed);
+}
+
+/**
+ * @brief       可读字节数,生产者和消费者都可以调用
+ * @param       ring : 环形缓冲区
+ * @retval      字节数
+ */
+uint32_t spsc_ring_used(spsc_ring_t *ring)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    return head - tail;
+}
+
+/**
+ * @brief       可写字节数,生产者和消费者都可以调用
+ * @param       ring : 环形缓冲区
+ * @retval      字节数
+ */
+uint32_t spsc_ring_free(spsc_ring_t *ring)
+{
+    return ring->size - spsc_ring_used(ring);
+}
+
+/**
+ * @brief       获取连续可写区域(仅生产者调用)
+ * @note        区域不跨越数据区末尾,写完后调用spsc_ring_commit
+ * @param       ring : 环形缓冲区
+ * @param       len  : 输入期望长度,输出实际可写长度(可能为0)
+ * @retval      可写区域起始地址
+ */
+void *spsc_ring_reserve(spsc_ring_t *ring, uint32_t *len)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t offset = head & ring->mask;
+    uint32_t space = ring->size - (head - tail);
+    uint32_t contig = ring->size - offset;
+
+    if (space > contig) space = contig;
+    if (*len > space) *len = space;
+
+    return ring->buf + offset;
+}
+
+/**
+ * @brief       提交已写入的字节(仅生产者调用)
+ * @param       ring : 环形缓冲区
+ * @param       len  : 字节数,不能超过spsc_ring_reserve返回的长度
+ * @retval      无
+ */
+void spsc_ring_commit(spsc_ring_t *ring, uint32_t len)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    atomic_store_explicit(&ring->head, head + len, memory_order_release);
+}
+
+/**
+ * @brief       写入数据(仅生产者调用)
+ * @param       ring : 环形缓冲区
+ * @param       data : 数据
+ * @param       len  : 数据长度
+ * @retval      实际写入的字节数,空间不足时小于len
+ */
+uint32_t spsc_ring_write(spsc_ring_t *ring, const void *data, uint32_t len)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t space = ring->size - (head - tail);
+    uint32_t offset = head & ring->mask;
+
+    if (len > space) len = space;
+
+    uint32_t first = ring->size - offset;
+    if (first > len) first = len;
+
+    memcpy(ring->buf + offset, data, first);
+    memcpy(ring->buf, (const uint8_t *)data + first, len - first);
+
+    atomic_store_explicit(&ring->head, head + len, memory_order_release);
+    return len;
+}
+
+/**
+ * @brief       获取连续可读区域,不释放(仅消费者调用)
+ * @note        区域不跨越数据区末尾,读完后调用spsc_ring_release
+ * @param       ring   : 环形缓冲区
+ * @param       offset : 相对读索引的偏移
+ * @param       len    : 输入期望长度,输出实际可读长度(可能为0)
+ * @retval      可读区域起始地址
+ */
+const void *spsc_ring_peek(spsc_ring_t *ring, uint32_t offset, uint32_t *len)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t avail = head - tail;
+    uint32_t pos = (tail + offset) & ring->mask;
+
+    avail = (offset < avail) ? avail - offset : 0;
+
+    uint32_t contig = ring->size - pos;
+    if (avail > contig) avail = contig;
+    if (*len > avail) *len = avail;
+
+    return ring->buf + pos;
+}
+
+/**
+ * @brief       释放已读取的字节(仅消费者调用)
+ * @param       ring : 环形缓冲区
+ * @param       len  : 字节数,不能超过可读字节数
+ * @retval      无
+ */
+void spsc_ring_release(spsc_ring_t *ring, uint32_t len)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + len, memory_order_release);
+}
+
+/**
+ * @brief       读出数据(仅消费者调用)
+ * @param       ring : 环形缓冲区
+ * @param       buf  : 数据缓冲区
+ * @param       len  : 最大读取长度
+ * @retval      实际读出的字节数
+ */
+uint32_t spsc_ring_read(spsc_ring_t *ring, void *buf, uint32_t len)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint32_t avail = head - tail;
+    uint32_t offset = tail & ring->mask;
+
+    if (len > avail) len = avail;
+
+    uint32_t first = ring->size - offset;
+    if (first > len) first = len;
+
+    memcpy(buf, ring->buf + offset, first);
+    memcpy((uint8_t *)buf + first, ring->buf, len - first);
+
+    atomic_store_explicit(&ring->tail, tail + len, memory_order_release);
+    return len;
+}
@@ -0,0 +1,49 @@
+/**
+ ****************************************************************************************************
+ * @file        spsc_ring.h
+ * @brief       单生产者/单消费者无锁字节环形缓冲区
+ * @note        读写索引自由递增,容量为2的幂,用掩码取模;生产者只写head,消费者只写tail,
+ *              双方用acquire/release原子操作同步,不需要互斥锁.
+ *              reserve/commit和peek/release接口直接返回缓冲区内的连续区域,
+ *              生产者(HTTP下载、I2S读取)可以原地写入,省去一次拷贝
+ ****************************************************************************************************
+ */
+
+#ifndef __SPSC_RING_H
+#define __SPSC_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "esp_err.h"
+
+typedef struct
+{
+    uint8_t *buf;                   /* 数据区 */
+    uint32_t size;                  /* 容量,2的幂 */
+    uint32_t mask;                  /* size - 1 */
+    bool owned;                     /* 数据区由spsc_ring_create申请 */
+    atomic_uint_least32_t head;     /* 写索引,只由生产者修改 */
+    atomic_uint_least32_t tail;     /* 读索引,只由消费者修改 */
+} spsc_ring_t;
+
+/* 函数声明 */
+esp_err_t spsc_ring_init(spsc_ring_t *ring, uint8_t *buf, uint32_t size);                  /* 使用外部数据区初始化 */
+esp_err_t spsc_ring_create(spsc_ring_t *ring, uint32_t size, uint32_t caps);               /* 按heap_caps申请数据区并初始化 */
+void spsc_ring_delete(spsc_ring_t *ring);                                                   /* 释放spsc_ring_create申请的数据区 */
+void spsc_ring_reset(spsc_ring_t *ring);                                                    /* 清空,调用时双方都不能访问 */
+void spsc_ring_reset_at(spsc_ring_t *ring, uint32_t index);                                 /* 清空并设置读写索引,缓冲区偏移与外部位置对齐 */
+uint32_t spsc_ring_used(spsc_ring_t *ring);                                                 /* 可读字节数 */
+uint32_t spsc_ring_free(spsc_ring_t *ring);                                                 /* 可写字节数 */
+
+/* 生产者接口 */
+uint32_t spsc_ring_write(spsc_ring_t *ring, const void *data, uint32_t len);                /* 写入,返回实际写入字节数 */
+void *spsc_ring_reserve(spsc_ring_t *ring, uint32_t *len);                                  /* 获取连续可写区域 */
+void spsc_ring_commit(spsc_ring_t *ring, uint32_t len);                                     /* 提交已写入的字节 */
+
+/* 消费者接口 */
+uint32_t spsc_ring_read(spsc_ring_t *ring, void *buf, uint32_t len);                        /* 读出,返回实际读出字节数 */
+const void *spsc_ring_peek(spsc_ring_t *ring, uint32_t offset, uint32_t *len);              /* 获取连续可读区域,不释放 */
+void spsc_ring_release(spsc_ring_t *ring, uint32_t len);                                    /* 释放已读取的字节 */
+
+#endif
@@ -0,0 +1,420 @@
+/**
+ ****************************************************************************************************
+ * @file        vad.c
+ * @brief       基于能量和过零率的语音活动检测(16位PCM)
+ ****************************************************************************************************
+ */
+
+#include "vad.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sdkconfig.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_check.h"
+
+static const char *TAG = "vad";
+
+#if CONFIG_IDF_TARGET_ESP32S3
+#define VAD_PIE             1                   /* 使用ESP32-S3的PIE SIMD指令 */
+#else
+#define VAD_PIE             0
+#endif
+
+#define VAD_NOISE_MIN       4.0f                /* 噪声基底下限(每采样点平均能量),数字静音时阈值不为0 */
+#define VAD_NOISE_FALL      0.25f               /* 能量低于噪声基底时每帧跟随的比例 */
+#define VAD_NOISE_RISE      (1.0f / 64)         /* 非语音帧能量高于噪声基底时每帧跟随的比例,10ms帧约0.6s */
+#define VAD_NOISE_RISE_SPEECH (1.0f / 1024)     /* 语音帧时的跟随比例,背景噪声持续变大时最终也能结束一段 */
+
+struct vad
+{
+    vad_config_t cfg;                           /* 配置 */
+    uint32_t frame_frames;                      /* 每个分析帧的帧数 */
+    uint32_t frame_samples;                     /* 每个分析帧的采样点数 */
+    int16_t *frame;                             /* 正在攒的分析帧,16字节对齐 */
+    uint32_t fill;                              /* frame中的帧数 */
+    int16_t *hist;                              /* 预录的分析帧,[hist_cap][frame_samples] */
+    uint32_t hist_cap;                          /* 预录的最大分析帧数,含触发所需的帧 */
+    uint32_t hist_head;                         /* 最早的预录帧 */
+    uint32_t hist_count;                        /* 预录帧数 */
+    uint32_t hangover_frames;                   /* hangover_ms对应的分析帧数 */
+    float ratio;                                /* threshold_db对应的能量比 */
+    float noise;                                /* 噪声基底 */
+    bool noise_valid;                           /* 已有噪声基底的估计 */
+    int16_t last;                               /* 上一帧第一个声道的最后一个采样点 */
+    uint32_t pos;                               /* 已分析的帧数 */
+    uint32_t speech_run;                        /* 连续的语音帧数 */
+    uint32_t hang;                              /* 剩余的拖尾分析帧数 */
+    bool active;                                /* 在段内 */
+    vad_segment_t seg;                          /* 当前段 */
+    vad_stats_t stats;                          /* 统计信息 */
+};
+
+/**
+ * @brief       平方和,C参考实现
+ * @param       x       : 采样点
+ * @param       samples : 采样点数
+ * @retval      平方和
+ */
+uint64_t vad_energy_ref(const int16_t *x, size_t samples)
+{
+    uint64_t sum = 0;
+
+    for (size_t n = 0; n < samples; n++)
+    {
+        sum += (uint32_t)((int32_t)x[n] * x[n]);
+    }
+
+    return sum;
+}
+
+/**
+ * @brief       平方和
+ * @note        x按16字节对齐时,EE.VMULAS.S16.ACCX每条把8个平方累加到40位的ACCX,
+ *              每VAD_ENERGY_CHUNK个采样点用RUR读出完整的40位再清零,满幅输入也不会溢出.
+ *              不对齐的缓冲区和剩余的采样点使用参考实现,结果完全一致
+ * @param       参数同vad_energy_ref
+ * @retval      平方和
+ */
+uint64_t vad_energy(const int16_t *x, size_t samples)
+{
+    uint64_t sum = 0;
+    size_t done = 0;
+
+#if VAD_PIE
+    if (((uintptr_t)x & 15) == 0)
+    {
+        const int16_t *p = x;
+        size_t blocks = samples / 8;
+
+        while (blocks > 0)
+        {
+            size_t n = (blocks < VAD_ENERGY_CHUNK / 8) ? blocks : VAD_ENERGY_CHUNK / 8;
+            uint32_t lo;
+            uint32_t hi;
+
+            __asm__ volatile("ee.zero.accx");
+
+            for (size_t b = 0; b < n; b++)
+            {
+                __asm__ volatile(
+                    "ee.vld.128.ip      q0, %0, 16  \n"
+                    "ee.vmulas.s16.accx q0, q0      \n"
+                    : "+r"(p) :: "memory");
+            }
+
+            __asm__ volatile(
+                "rur.accx_0         %0          \n"
+                "rur.accx_1         %1          \n"
+                : "=r"(lo), "=r"(hi));
+
+            sum += ((uint64_t)(hi & 0xff) << 32) | lo;
+            blocks -= n;
+        }
+
+        done = samples & ~(size_t)7;
+    }
+#endif
+
+    return sum + vad_energy_ref(x + done, samples - done);
+}
+
+/**
+ * @brief       第一个声道的过零次数,与上一帧的最后一个采样点相接
+ */
+static uint32_t vad_zero_crossings(vad_t *vad, const int16_t *x)
+{
+    uint32_t step = vad->cfg.channels;
+    int32_t prev = vad->last;
+    uint32_t count = 0;
+
+    for (uint32_t n = 0; n < vad->frame_frames; n++)
+    {
+        int32_t cur = x[n * step];
+        count += (uint32_t)(prev ^ cur) >> 31;                          /* 符号不同 */
+        prev = cur;
+    }
+
+    vad->last = (int16_t)prev;
+
+    return count;
+}
+
+/**
+ * @brief       输出一个分析帧
+ */
+static void vad_commit(vad_t *vad, const int16_t *frame, uint32_t frames)
+{
+    vad->cfg.commit_fn(frame, frames, vad->cfg.arg);
+    vad->stats.committed += frames;
+}
+
+/**
+ * @brief       放入预录缓冲区,满时覆盖最早的帧
+ */
+static void vad_hist_push(vad_t *vad, const int16_t *frame)
+{
+    uint32_t slot = (vad->hist_head + vad->hist_count) % vad->hist_cap;
+
+    memcpy(vad->hist + slot * vad->frame_samples, frame, vad->frame_samples * sizeof(int16_t));
+
+    if (vad->hist_count < vad->hist_cap)
+    {
+        vad->hist_count++;
+    }
+    else
+    {
+        vad->hist_head = (vad->hist_head + 1) % vad->hist_cap;
+    }
+}
+
+/**
+ * @brief       开始一段,先输出预录的帧
+ */
+static void vad_start(vad_t *vad)
+{
+    vad->seg.start = vad->pos + vad->frame_frames - vad->hist_count * vad->frame_frames;
+    vad->seg.offset = vad->stats.committed;
+
+    for (uint32_t i = 0; i < vad->hist_count; i++)
+    {
+        uint32_t slot = (vad->hist_head + i) % vad->hist_cap;
+        vad_commit(vad, vad->hist + slot * vad->frame_samples, vad->frame_frames);
+    }
+
+    vad->hist_head = 0;
+    vad->hist_count = 0;
+    vad->active = true;
+    vad->hang = vad->hangover_frames;
+}
+
+/**
+ * @brief       结束一段
+ */
+static void vad_end(vad_t *vad)
+{
+    vad->seg.frames = vad->stats.committed - vad->seg.offset;
+    vad->active = false;
+    vad->speech_run = 0;
+    vad->stats.segments++;
+
+    if (vad->cfg.segment_fn)
+    {
+        vad->cfg.segment_fn(&vad->seg, vad->cfg.arg);
+    }
+}
+
+/**
+ * @brief       分析一帧并更新状态
+ */
+static void vad_frame(vad_t *vad)
+{
+    float energy = (float)vad_energy(vad->frame, vad->frame_samples) / vad->frame_samples;
+    uint32_t zcr = vad_zero_crossings(vad, vad->frame) * 1000 / vad->cfg.frame_ms;
+
+    if (!vad->noise_valid)
+    {
+        vad->noise = (energy > VAD_NOISE_MIN) ? energy : VAD_NOISE_MIN;
+        vad->noise_valid = true;
+    }
+
+    bool speech = (energy > vad->noise * vad->ratio) && (zcr >= vad->cfg.zcr_min) && (zcr <= vad->cfg.zcr_max);
+
+    /* 噪声基底:向下很快跟随,向上在非语音帧时慢慢跟随 */
+    if (energy < vad->noise)
+    {
+        vad->noise += (energy - vad->noise) * VAD_NOISE_FALL;
+    }
+    else
+    {
+        vad->noise += (energy - vad->noise) * (speech ? VAD_NOISE_RISE_SPEECH : VAD_NOISE_RISE);
+    }
+
+    if (vad->noise < VAD_NOISE_MIN)
+    {
+        vad->noise = VAD_NOISE_MIN;
+    }
+
+    vad->speech_run = speech ? vad->speech_run + 1 : 0;
+
+    if (!vad->active)
+    {
+        vad_hist_push(vad, vad->frame);
+
+        if (vad->speech_run >= vad->cfg.attack_frames)
+        {
+            vad_start(vad);
+        }
+    }
+    else
+    {
+        vad_commit(vad, vad->frame, vad->frame_frames);
+
+        if (speech)
+        {
+            vad->hang = vad->hangover_frames;
+        }
+        else if (vad->hang > 0)
+        {
+            vad->hang--;
+        }
+
+        if (!speech && vad->hang == 0)
+        {
+            vad_end(vad);
+        }
+    }
+
+    vad->pos += vad->frame_frames;
+}
+
+/**
+ * @brief       创建语音活动检测器
+ * @note        分析帧放在内部RAM,预录缓冲区较大时放到PSRAM
+ * @param       config : 配置
+ * @retval      检测器,参数错误或内存不足时为NULL
+ */
+vad_t *vad_create(const vad_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(config && config->commit_fn && config->frame_ms && config->sample_rate &&
+                        config->channels >= 1 && config->channels <= VAD_CHANNELS_MAX,
+                        NULL, TAG, "invalid argument");
+
+    uint32_t frame_frames = config->sample_rate * config->frame_ms / 1000;
+    ESP_RETURN_ON_FALSE(frame_frames >= 8, NULL, TAG, "frame of %lu samples too short", frame_frames);
+
+    vad_t *vad = calloc(1, sizeof(vad_t));
+    ESP_RETURN_ON_FALSE(vad, NULL, TAG, "no memory");
+
+    vad->cfg = *config;
+    vad->cfg.attack_frames = config->attack_frames ? config->attack_frames : 1;
+    vad->frame_frames = frame_frames;
+    vad->frame_samples = frame_frames * config->channels;
+    vad->hist_cap = (config->pre_roll_ms + config->frame_ms - 1) / config->frame_ms + vad->cfg.attack_frames;
+    vad->hangover_frames = (config->hangover_ms + config->frame_ms - 1) / config->frame_ms;
+    vad->ratio = powf(10.0f, config->threshold_db / 10.0f);
+
+    size_t frame_size = vad->frame_samples * sizeof(int16_t);
+    size_t hist_size = vad->hist_cap * frame_size;
+
+    vad->frame = heap_caps_aligned_alloc(16, frame_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    vad->hist = heap_caps_malloc(hist_size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!vad->hist)
+    {
+        vad->hist = heap_caps_malloc(hist_size, MALLOC_CAP_8BIT);
+    }
+
+    if (!vad->frame || !vad->hist)
+    {
+        ESP_LOGE(TAG, "no memory for %lu ms of pre-roll", (uint32_t)config->pre_roll_ms);
+        vad_delete(vad);
+        return NULL;
+    }
+
+    vad_reset(vad);
+
+    return vad;
+}
+
+/**
+ * @brief       删除语音活动检测器
+ * @param       vad : 检测器
+ * @retval      无
+ */
+void vad_delete(vad_t *vad)
+{
+    if (vad)
+    {
+        heap_caps_free(vad->frame);
+        heap_caps_free(vad->hist);
+        free(vad);
+    }
+}
+
+/**
+ * @brief       回到段外,丢弃预录的数据,重新估计噪声基底
+ * @note        不调用segment_fn,需要时先调用vad_flush
+ * @param       vad : 检测器
+ * @retval      无
+ */
+void vad_reset(vad_t *vad)
+{
+    vad->fill = 0;
+    vad->hist_head = 0;
+    vad->hist_count = 0;
+    vad->noise_valid = false;
+    vad->last = 0;
+    vad->pos = 0;
+    vad->speech_run = 0;
+    vad->hang = 0;
+    vad->active = false;
+    memset(&vad->seg, 0, sizeof(vad->seg));
+    memset(&vad->stats, 0, sizeof(vad->stats));
+}
+
+/**
+ * @brief       输入PCM
+ * @note        数据先攒成整个分析帧再检测,段内的数据在同一次调用中通过commit_fn输出
+ * @param       vad    : 检测器
+ * @param       pcm    : 交错的16位PCM
+ * @param       frames : 帧数
+ * @retval      无
+ */
+void vad_write(vad_t *vad, const int16_t *pcm, size_t frames)
+{
+    uint32_t channels = vad->cfg.channels;
+
+    while (frames > 0)
+    {
+        size_t n = vad->frame_frames - vad->fill;
+        n = (n < frames) ? n : frames;
+
+        memcpy(vad->frame + vad->fill * channels, pcm, n * channels * sizeof(int16_t));
+        vad->fill += n;
+        pcm += n * channels;
+        frames -= n;
+
+        if (vad->fill == vad->frame_frames)
+        {
+            vad_frame(vad);
+            vad->fill = 0;
+        }
+    }
+}
+
+/**
+ * @brief       结束正在进行的段
+ * @note        停止检测时调用,段内时不满一个分析帧的数据也输出
+ * @param       vad : 检测器
+ * @retval      无
+ */
+void vad_flush(vad_t *vad)
+{
+    if (vad->active)
+    {
+        if (vad->fill > 0)
+        {
+            vad_commit(vad, vad->frame, vad->fill);
+        }
+
+        vad_end(vad);
+    }
+
+    vad->pos += vad->fill;
+    vad->fill = 0;
+}
+
+/**
+ * @brief       获取统计信息
+ * @param       vad   : 检测器
+ * @param       stats : 统计信息
+ * @retval      无
+ */
+void vad_get_stats(vad_t *vad, vad_stats_t *stats)
+{
+    *stats = vad->stats;
+    stats->frames = vad->pos + vad->fill;
+    stats->noise_floor = (uint32_t)vad->noise;
+    stats->active = vad->active;
+}
@@ -0,0 +1,96 @@
+/**
+ ****************************************************************************************************
+ * @file        vad.h
+ * @brief       基于能量和过零率的语音活动检测(16位PCM)
+ * @note        输入按frame_ms分帧,每帧计算平均能量和第一个声道的过零率.
+ *              能量高于自适应噪声基底threshold_db以上、过零率在[zcr_min, zcr_max]之间的帧为语音帧:
+ *              过零率太低的是哼声等低频噪声,太高的是宽带噪声.
+ *              连续attack_frames个语音帧开始一段,最后一个语音帧之后再保持hangover_ms才结束,
+ *              开始时先输出之前pre_roll_ms的数据,不会截掉起始的辅音.
+ *              只有段内的数据通过commit_fn输出,每段结束时通过segment_fn报告其位置.
+ *              ESP32-S3上帧能量用PIE指令每条处理8个采样点
+ ****************************************************************************************************
+ */
+
+#ifndef __VAD_H
+#define __VAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define VAD_CHANNELS_MAX    2           /* 最大声道数 */
+#define VAD_ENERGY_CHUNK    256         /* SIMD累加器每次累加的最大采样点数,满幅时不超过40位 */
+
+/* 一段语音的位置,单位都是帧(每声道采样数) */
+typedef struct
+{
+    uint32_t start;                     /* 在输入中的起点(含预录),即开始检测后的时间 */
+    uint32_t offset;                    /* 在输出中的起点,即之前各段长度之和 */
+    uint32_t frames;                    /* 长度(含预录和拖尾) */
+} vad_segment_t;
+
+/* 输出段内的数据,frames为帧数 */
+typedef void (*vad_commit_fn_t)(const int16_t *pcm, size_t frames, void *arg);
+
+/* 一段结束 */
+typedef void (*vad_segment_fn_t)(const vad_segment_t *segment, void *arg);
+
+typedef struct
+{
+    uint32_t sample_rate;               /* 采样率 */
+    uint8_t channels;                   /* 声道数,1或2 */
+    uint8_t frame_ms;                   /* 分析帧长度,通常10ms */
+    uint8_t attack_frames;              /* 开始一段需要的连续语音帧数 */
+    uint8_t threshold_db;               /* 语音帧能量至少高于噪声基底的分贝数 */
+    uint16_t hangover_ms;               /* 最后一个语音帧之后保持的时长 */
+    uint16_t pre_roll_ms;               /* 一段开始前预录的时长 */
+    uint16_t zcr_min;                   /* 语音帧的最低过零率(每秒过零次数) */
+    uint16_t zcr_max;                   /* 语音帧的最高过零率(每秒过零次数) */
+    vad_commit_fn_t commit_fn;          /* 输出段内的数据,必须提供 */
+    vad_segment_fn_t segment_fn;        /* 一段结束,可为NULL */
+    void *arg;                          /* 回调参数 */
+} vad_config_t;
+
+typedef struct
+{
+    uint32_t frames;                    /* 输入的帧数 */
+    uint32_t committed;                 /* 输出的帧数 */
+    uint32_t segments;                  /* 已结束的段数 */
+    uint32_t noise_floor;               /* 当前噪声基底(每采样点平均能量) */
+    bool active;                        /* 是否在段内 */
+} vad_stats_t;
+
+typedef struct vad vad_t;
+
+/* 默认配置,48kHz语音 */
+#define VAD_DEFAULT_CONFIG() {          \
+    .sample_rate = 48000,               \
+    .channels = 2,                      \
+    .frame_ms = 10,                     \
+    .attack_frames = 3,                 \
+    .threshold_db = 9,                  \
+    .hangover_ms = 400,                 \
+    .pre_roll_ms = 300,                 \
+    .zcr_min = 150,                     \
+    .zcr_max = 12000,                   \
+}
+
+/* 函数声明 */
+vad_t *vad_create(const vad_config_t *config);                                          /* 创建 */
+void vad_delete(vad_t *vad);                                                            /* 删除 */
+void vad_reset(vad_t *vad);                                                             /* 回到段外,重新估计噪声基底 */
+void vad_write(vad_t *vad, const int16_t *pcm, size_t frames);                          /* 输入交错的PCM,不必是整帧 */
+void vad_flush(vad_t *vad);                                                             /* 结束正在进行的段 */
+void vad_get_stats(vad_t *vad, vad_stats_t *stats);                                     /* 获取统计信息 */
+
+/* 能量内核,返回平方和 */
+uint64_t vad_energy(const int16_t *x, size_t samples);                                  /* x按16字节对齐时使用SIMD */
+uint64_t vad_energy_ref(const int16_t *x, size_t samples);                              /* C参考实现 */
+
+/* 测试 */
+bool vad_selftest(void);                                                                /* 检查SIMD内核与参考实现一致,以及合成信号的分段 */
+void vad_bench(void);                                                                   /* 测量48kHz立体声检测的CPU占用 */
+
+#endif
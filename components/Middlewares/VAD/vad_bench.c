@@ -0,0 +1,267 @@
+/**
+ ****************************************************************************************************
+ * @file        vad_bench.c
+ * @brief       语音活动检测的正确性与CPU占用测试
+ * @note        合成信号:低噪声中间有一段语音样的双音,之后是工频哼声和满幅白噪声,
+ *              只有双音应被检测为一段
+ ****************************************************************************************************
+ */
+
+#include "vad.h"
+#include <math.h>
+#include <string.h>
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "vad";
+
+#define BENCH_RATE          48000                               /* 测试采样率 */
+#define BENCH_SECONDS       10                                  /* CPU占用测试的音频时长 */
+#define BENCH_CHUNK         1024                                /* 每次输入的帧数,与录音每次读取I2S相同 */
+#define BENCH_SEGMENTS_MAX  8
+
+typedef enum
+{
+    BENCH_NOISE,                                                /* 低噪声,约±32 */
+    BENCH_SPEECH,                                               /* 300Hz和2kHz双音 */
+    BENCH_HUM,                                                  /* 50Hz哼声,过零率太低 */
+    BENCH_HISS,                                                 /* 满幅白噪声,过零率太高 */
+} bench_kind_t;
+
+typedef struct
+{
+    bench_kind_t kind;
+    uint32_t ms;
+} bench_part_t;
+
+static const bench_part_t s_parts[] = {
+    { BENCH_NOISE, 1000 },
+    { BENCH_SPEECH, 500 },
+    { BENCH_NOISE, 2000 },
+    { BENCH_HUM, 1000 },
+    { BENCH_NOISE, 500 },
+    { BENCH_HISS, 500 },
+    { BENCH_NOISE, 1000 },
+};
+
+static vad_segment_t s_segments[BENCH_SEGMENTS_MAX];
+static uint32_t s_segment_count;
+static uint32_t s_committed;
+
+static void bench_commit(const int16_t *pcm, size_t frames, void *arg)
+{
+    s_committed += frames;
+}
+
+static void bench_segment(const vad_segment_t *segment, void *arg)
+{
+    if (s_segment_count < BENCH_SEGMENTS_MAX)
+    {
+        s_segments[s_segment_count] = *segment;
+    }
+
+    s_segment_count++;
+}
+
+/**
+ * @brief       生成一块合成信号
+ * @param       buf    : 16位立体声
+ * @param       pos    : 第一帧在整个信号中的位置
+ * @param       frames : 帧数
+ */
+static void bench_signal(int16_t *buf, uint32_t pos, size_t frames, uint32_t *seed)
+{
+    uint32_t total = 0;
+
+    for (size_t i = 0; i < sizeof(s_parts) / sizeof(s_parts[0]); i++)
+    {
+        total += s_parts[i].ms;
+    }
+
+    for (size_t n = 0; n < frames; n++)
+    {
+        uint32_t t = pos + n;
+        uint32_t ms = (uint64_t)t * 1000 / BENCH_RATE % total;        /* 超出各段总长后循环 */
+        bench_kind_t kind = BENCH_NOISE;
+
+        for (size_t i = 0; i < sizeof(s_parts) / sizeof(s_parts[0]); i++)
+        {
+            if (ms < s_parts[i].ms)
+            {
+                kind = s_parts[i].kind;
+                break;
+            }
+            ms -= s_parts[i].ms;
+        }
+
+        *seed = *seed * 1664525 + 1013904223;
+        float v = (int32_t)(*seed >> 26) - 32;
+
+        switch (kind)
+        {
+            case BENCH_SPEECH:
+                v += 6000 * sinf(2 * M_PI * 300.0f * t / BENCH_RATE) + 3000 * sinf(2 * M_PI * 2000.0f * t / BENCH_RATE);
+                break;
+            case BENCH_HUM:
+                v += 8000 * sinf(2 * M_PI * 50.0f * t / BENCH_RATE);
+                break;
+            case BENCH_HISS:
+                v = (int16_t)(*seed >> 16);
+                break;
+            default:
+                break;
+        }
+
+        buf[2 * n] = (int16_t)v;
+        buf[2 * n + 1] = (int16_t)v;
+    }
+}
+
+/**
+ * @brief       检查SIMD内核与参考实现一致,以及合成信号的分段
+ * @note        内核覆盖对齐/不对齐、不是8的倍数和超过VAD_ENERGY_CHUNK的长度以及满幅输入;
+ *              分段应只有一段,从双音之前不超过预录时长处开始,包含双音和拖尾
+ * @param       无
+ * @retval      true:通过
+ */
+bool vad_selftest(void)
+{
+    static const size_t lengths[] = { 0, 1, 7, 8, 9, 255, 256, 257, 960, 1000 };
+    static int16_t x[1008] __attribute__((aligned(16)));
+    static int16_t buf[BENCH_CHUNK * 2];
+    uint32_t seed = 12345;
+    bool ok = true;
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (size_t i = 0; i < 1008; i++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            x[i] = pass ? INT16_MIN : (int16_t)(seed >> 16);
+        }
+
+        for (size_t offset = 0; offset < 2; offset++)
+        {
+            for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+            {
+                ok &= vad_energy(x + offset, lengths[l]) == vad_energy_ref(x + offset, lengths[l]);
+            }
+        }
+    }
+
+    vad_config_t config = VAD_DEFAULT_CONFIG();
+    config.commit_fn = bench_commit;
+    config.segment_fn = bench_segment;
+
+    vad_t *vad = vad_create(&config);
+    if (!vad)
+    {
+        return false;
+    }
+
+    s_segment_count = 0;
+    s_committed = 0;
+
+    uint32_t total = 0;
+    for (size_t i = 0; i < sizeof(s_parts) / sizeof(s_parts[0]); i++)
+    {
+        total += s_parts[i].ms * (BENCH_RATE / 1000);
+    }
+
+    for (uint32_t pos = 0; pos < total; pos += BENCH_CHUNK)
+    {
+        size_t n = (total - pos < BENCH_CHUNK) ? total - pos : BENCH_CHUNK;
+        bench_signal(buf, pos, n, &seed);
+        vad_write(vad, buf, n);
+    }
+
+    vad_flush(vad);
+
+    vad_stats_t stats;
+    vad_get_stats(vad, &stats);
+    vad_delete(vad);
+
+    uint32_t onset = s_parts[0].ms * (BENCH_RATE / 1000);
+    uint32_t burst = s_parts[1].ms * (BENCH_RATE / 1000);
+    uint32_t pre_roll = config.pre_roll_ms * (BENCH_RATE / 1000);
+    uint32_t hangover = config.hangover_ms * (BENCH_RATE / 1000);
+    uint32_t frame = config.frame_ms * (BENCH_RATE / 1000);
+
+    ok &= s_segment_count == 1 && stats.segments == 1 && stats.frames == total;
+
+    if (s_segment_count == 1)
+    {
+        const vad_segment_t *seg = &s_segments[0];
+
+        ESP_LOGI(TAG, "segment at %lu ms, %lu ms long", seg->start / (BENCH_RATE / 1000), seg->frames / (BENCH_RATE / 1000));
+        ok &= seg->offset == 0 && seg->frames == s_committed;
+        ok &= seg->start <= onset && seg->start + pre_roll + frame >= onset;
+        ok &= seg->start + seg->frames >= onset + burst + hangover &&
+              seg->start + seg->frames <= onset + burst + hangover + 2 * frame;
+    }
+
+    return ok;
+}
+
+/**
+ * @brief       测量48kHz立体声检测的CPU占用
+ * @note        结果应远低于一个核心的1%
+ * @param       无
+ * @retval      无
+ */
+void vad_bench(void)
+{
+    const uint32_t chunks = BENCH_RATE * BENCH_SECONDS / BENCH_CHUNK;
+    int16_t *buf = heap_caps_malloc(BENCH_CHUNK * 4, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    int16_t *frame = heap_caps_aligned_alloc(16, 960 * 2, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    vad_config_t config = VAD_DEFAULT_CONFIG();
+    config.commit_fn = bench_commit;
+    vad_t *vad = vad_create(&config);
+    uint32_t seed = 1;
+
+    if (!buf || !frame || !vad)
+    {
+        ESP_LOGE(TAG, "bench: no memory");
+        goto out;
+    }
+
+    ESP_LOGI(TAG, "selftest %s", vad_selftest() ? "passed" : "FAILED");
+
+    /* 能量内核,每个10ms立体声分析帧960个采样点 */
+    bench_signal(frame, 48000, 480, &seed);
+    const uint32_t frames = BENCH_RATE * BENCH_SECONDS / 480;
+    volatile uint64_t sink = 0;
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        sink += vad_energy_ref(frame, 960);
+    }
+    int64_t ref_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        sink += vad_energy(frame, 960);
+    }
+    int64_t simd_us = esp_timer_get_time() - start;
+
+    /* 整个检测,生成信号不计时 */
+    int64_t total_us = 0;
+    for (uint32_t c = 0; c < chunks; c++)
+    {
+        bench_signal(buf, c * BENCH_CHUNK, BENCH_CHUNK, &seed);
+        start = esp_timer_get_time();
+        vad_write(vad, buf, BENCH_CHUNK);
+        total_us += esp_timer_get_time() - start;
+    }
+
+    ESP_LOGI(TAG, "energy: reference %lld us, simd %lld us for %d s", ref_us, simd_us, BENCH_SECONDS);
+    uint32_t load = total_us / (BENCH_SECONDS * 100);                /* 占一个核心的万分比 */
+    ESP_LOGI(TAG, "vad_write %3lu.%02lu%% of one core", load / 100, load % 100);
+
+out:
+    vad_delete(vad);
+    heap_caps_free(frame);
+    heap_caps_free(buf);
+}
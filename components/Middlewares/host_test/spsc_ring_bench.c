@@ -0,0 +1,292 @@
+/**
+ ****************************************************************************************************
+ * @file        spsc_ring_bench.c
+ * @brief       环形缓冲区吞吐量测试(主机)
+ * @note        对比原http.c中的实现(互斥锁保护,逐字节拷贝并取模)与spsc_ring:
+ *              单线程交替写入/读出1000字节的数据块(与HTTP事件的数据块大小相当),只测量缓冲区本身的开销;
+ *              再用生产者和消费者两个线程同时读写,测量实际的并发吞吐量并检查无锁同步没有丢失或打乱数据.
+ *              数据出错时返回非零,吞吐量只打印
+ ****************************************************************************************************
+ */
+
+#define _GNU_SOURCE 1
+#include "spsc_ring.h"
+#include "esp_heap_caps.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_RING_SIZE     (8 * 1024)          /* 与原http.c的RINGBUF_SIZE相同 */
+#define BENCH_CHUNK         1000                /* 每次写入/读出的字节数,不能整除缓冲区,覆盖回绕路径 */
+#define BENCH_TOTAL         (64 * 1024 * 1024)  /* 单线程每项传输的总字节数 */
+#define BENCH_THREAD_TOTAL  (256 * 1024 * 1024) /* 双线程每项传输的总字节数 */
+
+/* 原http.c实现,FreeRTOS互斥锁换成pthread互斥锁 */
+static uint8_t legacy_buf[BENCH_RING_SIZE];
+static int legacy_write_pos = 0;
+static int legacy_read_pos = 0;
+static pthread_mutex_t legacy_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int legacy_write(const uint8_t *data, int len)
+{
+    pthread_mutex_lock(&legacy_mutex);
+
+    int free_space = (legacy_write_pos >= legacy_read_pos)
+                     ? BENCH_RING_SIZE - (legacy_write_pos - legacy_read_pos) - 1
+                     : (legacy_read_pos - legacy_write_pos) - 1;
+
+    if (len > free_space) len = free_space;
+
+    for (int i = 0; i < len; i++) {
+        legacy_buf[legacy_write_pos] = data[i];
+        legacy_write_pos = (legacy_write_pos + 1) % BENCH_RING_SIZE;
+    }
+
+    pthread_mutex_unlock(&legacy_mutex);
+    return len;
+}
+
+static int legacy_read(uint8_t *buf, int len)
+{
+    pthread_mutex_lock(&legacy_mutex);
+
+    int data_len = (legacy_write_pos >= legacy_read_pos)
+                   ? (legacy_write_pos - legacy_read_pos)
+                   : (BENCH_RING_SIZE - (legacy_read_pos - legacy_write_pos));
+
+    if (len > data_len) len = data_len;
+
+    for (int i = 0; i < len; i++) {
+        buf[i] = legacy_buf[legacy_read_pos];
+        legacy_read_pos = (legacy_read_pos + 1) % BENCH_RING_SIZE;
+    }
+
+    pthread_mutex_unlock(&legacy_mutex);
+    return len;
+}
+
+static spsc_ring_t ring;
+static int errors;
+
+/**
+ * @brief       单调时钟,秒
+ */
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * @brief       数据流中第pos个字节的值,消费者据此检查顺序
+ */
+static inline uint8_t pattern(uint32_t pos)
+{
+    return (uint8_t)(pos ^ (pos >> 8) ^ (pos >> 16) ^ (pos >> 24));
+}
+
+/**
+ * @brief       打印吞吐量
+ */
+static void bench_report(const char *name, uint64_t bytes, double s, bool ok)
+{
+    printf("%-26s %9.1f MB/s %s\n", name, bytes / s / 1e6, ok ? "" : "DATA ERROR");
+    errors += !ok;
+}
+
+/**
+ * @brief       单线程交替写入/读出
+ */
+static void bench_single(const uint8_t *src, uint8_t *dst)
+{
+    bool ok = true;
+    double start = now_s();
+
+    for (uint32_t done = 0; done < BENCH_TOTAL; done += BENCH_CHUNK)
+    {
+        legacy_write(src, BENCH_CHUNK);
+        ok &= legacy_read(dst, BENCH_CHUNK) == BENCH_CHUNK;
+    }
+
+    bench_report("mutex + per-byte", BENCH_TOTAL, now_s() - start, ok && memcmp(src, dst, BENCH_CHUNK) == 0);
+
+    start = now_s();
+
+    for (uint32_t done = 0; done < BENCH_TOTAL; done += BENCH_CHUNK)
+    {
+        spsc_ring_write(&ring, src, BENCH_CHUNK);
+        ok &= spsc_ring_read(&ring, dst, BENCH_CHUNK) == BENCH_CHUNK;
+    }
+
+    bench_report("spsc write/read", BENCH_TOTAL, now_s() - start, ok && memcmp(src, dst, BENCH_CHUNK) == 0);
+
+    start = now_s();
+
+    for (uint32_t done = 0; done < BENCH_TOTAL; done += BENCH_CHUNK)
+    {
+        /* 生产者原地写入,消费者原地读取,回绕时分两段 */
+        uint32_t left = BENCH_CHUNK;
+        while (left)
+        {
+            uint32_t len = left;
+            uint8_t *p = spsc_ring_reserve(&ring, &len);
+            memcpy(p, src + BENCH_CHUNK - left, len);
+            spsc_ring_commit(&ring, len);
+            left -= len;
+        }
+
+        left = BENCH_CHUNK;
+        while (left)
+        {
+            uint32_t len = left;
+            const uint8_t *p = spsc_ring_peek(&ring, 0, &len);
+            ok &= memcmp(p, src + BENCH_CHUNK - left, len) == 0;
+            spsc_ring_release(&ring, len);
+            left -= len;
+        }
+    }
+
+    bench_report("spsc reserve/peek", BENCH_TOTAL, now_s() - start, ok);
+}
+
+/* 双线程:生产者按pattern写入,消费者逐字节检查 */
+typedef struct
+{
+    bool spsc;                      /* true:spsc_ring; false:原实现 */
+    bool ok;                        /* 消费者检查的结果 */
+} thread_arg_t;
+
+static void *producer(void *param)
+{
+    thread_arg_t *arg = param;
+    uint8_t chunk[BENCH_CHUNK];
+    uint32_t pos = 0;
+
+    while (pos < BENCH_THREAD_TOTAL)
+    {
+        uint32_t len = BENCH_THREAD_TOTAL - pos < BENCH_CHUNK ? BENCH_THREAD_TOTAL - pos : BENCH_CHUNK;
+
+        if (arg->spsc)
+        {
+            uint8_t *p = spsc_ring_reserve(&ring, &len);
+            for (uint32_t i = 0; i < len; i++)
+            {
+                p[i] = pattern(pos + i);
+            }
+            spsc_ring_commit(&ring, len);
+        }
+        else
+        {
+            for (uint32_t i = 0; i < len; i++)
+            {
+                chunk[i] = pattern(pos + i);
+            }
+            len = legacy_write(chunk, len);
+        }
+
+        if (len == 0)
+        {
+            sched_yield();                                              /* 缓冲区满 */
+        }
+        pos += len;
+    }
+
+    return NULL;
+}
+
+static void *consumer(void *param)
+{
+    thread_arg_t *arg = param;
+    uint8_t chunk[BENCH_CHUNK];
+    uint32_t pos = 0;
+
+    arg->ok = true;
+
+    while (pos < BENCH_THREAD_TOTAL)
+    {
+        uint32_t len = BENCH_CHUNK;
+        const uint8_t *p = chunk;
+
+        if (arg->spsc)
+        {
+            p = spsc_ring_peek(&ring, 0, &len);
+        }
+        else
+        {
+            len = legacy_read(chunk, len);
+        }
+
+        if (len == 0)
+        {
+            sched_yield();                                              /* 缓冲区空 */
+            continue;
+        }
+
+        for (uint32_t i = 0; i < len; i++)
+        {
+            if (p[i] != pattern(pos + i))
+            {
+                arg->ok = false;
+            }
+        }
+
+        if (arg->spsc)
+        {
+            spsc_ring_release(&ring, len);
+        }
+        pos += len;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief       生产者和消费者两个线程同时读写
+ */
+static void bench_threads(bool spsc)
+{
+    thread_arg_t arg = { .spsc = spsc };
+    pthread_t prod, cons;
+    double start = now_s();
+
+    pthread_create(&cons, NULL, consumer, &arg);
+    pthread_create(&prod, NULL, producer, &arg);
+    pthread_join(prod, NULL);
+    pthread_join(cons, NULL);
+
+    bench_report(spsc ? "spsc 2 threads" : "mutex + per-byte 2 threads", BENCH_THREAD_TOTAL, now_s() - start, arg.ok);
+}
+
+int main(void)
+{
+    uint8_t *src = malloc(BENCH_CHUNK);
+    uint8_t *dst = malloc(BENCH_CHUNK);
+
+    if (!src || !dst || spsc_ring_create(&ring, BENCH_RING_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) != ESP_OK)
+    {
+        fprintf(stderr, "no memory\n");
+        return 1;
+    }
+
+    for (int i = 0; i < BENCH_CHUNK; i++)
+    {
+        src[i] = i * 7 + 3;
+    }
+
+    printf("%d KB ring, %d byte blocks\n", BENCH_RING_SIZE / 1024, BENCH_CHUNK);
+    bench_single(src, dst);
+
+    spsc_ring_reset(&ring);
+    bench_threads(false);
+    bench_threads(true);
+
+    spsc_ring_delete(&ring);
+    free(src);
+    free(dst);
+
+    return errors ? 1 : 0;
+}
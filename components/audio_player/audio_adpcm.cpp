@@ -0,0 +1,150 @@
+#include "audio_adpcm.h"
+
+static const int16_t s_step_table[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31,
+    34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143,
+    157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658,
+    724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024,
+    3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t s_index_table[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+#define STEP_INDEX_MAX  88
+
+static inline int32_t clamp16(int32_t v) {
+    return (v > INT16_MAX) ? INT16_MAX : ((v < INT16_MIN) ? INT16_MIN : v);
+}
+
+static inline int32_t next_index(int32_t index, uint32_t nibble) {
+    index += s_index_table[nibble];
+    return (index < 0) ? 0 : ((index > STEP_INDEX_MAX) ? STEP_INDEX_MAX : index);
+}
+
+/** quantize the difference to the prediction, the prediction follows what the decoder will reconstruct */
+static inline uint32_t encode_sample(int32_t &pred, int32_t &index, int32_t sample) {
+    int32_t step = s_step_table[index];
+    int32_t diff = sample - pred;
+    uint32_t nibble = 0;
+
+    if(diff < 0) {
+        nibble = 8;
+        diff = -diff;
+    }
+
+    int32_t vpdiff = step >> 3;
+    if(diff >= step) {
+        nibble |= 4;
+        diff -= step;
+        vpdiff += step;
+    }
+    step >>= 1;
+    if(diff >= step) {
+        nibble |= 2;
+        diff -= step;
+        vpdiff += step;
+    }
+    step >>= 1;
+    if(diff >= step) {
+        nibble |= 1;
+        vpdiff += step;
+    }
+
+    pred = clamp16((nibble & 8) ? pred - vpdiff : pred + vpdiff);
+    index = next_index(index, nibble);
+    return nibble;
+}
+
+static inline int16_t decode_sample(int32_t &pred, int32_t &index, uint32_t nibble) {
+    int32_t step = s_step_table[index];
+    int32_t vpdiff = step >> 3;
+
+    if(nibble & 4) {
+        vpdiff += step;
+    }
+    if(nibble & 2) {
+        vpdiff += step >> 1;
+    }
+    if(nibble & 1) {
+        vpdiff += step >> 2;
+    }
+
+    pred = clamp16((nibble & 8) ? pred - vpdiff : pred + vpdiff);
+    index = next_index(index, nibble);
+    return static_cast<int16_t>(pred);
+}
+
+size_t audio_adpcm_samples_per_block(size_t block_align, uint32_t channels) {
+    if((channels == 0) || (channels > AUDIO_ADPCM_MAX_CHANNELS) || (block_align <= 4 * channels) ||
+       ((block_align - 4 * channels) % (4 * channels) != 0)) {
+        return 0;
+    }
+
+    return (block_align - 4 * channels) * 2 / channels + 1;
+}
+
+void audio_adpcm_encode_block(audio_adpcm_state_t *state, const int16_t *pcm, size_t frames,
+                              uint32_t channels, uint8_t *block, size_t block_align) {
+    size_t spb = audio_adpcm_samples_per_block(block_align, channels);
+    size_t last = (frames < spb ? frames : spb) - 1;
+
+    for(uint32_t ch = 0; ch < channels; ch++) {
+        int32_t pred = pcm[ch];
+        int32_t index = state->index[ch];
+
+        uint8_t *hdr = block + 4 * ch;
+        hdr[0] = static_cast<uint8_t>(pred);
+        hdr[1] = static_cast<uint8_t>(pred >> 8);
+        hdr[2] = static_cast<uint8_t>(index);
+        hdr[3] = 0;
+
+        // 8 samples go into 4 bytes, the groups of the channels alternate
+        uint8_t *out = block + 4 * channels + 4 * ch;
+        for(size_t n = 1; n < spb; n += 8) {
+            for(size_t k = 0; k < 8; k += 2) {
+                size_t a = (n + k <= last) ? n + k : last;
+                size_t b = (n + k + 1 <= last) ? n + k + 1 : last;
+                uint32_t lo = encode_sample(pred, index, pcm[a * channels + ch]);
+                uint32_t hi = encode_sample(pred, index, pcm[b * channels + ch]);
+                out[k / 2] = static_cast<uint8_t>(lo | (hi << 4));
+            }
+            out += 4 * channels;
+        }
+
+        state->index[ch] = static_cast<uint8_t>(index);
+    }
+}
+
+size_t audio_adpcm_decode_block(const uint8_t *block, size_t len, uint32_t channels, int16_t *pcm) {
+    if((channels == 0) || (channels > AUDIO_ADPCM_MAX_CHANNELS) || (len < 4 * channels)) {
+        return 0;
+    }
+
+    size_t groups = (len - 4 * channels) / (4 * channels);
+
+    for(uint32_t ch = 0; ch < channels; ch++) {
+        const uint8_t *hdr = block + 4 * ch;
+        int32_t pred = static_cast<int16_t>(hdr[0] | (hdr[1] << 8));
+        int32_t index = (hdr[2] > STEP_INDEX_MAX) ? STEP_INDEX_MAX : hdr[2];
+
+        int16_t *out = pcm + ch;
+        *out = static_cast<int16_t>(pred);
+        out += channels;
+
+        const uint8_t *in = block + 4 * channels + 4 * ch;
+        for(size_t g = 0; g < groups; g++) {
+            for(size_t k = 0; k < 4; k++) {
+                out[0] = decode_sample(pred, index, in[k] & 0x0f);
+                out[channels] = decode_sample(pred, index, in[k] >> 4);
+                out += 2 * channels;
+            }
+            in += 4 * channels;
+        }
+    }
+
+    return 1 + groups * 8;
+}
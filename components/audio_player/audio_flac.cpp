@@ -0,0 +1,978 @@
+#include <string.h>
+#include <stdlib.h>
+#include "audio_flac.h"
+#include "audio_prof.h"
+#include "esp_log.h"
+
+static const char *TAG = "flac";
+
+/** longest frame header: sync, codes, 7 byte coded number, 16 bit block size and rate, crc-8 */
+#define FLAC_HEADER_MAX     16
+
+/** size of a metadata block header */
+#define FLAC_META_HEADER    4
+#define FLAC_STREAMINFO_LEN 34
+#define FLAC_SEEKPOINT_LEN  18
+
+#define FLAC_META_STREAMINFO    0
+#define FLAC_META_SEEKTABLE     3
+#define FLAC_META_INVALID       127
+
+/** channel assignments of the frame header */
+#define FLAC_CH_LEFT_SIDE   8
+#define FLAC_CH_RIGHT_SIDE  9
+#define FLAC_CH_MID_SIDE    10
+
+/** largest LPC order and the number of times a position estimate is moved back when it overshoots */
+#define FLAC_MAX_LPC_ORDER  32
+#define FLAC_SEEK_RETRIES   4
+
+typedef enum {
+    FRAME_OK,
+    FRAME_NEED_DATA,    /*!< frame continues past the end of the buffered data */
+    FRAME_BAD,          /*!< not a frame, or a corrupt one */
+} frame_result_t;
+
+typedef struct {
+    uint32_t blocksize;
+    uint8_t assignment;     /*!< channel assignment code */
+    uint8_t bps;
+    uint64_t sample;        /*!< stream position of the first sample */
+    size_t header_len;
+} frame_header_t;
+
+/**
+ * MSB first bit reader. Bits past the end of the buffer read as zero and are
+ * counted in pad, so a frame that doesn't fit the buffer is detected afterwards
+ * instead of checking every read.
+ */
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t cache;         /*!< unread bits, MSB aligned, the bits below them are zero */
+    int bits;               /*!< number of unread bits in cache */
+    size_t pad;             /*!< zero bytes fed after the end of the buffer */
+} bitreader_t;
+
+static uint8_t s_crc8[256];
+static uint16_t s_crc16[256];
+
+static void crc_init(void) {
+    if(s_crc16[1]) {
+        return;
+    }
+    for(int i = 0; i < 256; i++) {
+        uint8_t c8 = i;
+        uint16_t c16 = i << 8;
+        for(int b = 0; b < 8; b++) {
+            c8 = (c8 & 0x80) ? (c8 << 1) ^ 0x07 : (c8 << 1);
+            c16 = (c16 & 0x8000) ? (c16 << 1) ^ 0x8005 : (c16 << 1);
+        }
+        s_crc8[i] = c8;
+        s_crc16[i] = c16;
+    }
+}
+
+static uint8_t crc8(const uint8_t *p, size_t len) {
+    uint8_t crc = 0;
+    while(len--) {
+        crc = s_crc8[crc ^ *p++];
+    }
+    return crc;
+}
+
+static uint16_t crc16(const uint8_t *p, size_t len) {
+    uint16_t crc = 0;
+    while(len--) {
+        crc = (crc << 8) ^ s_crc16[(crc >> 8) ^ *p++];
+    }
+    return crc;
+}
+
+static inline void br_init(bitreader_t *r, const uint8_t *p, size_t len) {
+    r->p = p;
+    r->end = p + len;
+    r->cache = 0;
+    r->bits = 0;
+    r->pad = 0;
+}
+
+static inline void br_refill(bitreader_t *r) {
+    if(r->end - r->p >= 8) {
+        // load as many whole bytes as fit below the unread bits
+        int n = (64 - r->bits) >> 3;
+        uint64_t w;
+        memcpy(&w, r->p, sizeof(w));    // unaligned
+        w = __builtin_bswap64(w);
+        if(n < 8) {
+            w >>= 64 - 8 * n;
+        }
+        r->cache |= w << (64 - r->bits - 8 * n);
+        r->p += n;
+        r->bits += 8 * n;
+        return;
+    }
+    while(r->bits <= 56) {
+        uint64_t b = 0;
+        if(r->p < r->end) {
+            b = *r->p++;
+        } else {
+            r->pad++;
+        }
+        r->cache |= b << (56 - r->bits);
+        r->bits += 8;
+    }
+}
+
+/** read n <= 32 bits */
+static inline uint32_t br_read(bitreader_t *r, int n) {
+    if(n == 0) {
+        return 0;
+    }
+    if(r->bits < n) {
+        br_refill(r);
+    }
+    uint32_t v = static_cast<uint32_t>(r->cache >> (64 - n));
+    r->cache <<= n;
+    r->bits -= n;
+    return v;
+}
+
+static inline int32_t br_read_signed(bitreader_t *r, int n) {
+    if(n == 0) {
+        return 0;
+    }
+    return static_cast<int32_t>(br_read(r, n) << (32 - n)) >> (32 - n);
+}
+
+/** count zero bits up to the next one bit and skip over it */
+static inline uint32_t br_unary(bitreader_t *r) {
+    uint32_t q = 0;
+    for(;;) {
+        if(r->cache) {
+            int lz = __builtin_clzll(r->cache);
+            r->cache = (lz == 63) ? 0 : r->cache << (lz + 1);
+            r->bits -= lz + 1;
+            return q + lz;
+        }
+        q += r->bits;
+        r->bits = 0;
+        if(r->pad > 8) {
+            return q;       // ran off the end, the caller sees the overrun
+        }
+        br_refill(r);
+    }
+}
+
+/** bytes consumed, after the reader was aligned to a byte */
+static inline size_t br_consumed(const bitreader_t *r, const uint8_t *start) {
+    return (r->p - start) + r->pad - r->bits / 8;
+}
+
+static uint32_t read_be(const uint8_t *p, int n) {
+    uint32_t v = 0;
+    while(n--) {
+        v = (v << 8) | *p++;
+    }
+    return v;
+}
+
+static bool parse_frame_header(const flac_instance *f, const uint8_t *p, size_t avail, frame_header_t *h) {
+    static const uint32_t rates[12] = {
+        0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100, 48000, 96000,
+    };
+    static const uint8_t sizes[8] = { 0, 8, 12, 0, 16, 20, 24, 0 };
+
+    if(avail < 6 || p[0] != 0xFF || (p[1] & 0xFE) != 0xF8) {
+        return false;
+    }
+
+    bool variable = p[1] & 0x01;
+    uint32_t bs_code = p[2] >> 4;
+    uint32_t rate_code = p[2] & 0x0F;
+    uint32_t assignment = p[3] >> 4;
+    uint32_t size_code = (p[3] >> 1) & 0x07;
+
+    if((bs_code == 0) || (rate_code == 15) || (assignment > FLAC_CH_MID_SIDE) ||
+       (sizes[size_code] == 0 && size_code != 0) || (p[3] & 0x01)) {
+        return false;
+    }
+
+    // frame or sample number, coded like UTF-8 up to 36 bits
+    size_t pos = 4;
+    uint32_t extra = 0;
+    uint64_t number = p[pos];
+    if(number >= 0x80) {
+        if(number == 0xFE) {
+            extra = 6;
+            number = 0;
+        } else {
+            while(number & (0x40 >> extra)) {
+                extra++;
+            }
+            if((extra == 0) || (extra > 5)) {
+                return false;
+            }
+            number &= 0x3F >> extra;
+        }
+    }
+    pos++;
+    if(pos + extra > avail) {
+        return false;
+    }
+    for(uint32_t i = 0; i < extra; i++, pos++) {
+        if((p[pos] & 0xC0) != 0x80) {
+            return false;
+        }
+        number = (number << 6) | (p[pos] & 0x3F);
+    }
+
+    uint32_t blocksize;
+    if(bs_code == 1) {
+        blocksize = 192;
+    } else if(bs_code <= 5) {
+        blocksize = 576 << (bs_code - 2);
+    } else if(bs_code <= 7) {
+        int n = bs_code - 5;
+        if(pos + n > avail) {
+            return false;
+        }
+        blocksize = read_be(p + pos, n) + 1;
+        pos += n;
+    } else {
+        blocksize = 256 << (bs_code - 8);
+    }
+
+    uint32_t rate = f->sample_rate;
+    if(rate_code >= 12) {
+        int n = (rate_code == 12) ? 1 : 2;
+        if(pos + n > avail) {
+            return false;
+        }
+        rate = read_be(p + pos, n);
+        rate *= (rate_code == 12) ? 1000 : (rate_code == 14) ? 10 : 1;
+        pos += n;
+    } else if(rate_code) {
+        rate = rates[rate_code];
+    }
+
+    if(pos + 1 > avail || crc8(p, pos) != p[pos]) {
+        return false;
+    }
+    pos++;
+
+    // a header that disagrees with STREAMINFO is a false sync inside frame data
+    uint32_t channels = (assignment >= FLAC_CH_LEFT_SIDE) ? 2 : assignment + 1;
+    uint32_t bps = size_code ? sizes[size_code] : f->bits_per_sample;
+    if((channels != f->channels) || (bps != f->bits_per_sample) || (rate != f->sample_rate) ||
+       (blocksize > f->block_capacity)) {
+        return false;
+    }
+
+    h->blocksize = blocksize;
+    h->assignment = assignment;
+    h->bps = bps;
+    h->sample = variable ? number : number * f->min_blocksize;
+    h->header_len = pos;
+    return true;
+}
+
+static bool decode_residual(bitreader_t *r, int32_t *res, uint32_t blocksize, uint32_t order) {
+    uint32_t method = br_read(r, 2);
+    if(method > 1) {
+        return false;
+    }
+    int param_bits = method ? 5 : 4;
+    uint32_t escape = method ? 31 : 15;
+    uint32_t porder = br_read(r, 4);
+    uint32_t part_len = blocksize >> porder;
+
+    if((part_len << porder != blocksize) || (part_len < order)) {
+        return false;
+    }
+
+    for(uint32_t part = 0; part < (1u << porder); part++) {
+        uint32_t n = part ? part_len : part_len - order;
+        uint32_t k = br_read(r, param_bits);
+
+        if(k == escape) {
+            int bits = br_read(r, 5);
+            for(uint32_t i = 0; i < n; i++) {
+                res[i] = br_read_signed(r, bits);
+            }
+        } else {
+            for(uint32_t i = 0; i < n; i++) {
+                uint32_t v = (br_unary(r) << k) | br_read(r, k);
+                res[i] = static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1);
+            }
+        }
+
+        res += n;
+        if(r->pad > 8) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void restore_fixed(int32_t *s, uint32_t n, uint32_t order) {
+    switch(order) {
+        case 1:
+            for(uint32_t i = 1; i < n; i++) {
+                s[i] += s[i - 1];
+            }
+            break;
+        case 2:
+            for(uint32_t i = 2; i < n; i++) {
+                s[i] += 2 * s[i - 1] - s[i - 2];
+            }
+            break;
+        case 3:
+            for(uint32_t i = 3; i < n; i++) {
+                s[i] += 3 * (s[i - 1] - s[i - 2]) + s[i - 3];
+            }
+            break;
+        case 4:
+            for(uint32_t i = 4; i < n; i++) {
+                s[i] += 4 * (s[i - 1] + s[i - 3]) - 6 * s[i - 2] - s[i - 4];
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+static void restore_lpc(int32_t *s, uint32_t n, const int32_t *coef, uint32_t order, int shift, bool wide) {
+    if(wide) {
+        for(uint32_t i = order; i < n; i++) {
+            int64_t sum = 0;
+            for(uint32_t j = 0; j < order; j++) {
+                sum += static_cast<int64_t>(coef[j]) * s[i - 1 - j];
+            }
+            s[i] += static_cast<int32_t>(sum >> shift);
+        }
+    } else {
+        // the sum fits 32 bits, which is the case for 16 bit audio
+        for(uint32_t i = order; i < n; i++) {
+            int32_t sum = 0;
+            for(uint32_t j = 0; j < order; j++) {
+                sum += coef[j] * s[i - 1 - j];
+            }
+            s[i] += sum >> shift;
+        }
+    }
+}
+
+static bool decode_subframe(bitreader_t *r, int32_t *s, uint32_t blocksize, uint32_t bps) {
+    if(br_read(r, 1) != 0) {
+        return false;
+    }
+    uint32_t type = br_read(r, 6);
+    uint32_t wasted = 0;
+    if(br_read(r, 1)) {
+        wasted = br_unary(r) + 1;
+        if(wasted >= bps) {
+            return false;
+        }
+        bps -= wasted;
+    }
+
+    if(type == 0) {
+        int32_t v = br_read_signed(r, bps);
+        for(uint32_t i = 0; i < blocksize; i++) {
+            s[i] = v;
+        }
+    } else if(type == 1) {
+        for(uint32_t i = 0; i < blocksize; i++) {
+            s[i] = br_read_signed(r, bps);
+        }
+    } else if((type >= 8) && (type <= 12)) {
+        uint32_t order = type - 8;
+        if(order > blocksize) {
+            return false;
+        }
+        for(uint32_t i = 0; i < order; i++) {
+            s[i] = br_read_signed(r, bps);
+        }
+        if(!decode_residual(r, s + order, blocksize, order)) {
+            return false;
+        }
+        restore_fixed(s, blocksize, order);
+    } else if(type >= 32) {
+        uint32_t order = type - 31;
+        int32_t coef[FLAC_MAX_LPC_ORDER];
+        if(order > blocksize) {
+            return false;
+        }
+        for(uint32_t i = 0; i < order; i++) {
+            s[i] = br_read_signed(r, bps);
+        }
+        uint32_t precision = br_read(r, 4) + 1;
+        int shift = br_read_signed(r, 5);
+        if((precision == 16) || (shift < 0)) {
+            return false;
+        }
+        for(uint32_t i = 0; i < order; i++) {
+            coef[i] = br_read_signed(r, precision);
+        }
+        if(!decode_residual(r, s + order, blocksize, order)) {
+            return false;
+        }
+        // order coefficients of precision bits times samples of bps bits
+        uint32_t log2_order = 32 - __builtin_clz(order);
+        restore_lpc(s, blocksize, coef, order, shift, bps + precision + log2_order > 32);
+    } else {
+        return false;
+    }
+
+    if(wasted) {
+        for(uint32_t i = 0; i < blocksize; i++) {
+            s[i] = static_cast<int32_t>(static_cast<uint32_t>(s[i]) << wasted);
+        }
+    }
+
+    return true;
+}
+
+static frame_result_t decode_frame(flac_instance *f, const uint8_t *p, size_t avail,
+                                   frame_header_t *h, size_t *used) {
+    if(!parse_frame_header(f, p, avail, h)) {
+        return (avail < FLAC_HEADER_MAX) ? FRAME_NEED_DATA : FRAME_BAD;
+    }
+
+    bitreader_t r;
+    br_init(&r, p + h->header_len, avail - h->header_len);
+
+    for(uint32_t ch = 0; ch < f->channels; ch++) {
+        // the side channel has one more bit
+        bool side = ((h->assignment == FLAC_CH_LEFT_SIDE) && (ch == 1)) ||
+                    ((h->assignment == FLAC_CH_RIGHT_SIDE) && (ch == 0)) ||
+                    ((h->assignment == FLAC_CH_MID_SIDE) && (ch == 1));
+        if(!decode_subframe(&r, f->block[ch], h->blocksize, h->bps + side)) {
+            return (r.pad > 8) ? FRAME_NEED_DATA : FRAME_BAD;
+        }
+    }
+
+    // zero padding up to a byte, then the crc-16 of the whole frame
+    br_read(&r, r.bits & 7);
+    uint16_t crc = br_read(&r, 16);
+    size_t len = h->header_len + br_consumed(&r, p + h->header_len);
+    if(len > avail) {
+        return FRAME_NEED_DATA;
+    }
+    if(crc16(p, len - 2) != crc) {
+        return FRAME_BAD;
+    }
+
+    int32_t *a = f->block[0];
+    int32_t *b = f->block[1];
+    switch(h->assignment) {
+        case FLAC_CH_LEFT_SIDE:
+            for(uint32_t i = 0; i < h->blocksize; i++) {
+                b[i] = a[i] - b[i];
+            }
+            break;
+        case FLAC_CH_RIGHT_SIDE:
+            for(uint32_t i = 0; i < h->blocksize; i++) {
+                a[i] += b[i];
+            }
+            break;
+        case FLAC_CH_MID_SIDE:
+            for(uint32_t i = 0; i < h->blocksize; i++) {
+                int32_t side = b[i];
+                int32_t mid = static_cast<int32_t>(static_cast<uint32_t>(a[i]) << 1) | (side & 1);
+                a[i] = (mid + side) >> 1;
+                b[i] = (mid - side) >> 1;
+            }
+            break;
+        default:
+            break;
+    }
+
+    *used = len;
+    return FRAME_OK;
+}
+
+/** offset of the next frame sync code in p, or len if there is none */
+static size_t find_sync(const uint8_t *p, size_t len) {
+    const uint8_t *start = p;
+    const uint8_t *end = p + len;
+
+    while(p + 1 < end) {
+        p = static_cast<const uint8_t *>(memchr(p, 0xFF, end - p - 1));
+        if(!p) {
+            break;
+        }
+        if((p[1] & 0xFE) == 0xF8) {
+            return p - start;
+        }
+        p++;
+    }
+
+    return len;
+}
+
+/**
+ * Move the unread data to the start of the buffer and fill it up, done when
+ * less than a whole frame is left or when force is set
+ */
+static void fill_input(FILE *fp, flac_instance *f, bool force) {
+    size_t unread = f->in_len - f->in_pos;
+
+    if(f->eof_reached || (!force && (unread >= f->frame_bound)) || (unread == f->in_size)) {
+        return;
+    }
+
+    memmove(f->in_buf, f->in_buf + f->in_pos, unread);
+    f->in_offset += f->in_pos;
+
+    uint32_t t = audio_prof_start();
+    size_t n = fread(f->in_buf + unread, 1, f->in_size - unread, fp);
+    audio_prof_stop(AUDIO_PROF_READ, t);
+    audio_prof_count(AUDIO_PROF_BYTES_READ, n);
+
+    f->in_len = unread + n;
+    f->in_pos = 0;
+    if((n == 0) || feof(fp)) {
+        f->eof_reached = true;
+    }
+}
+
+static bool read_seektable(FILE *fp, flac_instance *f, uint32_t len) {
+    uint32_t count = len / FLAC_SEEKPOINT_LEN;
+    uint32_t keep = (count > FLAC_SEEK_POINTS_MAX) ? FLAC_SEEK_POINTS_MAX : count;
+
+    f->seek_count = 0;
+    if(keep > f->seek_capacity) {
+        flac_seekpoint_t *table = static_cast<flac_seekpoint_t *>(realloc(f->seektable, keep * sizeof(flac_seekpoint_t)));
+        if(!table) {
+            return fseek(fp, len, SEEK_CUR) == 0;   // play without it
+        }
+        f->seektable = table;
+        f->seek_capacity = keep;
+    }
+
+    // large tables are thinned out to evenly spaced points
+    uint32_t next = 0;
+    for(uint32_t i = 0; i < count; i++) {
+        uint8_t point[FLAC_SEEKPOINT_LEN];
+        if(fread(point, 1, sizeof(point), fp) != sizeof(point)) {
+            return false;
+        }
+        if(i != static_cast<uint64_t>(next) * count / keep) {
+            continue;
+        }
+        next++;
+
+        uint64_t sample = (static_cast<uint64_t>(read_be(point, 4)) << 32) | read_be(point + 4, 4);
+        uint64_t offset = (static_cast<uint64_t>(read_be(point + 8, 4)) << 32) | read_be(point + 12, 4);
+        if(sample != UINT64_MAX) {      // placeholder
+            f->seektable[f->seek_count].sample = sample;
+            f->seektable[f->seek_count].offset = offset;
+            f->seek_count++;
+        }
+    }
+
+    return fseek(fp, len % FLAC_SEEKPOINT_LEN, SEEK_CUR) == 0;
+}
+
+static void parse_streaminfo(const uint8_t *p, flac_instance *f) {
+    f->min_blocksize = read_be(p, 2);
+    f->max_blocksize = read_be(p + 2, 2);
+    f->max_framesize = read_be(p + 7, 3);
+    f->sample_rate = read_be(p + 10, 3) >> 4;
+    f->channels = ((p[12] >> 1) & 0x07) + 1;
+    f->bits_per_sample = (((p[12] & 0x01) << 4) | (p[13] >> 4)) + 1;
+    f->total_samples = (static_cast<uint64_t>(p[13] & 0x0F) << 32) | read_be(p + 14, 4);
+}
+
+/** (re)allocate the buffers for the stream parsed into f */
+static bool alloc_buffers(flac_instance *f) {
+    // without a max_framesize the worst case is a verbatim frame, the side channel has one more bit
+    size_t bound = f->max_framesize;
+    if(bound == 0) {
+        bound = (static_cast<size_t>(f->max_blocksize) * (f->bits_per_sample + 1) * f->channels + 7) / 8 + 64;
+    }
+    f->frame_bound = bound;
+
+    if(2 * bound > f->in_size) {
+        uint8_t *buf = static_cast<uint8_t *>(realloc(f->in_buf, 2 * bound));
+        if(!buf) {
+            return false;
+        }
+        f->in_buf = buf;
+        f->in_size = 2 * bound;
+    }
+
+    if(f->max_blocksize > f->block_capacity) {
+        for(int ch = 0; ch < FLAC_MAX_CHANNELS; ch++) {
+            int32_t *block = static_cast<int32_t *>(realloc(f->block[ch], f->max_blocksize * sizeof(int32_t)));
+            if(!block) {
+                return false;
+            }
+            f->block[ch] = block;
+        }
+        f->block_capacity = f->max_blocksize;
+    }
+
+    return true;
+}
+
+bool is_flac(FILE *fp, flac_instance *pInstance) {
+    flac_instance *f = pInstance;
+    uint8_t buf[FLAC_STREAMINFO_LEN];
+    bool have_info = false;
+    bool last = false;
+
+    fseek(fp, 0, SEEK_SET);
+    if(fread(buf, 1, 4, fp) != 4) {
+        return false;
+    }
+
+    // some taggers put an ID3v2 tag in front of the stream
+    if(memcmp(buf, "ID3", 3) == 0) {
+        if(fread(buf + 4, 1, 6, fp) != 6) {
+            return false;
+        }
+        long skip = ((buf[6] & 0x7F) << 21) | ((buf[7] & 0x7F) << 14) | ((buf[8] & 0x7F) << 7) | (buf[9] & 0x7F);
+        skip += (buf[5] & 0x10) ? 10 : 0;   // footer
+        if((fseek(fp, skip, SEEK_CUR) != 0) || (fread(buf, 1, 4, fp) != 4)) {
+            return false;
+        }
+    }
+
+    if(memcmp(buf, "fLaC", 4) != 0) {
+        return false;
+    }
+
+    crc_init();
+    f->seek_count = 0;
+
+    while(!last) {
+        if(fread(buf, 1, FLAC_META_HEADER, fp) != FLAC_META_HEADER) {
+            return false;
+        }
+        last = buf[0] & 0x80;
+        uint32_t type = buf[0] & 0x7F;
+        uint32_t len = read_be(buf + 1, 3);
+
+        if(type == FLAC_META_INVALID) {
+            return false;
+        } else if((type == FLAC_META_STREAMINFO) && (len >= FLAC_STREAMINFO_LEN)) {
+            if(fread(buf, 1, FLAC_STREAMINFO_LEN, fp) != FLAC_STREAMINFO_LEN) {
+                return false;
+            }
+            parse_streaminfo(buf, f);
+            have_info = true;
+            fseek(fp, len - FLAC_STREAMINFO_LEN, SEEK_CUR);
+        } else if(type == FLAC_META_SEEKTABLE) {
+            if(!read_seektable(fp, f, len)) {
+                return false;
+            }
+        } else if(fseek(fp, len, SEEK_CUR) != 0) {
+            return false;
+        }
+    }
+
+    if(!have_info) {
+        ESP_LOGE(TAG, "no STREAMINFO");
+        return false;
+    }
+
+    LOGI_1("sample_rate=%d, channels=%d, bps=%d, blocksize %d-%d, max frame %d, %d seek points",
+           (int)f->sample_rate, f->channels, f->bits_per_sample, f->min_blocksize, f->max_blocksize,
+           (int)f->max_framesize, f->seek_count);
+
+    if((f->channels > FLAC_MAX_CHANNELS) || (f->bits_per_sample < 4) || (f->bits_per_sample > 24) ||
+       (f->sample_rate == 0) || (f->min_blocksize < 16) || (f->max_blocksize > FLAC_MAX_BLOCKSIZE) ||
+       (f->min_blocksize > f->max_blocksize)) {
+        ESP_LOGE(TAG, "unsupported stream: %d channels, %d bit, block size %d-%d",
+                 f->channels, f->bits_per_sample, f->min_blocksize, f->max_blocksize);
+        return false;
+    }
+
+    if(!alloc_buffers(f)) {
+        ESP_LOGE(TAG, "no memory for %d byte frames", (int)f->frame_bound);
+        return false;
+    }
+
+    f->audio_start = ftell(fp);
+    long file_size = (fseek(fp, 0, SEEK_END) == 0) ? ftell(fp) : -1;
+    f->file_size = (file_size > 0) ? file_size : 0;
+    fseek(fp, f->audio_start, SEEK_SET);
+
+    f->in_len = 0;
+    f->in_pos = 0;
+    f->in_offset = f->audio_start;
+    f->eof_reached = false;
+    f->block_len = 0;
+    f->block_pos = 0;
+    f->block_start = 0;
+    f->skip_to = 0;
+
+    return true;
+}
+
+/**
+ * Decode the next frame in the input into the block buffers
+ */
+static DECODE_STATUS next_frame(FILE *fp, flac_instance *f) {
+    fill_input(fp, f, false);
+
+    size_t unread = f->in_len - f->in_pos;
+    if(unread == 0) {
+        return DECODE_STATUS_DONE;
+    }
+
+    size_t sync = find_sync(f->in_buf + f->in_pos, unread);
+    if(sync == unread) {
+        // keep the last byte, it could be the first half of a sync code
+        f->in_pos = f->eof_reached ? f->in_len : f->in_len - 1;
+        return f->eof_reached ? DECODE_STATUS_DONE : DECODE_STATUS_NO_DATA_CONTINUE;
+    }
+    f->in_pos += sync;
+
+    frame_header_t h;
+    size_t used = 0;
+    uint32_t t = audio_prof_start();
+    frame_result_t result = decode_frame(f, f->in_buf + f->in_pos, f->in_len - f->in_pos, &h, &used);
+    audio_prof_stop(AUDIO_PROF_DECODE, t);
+
+    if(result == FRAME_OK) {
+        audio_prof_count(AUDIO_PROF_FRAMES_DECODED, 1);
+        f->in_pos += used;
+        f->block_len = h.blocksize;
+        f->block_pos = 0;
+        f->block_start = h.sample;
+        return DECODE_STATUS_CONTINUE;
+    }
+
+    if(result == FRAME_NEED_DATA) {
+        if(f->eof_reached) {
+            LOGI_1("truncated last frame");
+            f->in_pos = f->in_len;
+            return DECODE_STATUS_DONE;
+        }
+        if(f->in_pos) {
+            // the frame was found past the start of the buffer, read the rest of it
+            fill_input(fp, f, true);
+            return DECODE_STATUS_NO_DATA_CONTINUE;
+        }
+    }
+
+    // a false sync code or a corrupt frame, search again after it
+    ESP_LOGW(TAG, "bad frame at %u", (unsigned)(f->in_offset + f->in_pos));
+    f->in_pos++;
+    return DECODE_STATUS_NO_DATA_CONTINUE;
+}
+
+DECODE_STATUS decode_flac(FILE *fp, decode_data *pData, flac_instance *pInstance) {
+    flac_instance *f = pInstance;
+
+    pData->fmt.sample_rate = f->sample_rate;
+    pData->fmt.channels = f->channels;
+    pData->fmt.bits_per_sample = (f->bits_per_sample <= 16) ? 16 : 32;
+    pData->frame_count = 0;
+
+    if(f->block_pos >= f->block_len) {
+        DECODE_STATUS status = next_frame(fp, f);
+        if(status != DECODE_STATUS_CONTINUE) {
+            return status;
+        }
+    }
+
+    // drop the samples in front of a seek target
+    if(f->skip_to > f->block_start + f->block_pos) {
+        uint64_t skip = f->skip_to - f->block_start;
+        f->block_pos = (skip < f->block_len) ? skip : f->block_len;
+        if(f->block_pos == f->block_len) {
+            return DECODE_STATUS_NO_DATA_CONTINUE;
+        }
+    }
+
+    size_t sample_bytes = pData->fmt.bits_per_sample / BITS_PER_BYTE;
+    size_t frames = pData->samples_capacity / (sample_bytes * f->channels);
+    if(frames > static_cast<size_t>(f->block_len - f->block_pos)) {
+        frames = f->block_len - f->block_pos;
+    }
+
+    const int32_t *a = f->block[0] + f->block_pos;
+    const int32_t *b = f->block[1] + f->block_pos;
+    uint32_t shift = pData->fmt.bits_per_sample - f->bits_per_sample;
+
+    if(sample_bytes == 2) {
+        int16_t *out = reinterpret_cast<int16_t *>(pData->samples);
+        if(f->channels == 2) {
+            for(size_t i = 0; i < frames; i++) {
+                out[2 * i] = static_cast<int16_t>(static_cast<uint32_t>(a[i]) << shift);
+                out[2 * i + 1] = static_cast<int16_t>(static_cast<uint32_t>(b[i]) << shift);
+            }
+        } else {
+            for(size_t i = 0; i < frames; i++) {
+                out[i] = static_cast<int16_t>(static_cast<uint32_t>(a[i]) << shift);
+            }
+        }
+    } else {
+        int32_t *out = reinterpret_cast<int32_t *>(pData->samples);
+        if(f->channels == 2) {
+            for(size_t i = 0; i < frames; i++) {
+                out[2 * i] = static_cast<uint32_t>(a[i]) << shift;
+                out[2 * i + 1] = static_cast<uint32_t>(b[i]) << shift;
+            }
+        } else {
+            for(size_t i = 0; i < frames; i++) {
+                out[i] = static_cast<uint32_t>(a[i]) << shift;
+            }
+        }
+    }
+
+    f->block_pos += frames;
+    pData->frame_count = frames;
+    return DECODE_STATUS_CONTINUE;
+}
+
+/**
+ * Position the input at the frame holding target, searching from offset
+ *
+ * Frame headers are walked without decoding, a header only counts if its
+ * sample number continues the previous one, which weeds out sync codes
+ * that happen to appear inside frame data.
+ *
+ * @return 1 if the frame was found or the end of the stream reached,
+ * 0 if the first frame after offset is already past target, -1 if fp can't be seeked
+ */
+static int seek_walk(FILE *fp, flac_instance *f, uint64_t offset, uint64_t target) {
+    if(fseek(fp, f->audio_start + offset, SEEK_SET) != 0) {
+        return -1;
+    }
+
+    f->in_len = 0;
+    f->in_pos = 0;
+    f->in_offset = f->audio_start + offset;
+    f->eof_reached = false;
+    f->block_len = 0;
+    f->block_pos = 0;
+
+    bool anchored = false;
+    uint64_t expect = 0;
+    uint64_t anchor_at = 0;
+
+    for(;;) {
+        fill_input(fp, f, false);
+
+        size_t unread = f->in_len - f->in_pos;
+        size_t sync = find_sync(f->in_buf + f->in_pos, unread);
+        if(sync == unread) {
+            if(f->eof_reached) {
+                return 1;
+            }
+            f->in_pos = f->in_len - 1;
+            fill_input(fp, f, true);
+            continue;
+        }
+        f->in_pos += sync;
+
+        if((f->in_len - f->in_pos < FLAC_HEADER_MAX) && !f->eof_reached) {
+            fill_input(fp, f, true);    // header split at the end of the buffer
+            continue;
+        }
+
+        uint64_t at = f->in_offset + f->in_pos;
+        frame_header_t h;
+        if(!parse_frame_header(f, f->in_buf + f->in_pos, f->in_len - f->in_pos, &h)) {
+            f->in_pos++;
+            continue;
+        }
+
+        // a real frame starts within frame_bound of the previous header, else start over from here
+        if(anchored && (h.sample != expect)) {
+            if(at - anchor_at <= f->frame_bound) {
+                f->in_pos++;
+                continue;
+            }
+            anchored = false;
+        }
+
+        if(!anchored && (h.sample > target)) {
+            return 0;
+        }
+
+        if(h.sample + h.blocksize > target) {
+            f->block_start = h.sample;
+            return 1;
+        }
+
+        anchored = true;
+        anchor_at = at;
+        expect = h.sample + h.blocksize;
+        f->in_pos += h.header_len;
+    }
+}
+
+bool flac_seek(FILE *fp, flac_instance *pInstance, uint32_t position_ms) {
+    flac_instance *f = pInstance;
+    uint64_t target = static_cast<uint64_t>(position_ms) * f->sample_rate / 1000;
+    uint64_t offset = 0;
+    uint64_t back = f->frame_bound;
+
+    if(f->total_samples && (target > f->total_samples)) {
+        target = f->total_samples;
+    }
+
+    if(f->seek_count) {
+        for(uint16_t i = 0; (i < f->seek_count) && (f->seektable[i].sample <= target); i++) {
+            offset = f->seektable[i].offset;
+        }
+    } else if(f->total_samples && (f->file_size > f->audio_start)) {
+        // no table, assume an even bitrate and land a little before the target
+        uint64_t estimate = (f->file_size - f->audio_start) * target / f->total_samples;
+        offset = (estimate > back) ? estimate - back : 0;
+    }
+
+    for(int tries = 0; ; tries++) {
+        int found = seek_walk(fp, f, offset, target);
+        if(found < 0) {
+            ESP_LOGE(TAG, "seek to %u failed", (unsigned)(f->audio_start + offset));
+            return false;
+        }
+        if(found || (offset == 0) || (tries == FLAC_SEEK_RETRIES)) {
+            break;
+        }
+        // landed past the target, move back further each time
+        back *= 4;
+        offset = (offset > back) ? offset - back : 0;
+    }
+
+    f->skip_to = target;
+    f->block_start = target;
+    return true;
+}
+
+uint32_t flac_position_ms(const flac_instance *pInstance) {
+    if(pInstance->sample_rate == 0) {
+        return 0;
+    }
+    return (pInstance->block_start + pInstance->block_pos) * 1000 / pInstance->sample_rate;
+}
+
+uint32_t flac_duration_ms(const flac_instance *pInstance) {
+    if(pInstance->sample_rate == 0) {
+        return 0;
+    }
+    return pInstance->total_samples * 1000 / pInstance->sample_rate;
+}
+
+void flac_free(flac_instance *pInstance) {
+    free(pInstance->in_buf);
+    free(pInstance->seektable);
+    for(int ch = 0; ch < FLAC_MAX_CHANNELS; ch++) {
+        free(pInstance->block[ch]);
+        pInstance->block[ch] = NULL;
+    }
+    pInstance->in_buf = NULL;
+    pInstance->in_size = 0;
+    pInstance->seektable = NULL;
+    pInstance->seek_capacity = 0;
+    pInstance->block_capacity = 0;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stdio.h>
+#include "audio_log.h"
+#include "audio_decode_types.h"
+
+/** channels that can be decoded, multichannel streams are rejected */
+#define FLAC_MAX_CHANNELS       2
+
+/** largest block size accepted, the subset limit for rates up to 48kHz */
+#define FLAC_MAX_BLOCKSIZE      4608
+
+/** seek points kept from the SEEKTABLE, larger tables are thinned out evenly */
+#define FLAC_SEEK_POINTS_MAX    256
+
+typedef struct {
+    uint64_t sample;    /*!< first sample of the target frame */
+    uint64_t offset;    /*!< offset of the frame from the first frame */
+} flac_seekpoint_t;
+
+typedef struct {
+    // STREAMINFO
+    uint32_t sample_rate;
+    uint8_t channels;
+    uint8_t bits_per_sample;
+    uint16_t min_blocksize;
+    uint16_t max_blocksize;
+    uint32_t max_framesize;     /*!< 0 if unknown */
+    uint64_t total_samples;     /*!< samples per channel, 0 if unknown */
+
+    /** offset of the first frame, after the metadata blocks */
+    uint32_t audio_start;
+
+    /** size of the file, 0 if unknown */
+    uint32_t file_size;
+
+    /**
+     * Input buffer, twice the largest frame so a whole frame is always
+     * buffered when decoding starts
+     */
+    uint8_t *in_buf;
+    size_t in_size;
+
+    /** largest frame expected, the buffer is refilled below this */
+    size_t frame_bound;
+
+    /** bytes in in_buf and position of the next unread byte */
+    size_t in_len;
+    size_t in_pos;
+
+    /** file offset of in_buf[0] */
+    uint32_t in_offset;
+
+    /** set to true if the end of file has been reached */
+    bool eof_reached;
+
+    /** decoded block, one array of max_blocksize samples per channel */
+    int32_t *block[FLAC_MAX_CHANNELS];
+    uint16_t block_capacity;
+
+    /** samples per channel in the decoded block and the next one to output */
+    uint16_t block_len;
+    uint16_t block_pos;
+
+    /** stream position of the first sample of the decoded block */
+    uint64_t block_start;
+
+    /** samples before this position are dropped, set by flac_seek() */
+    uint64_t skip_to;
+
+    /** seek points from the SEEKTABLE, placeholders removed */
+    flac_seekpoint_t *seektable;
+    uint16_t seek_count;
+    uint16_t seek_capacity;
+} flac_instance;
+
+/**
+ * Parse the metadata blocks and prepare pInstance for decoding, buffers
+ * allocated for a previous file are reused when they are large enough
+ *
+ * @return true if fp is a FLAC stream that can be decoded, fp is then
+ * positioned at the first frame
+ */
+bool is_flac(FILE *fp, flac_instance *pInstance);
+
+/**
+ * Decode the next frame, or output more of the one already decoded
+ *
+ * 8 to 16 bit streams are output as 16 bit samples, 20 and 24 bit streams as
+ * 32 bit samples with the audio in the upper bits
+ */
+DECODE_STATUS decode_flac(FILE *fp, decode_data *pData, flac_instance *pInstance);
+
+/**
+ * Move decoding to position_ms
+ *
+ * Without a seek index the nearest SEEKTABLE point at or before the target is
+ * used, or a position estimated from the file size. Whole frames up to the
+ * target are skipped by walking the frame headers, the samples before it are
+ * decoded and dropped.
+ *
+ * @return false if fp can't be seeked
+ */
+bool flac_seek(FILE *fp, flac_instance *pInstance, uint32_t position_ms);
+
+/** @return position of the next sample to be output, in milliseconds */
+uint32_t flac_position_ms(const flac_instance *pInstance);
+
+/** @return length of the stream in milliseconds, 0 if unknown */
+uint32_t flac_duration_ms(const flac_instance *pInstance);
+
+/** Free the buffers of pInstance */
+void flac_free(flac_instance *pInstance);
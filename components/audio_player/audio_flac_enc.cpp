@@ -0,0 +1,750 @@
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include "audio_flac_enc.h"
+
+/** longest frame header: sync, codes, 6 byte coded frame number, 16 bit block size and rate, crc-8 */
+#define FLAC_HEADER_MAX     16
+
+#define FLAC_STREAMINFO_LEN 34
+
+/** subframe types, the order or order - 1 is added to FIXED and LPC */
+#define FLAC_SUBFRAME_CONSTANT  0
+#define FLAC_SUBFRAME_VERBATIM  1
+#define FLAC_SUBFRAME_FIXED     8
+#define FLAC_SUBFRAME_LPC       32
+
+/** channel assignments of the frame header */
+#define FLAC_CH_INDEPENDENT 1
+#define FLAC_CH_LEFT_SIDE   8
+#define FLAC_CH_RIGHT_SIDE  9
+#define FLAC_CH_MID_SIDE    10
+
+#define FLAC_BPS            16
+#define FLAC_MAX_FIXED_ORDER 4
+
+/**
+ * Precision of the quantized LPC coefficients. With 12 bits the prediction of
+ * 16 bit channels fits 32 bits up to order 8, so decoders can use their fast path.
+ */
+#define FLAC_QLP_PRECISION  12
+#define FLAC_QLP_SHIFT_MAX  15
+
+/** Rice parameters are 4 bits, 15 is the escape code which isn't used */
+#define FLAC_RICE_PARAM_MAX 14
+
+/** samples of the residual may not exceed 32 bits, LPC subframes beyond this are not used */
+#define FLAC_RESIDUAL_LIMIT (1 << 30)
+
+/** what was chosen for a subframe and its size */
+typedef struct {
+    uint8_t type;
+    uint8_t order;
+    uint8_t partition_order;
+    int8_t shift;
+    int32_t qlp[FLAC_ENC_MAX_LPC_ORDER];
+    uint8_t params[1 << FLAC_ENC_MAX_PARTITION];
+    uint64_t bits;
+} subframe_t;
+
+/** MSB first bit writer, at most 32 bits per put */
+typedef struct {
+    uint8_t *p;
+    uint64_t acc;       /*!< the low 'bits' bits are not written yet */
+    int bits;
+} bitwriter_t;
+
+static uint8_t s_crc8[256];
+static uint16_t s_crc16[256];
+
+static void crc_init(void) {
+    if(s_crc16[1]) {
+        return;
+    }
+    for(int i = 0; i < 256; i++) {
+        uint8_t c8 = i;
+        uint16_t c16 = i << 8;
+        for(int b = 0; b < 8; b++) {
+            c8 = (c8 & 0x80) ? (c8 << 1) ^ 0x07 : (c8 << 1);
+            c16 = (c16 & 0x8000) ? (c16 << 1) ^ 0x8005 : (c16 << 1);
+        }
+        s_crc8[i] = c8;
+        s_crc16[i] = c16;
+    }
+}
+
+static uint8_t crc8(const uint8_t *p, size_t len) {
+    uint8_t crc = 0;
+    while(len--) {
+        crc = s_crc8[crc ^ *p++];
+    }
+    return crc;
+}
+
+static uint16_t crc16(const uint8_t *p, size_t len) {
+    uint16_t crc = 0;
+    while(len--) {
+        crc = (crc << 8) ^ s_crc16[(crc >> 8) ^ *p++];
+    }
+    return crc;
+}
+
+static inline void bw_put(bitwriter_t *w, uint32_t v, int n) {
+    w->acc = (w->acc << n) | v;
+    w->bits += n;
+    if(w->bits >= 32) {
+        w->bits -= 32;
+        uint32_t out = static_cast<uint32_t>(w->acc >> w->bits);
+        w->p[0] = out >> 24;
+        w->p[1] = out >> 16;
+        w->p[2] = out >> 8;
+        w->p[3] = out;
+        w->p += 4;
+    }
+}
+
+static inline void bw_put_signed(bitwriter_t *w, int32_t v, int n) {
+    bw_put(w, static_cast<uint32_t>(v) & ((1u << n) - 1), n);
+}
+
+static inline void bw_rice(bitwriter_t *w, int32_t r, int k) {
+    uint32_t u = (static_cast<uint32_t>(r) << 1) ^ static_cast<uint32_t>(r >> 31);
+    uint32_t q = u >> k;
+    if(q + 1 + k <= 32) {
+        // the q leading zeros are the unused high bits of the value
+        bw_put(w, (1u << k) | (u & ((1u << k) - 1)), q + 1 + k);
+    } else {
+        while(q > 31) {
+            bw_put(w, 0, 31);
+            q -= 31;
+        }
+        bw_put(w, 1, q + 1);
+        bw_put(w, u & ((1u << k) - 1), k);
+    }
+}
+
+/** pad to a byte boundary and write out what is left, returns the end of the data */
+static uint8_t *bw_flush(bitwriter_t *w) {
+    if(w->bits & 7) {
+        bw_put(w, 0, 8 - (w->bits & 7));
+    }
+    while(w->bits >= 8) {
+        w->bits -= 8;
+        *w->p++ = static_cast<uint8_t>(w->acc >> w->bits);
+    }
+    return w->p;
+}
+
+static size_t put_utf8(uint8_t *p, uint32_t v) {
+    if(v < 0x80) {
+        p[0] = v;
+        return 1;
+    }
+    size_t len = (v < 0x800) ? 2 : (v < 0x10000) ? 3 : (v < 0x200000) ? 4 : (v < 0x4000000) ? 5 : 6;
+    for(size_t i = len - 1; i > 0; i--) {
+        p[i] = 0x80 | (v & 0x3F);
+        v >>= 6;
+    }
+    p[0] = static_cast<uint8_t>(0xFF00 >> len) | v;
+    return len;
+}
+
+static uint32_t blocksize_code(uint32_t n) {
+    switch(n) {
+        case 192: return 1;
+        case 576: return 2;
+        case 1152: return 3;
+        case 2304: return 4;
+        case 4608: return 5;
+        case 256: return 8;
+        case 512: return 9;
+        case 1024: return 10;
+        case 2048: return 11;
+        case 4096: return 12;
+        default: return (n <= 256) ? 6 : 7;
+    }
+}
+
+static uint32_t rate_code(uint32_t rate) {
+    switch(rate) {
+        case 88200: return 1;
+        case 176400: return 2;
+        case 192000: return 3;
+        case 8000: return 4;
+        case 16000: return 5;
+        case 22050: return 6;
+        case 24000: return 7;
+        case 32000: return 8;
+        case 44100: return 9;
+        case 48000: return 10;
+        case 96000: return 11;
+        default: break;
+    }
+    if((rate % 1000 == 0) && (rate / 1000 < 256)) {
+        return 12;
+    }
+    if(rate < 65536) {
+        return 13;
+    }
+    return ((rate % 10 == 0) && (rate / 10 < 65536)) ? 14 : 0;
+}
+
+static size_t write_frame_header(const flac_enc_t *enc, uint32_t n, uint32_t assignment, uint8_t *p) {
+    uint32_t bs = blocksize_code(n);
+    uint32_t rate = rate_code(enc->cfg.sample_rate);
+    size_t len = 0;
+
+    p[len++] = 0xFF;
+    p[len++] = 0xF8;    // sync, fixed block size stream
+    p[len++] = (bs << 4) | rate;
+    p[len++] = (assignment << 4) | (4 << 1);    // 16 bit samples
+    len += put_utf8(p + len, enc->frame_number);
+
+    if(bs == 6) {
+        p[len++] = n - 1;
+    } else if(bs == 7) {
+        p[len++] = (n - 1) >> 8;
+        p[len++] = n - 1;
+    }
+
+    uint32_t r = enc->cfg.sample_rate;
+    if(rate == 12) {
+        p[len++] = r / 1000;
+    } else if(rate == 13 || rate == 14) {
+        r = (rate == 14) ? r / 10 : r;
+        p[len++] = r >> 8;
+        p[len++] = r;
+    }
+
+    p[len] = crc8(p, len);
+    return len + 1;
+}
+
+static inline int32_t fixed_residual(const int32_t *x, uint32_t i, uint32_t order) {
+    switch(order) {
+        case 0: return x[i];
+        case 1: return x[i] - x[i - 1];
+        case 2: return x[i] - 2 * x[i - 1] + x[i - 2];
+        case 3: return x[i] - 3 * (x[i - 1] - x[i - 2]) - x[i - 3];
+        default: return x[i] - 4 * (x[i - 1] + x[i - 3]) + 6 * x[i - 2] + x[i - 4];
+    }
+}
+
+/** Rice parameter with the fewest bits for n values adding up to sum, from the estimate n * (k + 1) + (sum >> k) */
+static inline uint32_t rice_param(uint64_t sum, uint32_t n) {
+    uint32_t k = 0;
+    while((k < FLAC_RICE_PARAM_MAX) && ((static_cast<uint64_t>(n) << (k + 1)) < sum)) {
+        k++;
+    }
+    return k;
+}
+
+/**
+ * Best fixed predictor order from the sums of the absolute residuals of all
+ * orders, computed together in one pass. Returns an estimate of the subframe bits.
+ */
+static uint64_t fixed_estimate(const int32_t *x, uint32_t n, uint32_t bps, uint32_t *order) {
+    uint64_t sum[FLAC_MAX_FIXED_ORDER + 1] = {};
+    int32_t last0 = x[3];
+    int32_t last1 = x[3] - x[2];
+    int32_t last2 = last1 - (x[2] - x[1]);
+    int32_t last3 = last2 - (x[2] - x[1]) + (x[1] - x[0]);
+
+    for(uint32_t i = FLAC_MAX_FIXED_ORDER; i < n; i++) {
+        int32_t e0 = x[i];
+        int32_t e1 = e0 - last0;
+        int32_t e2 = e1 - last1;
+        int32_t e3 = e2 - last2;
+        int32_t e4 = e3 - last3;
+        sum[0] += abs(e0);
+        sum[1] += abs(e1);
+        sum[2] += abs(e2);
+        sum[3] += abs(e3);
+        sum[4] += abs(e4);
+        last0 = e0;
+        last1 = e1;
+        last2 = e2;
+        last3 = e3;
+    }
+
+    uint32_t best = 0;
+    for(uint32_t o = 1; o <= FLAC_MAX_FIXED_ORDER; o++) {
+        if(sum[o] < sum[best]) {
+            best = o;
+        }
+    }
+    *order = best;
+
+    // the folded residual is twice the absolute value
+    uint32_t count = n - FLAC_MAX_FIXED_ORDER;
+    uint32_t k = rice_param(2 * sum[best], count);
+    return 8 + best * bps + count * (k + 1) + ((2 * sum[best]) >> k);
+}
+
+/** Highest partition order that divides n with more than order samples per partition */
+static uint32_t max_partition_order(uint32_t n, uint32_t order, uint32_t limit) {
+    uint32_t p = 0;
+    while((p < limit) && ((n >> (p + 1)) << (p + 1) == n) && ((n >> (p + 1)) > order)) {
+        p++;
+    }
+    return p;
+}
+
+/**
+ * Choose the partition order and Rice parameters for the residual res[order..n),
+ * fills sf and returns the bits of the residual section
+ */
+static uint64_t plan_residual(const int32_t *res, uint32_t n, uint32_t max_porder, subframe_t *sf) {
+    uint32_t order = sf->order;
+    uint32_t porder = max_partition_order(n, order, max_porder);
+    uint64_t sums[1 << FLAC_ENC_MAX_PARTITION];
+    uint32_t len = n >> porder;
+
+    // sums of the folded residual at the highest order, the lower orders are merged from them
+    for(uint32_t part = 0, i = order; part < (1u << porder); part++) {
+        uint64_t sum = 0;
+        for(uint32_t end = (part + 1) * len; i < end; i++) {
+            sum += (static_cast<uint32_t>(res[i]) << 1) ^ static_cast<uint32_t>(res[i] >> 31);
+        }
+        sums[part] = sum;
+    }
+
+    uint64_t best = UINT64_MAX;
+    for(int p = porder; p >= 0; p--) {
+        uint32_t parts = 1u << p;
+        uint32_t plen = n >> p;
+        uint8_t params[1 << FLAC_ENC_MAX_PARTITION];
+        uint64_t bits = 0;
+
+        for(uint32_t part = 0; part < parts; part++) {
+            uint32_t count = part ? plen : plen - order;
+            uint32_t k = rice_param(sums[part], count);
+            params[part] = k;
+            bits += 4 + count * (k + 1) + (sums[part] >> k);
+        }
+
+        if(bits < best) {
+            best = bits;
+            sf->partition_order = p;
+            memcpy(sf->params, params, parts);
+        }
+
+        for(uint32_t part = 0; part < parts / 2; part++) {
+            sums[part] = sums[2 * part] + sums[2 * part + 1];
+        }
+    }
+
+    return 2 + 4 + best;    // coding method and partition order
+}
+
+static void fixed_compute(const int32_t *x, uint32_t n, uint32_t order, int32_t *res) {
+    for(uint32_t i = order; i < n; i++) {
+        res[i] = fixed_residual(x, i, order);
+    }
+}
+
+/** residual of the quantized LPC predictor, false if it doesn't fit the limit */
+static bool lpc_compute(const int32_t *x, uint32_t n, const int32_t *qlp, uint32_t order, int shift, int32_t *res) {
+    for(uint32_t i = order; i < n; i++) {
+        int64_t sum = 0;
+        for(uint32_t j = 0; j < order; j++) {
+            sum += static_cast<int64_t>(qlp[j]) * x[i - 1 - j];
+        }
+        int64_t r = x[i] - (sum >> shift);
+        if((r >= FLAC_RESIDUAL_LIMIT) || (r <= -FLAC_RESIDUAL_LIMIT)) {
+            return false;
+        }
+        res[i] = static_cast<int32_t>(r);
+    }
+    return true;
+}
+
+/**
+ * LPC coefficients of all orders up to max_order from the autocorrelation
+ * (Levinson-Durbin), and the prediction error of each order
+ */
+static uint32_t levinson(const float *autoc, uint32_t max_order,
+                         double lp[][FLAC_ENC_MAX_LPC_ORDER], double *error) {
+    double a[FLAC_ENC_MAX_LPC_ORDER];
+    double err = autoc[0];
+
+    for(uint32_t i = 0; i < max_order; i++) {
+        double r = -autoc[i + 1];
+        for(uint32_t j = 0; j < i; j++) {
+            r -= a[j] * autoc[i - j];
+        }
+        r /= err;
+
+        a[i] = r;
+        uint32_t j = 0;
+        for(; j < (i >> 1); j++) {
+            double tmp = a[j];
+            a[j] += r * a[i - 1 - j];
+            a[i - 1 - j] += r * tmp;
+        }
+        if(i & 1) {
+            a[j] += a[j] * r;
+        }
+
+        err *= 1.0 - r * r;
+        for(j = 0; j <= i; j++) {
+            lp[i][j] = -a[j];   // predictor coefficients are the negated filter
+        }
+        error[i] = err;
+
+        if(err <= 0) {
+            return i + 1;
+        }
+    }
+
+    return max_order;
+}
+
+/** quantize to FLAC_QLP_PRECISION bits, the rounding error is carried to the next coefficient */
+static bool quantize(const double *lp, uint32_t order, int32_t *qlp, int *shift) {
+    const int32_t qmax = (1 << (FLAC_QLP_PRECISION - 1)) - 1;
+    const int32_t qmin = -(1 << (FLAC_QLP_PRECISION - 1));
+    double cmax = 0;
+
+    for(uint32_t i = 0; i < order; i++) {
+        cmax = fmax(cmax, fabs(lp[i]));
+    }
+    if(cmax <= 0) {
+        return false;
+    }
+
+    int log2cmax;
+    frexp(cmax, &log2cmax);
+    *shift = (FLAC_QLP_PRECISION - 1) - (log2cmax - 1) - 1;
+    if(*shift > FLAC_QLP_SHIFT_MAX) {
+        *shift = FLAC_QLP_SHIFT_MAX;
+    } else if(*shift < 0) {
+        return false;
+    }
+
+    double error = 0;
+    for(uint32_t i = 0; i < order; i++) {
+        error += lp[i] * (1 << *shift);
+        int32_t q = lround(error);
+        q = (q > qmax) ? qmax : ((q < qmin) ? qmin : q);
+        error -= q;
+        qlp[i] = q;
+    }
+    return true;
+}
+
+/** LPC order with the fewest bits expected from the prediction errors */
+static uint32_t lpc_best_order(const double *error, uint32_t orders, uint32_t n, uint32_t bps) {
+    double best_bits = 0;
+    uint32_t best = 0;
+
+    for(uint32_t i = 0; i < orders; i++) {
+        double scaled = error[i] * 0.5 / n;
+        double per_sample = (scaled > 1.0) ? 0.5 * log2(scaled) : 0;
+        double bits = per_sample * (n - i - 1) + (i + 1) * (bps + FLAC_QLP_PRECISION);
+        if((i == 0) || (bits < best_bits)) {
+            best_bits = bits;
+            best = i;
+        }
+    }
+    return best + 1;
+}
+
+/** try an LPC subframe, fills sf and returns false if LPC can't be used for x */
+static bool plan_lpc(flac_enc_t *enc, const int32_t *x, uint32_t n, uint32_t bps, int32_t *res, subframe_t *sf) {
+    uint32_t max_order = enc->cfg.lpc_order;
+    float autoc[FLAC_ENC_MAX_LPC_ORDER + 1];
+
+    for(uint32_t i = 0; i < n; i++) {
+        enc->windowed[i] = x[i] * enc->window[i];
+    }
+    for(uint32_t lag = 0; lag <= max_order; lag++) {
+        float sum = 0;
+        for(uint32_t i = lag; i < n; i++) {
+            sum += enc->windowed[i] * enc->windowed[i - lag];
+        }
+        autoc[lag] = sum;
+    }
+    if(autoc[0] <= 0) {
+        return false;
+    }
+
+    double lp[FLAC_ENC_MAX_LPC_ORDER][FLAC_ENC_MAX_LPC_ORDER];
+    double error[FLAC_ENC_MAX_LPC_ORDER];
+    uint32_t orders = levinson(autoc, max_order, lp, error);
+    uint32_t order = lpc_best_order(error, orders, n, bps);
+    int shift;
+
+    if(!quantize(lp[order - 1], order, sf->qlp, &shift) || !lpc_compute(x, n, sf->qlp, order, shift, res)) {
+        return false;
+    }
+
+    sf->type = FLAC_SUBFRAME_LPC;
+    sf->order = order;
+    sf->shift = shift;
+    sf->bits = 8 + order * bps + 4 + 5 + order * FLAC_QLP_PRECISION +
+               plan_residual(res, n, enc->cfg.partition_order, sf);
+    return true;
+}
+
+/** choose the smallest subframe for the n samples of x and write it */
+static void encode_subframe(flac_enc_t *enc, bitwriter_t *w, const int32_t *x, uint32_t n, uint32_t bps, int32_t *res) {
+    subframe_t best = {};
+    subframe_t cand = {};
+
+    uint32_t i = 1;
+    while((i < n) && (x[i] == x[0])) {
+        i++;
+    }
+    if(i == n) {
+        bw_put(w, FLAC_SUBFRAME_CONSTANT << 1, 8);
+        bw_put_signed(w, x[0], bps);
+        return;
+    }
+
+    best.type = FLAC_SUBFRAME_VERBATIM;
+    best.order = 0;
+    best.bits = 8 + static_cast<uint64_t>(n) * bps;
+    bool lpc_tried = false;
+
+    if(n > 2 * FLAC_MAX_FIXED_ORDER) {
+        uint32_t order;
+        fixed_estimate(x, n, bps, &order);
+        fixed_compute(x, n, order, res);
+        cand.type = FLAC_SUBFRAME_FIXED;
+        cand.order = order;
+        cand.bits = 8 + order * bps + plan_residual(res, n, enc->cfg.partition_order, &cand);
+        if(cand.bits < best.bits) {
+            best = cand;
+        }
+
+        // the window is made for full blocks, the short last block of a stream goes without LPC
+        if(enc->cfg.lpc_order && (n == enc->cfg.blocksize)) {
+            lpc_tried = true;
+            if(plan_lpc(enc, x, n, bps, res, &cand) && (cand.bits < best.bits)) {
+                best = cand;
+            }
+        }
+    }
+
+    if(best.type == FLAC_SUBFRAME_VERBATIM) {
+        bw_put(w, FLAC_SUBFRAME_VERBATIM << 1, 8);
+        for(i = 0; i < n; i++) {
+            bw_put_signed(w, x[i], bps);
+        }
+        return;
+    }
+
+    // res holds the residual of the subframe tried last, an LPC subframe is always tried last
+    if(best.type == FLAC_SUBFRAME_FIXED) {
+        if(lpc_tried) {
+            fixed_compute(x, n, best.order, res);
+        }
+        bw_put(w, (FLAC_SUBFRAME_FIXED + best.order) << 1, 8);
+    } else {
+        bw_put(w, (FLAC_SUBFRAME_LPC + best.order - 1) << 1, 8);
+    }
+
+    for(i = 0; i < best.order; i++) {
+        bw_put_signed(w, x[i], bps);
+    }
+    if(best.type == FLAC_SUBFRAME_LPC) {
+        bw_put(w, FLAC_QLP_PRECISION - 1, 4);
+        bw_put_signed(w, best.shift, 5);
+        for(i = 0; i < best.order; i++) {
+            bw_put_signed(w, best.qlp[i], FLAC_QLP_PRECISION);
+        }
+    }
+
+    // Rice coding with 4 bit parameters
+    bw_put(w, 0, 2);
+    bw_put(w, best.partition_order, 4);
+    uint32_t len = n >> best.partition_order;
+    for(uint32_t part = 0, j = best.order; part < (1u << best.partition_order); part++) {
+        uint32_t k = best.params[part];
+        bw_put(w, k, 4);
+        for(uint32_t end = (part + 1) * len; j < end; j++) {
+            bw_rice(w, res[j], k);
+        }
+    }
+}
+
+bool flac_enc_init(flac_enc_t *enc, const flac_enc_config_t *cfg) {
+    memset(enc, 0, sizeof(*enc));
+
+    if((cfg->channels < 1) || (cfg->channels > FLAC_ENC_MAX_CHANNELS) ||
+       (cfg->blocksize < 16) || (cfg->blocksize > FLAC_ENC_MAX_BLOCKSIZE) ||
+       (cfg->lpc_order > FLAC_ENC_MAX_LPC_ORDER) || (cfg->partition_order > FLAC_ENC_MAX_PARTITION) ||
+       (cfg->sample_rate == 0) || (cfg->sample_rate >= (1 << 20))) {
+        return false;
+    }
+
+    crc_init();
+    enc->cfg = *cfg;
+
+    size_t n = cfg->blocksize;
+    for(int ch = 0; ch < 3; ch++) {
+        enc->chan[ch] = static_cast<int32_t *>(malloc(n * sizeof(int32_t)));
+    }
+    // the residual shares the allocation of the windowed signal
+    enc->windowed = static_cast<float *>(malloc(n * sizeof(float) + n * sizeof(int32_t)));
+    enc->window = static_cast<float *>(malloc(n * sizeof(float)));
+    if(!enc->chan[0] || !enc->chan[1] || !enc->chan[2] || !enc->windowed || !enc->window) {
+        flac_enc_free(enc);
+        return false;
+    }
+
+    // Tukey window with half of it tapered
+    int32_t np = static_cast<int32_t>(0.25f * n) - 1;
+    for(size_t i = 0; i < n; i++) {
+        enc->window[i] = 1.0f;
+    }
+    if(np > 0) {
+        for(int32_t i = 0; i <= np; i++) {
+            enc->window[i] = 0.5f - 0.5f * cosf(M_PI * i / np);
+            enc->window[n - np - 1 + i] = 0.5f - 0.5f * cosf(M_PI * (i + np) / np);
+        }
+    }
+
+    return true;
+}
+
+size_t flac_enc_max_frame_bytes(const flac_enc_t *enc) {
+    // verbatim subframes, the side channel has one more bit, and the crc-16
+    uint32_t n = enc->cfg.blocksize;
+    return FLAC_HEADER_MAX + (enc->cfg.channels * (8 + static_cast<size_t>(n) * (FLAC_BPS + 1)) + 7) / 8 + 2;
+}
+
+size_t flac_enc_frame(flac_enc_t *enc, const int16_t *pcm, uint32_t frames, uint8_t *out) {
+    uint32_t channels = enc->cfg.channels;
+    uint32_t n = frames;
+    int32_t *res = reinterpret_cast<int32_t *>(enc->windowed + enc->cfg.blocksize);
+
+    if((n == 0) || (n > enc->cfg.blocksize)) {
+        return 0;
+    }
+
+    for(uint32_t ch = 0; ch < channels; ch++) {
+        int32_t *x = enc->chan[ch];
+        for(uint32_t i = 0; i < n; i++) {
+            x[i] = pcm[i * channels + ch];
+        }
+    }
+
+    uint32_t assignment = channels - 1;
+    const int32_t *sub[FLAC_ENC_MAX_CHANNELS] = { enc->chan[0], enc->chan[1] };
+    uint32_t bps[FLAC_ENC_MAX_CHANNELS] = { FLAC_BPS, FLAC_BPS };
+
+    if((channels == 2) && (n > 2 * FLAC_MAX_FIXED_ORDER)) {
+        int32_t *left = enc->chan[0];
+        int32_t *right = enc->chan[1];
+        int32_t *side = enc->chan[2];
+        int32_t *mid = res;     // free until the subframes are encoded
+        for(uint32_t i = 0; i < n; i++) {
+            side[i] = left[i] - right[i];
+            mid[i] = (left[i] + right[i]) >> 1;
+        }
+
+        // pick the pair that is cheapest to code with the fixed predictors
+        uint32_t order;
+        uint64_t l = fixed_estimate(left, n, FLAC_BPS, &order);
+        uint64_t r = fixed_estimate(right, n, FLAC_BPS, &order);
+        uint64_t s = fixed_estimate(side, n, FLAC_BPS + 1, &order);
+        uint64_t m = fixed_estimate(mid, n, FLAC_BPS, &order);
+
+        assignment = FLAC_CH_INDEPENDENT;
+        uint64_t cost = l + r;
+        if(l + s < cost) {
+            assignment = FLAC_CH_LEFT_SIDE;
+            cost = l + s;
+        }
+        if(r + s < cost) {
+            assignment = FLAC_CH_RIGHT_SIDE;
+            cost = r + s;
+        }
+        if(m + s < cost) {
+            assignment = FLAC_CH_MID_SIDE;
+        }
+
+        if(assignment == FLAC_CH_LEFT_SIDE) {
+            sub[1] = side;
+            bps[1] = FLAC_BPS + 1;
+        } else if(assignment == FLAC_CH_RIGHT_SIDE) {
+            sub[0] = side;
+            bps[0] = FLAC_BPS + 1;
+        } else if(assignment == FLAC_CH_MID_SIDE) {
+            memcpy(left, mid, n * sizeof(int32_t));
+            sub[1] = side;
+            bps[1] = FLAC_BPS + 1;
+        }
+    }
+
+    size_t header = write_frame_header(enc, n, assignment, out);
+    bitwriter_t w = { out + header, 0, 0 };
+    for(uint32_t ch = 0; ch < channels; ch++) {
+        encode_subframe(enc, &w, sub[ch], n, bps[ch], res);
+    }
+    uint8_t *end = bw_flush(&w);
+
+    size_t len = end - out;
+    uint16_t crc = crc16(out, len);
+    out[len++] = crc >> 8;
+    out[len++] = crc;
+
+    enc->frame_number++;
+    enc->total_samples += n;
+    if((enc->min_framesize == 0) || (len < enc->min_framesize)) {
+        enc->min_framesize = len;
+    }
+    if(len > enc->max_framesize) {
+        enc->max_framesize = len;
+    }
+
+    return len;
+}
+
+void flac_enc_header(const flac_enc_t *enc, uint8_t *out) {
+    const flac_enc_config_t *cfg = &enc->cfg;
+    uint8_t *p = out;
+
+    memcpy(p, "fLaC", 4);
+    p[4] = 0x80;    // last metadata block, STREAMINFO
+    p[5] = 0;
+    p[6] = 0;
+    p[7] = FLAC_STREAMINFO_LEN;
+    p += 8;
+
+    p[0] = cfg->blocksize >> 8;
+    p[1] = cfg->blocksize;
+    p[2] = cfg->blocksize >> 8;
+    p[3] = cfg->blocksize;
+    p[4] = enc->min_framesize >> 16;
+    p[5] = enc->min_framesize >> 8;
+    p[6] = enc->min_framesize;
+    p[7] = enc->max_framesize >> 16;
+    p[8] = enc->max_framesize >> 8;
+    p[9] = enc->max_framesize;
+
+    // 20 bits rate, 3 bits channels - 1, 5 bits bits per sample - 1, 36 bits samples
+    p[10] = cfg->sample_rate >> 12;
+    p[11] = cfg->sample_rate >> 4;
+    p[12] = ((cfg->sample_rate & 0x0F) << 4) | ((cfg->channels - 1) << 1) | ((FLAC_BPS - 1) >> 4);
+    p[13] = (((FLAC_BPS - 1) & 0x0F) << 4) | static_cast<uint8_t>((enc->total_samples >> 32) & 0x0F);
+    p[14] = enc->total_samples >> 24;
+    p[15] = enc->total_samples >> 16;
+    p[16] = enc->total_samples >> 8;
+    p[17] = enc->total_samples;
+
+    memset(p + 18, 0, 16);  // MD5 intentionally unset: zero tells decoders to skip the check
+}
+
+void flac_enc_free(flac_enc_t *enc) {
+    for(int ch = 0; ch < 3; ch++) {
+        free(enc->chan[ch]);
+        enc->chan[ch] = NULL;
+    }
+    free(enc->windowed);
+    free(enc->window);
+    enc->windowed = NULL;
+    enc->window = NULL;
+}
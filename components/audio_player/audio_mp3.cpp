@@ -0,0 +1,894 @@
+#include <string.h>
+#include "audio_log.h"
+#include <stdlib.h>
+#include "audio_mp3.h"
+#include "audio_prof.h"
+#include "esp_check.h"
+#include "esp_log.h"
+
+extern "C" {
+#include "mp3common.h"
+}
+
+static const char *TAG = "mp3";
+
+/** decoder delay of the libhelix synthesis filterbank, in samples */
+#define MP3_DECODER_DELAY   529
+
+/** bytes searched for a frame header when landing at an estimated offset */
+#define MP3_SYNC_SEARCH     (8 * 1024)
+
+/** frames walked up to a seek target, enough to hold the largest bit reservoir at any bitrate */
+#define MP3_SEEK_WALK       16
+
+/** largest main_data_begin, how far back the bit reservoir of a frame can reach */
+#define MP3_RESERVOIR_MPEG1 511
+#define MP3_RESERVOIR_MPEG2 255
+
+/** read buffer for walking frame headers */
+#define MP3_SEEK_BUF_SIZE   2048
+#define MP3_SCAN_BUF_SIZE   (16 * 1024)
+
+bool is_mp3(FILE *fp) {
+    bool is_mp3_file = false;
+
+    fseek(fp, 0, SEEK_SET);
+
+    // see https://en.wikipedia.org/wiki/List_of_file_signatures
+    uint8_t magic[3];
+    if(sizeof(magic) == fread(magic, 1, sizeof(magic), fp)) {
+        if((magic[0] == 0xFF) &&
+            (magic[1] == 0xFB))
+        {
+            is_mp3_file = true;
+        } else if((magic[0] == 0xFF) &&
+                  (magic[1] == 0xF3))
+        {
+            is_mp3_file = true;
+        } else if((magic[0] == 0xFF) &&
+                  (magic[1] == 0xF2))
+        {
+            is_mp3_file = true;
+        } else if((magic[0] == 0x49) &&
+                  (magic[1] == 0x44) &&
+                  (magic[2] == 0x33)) /* 'ID3' */
+        {
+            fseek(fp, 0, SEEK_SET);
+
+            /* Get ID3 head */
+            mp3_id3_header_v2_t tag;
+            if (sizeof(mp3_id3_header_v2_t) == fread(&tag, 1, sizeof(mp3_id3_header_v2_t), fp)) {
+                if (memcmp("ID3", (const void *) &tag, sizeof(tag.header)) == 0) {
+                    is_mp3_file = true;
+                }
+            }
+        }
+    }
+
+    // seek back to the start of the file to avoid
+    // missing frames upon decode
+    fseek(fp, 0, SEEK_SET);
+
+    return is_mp3_file;
+}
+
+static uint32_t read_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint32_t read_be16(const uint8_t *p) {
+    return ((uint32_t)p[0] << 8) | p[1];
+}
+
+typedef struct {
+    int version;            /*!< 0 = MPEG1, 1 = MPEG2, 2 = MPEG2.5 */
+    int samprate;
+    int bitrate;            /*!< kbps */
+    int samples_per_frame;
+    int frame_len;          /*!< bytes, including the header */
+    bool mono;
+    bool crc;
+} frame_header_t;
+
+/**
+ * Parse a layer 3 frame header, free format frames are not supported
+ *
+ * @return true if p holds a valid header
+ */
+static bool parse_header(const uint8_t *p, frame_header_t *h) {
+    if((p[0] != 0xFF) || ((p[1] & 0xE0) != 0xE0)) {
+        return false;
+    }
+
+    // MPEG version: 3 = MPEG1, 2 = MPEG2, 0 = MPEG2.5
+    int version_bits = (p[1] >> 3) & 0x03;
+    int layer_bits = (p[1] >> 1) & 0x03;
+    if((version_bits == 1) || (layer_bits != 1)) {
+        return false; // reserved version or not layer 3
+    }
+
+    int bitrate_idx = (p[2] >> 4) & 0x0F;
+    int samprate_idx = (p[2] >> 2) & 0x03;
+    if((bitrate_idx == 0) || (bitrate_idx == 15) || (samprate_idx == 3)) {
+        return false;
+    }
+
+    h->version = (version_bits == 3) ? 0 : ((version_bits == 2) ? 1 : 2);
+    h->samprate = samplerateTab[h->version][samprate_idx];
+    h->bitrate = bitrateTab[h->version][2][bitrate_idx];
+    h->samples_per_frame = samplesPerFrameTab[h->version][2];
+    h->frame_len = ((h->version == 0) ? 144000 : 72000) * h->bitrate / h->samprate + ((p[2] >> 1) & 0x01);
+    h->mono = ((p[3] >> 6) & 0x03) == 3;
+    h->crc = !(p[1] & 0x01);
+
+    return true;
+}
+
+/**
+ * @return size of the ID3v2 tag at the start of the file, 0 if there is none
+ */
+static long id3v2_size(FILE *fp) {
+    mp3_id3_header_v2_t tag;
+
+    fseek(fp, 0, SEEK_SET);
+    if((sizeof(tag) != fread(&tag, 1, sizeof(tag), fp)) ||
+       (memcmp("ID3", tag.header, sizeof(tag.header)) != 0)) {
+        return 0;
+    }
+
+    // size is stored as a 28 bit syncsafe integer and excludes the header and footer
+    long size = ((tag.size[0] & 0x7f) << 21) | ((tag.size[1] & 0x7f) << 14) |
+                ((tag.size[2] & 0x7f) << 7) | (tag.size[3] & 0x7f);
+    size += sizeof(tag);
+    if(tag.flag & 0x10) {
+        size += sizeof(tag); // footer present
+    }
+
+    return size;
+}
+
+void mp3_probe(FILE *fp, mp3_instance *pInstance) {
+    pInstance->bytes_in_data_buf = 0;
+    pInstance->read_ptr = pInstance->data_buf;
+    pInstance->eof_reached = false;
+    pInstance->skip_samples = 0;
+    pInstance->valid_samples = 0;
+    pInstance->samples_out = 0;
+    pInstance->sample_rate = 0;
+    pInstance->total_frames = 0;
+    pInstance->start_skip = 0;
+    pInstance->has_toc = false;
+    pInstance->has_vbri = false;
+    pInstance->discard_frames = 0;
+    memset(&pInstance->index, 0, sizeof(pInstance->index));
+
+    long file_size = (fseek(fp, 0, SEEK_END) == 0) ? ftell(fp) : -1;
+    pInstance->file_size = (file_size > 0) ? file_size : 0;
+
+    long audio_start = id3v2_size(fp);
+    pInstance->audio_start = audio_start;
+
+    // the Xing/Info frame is the first frame, look at the first few hundred bytes after the tag
+    uint8_t buf[4 + 32 + 2 + 120 + 36];
+    fseek(fp, audio_start, SEEK_SET);
+    size_t len = fread(buf, 1, sizeof(buf), fp);
+    fseek(fp, audio_start, SEEK_SET);
+
+    frame_header_t h;
+    if((len < 4) || !parse_header(buf, &h)) {
+        return;
+    }
+
+    pInstance->sample_rate = h.samprate;
+    pInstance->samples_per_frame = h.samples_per_frame;
+    pInstance->bitrate = h.bitrate;
+    pInstance->version = h.version;
+
+    // the VBRI frame, written by the Fraunhofer encoder, is always 32 bytes after the header
+    const size_t vbri_offset = 4 + 32;
+    if((vbri_offset + 18 <= len) && (memcmp(&buf[vbri_offset], "VBRI", 4) == 0)) {
+        pInstance->has_vbri = true;
+        pInstance->total_frames = read_be32(&buf[vbri_offset + 14]);
+        pInstance->toc_base = audio_start;
+        pInstance->audio_start = audio_start + h.frame_len;
+        fseek(fp, pInstance->audio_start, SEEK_SET);
+        LOGI_1("vbri: frames %u", (unsigned)pInstance->total_frames);
+        return;
+    }
+
+    size_t xing_offset = 4 + (h.crc ? 2 : 0) + sideBytesTab[h.version][h.mono ? 0 : 1];
+    if((xing_offset + 8 > len) ||
+       ((memcmp(&buf[xing_offset], "Xing", 4) != 0) && (memcmp(&buf[xing_offset], "Info", 4) != 0))) {
+        return;
+    }
+
+    uint32_t flags = read_be32(&buf[xing_offset + 4]);
+    size_t pos = xing_offset + 8;
+    uint32_t frames = 0;
+    uint32_t bytes = 0;
+    if(flags & 0x01) {
+        frames = read_be32(&buf[pos]);
+        pos += 4;
+    }
+    if(flags & 0x02) {
+        bytes = read_be32(&buf[pos]);
+        pos += 4;
+    }
+    if(flags & 0x04) {
+        memcpy(pInstance->toc, &buf[pos], sizeof(pInstance->toc));
+        pos += 100;
+    }
+    if(flags & 0x08) pos += 4;   // quality
+
+    // TOC positions are fractions of the stream size, counted from the Xing frame
+    if(!bytes && (pInstance->file_size > (uint32_t)audio_start)) {
+        bytes = pInstance->file_size - audio_start;
+    }
+    pInstance->toc_base = audio_start;
+    pInstance->toc_bytes = bytes;
+    // an "Info" frame marks a CBR file, where the bitrate gives better positions than the TOC
+    pInstance->has_toc = (flags & 0x04) && frames && bytes && (memcmp(&buf[xing_offset], "Xing", 4) == 0);
+
+    // the Xing/Info frame decodes as silence, start decoding after it
+    audio_start += h.frame_len;
+    pInstance->audio_start = audio_start;
+    pInstance->total_frames = frames;
+    fseek(fp, audio_start, SEEK_SET);
+
+    // encoders may write the Xing/Info frame at a different bitrate than the audio
+    uint8_t first[4];
+    if((fread(first, 1, sizeof(first), fp) == sizeof(first)) && parse_header(first, &h)) {
+        pInstance->bitrate = h.bitrate;
+    }
+    fseek(fp, audio_start, SEEK_SET);
+
+    uint32_t enc_delay = 0;
+    uint32_t enc_padding = 0;
+    if((pos + 24 <= len) && (memcmp(&buf[pos], "LAME", 4) == 0 || memcmp(&buf[pos], "Lavc", 4) == 0 ||
+                             memcmp(&buf[pos], "Lavf", 4) == 0)) {
+        enc_delay = (buf[pos + 21] << 4) | (buf[pos + 22] >> 4);
+        enc_padding = ((buf[pos + 22] & 0x0F) << 8) | buf[pos + 23];
+    }
+
+    pInstance->skip_samples = enc_delay + MP3_DECODER_DELAY;
+    pInstance->start_skip = pInstance->skip_samples;
+    if(frames) {
+        uint64_t total = (uint64_t)frames * h.samples_per_frame;
+        uint64_t trim = enc_delay + enc_padding;
+        pInstance->valid_samples = (total > trim) ? (total - trim) : 0;
+    }
+
+    LOGI_1("gapless: frames %u, delay %u, padding %u, valid %llu", (unsigned)frames,
+           (unsigned)enc_delay, (unsigned)enc_padding, pInstance->valid_samples);
+}
+
+/**
+ * @return true if data remains, false on error or end of file
+ */
+DECODE_STATUS decode_mp3(HMP3Decoder mp3_decoder, FILE *fp, decode_data *pData, mp3_instance *pInstance) {
+    MP3FrameInfo frame_info;
+
+    size_t unread_bytes = pInstance->bytes_in_data_buf - (pInstance->read_ptr - pInstance->data_buf);
+
+    /* somewhat arbitrary trigger to refill buffer - should always be enough for a full frame */
+    if (unread_bytes < 1.25 * MAINBUF_SIZE && !pInstance->eof_reached) {
+        uint8_t *write_ptr = pInstance->data_buf + unread_bytes;
+        size_t free_space = pInstance->data_buf_size - unread_bytes;
+
+    	/* move last, small chunk from end of buffer to start,
+           then fill with new data */
+        memmove(pInstance->data_buf, pInstance->read_ptr, unread_bytes);
+
+        uint32_t t = audio_prof_start();
+        size_t nRead = fread(write_ptr, 1, free_space, fp);
+        audio_prof_stop(AUDIO_PROF_READ, t);
+        audio_prof_count(AUDIO_PROF_BYTES_READ, nRead);
+
+        pInstance->bytes_in_data_buf = unread_bytes + nRead;
+        pInstance->read_ptr = pInstance->data_buf;
+
+        if ((nRead == 0) || feof(fp)) {
+            pInstance->eof_reached = true;
+        }
+
+        LOGI_2("pos %ld, nRead %d, eof %d", ftell(fp), nRead, pInstance->eof_reached);
+        //ESP_LOGI("MY_Mp3decode","pos %ld, nRead %d, eof %d", ftell(fp), nRead, pInstance->eof_reached);
+        unread_bytes = pInstance->bytes_in_data_buf;
+    }
+
+    LOGI_3("data_buf 0x%p, read 0x%p", pInstance->data_buf, pInstance->read_ptr);
+    //ESP_LOGI("MY_Mp3decode","data_buf 0x%p, read 0x%p", pInstance->data_buf, pInstance->read_ptr);
+    if(unread_bytes == 0) {
+        LOGI_1("unread_bytes == 0, status done");
+        return DECODE_STATUS_DONE;
+    }
+
+    if(pInstance->valid_samples && (pInstance->samples_out >= pInstance->valid_samples)) {
+        LOGI_1("encoder padding reached, status done");
+        return DECODE_STATUS_DONE;
+    }
+
+    /* Find MP3 sync word from read buffer */
+    int offset = MP3FindSyncWord(pInstance->read_ptr, unread_bytes);
+
+    LOGI_2("unread %d, total %d, offset 0x%x(%d)",
+            unread_bytes, pInstance->bytes_in_data_buf, offset, offset);
+    if (offset >= 0) {
+        COMPILE_3(int starting_unread_bytes = unread_bytes);
+        uint8_t *read_ptr = pInstance->read_ptr + offset; /*!< Data start point */
+        unread_bytes -= offset;
+        LOGI_3("read 0x%p, unread %d", read_ptr, unread_bytes);
+        //ESP_LOGI("MY_Mp3decode","read 0x%p, unread %d", read_ptr, unread_bytes);
+        uint32_t t = audio_prof_start();
+        int mp3_dec_err = MP3Decode(mp3_decoder, &read_ptr, (int*)&unread_bytes, reinterpret_cast<int16_t *>(pData->samples),
+0);
+        audio_prof_stop(AUDIO_PROF_DECODE, t);
+        audio_prof_count(AUDIO_PROF_FRAMES_DECODED, 1);
+
+        pInstance->read_ptr = read_ptr;
+
+        // after a seek, frames ahead of the target only refill the bit reservoir
+        if(pInstance->discard_frames &&
+           ((mp3_dec_err == ERR_MP3_NONE) || (mp3_dec_err == ERR_MP3_MAINDATA_UNDERFLOW))) {
+            pInstance->discard_frames--;
+            pData->frame_count = 0;
+            return DECODE_STATUS_NO_DATA_CONTINUE;
+        }
+
+        if(mp3_dec_err == ERR_MP3_NONE) {
+            /* Get MP3 frame info */
+            MP3GetLastFrameInfo(mp3_decoder, &frame_info);
+
+            pData->fmt.sample_rate = frame_info.samprate;
+            pData->fmt.bits_per_sample = frame_info.bitsPerSample;
+            pData->fmt.channels = frame_info.nChans;
+
+            pData->frame_count = (frame_info.outputSamps / frame_info.nChans);
+
+            // drop the encoder and decoder delay at the start of the stream
+            if(pInstance->skip_samples) {
+                size_t skip = pData->frame_count;
+                if(skip > pInstance->skip_samples) {
+                    skip = pInstance->skip_samples;
+                }
+                size_t frame_bytes = frame_info.nChans * sizeof(int16_t);
+                memmove(pData->samples, pData->samples + skip * frame_bytes,
+                        (pData->frame_count - skip) * frame_bytes);
+                pData->frame_count -= skip;
+                pInstance->skip_samples -= skip;
+            }
+
+            // and the encoder padding at the end
+            if(pInstance->valid_samples) {
+                uint64_t remaining = pInstance->valid_samples - pInstance->samples_out;
+                if(pData->frame_count > remaining) {
+                    pData->frame_count = remaining;
+                }
+            }
+            pInstance->samples_out += pData->frame_count;
+
+            LOGI_3("mp3: channels %d, sr %d, bps %d, frame_count %d, processed %d",
+                pData->fmt.channels,
+                pData->fmt.sample_rate,
+                pData->fmt.bits_per_sample,
+                frame_info.outputSamps,
+                starting_unread_bytes - unread_bytes);
+
+            if(pData->frame_count == 0) {
+                return DECODE_STATUS_NO_DATA_CONTINUE;
+            }
+        } else {
+            if (pInstance->eof_reached) {
+                ESP_LOGE(TAG, "status error %d, but EOF", mp3_dec_err);
+                return DECODE_STATUS_DONE;
+            } else if (mp3_dec_err == ERR_MP3_MAINDATA_UNDERFLOW) {
+                // underflow indicates MP3Decode should be called again
+                LOGI_1("underflow read ptr is 0x%p", read_ptr);
+                return DECODE_STATUS_NO_DATA_CONTINUE;
+            } else {
+                // NOTE: some mp3 files result in misdetection of mp3 frame headers
+                // and during decode these misdetected frames cannot be
+                // decoded
+                //
+                // Rather than give up on the file by returning
+                // DECODE_STATUS_ERROR, we ask the caller
+                // to continue to call us, by returning DECODE_STATUS_NO_DATA_CONTINUE.
+                //
+                // The invalid frame data is skipped over as a search for the next frame
+                // on the subsequent call to this function will start searching
+                // AFTER the misdetected frmame header, dropping the invalid data.
+                //
+                // We may want to consider a more sophisticated approach here at a later time.
+                ESP_LOGE(TAG, "status error %d", mp3_dec_err);
+                // ✅【新增】跳过当前错误帧的1个字节，避免死循环
+                if (pInstance->read_ptr - pInstance->data_buf < pInstance->bytes_in_data_buf - 1) {
+                    pInstance->read_ptr += 1;
+                }
+                return DECODE_STATUS_NO_DATA_CONTINUE;
+            }
+        }
+    } else {
+        // if we are dropping data there were no frames decoded
+        pData->frame_count = 0;
+
+        // drop an even count of words
+        size_t words_to_drop = unread_bytes / BYTES_IN_WORD;
+        size_t bytes_to_drop = words_to_drop * BYTES_IN_WORD;
+
+        // if the unread bytes is less than BYTES_IN_WORD, we should drop any unread bytes
+        // to avoid the situation where the file could have a few extra bytes at the end
+        // of the file that isn't at least BYTES_IN_WORD and decoding would get stuck
+        if(unread_bytes < BYTES_IN_WORD) {
+            bytes_to_drop = unread_bytes;
+        }
+
+        // shift the read_ptr to drop the bytes in the buffer
+        pInstance->read_ptr += bytes_to_drop;
+
+        /* Sync word not found in frame. Drop data that was read until a word boundary */
+        ESP_LOGE(TAG, "MP3 sync word not found, dropping %d bytes", bytes_to_drop);
+    }
+
+    return DECODE_STATUS_CONTINUE;
+}
+
+/**
+ * Frame headers are visited in increasing offset order, this reads the file in
+ * large blocks instead of seeking to every header
+ */
+typedef struct {
+    FILE *fp;
+    uint8_t *buf;
+    size_t size;
+    size_t len;     /*!< bytes in buf */
+    uint32_t base;  /*!< file offset of buf[0] */
+} frame_reader_t;
+
+/**
+ * @return pointer to n bytes at offset, NULL if they are past the end of the file
+ */
+static const uint8_t *reader_peek(frame_reader_t *r, uint32_t offset, size_t n) {
+    if((offset < r->base) || (offset + n > r->base + r->len)) {
+        r->base = offset;
+        r->len = 0;
+        if(fseek(r->fp, offset, SEEK_SET) == 0) {
+            r->len = fread(r->buf, 1, r->size, r->fp);
+        }
+        if(n > r->len) {
+            return NULL;
+        }
+    }
+
+    return r->buf + (offset - r->base);
+}
+
+/**
+ * @return length of the frame at offset, 0 if there is no frame of this stream there
+ */
+static int frame_at(frame_reader_t *r, uint32_t offset, const mp3_instance *pInstance) {
+    frame_header_t h;
+    const uint8_t *p = reader_peek(r, offset, 4);
+    if(!p || !parse_header(p, &h) ||
+       (h.version != pInstance->version) || ((uint32_t)h.samprate != pInstance->sample_rate)) {
+        return 0;
+    }
+
+    return h.frame_len;
+}
+
+/**
+ * Find the first frame at or after offset, a header is only trusted if another
+ * one follows it, as sync words also occur in the audio data
+ *
+ * @return offset of the frame, UINT32_MAX if none was found
+ */
+static uint32_t frame_sync(frame_reader_t *r, uint32_t offset, const mp3_instance *pInstance) {
+    for(uint32_t end = offset + MP3_SYNC_SEARCH; offset < end; offset++) {
+        if(!reader_peek(r, offset, 4)) {
+            break; // end of file
+        }
+
+        int len = frame_at(r, offset, pInstance);
+        if(len && frame_at(r, offset + len, pInstance)) {
+            return offset;
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+static bool index_read(FILE *index_fp, uint32_t n, mp3_index_entry_t *entry) {
+    return (fseek(index_fp, sizeof(mp3_index_header_t) + n * sizeof(*entry), SEEK_SET) == 0) &&
+           (fread(entry, sizeof(*entry), 1, index_fp) == 1);
+}
+
+/**
+ * Binary search of the sidecar index for the last entry at or before frame, and the entry after it
+ */
+static bool index_lookup(FILE *index_fp, const mp3_index_header_t *hdr, uint32_t frame,
+                         mp3_index_entry_t *lo, mp3_index_entry_t *hi) {
+    uint32_t first = 0;
+    uint32_t last = hdr->entry_count - 1;
+
+    if(!index_read(index_fp, 0, lo)) {
+        return false;
+    }
+
+    while(first < last) {
+        uint32_t mid = first + (last - first + 1) / 2;
+        mp3_index_entry_t entry;
+        if(!index_read(index_fp, mid, &entry)) {
+            return false;
+        }
+
+        if(entry.frame <= frame) {
+            first = mid;
+            *lo = entry;
+        } else {
+            last = mid - 1;
+        }
+    }
+
+    if(first + 1 < hdr->entry_count) {
+        return index_read(index_fp, first + 1, hi);
+    }
+
+    hi->frame = hdr->total_frames;
+    hi->offset = hdr->file_size;
+    return true;
+}
+
+static uint32_t interpolate(const mp3_index_entry_t *lo, const mp3_index_entry_t *hi, uint32_t frame) {
+    if((hi->frame <= lo->frame) || (hi->offset <= lo->offset) || (frame <= lo->frame)) {
+        return lo->offset;
+    }
+    if(frame >= hi->frame) {
+        return hi->offset;
+    }
+
+    return lo->offset + (uint64_t)(hi->offset - lo->offset) * (frame - lo->frame) / (hi->frame - lo->frame);
+}
+
+/**
+ * Find where to start looking for frame
+ *
+ * A scanned sidecar index gives the start of a frame at or before it, a TOC
+ * or the bitrate only give an estimate of its offset.
+ */
+static void seek_estimate(FILE *index_fp, const mp3_instance *pInstance, uint32_t frame, mp3_index_entry_t *at) {
+    mp3_index_entry_t lo = { .frame = 0, .offset = pInstance->audio_start };
+    mp3_index_entry_t hi = lo;
+
+    if(index_fp && pInstance->index.entry_count && index_lookup(index_fp, &pInstance->index, frame, &lo, &hi)) {
+        if(pInstance->index.source == MP3_INDEX_SOURCE_SCAN) {
+            *at = lo;
+            return;
+        }
+    } else if(pInstance->has_toc) {
+        // point i of the TOC is at i percent of the duration
+        uint32_t i = (uint64_t)frame * 100 / pInstance->total_frames;
+        if(i > 99) {
+            i = 99;
+        }
+        lo.frame = (uint64_t)i * pInstance->total_frames / 100;
+        lo.offset = pInstance->toc_base + (uint64_t)pInstance->toc[i] * pInstance->toc_bytes / 256;
+        hi.frame = (uint64_t)(i + 1) * pInstance->total_frames / 100;
+        hi.offset = pInstance->toc_base + ((i < 99) ? (uint64_t)pInstance->toc[i + 1] * pInstance->toc_bytes / 256
+                                                    : pInstance->toc_bytes);
+        if(lo.offset < pInstance->audio_start) {
+            lo.offset = pInstance->audio_start;
+        }
+    } else {
+        // constant bitrate, bytes per frame = samples * kbps * 1000 / 8 / rate. Padding can put the
+        // frame a byte either side of this, start looking a little early so it isn't skipped
+        at->frame = frame;
+        at->offset = pInstance->audio_start +
+                     (uint64_t)frame * pInstance->samples_per_frame * pInstance->bitrate * 125 / pInstance->sample_rate;
+        at->offset = (at->offset - pInstance->audio_start > 4) ? (at->offset - 4) : pInstance->audio_start;
+        return;
+    }
+
+    at->frame = frame;
+    at->offset = interpolate(&lo, &hi, frame);
+}
+
+bool mp3_seek(FILE *fp, mp3_instance *pInstance, FILE *index_fp, uint32_t position_ms) {
+    if(!pInstance->sample_rate) {
+        return false;
+    }
+
+    uint32_t spf = pInstance->samples_per_frame;
+    uint64_t sample = (uint64_t)position_ms * pInstance->sample_rate / 1000;
+    if(pInstance->valid_samples && (sample > pInstance->valid_samples)) {
+        sample = pInstance->valid_samples;
+    }
+
+    // position in the decoded stream, which still has the encoder and decoder delay at its start
+    uint64_t stream_sample = sample + pInstance->start_skip;
+    uint32_t target = stream_sample / spf;
+    uint32_t first = (target > MP3_SEEK_WALK) ? (target - MP3_SEEK_WALK) : 0;
+
+    frame_reader_t r = { .fp = fp, .buf = static_cast<uint8_t*>(malloc(MP3_SEEK_BUF_SIZE)),
+                         .size = MP3_SEEK_BUF_SIZE, .len = 0, .base = 0 };
+    ESP_RETURN_ON_FALSE(r.buf, false, TAG, "no memory to seek");
+    long resume = ftell(fp);
+
+    mp3_index_entry_t at;
+    seek_estimate(index_fp, pInstance, first, &at);
+    uint32_t offset = frame_sync(&r, at.offset, pInstance);
+    if(offset == UINT32_MAX) {
+        free(r.buf);
+
+        if(pInstance->file_size && (at.offset + MP3_SYNC_SEARCH >= pInstance->file_size)) {
+            // estimated past the last frame, let decoding finish
+            fseek(fp, 0, SEEK_END);
+            pInstance->bytes_in_data_buf = 0;
+            pInstance->read_ptr = pInstance->data_buf;
+            pInstance->eof_reached = false;
+            pInstance->discard_frames = 0;
+            pInstance->skip_samples = 0;
+            pInstance->samples_out = sample;
+            return true;
+        }
+
+        ESP_LOGE(TAG, "no frame found near offset %u", (unsigned)at.offset);
+        fseek(fp, resume, SEEK_SET);
+        return false;
+    }
+
+    // walk the headers up to the target, remembering where the last few frames start
+    uint32_t starts[MP3_SEEK_WALK + 1];
+    uint32_t frame = at.frame;
+    starts[frame % (MP3_SEEK_WALK + 1)] = offset;
+    while(frame < target) {
+        int len = frame_at(&r, offset, pInstance);
+        if(!len) {
+            break;
+        }
+        offset += len;
+        frame++;
+        starts[frame % (MP3_SEEK_WALK + 1)] = offset;
+    }
+    free(r.buf);
+
+    if(frame < target) {
+        // past the end of the stream, land after the last frame and let decoding finish
+        target = frame;
+        stream_sample = (uint64_t)target * spf;
+        if(stream_sample < pInstance->start_skip) {
+            stream_sample = pInstance->start_skip;
+        }
+    }
+
+    // start early enough that the frame before the target decodes with its whole bit
+    // reservoir, its overlap is then correct for the target frame
+    uint32_t reservoir = (pInstance->version == 0) ? MP3_RESERVOIR_MPEG1 : MP3_RESERVOIR_MPEG2;
+    uint32_t lowest = (first > at.frame) ? first : at.frame;
+    uint32_t start = target;
+    if(target > lowest) {
+        uint32_t before = starts[(target - 1) % (MP3_SEEK_WALK + 1)];
+        start = target - 1;
+        while((start > lowest) && (before - starts[start % (MP3_SEEK_WALK + 1)] < reservoir)) {
+            start--;
+        }
+    }
+
+    if(fseek(fp, starts[start % (MP3_SEEK_WALK + 1)], SEEK_SET) != 0) {
+        fseek(fp, resume, SEEK_SET);
+        return false;
+    }
+
+    pInstance->bytes_in_data_buf = 0;
+    pInstance->read_ptr = pInstance->data_buf;
+    pInstance->eof_reached = false;
+    pInstance->discard_frames = target - start;
+    pInstance->skip_samples = stream_sample - (uint64_t)target * spf;
+    pInstance->samples_out = stream_sample - pInstance->start_skip;
+
+    LOGI_1("seek %u ms: frame %u, decoding from %u at offset %u", (unsigned)position_ms,
+           (unsigned)target, (unsigned)start, (unsigned)starts[start % (MP3_SEEK_WALK + 1)]);
+
+    return true;
+}
+
+uint32_t mp3_position_ms(const mp3_instance *pInstance) {
+    if(!pInstance->sample_rate) {
+        return 0;
+    }
+
+    return pInstance->samples_out * 1000 / pInstance->sample_rate;
+}
+
+uint32_t mp3_duration_ms(const mp3_instance *pInstance) {
+    if(!pInstance->sample_rate) {
+        return 0;
+    }
+
+    uint64_t samples = pInstance->valid_samples;
+    if(!samples && pInstance->total_frames) {
+        samples = (uint64_t)pInstance->total_frames * pInstance->samples_per_frame;
+        samples = (samples > pInstance->start_skip) ? (samples - pInstance->start_skip) : 0;
+    }
+    if(!samples && (pInstance->file_size > pInstance->audio_start)) {
+        // no frame count, assume a constant bitrate, bits / kbps = ms
+        return (uint64_t)(pInstance->file_size - pInstance->audio_start) * 8 / pInstance->bitrate;
+    }
+
+    return samples * 1000 / pInstance->sample_rate;
+}
+
+bool mp3_index_attach(FILE *index_fp, mp3_instance *pInstance) {
+    mp3_index_header_t hdr;
+
+    if(!index_fp || (fseek(index_fp, 0, SEEK_SET) != 0) || (fread(&hdr, sizeof(hdr), 1, index_fp) != 1)) {
+        return false;
+    }
+
+    if((memcmp(hdr.magic, MP3_INDEX_MAGIC, sizeof(hdr.magic)) != 0) || (hdr.version != MP3_INDEX_VERSION) ||
+       (hdr.file_size != pInstance->file_size) || (hdr.audio_start != pInstance->audio_start) ||
+       (hdr.entry_count == 0)) {
+        ESP_LOGW(TAG, "index doesn't match the file, ignored");
+        return false;
+    }
+
+    pInstance->index = hdr;
+    if(!pInstance->total_frames) {
+        pInstance->total_frames = hdr.total_frames;
+    }
+
+    return true;
+}
+
+static bool index_write(FILE *index_fp, uint32_t frame, uint32_t offset, mp3_index_header_t *hdr) {
+    mp3_index_entry_t entry = { .frame = frame, .offset = offset };
+    if(fwrite(&entry, sizeof(entry), 1, index_fp) != 1) {
+        return false;
+    }
+
+    hdr->entry_count++;
+    return true;
+}
+
+/**
+ * One entry per point of the Xing TOC
+ */
+static bool index_from_xing(FILE *index_fp, const mp3_instance *inst, mp3_index_header_t *hdr) {
+    uint32_t last_frame = 0;
+
+    for(uint32_t i = 0; i < sizeof(inst->toc); i++) {
+        uint32_t frame = (uint64_t)i * inst->total_frames / 100;
+        uint32_t offset = inst->toc_base + (uint64_t)inst->toc[i] * inst->toc_bytes / 256;
+        if(i && (frame == last_frame)) {
+            continue; // fewer than 100 frames
+        }
+        if(offset < inst->audio_start) {
+            offset = inst->audio_start;
+        }
+        if(!index_write(index_fp, frame, offset, hdr)) {
+            return false;
+        }
+        last_frame = frame;
+    }
+
+    return true;
+}
+
+/**
+ * One entry per group of frames in the VBRI TOC, which stores the size of each group
+ */
+static bool index_from_vbri(FILE *fp, FILE *index_fp, const mp3_instance *inst, mp3_index_header_t *hdr) {
+    uint8_t vbri[26];
+    if((fseek(fp, inst->toc_base + 4 + 32, SEEK_SET) != 0) || (fread(vbri, 1, sizeof(vbri), fp) != sizeof(vbri))) {
+        return false;
+    }
+
+    uint32_t entries = read_be16(&vbri[18]);
+    uint32_t scale = read_be16(&vbri[20]);
+    uint32_t entry_size = read_be16(&vbri[22]);
+    uint32_t frames_per_entry = read_be16(&vbri[24]);
+    if((entry_size < 1) || (entry_size > 4) || !frames_per_entry) {
+        return false;
+    }
+
+    uint32_t offset = inst->audio_start;
+    uint32_t frame = 0;
+    if(!index_write(index_fp, frame, offset, hdr)) {
+        return false;
+    }
+
+    for(uint32_t i = 0; i + 1 < entries; i++) {
+        uint8_t b[4];
+        if(fread(b, 1, entry_size, fp) != entry_size) {
+            return false;
+        }
+
+        uint32_t size = 0;
+        for(uint32_t n = 0; n < entry_size; n++) {
+            size = (size << 8) | b[n];
+        }
+
+        offset += size * scale;
+        frame += frames_per_entry;
+        if(inst->total_frames && (frame >= inst->total_frames)) {
+            break;
+        }
+        if(!index_write(index_fp, frame, offset, hdr)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Walk every frame header, one entry every MP3_INDEX_STRIDE frames
+ */
+static bool index_from_scan(FILE *fp, FILE *index_fp, const mp3_instance *inst, mp3_index_header_t *hdr) {
+    frame_reader_t r = { .fp = fp, .buf = static_cast<uint8_t*>(malloc(MP3_SCAN_BUF_SIZE)),
+                         .size = MP3_SCAN_BUF_SIZE, .len = 0, .base = 0 };
+    ESP_RETURN_ON_FALSE(r.buf, false, TAG, "no memory for index scan");
+
+    bool ok = true;
+    uint32_t frame = 0;
+    uint32_t offset = frame_sync(&r, inst->audio_start, inst);
+    while(offset != UINT32_MAX) {
+        int len = frame_at(&r, offset, inst);
+        if(!len) {
+            // damaged data, or the tags at the end of the file
+            offset = frame_sync(&r, offset, inst);
+            continue;
+        }
+
+        if((frame % MP3_INDEX_STRIDE) == 0) {
+            ok = index_write(index_fp, frame, offset, hdr);
+            if(!ok) {
+                break;
+            }
+        }
+        offset += len;
+        frame++;
+    }
+
+    free(r.buf);
+    hdr->total_frames = frame;
+    return ok && frame;
+}
+
+esp_err_t mp3_index_build(FILE *fp, FILE *index_fp) {
+    mp3_instance inst;
+    memset(&inst, 0, sizeof(inst));
+    mp3_probe(fp, &inst);
+    ESP_RETURN_ON_FALSE(inst.sample_rate, ESP_ERR_INVALID_ARG, TAG, "no mp3 frame found");
+
+    mp3_index_header_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, MP3_INDEX_MAGIC, sizeof(hdr.magic));
+    hdr.version = MP3_INDEX_VERSION;
+    hdr.file_size = inst.file_size;
+    hdr.audio_start = inst.audio_start;
+    hdr.total_frames = inst.total_frames;
+
+    // the header is rewritten once the entries are counted
+    ESP_RETURN_ON_FALSE(fwrite(&hdr, sizeof(hdr), 1, index_fp) == 1, ESP_FAIL, TAG, "index write failed");
+
+    bool ok;
+    if(inst.has_toc) {
+        hdr.source = MP3_INDEX_SOURCE_XING;
+        ok = index_from_xing(index_fp, &inst, &hdr);
+    } else if(inst.has_vbri && inst.total_frames) {
+        hdr.source = MP3_INDEX_SOURCE_VBRI;
+        ok = index_from_vbri(fp, index_fp, &inst, &hdr);
+    } else {
+        hdr.source = MP3_INDEX_SOURCE_SCAN;
+        ok = index_from_scan(fp, index_fp, &inst, &hdr);
+    }
+
+    ESP_RETURN_ON_FALSE(ok, ESP_FAIL, TAG, "index build failed");
+    ESP_RETURN_ON_FALSE((fseek(index_fp, 0, SEEK_SET) == 0) && (fwrite(&hdr, sizeof(hdr), 1, index_fp) == 1),
+                        ESP_FAIL, TAG, "index write failed");
+
+    LOGI_1("index: source %u, %u entries, %u frames", (unsigned)hdr.source,
+           (unsigned)hdr.entry_count, (unsigned)hdr.total_frames);
+
+    return ESP_OK;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <stdio.h>
+#include "esp_err.h"
+#include "audio_decode_types.h"
+#include "mp3dec.h"
+
+typedef struct {
+    char header[3];     /*!< Always "TAG" */
+    char title[30];     /*!< Audio title */
+    char artist[30];    /*!< Audio artist */
+    char album[30];     /*!< Album name */
+    char year[4];       /*!< Char array of year */
+    char comment[30];   /*!< Extra comment */
+    char genre;         /*!< See "https://en.wikipedia.org/wiki/ID3" */
+} __attribute__((packed)) mp3_id3_header_v1_t;
+
+typedef struct {
+    char header[3];     /*!< Always "ID3" */
+    char ver;           /*!< Version, equals to3 if ID3V2.3 */
+    char revision;      /*!< Revision, should be 0 */
+    char flag;          /*!< Flag byte, use Bit[7..5] only */
+    char size[4];       /*!< TAG size */
+} __attribute__((packed)) mp3_id3_header_v2_t;
+
+/** Sidecar seek index, see mp3_index_build() */
+#define MP3_INDEX_MAGIC     "MP3X"
+#define MP3_INDEX_VERSION   1
+
+/** frames between the entries of an index built by scanning the frame headers */
+#define MP3_INDEX_STRIDE    32
+
+typedef enum {
+    MP3_INDEX_SOURCE_SCAN,  /*!< every MP3_INDEX_STRIDE frames, offsets are frame starts */
+    MP3_INDEX_SOURCE_XING,  /*!< 100 points of the Xing TOC, offsets are interpolated */
+    MP3_INDEX_SOURCE_VBRI,  /*!< VBRI TOC, one entry per group of frames */
+} mp3_index_source_t;
+
+typedef struct {
+    char magic[4];          /*!< MP3_INDEX_MAGIC */
+    uint16_t version;       /*!< MP3_INDEX_VERSION */
+    uint16_t source;        /*!< mp3_index_source_t */
+    uint32_t file_size;     /*!< size of the mp3 file the index was built for */
+    uint32_t audio_start;   /*!< offset of the first audio frame */
+    uint32_t total_frames;  /*!< audio frames in the file, 0 if unknown */
+    uint32_t entry_count;   /*!< number of mp3_index_entry_t following the header */
+} __attribute__((packed)) mp3_index_header_t;
+
+/** Entries are sorted by frame, the first one is always frame 0 at audio_start */
+typedef struct {
+    uint32_t frame;         /*!< frame number counted from the first audio frame */
+    uint32_t offset;        /*!< byte offset of the frame in the file */
+} __attribute__((packed)) mp3_index_entry_t;
+
+typedef struct {
+    // Constants below
+    uint8_t *data_buf;
+
+    /** number of bytes in data_buf */
+    size_t data_buf_size;
+
+    // Values that change at runtime are below
+
+    /**
+     * Total bytes in data_buf,
+     * not the number of bytes remaining after the read_ptr
+     */
+    size_t bytes_in_data_buf;
+
+    /** Pointer to read location in data_buf */
+    uint8_t *read_ptr;
+
+    // set to true if the end of file has been reached
+    bool eof_reached;
+
+    /**
+     * Gapless playback info taken from the Xing/Info frame and LAME tag,
+     * see mp3_probe(). All values are in samples per channel.
+     */
+
+    /** samples still to be dropped at the start (encoder + decoder delay) */
+    uint32_t skip_samples;
+
+    /** number of samples to output for the whole stream, 0 if unknown */
+    uint64_t valid_samples;
+
+    /** number of samples output so far */
+    uint64_t samples_out;
+
+    /**
+     * Stream layout taken from the first frame by mp3_probe(), used for seeking.
+     * sample_rate is 0 if the first frame couldn't be parsed.
+     */
+
+    /** offset of the first audio frame, after any ID3v2 tag and Xing/Info/VBRI frame */
+    uint32_t audio_start;
+
+    /** size of the file, 0 if unknown */
+    uint32_t file_size;
+
+    uint32_t sample_rate;
+    uint16_t samples_per_frame;
+
+    /** bitrate of the first frame in kbps, for estimating positions in CBR files */
+    uint16_t bitrate;
+
+    /** MPEG version index as used by the libhelix tables, 0 = MPEG1 */
+    uint8_t version;
+
+    /** audio frames in the file from the Xing/VBRI frame, 0 if unknown */
+    uint32_t total_frames;
+
+    /** encoder + decoder delay, samples dropped at the start of the stream */
+    uint32_t start_skip;
+
+    /** Xing TOC, used to seek VBR files that have no sidecar index */
+    bool has_toc;
+    uint8_t toc[100];
+    uint32_t toc_base;   /*!< offset of the Xing or VBRI frame, TOC positions are relative to it */
+    uint32_t toc_bytes;  /*!< stream size the TOC positions are scaled to */
+
+    /** the first frame is a VBRI frame, its TOC is read by mp3_index_build() */
+    bool has_vbri;
+
+    /** header of the sidecar index attached with mp3_index_attach(), entry_count is 0 if none */
+    mp3_index_header_t index;
+
+    /** frames to decode and drop after a seek while the bit reservoir refills */
+    uint32_t discard_frames;
+} mp3_instance;
+
+bool is_mp3(FILE *fp);
+
+/**
+ * Parse the Xing/Info frame and LAME tag, if present, to retrieve the
+ * encoder delay and padding so that decode_mp3() can trim them.
+ *
+ * Resets the runtime values of pInstance and leaves fp positioned
+ * at the first audio frame (after any ID3v2 tag and the Xing/Info frame).
+ */
+void mp3_probe(FILE *fp, mp3_instance *pInstance);
+DECODE_STATUS decode_mp3(HMP3Decoder mp3_decoder, FILE *fp, decode_data *pData, mp3_instance *pInstance);
+
+/**
+ * Build a seek index for fp and write it to index_fp.
+ *
+ * The index comes from the Xing or VBRI TOC if the file has one, otherwise the
+ * frame headers of the whole file are walked once. The position of fp is not preserved.
+ *
+ * @param index_fp - opened for writing, e.g. "wb"
+ */
+esp_err_t mp3_index_build(FILE *fp, FILE *index_fp);
+
+/**
+ * Check that index_fp was built for the file probed into pInstance and, if so,
+ * use it for seeking.
+ *
+ * @return true if the index matches the file
+ */
+bool mp3_index_attach(FILE *index_fp, mp3_instance *pInstance);
+
+/**
+ * Move decoding to position_ms.
+ *
+ * The frame is found in O(log n) reads of the sidecar index when one is attached,
+ * otherwise from the Xing TOC or by assuming a constant bitrate. Decoding restarts
+ * a few frames early so the bit reservoir of the target frame is complete, those
+ * frames and the samples before position_ms are dropped.
+ *
+ * The decoder must be fresh, libhelix has no reset.
+ *
+ * @param index_fp - index attached with mp3_index_attach(), or NULL
+ * @return false if the stream can't be seeked, pInstance is unchanged
+ */
+bool mp3_seek(FILE *fp, mp3_instance *pInstance, FILE *index_fp, uint32_t position_ms);
+
+/** @return position of the next sample to be output, in milliseconds */
+uint32_t mp3_position_ms(const mp3_instance *pInstance);
+
+/** @return length of the stream in milliseconds, estimated for CBR files without a Xing/VBRI frame, 0 if unknown */
+uint32_t mp3_duration_ms(const mp3_instance *pInstance);
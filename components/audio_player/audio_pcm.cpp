@@ -0,0 +1,274 @@
+#include <string.h>
+#include "sdkconfig.h"
+#include "audio_pcm.h"
+
+#if CONFIG_IDF_TARGET_ESP32S3 && CONFIG_AUDIO_PLAYER_PCM_SIMD
+#define AUDIO_PCM_PIE 1
+#else
+#define AUDIO_PCM_PIE 0
+#endif
+
+#if defined(__XTENSA__) && !defined(__XTENSA_SOFT_FLOAT__)
+#define AUDIO_PCM_FPU 1
+#else
+#define AUDIO_PCM_FPU 0
+#endif
+
+static inline bool is_aligned(const void *out, const void *in) {
+    return ((reinterpret_cast<uintptr_t>(out) | reinterpret_cast<uintptr_t>(in)) & (AUDIO_PCM_ALIGN - 1)) == 0;
+}
+
+void audio_pcm_mono16_to_stereo16_ref(int16_t *out, const int16_t *in, size_t frames) {
+    for(size_t n = 0; n < frames; n++) {
+        out[2 * n] = in[n];
+        out[2 * n + 1] = in[n];
+    }
+}
+
+void audio_pcm_mono16_to_stereo32_ref(int32_t *out, const int16_t *in, size_t frames) {
+    for(size_t n = 0; n < frames; n++) {
+        int32_t s = static_cast<int32_t>(static_cast<uint32_t>(static_cast<uint16_t>(in[n])) << 16);
+        out[2 * n] = s;
+        out[2 * n + 1] = s;
+    }
+}
+
+void audio_pcm_s16_to_s32_ref(int32_t *out, const int16_t *in, size_t samples) {
+    for(size_t n = 0; n < samples; n++) {
+        out[n] = static_cast<int32_t>(static_cast<uint32_t>(static_cast<uint16_t>(in[n])) << 16);
+    }
+}
+
+void audio_pcm_mono32_to_stereo32_ref(int32_t *out, const int32_t *in, size_t frames) {
+    for(size_t n = 0; n < frames; n++) {
+        out[2 * n] = in[n];
+        out[2 * n + 1] = in[n];
+    }
+}
+
+void audio_pcm_s24_to_s32_ref(int32_t *out, const uint8_t *in, size_t samples) {
+    for(size_t n = 0; n < samples; n++) {
+        uint32_t s = (static_cast<uint32_t>(in[3 * n]) << 8) |
+                     (static_cast<uint32_t>(in[3 * n + 1]) << 16) |
+                     (static_cast<uint32_t>(in[3 * n + 2]) << 24);
+        out[n] = static_cast<int32_t>(s);
+    }
+}
+
+void audio_pcm_f32_to_s32_ref(int32_t *out, const float *in, size_t samples) {
+    for(size_t n = 0; n < samples; n++) {
+        float x = in[n];
+        if(x >= 1.0f) {
+            out[n] = INT32_MAX;
+        } else if(x > -1.0f) {
+            out[n] = static_cast<int32_t>(x * 2147483648.0f);
+        } else {
+            out[n] = INT32_MIN;
+        }
+    }
+}
+
+void audio_pcm_s24_to_s32(int32_t *out, const uint8_t *in, size_t samples) {
+    size_t done = 0;
+    if((reinterpret_cast<uintptr_t>(in) & 3) == 0) {
+        // little endian words w0 = b3 b2 b1 b0, w1 = b7 b6 b5 b4, w2 = b11 b10 b9 b8
+        const uint32_t *src = reinterpret_cast<const uint32_t *>(in);
+        size_t blocks = samples / 4;
+        for(size_t b = 0; b < blocks; b++) {
+            uint32_t w0 = src[0];
+            uint32_t w1 = src[1];
+            uint32_t w2 = src[2];
+            out[0] = static_cast<int32_t>(w0 << 8);
+            out[1] = static_cast<int32_t>(((w0 >> 16) & 0xff00) | (w1 << 16));
+            out[2] = static_cast<int32_t>(((w1 >> 8) & 0xffff00) | (w2 << 24));
+            out[3] = static_cast<int32_t>(w2 & 0xffffff00);
+            src += 3;
+            out += 4;
+        }
+        done = blocks * 4;
+    }
+    audio_pcm_s24_to_s32_ref(out, in + 3 * done, samples - done);
+}
+
+void audio_pcm_f32_to_s32(int32_t *out, const float *in, size_t samples) {
+#if AUDIO_PCM_FPU
+    // TRUNC.S scales by 2^31 and saturates out of range values to INT32_MIN/MAX
+    for(size_t n = 0; n < samples; n++) {
+        int32_t s;
+        asm("trunc.s %0, %1, 31" : "=r"(s) : "f"(in[n]));
+        out[n] = s;
+    }
+#else
+    audio_pcm_f32_to_s32_ref(out, in, samples);
+#endif
+}
+
+/*
+ * The PIE kernels below work on one 128 bit register of input per iteration.
+ * EE.VZIP interleaves the lanes of two registers: the first register receives
+ * the interleaved low halves, the second the interleaved high halves. Zipping a
+ * register with a copy of itself duplicates every sample (mono -> stereo),
+ * zipping a zero register with data puts each 16 bit sample in the high half
+ * of a 32 bit lane (16 -> 32 bit).
+ */
+
+void audio_pcm_mono16_to_stereo16(int16_t *out, const int16_t *in, size_t frames) {
+    size_t done = 0;
+#if AUDIO_PCM_PIE
+    if(is_aligned(out, in)) {
+        const int16_t *src = in;
+        int16_t *dst = out;
+        size_t blocks = frames / 8;
+        for(size_t b = 0; b < blocks; b++) {
+            asm volatile(
+                "ee.vld.128.ip  q0, %0, 16 \n"
+                "ee.orq         q1, q0, q0 \n"
+                "ee.vzip.16     q0, q1     \n"
+                "ee.vst.128.ip  q0, %1, 16 \n"
+                "ee.vst.128.ip  q1, %1, 16 \n"
+                : "+r"(src), "+r"(dst) :: "memory");
+        }
+        done = blocks * 8;
+    }
+#endif
+    audio_pcm_mono16_to_stereo16_ref(out + 2 * done, in + done, frames - done);
+}
+
+void audio_pcm_mono16_to_stereo32(int32_t *out, const int16_t *in, size_t frames) {
+    size_t done = 0;
+#if AUDIO_PCM_PIE
+    if(is_aligned(out, in)) {
+        const int16_t *src = in;
+        int32_t *dst = out;
+        size_t blocks = frames / 8;
+        for(size_t b = 0; b < blocks; b++) {
+            asm volatile(
+                "ee.vld.128.ip  q0, %0, 16 \n"
+                "ee.orq         q1, q0, q0 \n"
+                "ee.vzip.16     q0, q1     \n"  // q0 = a0 a0 .. a3 a3, q1 = a4 a4 .. a7 a7
+                "ee.zero.q      q2         \n"
+                "ee.zero.q      q3         \n"
+                "ee.vzip.16     q2, q0     \n"
+                "ee.vzip.16     q3, q1     \n"
+                "ee.vst.128.ip  q2, %1, 16 \n"
+                "ee.vst.128.ip  q0, %1, 16 \n"
+                "ee.vst.128.ip  q3, %1, 16 \n"
+                "ee.vst.128.ip  q1, %1, 16 \n"
+                : "+r"(src), "+r"(dst) :: "memory");
+        }
+        done = blocks * 8;
+    }
+#endif
+    audio_pcm_mono16_to_stereo32_ref(out + 2 * done, in + done, frames - done);
+}
+
+void audio_pcm_s16_to_s32(int32_t *out, const int16_t *in, size_t samples) {
+    size_t done = 0;
+#if AUDIO_PCM_PIE
+    if(is_aligned(out, in)) {
+        const int16_t *src = in;
+        int32_t *dst = out;
+        size_t blocks = samples / 8;
+        for(size_t b = 0; b < blocks; b++) {
+            asm volatile(
+                "ee.vld.128.ip  q1, %0, 16 \n"
+                "ee.zero.q      q0         \n"
+                "ee.vzip.16     q0, q1     \n"
+                "ee.vst.128.ip  q0, %1, 16 \n"
+                "ee.vst.128.ip  q1, %1, 16 \n"
+                : "+r"(src), "+r"(dst) :: "memory");
+        }
+        done = blocks * 8;
+    }
+#endif
+    audio_pcm_s16_to_s32_ref(out + done, in + done, samples - done);
+}
+
+void audio_pcm_mono32_to_stereo32(int32_t *out, const int32_t *in, size_t frames) {
+    size_t done = 0;
+#if AUDIO_PCM_PIE
+    if(is_aligned(out, in)) {
+        const int32_t *src = in;
+        int32_t *dst = out;
+        size_t blocks = frames / 4;
+        for(size_t b = 0; b < blocks; b++) {
+            asm volatile(
+                "ee.vld.128.ip  q0, %0, 16 \n"
+                "ee.orq         q1, q0, q0 \n"
+                "ee.vzip.32     q0, q1     \n"
+                "ee.vst.128.ip  q0, %1, 16 \n"
+                "ee.vst.128.ip  q1, %1, 16 \n"
+                : "+r"(src), "+r"(dst) :: "memory");
+        }
+        done = blocks * 4;
+    }
+#endif
+    audio_pcm_mono32_to_stereo32_ref(out + 2 * done, in + done, frames - done);
+}
+
+bool audio_pcm_selftest(void) {
+    static const size_t lengths[] = { 0, 1, 7, 8, 9, 63, 64, 67 };
+    alignas(AUDIO_PCM_ALIGN) static int32_t in[72];
+    alignas(AUDIO_PCM_ALIGN) static int32_t out[2 * 72];
+    alignas(AUDIO_PCM_ALIGN) static int32_t ref[2 * 72];
+
+    uint32_t seed = 12345;
+    for(size_t n = 0; n < sizeof(in) / sizeof(in[0]); n++) {
+        seed = seed * 1664525 + 1013904223;
+        in[n] = static_cast<int32_t>(seed);
+    }
+
+    // floats in [-1.25, 1.25) so both saturation ends are covered
+    alignas(AUDIO_PCM_ALIGN) static float fin[72];
+    for(size_t n = 0; n < sizeof(fin) / sizeof(fin[0]); n++) {
+        fin[n] = static_cast<float>(in[n]) * (1.25f / 2147483648.0f);
+    }
+    fin[0] = 1.0f;
+    fin[1] = -1.0f;
+
+    const int16_t *in16 = reinterpret_cast<const int16_t *>(in);
+    bool ok = true;
+
+    // offset 0 takes the SIMD path, offset 1 the unaligned fallback
+    for(size_t offset = 0; offset < 2; offset++) {
+        for(size_t len : lengths) {
+            memset(out, 0x55, sizeof(out));
+            memset(ref, 0x55, sizeof(ref));
+            audio_pcm_mono16_to_stereo16(reinterpret_cast<int16_t *>(out) + offset, in16 + offset, len);
+            audio_pcm_mono16_to_stereo16_ref(reinterpret_cast<int16_t *>(ref) + offset, in16 + offset, len);
+            ok &= memcmp(out, ref, sizeof(out)) == 0;
+
+            memset(out, 0x55, sizeof(out));
+            memset(ref, 0x55, sizeof(ref));
+            audio_pcm_mono16_to_stereo32(out + offset, in16 + offset, len);
+            audio_pcm_mono16_to_stereo32_ref(ref + offset, in16 + offset, len);
+            ok &= memcmp(out, ref, sizeof(out)) == 0;
+
+            memset(out, 0x55, sizeof(out));
+            memset(ref, 0x55, sizeof(ref));
+            audio_pcm_s16_to_s32(out + offset, in16 + offset, 2 * len);
+            audio_pcm_s16_to_s32_ref(ref + offset, in16 + offset, 2 * len);
+            ok &= memcmp(out, ref, sizeof(out)) == 0;
+
+            memset(out, 0x55, sizeof(out));
+            memset(ref, 0x55, sizeof(ref));
+            audio_pcm_mono32_to_stereo32(out + offset, in + offset, len);
+            audio_pcm_mono32_to_stereo32_ref(ref + offset, in + offset, len);
+            ok &= memcmp(out, ref, sizeof(out)) == 0;
+
+            memset(out, 0x55, sizeof(out));
+            memset(ref, 0x55, sizeof(ref));
+            audio_pcm_s24_to_s32(out + offset, reinterpret_cast<const uint8_t *>(in) + offset, len);
+            audio_pcm_s24_to_s32_ref(ref + offset, reinterpret_cast<const uint8_t *>(in) + offset, len);
+            ok &= memcmp(out, ref, sizeof(out)) == 0;
+
+            memset(out, 0x55, sizeof(out));
+            memset(ref, 0x55, sizeof(ref));
+            audio_pcm_f32_to_s32(out + offset, fin + offset, len);
+            audio_pcm_f32_to_s32_ref(ref + offset, fin + offset, len);
+            ok &= memcmp(out, ref, sizeof(out)) == 0;
+        }
+    }
+
+    return ok;
+}
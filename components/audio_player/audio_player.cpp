@@ -0,0 +1,1262 @@
+/**
+ * @file
+ * @version 0.1
+ *
+ * @copyright Copyright 2021 Espressif Systems (Shanghai) Co. Ltd.
+ * @copyright Copyright 2022 Chris Morgan <chmorgan@gmail.com>
+ *
+ *      Licensed under the Apache License, Version 2.0 (the "License");
+ *      you may not use this file except in compliance with the License.
+ *      You may obtain a copy of the License at
+ *
+ *               http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *      Unless required by applicable law or agreed to in writing, software
+ *      distributed under the License is distributed on an "AS IS" BASIS,
+ *      WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *      See the License for the specific language governing permissions and
+ *      limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/unistd.h>
+#include <sys/stat.h>
+
+#include "esp_check.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_heap_caps.h"
+
+#include "sdkconfig.h"
+
+#include "audio_player.h"
+#include "audio_pcm.h"
+#include "audio_prof.h"
+
+#include "audio_wav.h"
+#include "audio_mp3.h"
+#include "audio_flac.h"
+#include "esp_log.h"
+
+static const char *TAG = "audio";
+
+typedef enum {
+    AUDIO_PLAYER_REQUEST_NONE = 0,
+    AUDIO_PLAYER_REQUEST_PAUSE,              /**< pause playback */
+    AUDIO_PLAYER_REQUEST_RESUME,             /**< resumed paused playback */
+    AUDIO_PLAYER_REQUEST_PLAY,               /**< initiate playing a new file */
+    AUDIO_PLAYER_REQUEST_STOP,               /**< stop playback */
+    AUDIO_PLAYER_REQUEST_SHUTDOWN_THREAD,    /**< shutdown audio playback thread */
+    AUDIO_PLAYER_REQUEST_NEXT,               /**< wake up to check the next-track queue */
+    AUDIO_PLAYER_REQUEST_SEEK,               /**< move the playback position of the present file */
+    AUDIO_PLAYER_REQUEST_MAX
+} audio_player_event_type_t;
+
+typedef struct {
+    audio_player_event_type_t type;
+
+    // valid if type == AUDIO_PLAYER_EVENT_TYPE_PLAY
+    FILE* fp;
+    FILE* index_fp;
+
+    // valid if type == AUDIO_PLAYER_REQUEST_PLAY or AUDIO_PLAYER_REQUEST_SEEK
+    uint32_t position_ms;
+} audio_player_event_t;
+
+/** Entry of the next-track queue */
+typedef struct {
+    FILE *fp;
+    FILE *index_fp;
+} audio_player_queued_t;
+
+typedef enum {
+    FILE_TYPE_UNKNOWN,
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_MP3)
+    FILE_TYPE_MP3,
+#endif
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_WAV)
+    FILE_TYPE_WAV,
+#endif
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_FLAC)
+    FILE_TYPE_FLAC,
+#endif
+} FILE_TYPE;
+
+/** Number of files that can be waiting in the next-track queue */
+#define NEXT_QUEUE_LEN      4
+
+/** Upper bound on decode calls when pre-decoding the start of the next track */
+#define PRIME_MAX_DECODES   8
+
+/**
+ * A file being decoded.
+ *
+ * There are two of these, the current track and the next one, so the next track
+ * can be opened, probed and its first frame decoded while the current one finishes.
+ */
+typedef struct {
+    FILE *fp;
+    FILE_TYPE file_type;
+
+    /** seek index of an mp3 file, NULL if there is none */
+    FILE *index_fp;
+
+    decode_data output;
+
+    /** true if output holds a frame decoded ahead of time by track_prime() */
+    bool primed;
+
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_WAV)
+    wav_instance wav_data;
+#endif
+
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_MP3)
+    HMP3Decoder mp3_decoder;
+    mp3_instance mp3_data;
+#endif
+
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_FLAC)
+    flac_instance flac_data;
+#endif
+} audio_track_t;
+
+typedef struct audio_instance {
+    /**
+     * Set to true before task is created, false immediately before the
+     * task is deleted.
+     */
+    bool running;
+
+    audio_track_t track[2];
+
+    /**
+     * Decoded audio that has to be converted before it is written to i2s
+     * (mono, or 16 bit samples going to 32 bit slots) is rendered here in a
+     * single pass, aligned for the SIMD conversion kernels
+     */
+    uint8_t *render_buf;
+    size_t render_capacity;
+
+    /** index into track[] of the track presently playing */
+    uint8_t cur;
+
+    /** position and length of the present track, written by the audio task */
+    volatile uint32_t position_ms;
+    volatile uint32_t duration_ms;
+
+    QueueHandle_t event_queue;
+
+    /** files queued with audio_player_queue(), played back to back */
+    QueueHandle_t next_queue;
+
+    /* **************** AUDIO CALLBACK **************** */
+    audio_player_cb_t s_audio_cb;
+    void *audio_cb_usrt_ctx;
+    audio_player_state_t state;
+
+    audio_player_config_t config;
+} audio_instance_t;
+
+static audio_instance_t instance;
+
+audio_player_state_t audio_player_get_state() {
+    return instance.state;
+}
+
+esp_err_t audio_player_callback_register(audio_player_cb_t call_back, void *user_ctx)
+{
+#if CONFIG_IDF_TARGET_ARCH_XTENSA
+    ESP_RETURN_ON_FALSE(esp_ptr_executable(reinterpret_cast<void*>(call_back)), ESP_ERR_INVALID_ARG,
+        TAG, "Not a valid call back");
+#else
+    ESP_RETURN_ON_FALSE(reinterpret_cast<void*>(call_back), ESP_ERR_INVALID_ARG,
+        TAG, "Not a valid call back");
+#endif
+    instance.s_audio_cb = call_back;
+    instance.audio_cb_usrt_ctx = user_ctx;
+
+    return ESP_OK;
+}
+
+// This function is used in some optional logging functions so we don't want to
+// have a cppcheck warning here
+// cppcheck-suppress unusedFunction
+const char* event_to_string(audio_player_callback_event_t event) {
+    switch(event) {
+    case AUDIO_PLAYER_CALLBACK_EVENT_IDLE:
+        return "AUDIO_PLAYER_CALLBACK_EVENT_IDLE";
+    case AUDIO_PLAYER_CALLBACK_EVENT_COMPLETED_PLAYING_NEXT:
+        return "AUDIO_PLAYER_CALLBACK_EVENT_COMPLETED_PLAYING_NEXT";
+    case AUDIO_PLAYER_CALLBACK_EVENT_PLAYING:
+        return "AUDIO_PLAYER_CALLBACK_EVENT_PLAYING";
+    case AUDIO_PLAYER_CALLBACK_EVENT_PAUSE:
+        return "AUDIO_PLAYER_CALLBACK_EVENT_PAUSE";
+    case AUDIO_PLAYER_CALLBACK_EVENT_SHUTDOWN:
+        return "AUDIO_PLAYER_CALLBACK_EVENT_SHUTDOWN";
+    case AUDIO_PLAYER_CALLBACK_EVENT_UNKNOWN_FILE_TYPE:
+        return "AUDIO_PLAYER_CALLBACK_EVENT_UNKNOWN_FILE_TYPE";
+    case AUDIO_PLAYER_CALLBACK_EVENT_UNKNOWN:
+        return "AUDIO_PLAYER_CALLBACK_EVENT_UNKNOWN";
+    }
+
+    return "unknown event";
+}
+
+static audio_player_callback_event_t state_to_event(audio_player_state_t state) {
+    audio_player_callback_event_t event = AUDIO_PLAYER_CALLBACK_EVENT_UNKNOWN;
+
+    switch(state) {
+        case AUDIO_PLAYER_STATE_IDLE:
+            event = AUDIO_PLAYER_CALLBACK_EVENT_IDLE;
+            break;
+        case AUDIO_PLAYER_STATE_PAUSE:
+            event = AUDIO_PLAYER_CALLBACK_EVENT_PAUSE;
+            break;
+        case AUDIO_PLAYER_STATE_PLAYING:
+            event = AUDIO_PLAYER_CALLBACK_EVENT_PLAYING;
+            break;
+        case AUDIO_PLAYER_STATE_SHUTDOWN:
+            event = AUDIO_PLAYER_CALLBACK_EVENT_SHUTDOWN;
+            break;
+    };
+
+    return event;
+}
+
+static void dispatch_callback(audio_instance_t *i, audio_player_callback_event_t event) {
+    LOGI_1("event '%s'", event_to_string(event));
+
+#if CONFIG_IDF_TARGET_ARCH_XTENSA
+    if (esp_ptr_executable(reinterpret_cast<void*>(i->s_audio_cb))) {
+#else
+    if (reinterpret_cast<void*>(i->s_audio_cb)) {
+#endif
+        audio_player_cb_ctx_t ctx = {
+            .audio_event = event,
+            .user_ctx = i->audio_cb_usrt_ctx,
+        };
+        i->s_audio_cb(&ctx);
+    }
+}
+
+static void set_state(audio_instance_t *i, audio_player_state_t new_state) {
+    if(i->state != new_state) {
+        i->state = new_state;
+        audio_player_callback_event_t event = state_to_event(new_state);
+        dispatch_callback(i, event);
+    }
+}
+
+static void audio_instance_init(audio_instance_t &i) {
+    memset(i.track, 0, sizeof(i.track));
+    i.cur = 0;
+    i.position_ms = 0;
+    i.duration_ms = 0;
+    i.event_queue = NULL;
+    i.next_queue = NULL;
+    i.render_buf = NULL;
+    i.render_capacity = 0;
+    i.s_audio_cb = NULL;
+    i.audio_cb_usrt_ctx = NULL;
+    i.state = AUDIO_PLAYER_STATE_IDLE;
+}
+
+/**
+ * Get decoded audio into the format that is written to i2s.
+ *
+ * Mono is widened to stereo, as es8311 requires stereo input even though it is
+ * mono output, and 16 bit samples are expanded if output_bits_per_sample asks for
+ * 32 bit slots. Both happen in one pass into render_buf. Audio that needs no
+ * conversion is written straight from the decode buffer.
+ */
+static esp_err_t render_output(audio_instance_t *i, const decode_data &adata,
+                               const uint8_t **pcm, size_t *bytes, format *fmt)
+{
+    uint32_t in_bits = adata.fmt.bits_per_sample;
+    uint32_t out_bits = in_bits;
+    if((in_bits == 16) && (i->config.output_bits_per_sample == 32)) {
+        out_bits = 32;
+    }
+
+    *fmt = adata.fmt;
+    fmt->bits_per_sample = out_bits;
+    fmt->channels = 2;
+
+    if((adata.fmt.channels != 1) && (out_bits == in_bits)) {
+        *fmt = adata.fmt;
+        *pcm = adata.samples;
+        *bytes = adata.frame_count * adata.fmt.channels * (in_bits / BITS_PER_BYTE);
+        return ESP_OK;
+    }
+
+    size_t need = adata.frame_count * fmt->channels * (out_bits / BITS_PER_BYTE);
+    if((adata.fmt.channels > 2) || (need > i->render_capacity)) {
+        ESP_LOGE(TAG, "insufficient space in render buffer, need %d, have %d", need, i->render_capacity);
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint32_t t = audio_prof_start();
+    if(adata.fmt.channels == 1) {
+        LOGI_3("c == 1, mono -> stereo");
+        if(in_bits == 16 && out_bits == 16) {
+            audio_pcm_mono16_to_stereo16(reinterpret_cast<int16_t*>(i->render_buf),
+                                         reinterpret_cast<const int16_t*>(adata.samples), adata.frame_count);
+        } else if(in_bits == 16 && out_bits == 32) {
+            audio_pcm_mono16_to_stereo32(reinterpret_cast<int32_t*>(i->render_buf),
+                                         reinterpret_cast<const int16_t*>(adata.samples), adata.frame_count);
+        } else if(in_bits == 32) {
+            audio_pcm_mono32_to_stereo32(reinterpret_cast<int32_t*>(i->render_buf),
+                                         reinterpret_cast<const int32_t*>(adata.samples), adata.frame_count);
+        } else {
+            ESP_LOGE(TAG, "mono %d bit audio not supported", in_bits);
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+    } else {
+        audio_pcm_s16_to_s32(reinterpret_cast<int32_t*>(i->render_buf),
+                             reinterpret_cast<const int16_t*>(adata.samples), adata.frame_count * 2);
+    }
+    audio_prof_stop(AUDIO_PROF_CONVERT, t);
+
+    *pcm = i->render_buf;
+    *bytes = need;
+    return ESP_OK;
+}
+
+/**
+ * Identify the file type and prepare the decoder for it
+ *
+ * @param index_fp - seek index, owned by the track from here on, may be NULL
+ * @return true if the file can be played
+ */
+static bool track_open(audio_track_t *t, FILE *fp, FILE *index_fp)
+{
+    t->fp = fp;
+    t->index_fp = index_fp;
+    t->file_type = FILE_TYPE_UNKNOWN;
+    t->primed = false;
+
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_FLAC)
+    // checked first, is_mp3() accepts anything that starts with an ID3 tag
+    if(is_flac(fp, &t->flac_data)) {
+        t->file_type = FILE_TYPE_FLAC;
+        LOGI_1("file is flac");
+
+        // flac files seek with their SEEKTABLE
+        if(t->index_fp) {
+            fclose(t->index_fp);
+            t->index_fp = NULL;
+        }
+    }
+#endif
+
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_MP3)
+    // cppcheck-suppress knownConditionTrueFalse
+    if(t->file_type == FILE_TYPE_UNKNOWN && is_mp3(fp)) {
+        t->file_type = FILE_TYPE_MP3;
+        LOGI_1("file is mp3");
+
+        // libhelix has no reset, start from a fresh decoder so the bit reservoir
+        // and overlap state of the slot's previous track don't leak into this one
+        MP3FreeDecoder(t->mp3_decoder);
+        t->mp3_decoder = MP3InitDecoder();
+        if(NULL == t->mp3_decoder) {
+            ESP_LOGE(TAG, "Failed create MP3 decoder");
+            return false;
+        }
+
+        // initialize mp3_instance and skip over the tags and encoder delay
+        mp3_probe(fp, &t->mp3_data);
+
+        if(t->index_fp && !mp3_index_attach(t->index_fp, &t->mp3_data)) {
+            fclose(t->index_fp);
+            t->index_fp = NULL;
+        }
+    }
+#endif
+
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_WAV)
+    // This can be a pointless condition depending on the build options, no reason to warn about it
+    // cppcheck-suppress knownConditionTrueFalse
+    if(t->file_type == FILE_TYPE_UNKNOWN)
+    {
+        if(is_wav(fp, &t->wav_data)) {
+            t->file_type = FILE_TYPE_WAV;
+            LOGI_1("file is wav");
+
+            // wav files seek without an index
+            if(t->index_fp) {
+                fclose(t->index_fp);
+                t->index_fp = NULL;
+            }
+        }
+    }
+#endif
+
+    // cppcheck-suppress knownConditionTrueFalse
+    return (t->file_type != FILE_TYPE_UNKNOWN);
+}
+
+static void track_close(audio_track_t *t)
+{
+    if(t->fp) {
+        fclose(t->fp);
+        t->fp = NULL;
+    }
+    if(t->index_fp) {
+        fclose(t->index_fp);
+        t->index_fp = NULL;
+    }
+    t->primed = false;
+}
+
+/**
+ * Move the decoding position of the track, anything decoded ahead of time is dropped
+ */
+static void track_seek(audio_track_t *t, uint32_t position_ms)
+{
+    bool ok = false;
+
+    switch(t->file_type) {
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_MP3)
+        case FILE_TYPE_MP3:
+            // libhelix has no reset, decoding restarts with a fresh decoder
+            MP3FreeDecoder(t->mp3_decoder);
+            t->mp3_decoder = MP3InitDecoder();
+            ok = (NULL != t->mp3_decoder) && mp3_seek(t->fp, &t->mp3_data, t->index_fp, position_ms);
+            break;
+#endif
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_WAV)
+        case FILE_TYPE_WAV:
+            ok = wav_seek(t->fp, &t->wav_data, position_ms);
+            break;
+#endif
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_FLAC)
+        case FILE_TYPE_FLAC:
+            ok = flac_seek(t->fp, &t->flac_data, position_ms);
+            break;
+#endif
+        case FILE_TYPE_UNKNOWN:
+            break;
+    }
+
+    if(ok) {
+        t->primed = false;
+    } else {
+        ESP_LOGE(TAG, "unable to seek to %u ms", (unsigned)position_ms);
+    }
+}
+
+/**
+ * @return position of the next decoded sample in milliseconds
+ */
+static uint32_t track_position_ms(const audio_track_t *t)
+{
+    switch(t->file_type) {
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_MP3)
+        case FILE_TYPE_MP3:
+            return mp3_position_ms(&t->mp3_data);
+#endif
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_WAV)
+        case FILE_TYPE_WAV:
+            return wav_position_ms(&t->wav_data);
+#endif
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_FLAC)
+        case FILE_TYPE_FLAC:
+            return flac_position_ms(&t->flac_data);
+#endif
+        case FILE_TYPE_UNKNOWN:
+            break;
+    }
+
+    return 0;
+}
+
+static uint32_t track_duration_ms(const audio_track_t *t)
+{
+    switch(t->file_type) {
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_MP3)
+        case FILE_TYPE_MP3:
+            return mp3_duration_ms(&t->mp3_data);
+#endif
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_WAV)
+        case FILE_TYPE_WAV:
+            return wav_duration_ms(&t->wav_data);
+#endif
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_FLAC)
+        case FILE_TYPE_FLAC:
+            return flac_duration_ms(&t->flac_data);
+#endif
+        case FILE_TYPE_UNKNOWN:
+            break;
+    }
+
+    return 0;
+}
+
+static DECODE_STATUS track_decode(audio_track_t *t)
+{
+    DECODE_STATUS decode_status = DECODE_STATUS_ERROR;
+
+    switch(t->file_type) {
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_MP3)
+        case FILE_TYPE_MP3:
+            decode_status = decode_mp3(t->mp3_decoder, t->fp, &t->output, &t->mp3_data);
+            break;
+#endif
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_WAV)
+        case FILE_TYPE_WAV:
+            decode_status = decode_wav(t->fp, &t->output, &t->wav_data);
+            break;
+#endif
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_FLAC)
+        case FILE_TYPE_FLAC:
+            decode_status = decode_flac(t->fp, &t->output, &t->flac_data);
+            break;
+#endif
+        case FILE_TYPE_UNKNOWN:
+            ESP_LOGE(TAG, "unexpected unknown file type when decoding");
+            break;
+    }
+
+    return decode_status;
+}
+
+/**
+ * @return true once all of the track's input has been read, this is when the
+ * next track is opened and primed
+ */
+static bool track_input_exhausted(audio_track_t *t)
+{
+    switch(t->file_type) {
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_MP3)
+        case FILE_TYPE_MP3:
+            return t->mp3_data.eof_reached;
+#endif
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_WAV)
+        case FILE_TYPE_WAV:
+            return t->wav_data.data_remaining <= (2 * t->output.samples_capacity);
+#endif
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_FLAC)
+        case FILE_TYPE_FLAC:
+            return t->flac_data.eof_reached;
+#endif
+        case FILE_TYPE_UNKNOWN:
+            break;
+    }
+
+    return true;
+}
+
+/**
+ * Decode ahead until the track has its first frame of audio ready
+ */
+static void track_prime(audio_track_t *t)
+{
+    for(int n = 0; n < PRIME_MAX_DECODES; n++) {
+        DECODE_STATUS decode_status = track_decode(t);
+        if(decode_status == DECODE_STATUS_CONTINUE) {
+            t->primed = true;
+            return;
+        } else if(decode_status != DECODE_STATUS_NO_DATA_CONTINUE) {
+            return;
+        }
+    }
+}
+
+/**
+ * Pull the next file off of the next-track queue, open it and decode its first frame
+ * into the idle track slot
+ *
+ * @return true if the idle slot holds a playable track
+ */
+static bool preload_next(audio_instance_t *i)
+{
+    audio_track_t *next = &i->track[i->cur ^ 1];
+    if(next->fp) {
+        return true;
+    }
+
+    audio_player_queued_t queued;
+    while(pdPASS == xQueueReceive(i->next_queue, &queued, 0)) {
+        if(track_open(next, queued.fp, queued.index_fp)) {
+            track_prime(next);
+            return true;
+        }
+
+        ESP_LOGE(TAG, "unknown file type in next-track queue, skipping");
+        dispatch_callback(i, AUDIO_PLAYER_CALLBACK_EVENT_UNKNOWN_FILE_TYPE);
+        track_close(next);
+    }
+
+    return false;
+}
+
+static void close_queued(QueueHandle_t next_queue)
+{
+    audio_player_queued_t queued;
+    while(pdPASS == xQueueReceive(next_queue, &queued, 0)) {
+        fclose(queued.fp);
+        if(queued.index_fp) {
+            fclose(queued.index_fp);
+        }
+    }
+}
+
+static void flush_next(audio_instance_t *i)
+{
+    close_queued(i->next_queue);
+    track_close(&i->track[i->cur ^ 1]);
+}
+
+static esp_err_t aplay_file(audio_instance_t *i, const audio_player_event_t &play)
+{
+    LOGI_1("start to decode");
+
+    format i2s_format;
+    memset(&i2s_format, 0, sizeof(i2s_format));
+
+    esp_err_t ret = ESP_OK;
+    audio_player_event_t audio_event = { .type = AUDIO_PLAYER_REQUEST_NONE, .fp = NULL };
+
+    audio_track_t *t = &i->track[i->cur];
+
+    if(!track_open(t, play.fp, play.index_fp)) {
+        ESP_LOGE(TAG, "unknown file type, cleaning up");
+        dispatch_callback(i, AUDIO_PLAYER_CALLBACK_EVENT_UNKNOWN_FILE_TYPE);
+        goto clean_up;
+    }
+
+    if(play.position_ms) {
+        track_seek(t, play.position_ms);
+    }
+    i->position_ms = track_position_ms(t);
+    i->duration_ms = track_duration_ms(t);
+
+    do {
+        /* Process audio event sent from other task */
+        if (pdPASS == xQueuePeek(i->event_queue, &audio_event, 0)) {
+            LOGI_2("event in queue");
+            if (AUDIO_PLAYER_REQUEST_PAUSE == audio_event.type) {
+                // receive the pause event to take it off of the queue
+                xQueueReceive(i->event_queue, &audio_event, 0);
+
+                set_state(i, AUDIO_PLAYER_STATE_PAUSE);
+
+                // wait until an event is received that will cause playback to resume,
+                // stop, or change file
+                while(1) {
+                    xQueuePeek(i->event_queue, &audio_event, portMAX_DELAY);
+
+                    if(AUDIO_PLAYER_REQUEST_SEEK == audio_event.type) {
+                        // seeking while paused moves the position without resuming
+                        xQueueReceive(i->event_queue, &audio_event, 0);
+                        track_seek(t, audio_event.position_ms);
+                        i->position_ms = track_position_ms(t);
+                    } else if((AUDIO_PLAYER_REQUEST_PLAY != audio_event.type) &&
+                              (AUDIO_PLAYER_REQUEST_STOP != audio_event.type) &&
+                              (AUDIO_PLAYER_REQUEST_RESUME != audio_event.type))
+                    {
+                        // receive to discard the event
+                        xQueueReceive(i->event_queue, &audio_event, 0);
+                    } else {
+                        break;
+                    }
+                }
+
+                if(AUDIO_PLAYER_REQUEST_RESUME == audio_event.type) {
+                    // receive to discard the event
+                    xQueueReceive(i->event_queue, &audio_event, 0);
+                    continue;
+                }
+
+                // else fall out of this condition and let the below logic
+                // handle the other event types
+            }
+
+            if ((AUDIO_PLAYER_REQUEST_STOP == audio_event.type) ||
+                (AUDIO_PLAYER_REQUEST_PLAY == audio_event.type)) {
+                // both replace whatever was queued to follow the present track
+                flush_next(i);
+                ret = ESP_OK;
+                goto clean_up;
+            } else if(AUDIO_PLAYER_REQUEST_SEEK == audio_event.type) {
+                xQueueReceive(i->event_queue, &audio_event, 0);
+                track_seek(t, audio_event.position_ms);
+                continue;
+            } else {
+                // receive to discard the event, this event has no
+                // impact on the state of playback
+                xQueueReceive(i->event_queue, &audio_event, 0);
+                continue;
+            }
+        }
+
+        set_state(i, AUDIO_PLAYER_STATE_PLAYING);
+
+        DECODE_STATUS decode_status = DECODE_STATUS_CONTINUE;
+        if(t->primed) {
+            // frame was decoded while the previous track was finishing
+            t->primed = false;
+        } else {
+            decode_status = track_decode(t);
+        }
+
+        // break out and exit if we aren't supposed to continue decoding
+        if(decode_status == DECODE_STATUS_CONTINUE)
+        {
+            i->position_ms = track_position_ms(t);
+
+            const uint8_t *pcm;
+            size_t bytes_to_write;
+            format out_fmt;
+            ret = render_output(i, t->output, &pcm, &bytes_to_write, &out_fmt);
+            if(ret != ESP_OK) {
+                goto clean_up;
+            }
+
+            /* Configure I2S clock if the output format changed */
+            if ((i2s_format.sample_rate != out_fmt.sample_rate) ||
+                    (i2s_format.channels != out_fmt.channels) ||
+                    (i2s_format.bits_per_sample != out_fmt.bits_per_sample)) {
+                i2s_format = out_fmt;
+                LOGI_1("format change: sr=%d, bit=%d, ch=%d",
+                        i2s_format.sample_rate,
+                        i2s_format.bits_per_sample,
+                        i2s_format.channels);
+                i2s_slot_mode_t channel_setting = (i2s_format.channels == 1) ? I2S_SLOT_MODE_MONO : I2S_SLOT_MODE_STEREO;
+                ret = i->config.clk_set_fn(i2s_format.sample_rate,
+                            i2s_format.bits_per_sample,
+                            channel_setting);
+                ESP_GOTO_ON_ERROR(ret, clean_up, TAG, "i2s_set_clk");
+            }
+
+            /**
+             * Block until all data has been accepted into the i2s driver, however
+             * the i2s driver has been configured with a buffer to allow for the next round of
+             * audio decoding to occur while the previous set of samples is finishing playback, in order
+             * to ensure playback without interruption.
+             */
+            size_t i2s_bytes_written = 0;
+            LOGI_2("c %d, bps %d, bytes %d, frame_count %d",
+                out_fmt.channels,
+                i2s_format.bits_per_sample,
+                bytes_to_write,
+                t->output.frame_count);
+
+            uint32_t start = audio_prof_start();
+            i->config.write_fn(const_cast<uint8_t*>(pcm), bytes_to_write, &i2s_bytes_written, portMAX_DELAY);
+            audio_prof_stop(AUDIO_PROF_OUTPUT, start);
+            if(bytes_to_write != i2s_bytes_written) {
+                ESP_LOGE(TAG, "to write %d != written %d", bytes_to_write, i2s_bytes_written);
+            }
+
+            // the i2s dma buffers are full at this point, use the slack to get the
+            // next track ready while the last of this one is being decoded
+            if(track_input_exhausted(t)) {
+                preload_next(i);
+            }
+        } else if(decode_status == DECODE_STATUS_NO_DATA_CONTINUE)
+        {
+            LOGI_2("no data");
+        } else { // DECODE_STATUS_DONE || DECODE_STATUS_ERROR
+            if(preload_next(i)) {
+                // switch tracks without leaving the decode loop, the i2s clock is only
+                // reconfigured if the format of the next track differs
+                LOGI_1("continuing with next track");
+                track_close(t);
+                i->cur ^= 1;
+                t = &i->track[i->cur];
+                i->duration_ms = track_duration_ms(t);
+                dispatch_callback(i, AUDIO_PLAYER_CALLBACK_EVENT_COMPLETED_PLAYING_NEXT);
+                continue;
+            }
+
+            LOGI_1("breaking out of playback");
+            break;
+        }
+    } while (true);
+
+clean_up:
+    track_close(t);
+    i->position_ms = 0;
+    i->duration_ms = 0;
+    if(ret != ESP_OK) {
+        flush_next(i);
+    }
+    return ret;
+}
+
+static void audio_task(void *pvParam)
+{
+    audio_instance_t *i = static_cast<audio_instance_t*>(pvParam);
+    audio_player_event_t audio_event;
+
+    while (true) {
+        // pull items off of the queue until we run into a PLAY request
+        while(true) {
+            // files queued while idle, or queued too late to be picked up by the
+            // last track, are started here
+            audio_player_queued_t queued;
+            if(pdPASS == xQueueReceive(i->next_queue, &queued, 0)) {
+                audio_event.type = AUDIO_PLAYER_REQUEST_PLAY;
+                audio_event.fp = queued.fp;
+                audio_event.index_fp = queued.index_fp;
+                audio_event.position_ms = 0;
+                if(i->state == AUDIO_PLAYER_STATE_PLAYING) {
+                    dispatch_callback(i, AUDIO_PLAYER_CALLBACK_EVENT_COMPLETED_PLAYING_NEXT);
+                } else {
+                    set_state(i, AUDIO_PLAYER_STATE_PLAYING);
+                }
+
+                break;
+            }
+
+            // zero delay in the case where we are playing as we want to
+            // send an event indicating either
+            // PLAYING -> IDLE (IDLE) or PLAYING -> PLAYING (COMPLETED PLAYING NEXT)
+            // and thus don't want to block until the next request comes in
+            // in the case when there are no further requests pending
+            int delay = (i->state == AUDIO_PLAYER_STATE_PLAYING) ? 0 : portMAX_DELAY;
+
+            int retval = xQueuePeek(i->event_queue, &audio_event, delay);
+            if (pdPASS == retval) { // item on the queue, process it
+                xQueueReceive(i->event_queue, &audio_event, 0);
+
+                // if the item is a play request, process it
+                if(AUDIO_PLAYER_REQUEST_PLAY == audio_event.type) {
+                    if(i->state == AUDIO_PLAYER_STATE_PLAYING) {
+                        dispatch_callback(i, AUDIO_PLAYER_CALLBACK_EVENT_COMPLETED_PLAYING_NEXT);
+                    } else {
+                        set_state(i, AUDIO_PLAYER_STATE_PLAYING);
+                    }
+
+                    break;
+                } else if(AUDIO_PLAYER_REQUEST_SHUTDOWN_THREAD == audio_event.type) {
+                    set_state(i, AUDIO_PLAYER_STATE_SHUTDOWN);
+                    i->running = false;
+
+                    // should never return
+                    vTaskDelete(NULL);
+                    break;
+                } else if(AUDIO_PLAYER_REQUEST_STOP == audio_event.type) {
+                    // drop anything queued while idle
+                    flush_next(i);
+                } else {
+                    // ignore other events when not playing
+                }
+            } else { // no items on the queue
+                // if we are playing transition to idle and indicate the transition via callback
+                if(i->state == AUDIO_PLAYER_STATE_PLAYING) {
+                    set_state(i, AUDIO_PLAYER_STATE_IDLE);
+                }
+            }
+        }
+
+        i->config.mute_fn(AUDIO_PLAYER_UNMUTE);
+        esp_err_t ret_val = aplay_file(i, audio_event);
+        if(ret_val != ESP_OK)
+        {
+            ESP_LOGE(TAG, "aplay_file() %d", ret_val);
+        }
+        i->config.mute_fn(AUDIO_PLAYER_MUTE);
+    }
+}
+
+/* **************** AUDIO PLAY CONTROL **************** */
+static esp_err_t audio_send_event(audio_instance_t *i, audio_player_event_t event) {
+    ESP_RETURN_ON_FALSE(NULL != i->event_queue, ESP_ERR_INVALID_STATE,
+        TAG, "Audio task not started yet");
+
+    BaseType_t ret_val = xQueueSend(i->event_queue, &event, 0);
+
+    ESP_RETURN_ON_FALSE(pdPASS == ret_val, ESP_ERR_INVALID_STATE,
+        TAG, "The last event has not been processed yet");
+
+    return ESP_OK;
+}
+
+esp_err_t audio_player_play(FILE *fp)
+{
+    return audio_player_play_at(fp, NULL, 0);
+}
+
+esp_err_t audio_player_play_at(FILE *fp, FILE *index_fp, uint32_t position_ms)
+{
+    LOGI_1("%s", __FUNCTION__);
+    audio_player_event_t event = { .type = AUDIO_PLAYER_REQUEST_PLAY, .fp = fp, .index_fp = index_fp,
+                                   .position_ms = position_ms };
+    return audio_send_event(&instance, event);
+}
+
+esp_err_t audio_player_queue(FILE *fp)
+{
+    return audio_player_queue_indexed(fp, NULL);
+}
+
+esp_err_t audio_player_queue_indexed(FILE *fp, FILE *index_fp)
+{
+    LOGI_1("%s", __FUNCTION__);
+    ESP_RETURN_ON_FALSE(NULL != instance.next_queue, ESP_ERR_INVALID_STATE,
+        TAG, "Audio task not started yet");
+
+    audio_player_queued_t queued = { .fp = fp, .index_fp = index_fp };
+    BaseType_t ret_val = xQueueSend(instance.next_queue, &queued, 0);
+    ESP_RETURN_ON_FALSE(pdPASS == ret_val, ESP_ERR_INVALID_STATE,
+        TAG, "Next-track queue is full");
+
+    // wake the audio task in case it is idle, if the event queue is full the
+    // task is busy and will look at the next-track queue anyway
+    audio_player_event_t event = { .type = AUDIO_PLAYER_REQUEST_NEXT, .fp = NULL };
+    xQueueSend(instance.event_queue, &event, 0);
+
+    return ESP_OK;
+}
+
+static ssize_t source_read(void *cookie, char *buf, size_t len) {
+    audio_player_source_t *src = static_cast<audio_player_source_t *>(cookie);
+    int ret = src->read_fn(src->ctx, buf, len);
+    return (ret < 0) ? -1 : ret;
+}
+
+static int source_seek(void *cookie, _off64_t *offset, int whence) {
+    audio_player_source_t *src = static_cast<audio_player_source_t *>(cookie);
+    int64_t pos = *offset;
+
+    if(whence == SEEK_END) {
+        int64_t size = src->size_fn ? src->size_fn(src->ctx) : -1;
+        if(size < 0) {
+            return -1;
+        }
+        pos += size;
+        whence = SEEK_SET;
+    }
+
+    if(src->seek_fn(src->ctx, &pos, whence) < 0) {
+        return -1;
+    }
+
+    *offset = pos;
+    return 0;
+}
+
+static int source_close(void *cookie) {
+    audio_player_source_t *src = static_cast<audio_player_source_t *>(cookie);
+    if(src->close_fn) {
+        src->close_fn(src->ctx);
+    }
+    free(src);
+    return 0;
+}
+
+static FILE *source_fopen(const audio_player_source_t *source, audio_player_source_t **cookie) {
+    ESP_RETURN_ON_FALSE(source && source->read_fn && source->seek_fn, NULL,
+        TAG, "source needs read_fn and seek_fn");
+
+    audio_player_source_t *src = static_cast<audio_player_source_t *>(malloc(sizeof(audio_player_source_t)));
+    ESP_RETURN_ON_FALSE(src, NULL, TAG, "no memory for source");
+    *src = *source;
+
+    cookie_io_functions_t io = {};
+    io.read = source_read;
+    io.seek = source_seek;
+    io.close = source_close;
+
+    FILE *fp = fopencookie(src, "rb", io);
+    if(!fp) {
+        free(src);
+        return NULL;
+    }
+
+    *cookie = src;
+    return fp;
+}
+
+FILE *audio_player_source_open(const audio_player_source_t *source)
+{
+    audio_player_source_t *cookie;
+    return source_fopen(source, &cookie);
+}
+
+esp_err_t audio_player_play_source(const audio_player_source_t *source)
+{
+    LOGI_1("%s", __FUNCTION__);
+    audio_player_source_t *cookie;
+    FILE *fp = source_fopen(source, &cookie);
+    ESP_RETURN_ON_FALSE(fp, ESP_ERR_NO_MEM, TAG, "unable to open source");
+
+    esp_err_t ret = audio_player_play(fp);
+    if(ret != ESP_OK) {
+        // the caller still owns the source, don't let fclose() close it
+        cookie->close_fn = NULL;
+        fclose(fp);
+    }
+
+    return ret;
+}
+
+esp_err_t audio_player_pause(void)
+{
+    LOGI_1("%s", __FUNCTION__);
+    audio_player_event_t event = { .type = AUDIO_PLAYER_REQUEST_PAUSE, .fp = NULL };
+    return audio_send_event(&instance, event);
+}
+
+esp_err_t audio_player_resume(void)
+{
+    LOGI_1("%s", __FUNCTION__);
+    audio_player_event_t event = { .type = AUDIO_PLAYER_REQUEST_RESUME, .fp = NULL };
+    return audio_send_event(&instance, event);
+}
+
+esp_err_t audio_player_stop(void)
+{
+    LOGI_1("%s", __FUNCTION__);
+    audio_player_event_t event = { .type = AUDIO_PLAYER_REQUEST_STOP, .fp = NULL };
+    return audio_send_event(&instance, event);
+}
+
+esp_err_t audio_player_seek(uint32_t position_ms)
+{
+    LOGI_1("%s", __FUNCTION__);
+    audio_player_event_t event = { .type = AUDIO_PLAYER_REQUEST_SEEK, .fp = NULL, .index_fp = NULL,
+                                   .position_ms = position_ms };
+    return audio_send_event(&instance, event);
+}
+
+uint32_t audio_player_get_position_ms(void)
+{
+    return instance.position_ms;
+}
+
+uint32_t audio_player_get_duration_ms(void)
+{
+    return instance.duration_ms;
+}
+
+esp_err_t audio_player_mp3_index(FILE *fp, FILE *index_fp)
+{
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_MP3)
+    ESP_RETURN_ON_FALSE(fp && index_fp, ESP_ERR_INVALID_ARG, TAG, "no file");
+    ESP_RETURN_ON_FALSE(is_mp3(fp), ESP_ERR_NOT_SUPPORTED, TAG, "not an mp3 file");
+    return mp3_index_build(fp, index_fp);
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t audio_player_decode(FILE *fp, audio_player_pcm_fn pcm_fn, void *ctx)
+{
+    ESP_RETURN_ON_FALSE(fp && pcm_fn, ESP_ERR_INVALID_ARG, TAG, "no file");
+
+    // a track of its own, the two of the audio task may be in use
+    audio_track_t *t = static_cast<audio_track_t*>(calloc(1, sizeof(audio_track_t)));
+    ESP_RETURN_ON_FALSE(NULL != t, ESP_ERR_NO_MEM, TAG, "Failed allocate track");
+
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    t->output.samples_capacity = MAX_NCHAN * MAX_NGRAN * MAX_NSAMP;
+    t->output.samples_capacity_max = t->output.samples_capacity * 2;
+    t->output.samples = static_cast<uint8_t*>(heap_caps_aligned_alloc(AUDIO_PCM_ALIGN,
+                                              t->output.samples_capacity_max, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_MP3)
+    t->mp3_data.data_buf_size = MAINBUF_SIZE * 3;
+    t->mp3_data.data_buf = static_cast<uint8_t*>(malloc(t->mp3_data.data_buf_size));
+    bool allocated = t->output.samples && t->mp3_data.data_buf;
+#else
+    bool allocated = (NULL != t->output.samples);
+#endif
+
+    if(allocated) {
+        ret = track_open(t, fp, NULL) ? ESP_OK : ESP_ERR_NOT_SUPPORTED;
+    }
+
+    while(ret == ESP_OK) {
+        DECODE_STATUS status = track_decode(t);
+        if(status == DECODE_STATUS_DONE) {
+            break;
+        } else if(status == DECODE_STATUS_ERROR) {
+            ret = ESP_FAIL;
+        } else if((status == DECODE_STATUS_CONTINUE) && (t->output.frame_count > 0)) {
+            const decode_data &d = t->output;
+            size_t samples = d.frame_count * d.fmt.channels;
+            int16_t *pcm = reinterpret_cast<int16_t*>(d.samples);
+
+            // 32 bit samples carry the audio in the upper bits, narrowed in place
+            if(d.fmt.bits_per_sample == 32) {
+                const int32_t *in = reinterpret_cast<const int32_t*>(d.samples);
+                for(size_t n = 0; n < samples; n++) {
+                    pcm[n] = in[n] >> 16;
+                }
+            } else if(d.fmt.bits_per_sample != 16) {
+                ESP_LOGE(TAG, "%d bit audio not supported", (int)d.fmt.bits_per_sample);
+                ret = ESP_ERR_NOT_SUPPORTED;
+                break;
+            }
+
+            ret = pcm_fn(pcm, d.frame_count, d.fmt.channels, d.fmt.sample_rate, ctx);
+        }
+    }
+
+    // fp belongs to the caller, only the decoder state is released
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_MP3)
+    if(t->mp3_decoder) MP3FreeDecoder(t->mp3_decoder);
+    free(t->mp3_data.data_buf);
+#endif
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_FLAC)
+    flac_free(&t->flac_data);
+#endif
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_WAV)
+    wav_free(&t->wav_data);
+#endif
+    if(t->output.samples) heap_caps_free(t->output.samples);
+    free(t);
+
+    return ret;
+}
+
+/**
+ * Can only shut down the playback thread if the thread is not presently playing audio.
+ * Call audio_player_stop()
+ */
+static esp_err_t _internal_audio_player_shutdown_thread(void)
+{
+    LOGI_1("%s", __FUNCTION__);
+    audio_player_event_t event = { .type = AUDIO_PLAYER_REQUEST_SHUTDOWN_THREAD, .fp = NULL };
+    return audio_send_event(&instance, event);
+}
+
+static void cleanup_memory(audio_instance_t &i)
+{
+    for(audio_track_t &t : i.track) {
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_MP3)
+        if(t.mp3_decoder) MP3FreeDecoder(t.mp3_decoder);
+        if(t.mp3_data.data_buf) free(t.mp3_data.data_buf);
+        t.mp3_decoder = NULL;
+        t.mp3_data.data_buf = NULL;
+#endif
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_FLAC)
+        flac_free(&t.flac_data);
+#endif
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_WAV)
+        wav_free(&t.wav_data);
+#endif
+        if(t.output.samples) heap_caps_free(t.output.samples);
+        t.output.samples = NULL;
+    }
+
+    if(i.render_buf) heap_caps_free(i.render_buf);
+    i.render_buf = NULL;
+
+    if(i.next_queue) {
+        close_queued(i.next_queue);
+        vQueueDelete(i.next_queue);
+        i.next_queue = NULL;
+    }
+
+    if(i.event_queue) {
+        vQueueDelete(i.event_queue);
+        i.event_queue = NULL;
+    }
+}
+
+esp_err_t audio_player_new(audio_player_config_t config)
+{
+    BaseType_t task_val;
+
+    audio_instance_init(instance);
+
+    instance.config = config;
+
+    /* Audio control event queue */
+    instance.event_queue = xQueueCreate(4, sizeof(audio_player_event_t));
+    ESP_RETURN_ON_FALSE(NULL != instance.event_queue, -1, TAG, "xQueueCreate");
+
+    int ret = ESP_OK;
+    instance.next_queue = xQueueCreate(NEXT_QUEUE_LEN, sizeof(audio_player_queued_t));
+    ESP_GOTO_ON_FALSE(NULL != instance.next_queue, ESP_ERR_NO_MEM, cleanup,
+        TAG, "Failed create next-track queue");
+
+    // each track slot gets its own decoder so the next track can be primed
+    // without disturbing the state of the one playing
+    for(audio_track_t &t : instance.track) {
+        /** See https://github.com/ultraembedded/libhelix-mp3/blob/0a0e0673f82bc6804e5a3ddb15fb6efdcde747cd/testwrap/main.c#L74 */
+        t.output.samples_capacity = MAX_NCHAN * MAX_NGRAN * MAX_NSAMP;
+        t.output.samples_capacity_max = t.output.samples_capacity * 2;
+        t.output.samples = static_cast<uint8_t*>(heap_caps_aligned_alloc(AUDIO_PCM_ALIGN,
+                                                 t.output.samples_capacity_max, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+        LOGI_1("samples_capacity %d bytes", t.output.samples_capacity_max);
+        ESP_GOTO_ON_FALSE(NULL != t.output.samples, ESP_ERR_NO_MEM, cleanup,
+            TAG, "Failed allocate output buffer");
+
+#if defined(CONFIG_AUDIO_PLAYER_ENABLE_MP3)
+        t.mp3_data.data_buf_size = MAINBUF_SIZE * 3;
+        t.mp3_data.data_buf = static_cast<uint8_t*>(malloc(t.mp3_data.data_buf_size));
+        ESP_GOTO_ON_FALSE(NULL != t.mp3_data.data_buf, ESP_ERR_NO_MEM, cleanup,
+            TAG, "Failed allocate mp3 data buffer");
+
+        t.mp3_decoder = MP3InitDecoder();
+        ESP_GOTO_ON_FALSE(NULL != t.mp3_decoder, ESP_ERR_NO_MEM, cleanup,
+            TAG, "Failed create MP3 decoder");
+#endif
+    }
+
+    // worst case is mono 16 bit going to stereo 32 bit slots, 4x the decoded size
+    instance.render_capacity = instance.track[0].output.samples_capacity_max * 2;
+    instance.render_buf = static_cast<uint8_t*>(heap_caps_aligned_alloc(AUDIO_PCM_ALIGN,
+                                                instance.render_capacity, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+    ESP_GOTO_ON_FALSE(NULL != instance.render_buf, ESP_ERR_NO_MEM, cleanup,
+        TAG, "Failed allocate render buffer");
+
+    instance.running = true;
+    task_val = xTaskCreatePinnedToCore(
+        (TaskFunction_t)        audio_task,
+                                "Audio Task",
+                                4 * 1024,
+                                &instance,
+        (UBaseType_t)           instance.config.priority,
+        (TaskHandle_t * const)  NULL,
+        (BaseType_t)            instance.config.coreID);
+
+    ESP_GOTO_ON_FALSE(pdPASS == task_val, ESP_ERR_NO_MEM, cleanup,
+        TAG, "Failed create audio task");
+
+    // start muted
+    instance.config.mute_fn(AUDIO_PLAYER_MUTE);
+
+    return ret;
+
+// At the moment when we run cppcheck there is a lack of esp-idf header files this
+// means cppcheck doesn't know that ESP_GOTO_ON_FALSE() etc are making use of this label
+// cppcheck-suppress unusedLabelConfiguration
+cleanup:
+    cleanup_memory(instance);
+
+    return ret;
+}
+
+esp_err_t audio_player_delete() {
+    const int MAX_RETRIES = 5;
+    int retries = MAX_RETRIES;
+    while(instance.running && retries) {
+        // stop any playback and shutdown the thread
+        audio_player_stop();
+        _internal_audio_player_shutdown_thread();
+
+        vTaskDelay(pdMS_TO_TICKS(100));
+        retries--;
+    }
+
+    cleanup_memory(instance);
+
+    // if we ran out of retries, return fail code
+    if(retries == 0) {
+        return ESP_FAIL;
+    }
+
+    return ESP_OK;
+}
@@ -0,0 +1,248 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "audio_wav.h"
+#include "audio_adpcm.h"
+#include "audio_prof.h"
+
+static const char *TAG = "wav";
+
+/** check the IMA ADPCM parameters and (re)allocate the block buffers */
+static bool adpcm_open(FILE *fp, wav_instance *pInstance) {
+    wav_header_t *wav_head = &pInstance->header;
+
+    // cbSize and wSamplesPerBlock follow the 16 bytes read with the header
+    uint16_t ext[2];
+    if((wav_head->Subchunk1Size < 20) || (fread(ext, 1, sizeof(ext), fp) != sizeof(ext))) {
+        return false;
+    }
+
+    size_t spb = audio_adpcm_samples_per_block(wav_head->BlockAlign, wav_head->NumChannels);
+    if((spb == 0) || (ext[1] != spb) || (spb > UINT16_MAX)) {
+        LOGI_1("unsupported ima adpcm block, align %d, %d samples", wav_head->BlockAlign, ext[1]);
+        return false;
+    }
+
+    size_t align = wav_head->BlockAlign;
+    if(align > pInstance->adpcm_capacity) {
+        uint8_t *block = static_cast<uint8_t *>(realloc(pInstance->adpcm_block, align));
+        if(block) {
+            pInstance->adpcm_block = block;
+        }
+        int16_t *pcm = static_cast<int16_t *>(realloc(pInstance->adpcm_pcm, spb * AUDIO_ADPCM_MAX_CHANNELS * sizeof(int16_t)));
+        if(pcm) {
+            pInstance->adpcm_pcm = pcm;
+        }
+        if(!block || !pcm) {
+            return false;
+        }
+        pInstance->adpcm_capacity = align;
+    }
+
+    pInstance->adpcm_spb = spb;
+    return true;
+}
+
+/**
+ * @param fp
+ * @param pInstance - Values can be considered valid if true is returned
+ * @return true if file is a wav file
+ */
+bool is_wav(FILE *fp, wav_instance *pInstance) {
+    fseek(fp, 0, SEEK_SET);
+
+    size_t bytes_read = fread(&pInstance->header, 1, sizeof(wav_header_t), fp);
+    if(bytes_read != sizeof(wav_header_t)) {
+        return false;
+    }
+
+    wav_header_t *wav_head = &pInstance->header;
+    if((NULL == strstr(reinterpret_cast<char *>(wav_head->ChunkID), "RIFF")) ||
+        (NULL == strstr(reinterpret_cast<char*>(wav_head->Format), "WAVE"))
+      )
+    {
+        return false;
+    }
+
+    pInstance->adpcm_spb = 0;
+    pInstance->adpcm_frames = 0;
+    pInstance->adpcm_pos = 0;
+    if((wav_head->AudioFormat == AUDIO_ADPCM_FORMAT_IMA) && !adpcm_open(fp, pInstance)) {
+        return false;
+    }
+
+    // the 'fmt ' chunk can be longer than the 16 bytes of PCM, e.g. 20 for IMA ADPCM
+    if(fseek(fp, 20 + wav_head->Subchunk1Size + (wav_head->Subchunk1Size & 1), SEEK_SET) != 0) {
+        return false;
+    }
+
+    // decode chunks until we find the 'data' one
+    wav_subchunk_header_t subchunk;
+    while(true) {
+        bytes_read = fread(&subchunk, 1, sizeof(wav_subchunk_header_t), fp);
+        if(bytes_read != sizeof(wav_subchunk_header_t)) {
+            return false;
+        }
+
+        if(memcmp(subchunk.SubchunkID, "data", 4) == 0)
+        {
+            // a size of 0 is written by recorders that were not stopped cleanly, play until EOF
+            pInstance->data_remaining = (subchunk.SubchunkSize > 0) ? subchunk.SubchunkSize : UINT32_MAX;
+            pInstance->data_size = pInstance->data_remaining;
+            pInstance->data_start = ftell(fp);
+            pInstance->data_offset = 0;
+            break;
+        } else {
+            // advance beyond this subchunk, it could be a 'LIST' chunk with file info or some other unhandled subchunk
+            fseek(fp, subchunk.SubchunkSize, SEEK_CUR);
+        }
+    }
+
+    LOGI_2("sample_rate=%d, channels=%d, bps=%d",
+            wav_head->SampleRate,
+            wav_head->NumChannels,
+            wav_head->BitsPerSample);
+
+    return true;
+}
+
+/** output the next part of the decoded IMA ADPCM block, decoding a new block when it has been used up */
+static DECODE_STATUS decode_adpcm(FILE *fp, decode_data *pData, wav_instance *pInstance) {
+    uint32_t channels = pInstance->header.NumChannels;
+
+    if(pInstance->adpcm_pos >= pInstance->adpcm_frames) {
+        size_t len = pInstance->header.BlockAlign;
+        if(len > pInstance->data_remaining) {
+            len = pInstance->data_remaining;
+        }
+
+        uint32_t t = audio_prof_start();
+        size_t bytes_read = fread(pInstance->adpcm_block, 1, len, fp);
+        audio_prof_stop(AUDIO_PROF_READ, t);
+        audio_prof_count(AUDIO_PROF_BYTES_READ, bytes_read);
+        pInstance->data_remaining -= bytes_read;
+        pInstance->data_offset += bytes_read;
+
+        // a short last block holds fewer sample groups
+        pInstance->adpcm_frames = audio_adpcm_decode_block(pInstance->adpcm_block, bytes_read, channels, pInstance->adpcm_pcm);
+        pInstance->adpcm_pos = 0;
+        if(pInstance->adpcm_frames == 0) {
+            pData->frame_count = 0;
+            return DECODE_STATUS_DONE;
+        }
+    }
+
+    size_t frames = pData->samples_capacity / (channels * sizeof(int16_t));
+    if(frames > (size_t)(pInstance->adpcm_frames - pInstance->adpcm_pos)) {
+        frames = pInstance->adpcm_frames - pInstance->adpcm_pos;
+    }
+
+    memcpy(pData->samples, pInstance->adpcm_pcm + pInstance->adpcm_pos * channels, frames * channels * sizeof(int16_t));
+    pInstance->adpcm_pos += frames;
+
+    pData->fmt.channels = channels;
+    pData->fmt.bits_per_sample = 16;
+    pData->fmt.sample_rate = pInstance->header.SampleRate;
+    pData->frame_count = frames;
+
+    return DECODE_STATUS_CONTINUE;
+}
+
+/**
+ * @return true if data remains, false on error or end of file
+ */
+DECODE_STATUS decode_wav(FILE *fp, decode_data *pData, wav_instance *pInstance) {
+    if(pInstance->adpcm_spb) {
+        return decode_adpcm(fp, pData, pInstance);
+    }
+
+    // read an even multiple of frames that can fit into output_samples buffer, otherwise
+    // we would have to manage what happens with partial frames in the output buffer
+    size_t bytes_per_frame = (pInstance->header.BitsPerSample / BITS_PER_BYTE) * pInstance->header.NumChannels;
+    size_t frames_to_read = pData->samples_capacity / bytes_per_frame;
+    size_t bytes_to_read = frames_to_read * bytes_per_frame;
+
+    // don't play chunks that follow the 'data' chunk
+    if(bytes_to_read > pInstance->data_remaining) {
+        bytes_to_read = (pInstance->data_remaining / bytes_per_frame) * bytes_per_frame;
+    }
+
+    uint32_t t = audio_prof_start();
+    size_t bytes_read = fread(pData->samples, 1, bytes_to_read, fp);
+    audio_prof_stop(AUDIO_PROF_READ, t);
+    audio_prof_count(AUDIO_PROF_BYTES_READ, bytes_read);
+    pInstance->data_remaining -= bytes_read;
+    pInstance->data_offset += bytes_read;
+
+    pData->fmt.channels = pInstance->header.NumChannels;
+    pData->fmt.bits_per_sample = pInstance->header.BitsPerSample;
+    pData->fmt.sample_rate = pInstance->header.SampleRate;
+
+    if(bytes_read != 0)
+    {
+        pData->frame_count = (bytes_read / (pInstance->header.BitsPerSample / BITS_PER_BYTE)) / pInstance->header.NumChannels;
+    } else {
+        pData->frame_count = 0;
+    }
+
+    LOGI_2("bytes_per_frame %d, bytes_to_read %d, bytes_read %d, frame_count %d",
+            bytes_per_frame, bytes_to_read, bytes_read,
+            pData->frame_count);
+
+    return (bytes_read == 0) ? DECODE_STATUS_DONE : DECODE_STATUS_CONTINUE;
+}
+
+bool wav_seek(FILE *fp, wav_instance *pInstance, uint32_t position_ms) {
+    uint32_t block = pInstance->header.BlockAlign ? pInstance->header.BlockAlign : 1;
+    uint64_t offset = (uint64_t)position_ms * pInstance->header.ByteRate / 1000;
+    offset -= offset % block;
+    if(offset > pInstance->data_size) {
+        offset = pInstance->data_size - (pInstance->data_size % block);
+    }
+
+    if(fseek(fp, pInstance->data_start + offset, SEEK_SET) != 0) {
+        return false;
+    }
+
+    pInstance->data_offset = offset;
+    if(pInstance->data_size != UINT32_MAX) {
+        pInstance->data_remaining = pInstance->data_size - offset;
+    }
+    pInstance->adpcm_frames = 0;
+    pInstance->adpcm_pos = 0;
+
+    return true;
+}
+
+uint32_t wav_position_ms(const wav_instance *pInstance) {
+    if(pInstance->header.ByteRate <= 0) {
+        return 0;
+    }
+
+    // data_offset is past the ADPCM block being output, count its frames instead
+    if(pInstance->adpcm_spb && (pInstance->header.SampleRate > 0)) {
+        uint64_t blocks = pInstance->data_offset / pInstance->header.BlockAlign;
+        uint64_t frames = (pInstance->adpcm_frames ? (blocks - 1) * pInstance->adpcm_spb : blocks * pInstance->adpcm_spb) +
+                          pInstance->adpcm_pos;
+        return frames * 1000 / pInstance->header.SampleRate;
+    }
+
+    return (uint64_t)pInstance->data_offset * 1000 / pInstance->header.ByteRate;
+}
+
+uint32_t wav_duration_ms(const wav_instance *pInstance) {
+    if((pInstance->header.ByteRate <= 0) || (pInstance->data_size == UINT32_MAX)) {
+        return 0;
+    }
+
+    return (uint64_t)pInstance->data_size * 1000 / pInstance->header.ByteRate;
+}
+
+void wav_free(wav_instance *pInstance) {
+    free(pInstance->adpcm_block);
+    free(pInstance->adpcm_pcm);
+    pInstance->adpcm_block = NULL;
+    pInstance->adpcm_pcm = NULL;
+    pInstance->adpcm_capacity = 0;
+    pInstance->adpcm_spb = 0;
+}
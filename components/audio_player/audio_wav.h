@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdio.h>
+#include "audio_log.h"
+#include "audio_decode_types.h"
+
+typedef struct {
+    // The "RIFF" chunk descriptor
+    uint8_t ChunkID[4];
+    int32_t ChunkSize;
+    uint8_t Format[4];
+    // The "fmt" sub-chunk
+    uint8_t Subchunk1ID[4];
+    int32_t Subchunk1Size;
+    int16_t AudioFormat;
+    int16_t NumChannels;
+    int32_t SampleRate;
+    int32_t ByteRate;
+    int16_t BlockAlign;
+    int16_t BitsPerSample;
+} wav_header_t;
+
+typedef struct {
+    // The "data" sub-chunk
+    uint8_t SubchunkID[4];
+    int32_t SubchunkSize;
+} wav_subchunk_header_t;
+
+typedef struct {
+    wav_header_t header;
+
+    /** bytes of the 'data' chunk not yet read */
+    uint32_t data_remaining;
+
+    /** file offset of the 'data' chunk contents */
+    uint32_t data_start;
+
+    /** size of the 'data' chunk, UINT32_MAX if it wasn't recorded */
+    uint32_t data_size;
+
+    /** bytes of the 'data' chunk read so far */
+    uint32_t data_offset;
+
+    /** IMA ADPCM frames per block, 0 for PCM */
+    uint16_t adpcm_spb;
+
+    /** IMA ADPCM: one compressed block and its decoded 16 bit samples */
+    uint8_t *adpcm_block;
+    int16_t *adpcm_pcm;
+    size_t adpcm_capacity;      /*!< block_align the buffers were allocated for */
+
+    /** frames decoded into adpcm_pcm and the next one to output */
+    uint16_t adpcm_frames;
+    uint16_t adpcm_pos;
+} wav_instance;
+
+/**
+ * Parse the header and prepare pInstance for decoding, buffers allocated for
+ * a previous file are reused when they are large enough
+ *
+ * PCM and IMA ADPCM (format 0x0011) files are accepted, ADPCM is decoded to
+ * 16 bit samples.
+ *
+ * @return true if fp is a wav file that can be decoded, fp is then positioned
+ * at the start of the 'data' chunk
+ */
+bool is_wav(FILE *fp, wav_instance *pInstance);
+DECODE_STATUS decode_wav(FILE *fp, decode_data *pData, wav_instance *pInstance);
+
+/**
+ * Move decoding to the frame at position_ms
+ *
+ * @return false if the file can't be seeked
+ */
+bool wav_seek(FILE *fp, wav_instance *pInstance, uint32_t position_ms);
+
+/** @return position of the next frame to be output, in milliseconds */
+uint32_t wav_position_ms(const wav_instance *pInstance);
+
+/** @return length of the 'data' chunk in milliseconds, 0 if unknown */
+uint32_t wav_duration_ms(const wav_instance *pInstance);
+
+/** Free the buffers of pInstance */
+void wav_free(wav_instance *pInstance);
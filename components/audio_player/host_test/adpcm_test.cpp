@@ -0,0 +1,404 @@
+/**
+ * Host test of the IMA ADPCM codec and of IMA ADPCM WAV files in audio_wav.cpp
+ *
+ * audio_adpcm.cpp is checked bit for bit against a plain sample-at-a-time
+ * reference codec below, written after the IMA recommendation the same way
+ * as the common IMA implementations (Jansen's adpcm.c, Python's audioop), on
+ * synthetic mono and stereo signals over several block sizes, including
+ * silence, full scale square waves and a short last block. The quality of
+ * the round trip is checked with the SNR of a sine.
+ *
+ *   adpcm_test [in.wav out.ima.wav]
+ *
+ * With arguments the 16 bit PCM of in.wav is also encoded to an IMA ADPCM WAV
+ * file, which decode_bench then plays through the WAV reader.
+ *
+ * The exit status is non-zero if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include "audio_adpcm.h"
+#include "audio_wav.h"
+
+static int s_failures;
+
+#define CHECK(cond, ...) do { \
+        if(!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            s_failures++; \
+        } \
+    } while(0)
+
+/* ---- reference codec, one sample at a time ---- */
+
+static const int ref_steps[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int ref_index_adjust[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+typedef struct {
+    int valpred;
+    int index;
+} ref_state_t;
+
+static void ref_step(ref_state_t *s, int delta) {
+    int step = ref_steps[s->index];
+    int vpdiff = step >> 3;
+    if(delta & 4) vpdiff += step;
+    if(delta & 2) vpdiff += step >> 1;
+    if(delta & 1) vpdiff += step >> 2;
+
+    s->valpred += (delta & 8) ? -vpdiff : vpdiff;
+    if(s->valpred > 32767) s->valpred = 32767;
+    if(s->valpred < -32768) s->valpred = -32768;
+
+    s->index += ref_index_adjust[delta & 7];
+    if(s->index < 0) s->index = 0;
+    if(s->index > 88) s->index = 88;
+}
+
+static int ref_encode(ref_state_t *s, int val) {
+    int step = ref_steps[s->index];
+    int diff = val - s->valpred;
+    int delta = 0;
+    if(diff < 0) {
+        delta = 8;
+        diff = -diff;
+    }
+    if(diff >= step) {
+        delta |= 4;
+        diff -= step;
+    }
+    step >>= 1;
+    if(diff >= step) {
+        delta |= 2;
+        diff -= step;
+    }
+    step >>= 1;
+    if(diff >= step) {
+        delta |= 1;
+    }
+
+    ref_step(s, delta);
+    return delta;
+}
+
+/** Encode one block: header sample, then the 4 bit codes of each channel packed in groups of 8 */
+static void ref_encode_block(int *index, const int16_t *pcm, size_t frames, int channels,
+                             uint8_t *block, size_t block_align) {
+    size_t spb = (block_align - 4 * channels) * 2 / channels + 1;
+
+    for(int ch = 0; ch < channels; ch++) {
+        std::vector<int> codes;
+        ref_state_t s = { pcm[ch], index[ch] };
+        for(size_t n = 1; n < spb; n++) {
+            size_t src = (n < frames) ? n : frames - 1;
+            codes.push_back(ref_encode(&s, pcm[src * channels + ch]));
+        }
+
+        block[4 * ch] = pcm[ch] & 0xff;
+        block[4 * ch + 1] = (pcm[ch] >> 8) & 0xff;
+        block[4 * ch + 2] = index[ch];
+        block[4 * ch + 3] = 0;
+        for(size_t i = 0; i < codes.size(); i++) {
+            size_t byte = 4 * channels + (i / 8) * 4 * channels + 4 * ch + (i % 8) / 2;
+            if(i % 2 == 0) {
+                block[byte] = codes[i];
+            } else {
+                block[byte] |= codes[i] << 4;
+            }
+        }
+        index[ch] = s.index;
+    }
+}
+
+static size_t ref_decode_block(const uint8_t *block, size_t len, int channels, int16_t *pcm) {
+    size_t codes = (len - 4 * channels) / (4 * channels) * 8;
+
+    for(int ch = 0; ch < channels; ch++) {
+        ref_state_t s = { (int16_t)(block[4 * ch] | (block[4 * ch + 1] << 8)), block[4 * ch + 2] };
+        pcm[ch] = s.valpred;
+        for(size_t i = 0; i < codes; i++) {
+            size_t byte = 4 * channels + (i / 8) * 4 * channels + 4 * ch + (i % 8) / 2;
+            int delta = (i % 2 == 0) ? (block[byte] & 0x0f) : (block[byte] >> 4);
+            ref_step(&s, delta);
+            pcm[(i + 1) * channels + ch] = s.valpred;
+        }
+    }
+    return codes + 1;
+}
+
+/* ---- test signals ---- */
+
+static std::vector<int16_t> make_signal(int kind, size_t frames, int channels) {
+    std::vector<int16_t> pcm(frames * channels);
+    uint32_t seed = 12345;
+    for(size_t n = 0; n < frames; n++) {
+        for(int ch = 0; ch < channels; ch++) {
+            double v = 0;
+            switch(kind) {
+            case 0:     // silence
+                break;
+            case 1:     // full scale square, clamps the predictor at both ends
+                v = ((n / (37 + ch)) & 1) ? 32767 : -32768;
+                break;
+            case 2:     // sine, a different tone on each channel
+                v = 20000 * sin(2 * M_PI * (440.0 * (ch + 1)) * n / 44100);
+                break;
+            default:    // noise
+                seed = seed * 1664525u + 1013904223u;
+                v = (int16_t)(seed >> 16);
+                break;
+            }
+            pcm[n * channels + ch] = (int16_t)v;
+        }
+    }
+    return pcm;
+}
+
+static const char *s_kinds[] = { "silence", "square", "sine", "noise" };
+
+/** Encode and decode a signal with both codecs block by block and compare */
+static void test_codec(int kind, int channels, size_t block_align, size_t frames) {
+    std::vector<int16_t> pcm = make_signal(kind, frames, channels);
+    size_t spb = audio_adpcm_samples_per_block(block_align, channels);
+    CHECK(spb == (block_align - 4 * channels) * 2 / channels + 1, "samples per block of %zu", block_align);
+
+    std::vector<uint8_t> block(block_align), ref_block(block_align);
+    std::vector<int16_t> out(spb * channels), ref_out(spb * channels);
+    audio_adpcm_state_t state = {};
+    int ref_index[2] = {};
+    double signal = 0, noise = 0;
+
+    for(size_t pos = 0; pos < frames; pos += spb) {
+        size_t n = (frames - pos < spb) ? frames - pos : spb;
+        const int16_t *in = &pcm[pos * channels];
+
+        audio_adpcm_encode_block(&state, in, n, channels, block.data(), block_align);
+        ref_encode_block(ref_index, in, n, channels, ref_block.data(), block_align);
+        if(block != ref_block) {
+            CHECK(false, "%s %dch align %zu: block at frame %zu differs from the reference encoder",
+                  s_kinds[kind], channels, block_align, pos);
+            return;
+        }
+
+        size_t got = audio_adpcm_decode_block(block.data(), block_align, channels, out.data());
+        ref_decode_block(block.data(), block_align, channels, ref_out.data());
+        if((got != spb) || (out != ref_out)) {
+            CHECK(false, "%s %dch align %zu: decode at frame %zu differs from the reference decoder",
+                  s_kinds[kind], channels, block_align, pos);
+            return;
+        }
+
+        for(size_t i = 0; i < n * channels; i++) {
+            double d = (double)out[i] - in[i];
+            signal += (double)in[i] * in[i];
+            noise += d * d;
+        }
+    }
+
+    if(kind == 2) {
+        double snr = 10 * log10(signal / (noise > 0 ? noise : 1));
+        CHECK(snr > 20, "%dch align %zu: sine SNR %.1f dB", channels, block_align, snr);
+        printf("sine %dch align %4zu: SNR %.1f dB\n", channels, block_align, snr);
+    } else if(kind == 0) {
+        CHECK(noise == 0, "%dch align %zu: silence doesn't decode to silence", channels, block_align);
+    }
+}
+
+/** A block cut short at the end of a file decodes up to its last whole sample group */
+static void test_short_block(int channels) {
+    size_t block_align = 256 * channels;
+    std::vector<int16_t> pcm = make_signal(2, 1000, channels);
+    std::vector<uint8_t> block(block_align);
+    std::vector<int16_t> full(1000 * channels), part(1000 * channels);
+    audio_adpcm_state_t state = {};
+
+    audio_adpcm_encode_block(&state, pcm.data(), 1000, channels, block.data(), block_align);
+    size_t spb = audio_adpcm_decode_block(block.data(), block_align, channels, full.data());
+    size_t len = 4 * channels + 3 * 4 * channels + 2;
+    size_t got = audio_adpcm_decode_block(block.data(), len, channels, part.data());
+
+    CHECK(got == 1 + 3 * 8, "%dch short block: %zu frames", channels, got);
+    CHECK(memcmp(part.data(), full.data(), got * channels * sizeof(int16_t)) == 0, "%dch short block differs", channels);
+    CHECK(spb > got, "%dch short block", channels);
+    CHECK(audio_adpcm_decode_block(block.data(), 4 * channels - 1, channels, part.data()) == 0,
+          "%dch block shorter than the header", channels);
+}
+
+/* ---- IMA ADPCM WAV files ---- */
+
+static void put16(std::vector<uint8_t> &v, uint32_t x) {
+    v.push_back(x & 0xff);
+    v.push_back((x >> 8) & 0xff);
+}
+
+static void put32(std::vector<uint8_t> &v, uint32_t x) {
+    put16(v, x & 0xffff);
+    put16(v, x >> 16);
+}
+
+/** Encode pcm to an IMA ADPCM WAV image with the 20 byte fmt chunk and a fact chunk */
+static std::vector<uint8_t> encode_wav(const int16_t *pcm, size_t frames, int channels, uint32_t rate,
+                                       size_t block_align, bool cut_last_block) {
+    size_t spb = audio_adpcm_samples_per_block(block_align, channels);
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> block(block_align);
+    audio_adpcm_state_t state = {};
+
+    for(size_t pos = 0; pos < frames; pos += spb) {
+        size_t n = (frames - pos < spb) ? frames - pos : spb;
+        audio_adpcm_encode_block(&state, pcm + pos * channels, n, channels, block.data(), block_align);
+        // some writers store only the sample groups that are used in the last block
+        size_t len = block_align;
+        if(cut_last_block && (pos + n == frames)) {
+            len = 4 * channels + (n + 6) / 8 * 4 * channels;
+        }
+        data.insert(data.end(), block.begin(), block.begin() + len);
+    }
+
+    std::vector<uint8_t> wav;
+    wav.insert(wav.end(), { 'R', 'I', 'F', 'F' });
+    put32(wav, 4 + 28 + 12 + 8 + data.size());
+    wav.insert(wav.end(), { 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ' });
+    put32(wav, 20);
+    put16(wav, AUDIO_ADPCM_FORMAT_IMA);
+    put16(wav, channels);
+    put32(wav, rate);
+    put32(wav, (uint32_t)((uint64_t)rate * block_align / spb));
+    put16(wav, block_align);
+    put16(wav, 4);
+    put16(wav, 2);
+    put16(wav, spb);
+    wav.insert(wav.end(), { 'f', 'a', 'c', 't' });
+    put32(wav, 4);
+    put32(wav, frames);
+    wav.insert(wav.end(), { 'd', 'a', 't', 'a' });
+    put32(wav, data.size());
+    wav.insert(wav.end(), data.begin(), data.end());
+    return wav;
+}
+
+/** Play a file image through is_wav()/decode_wav() in small pieces, seek, and compare with a direct decode */
+static void test_wav_reader(int channels, size_t block_align, bool cut_last_block) {
+    const size_t frames = 10000;
+    std::vector<int16_t> pcm = make_signal(2, frames, channels);
+    std::vector<uint8_t> image = encode_wav(pcm.data(), frames, channels, 22050, block_align, cut_last_block);
+
+    // what a direct decode of the blocks gives, the padding of the last block included
+    size_t spb = audio_adpcm_samples_per_block(block_align, channels);
+    std::vector<int16_t> expect;
+    std::vector<int16_t> out(spb * channels);
+    for(size_t off = 60; off < image.size(); off += block_align) {
+        size_t len = image.size() - off;
+        size_t n = audio_adpcm_decode_block(&image[off], len < block_align ? len : block_align, channels, out.data());
+        expect.insert(expect.end(), out.begin(), out.begin() + n * channels);
+    }
+
+    FILE *fp = fmemopen(image.data(), image.size(), "rb");
+    wav_instance wav = {};
+    CHECK(is_wav(fp, &wav), "%dch align %zu: not recognized", channels, block_align);
+    CHECK(wav.header.AudioFormat == AUDIO_ADPCM_FORMAT_IMA && wav.adpcm_spb == spb, "%dch align %zu: format", channels, block_align);
+
+    decode_data d = {};
+    int16_t buf[300];
+    d.samples = reinterpret_cast<uint8_t *>(buf);
+    d.samples_capacity = sizeof(buf);
+
+    std::vector<int16_t> got;
+    while(decode_wav(fp, &d, &wav) == DECODE_STATUS_CONTINUE) {
+        CHECK(d.fmt.bits_per_sample == 16 && d.fmt.channels == (uint32_t)channels && d.fmt.sample_rate == 22050,
+              "%dch align %zu: output format", channels, block_align);
+        got.insert(got.end(), buf, buf + d.frame_count * channels);
+    }
+    CHECK(got == expect, "%dch align %zu%s: %zu frames read, %zu expected", channels, block_align,
+          cut_last_block ? " cut" : "", got.size() / channels, expect.size() / channels);
+
+    // seek into the second block, playback resumes at its start
+    CHECK(wav_seek(fp, &wav, (spb + spb / 2) * 1000 / 22050), "%dch seek", channels);
+    CHECK(decode_wav(fp, &d, &wav) == DECODE_STATUS_CONTINUE, "%dch decode after seek", channels);
+    CHECK(memcmp(buf, &expect[spb * channels], d.frame_count * channels * sizeof(int16_t)) == 0,
+          "%dch data after seek", channels);
+    CHECK(wav_position_ms(&wav) == (spb + d.frame_count) * 1000 / 22050, "%dch position after seek", channels);
+
+    wav_free(&wav);
+    fclose(fp);
+}
+
+/** Read the 16 bit PCM of a WAV file */
+static bool load_pcm(const char *path, std::vector<int16_t> *pcm, int *channels, uint32_t *rate) {
+    FILE *fp = fopen(path, "rb");
+    if(!fp) {
+        return false;
+    }
+
+    wav_instance wav = {};
+    bool ok = is_wav(fp, &wav) && (wav.header.AudioFormat == 1) && (wav.header.BitsPerSample == 16) &&
+              (wav.header.NumChannels >= 1) && (wav.header.NumChannels <= AUDIO_ADPCM_MAX_CHANNELS);
+    if(ok) {
+        pcm->resize(wav.data_remaining / sizeof(int16_t));
+        pcm->resize(fread(pcm->data(), sizeof(int16_t), pcm->size(), fp));
+        *channels = wav.header.NumChannels;
+        *rate = wav.header.SampleRate;
+    }
+    fclose(fp);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    const size_t aligns[] = { 36, 256, 512, 1024, 2048 };
+    for(int channels = 1; channels <= 2; channels++) {
+        for(size_t align : aligns) {
+            align *= channels;
+            for(int kind = 0; kind < 4; kind++) {
+                // 10.5 blocks, the last one is padded
+                size_t spb = audio_adpcm_samples_per_block(align, channels);
+                test_codec(kind, channels, align, spb * 10 + spb / 2);
+            }
+        }
+        test_short_block(channels);
+        test_wav_reader(channels, 512 * channels, false);
+        test_wav_reader(channels, 512 * channels, true);
+    }
+
+    CHECK(audio_adpcm_samples_per_block(2048, 2) == 2041, "stereo 2048 byte blocks");
+    CHECK(audio_adpcm_samples_per_block(1024, 1) == 2041, "mono 1024 byte blocks");
+    CHECK(audio_adpcm_samples_per_block(1022, 1) == 0, "partial sample group");
+    CHECK(audio_adpcm_samples_per_block(1024, 3) == 0, "3 channels");
+
+    if(argc == 3) {
+        std::vector<int16_t> pcm;
+        int channels;
+        uint32_t rate;
+        if(!load_pcm(argv[1], &pcm, &channels, &rate)) {
+            CHECK(false, "can't read 16 bit PCM from %s", argv[1]);
+        } else {
+            std::vector<uint8_t> image = encode_wav(pcm.data(), pcm.size() / channels, channels, rate, 1024 * channels, false);
+            FILE *fp = fopen(argv[2], "wb");
+            CHECK(fp && fwrite(image.data(), 1, image.size(), fp) == image.size(), "can't write %s", argv[2]);
+            if(fp) {
+                fclose(fp);
+            }
+        }
+    }
+
+    if(s_failures) {
+        printf("%d checks failed\n", s_failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
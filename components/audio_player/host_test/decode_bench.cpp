@@ -0,0 +1,581 @@
+/**
+ * Host benchmark of the decode layer
+ *
+ * Runs audio_mp3.cpp, audio_wav.cpp, audio_flac.cpp and libhelix on Linux the
+ * way the player task does: probe the file, decode into a decode_data buffer,
+ * render mono and 16 bit audio to stereo i2s slots with audio_pcm and hand the
+ * result to a write_fn. The write_fn here is a stub that hashes and counts the
+ * PCM instead of blocking on i2s, so the numbers are the decoder's own cost.
+ *
+ * For each file it reports decoded frames per second, the speed relative to
+ * real time, bytes read per decode call and the peak heap use, and checks the
+ * output against
+ *  - the FNV-1a hash recorded for the file name in a reference list (--ref),
+ *    so any change of the decoded PCM is caught bit-exactly
+ *  - a reference decode "<file>.ref.wav" next to the input if there is one,
+ *    e.g. from another decoder, within --tolerance 16 bit LSBs
+ *
+ * The exit status is non-zero if a file fails to decode, doesn't match its
+ * references or decodes slower than --min-realtime.
+ */
+
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <malloc.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "audio_decode_types.h"
+#include "audio_mp3.h"
+#include "audio_wav.h"
+#include "audio_flac.h"
+#include "audio_pcm.h"
+
+/** Same as audio_player_write_fn, audio_player.h isn't usable without the i2s driver */
+typedef esp_err_t (*bench_write_fn)(void *audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms);
+
+typedef struct {
+    int output_bits;            /*!< 0 keeps the decoded bits, 32 widens 16 bit audio like output_bits_per_sample */
+    int repeat;                 /*!< decodes per file, the fastest one is reported */
+    double min_realtime;        /*!< fail files decoding slower than this multiple of real time */
+    int tolerance;              /*!< allowed difference to a .ref.wav, in 16 bit LSBs */
+    const char *ref_path;       /*!< reference hashes to check against */
+    bool update_ref;            /*!< record the hashes in ref_path instead of checking them */
+    const char *wav_out;        /*!< write the rendered output of the (single) input here */
+} bench_options_t;
+
+typedef struct {
+    std::string type;
+    uint32_t sample_rate;
+    uint32_t channels;
+    uint32_t bits;              /*!< decoded bits per sample */
+    uint64_t frames;            /*!< pcm frames (samples per channel) written */
+    uint64_t calls;             /*!< decode calls that returned audio */
+    uint64_t bytes_read;
+    uint64_t read_calls;
+    double decode_s;            /*!< time spent in the decoder */
+    double render_s;            /*!< time spent converting to i2s slots */
+    size_t heap_peak;           /*!< bytes of heap in use above the level before opening the file */
+    uint64_t hash;              /*!< FNV-1a 64 of everything written */
+    bool ok;
+} bench_result_t;
+
+/* write_fn sink */
+static struct {
+    uint64_t hash;
+    uint64_t bytes;
+    uint32_t frame_bytes;       /*!< bytes of one rendered stereo frame */
+    FILE *wav;
+    const std::vector<int32_t> *ref;    /*!< reference decode, stereo, left justified 32 bit */
+    uint64_t ref_pos;
+    int32_t ref_max_diff;
+    uint64_t ref_over;          /*!< samples differing by more than the tolerance */
+    int tolerance;
+} s_sink;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t heap_in_use(void) {
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+/* FILE wrapper that counts what the decoder reads */
+typedef struct {
+    FILE *fp;
+    uint64_t bytes;
+    uint64_t calls;
+} counted_file_t;
+
+static ssize_t counted_read(void *cookie, char *buf, size_t size) {
+    counted_file_t *c = static_cast<counted_file_t *>(cookie);
+    size_t n = fread(buf, 1, size, c->fp);
+    c->bytes += n;
+    c->calls++;
+    return n;
+}
+
+static int counted_seek(void *cookie, off64_t *offset, int whence) {
+    counted_file_t *c = static_cast<counted_file_t *>(cookie);
+    if(fseeko(c->fp, *offset, whence) != 0) {
+        return -1;
+    }
+    *offset = ftello(c->fp);
+    return 0;
+}
+
+static int counted_close(void *cookie) {
+    counted_file_t *c = static_cast<counted_file_t *>(cookie);
+    return fclose(c->fp);
+}
+
+static FILE *counted_open(const char *path, counted_file_t *c) {
+    c->fp = fopen(path, "rb");
+    c->bytes = 0;
+    c->calls = 0;
+    if(!c->fp) {
+        return NULL;
+    }
+    cookie_io_functions_t io = { counted_read, NULL, counted_seek, counted_close };
+    FILE *fp = fopencookie(c, "rb", io);
+    if(!fp) {
+        fclose(c->fp);
+        return NULL;
+    }
+    // a buffer the size of the 512 byte FatFs sectors, like fopen() on the SD card
+    setvbuf(fp, NULL, _IOFBF, 512);
+    return fp;
+}
+
+static uint64_t fnv1a(uint64_t hash, const uint8_t *p, size_t len) {
+    while(len--) {
+        hash = (hash ^ *p++) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void wav_header(FILE *fp, uint32_t rate, uint32_t bits, uint32_t data_bytes) {
+    uint32_t block = 2 * bits / 8;
+    uint8_t h[44];
+    memcpy(h, "RIFF", 4);
+    uint32_t v = 36 + data_bytes;
+    memcpy(h + 4, &v, 4);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    v = 16;
+    memcpy(h + 16, &v, 4);
+    uint16_t w = 1;         // PCM
+    memcpy(h + 20, &w, 2);
+    w = 2;
+    memcpy(h + 22, &w, 2);
+    memcpy(h + 24, &rate, 4);
+    v = rate * block;
+    memcpy(h + 28, &v, 4);
+    w = block;
+    memcpy(h + 32, &w, 2);
+    w = bits;
+    memcpy(h + 34, &w, 2);
+    memcpy(h + 36, "data", 4);
+    memcpy(h + 40, &data_bytes, 4);
+    fwrite(h, 1, sizeof(h), fp);
+}
+
+/** Stub i2s write: hash the PCM, compare it to the reference decode, keep it if asked to */
+static esp_err_t bench_write(void *audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms) {
+    (void)timeout_ms;
+    const uint8_t *p = static_cast<const uint8_t *>(audio_buffer);
+    s_sink.hash = fnv1a(s_sink.hash, p, len);
+    s_sink.bytes += len;
+
+    if(s_sink.ref) {
+        bool wide = (s_sink.frame_bytes == 8);
+        size_t samples = len / (wide ? 4 : 2);
+        for(size_t n = 0; n < samples; n++, s_sink.ref_pos++) {
+            int32_t s = wide ? reinterpret_cast<const int32_t *>(p)[n]
+                             : static_cast<int32_t>(static_cast<uint32_t>(reinterpret_cast<const int16_t *>(p)[n]) << 16);
+            if(s_sink.ref_pos >= s_sink.ref->size()) {
+                s_sink.ref_over++;
+                continue;
+            }
+            int32_t diff = abs((s >> 16) - ((*s_sink.ref)[s_sink.ref_pos] >> 16));
+            if(diff > s_sink.ref_max_diff) {
+                s_sink.ref_max_diff = diff;
+            }
+            if(diff > s_sink.tolerance) {
+                s_sink.ref_over++;
+            }
+        }
+    }
+
+    if(s_sink.wav) {
+        fwrite(p, 1, len, s_sink.wav);
+    }
+
+    *bytes_written = len;
+    return ESP_OK;
+}
+
+/* One file being decoded, like audio_track_t */
+typedef struct {
+    FILE *fp;
+    std::string type;
+    decode_data output;
+    HMP3Decoder mp3_decoder;
+    mp3_instance mp3_data;
+    wav_instance wav_data;
+    flac_instance flac_data;
+} bench_track_t;
+
+static bool track_open(bench_track_t *t) {
+    // same order as the player, is_mp3() accepts anything with an ID3 tag
+    if(is_flac(t->fp, &t->flac_data)) {
+        t->type = "flac";
+        return true;
+    }
+    if(is_mp3(t->fp)) {
+        t->type = "mp3";
+        t->mp3_data.data_buf_size = MAINBUF_SIZE * 3;
+        t->mp3_data.data_buf = static_cast<uint8_t *>(malloc(t->mp3_data.data_buf_size));
+        t->mp3_decoder = MP3InitDecoder();
+        if(!t->mp3_data.data_buf || !t->mp3_decoder) {
+            return false;
+        }
+        mp3_probe(t->fp, &t->mp3_data);
+        return true;
+    }
+    if(is_wav(t->fp, &t->wav_data)) {
+        t->type = "wav";
+        return true;
+    }
+    return false;
+}
+
+static DECODE_STATUS track_decode(bench_track_t *t) {
+    if(t->type == "flac") {
+        return decode_flac(t->fp, &t->output, &t->flac_data);
+    } else if(t->type == "mp3") {
+        return decode_mp3(t->mp3_decoder, t->fp, &t->output, &t->mp3_data);
+    }
+    return decode_wav(t->fp, &t->output, &t->wav_data);
+}
+
+static void track_close(bench_track_t *t) {
+    if(t->mp3_decoder) {
+        MP3FreeDecoder(t->mp3_decoder);
+    }
+    free(t->mp3_data.data_buf);
+    flac_free(&t->flac_data);
+    wav_free(&t->wav_data);
+    free(t->output.samples);
+    fclose(t->fp);
+}
+
+/**
+ * Render to stereo i2s slots the way render_output() in audio_player.cpp does
+ *
+ * @return bytes in *pcm, 0 if the format can't be played
+ */
+static size_t render(const decode_data &d, int output_bits, uint8_t *buf, const uint8_t **pcm) {
+    uint32_t in_bits = d.fmt.bits_per_sample;
+    uint32_t out_bits = ((in_bits == 16) && (output_bits == 32)) ? 32 : in_bits;
+
+    if((d.fmt.channels == 2) && (out_bits == in_bits)) {
+        *pcm = d.samples;
+        return d.frame_count * 2 * (in_bits / BITS_PER_BYTE);
+    }
+
+    *pcm = buf;
+    if(d.fmt.channels == 1) {
+        if(in_bits == 16 && out_bits == 16) {
+            audio_pcm_mono16_to_stereo16(reinterpret_cast<int16_t *>(buf), reinterpret_cast<const int16_t *>(d.samples), d.frame_count);
+        } else if(in_bits == 16) {
+            audio_pcm_mono16_to_stereo32(reinterpret_cast<int32_t *>(buf), reinterpret_cast<const int16_t *>(d.samples), d.frame_count);
+        } else if(in_bits == 32) {
+            audio_pcm_mono32_to_stereo32(reinterpret_cast<int32_t *>(buf), reinterpret_cast<const int32_t *>(d.samples), d.frame_count);
+        } else {
+            return 0;
+        }
+    } else if(d.fmt.channels == 2) {
+        audio_pcm_s16_to_s32(reinterpret_cast<int32_t *>(buf), reinterpret_cast<const int16_t *>(d.samples), d.frame_count * 2);
+    } else {
+        return 0;
+    }
+    return d.frame_count * 2 * (out_bits / BITS_PER_BYTE);
+}
+
+/**
+ * Decode path to the end, writing through write_fn
+ */
+static bool decode_file(const char *path, const bench_options_t &opt, bench_write_fn write_fn, bench_result_t *r) {
+    size_t heap_base = heap_in_use();
+    size_t heap_peak = heap_base;
+
+    counted_file_t counted;
+    bench_track_t t = {};
+    t.fp = counted_open(path, &counted);
+    if(!t.fp) {
+        fprintf(stderr, "%s: can't open\n", path);
+        return false;
+    }
+
+    // the buffer sizes of audio_player_new()
+    t.output.samples_capacity = MAX_NCHAN * MAX_NGRAN * MAX_NSAMP;
+    t.output.samples_capacity_max = t.output.samples_capacity * 2;
+    t.output.samples = static_cast<uint8_t *>(aligned_alloc(AUDIO_PCM_ALIGN, t.output.samples_capacity_max));
+    std::vector<uint8_t> render_buf(t.output.samples_capacity_max * 2 + AUDIO_PCM_ALIGN);
+    uint8_t *render_aligned = reinterpret_cast<uint8_t *>(
+        (reinterpret_cast<uintptr_t>(render_buf.data()) + AUDIO_PCM_ALIGN - 1) & ~static_cast<uintptr_t>(AUDIO_PCM_ALIGN - 1));
+
+    double start = now_s();
+    bool ok = t.output.samples && track_open(&t);
+    r->decode_s = now_s() - start;
+    r->render_s = 0;
+    r->type = ok ? t.type : "?";
+    r->frames = 0;
+    r->calls = 0;
+    r->sample_rate = 0;
+    r->channels = 0;
+    r->bits = 0;
+
+    while(ok) {
+        start = now_s();
+        DECODE_STATUS status = track_decode(&t);
+        r->decode_s += now_s() - start;
+
+        size_t heap = heap_in_use();
+        heap_peak = (heap > heap_peak) ? heap : heap_peak;
+
+        if(status == DECODE_STATUS_DONE) {
+            break;
+        } else if(status == DECODE_STATUS_ERROR) {
+            fprintf(stderr, "%s: decode error after %llu frames\n", path, (unsigned long long)r->frames);
+            ok = false;
+            break;
+        } else if((status == DECODE_STATUS_NO_DATA_CONTINUE) || (t.output.frame_count == 0)) {
+            continue;
+        }
+
+        r->sample_rate = t.output.fmt.sample_rate;
+        r->channels = t.output.fmt.channels;
+        r->bits = t.output.fmt.bits_per_sample;
+
+        const uint8_t *pcm;
+        start = now_s();
+        size_t bytes = render(t.output, opt.output_bits, render_aligned, &pcm);
+        r->render_s += now_s() - start;
+        if(bytes == 0) {
+            fprintf(stderr, "%s: %u channel %u bit audio can't be rendered\n", path,
+                    (unsigned)t.output.fmt.channels, (unsigned)t.output.fmt.bits_per_sample);
+            ok = false;
+            break;
+        }
+
+        s_sink.frame_bytes = bytes / t.output.frame_count;
+        size_t written;
+        write_fn(const_cast<uint8_t *>(pcm), bytes, &written, UINT32_MAX);
+
+        r->frames += t.output.frame_count;
+        r->calls++;
+    }
+
+    r->bytes_read = counted.bytes;
+    r->read_calls = counted.calls;
+    track_close(&t);
+    r->heap_peak = heap_peak - heap_base;
+    return ok;
+}
+
+/**
+ * Decode a reference WAV into stereo left justified 32 bit samples
+ */
+static bool load_reference(const char *path, std::vector<int32_t> *out) {
+    bench_options_t opt = {};
+    opt.output_bits = 32;
+    bench_result_t r;
+
+    FILE *probe = fopen(path, "rb");
+    if(!probe) {
+        return false;
+    }
+    fclose(probe);
+
+    struct {
+        std::vector<int32_t> *out;
+    } static ctx;
+    ctx.out = out;
+    bench_write_fn collect = [](void *buf, size_t len, size_t *written, uint32_t) -> esp_err_t {
+        const int32_t *s = static_cast<const int32_t *>(buf);
+        ctx.out->insert(ctx.out->end(), s, s + len / 4);
+        *written = len;
+        return ESP_OK;
+    };
+    return decode_file(path, opt, collect, &r);
+}
+
+static std::map<std::string, std::pair<uint64_t, uint64_t>> read_refs(const char *path) {
+    std::map<std::string, std::pair<uint64_t, uint64_t>> refs;
+    FILE *fp = fopen(path, "r");
+    if(!fp) {
+        return refs;
+    }
+    char line[512], name[256];
+    unsigned long long frames, hash;
+    while(fgets(line, sizeof(line), fp)) {
+        if((line[0] != '#') && (sscanf(line, "%255s %llu %llx", name, &frames, &hash) == 3)) {
+            refs[name] = std::make_pair(frames, hash);
+        }
+    }
+    fclose(fp);
+    return refs;
+}
+
+static void write_refs(const char *path, const std::map<std::string, std::pair<uint64_t, uint64_t>> &refs) {
+    FILE *fp = fopen(path, "w");
+    if(!fp) {
+        fprintf(stderr, "%s: can't write\n", path);
+        return;
+    }
+    fprintf(fp, "# decode_bench reference: file name (@32 with --bits 32), pcm frames, FNV-1a 64 of the rendered output\n");
+    for(const auto &ref : refs) {
+        fprintf(fp, "%s %llu %016llx\n", ref.first.c_str(),
+                (unsigned long long)ref.second.first, (unsigned long long)ref.second.second);
+    }
+    fclose(fp);
+}
+
+static const char *base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: decode_bench [options] file...\n"
+            "  --ref FILE          check the output against the hashes in FILE\n"
+            "  --update-ref FILE   record the hashes of the output in FILE\n"
+            "  --bits 32           render 16 bit audio to 32 bit slots\n"
+            "  --repeat N          decode every file N times, report the fastest\n"
+            "  --min-realtime X    fail files decoding slower than X times real time\n"
+            "  --tolerance N       allowed difference to <file>.ref.wav in 16 bit LSBs (default 1)\n"
+            "  --wav-out FILE      write the rendered output of a single input as WAV\n");
+}
+
+int main(int argc, char **argv) {
+    bench_options_t opt = {};
+    opt.repeat = 1;
+    opt.tolerance = 1;
+    std::vector<const char *> files;
+
+    for(int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        bool has_value = (i + 1 < argc);
+        if(a == "--ref" && has_value) {
+            opt.ref_path = argv[++i];
+        } else if(a == "--update-ref" && has_value) {
+            opt.ref_path = argv[++i];
+            opt.update_ref = true;
+        } else if(a == "--bits" && has_value) {
+            opt.output_bits = atoi(argv[++i]);
+        } else if(a == "--repeat" && has_value) {
+            opt.repeat = atoi(argv[++i]);
+        } else if(a == "--min-realtime" && has_value) {
+            opt.min_realtime = atof(argv[++i]);
+        } else if(a == "--tolerance" && has_value) {
+            opt.tolerance = atoi(argv[++i]);
+        } else if(a == "--wav-out" && has_value) {
+            opt.wav_out = argv[++i];
+        } else if(a[0] == '-') {
+            usage();
+            return 2;
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if(files.empty() || (opt.repeat < 1) || (opt.wav_out && files.size() != 1)) {
+        usage();
+        return 2;
+    }
+
+    auto refs = opt.ref_path ? read_refs(opt.ref_path) : std::map<std::string, std::pair<uint64_t, uint64_t>>();
+    int failures = 0;
+
+    printf("%-32s %-4s %6s %2s %2s %9s %10s %8s %9s %6s %7s %8s  %s\n",
+           "file", "type", "rate", "ch", "b", "frames", "frames/s", "x rt", "render %", "B/call",
+           "rd/call", "heap KB", "result");
+
+    for(const char *path : files) {
+        std::string ref_wav = std::string(path) + ".ref.wav";
+        std::vector<int32_t> ref_pcm;
+        bool have_ref_wav = load_reference(ref_wav.c_str(), &ref_pcm);
+
+        bench_result_t best = {};
+        bool ok = true;
+        for(int n = 0; n < opt.repeat && ok; n++) {
+            memset(&s_sink, 0, sizeof(s_sink));
+            s_sink.hash = 0xcbf29ce484222325ULL;
+            s_sink.ref = have_ref_wav ? &ref_pcm : NULL;
+            s_sink.tolerance = opt.tolerance;
+            if(opt.wav_out && n == 0) {
+                s_sink.wav = fopen(opt.wav_out, "wb");
+                if(s_sink.wav) {
+                    wav_header(s_sink.wav, 0, 16, 0);   // rewritten below
+                }
+            }
+
+            bench_result_t r = {};
+            ok = decode_file(path, opt, bench_write, &r);
+            r.hash = s_sink.hash;
+
+            if(s_sink.wav) {
+                fseek(s_sink.wav, 0, SEEK_SET);
+                wav_header(s_sink.wav, r.sample_rate, s_sink.frame_bytes * 4, s_sink.bytes);
+                fclose(s_sink.wav);
+                s_sink.wav = NULL;
+            }
+
+            if((n == 0) || (r.decode_s < best.decode_s)) {
+                best = r;
+            }
+        }
+
+        std::string result = ok ? "ok" : "decode failed";
+        const char *name = base_name(path);
+        std::string key = std::string(name) + ((opt.output_bits == 32) ? "@32" : "");
+
+        if(ok && have_ref_wav) {
+            uint64_t missing = (ref_pcm.size() > s_sink.ref_pos) ? ref_pcm.size() - s_sink.ref_pos : 0;
+            if(s_sink.ref_over || missing) {
+                ok = false;
+                result = "differs from .ref.wav by up to " + std::to_string(s_sink.ref_max_diff) + " LSB in " +
+                         std::to_string(s_sink.ref_over + missing) + " samples";
+            } else {
+                result += ", .ref.wav within " + std::to_string(s_sink.ref_max_diff) + " LSB";
+            }
+        }
+
+        if(ok && opt.ref_path) {
+            if(opt.update_ref) {
+                refs[key] = std::make_pair(best.frames, best.hash);
+            } else if(refs.find(key) == refs.end()) {
+                ok = false;
+                result = "no reference";
+            } else if((refs[key].first != best.frames) || (refs[key].second != best.hash)) {
+                char msg[96];
+                snprintf(msg, sizeof(msg), "pcm differs from reference (%llu frames, hash %016llx)",
+                         (unsigned long long)best.frames, (unsigned long long)best.hash);
+                ok = false;
+                result = msg;
+            }
+        }
+
+        double audio_s = best.sample_rate ? static_cast<double>(best.frames) / best.sample_rate : 0;
+        double realtime = (best.decode_s > 0) ? audio_s / best.decode_s : 0;
+        if(ok && (opt.min_realtime > 0) && (realtime < opt.min_realtime)) {
+            ok = false;
+            result = "slower than " + std::to_string(opt.min_realtime) + "x real time";
+        }
+
+        printf("%-32.32s %-4s %6u %2u %2u %9llu %10.0f %8.1f %9.1f %6.0f %7.2f %8.1f  %s\n",
+               name, best.type.c_str(), (unsigned)best.sample_rate, (unsigned)best.channels, (unsigned)best.bits,
+               (unsigned long long)best.frames, (best.decode_s > 0) ? best.frames / best.decode_s : 0, realtime,
+               (best.decode_s > 0) ? 100.0 * best.render_s / best.decode_s : 0,
+               best.calls ? static_cast<double>(best.bytes_read) / best.calls : 0,
+               best.calls ? static_cast<double>(best.read_calls) / best.calls : 0,
+               best.heap_peak / 1024.0, result.c_str());
+
+        failures += !ok;
+    }
+
+    if(opt.update_ref) {
+        write_refs(opt.ref_path, refs);
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,259 @@
+/**
+ * Host test of the FLAC encoder
+ *
+ * Encodes synthetic mono and stereo signals with several block sizes and
+ * sample rates, including silence, full scale square waves, noise, identical
+ * channels and short last frames, and decodes them again with audio_flac.cpp,
+ * which checks the CRC of every frame. The decoded PCM must match the input
+ * bit for bit, and STREAMINFO must describe the stream.
+ *
+ *   flac_enc_test [in.wav out.flac]
+ *
+ * With arguments the 16 bit PCM of in.wav is also encoded to out.flac, which
+ * decode_bench then checks against the hash of in.wav, and the size and the
+ * encode speed are reported.
+ *
+ * The exit status is non-zero if any check fails.
+ */
+
+#define _GNU_SOURCE 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+
+#include "audio_flac_enc.h"
+#include "audio_flac.h"
+#include "audio_wav.h"
+
+static int s_failures;
+
+#define CHECK(cond, ...) do { \
+        if(!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            s_failures++; \
+        } \
+    } while(0)
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+enum { SILENCE, SINE, NOISE, SQUARE, SAME, RAMP, KINDS };
+static const char *s_kinds[] = { "silence", "sine", "noise", "square", "same", "ramp" };
+
+static std::vector<int16_t> make_signal(int kind, size_t frames, int channels, uint32_t rate) {
+    std::vector<int16_t> pcm(frames * channels);
+    uint32_t seed = 12345;
+    for(size_t n = 0; n < frames; n++) {
+        for(int ch = 0; ch < channels; ch++) {
+            double v = 0;
+            switch(kind) {
+            case SINE:      // correlated channels, some noise
+                seed = seed * 1664525u + 1013904223u;
+                v = 12000 * sin(2 * M_PI * 440.0 * n / rate + ch * 0.3) + 3000 * sin(2 * M_PI * 1250.0 * n / rate) +
+                    (static_cast<int32_t>(seed >> 24) - 128);
+                break;
+            case NOISE:
+                seed = seed * 1664525u + 1013904223u;
+                v = static_cast<int16_t>(seed >> 16);
+                break;
+            case SQUARE:    // full scale, the side channel needs 17 bits
+                v = ((n / (23 + ch)) & 1) ? (ch ? -32768 : 32767) : (ch ? 32767 : -32768);
+                break;
+            case SAME:      // both channels the same, the side channel is silent
+                v = 20000 * sin(2 * M_PI * 100.0 * n / rate);
+                break;
+            case RAMP:
+                v = static_cast<int16_t>(n * 7 + ch * 1000);
+                break;
+            default:
+                break;
+            }
+            pcm[n * channels + ch] = static_cast<int16_t>(fmax(-32768, fmin(32767, v)));
+        }
+    }
+    return pcm;
+}
+
+static std::vector<uint8_t> encode(const flac_enc_config_t *cfg, const int16_t *pcm, size_t frames, double *seconds) {
+    flac_enc_t enc;
+    std::vector<uint8_t> out;
+    if(!flac_enc_init(&enc, cfg)) {
+        CHECK(false, "flac_enc_init failed");
+        return out;
+    }
+
+    std::vector<uint8_t> frame(flac_enc_max_frame_bytes(&enc));
+    out.resize(FLAC_ENC_HEADER_SIZE);
+    flac_enc_header(&enc, out.data());
+
+    double start = now_s();
+    for(size_t pos = 0; pos < frames; pos += cfg->blocksize) {
+        uint32_t n = (frames - pos < cfg->blocksize) ? frames - pos : cfg->blocksize;
+        size_t len = flac_enc_frame(&enc, pcm + pos * cfg->channels, n, frame.data());
+        CHECK(len > 0 && len <= frame.size(), "frame of %zu bytes", len);
+        out.insert(out.end(), frame.begin(), frame.begin() + len);
+    }
+    if(seconds) {
+        *seconds = now_s() - start;
+    }
+
+    // the header with the sample count and frame sizes, as the recorder rewrites it when stopping
+    flac_enc_header(&enc, out.data());
+    CHECK(enc.total_samples == frames, "%llu samples counted", (unsigned long long)enc.total_samples);
+    flac_enc_free(&enc);
+    return out;
+}
+
+/** decode with audio_flac.cpp, false if the stream is rejected */
+static bool decode(std::vector<uint8_t> &stream, std::vector<int16_t> *pcm, flac_instance *flac) {
+    FILE *fp = fmemopen(stream.data(), stream.size(), "rb");
+    bool ok = is_flac(fp, flac);
+
+    decode_data d = {};
+    std::vector<int16_t> buf(8192);
+    d.samples = reinterpret_cast<uint8_t *>(buf.data());
+    d.samples_capacity = buf.size() * sizeof(int16_t);
+
+    DECODE_STATUS status = DECODE_STATUS_ERROR;
+    while(ok && (status = decode_flac(fp, &d, flac)) == DECODE_STATUS_CONTINUE) {
+        if(d.fmt.bits_per_sample != 16) {
+            ok = false;
+            break;
+        }
+        pcm->insert(pcm->end(), buf.begin(), buf.begin() + d.frame_count * d.fmt.channels);
+    }
+
+    fclose(fp);
+    return ok && (status == DECODE_STATUS_DONE);
+}
+
+static void test_roundtrip(int kind, int channels, uint32_t rate, uint16_t blocksize, uint8_t lpc_order, size_t frames) {
+    flac_enc_config_t cfg = { rate, static_cast<uint8_t>(channels), blocksize, lpc_order, 6 };
+    std::vector<int16_t> pcm = make_signal(kind, frames, channels, rate);
+    std::vector<uint8_t> stream = encode(&cfg, pcm.data(), frames, NULL);
+
+    std::vector<int16_t> out;
+    flac_instance flac = {};
+    bool ok = decode(stream, &out, &flac);
+    CHECK(ok, "%s %dch %u Hz block %u: not decoded", s_kinds[kind], channels, rate, blocksize);
+    CHECK(out == pcm, "%s %dch %u Hz block %u lpc %u: decoded %zu of %zu samples, PCM differs", s_kinds[kind],
+          channels, rate, blocksize, lpc_order, out.size(), pcm.size());
+    CHECK(flac.sample_rate == rate && flac.channels == channels && flac.bits_per_sample == 16 &&
+          flac.total_samples == frames && flac.min_blocksize == blocksize && flac.max_blocksize == blocksize,
+          "%s %dch %u Hz block %u: STREAMINFO", s_kinds[kind], channels, rate, blocksize);
+    flac_free(&flac);
+
+    if(kind == SILENCE) {
+        // constant subframes, a few bytes per frame
+        size_t frame_count = (frames + blocksize - 1) / blocksize;
+        CHECK(stream.size() < FLAC_ENC_HEADER_SIZE + frame_count * (16 + 3 * channels + 2),
+              "%dch silence is %zu bytes", channels, stream.size());
+    }
+}
+
+static void test_config(void) {
+    flac_enc_t enc;
+    flac_enc_config_t cfg = { 48000, 2, 4096, 8, 6 };
+    CHECK(flac_enc_init(&enc, &cfg), "valid config");
+    std::vector<int16_t> pcm(2 * 4097);
+    std::vector<uint8_t> out(flac_enc_max_frame_bytes(&enc));
+    CHECK(flac_enc_frame(&enc, pcm.data(), 0, out.data()) == 0, "empty frame");
+    CHECK(flac_enc_frame(&enc, pcm.data(), 4097, out.data()) == 0, "frame larger than the block size");
+    flac_enc_free(&enc);
+
+    flac_enc_config_t bad[] = {
+        { 48000, 3, 4096, 8, 6 },
+        { 48000, 2, 8, 8, 6 },
+        { 48000, 2, 8192, 8, 6 },
+        { 48000, 2, 4096, 13, 6 },
+        { 48000, 2, 4096, 8, 9 },
+        { 0, 2, 4096, 8, 6 },
+    };
+    for(const flac_enc_config_t &c : bad) {
+        CHECK(!flac_enc_init(&enc, &c), "invalid config accepted");
+    }
+}
+
+/** Read the 16 bit PCM of a WAV file */
+static bool load_pcm(const char *path, std::vector<int16_t> *pcm, int *channels, uint32_t *rate) {
+    FILE *fp = fopen(path, "rb");
+    if(!fp) {
+        return false;
+    }
+
+    wav_instance wav = {};
+    bool ok = is_wav(fp, &wav) && (wav.header.AudioFormat == 1) && (wav.header.BitsPerSample == 16) &&
+              (wav.header.NumChannels >= 1) && (wav.header.NumChannels <= FLAC_ENC_MAX_CHANNELS);
+    if(ok) {
+        pcm->resize(wav.data_remaining / sizeof(int16_t));
+        pcm->resize(fread(pcm->data(), sizeof(int16_t), pcm->size(), fp));
+        *channels = wav.header.NumChannels;
+        *rate = wav.header.SampleRate;
+    }
+    wav_free(&wav);
+    fclose(fp);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    test_config();
+
+    for(int channels = 1; channels <= 2; channels++) {
+        for(int kind = 0; kind < KINDS; kind++) {
+            test_roundtrip(kind, channels, 48000, 4096, 8, 4096 * 5 + 1000);
+            test_roundtrip(kind, channels, 44100, 1152, 12, 1152 * 3 + 7);
+            test_roundtrip(kind, channels, 11025, 1000, 0, 3000);
+        }
+        // uncommon rates and block sizes are coded in the frame header
+        test_roundtrip(SINE, channels, 22000, 100, 8, 1001);
+        test_roundtrip(SINE, channels, 8000, 192, 4, 1000);
+        test_roundtrip(SINE, channels, 96000, 4608, 8, 4608 * 2);
+        test_roundtrip(SINE, channels, 100010, 256, 8, 1000);
+        // a stream shorter than one block, and shorter than the fixed predictors
+        test_roundtrip(NOISE, channels, 48000, 4096, 8, 5);
+        test_roundtrip(SINE, channels, 48000, 4096, 8, 1);
+    }
+
+    // frame numbers past one byte of the coded number
+    test_roundtrip(SINE, 1, 8000, 16, 4, 16 * 3000);
+
+    if(argc == 3) {
+        std::vector<int16_t> pcm;
+        int channels;
+        uint32_t rate;
+        if(!load_pcm(argv[1], &pcm, &channels, &rate)) {
+            CHECK(false, "can't read 16 bit PCM from %s", argv[1]);
+        } else {
+            flac_enc_config_t cfg = { rate, static_cast<uint8_t>(channels), 4096, 8, 6 };
+            size_t frames = pcm.size() / channels;
+            double seconds;
+            std::vector<uint8_t> stream = encode(&cfg, pcm.data(), frames, &seconds);
+
+            FILE *fp = fopen(argv[2], "wb");
+            CHECK(fp && fwrite(stream.data(), 1, stream.size(), fp) == stream.size(), "can't write %s", argv[2]);
+            if(fp) {
+                fclose(fp);
+            }
+
+            double ratio = static_cast<double>(stream.size()) / (pcm.size() * sizeof(int16_t));
+            printf("%s: %zu -> %zu bytes (%.1f%%), encoded at %.0fx real time\n", argv[1],
+                   pcm.size() * sizeof(int16_t), stream.size(), ratio * 100, frames / seconds / rate);
+            CHECK(ratio < 0.75, "compressed to %.1f%%", ratio * 100);
+        }
+    }
+
+    if(s_failures) {
+        printf("%d checks failed\n", s_failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,189 @@
+/**
+ * Host test of the sample format conversion kernels in audio_pcm.cpp
+ *
+ * The kernels are compared with the scalar references bit for bit through
+ * audio_pcm_selftest(), the same check the target runs, and then more widely:
+ *  - 16 bit: every one of the 65536 sample values through s16_to_s32 and the
+ *    mono -> stereo kernels
+ *  - 24 bit: the word unpacking path of s24_to_s32 against the byte-wise
+ *    reference for every byte alignment and length 0..67, and fixed values
+ *    at both ends of the range
+ *  - 32 bit: mono -> stereo duplication of random words
+ *  - float: the reference against an emulation of the TRUNC.S instruction
+ *    the target kernel uses (scale by 2^31, truncate toward zero, saturate),
+ *    over random values in [-1.25, 1.25) and the values around +-1.0
+ *
+ * The PIE SIMD paths only exist on the ESP32-S3, the host build runs the
+ * portable code with the same buffers so any difference in the references or
+ * in the unaligned fallbacks is caught here.
+ *
+ * The exit status is non-zero if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include "audio_pcm.h"
+
+static int s_failures;
+
+#define CHECK(cond, ...) do { \
+        if(!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            s_failures++; \
+        } \
+    } while(0)
+
+static uint32_t s_seed = 12345;
+
+static uint32_t next_random() {
+    s_seed = s_seed * 1664525 + 1013904223;
+    return s_seed;
+}
+
+/** what TRUNC.S with a scale of 31 computes on the target */
+static int32_t trunc_s_31(float x) {
+    double v = static_cast<double>(x) * 2147483648.0;
+    if(v >= 2147483647.0) {
+        return INT32_MAX;
+    }
+    if(v <= -2147483648.0) {
+        return INT32_MIN;
+    }
+    return static_cast<int32_t>(trunc(v));
+}
+
+static void test_16bit() {
+    std::vector<int16_t> in(65536);
+    for(size_t n = 0; n < in.size(); n++) {
+        in[n] = static_cast<int16_t>(n);
+    }
+
+    std::vector<int32_t> out(2 * in.size());
+    audio_pcm_s16_to_s32(out.data(), in.data(), in.size());
+    for(size_t n = 0; n < in.size(); n++) {
+        CHECK(out[n] == static_cast<int32_t>(in[n]) * 65536, "s16_to_s32(%d) = %08x", in[n], static_cast<unsigned>(out[n]));
+    }
+
+    audio_pcm_mono16_to_stereo32(out.data(), in.data(), in.size());
+    for(size_t n = 0; n < in.size(); n++) {
+        CHECK(out[2 * n] == static_cast<int32_t>(in[n]) * 65536 && out[2 * n + 1] == out[2 * n],
+              "mono16_to_stereo32(%d)", in[n]);
+    }
+
+    std::vector<int16_t> out16(2 * in.size());
+    audio_pcm_mono16_to_stereo16(out16.data(), in.data(), in.size());
+    for(size_t n = 0; n < in.size(); n++) {
+        CHECK(out16[2 * n] == in[n] && out16[2 * n + 1] == in[n], "mono16_to_stereo16(%d)", in[n]);
+    }
+}
+
+static void test_24bit() {
+    // packed little endian bytes -> left aligned 32 bit
+    static const struct {
+        uint8_t b[3];
+        uint32_t out;
+    } fixed[] = {
+        { { 0x00, 0x00, 0x00 }, 0x00000000 },
+        { { 0xff, 0xff, 0x7f }, 0x7fffff00 },
+        { { 0x00, 0x00, 0x80 }, 0x80000000 },
+        { { 0xff, 0xff, 0xff }, 0xffffff00 },
+        { { 0x56, 0x34, 0x12 }, 0x12345600 },
+    };
+
+    for(const auto &f : fixed) {
+        alignas(4) uint8_t in[12];
+        int32_t out[4];
+        for(int k = 0; k < 4; k++) {
+            memcpy(in + 3 * k, f.b, 3);     // 4 samples so the word path is taken
+        }
+        audio_pcm_s24_to_s32(out, in, 4);
+        for(int k = 0; k < 4; k++) {
+            CHECK(static_cast<uint32_t>(out[k]) == f.out, "s24_to_s32(%02x %02x %02x)[%d] = %08x",
+                  f.b[0], f.b[1], f.b[2], k, static_cast<unsigned>(out[k]));
+        }
+    }
+
+    alignas(16) static uint8_t in[3 * 72 + 4];
+    for(auto &b : in) {
+        b = static_cast<uint8_t>(next_random() >> 24);
+    }
+
+    for(size_t offset = 0; offset < 4; offset++) {
+        for(size_t len = 0; len <= 67; len++) {
+            std::vector<int32_t> out(len + 1, 0x55555555), ref(len + 1, 0x55555555);
+            audio_pcm_s24_to_s32(out.data(), in + offset, len);
+            audio_pcm_s24_to_s32_ref(ref.data(), in + offset, len);
+            CHECK(out == ref, "s24_to_s32 offset %zu length %zu", offset, len);
+        }
+    }
+}
+
+static void test_32bit() {
+    std::vector<int32_t> in(1000), out(2 * in.size() + 1, 0x55555555);
+    for(auto &s : in) {
+        s = static_cast<int32_t>(next_random());
+    }
+
+    audio_pcm_mono32_to_stereo32(out.data(), in.data(), in.size());
+    for(size_t n = 0; n < in.size(); n++) {
+        CHECK(out[2 * n] == in[n] && out[2 * n + 1] == in[n], "mono32_to_stereo32 frame %zu", n);
+    }
+    CHECK(out[2 * in.size()] == 0x55555555, "mono32_to_stereo32 wrote past the end");
+}
+
+static void test_float() {
+    std::vector<float> in;
+    for(int n = 0; n < 100000; n++) {
+        in.push_back(static_cast<float>(static_cast<int32_t>(next_random())) * (1.25f / 2147483648.0f));
+    }
+
+    // the neighbours of the saturation points and of zero
+    for(float x : { 1.0f, -1.0f, 0.0f }) {
+        float up = x, down = x;
+        for(int k = 0; k < 4; k++) {
+            up = nextafterf(up, 2.0f);
+            down = nextafterf(down, -2.0f);
+            in.push_back(up);
+            in.push_back(down);
+        }
+        in.push_back(x);
+    }
+    in.push_back(0.5f);
+    in.push_back(-0.5f);
+    in.push_back(1e30f);
+    in.push_back(-1e30f);
+
+    std::vector<int32_t> out(in.size()), ref(in.size());
+    audio_pcm_f32_to_s32(out.data(), in.data(), in.size());
+    audio_pcm_f32_to_s32_ref(ref.data(), in.data(), in.size());
+
+    for(size_t n = 0; n < in.size(); n++) {
+        int32_t expect = trunc_s_31(in[n]);
+        CHECK(ref[n] == expect, "f32_to_s32_ref(%.9g) = %d, TRUNC.S gives %d", in[n], ref[n], expect);
+        CHECK(out[n] == ref[n], "f32_to_s32(%.9g) = %d, reference %d", in[n], out[n], ref[n]);
+    }
+
+    CHECK(trunc_s_31(0.5f) == 0x40000000 && trunc_s_31(-1.0f) == INT32_MIN && trunc_s_31(1.0f) == INT32_MAX,
+          "TRUNC.S emulation");
+}
+
+int main() {
+    CHECK(audio_pcm_selftest(), "audio_pcm_selftest");
+    test_16bit();
+    test_24bit();
+    test_32bit();
+    test_float();
+
+    if(s_failures) {
+        printf("%d checks failed\n", s_failures);
+        return 1;
+    }
+    printf("audio_pcm: all kernels match the references\n");
+    return 0;
+}
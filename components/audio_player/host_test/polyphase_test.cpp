@@ -0,0 +1,93 @@
+/**
+ * Host test of the libhelix mp3 polyphase synthesis filter for Xtensa
+ *
+ * real/xtensa/polyxtensa.c is plain C on top of the MADD64/SAR64 macros of
+ * assembly.h, so it builds here with the portable macros and is compared bit
+ * for bit with the C reference in polyphase.c (PolyphaseStereoRef and
+ * PolyphaseMonoRef when HELIX_XTENSA_POLYPHASE is defined):
+ *  - MP3PolyphaseSelftest(), the check the target runs, on random input at
+ *    every level from full scale down
+ *  - constant full scale, alternating sign and zero input, where the outputs
+ *    clip and the rounding constant decides every sample
+ *  - a full scale impulse at every position of vbuf, so each coefficient and
+ *    each vbuf offset of the reordered loops is exercised on its own
+ *
+ * The decoder built with this filter also has to decode the test mp3 to the
+ * recorded PCM, see decode_mp3_xtensa_polyphase in CMakeLists.txt.
+ *
+ * The exit status is non-zero if any check fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <vector>
+
+extern "C" {
+#include "coder.h"
+}
+
+static int s_failures;
+
+#define CHECK(cond, ...) do { \
+        if(!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            s_failures++; \
+        } \
+    } while(0)
+
+/** true if both filters give the same stereo and mono output for vbuf */
+static bool same_output(std::vector<int> &vbuf) {
+    short ref[2 * NBANDS], out[2 * NBANDS];
+
+    PolyphaseStereoRef(ref, vbuf.data(), polyCoef);
+    PolyphaseStereo(out, vbuf.data(), polyCoef);
+    if(memcmp(ref, out, sizeof(ref)) != 0) {
+        return false;
+    }
+
+    PolyphaseMonoRef(ref, vbuf.data(), polyCoef);
+    PolyphaseMono(out, vbuf.data(), polyCoef);
+    return memcmp(ref, out, NBANDS * sizeof(short)) == 0;
+}
+
+int main() {
+    unsigned int ref_cycles, cycles;
+    CHECK(MP3PolyphaseSelftest(&ref_cycles, &cycles), "MP3PolyphaseSelftest");
+
+    std::vector<int> vbuf(VBUF_LENGTH);
+    static const struct {
+        const char *name;
+        int even, odd;
+    } patterns[] = {
+        { "zero", 0, 0 },
+        { "INT_MAX", INT_MAX, INT_MAX },
+        { "INT_MIN", INT_MIN, INT_MIN },
+        { "alternating", INT_MAX, INT_MIN },
+        { "alternating -1", -1, 1 },
+    };
+    for(const auto &p : patterns) {
+        for(size_t n = 0; n < vbuf.size(); n++) {
+            vbuf[n] = (n & 1) ? p.odd : p.even;
+        }
+        CHECK(same_output(vbuf), "%s input", p.name);
+    }
+
+    for(int value : { INT_MAX, INT_MIN }) {
+        for(size_t n = 0; n < vbuf.size(); n++) {
+            std::fill(vbuf.begin(), vbuf.end(), 0);
+            vbuf[n] = value;
+            CHECK(same_output(vbuf), "impulse %d at vbuf[%zu]", value, n);
+        }
+    }
+
+    if(s_failures) {
+        printf("%d checks failed\n", s_failures);
+        return 1;
+    }
+    printf("polyphase: xtensa filter matches the reference\n");
+    return 0;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+
+// Only referenced by audio_prof.h (components/audio_prof), profiling is off in the host build
+static inline uint32_t esp_cpu_get_cycle_count(void) {
+    return 0;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdio.h>
+
+// Warnings and errors go to stderr, info logging is dropped so it doesn't skew the timings
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) do { (void)(tag); } while(0)
+#define ESP_LOGD(tag, fmt, ...) do { (void)(tag); } while(0)
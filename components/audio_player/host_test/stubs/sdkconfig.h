@@ -0,0 +1,7 @@
+#pragma once
+
+// Configuration of the host build, see host_test/CMakeLists.txt
+#define CONFIG_AUDIO_PLAYER_ENABLE_MP3      1
+#define CONFIG_AUDIO_PLAYER_ENABLE_WAV      1
+#define CONFIG_AUDIO_PLAYER_ENABLE_FLAC     1
+#define CONFIG_AUDIO_PLAYER_LOG_LEVEL       0
@@ -0,0 +1,76 @@
+/**
+ * @file
+ * @brief IMA ADPCM block codec (WAVE format 0x0011)
+ *
+ * Blocks are laid out as in Microsoft IMA ADPCM WAV files: a 4 byte header
+ * per channel (first sample, step index, reserved byte), then groups of 4
+ * bytes per channel holding 8 samples each, low nibble first. A block of
+ * block_align bytes holds audio_adpcm_samples_per_block() frames, the first
+ * one stored verbatim in the header.
+ *
+ * Each channel is coded independently, a whole block of a channel is run in
+ * one loop so the predictor and step index stay in registers. The step index
+ * is carried from one block to the next, the predictor restarts from the
+ * sample in the block header. 16 bit PCM is reduced to 4 bits per sample.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** WAVE format tag of IMA ADPCM */
+#define AUDIO_ADPCM_FORMAT_IMA      0x0011
+
+/** channels that can be coded */
+#define AUDIO_ADPCM_MAX_CHANNELS    2
+
+/** Encoder state carried between blocks, zero initialize before the first block */
+typedef struct {
+    uint8_t index[AUDIO_ADPCM_MAX_CHANNELS];    /*!< step index of each channel */
+} audio_adpcm_state_t;
+
+/**
+ * @brief Frames held by one block
+ *
+ * @param block_align - bytes per block
+ * @param channels - 1 or 2
+ * @return frames per block, 0 if block_align doesn't hold a whole number of sample groups
+ */
+size_t audio_adpcm_samples_per_block(size_t block_align, uint32_t channels);
+
+/**
+ * @brief Encode one block
+ *
+ * @param state - encoder state, updated for the next block
+ * @param pcm - interleaved 16 bit samples
+ * @param frames - frames in pcm, 1 to audio_adpcm_samples_per_block(); a short
+ *                 last block is padded by repeating the last frame
+ * @param channels - 1 or 2
+ * @param block - block_align bytes of output
+ * @param block_align - bytes per block
+ */
+void audio_adpcm_encode_block(audio_adpcm_state_t *state, const int16_t *pcm, size_t frames,
+                              uint32_t channels, uint8_t *block, size_t block_align);
+
+/**
+ * @brief Decode one block
+ *
+ * A block shorter than block_align, as found at the end of some files, is
+ * decoded up to its last whole sample group.
+ *
+ * @param block - compressed block
+ * @param len - bytes in block
+ * @param channels - 1 or 2
+ * @param pcm - interleaved 16 bit output, room for audio_adpcm_samples_per_block(len, channels) frames
+ * @return frames decoded, 0 if len is shorter than the block header
+ */
+size_t audio_adpcm_decode_block(const uint8_t *block, size_t len, uint32_t channels, int16_t *pcm);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,108 @@
+/**
+ * @file
+ * @brief Streaming FLAC encoder for 16 bit PCM
+ *
+ * Encodes one block of interleaved 16 bit samples per call into a complete
+ * FLAC frame, so frames can be produced as audio is captured and written out
+ * as they come. Each channel is coded as a constant, fixed predictor (order 0
+ * to 4) or LPC subframe, whichever is smallest, with partitioned Rice coding
+ * of the residual. Stereo is coded as left/right, left/side, right/side or
+ * mid/side, chosen per frame from an estimate of the fixed predictor cost.
+ *
+ * The streams are in the FLAC subset, so any decoder plays them.
+ *
+ * The MD5 signature in STREAMINFO is intentionally left unset (all zero).
+ * The format defines zero as "not computed", so decoders skip the check
+ * (flac -t reports it as unset rather than as a mismatch). Each frame still
+ * carries its CRC-8 header and CRC-16 footer, which catch corruption. An MD5
+ * over the whole recording would only be known at stop, and hashing every
+ * block on the capture core was not worth it for recordings.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** channels that can be encoded */
+#define FLAC_ENC_MAX_CHANNELS       2
+
+/** largest block size, the subset limit for rates up to 48kHz */
+#define FLAC_ENC_MAX_BLOCKSIZE      4608
+
+/** largest LPC order, the subset limit for rates up to 48kHz */
+#define FLAC_ENC_MAX_LPC_ORDER      12
+
+/** largest Rice partition order */
+#define FLAC_ENC_MAX_PARTITION      8
+
+/** size of the stream header written by flac_enc_header(), "fLaC" and the STREAMINFO block */
+#define FLAC_ENC_HEADER_SIZE        42
+
+typedef struct {
+    uint32_t sample_rate;       /*!< 1Hz to 655350Hz */
+    uint8_t channels;           /*!< 1 or 2 */
+    uint16_t blocksize;         /*!< samples per channel in a frame, 16 to FLAC_ENC_MAX_BLOCKSIZE; 4096 is usual */
+    uint8_t lpc_order;          /*!< highest LPC order tried, 0 to use the fixed predictors only; 8 is usual */
+    uint8_t partition_order;    /*!< highest Rice partition order tried, up to FLAC_ENC_MAX_PARTITION */
+} flac_enc_config_t;
+
+typedef struct {
+    flac_enc_config_t cfg;
+
+    /** deinterleaved input, channel 0 and 1, and the side channel */
+    int32_t *chan[3];
+
+    /** Tukey window for the LPC analysis and the windowed signal */
+    float *window;
+    float *windowed;
+
+    /** frames encoded and the range of their sizes, for STREAMINFO */
+    uint32_t frame_number;
+    uint64_t total_samples;
+    uint32_t min_framesize;
+    uint32_t max_framesize;
+} flac_enc_t;
+
+/**
+ * @brief Check the configuration and allocate the work buffers
+ *
+ * @return false if cfg is out of range or memory is short
+ */
+bool flac_enc_init(flac_enc_t *enc, const flac_enc_config_t *cfg);
+
+/** @return the largest frame flac_enc_frame() can produce, the size of its output buffer */
+size_t flac_enc_max_frame_bytes(const flac_enc_t *enc);
+
+/**
+ * @brief Encode one frame
+ *
+ * @param pcm - interleaved 16 bit samples
+ * @param frames - samples per channel, cfg.blocksize except for the last frame of the stream
+ * @param out - flac_enc_max_frame_bytes() of output
+ * @return bytes in out, 0 if frames is out of range
+ */
+size_t flac_enc_frame(flac_enc_t *enc, const int16_t *pcm, uint32_t frames, uint8_t *out);
+
+/**
+ * @brief Write the stream header
+ *
+ * Written before the first frame with the sample count and frame sizes
+ * unknown, and written again over it at the end of the stream with the
+ * values of the frames encoded since flac_enc_init().
+ *
+ * @param out - FLAC_ENC_HEADER_SIZE bytes
+ */
+void flac_enc_header(const flac_enc_t *enc, uint8_t *out);
+
+/** Free the work buffers */
+void flac_enc_free(flac_enc_t *enc);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,108 @@
+/**
+ * @file
+ * @brief PCM sample format conversion kernels
+ *
+ * On the ESP32-S3 the kernels use the PIE 128 bit SIMD instructions when both
+ * buffers are 16 byte aligned, 8 input samples per iteration, and fall back to
+ * the scalar reference for unaligned buffers and the remaining samples.
+ * The *_ref functions are the plain C reference implementations, the SIMD
+ * versions must produce bit-identical output, see audio_pcm_selftest() and
+ * host_test/pcm_test.cpp.
+ *
+ * 32 bit output samples are left aligned (sample << 16), which is how a 16 bit
+ * sample is placed in a 32 bit i2s slot.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Buffers aligned to this are converted with SIMD instructions */
+#define AUDIO_PCM_ALIGN 16
+
+/**
+ * @brief Duplicate each mono 16 bit sample into a stereo frame
+ *
+ * @param out - 2 * frames samples, must not overlap in
+ * @param in - frames samples
+ * @param frames - number of frames
+ */
+void audio_pcm_mono16_to_stereo16(int16_t *out, const int16_t *in, size_t frames);
+
+/**
+ * @brief Duplicate each mono 16 bit sample into a stereo frame of 32 bit samples
+ *
+ * @param out - 2 * frames samples, must not overlap in
+ * @param in - frames samples
+ * @param frames - number of frames
+ */
+void audio_pcm_mono16_to_stereo32(int32_t *out, const int16_t *in, size_t frames);
+
+/**
+ * @brief Expand 16 bit samples to left aligned 32 bit samples
+ *
+ * @param out - samples, must not overlap in
+ * @param in - samples
+ * @param samples - number of samples
+ */
+void audio_pcm_s16_to_s32(int32_t *out, const int16_t *in, size_t samples);
+
+/**
+ * @brief Duplicate each mono 32 bit sample into a stereo frame
+ *
+ * @param out - 2 * frames samples, must not overlap in
+ * @param in - frames samples
+ * @param frames - number of frames
+ */
+void audio_pcm_mono32_to_stereo32(int32_t *out, const int32_t *in, size_t frames);
+
+/**
+ * @brief Expand packed little endian 24 bit samples to left aligned 32 bit samples
+ *
+ * There is no byte shuffle in PIE, so when in is 4 byte aligned the kernel
+ * unpacks 4 samples from 3 word loads with shifts instead of 12 byte loads.
+ *
+ * @param out - samples, must not overlap in
+ * @param in - 3 * samples bytes
+ * @param samples - number of samples
+ */
+void audio_pcm_s24_to_s32(int32_t *out, const uint8_t *in, size_t samples);
+
+/**
+ * @brief Convert float samples in [-1.0, 1.0) to 32 bit samples
+ *
+ * Values outside the range saturate. On targets with an FPU each sample is a
+ * single scaled TRUNC.S, which saturates in hardware. NaN input is undefined.
+ *
+ * @param out - samples, must not overlap in
+ * @param in - samples, 4 byte aligned
+ * @param samples - number of samples
+ */
+void audio_pcm_f32_to_s32(int32_t *out, const float *in, size_t samples);
+
+/* Scalar reference implementations, same arguments as above */
+void audio_pcm_mono16_to_stereo16_ref(int16_t *out, const int16_t *in, size_t frames);
+void audio_pcm_mono16_to_stereo32_ref(int32_t *out, const int16_t *in, size_t frames);
+void audio_pcm_s16_to_s32_ref(int32_t *out, const int16_t *in, size_t samples);
+void audio_pcm_mono32_to_stereo32_ref(int32_t *out, const int32_t *in, size_t frames);
+void audio_pcm_s24_to_s32_ref(int32_t *out, const uint8_t *in, size_t samples);
+void audio_pcm_f32_to_s32_ref(int32_t *out, const float *in, size_t samples);
+
+/**
+ * @brief Check that the optimized kernels are bit-exact with the references
+ *
+ * Converts pseudo random data of several lengths, aligned and unaligned.
+ *
+ * @return true if all outputs match
+ */
+bool audio_pcm_selftest(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,371 @@
+/**
+ * @file
+ * @version 0.1
+ *
+ * @copyright Copyright 2021 Espressif Systems (Shanghai) Co. Ltd.
+ * @copyright Copyright 2022 Chris Morgan <chmorgan@gmail.com>
+ *
+ *      Licensed under the Apache License, Version 2.0 (the "License");
+ *      you may not use this file except in compliance with the License.
+ *      You may obtain a copy of the License at
+ *
+ *               http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *      Unless required by applicable law or agreed to in writing, software
+ *      distributed under the License is distributed on an "AS IS" BASIS,
+ *      WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *      See the License for the specific language governing permissions and
+ *      limitations under the License.
+ */
+
+/**
+ * Design notes
+ *
+ * - There is a distinct event for playing -> playing state transitions.
+ * COMPLETED_PLAYING_NEXT is helpful for users of the audio player to know
+ * the difference between playing and transitioning to another audio file
+ * vs. detecting that the audio file transitioned by looking at
+ * events indicating IDLE and then PLAYING within a short period of time.
+ *
+ * State machine diagram
+ *
+ * cb is the callback function registered with audio_player_callback_register()
+ *
+ *             cb(PLAYING)                     cb(PLAYING)
+ *   _______________________________     ____________________________________
+ *   |                             |     |                                  |
+ *   |                             |     |                                  |
+ *   |         cb(IDLE)            V     V             cb(PAUSE)            |
+ * Idle <------------------------  Playing  ----------------------------> Pause
+ *   ^                             |_____^                                  |
+ *   |                      cb(COMPLETED_PLAYING_NEXT)                      |
+ *   |                                                                      |
+ *   |______________________________________________________________________|
+ *                                cb(IDLE)
+ *
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "driver/i2s_std.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    AUDIO_PLAYER_STATE_IDLE,
+    AUDIO_PLAYER_STATE_PLAYING,
+    AUDIO_PLAYER_STATE_PAUSE,
+    AUDIO_PLAYER_STATE_SHUTDOWN
+} audio_player_state_t;
+
+/**
+ * @brief Get the audio player state
+ *
+ * @return the present audio_player_state_t
+ */
+audio_player_state_t audio_player_get_state();
+
+typedef enum {
+    AUDIO_PLAYER_CALLBACK_EVENT_IDLE, /**< Player is idle, not playing audio */
+    AUDIO_PLAYER_CALLBACK_EVENT_COMPLETED_PLAYING_NEXT, /**< Player is playing and playing a new audio file */
+    AUDIO_PLAYER_CALLBACK_EVENT_PLAYING, /**< Player is playing */
+    AUDIO_PLAYER_CALLBACK_EVENT_PAUSE, /**< Player is pausing */
+    AUDIO_PLAYER_CALLBACK_EVENT_SHUTDOWN, /**< Player is shutting down */
+    AUDIO_PLAYER_CALLBACK_EVENT_UNKNOWN_FILE_TYPE, /**< File type is unknown */
+    AUDIO_PLAYER_CALLBACK_EVENT_UNKNOWN /**< Unknown event */
+} audio_player_callback_event_t;
+
+typedef struct {
+    audio_player_callback_event_t audio_event;
+    void *user_ctx;
+} audio_player_cb_ctx_t;
+
+/** Audio callback function type */
+typedef void (*audio_player_cb_t)(audio_player_cb_ctx_t *);
+
+/**
+ * @brief Play mp3 audio file.
+ *
+ * Will interrupt a present playback and start the new playback
+ * as soon as possible.
+ *
+ * @param fp - If ESP_OK is returned, will be fclose()ed by the audio system
+ *             when the playback has completed or in the event of a playback error.
+ *             If not ESP_OK returned then should be fclose()d by the caller.
+ * @return
+ *    - ESP_OK: Success in queuing play request
+ *    - Others: Fail
+ */
+esp_err_t audio_player_play(FILE *fp);
+
+/**
+ * @brief Queue an audio file to be played when the present one completes.
+ *
+ * Queued files are opened and their first frame decoded while the previous file
+ * finishes, and playback moves on to them without stopping the output or
+ * reconfiguring the i2s clock unless the format differs, so there is no gap
+ * between tracks. Encoder delay and padding recorded in the LAME tag of mp3
+ * files is trimmed.
+ *
+ * If the player is idle the file starts playing immediately.
+ * audio_player_play() and audio_player_stop() discard any queued files.
+ *
+ * @param fp - If ESP_OK is returned, will be fclose()ed by the audio system
+ *             when the playback has completed, in the event of a playback error
+ *             or when it is discarded.
+ *             If not ESP_OK returned then should be fclose()d by the caller.
+ * @return
+ *    - ESP_OK: Success in queuing the file
+ *    - ESP_ERR_INVALID_STATE: Player not started or too many files queued
+ */
+esp_err_t audio_player_queue(FILE *fp);
+
+/**
+ * @brief Play an audio file starting at a position, see audio_player_play().
+ *
+ * Used to resume long files, e.g. podcasts or audiobooks, after a reboot.
+ *
+ * @param fp - Ownership as for audio_player_play()
+ * @param index_fp - Seek index built by audio_player_mp3_index(), or NULL.
+ *                   Owned by the audio system like fp if ESP_OK is returned.
+ *                   Ignored, and closed, if it doesn't match the file.
+ * @param position_ms - Position to start at, 0 to start at the beginning
+ * @return
+ *    - ESP_OK: Success in queuing play request
+ *    - Others: Fail
+ */
+esp_err_t audio_player_play_at(FILE *fp, FILE *index_fp, uint32_t position_ms);
+
+/**
+ * @brief Queue an audio file together with its seek index, see audio_player_queue().
+ *
+ * @param index_fp - Seek index built by audio_player_mp3_index(), or NULL.
+ *                   Ownership as for fp.
+ */
+esp_err_t audio_player_queue_indexed(FILE *fp, FILE *index_fp);
+
+/**
+ * @brief Move the playback position of the present file.
+ *
+ * Also works while paused, playback stays paused. Has no effect if nothing is playing.
+ *
+ * Wav files are seeked directly. Mp3 files land on the frame holding position_ms
+ * and decode from there with the samples before it dropped. The frame is found with
+ * O(log n) reads of the seek index if the file was played with one, otherwise it is
+ * estimated from the Xing TOC or the bitrate, which is exact for CBR files but only
+ * as precise as the TOC for VBR files.
+ *
+ * @param position_ms - Position from the start of the file
+ * @return
+ *    - ESP_OK: Success in queuing seek request
+ *    - Others: Fail
+ */
+esp_err_t audio_player_seek(uint32_t position_ms);
+
+/**
+ * @brief Get the playback position of the present file.
+ *
+ * This is the position of the audio written to the write_fn, the output buffers
+ * hold audio that is still to be heard.
+ *
+ * @return position in milliseconds, 0 if nothing is playing
+ */
+uint32_t audio_player_get_position_ms(void);
+
+/**
+ * @brief Get the length of the present file.
+ *
+ * @return length in milliseconds, 0 if nothing is playing or the length is unknown
+ */
+uint32_t audio_player_get_duration_ms(void);
+
+/**
+ * @brief Build a seek index for an mp3 file.
+ *
+ * The index is taken from the Xing or VBRI TOC when the file has one, otherwise
+ * every frame header of the file is read once and every 32nd frame is recorded.
+ * It is meant to be stored next to the file, e.g. as "<file>.idx", and passed to
+ * audio_player_play_at() or audio_player_queue_indexed() each time the file is played.
+ * The index records the size of the file and is ignored if that changes.
+ *
+ * Reads the whole file for files without a TOC, call it from a task other than
+ * the audio task. Safe to call while another file is playing.
+ *
+ * @param fp - The mp3 file, position is not preserved, not closed
+ * @param index_fp - Opened for writing, e.g. "wb", not closed
+ * @return
+ *    - ESP_OK: Success
+ *    - ESP_ERR_NOT_SUPPORTED: Not an mp3 file, or mp3 support disabled
+ *    - Others: Fail
+ */
+esp_err_t audio_player_mp3_index(FILE *fp, FILE *index_fp);
+
+/**
+ * @brief Receives the audio decoded by audio_player_decode().
+ *
+ * @param pcm - frames * channels interleaved 16 bit samples, only valid during the call
+ * @param frames - number of frames in pcm
+ * @param channels - 1 or 2
+ * @param sample_rate - sample rate of the file
+ * @param ctx - as passed to audio_player_decode()
+ * @return ESP_OK to continue, anything else stops decoding and is returned by audio_player_decode()
+ */
+typedef esp_err_t (*audio_player_pcm_fn)(const int16_t *pcm, size_t frames, uint8_t channels,
+                                         uint32_t sample_rate, void *ctx);
+
+/**
+ * @brief Decode a whole file in the calling task.
+ *
+ * Meant for short clips that are kept as PCM, e.g. a cache of prompts that have
+ * to start without the cost of opening and decoding the file. Uses its own
+ * decoder, so it is safe to call while another file is playing, and works
+ * without audio_player_new(). 20 to 32 bit audio is reduced to 16 bit.
+ *
+ * @param fp - The file, position is not preserved, not closed
+ * @param pcm_fn - Called with each block of decoded audio
+ * @param ctx - Passed to pcm_fn
+ * @return
+ *    - ESP_OK: Success, the whole file was decoded
+ *    - ESP_ERR_NOT_SUPPORTED: Not a file type that can be decoded
+ *    - ESP_ERR_NO_MEM: Out of memory
+ *    - Others: Decode error, or the error returned by pcm_fn
+ */
+esp_err_t audio_player_decode(FILE *fp, audio_player_pcm_fn pcm_fn, void *ctx);
+
+/**
+ * @brief Byte source for audio that isn't a file, e.g. a network stream.
+ *
+ * Format detection reads the start of the data and then seeks back to offset 0,
+ * so seek_fn must at least support rewinding over the first few kilobytes.
+ */
+typedef struct {
+    void *ctx; /*< passed to all callbacks */
+
+    /**
+     * Read up to len bytes, may block until data is available.
+     * Return the number of bytes read, 0 at the end of the data, negative on error.
+     */
+    int (*read_fn)(void *ctx, void *buf, size_t len);
+
+    /**
+     * Move the read position, whence is SEEK_SET or SEEK_CUR (SEEK_END is
+     * converted using size_fn). Store the new absolute position in *offset.
+     * Return 0 on success, negative if the position can't be reached.
+     */
+    int (*seek_fn)(void *ctx, int64_t *offset, int whence);
+
+    /** Optional, total size in bytes or negative if unknown */
+    int64_t (*size_fn)(void *ctx);
+
+    /** Optional, called once when the audio system is done with the source */
+    void (*close_fn)(void *ctx);
+} audio_player_source_t;
+
+/**
+ * @brief Wrap an audio_player_source_t into a FILE* that can be passed to
+ * audio_player_play() or audio_player_queue().
+ *
+ * fclose() on the returned FILE* calls close_fn.
+ *
+ * @param source - Callbacks, copied, does not need to outlive the call
+ * @return FILE* or NULL if out of memory, in which case close_fn is not called
+ */
+FILE *audio_player_source_open(const audio_player_source_t *source);
+
+/**
+ * @brief Play audio from an audio_player_source_t, see audio_player_play().
+ *
+ * @param source - If ESP_OK is returned close_fn will be called by the audio system
+ *                 when the playback has completed or in the event of a playback error.
+ *                 If not ESP_OK returned then the source is untouched.
+ * @return
+ *    - ESP_OK: Success in queuing play request
+ *    - ESP_ERR_NO_MEM: Out of memory
+ *    - Others: Fail
+ */
+esp_err_t audio_player_play_source(const audio_player_source_t *source);
+
+/**
+ * @brief Pause playback
+ *
+ * @return
+ *    - ESP_OK: Success in queuing pause request
+ *    - Others: Fail
+ */
+esp_err_t audio_player_pause(void);
+
+/**
+ * @brief Resume playback
+ *
+ * Has no effect if playback is not in progress
+ * @return esp_err_t
+ *    - ESP_OK: Success in queuing resume request
+ *    - Others: Fail
+ */
+esp_err_t audio_player_resume(void);
+
+/**
+ * @brief Stop playback
+ *
+ * Has no effect if playback is already stopped
+ * @return esp_err_t
+ *    - ESP_OK: Success in queuing resume request
+ *    - Others: Fail
+ */
+esp_err_t audio_player_stop(void);
+
+/**
+ * @brief Register callback for audio event
+ *
+ * @param call_back Call back function
+ * @param user_ctx User context
+ * @return
+ *    - ESP_OK: Success
+ *    - Others: Fail
+ */
+esp_err_t audio_player_callback_register(audio_player_cb_t call_back, void *user_ctx);
+
+typedef enum {
+    AUDIO_PLAYER_MUTE,
+    AUDIO_PLAYER_UNMUTE
+} AUDIO_PLAYER_MUTE_SETTING;
+
+typedef esp_err_t (*audio_player_mute_fn)(AUDIO_PLAYER_MUTE_SETTING setting);
+typedef esp_err_t (*audio_reconfig_std_clock)(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch);
+typedef esp_err_t (*audio_player_write_fn)(void *audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms);
+
+typedef struct {
+    audio_player_mute_fn mute_fn;
+    audio_reconfig_std_clock clk_set_fn;
+    audio_player_write_fn write_fn;
+    UBaseType_t priority; /*< FreeRTOS task priority */
+    BaseType_t coreID; /*< ESP32 core ID */
+    uint32_t output_bits_per_sample; /*< 0 to write samples as decoded, 32 to expand 16 bit audio into 32 bit i2s slots */
+} audio_player_config_t;
+
+/**
+ * @brief Initialize hardware, allocate memory, create and start audio task.
+ * Call before any other 'audio' functions.
+ *
+ * @param port - The i2s port for output
+ * @return esp_err_t
+ */
+esp_err_t audio_player_new(audio_player_config_t config);
+
+/**
+ * @brief Shut down audio task, free allocated memory.
+ *
+ * @return esp_err_t ESP_OK upon success, ESP_FAIL if unable to shutdown due to retries exhausted
+ */
+esp_err_t audio_player_delete();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,720 @@
+// Copyright 2020 Espressif Systems (Shanghai) Co. Ltd.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "unity.h"
+#include "audio_player.h"
+#include "audio_pcm.h"
+#include "audio_prof.h"
+#include "mp3dec.h"
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "driver/gpio.h"
+#include "test_utils.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "AUDIO PLAYER TEST";
+
+#define CONFIG_BSP_I2S_NUM 1
+
+/* Audio */
+#define BSP_I2S_SCLK          (GPIO_NUM_17)
+#define BSP_I2S_MCLK          (GPIO_NUM_2)
+#define BSP_I2S_LCLK          (GPIO_NUM_47)
+#define BSP_I2S_DOUT          (GPIO_NUM_15) // To Codec ES8311
+#define BSP_I2S_DSIN          (GPIO_NUM_16) // From ADC ES7210
+#define BSP_POWER_AMP_IO      (GPIO_NUM_46)
+#define BSP_MUTE_STATUS       (GPIO_NUM_1)
+
+/**
+ * @brief ESP-BOX I2S pinout
+ *
+ * Can be used for i2s_std_gpio_config_t and/or i2s_std_config_t initialization
+ */
+#define BSP_I2S_GPIO_CFG       \
+    {                          \
+        .mclk = BSP_I2S_MCLK,  \
+        .bclk = BSP_I2S_SCLK,  \
+        .ws = BSP_I2S_LCLK,    \
+        .dout = BSP_I2S_DOUT,  \
+        .din = BSP_I2S_DSIN,   \
+        .invert_flags = {      \
+            .mclk_inv = false, \
+            .bclk_inv = false, \
+            .ws_inv = false,   \
+        },                     \
+    }
+
+/**
+ * @brief Mono Duplex I2S configuration structure
+ *
+ * This configuration is used by default in bsp_audio_init()
+ */
+#define BSP_I2S_DUPLEX_MONO_CFG(_sample_rate)                                                         \
+    {                                                                                                 \
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(_sample_rate),                                          \
+        .slot_cfg = I2S_STD_PHILIP_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_MONO), \
+        .gpio_cfg = BSP_I2S_GPIO_CFG,                                                                 \
+    }
+
+static i2s_chan_handle_t i2s_tx_chan;
+static i2s_chan_handle_t i2s_rx_chan;
+
+static esp_err_t bsp_i2s_write(void * audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms)
+{
+    esp_err_t ret = ESP_OK;
+    ret = i2s_channel_write(i2s_tx_chan, (char *)audio_buffer, len, bytes_written, timeout_ms);
+    return ret;
+}
+
+static esp_err_t bsp_i2s_reconfig_clk(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch)
+{
+    esp_err_t ret = ESP_OK;
+    i2s_std_config_t std_cfg = {
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(rate),
+        .slot_cfg = I2S_STD_PHILIP_SLOT_DEFAULT_CONFIG((i2s_data_bit_width_t)bits_cfg, (i2s_slot_mode_t)ch),
+        .gpio_cfg = BSP_I2S_GPIO_CFG,
+    };
+
+    ret |= i2s_channel_disable(i2s_tx_chan);
+    ret |= i2s_channel_reconfig_std_clock(i2s_tx_chan, &std_cfg.clk_cfg);
+    ret |= i2s_channel_reconfig_std_slot(i2s_tx_chan, &std_cfg.slot_cfg);
+    ret |= i2s_channel_enable(i2s_tx_chan);
+    return ret;
+}
+
+static esp_err_t audio_mute_function(AUDIO_PLAYER_MUTE_SETTING setting) {
+    ESP_LOGI(TAG, "mute setting %d", setting);
+    return ESP_OK;
+}
+
+TEST_CASE("audio player can be newed and deleted", "[audio player]")
+{
+    audio_player_config_t config = { .mute_fn = audio_mute_function,
+                                     .write_fn = bsp_i2s_write,
+                                     .clk_set_fn = bsp_i2s_reconfig_clk,
+                                     .priority = 0,
+                                     .coreID = 0 };
+    esp_err_t ret = audio_player_new(config);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+
+    ret = audio_player_delete();
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+
+    audio_player_state_t state = audio_player_get_state();
+    TEST_ASSERT_EQUAL(state, AUDIO_PLAYER_STATE_SHUTDOWN);
+}
+
+static esp_err_t bsp_audio_init(const i2s_std_config_t *i2s_config, i2s_chan_handle_t *tx_channel, i2s_chan_handle_t *rx_channel)
+{
+    /* Setup I2S peripheral */
+    i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(CONFIG_BSP_I2S_NUM, I2S_ROLE_MASTER);
+    chan_cfg.auto_clear = true; // Auto clear the legacy data in the DMA buffer
+    ESP_ERROR_CHECK(i2s_new_channel(&chan_cfg, tx_channel, rx_channel));
+
+    /* Setup I2S channels */
+    const i2s_std_config_t std_cfg_default = BSP_I2S_DUPLEX_MONO_CFG(22050);
+    const i2s_std_config_t *p_i2s_cfg = &std_cfg_default;
+    if (i2s_config != NULL) {
+        p_i2s_cfg = i2s_config;
+    }
+
+    if (tx_channel != NULL) {
+        ESP_ERROR_CHECK(i2s_channel_init_std_mode(*tx_channel, p_i2s_cfg));
+        ESP_ERROR_CHECK(i2s_channel_enable(*tx_channel));
+    }
+    if (rx_channel != NULL) {
+        ESP_ERROR_CHECK(i2s_channel_init_std_mode(*rx_channel, p_i2s_cfg));
+        ESP_ERROR_CHECK(i2s_channel_enable(*rx_channel));
+    }
+
+    /* Setup power amplifier pin */
+    const gpio_config_t io_conf = {
+        .intr_type = GPIO_INTR_DISABLE,
+        .mode = GPIO_MODE_OUTPUT,
+        .pin_bit_mask = BIT64(BSP_POWER_AMP_IO),
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .pull_up_en = GPIO_PULLDOWN_DISABLE,
+    };
+    ESP_ERROR_CHECK(gpio_config(&io_conf));
+
+    return ESP_OK;
+}
+
+static audio_player_callback_event_t expected_event;
+static QueueHandle_t event_queue;
+
+static void audio_player_callback(audio_player_cb_ctx_t *ctx)
+{
+    TEST_ASSERT_EQUAL(ctx->audio_event, expected_event);
+
+    // wake up the test so it can continue to the next step
+    TEST_ASSERT_EQUAL(xQueueSend(event_queue, &(ctx->audio_event), 0), pdPASS);
+}
+
+TEST_CASE("audio player states and callbacks are correct", "[audio player]")
+{
+    audio_player_callback_event_t event;
+
+    /* Configure I2S peripheral and Power Amplifier */
+    i2s_std_config_t std_cfg = {
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(44100),
+        .slot_cfg = I2S_STD_PHILIP_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_STEREO),
+        .gpio_cfg = BSP_I2S_GPIO_CFG,
+    };
+    esp_err_t ret = bsp_audio_init(&std_cfg, &i2s_tx_chan, &i2s_rx_chan);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+
+    audio_player_config_t config = { .mute_fn = audio_mute_function,
+                                     .write_fn = bsp_i2s_write,
+                                     .clk_set_fn = bsp_i2s_reconfig_clk,
+                                     .priority = 0,
+                                     .coreID = 0 };
+    ret = audio_player_new(config);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+
+    event_queue = xQueueCreate(1, sizeof(audio_player_callback_event_t));
+    TEST_ASSERT_NOT_NULL(event_queue);
+
+    ret = audio_player_callback_register(audio_player_callback, NULL);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+
+    audio_player_state_t state = audio_player_get_state();
+    TEST_ASSERT_EQUAL(state, AUDIO_PLAYER_STATE_IDLE);
+
+    extern const char mp3_start[] asm("_binary_gs_16b_1c_44100hz_mp3_start");
+    extern const char mp3_end[]   asm("_binary_gs_16b_1c_44100hz_mp3_end");
+
+    // -1 due to the size being 1 byte too large, I think because end is the byte
+    // immediately after the last byte in the memory but I'm not sure - cmm 2022-08-20
+    //
+    // Suppression as these are linker symbols and cppcheck doesn't know how to ensure
+    // they are the same object
+    // cppcheck-suppress comparePointers
+    size_t mp3_size = (mp3_end - mp3_start) - 1;
+    ESP_LOGI(TAG, "mp3_size %zu bytes", mp3_size);
+
+    FILE *fp = fmemopen((void*)mp3_start, mp3_size, "rb");
+    TEST_ASSERT_NOT_NULL(fp);
+
+
+
+    ///////////////
+    expected_event = AUDIO_PLAYER_CALLBACK_EVENT_PLAYING;
+    ret = audio_player_play(fp);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+
+    // wait for playing event to arrive
+    TEST_ASSERT_EQUAL(xQueueReceive(event_queue, &event, pdMS_TO_TICKS(100)), pdPASS);
+
+    // confirm state is playing
+    state = audio_player_get_state();
+    TEST_ASSERT_EQUAL(state, AUDIO_PLAYER_STATE_PLAYING);
+
+
+
+    ///////////////
+    expected_event = AUDIO_PLAYER_CALLBACK_EVENT_PAUSE;
+    ret = audio_player_pause();
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+
+    // wait for paused event to arrive
+    TEST_ASSERT_EQUAL(xQueueReceive(event_queue, &event, pdMS_TO_TICKS(100)), pdPASS);
+
+    state = audio_player_get_state();
+    TEST_ASSERT_EQUAL(state, AUDIO_PLAYER_STATE_PAUSE);
+
+
+
+    ////////////////
+    expected_event = AUDIO_PLAYER_CALLBACK_EVENT_PLAYING;
+    ret = audio_player_resume();
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+
+    // wait for paused event to arrive
+    TEST_ASSERT_EQUAL(xQueueReceive(event_queue, &event, pdMS_TO_TICKS(100)), pdPASS);
+
+
+
+    ///////////////
+    expected_event = AUDIO_PLAYER_CALLBACK_EVENT_IDLE;
+
+    // the track is 16 seconds long so lets wait a bit here
+    int sleep_seconds = 16;
+    ESP_LOGI(TAG, "sleeping for %d seconds for playback to complete", sleep_seconds);
+    vTaskDelay(pdMS_TO_TICKS(sleep_seconds * 1000));
+
+    // wait for idle event to arrive
+    TEST_ASSERT_EQUAL(xQueueReceive(event_queue, &event, pdMS_TO_TICKS(100)), pdPASS);
+
+    state = audio_player_get_state();
+    TEST_ASSERT_EQUAL(state, AUDIO_PLAYER_STATE_IDLE);
+
+
+
+    ///////////////
+    expected_event = AUDIO_PLAYER_CALLBACK_EVENT_SHUTDOWN;
+    ret = audio_player_delete();
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+
+    // wait for idle event to arrive
+    TEST_ASSERT_EQUAL(xQueueReceive(event_queue, &event, pdMS_TO_TICKS(100)), pdPASS);
+
+    state = audio_player_get_state();
+    TEST_ASSERT_EQUAL(state, AUDIO_PLAYER_STATE_SHUTDOWN);
+
+    vQueueDelete(event_queue);
+
+    TEST_ESP_OK(i2s_channel_disable(i2s_tx_chan));
+    TEST_ESP_OK(i2s_channel_disable(i2s_rx_chan));
+    TEST_ESP_OK(i2s_del_channel(i2s_tx_chan));
+    TEST_ESP_OK(i2s_del_channel(i2s_rx_chan));
+
+    ESP_LOGI(TAG, "NOTE: a memory leak will be reported the first time this test runs.\n");
+    ESP_LOGI(TAG, "esp-idf v4.4.1 and v4.4.2 both leak memory between i2s_driver_install() and i2s_driver_uninstall()\n");
+}
+
+TEST_CASE("audio player plays queued files back to back", "[audio player]")
+{
+    audio_player_callback_event_t event;
+
+    i2s_std_config_t std_cfg = {
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(44100),
+        .slot_cfg = I2S_STD_PHILIP_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_STEREO),
+        .gpio_cfg = BSP_I2S_GPIO_CFG,
+    };
+    esp_err_t ret = bsp_audio_init(&std_cfg, &i2s_tx_chan, &i2s_rx_chan);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+
+    audio_player_config_t config = { .mute_fn = audio_mute_function,
+                                     .write_fn = bsp_i2s_write,
+                                     .clk_set_fn = bsp_i2s_reconfig_clk,
+                                     .priority = 0,
+                                     .coreID = 0 };
+    ret = audio_player_new(config);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+
+    event_queue = xQueueCreate(1, sizeof(audio_player_callback_event_t));
+    TEST_ASSERT_NOT_NULL(event_queue);
+
+    ret = audio_player_callback_register(audio_player_callback, NULL);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+
+    extern const char mp3_start[] asm("_binary_gs_16b_1c_44100hz_mp3_start");
+    extern const char mp3_end[]   asm("_binary_gs_16b_1c_44100hz_mp3_end");
+    // cppcheck-suppress comparePointers
+    size_t mp3_size = (mp3_end - mp3_start) - 1;
+
+    FILE *fp = fmemopen((void*)mp3_start, mp3_size, "rb");
+    TEST_ASSERT_NOT_NULL(fp);
+    FILE *fp_next = fmemopen((void*)mp3_start, mp3_size, "rb");
+    TEST_ASSERT_NOT_NULL(fp_next);
+
+    ///////////////
+    // queueing while idle starts playback
+    expected_event = AUDIO_PLAYER_CALLBACK_EVENT_PLAYING;
+    ret = audio_player_queue(fp);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+    TEST_ASSERT_EQUAL(xQueueReceive(event_queue, &event, pdMS_TO_TICKS(100)), pdPASS);
+
+    ///////////////
+    // the second file follows the first without passing through idle
+    expected_event = AUDIO_PLAYER_CALLBACK_EVENT_COMPLETED_PLAYING_NEXT;
+    ret = audio_player_queue(fp_next);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+
+    // the track is 16 seconds long
+    TEST_ASSERT_EQUAL(xQueueReceive(event_queue, &event, pdMS_TO_TICKS(17 * 1000)), pdPASS);
+    TEST_ASSERT_EQUAL(audio_player_get_state(), AUDIO_PLAYER_STATE_PLAYING);
+
+    ///////////////
+    expected_event = AUDIO_PLAYER_CALLBACK_EVENT_IDLE;
+    TEST_ASSERT_EQUAL(xQueueReceive(event_queue, &event, pdMS_TO_TICKS(17 * 1000)), pdPASS);
+
+    ///////////////
+    expected_event = AUDIO_PLAYER_CALLBACK_EVENT_SHUTDOWN;
+    ret = audio_player_delete();
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+    TEST_ASSERT_EQUAL(xQueueReceive(event_queue, &event, pdMS_TO_TICKS(100)), pdPASS);
+
+    vQueueDelete(event_queue);
+
+    TEST_ESP_OK(i2s_channel_disable(i2s_tx_chan));
+    TEST_ESP_OK(i2s_channel_disable(i2s_rx_chan));
+    TEST_ESP_OK(i2s_del_channel(i2s_tx_chan));
+    TEST_ESP_OK(i2s_del_channel(i2s_rx_chan));
+}
+
+typedef struct {
+    const uint8_t *data;
+    int64_t size;
+    int64_t pos;
+    bool closed;
+} mem_source_t;
+
+static int mem_source_read(void *ctx, void *buf, size_t len)
+{
+    mem_source_t *src = (mem_source_t *)ctx;
+    int64_t remaining = src->size - src->pos;
+    if (len > remaining) {
+        len = remaining;
+    }
+    memcpy(buf, src->data + src->pos, len);
+    src->pos += len;
+    return len;
+}
+
+static int mem_source_seek(void *ctx, int64_t *offset, int whence)
+{
+    mem_source_t *src = (mem_source_t *)ctx;
+    int64_t pos = (whence == SEEK_CUR) ? src->pos + *offset : *offset;
+    if (pos < 0 || pos > src->size) {
+        return -1;
+    }
+    src->pos = pos;
+    *offset = pos;
+    return 0;
+}
+
+static int64_t mem_source_size(void *ctx)
+{
+    return ((mem_source_t *)ctx)->size;
+}
+
+static void mem_source_close(void *ctx)
+{
+    ((mem_source_t *)ctx)->closed = true;
+}
+
+TEST_CASE("audio player plays from a pull source", "[audio player]")
+{
+    audio_player_callback_event_t event;
+
+    i2s_std_config_t std_cfg = {
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(44100),
+        .slot_cfg = I2S_STD_PHILIP_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_STEREO),
+        .gpio_cfg = BSP_I2S_GPIO_CFG,
+    };
+    esp_err_t ret = bsp_audio_init(&std_cfg, &i2s_tx_chan, &i2s_rx_chan);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+
+    audio_player_config_t config = { .mute_fn = audio_mute_function,
+                                     .write_fn = bsp_i2s_write,
+                                     .clk_set_fn = bsp_i2s_reconfig_clk,
+                                     .priority = 0,
+                                     .coreID = 0 };
+    ret = audio_player_new(config);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+
+    event_queue = xQueueCreate(1, sizeof(audio_player_callback_event_t));
+    TEST_ASSERT_NOT_NULL(event_queue);
+
+    ret = audio_player_callback_register(audio_player_callback, NULL);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+
+    extern const char mp3_start[] asm("_binary_gs_16b_1c_44100hz_mp3_start");
+    extern const char mp3_end[]   asm("_binary_gs_16b_1c_44100hz_mp3_end");
+    // cppcheck-suppress comparePointers
+    size_t mp3_size = (mp3_end - mp3_start) - 1;
+
+    mem_source_t mem = { .data = (const uint8_t *)mp3_start, .size = mp3_size, .pos = 0, .closed = false };
+    audio_player_source_t source = { .ctx = &mem,
+                                     .read_fn = mem_source_read,
+                                     .seek_fn = mem_source_seek,
+                                     .size_fn = mem_source_size,
+                                     .close_fn = mem_source_close };
+
+    ///////////////
+    expected_event = AUDIO_PLAYER_CALLBACK_EVENT_PLAYING;
+    ret = audio_player_play_source(&source);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+    TEST_ASSERT_EQUAL(xQueueReceive(event_queue, &event, pdMS_TO_TICKS(100)), pdPASS);
+
+    // let some of the data be read through the source
+    vTaskDelay(pdMS_TO_TICKS(1000));
+    TEST_ASSERT_GREATER_THAN(0, mem.pos);
+    TEST_ASSERT_FALSE(mem.closed);
+
+    ///////////////
+    // stopping closes the source
+    expected_event = AUDIO_PLAYER_CALLBACK_EVENT_IDLE;
+    ret = audio_player_stop();
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+    TEST_ASSERT_EQUAL(xQueueReceive(event_queue, &event, pdMS_TO_TICKS(100)), pdPASS);
+    TEST_ASSERT_TRUE(mem.closed);
+
+    ///////////////
+    expected_event = AUDIO_PLAYER_CALLBACK_EVENT_SHUTDOWN;
+    ret = audio_player_delete();
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+    TEST_ASSERT_EQUAL(xQueueReceive(event_queue, &event, pdMS_TO_TICKS(100)), pdPASS);
+
+    vQueueDelete(event_queue);
+
+    TEST_ESP_OK(i2s_channel_disable(i2s_tx_chan));
+    TEST_ESP_OK(i2s_channel_disable(i2s_rx_chan));
+    TEST_ESP_OK(i2s_del_channel(i2s_tx_chan));
+    TEST_ESP_OK(i2s_del_channel(i2s_rx_chan));
+}
+
+TEST_CASE("audio player seeks within an mp3 file using an index", "[audio player]")
+{
+    audio_player_callback_event_t event;
+
+    i2s_std_config_t std_cfg = {
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(44100),
+        .slot_cfg = I2S_STD_PHILIP_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_STEREO),
+        .gpio_cfg = BSP_I2S_GPIO_CFG,
+    };
+    esp_err_t ret = bsp_audio_init(&std_cfg, &i2s_tx_chan, &i2s_rx_chan);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+
+    audio_player_config_t config = { .mute_fn = audio_mute_function,
+                                     .write_fn = bsp_i2s_write,
+                                     .clk_set_fn = bsp_i2s_reconfig_clk,
+                                     .priority = 0,
+                                     .coreID = 0 };
+    ret = audio_player_new(config);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+
+    event_queue = xQueueCreate(1, sizeof(audio_player_callback_event_t));
+    TEST_ASSERT_NOT_NULL(event_queue);
+
+    ret = audio_player_callback_register(audio_player_callback, NULL);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+
+    extern const char mp3_start[] asm("_binary_gs_16b_1c_44100hz_mp3_start");
+    extern const char mp3_end[]   asm("_binary_gs_16b_1c_44100hz_mp3_end");
+    // cppcheck-suppress comparePointers
+    size_t mp3_size = (mp3_end - mp3_start) - 1;
+
+    FILE *fp = fmemopen((void*)mp3_start, mp3_size, "rb");
+    TEST_ASSERT_NOT_NULL(fp);
+
+    // the test file is CBR, marked by an Info frame, so the index is built by scanning its frame headers
+    static char index_buf[1024];
+    FILE *index_fp = fmemopen(index_buf, sizeof(index_buf), "w+");
+    TEST_ASSERT_NOT_NULL(index_fp);
+    TEST_ASSERT_EQUAL(ESP_OK, audio_player_mp3_index(fp, index_fp));
+
+    ///////////////
+    // start part way into the file, as when resuming
+    expected_event = AUDIO_PLAYER_CALLBACK_EVENT_PLAYING;
+    ret = audio_player_play_at(fp, index_fp, 8000);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+    TEST_ASSERT_EQUAL(xQueueReceive(event_queue, &event, pdMS_TO_TICKS(100)), pdPASS);
+
+    vTaskDelay(pdMS_TO_TICKS(100));
+    TEST_ASSERT_UINT32_WITHIN(500, 8200, audio_player_get_position_ms());
+
+    // the track is 16 seconds long
+    TEST_ASSERT_UINT32_WITHIN(200, 15900, audio_player_get_duration_ms());
+
+    ///////////////
+    // seeking back moves the position without a state change
+    ret = audio_player_seek(2000);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+    vTaskDelay(pdMS_TO_TICKS(100));
+    TEST_ASSERT_UINT32_WITHIN(500, 2200, audio_player_get_position_ms());
+    TEST_ASSERT_EQUAL(audio_player_get_state(), AUDIO_PLAYER_STATE_PLAYING);
+
+    ///////////////
+    // seeking close to the end finishes playback shortly after
+    expected_event = AUDIO_PLAYER_CALLBACK_EVENT_IDLE;
+    ret = audio_player_seek(15000);
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+    TEST_ASSERT_EQUAL(xQueueReceive(event_queue, &event, pdMS_TO_TICKS(2 * 1000)), pdPASS);
+    TEST_ASSERT_EQUAL(0, audio_player_get_position_ms());
+
+    ///////////////
+    expected_event = AUDIO_PLAYER_CALLBACK_EVENT_SHUTDOWN;
+    ret = audio_player_delete();
+    TEST_ASSERT_EQUAL(ret, ESP_OK);
+    TEST_ASSERT_EQUAL(xQueueReceive(event_queue, &event, pdMS_TO_TICKS(100)), pdPASS);
+
+    vQueueDelete(event_queue);
+
+    TEST_ESP_OK(i2s_channel_disable(i2s_tx_chan));
+    TEST_ESP_OK(i2s_channel_disable(i2s_rx_chan));
+    TEST_ESP_OK(i2s_del_channel(i2s_tx_chan));
+    TEST_ESP_OK(i2s_del_channel(i2s_rx_chan));
+}
+
+static esp_err_t count_pcm(const int16_t *pcm, size_t frames, uint8_t channels, uint32_t sample_rate, void *ctx)
+{
+    TEST_ASSERT_EQUAL(1, channels);
+    TEST_ASSERT_EQUAL(44100, sample_rate);
+    *(size_t *)ctx += frames;
+    return ESP_OK;
+}
+
+TEST_CASE("audio player decodes a whole file without the audio task", "[audio player]")
+{
+    extern const char mp3_start[] asm("_binary_gs_16b_1c_44100hz_mp3_start");
+    extern const char mp3_end[]   asm("_binary_gs_16b_1c_44100hz_mp3_end");
+    // cppcheck-suppress comparePointers
+    size_t mp3_size = (mp3_end - mp3_start) - 1;
+
+    FILE *fp = fmemopen((void*)mp3_start, mp3_size, "rb");
+    TEST_ASSERT_NOT_NULL(fp);
+
+    // encoder delay and padding are trimmed, as when playing
+    size_t frames = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, audio_player_decode(fp, count_pcm, &frames));
+    TEST_ASSERT_EQUAL(699311, frames);
+
+    fclose(fp);
+}
+
+TEST_CASE("pcm conversion kernels are bit-exact with the scalar reference", "[audio pcm]")
+{
+    TEST_ASSERT_TRUE(audio_pcm_selftest());
+}
+
+TEST_CASE("pcm conversion cost per mp3 frame", "[audio pcm]")
+{
+    // one mono mp3 frame going to stereo 32 bit slots
+    const size_t frames = 1152;
+    int16_t *in = heap_caps_aligned_alloc(AUDIO_PCM_ALIGN, frames * sizeof(int16_t), MALLOC_CAP_INTERNAL);
+    int32_t *out = heap_caps_aligned_alloc(AUDIO_PCM_ALIGN, frames * 2 * sizeof(int32_t), MALLOC_CAP_INTERNAL);
+    TEST_ASSERT_NOT_NULL(in);
+    TEST_ASSERT_NOT_NULL(out);
+    memset(in, 0x5a, frames * sizeof(int16_t));
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    audio_pcm_mono16_to_stereo32_ref(out, in, frames);
+    uint32_t ref_cycles = esp_cpu_get_cycle_count() - start;
+
+    start = esp_cpu_get_cycle_count();
+    audio_pcm_mono16_to_stereo32(out, in, frames);
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+    ESP_LOGI(TAG, "mono16 -> stereo32, %zu frames: reference %lu cycles, kernel %lu cycles",
+             frames, ref_cycles, cycles);
+#if CONFIG_AUDIO_PLAYER_PCM_SIMD
+    TEST_ASSERT_LESS_THAN(ref_cycles, cycles);
+#endif
+
+    heap_caps_free(in);
+    heap_caps_free(out);
+}
+
+#if CONFIG_LIBHELIX_MP3_XTENSA_POLYPHASE
+TEST_CASE("mp3 polyphase filter is bit-exact with the C reference", "[audio mp3]")
+{
+    unsigned int ref_cycles, cycles;
+    TEST_ASSERT_TRUE(MP3PolyphaseSelftest(&ref_cycles, &cycles));
+
+    ESP_LOGI(TAG, "stereo polyphase, 32 samples: reference %u cycles, xtensa %u cycles", ref_cycles, cycles);
+    TEST_ASSERT_LESS_OR_EQUAL(ref_cycles, cycles);
+}
+#endif
+
+TEST_CASE("mp3 decode cycles per frame", "[audio mp3]")
+{
+    extern const char mp3_start[] asm("_binary_gs_16b_1c_44100hz_mp3_start");
+    extern const char mp3_end[]   asm("_binary_gs_16b_1c_44100hz_mp3_end");
+    // cppcheck-suppress comparePointers
+    int bytes_left = (mp3_end - mp3_start) - 1;
+    unsigned char *in = (unsigned char *)mp3_start;
+
+    HMP3Decoder decoder = MP3InitDecoder();
+    TEST_ASSERT_NOT_NULL(decoder);
+    short *pcm = heap_caps_malloc(MAX_NCHAN * MAX_NGRAN * MAX_NSAMP * sizeof(short), MALLOC_CAP_INTERNAL);
+    TEST_ASSERT_NOT_NULL(pcm);
+
+    uint32_t frames = 0, total = 0, max = 0, min = UINT32_MAX;
+    MP3FrameInfo info = { 0 };
+    int offset;
+    while((offset = MP3FindSyncWord(in, bytes_left)) >= 0) {
+        in += offset;
+        bytes_left -= offset;
+
+        uint32_t start = esp_cpu_get_cycle_count();
+        int err = MP3Decode(decoder, &in, &bytes_left, pcm, 0);
+        uint32_t cycles = esp_cpu_get_cycle_count() - start;
+        if(err != ERR_MP3_NONE) {
+            // the Info frame and a truncated last frame don't decode
+            if(bytes_left > 0) {
+                in++;
+                bytes_left--;
+            }
+            continue;
+        }
+
+        MP3GetLastFrameInfo(decoder, &info);
+        frames++;
+        total += cycles;
+        max = (cycles > max) ? cycles : max;
+        min = (cycles < min) ? cycles : min;
+    }
+
+    TEST_ASSERT_GREATER_THAN(100, frames);
+
+    // cycles needed to decode one second of audio, as a share of the CPU clock
+    uint32_t avg = total / frames;
+    uint32_t per_second = (uint64_t)avg * info.samprate / (info.outputSamps / info.nChans);
+    ESP_LOGI(TAG, "mp3 %d kbps %d Hz %d ch, %lu frames: min %lu avg %lu max %lu cycles per frame, %lu.%lu%% of %d MHz",
+             info.bitrate / 1000, info.samprate, info.nChans, frames, min, avg, max,
+             per_second / (CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 10000),
+             per_second / (CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000) % 10,
+             CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+
+    // real time with plenty of room to spare
+    TEST_ASSERT_LESS_THAN(CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000000 / 2, per_second);
+
+    heap_caps_free(pcm);
+    MP3FreeDecoder(decoder);
+}
+
+#if CONFIG_AUDIO_PROF_ENABLE
+TEST_CASE("profiler aggregates min/avg/max/p99", "[audio prof]")
+{
+    audio_prof_reset();
+
+    // 990 samples of 1000 cycles and 10 outliers, the p99 bucket must hold the 1000s
+    for(int n = 0; n < 990; n++) {
+        audio_prof_record(AUDIO_PROF_DECODE, 1000);
+    }
+    for(int n = 0; n < 10; n++) {
+        audio_prof_record(AUDIO_PROF_DECODE, 100000);
+    }
+    audio_prof_count(AUDIO_PROF_UNDERRUNS, 3);
+
+    audio_prof_stats_t st;
+    audio_prof_get(AUDIO_PROF_DECODE, &st);
+    TEST_ASSERT_EQUAL_UINT32(1000, st.count);
+    TEST_ASSERT_EQUAL_UINT32(1000, st.min);
+    TEST_ASSERT_EQUAL_UINT32(100000, st.max);
+    TEST_ASSERT_EQUAL_UINT32((990 * 1000 + 10 * 100000) / 1000, st.avg);
+    TEST_ASSERT_UINT32_WITHIN(250, 1000, st.p99);
+    TEST_ASSERT_EQUAL_UINT32(3, audio_prof_get_count(AUDIO_PROF_UNDERRUNS));
+
+    // recording must stay well below 1% of an mp3 frame (~26 ms) per sample
+    uint32_t start = esp_cpu_get_cycle_count();
+    for(int n = 0; n < 1000; n++) {
+        audio_prof_stop(AUDIO_PROF_CONVERT, audio_prof_start());
+    }
+    uint32_t cycles = (esp_cpu_get_cycle_count() - start) / 1000;
+    ESP_LOGI(TAG, "profiler: %lu cycles per sample", cycles);
+    TEST_ASSERT_LESS_THAN(200, cycles);
+
+    audio_prof_log();
+    audio_prof_reset();
+    audio_prof_get(AUDIO_PROF_DECODE, &st);
+    TEST_ASSERT_EQUAL_UINT32(0, st.count);
+}
+#endif
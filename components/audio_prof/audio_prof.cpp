@@ -0,0 +1,133 @@
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "audio_prof.h"
+
+static const char *TAG = "audio_prof";
+
+/*
+ * Values below 4 have a bucket each, above that every octave [2^m, 2^(m+1))
+ * is split into 4 buckets, selected by the two bits after the leading one.
+ */
+#define PROF_SUB_BITS   2
+#define PROF_SUB        (1 << PROF_SUB_BITS)
+#define PROF_BUCKETS    (PROF_SUB * (32 - PROF_SUB_BITS + 1))
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t hist[PROF_BUCKETS];
+} prof_series_t;
+
+static prof_series_t s_series[AUDIO_PROF_SERIES_MAX];
+static volatile uint32_t s_counters[AUDIO_PROF_COUNTER_MAX];
+
+static const char *const s_series_name[AUDIO_PROF_SERIES_MAX] = {
+    "read", "decode", "convert", "output", "i2s", "fill %",
+};
+
+static const char *const s_counter_name[AUDIO_PROF_COUNTER_MAX] = {
+    "bytes read", "frames decoded", "underruns",
+};
+
+static inline uint32_t bucket_of(uint32_t v) {
+    if(v < PROF_SUB) {
+        return v;
+    }
+    uint32_t msb = 31 - __builtin_clz(v);
+    return PROF_SUB * (msb - PROF_SUB_BITS + 1) + ((v >> (msb - PROF_SUB_BITS)) & (PROF_SUB - 1));
+}
+
+static uint32_t bucket_upper(uint32_t b) {
+    if(b < PROF_SUB) {
+        return b;
+    }
+    uint32_t msb = b / PROF_SUB + PROF_SUB_BITS - 1;
+    uint32_t width = 1u << (msb - PROF_SUB_BITS);
+    uint64_t lower = static_cast<uint64_t>(PROF_SUB + b % PROF_SUB) << (msb - PROF_SUB_BITS);
+    uint64_t upper = lower + width - 1;
+    return (upper > UINT32_MAX) ? UINT32_MAX : static_cast<uint32_t>(upper);
+}
+
+#if CONFIG_AUDIO_PROF_ENABLE
+
+void audio_prof_record(audio_prof_series_t series, uint32_t value) {
+    prof_series_t *s = &s_series[series];
+
+    if((s->count == 0) || (value < s->min)) {
+        s->min = value;
+    }
+    if(value > s->max) {
+        s->max = value;
+    }
+    s->sum += value;
+    s->hist[bucket_of(value)]++;
+    s->count++;
+}
+
+void IRAM_ATTR audio_prof_count(audio_prof_counter_t counter, uint32_t n) {
+    s_counters[counter] += n;
+}
+
+#endif
+
+void audio_prof_get(audio_prof_series_t series, audio_prof_stats_t *stats) {
+    const prof_series_t *s = &s_series[series];
+
+    memset(stats, 0, sizeof(*stats));
+    stats->count = s->count;
+    if(stats->count == 0) {
+        return;
+    }
+
+    stats->min = s->min;
+    stats->max = s->max;
+    stats->avg = static_cast<uint32_t>(s->sum / stats->count);
+
+    // smallest bucket that holds at least 99% of the samples
+    uint32_t target = stats->count - stats->count / 100;
+    uint32_t seen = 0;
+    for(uint32_t b = 0; b < PROF_BUCKETS; b++) {
+        seen += s->hist[b];
+        if(seen >= target) {
+            stats->p99 = bucket_upper(b);
+            break;
+        }
+    }
+    if(stats->p99 > stats->max) {
+        stats->p99 = stats->max;
+    }
+}
+
+uint32_t audio_prof_get_count(audio_prof_counter_t counter) {
+    return s_counters[counter];
+}
+
+void audio_prof_reset(void) {
+    memset(s_series, 0, sizeof(s_series));
+    for(int c = 0; c < AUDIO_PROF_COUNTER_MAX; c++) {
+        s_counters[c] = 0;
+    }
+}
+
+void audio_prof_log(void) {
+    uint32_t mhz = esp_rom_get_cpu_ticks_per_us();
+
+    ESP_LOGI(TAG, "%-8s %8s %8s %8s %8s %8s", "stage", "count", "min", "avg", "p99", "max");
+    for(int i = 0; i < AUDIO_PROF_SERIES_MAX; i++) {
+        audio_prof_stats_t st;
+        audio_prof_get(static_cast<audio_prof_series_t>(i), &st);
+
+        // cycle stages are shown in microseconds, the fill level as is
+        uint32_t div = (i == AUDIO_PROF_FILL) ? 1 : mhz;
+        ESP_LOGI(TAG, "%-8s %8lu %8lu %8lu %8lu %8lu", s_series_name[i], (unsigned long)st.count,
+                 (unsigned long)(st.min / div), (unsigned long)(st.avg / div),
+                 (unsigned long)(st.p99 / div), (unsigned long)(st.max / div));
+    }
+    for(int c = 0; c < AUDIO_PROF_COUNTER_MAX; c++) {
+        ESP_LOGI(TAG, "%-15s %lu", s_counter_name[c], (unsigned long)s_counters[c]);
+    }
+}
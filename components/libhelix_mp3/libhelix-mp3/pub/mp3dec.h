@@ -125,6 +125,11 @@ void MP3GetLastFrameInfo(HMP3Decoder hMP3Decoder, MP3FrameInfo *mp3FrameInfo);
 int MP3GetNextFrameInfo(HMP3Decoder hMP3Decoder, MP3FrameInfo *mp3FrameInfo, unsigned char *buf);
 int MP3FindSyncWord(unsigned char *buf, int nBytes);
 
+/* only built with the Xtensa polyphase filter (CONFIG_LIBHELIX_MP3_XTENSA_POLYPHASE),
+ * returns 1 if it is bit-exact with the C reference and the cycles of one stereo call of each
+ */
+int MP3PolyphaseSelftest(unsigned int *refCycles, unsigned int *cycles);
+
 #ifdef __cplusplus
 }
 #endif
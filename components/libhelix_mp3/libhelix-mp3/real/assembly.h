@@ -420,27 +420,29 @@ static __inline Word64 SAR64(Word64 x, int n)
 
 typedef long long Word64;
 
+#if XCHAL_HAVE_MUL32_HIGH
+
+/* The asm statements below have no side effects, so they are not volatile: the
+ * compiler is free to schedule them around the 2 cycle latency of MULL/MULSH,
+ * and to keep the operands in registers across an unrolled filter tap.
+ */
+
 static __inline Word64 MADD64(Word64 sum64, int x, int y)
 {
-    return (sum64 + ((long long)x * y));
+    /* MULL and MULSH give the low and high words of the signed 64 bit product,
+     * this avoids a call to __muldi3 on toolchains that don't pair them up
+     */
+    unsigned int lo;
+    int hi;
+    asm ("mull %0, %1, %2" : "=r" (lo) : "r" (x), "r" (y));
+    asm ("mulsh %0, %1, %2" : "=r" (hi) : "r" (x), "r" (y));
+    return sum64 + (Word64)(((unsigned long long)(unsigned int)hi << 32) | lo);
 }
 
-#if XCHAL_HAVE_MUL32_HIGH
-
 static __inline int MULSHIFT32(int x, int y)
 {
-    /* important rules for smull RdLo, RdHi, Rm, Rs:
-     *     RdHi and Rm can't be the same register
-     *     RdLo and Rm can't be the same register
-     *     RdHi and RdLo can't be the same register
-     * Note: Rs determines early termination (leading sign bits) so if you want to specify
-     *   which operand is Rs, put it in the SECOND argument (y)
-     * For inline assembly, x and y are not assumed to be R0, R1 so it shouldn't matter
-     *   which one is returned. (If this were a function call, returning y (R1) would
-     *   require an extra "mov r0, r1")
-     */
     int ret;
-    asm volatile ("mulsh %0, %1, %2" : "=r" (ret) : "r" (x), "r" (y));
+    asm ("mulsh %0, %1, %2" : "=r" (ret) : "r" (x), "r" (y));
     return ret;
 }
 
@@ -455,7 +457,7 @@ static __inline int MULSHIFT32(int x, int y)
 static __inline int FASTABS(int x)
 {
     int ret;
-    asm volatile ("abs %0, %1" : "=r" (ret) : "r" (x));
+    asm ("abs %0, %1" : "=r" (ret) : "r" (x));
     return ret;
 }
 
@@ -472,7 +474,41 @@ static __inline Word64 SAR64(Word64 x, int n)
 
 static __inline int CLZ(int x)
 {
-    return __builtin_clz(x);
+    /* NSAU returns 32 for 0, like the other platforms, __builtin_clz(0) is undefined */
+    int ret;
+    asm ("nsau %0, %1" : "=r" (ret) : "r" (x));
+    return ret;
+}
+
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__))
+
+/* Linux hosts, for the host build of the decoder (audio_player/host_test) */
+
+typedef long long Word64;
+
+static __inline int MULSHIFT32(int x, int y)
+{
+    return (int)(((long long)x * y) >> 32);
+}
+
+static __inline int FASTABS(int x)
+{
+    return (x < 0) ? -x : x;
+}
+
+static __inline int CLZ(int x)
+{
+    return x ? __builtin_clz(x) : 32;
+}
+
+static __inline Word64 MADD64(Word64 sum64, int x, int y)
+{
+    return sum64 + (long long)x * y;
+}
+
+static __inline Word64 SAR64(Word64 x, int n)
+{
+    return x >> n;
 }
 
 #else
@@ -99,6 +99,8 @@
 #define	IntensityProcMPEG2	STATNAME(IntensityProcMPEG2)
 #define PolyphaseMono		STATNAME(PolyphaseMono)
 #define PolyphaseStereo		STATNAME(PolyphaseStereo)
+#define PolyphaseMonoRef	STATNAME(PolyphaseMonoRef)
+#define PolyphaseStereoRef	STATNAME(PolyphaseStereoRef)
 #define FDCT32				STATNAME(FDCT32)
 
 #define	ISFMpeg1			STATNAME(ISFMpeg1)
@@ -291,6 +293,11 @@ extern "C" {
 #endif
 void PolyphaseMono(short *pcm, int *vbuf, const int *coefBase);
 void PolyphaseStereo(short *pcm, int *vbuf, const int *coefBase);
+#ifdef HELIX_XTENSA_POLYPHASE
+/* with xtensa/polyxtensa.c the C versions in polyphase.c keep these names as the reference */
+void PolyphaseMonoRef(short *pcm, int *vbuf, const int *coefBase);
+void PolyphaseStereoRef(short *pcm, int *vbuf, const int *coefBase);
+#endif
 #ifdef __cplusplus
 }
 #endif
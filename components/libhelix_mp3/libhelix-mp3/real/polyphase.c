@@ -48,6 +48,14 @@
 #include "coder.h"
 #include "assembly.h"
 
+#ifdef HELIX_XTENSA_POLYPHASE
+/* xtensa/polyxtensa.c provides the filters, these stay as the reference they are tested against */
+#undef PolyphaseMono
+#undef PolyphaseStereo
+#define PolyphaseMono	PolyphaseMonoRef
+#define PolyphaseStereo	PolyphaseStereoRef
+#endif
+
 /* input to Polyphase = Q(DQ_FRACBITS_OUT-2), gain 2 bits in convolution
  *  we also have the implicit bias of 2^15 to add back, so net fraction bits = 
  *    DQ_FRACBITS_OUT - 2 - 2 - 15
@@ -0,0 +1,265 @@
+/* ***** BEGIN LICENSE BLOCK ***** 
+ * Version: RCSL 1.0/RPSL 1.0 
+ *  
+ * Portions Copyright (c) 1995-2002 RealNetworks, Inc. All Rights Reserved. 
+ *      
+ * The contents of this file, and the files included with this file, are 
+ * subject to the current version of the RealNetworks Public Source License 
+ * Version 1.0 (the "RPSL") available at 
+ * http://www.helixcommunity.org/content/rpsl unless you have licensed 
+ * the file under the RealNetworks Community Source License Version 1.0 
+ * (the "RCSL") available at http://www.helixcommunity.org/content/rcsl, 
+ * in which case the RCSL will apply. You may also obtain the license terms 
+ * directly from RealNetworks.  You may not use this file except in 
+ * compliance with the RPSL or, if you have a valid RCSL with RealNetworks 
+ * applicable to this file, the RCSL.  Please see the applicable RPSL or 
+ * RCSL for the rights, obligations and limitations governing use of the 
+ * contents of the file.  
+ *  
+ * This file is part of the Helix DNA Technology. RealNetworks is the 
+ * developer of the Original Code and owns the copyrights in the portions 
+ * it created. 
+ *  
+ * This file, and the files included with this file, is distributed and made 
+ * available on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER 
+ * EXPRESS OR IMPLIED, AND REALNETWORKS HEREBY DISCLAIMS ALL SUCH WARRANTIES, 
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY, FITNESS 
+ * FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT. 
+ * 
+ * Technology Compatibility Kit Test Suite(s) Location: 
+ *    http://www.helixcommunity.org/content/tck 
+ * 
+ * Contributor(s): 
+ *  
+ * ***** END LICENSE BLOCK ***** */ 
+
+/**************************************************************************************
+ * Fixed-point MP3 decoder
+ *
+ * polyxtensa.c - polyphase synthesis filter for Xtensa cores (ESP32, ESP32-S3)
+ *
+ * The C reference in polyphase.c filters both channels of a stereo frame in one
+ *   pass, which keeps eight 64-bit accumulators live. Xtensa only has 16 visible
+ *   address registers, so the compiler spills accumulators to the stack on every
+ *   tap. Here each channel is filtered on its own with four accumulators, which
+ *   fit in registers together with the coefficients, the pointers and the
+ *   MULL/MULSH temporaries. The arithmetic is unchanged, so the output is
+ *   bit-exact with the reference (see MP3PolyphaseSelftest(), also run on the host
+ *   by audio_player/host_test/polyphase_test.cpp).
+ *
+ * PIE and MAC16 only multiply 8 and 16-bit operands, the 32x32->64 products of
+ *   this filter can't be done with them without changing the output.
+ **************************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "coder.h"
+#include "assembly.h"
+
+/* see polyphase.c */
+#define DEF_NFRACBITS	(DQ_FRACBITS_OUT - 2 - 2 - 15)
+#define CSHIFT	12
+
+static __inline short ClipToShort(int x, int fracBits)
+{
+	int sign;
+
+	x >>= fracBits;
+
+	sign = x >> 31;
+	if (sign != (x >> 15))
+		x = sign ^ ((1 << 15) - 1);
+
+	return (short)x;
+}
+
+#define MC0(x)	{ \
+	c1 = *coef;		coef++;		c2 = *coef;		coef++; \
+	vLo = *(vb1+(x));			vHi = *(vb1+(23-(x))); \
+	sum1 = MADD64(sum1, vLo,  c1);	sum1 = MADD64(sum1, vHi, -c2); \
+}
+
+#define MC1(x)	{ \
+	c1 = *coef;		coef++; \
+	vLo = *(vb1+(x)); \
+	sum1 = MADD64(sum1, vLo,  c1); \
+}
+
+#define MC2(x)	{ \
+		c1 = *coef;		coef++;		c2 = *coef;		coef++; \
+		vLo = *(vb1+(x));	vHi = *(vb1+(23-(x))); \
+		sum1 = MADD64(sum1, vLo,  c1);	sum2 = MADD64(sum2, vLo,  c2); \
+		sum1 = MADD64(sum1, vHi, -c2);	sum2 = MADD64(sum2, vHi,  c1); \
+}
+
+/**************************************************************************************
+ * Function:    PolyphaseChannel
+ *
+ * Description: filter one subband and produce 32 output PCM samples for one channel
+ *
+ * Inputs:      pointer to PCM output buffer
+ *              distance between output samples (1 for mono, 2 for interleaved stereo)
+ *              pointer to the channel's samples in vbuf (vbuf + 32 for the right channel)
+ *              start of filter coefficient table (in proper, shuffled order)
+ *
+ * Outputs:     32 samples of one channel of decoded PCM data, (i.e. Q16.0)
+ *
+ * Return:      none
+ **************************************************************************************/
+static void PolyphaseChannel(short *pcm, int step, const int *vbuf, const int *coefBase)
+{
+	int i;
+	const int *coef;
+	const int *vb1;
+	int vLo, vHi, c1, c2;
+	Word64 sum1, sum2, rndVal;
+
+	rndVal = (Word64)( 1 << (DEF_NFRACBITS - 1 + (32 - CSHIFT)) );
+
+	/* special case, output sample 0 */
+	coef = coefBase;
+	vb1 = vbuf;
+	sum1 = rndVal;
+
+	MC0(0)
+	MC0(1)
+	MC0(2)
+	MC0(3)
+	MC0(4)
+	MC0(5)
+	MC0(6)
+	MC0(7)
+
+	*(pcm + 0) = ClipToShort((int)SAR64(sum1, (32-CSHIFT)), DEF_NFRACBITS);
+
+	/* special case, output sample 16 */
+	coef = coefBase + 256;
+	vb1 = vbuf + 64*16;
+	sum1 = rndVal;
+
+	MC1(0)
+	MC1(1)
+	MC1(2)
+	MC1(3)
+	MC1(4)
+	MC1(5)
+	MC1(6)
+	MC1(7)
+
+	*(pcm + 16*step) = ClipToShort((int)SAR64(sum1, (32-CSHIFT)), DEF_NFRACBITS);
+
+	/* main convolution loop: sum1 = samples 1, 2, 3, ... 15   sum2 = samples 31, 30, ... 17 */
+	coef = coefBase + 16;
+	vb1 = vbuf + 64;
+	pcm += step;
+
+	for (i = 15; i > 0; i--) {
+		sum1 = sum2 = rndVal;
+
+		MC2(0)
+		MC2(1)
+		MC2(2)
+		MC2(3)
+		MC2(4)
+		MC2(5)
+		MC2(6)
+		MC2(7)
+
+		vb1 += 64;
+		*(pcm)              = ClipToShort((int)SAR64(sum1, (32-CSHIFT)), DEF_NFRACBITS);
+		*(pcm + 2*i*step)   = ClipToShort((int)SAR64(sum2, (32-CSHIFT)), DEF_NFRACBITS);
+		pcm += step;
+	}
+}
+
+void PolyphaseMono(short *pcm, int *vbuf, const int *coefBase)
+{
+	PolyphaseChannel(pcm, 1, vbuf, coefBase);
+}
+
+/* interleaves PCM samples LRLRLR..., the right channel is 32 samples after the left in vbuf */
+void PolyphaseStereo(short *pcm, int *vbuf, const int *coefBase)
+{
+	PolyphaseChannel(pcm, 2, vbuf, coefBase);
+	PolyphaseChannel(pcm + 1, 2, vbuf + 32, coefBase);
+}
+
+static unsigned int CycleCount(void)
+{
+#if defined(__xtensa__)
+	unsigned int ccount;
+	asm volatile ("rsr %0, ccount" : "=r" (ccount));
+	return ccount;
+#else
+	return 0;
+#endif
+}
+
+/**************************************************************************************
+ * Function:    MP3PolyphaseSelftest
+ *
+ * Description: run the filters above and the C reference in polyphase.c on the
+ *                same pseudo-random vbuf and compare the output
+ *
+ * Inputs:      optional pointers to receive the cycles taken by one stereo call of
+ *                the reference and of the Xtensa filter
+ *
+ * Outputs:     none
+ *
+ * Return:      1 if the output is bit-exact, 0 otherwise (or if memory runs out)
+ **************************************************************************************/
+int MP3PolyphaseSelftest(unsigned int *refCycles, unsigned int *cycles)
+{
+	int *vbuf;
+	short *pcmRef, *pcm;
+	unsigned int seed, start, best, bestRef;
+	int i, n, ok;
+
+	vbuf = (int *)malloc(VBUF_LENGTH * sizeof(int));
+	pcmRef = (short *)malloc(2 * NBANDS * sizeof(short));
+	pcm = (short *)malloc(2 * NBANDS * sizeof(short));
+	if (!vbuf || !pcmRef || !pcm) {
+		free(vbuf);
+		free(pcmRef);
+		free(pcm);
+		return 0;
+	}
+
+	ok = 1;
+	seed = 12345;
+	best = bestRef = 0xffffffff;
+	for (n = 0; n < 64 && ok; n++) {
+		/* full scale, quiet and clipping inputs, vbuf needs no guard bits */
+		for (i = 0; i < VBUF_LENGTH; i++) {
+			seed = seed * 1664525 + 1013904223;
+			vbuf[i] = (int)seed >> (n % 24);
+		}
+
+		start = CycleCount();
+		PolyphaseStereoRef(pcmRef, vbuf, polyCoef);
+		start = CycleCount() - start;
+		bestRef = MIN(bestRef, start);
+
+		start = CycleCount();
+		PolyphaseStereo(pcm, vbuf, polyCoef);
+		start = CycleCount() - start;
+		best = MIN(best, start);
+
+		ok = (memcmp(pcmRef, pcm, 2 * NBANDS * sizeof(short)) == 0);
+
+		PolyphaseMonoRef(pcmRef, vbuf, polyCoef);
+		PolyphaseMono(pcm, vbuf, polyCoef);
+		ok = ok && (memcmp(pcmRef, pcm, NBANDS * sizeof(short)) == 0);
+	}
+
+	if (refCycles)
+		*refCycles = bestRef;
+	if (cycles)
+		*cycles = best;
+
+	free(vbuf);
+	free(pcmRef);
+	free(pcm);
+
+	return ok;
+}
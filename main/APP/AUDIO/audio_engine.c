@@ -0,0 +1,1442 @@
+/**
+ ****************************************************************************************************
+ * @file        audio_engine.c
+ * @brief       常驻音频引擎
+ *              I2S、ES8388和播放器任务只初始化一次,播放之间不再反复创建/销毁;
+ *              播放列表中的下一首在当前曲目结束前由播放器预先打开并解码首帧,实现无缝衔接.
+ *              播放器和提示音分别写入混音器的两路输入,提示音播放时音乐自动压低.
+ *              流水线分为I/O(SD卡预读,HTTP下载)、解码(播放器)和输出(混音,写I2S)三级,
+ *              各级的核心和优先级由audio_engine_placement_t决定,级间用有界环形缓冲区连接
+ ****************************************************************************************************
+ */
+
+#include "audio_engine.h"
+#include "audioplay.h"
+#include "http_stream.h"
+#include "file_stream.h"
+#include "prompt_cache.h"
+#include "rmt_nec_tx.h"
+#include "audio_prof.h"
+#include "freertos/event_groups.h"
+#include "nvs.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include <math.h>
+#include <unistd.h>
+
+static const char *TAG = "audio_engine";
+
+#define ENGINE_IDLE_BIT     (1 << 0)        /* 播放器空闲 */
+
+static bool s_running = false;                                          /* 引擎是否已初始化 */
+static SemaphoreHandle_t s_lock;                                        /* 保护播放列表 */
+static EventGroupHandle_t s_events;                                     /* 播放状态事件组 */
+
+static char s_playlist[AUDIO_ENGINE_PLAYLIST_MAX][AUDIO_ENGINE_PATH_LEN];/* 播放列表 */
+static uint16_t s_list_num = 0;                                         /* 播放列表曲目数 */
+static uint16_t s_list_next = 0;                                        /* 下一首交给播放器的曲目 */
+static uint8_t s_pending = 0;                                           /* 已交给播放器但尚未开始的曲目数 */
+static bool s_paused = false;                                           /* 播放器处于暂停状态 */
+static bool s_starting = false;                                         /* 立即播放请求尚未被播放器处理 */
+static audio_mixer_input_t *s_music;                                    /* 混音器音乐输入 */
+static char s_start_path[AUDIO_ENGINE_PATH_LEN];                        /* 立即播放请求的曲目 */
+static char s_next_path[AUDIO_ENGINE_PATH_LEN];                         /* 已交给播放器排队的曲目 */
+static char s_now_path[AUDIO_ENGINE_PATH_LEN];                          /* 正在播放的曲目,用于断点续播 */
+static audio_mixer_input_t *s_prompt;                                   /* 混音器提示音输入 */
+static uint32_t s_io_underruns;                                         /* 已关闭的本地文件预读欠载次数 */
+static volatile bool s_indexing;                                        /* 后台正在建立定位索引 */
+
+/* 播放请求到第一块数据写入I2S DMA的延迟测量:请求 -> 播放器开始新曲目 -> 新曲目数据写入混音器 -> 写入DMA */
+enum
+{
+    LATENCY_IDLE,
+    LATENCY_REQUESTED,
+    LATENCY_STARTED,
+    LATENCY_DECODED,
+};
+static volatile uint8_t s_lat_state = LATENCY_IDLE;                     /* 测量进行到的阶段 */
+static int64_t s_lat_request_us;                                        /* 播放请求的时间 */
+static volatile uint32_t s_lat_us;                                      /* 最近一次测得的延迟(us) */
+
+static audio_engine_placement_t s_place = {                             /* 流水线各级的核心和优先级 */
+    .io_core = AUDIO_ENGINE_IO_CORE,
+    .io_prio = AUDIO_ENGINE_IO_PRIO,
+    .decode_core = AUDIO_ENGINE_DECODE_CORE,
+    .decode_prio = AUDIO_ENGINE_DECODE_PRIO,
+    .output_core = AUDIO_ENGINE_OUTPUT_CORE,
+    .output_prio = AUDIO_ENGINE_OUTPUT_PRIO,
+};
+
+/**
+ * @brief       混音器写I2S
+ */
+static esp_err_t engine_i2s_write(void *audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms)
+{
+    audio_prof_record(AUDIO_PROF_FILL, audio_mixer_input_fill(s_music));
+
+    uint32_t start = audio_prof_start();
+    esp_err_t ret = i2s_channel_write(tx_handle, audio_buffer, len, bytes_written, timeout_ms);
+    audio_prof_stop(AUDIO_PROF_I2S, start);
+
+    if (s_lat_state == LATENCY_DECODED)
+    {
+        s_lat_us = esp_timer_get_time() - s_lat_request_us;
+        s_lat_state = LATENCY_IDLE;
+    }
+
+    i2s_tx_watch(true);             /* DMA中已有数据,开始统计欠载 */
+    return ret;
+}
+
+/**
+ * @brief       混音器修改I2S采样率,输出固定为16位立体声
+ * @note        正在录音且采样率不同时失败,按原采样率输出;AUDIO_ENGINE_FIXED_RATE与录音相同时不会冲突
+ */
+static esp_err_t engine_i2s_set_rate(uint32_t rate)
+{
+    return i2s_set_format(I2S_DIR_TX, rate, I2S_DATA_BIT_WIDTH_16BIT);
+}
+
+/**
+ * @brief       混音器开始/停止输出,通过XL9555控制喇叭使能(低电平打开)
+ * @note        混音器在最后的数据播完后才通知停止,曲目结尾和提示音不会被截断
+ */
+static void engine_speaker(bool active)
+{
+    if (!active)
+    {
+        i2s_tx_watch(false);        /* 混音器停止写入,DMA播完后重复发送静音不算欠载 */
+    }
+
+    xl9555_pin_write(SPK_EN_IO, active ? 0 : 1);
+}
+
+/**
+ * @brief       播放器输出写入混音器的音乐输入
+ */
+static esp_err_t engine_player_write(void *audio_buffer, size_t len, size_t *bytes_written, uint32_t timeout_ms)
+{
+    esp_err_t ret = audio_mixer_write(s_music, audio_buffer, len, bytes_written, timeout_ms);
+
+    if (s_lat_state == LATENCY_STARTED)
+    {
+        s_lat_state = LATENCY_DECODED;  /* 新曲目的第一块数据已交给混音器 */
+    }
+
+    return ret;
+}
+
+/**
+ * @brief       曲目格式变化,仅在曲目格式变化时调用
+ * @note        位宽和声道在写入混音器时转换;
+ *              固定采样率时由混音器重采样,否则混音器在旧数据播完后修改I2S时钟
+ */
+static esp_err_t engine_player_format(uint32_t rate, uint32_t bits_cfg, i2s_slot_mode_t ch)
+{
+    ESP_RETURN_ON_ERROR(audio_mixer_input_set_format(s_music, bits_cfg, ch == I2S_SLOT_MODE_MONO ? 1 : 2),
+                        TAG, "unsupported track format");
+#if AUDIO_ENGINE_FIXED_RATE
+    return audio_mixer_input_set_rate(s_music, rate);
+#else
+    if (audio_mixer_set_rate(rate) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "output still at %lu Hz, resampling", audio_mixer_get_rate());   /* 修改采样率超时,先重采样 */
+    }
+
+    return audio_mixer_input_set_rate(s_music, rate);
+#endif
+}
+
+/**
+ * @brief       播放器静音控制
+ * @note        喇叭由混音器根据实际输出控制,这里不处理
+ */
+static esp_err_t engine_mute(AUDIO_PLAYER_MUTE_SETTING setting)
+{
+    return ESP_OK;
+}
+
+/* HTTP数据源回调 */
+static int engine_http_read(void *ctx, void *buf, size_t len)
+{
+    return http_stream_read((http_stream_t *)ctx, buf, len);
+}
+
+static int engine_http_seek(void *ctx, int64_t *offset, int whence)
+{
+    return http_stream_seek((http_stream_t *)ctx, offset, whence);
+}
+
+static int64_t engine_http_size(void *ctx)
+{
+    return http_stream_size((http_stream_t *)ctx);
+}
+
+static void engine_http_close(void *ctx)
+{
+    http_stream_close((http_stream_t *)ctx);
+}
+
+/* 本地文件预读数据源回调 */
+static int engine_file_read(void *ctx, void *buf, size_t len)
+{
+    return file_stream_read((file_stream_t *)ctx, buf, len);
+}
+
+static int engine_file_seek(void *ctx, int64_t *offset, int whence)
+{
+    return file_stream_seek((file_stream_t *)ctx, offset, whence);
+}
+
+static int64_t engine_file_size(void *ctx)
+{
+    return file_stream_size((file_stream_t *)ctx);
+}
+
+static void engine_file_close(void *ctx)
+{
+    s_io_underruns += file_stream_underruns((file_stream_t *)ctx);
+    file_stream_close((file_stream_t *)ctx);
+}
+
+/**
+ * @brief       得到曲目的定位索引文件名
+ * @param       path : 曲目路径
+ * @param       buf  : 存放索引文件名,至少AUDIO_ENGINE_PATH_LEN + sizeof(AUDIO_ENGINE_INDEX_EXT)字节
+ * @retval      无
+ */
+static void engine_index_path(const char *path, char *buf)
+{
+    strcpy(buf, path);
+    strcat(buf, AUDIO_ENGINE_INDEX_EXT);
+}
+
+/**
+ * @brief       打开曲目,"http://"开头的路径边下载边播放
+ * @note        本地文件和URL都由I/O级任务读入缓冲区,解码任务不直接访问SD卡和网络
+ * @param       path     : 文件路径或URL
+ * @param       index_fp : 返回曲目旁的定位索引文件,没有时为NULL
+ * @retval      文件指针; NULL:失败
+ */
+static FILE *engine_open(const char *path, FILE **index_fp)
+{
+    audio_player_source_t source;
+
+    *index_fp = NULL;
+
+    if (strncmp(path, "http://", 7) != 0)
+    {
+        file_stream_t *stream = file_stream_open(path, s_place.io_core, s_place.io_prio);
+        if (!stream)
+        {
+            return NULL;
+        }
+
+        source = (audio_player_source_t) {
+            .ctx = stream,
+            .read_fn = engine_file_read,
+            .seek_fn = engine_file_seek,
+            .size_fn = engine_file_size,
+            .close_fn = engine_file_close,
+        };
+    }
+    else
+    {
+        http_stream_t *stream = http_stream_open(path);
+        if (!stream)
+        {
+            return NULL;
+        }
+
+        source = (audio_player_source_t) {
+            .ctx = stream,
+            .read_fn = engine_http_read,
+            .seek_fn = engine_http_seek,
+            .size_fn = engine_http_size,
+            .close_fn = engine_http_close,
+        };
+    }
+
+    FILE *fp = audio_player_source_open(&source);
+    if (!fp)
+    {
+        source.close_fn(source.ctx);
+        return NULL;
+    }
+
+    if (source.close_fn == engine_file_close)
+    {
+        char idx[AUDIO_ENGINE_PATH_LEN + sizeof(AUDIO_ENGINE_INDEX_EXT)];
+
+        engine_index_path(path, idx);
+        *index_fp = fopen(idx, "rb");       /* 没有索引时按Xing目录或码率估算位置 */
+    }
+
+    return fp;
+}
+
+/**
+ * @brief       打开文件并交给播放器排队
+ * @note        调用者需持有s_lock
+ */
+static void engine_feed(void)
+{
+    /* 立即播放请求会清空播放器的排队曲目,需等它开始后再交付下一首 */
+    while (!s_starting && s_pending == 0 && s_list_next < s_list_num)
+    {
+        const char *path = s_playlist[s_list_next++];
+        FILE *index_fp;
+        FILE *fp = engine_open(path, &index_fp);
+
+        if (!fp)
+        {
+            ESP_LOGE(TAG, "Failed to open file %s", path);
+            continue;
+        }
+
+        if (audio_player_queue_indexed(fp, index_fp) != ESP_OK)
+        {
+            fclose(fp);
+
+            if (index_fp)
+            {
+                fclose(index_fp);
+            }
+
+            continue;
+        }
+
+        strcpy(s_next_path, path);
+        s_pending++;
+    }
+}
+
+/**
+ * @brief       播放器事件回调(运行在播放器任务中)
+ */
+static void engine_event_cb(audio_player_cb_ctx_t *ctx)
+{
+    switch (ctx->audio_event)
+    {
+        case AUDIO_PLAYER_CALLBACK_EVENT_COMPLETED_PLAYING_NEXT:
+        case AUDIO_PLAYER_CALLBACK_EVENT_PLAYING:
+            xEventGroupClearBits(s_events, ENGINE_IDLE_BIT);
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+
+            if (ctx->audio_event == AUDIO_PLAYER_CALLBACK_EVENT_PLAYING && s_paused)
+            {
+                s_paused = false;   /* 暂停后恢复,不是新曲目 */
+            }
+            else if (s_starting)
+            {
+                s_starting = false; /* 立即播放的曲目已开始 */
+                strcpy(s_now_path, s_start_path);
+
+                if (s_lat_state == LATENCY_REQUESTED)
+                {
+                    s_lat_state = LATENCY_STARTED;
+                }
+            }
+            else if (s_pending)
+            {
+                s_pending--;        /* 排队的曲目已开始播放 */
+                strcpy(s_now_path, s_next_path);
+            }
+
+            engine_feed();          /* 始终保持一首预备曲目,供播放器提前解码 */
+            xSemaphoreGive(s_lock);
+            break;
+
+        case AUDIO_PLAYER_CALLBACK_EVENT_PAUSE:
+            s_paused = true;
+            break;
+
+        case AUDIO_PLAYER_CALLBACK_EVENT_IDLE:
+        case AUDIO_PLAYER_CALLBACK_EVENT_SHUTDOWN:
+            audio_mixer_input_drain(s_music);   /* 播放列表已播完,最后不满一块不是欠载 */
+            xSemaphoreTake(s_lock, portMAX_DELAY);
+            s_pending = 0;
+            s_paused = false;
+            s_now_path[0] = '\0';
+            xSemaphoreGive(s_lock);
+            xEventGroupSetBits(s_events, ENGINE_IDLE_BIT);
+            break;
+
+        case AUDIO_PLAYER_CALLBACK_EVENT_UNKNOWN_FILE_TYPE:
+            ESP_LOGE(TAG, "unsupported file skipped");
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief       初始化常驻音频引擎
+ * @note        I2S、ES8388播放配置和播放器任务只在这里初始化一次
+ * @param       无
+ * @retval      ESP_OK:成功; 其他:失败
+ */
+esp_err_t audio_engine_init(void)
+{
+    if (s_running)
+    {
+        return ESP_OK;
+    }
+
+    if (!s_lock)
+    {
+        s_lock = xSemaphoreCreateMutex();
+        s_events = xEventGroupCreate();
+        ESP_RETURN_ON_FALSE(s_lock && s_events, ESP_ERR_NO_MEM, TAG, "Failed to create engine sync objects");
+    }
+
+    http_stream_set_task(s_place.io_core, s_place.io_prio);     /* 下载任务属于I/O级 */
+
+    ESP_RETURN_ON_ERROR(i2s_open(I2S_DIR_TX), TAG, "I2S init failed");  /* 打开I2S TX,录音可能同时在使用RX */
+    es8388_adda_cfg(1, i2s_is_open(I2S_DIR_RX));    /* 打开DAC，正在录音时保留ADC */
+    es8388_input_cfg(0);                            /* 录音关闭 */
+    es8388_output_cfg(1, 1);                        /* 喇叭通道和耳机通道打开 */
+    es8388_hpvol_set(10);                           /* 设置耳机 */
+    es8388_spkvol_set(0);                           /* 设置喇叭 */
+
+    audio_mixer_config_t mixer_config = {
+        .write_fn = engine_i2s_write,
+        .rate_fn = engine_i2s_set_rate,
+        .active_fn = engine_speaker,
+        .sample_rate = AUDIO_ENGINE_FIXED_RATE ? AUDIO_ENGINE_FIXED_RATE : I2S_SAMPLE_RATE,
+        .ramp_ms = AUDIO_ENGINE_RAMP_MS,
+        .duck_gain = AUDIO_ENGINE_DUCK_GAIN,
+        .resample_quality = AUDIO_ENGINE_RESAMPLE_QUALITY,
+        .priority = s_place.output_prio,
+        .core = s_place.output_core,
+    };
+
+    audio_mixer_input_config_t music_config = {
+        .name = "music",
+        .priority = 0,
+        .buf_size = AUDIO_ENGINE_MUSIC_BUF,
+    };
+
+    audio_mixer_input_config_t prompt_config = {
+        .name = "prompt",
+        .priority = 1,                              /* 提示音播放时压低音乐 */
+        .buf_size = AUDIO_ENGINE_PROMPT_BUF,
+    };
+
+    engine_speaker(false);                          /* 有声音输出时由混音器打开喇叭 */
+
+    esp_err_t ret = audio_mixer_init(&mixer_config);
+    if (ret == ESP_OK)
+    {
+        s_music = audio_mixer_input_add(&music_config);
+        s_prompt = audio_mixer_input_add(&prompt_config);
+        ret = (s_music && s_prompt) ? ESP_OK : ESP_ERR_NO_MEM;
+    }
+
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "audio mixer init failed: %s", esp_err_to_name(ret));
+        audio_mixer_deinit();
+        audio_stop();
+        i2s_close(I2S_DIR_TX);
+        return ret;
+    }
+
+    audio_player_config_t config = {
+        .mute_fn = engine_mute,
+        .write_fn = engine_player_write,
+        .clk_set_fn = engine_player_format,
+        .priority = s_place.decode_prio,
+        .coreID = s_place.decode_core,
+    };
+
+    ret = audio_player_new(config);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "audio_player_new failed: %s", esp_err_to_name(ret));
+        audio_mixer_deinit();
+        audio_stop();
+        i2s_close(I2S_DIR_TX);
+        return ret;
+    }
+
+    audio_player_callback_register(engine_event_cb, NULL);
+    xEventGroupSetBits(s_events, ENGINE_IDLE_BIT);
+
+    s_list_num = 0;
+    s_list_next = 0;
+    s_pending = 0;
+    s_paused = false;
+    s_starting = false;
+    s_running = true;
+    ESP_LOGI(TAG, "audio engine ready, io %d/%u decode %d/%u output %d/%u (core/prio)",
+             s_place.io_core, s_place.io_prio, s_place.decode_core, s_place.decode_prio,
+             s_place.output_core, s_place.output_prio);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief       释放音频引擎
+ * @note        其他需要独占I2S TX的模块(24/32位WAV播放)在打开I2S前调用;录音只用RX,不需要释放
+ * @param       无
+ * @retval      无
+ */
+void audio_engine_deinit(void)
+{
+    if (!s_running)
+    {
+        return;
+    }
+
+    s_running = false;
+    audio_player_delete();
+    audio_mixer_deinit();
+    s_music = NULL;
+    s_prompt = NULL;
+    audio_stop();                   /* 先停止播放 */
+    i2s_close(I2S_DIR_TX);          /* 关闭I2S TX,都关闭后卸载 */
+    ESP_LOGI(TAG, "audio engine released");
+}
+
+/**
+ * @brief       音频引擎是否已初始化
+ * @param       无
+ * @retval      true:已初始化
+ */
+bool audio_engine_is_running(void)
+{
+    return s_running;
+}
+
+/**
+ * @brief       设置流水线各级任务的核心和优先级
+ * @note        任务创建后不能迁移核心,引擎运行时会先释放(停止播放),下次播放时按新设置初始化;
+ *              WAV播放的两个常驻任务在第一次播放时按当时的设置创建
+ * @param       placement : 各级的核心和优先级,核心可为tskNO_AFFINITY
+ * @retval      ESP_OK:成功; ESP_ERR_INVALID_ARG:参数错误
+ */
+esp_err_t audio_engine_set_placement(const audio_engine_placement_t *placement)
+{
+    ESP_RETURN_ON_FALSE(placement, ESP_ERR_INVALID_ARG, TAG, "no placement");
+
+    BaseType_t cores[] = {placement->io_core, placement->decode_core, placement->output_core};
+    UBaseType_t prios[] = {placement->io_prio, placement->decode_prio, placement->output_prio};
+
+    for (int i = 0; i < 3; i++)
+    {
+        ESP_RETURN_ON_FALSE((cores[i] >= 0 && cores[i] < portNUM_PROCESSORS) || cores[i] == tskNO_AFFINITY,
+                            ESP_ERR_INVALID_ARG, TAG, "invalid core %d", cores[i]);
+        ESP_RETURN_ON_FALSE(prios[i] > 0 && prios[i] < configMAX_PRIORITIES, ESP_ERR_INVALID_ARG,
+                            TAG, "invalid priority %u", prios[i]);
+    }
+
+    audio_engine_deinit();
+    s_place = *placement;
+
+    return ESP_OK;
+}
+
+/**
+ * @brief       获取流水线各级任务的核心和优先级
+ * @param       placement : 各级的核心和优先级
+ * @retval      无
+ */
+void audio_engine_get_placement(audio_engine_placement_t *placement)
+{
+    *placement = s_place;
+}
+
+/**
+ * @brief       开始测量播放请求到第一块数据写入I2S DMA的延迟
+ */
+static void engine_latency_request(void)
+{
+    s_lat_request_us = esp_timer_get_time();
+    s_lat_state = LATENCY_REQUESTED;
+}
+
+/**
+ * @brief       清空播放列表
+ */
+static void engine_clear_list(void)
+{
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_list_num = 0;
+    s_list_next = 0;
+    s_pending = 0;
+    xSemaphoreGive(s_lock);
+}
+
+/**
+ * @brief       交给播放器立即播放,清空播放列表
+ * @param       fp          : 文件指针
+ * @param       index_fp    : 定位索引文件,可为NULL
+ * @param       position_ms : 开始播放的位置
+ * @param       path        : 曲目路径,用于断点续播,可为NULL
+ * @retval      ESP_OK:成功,文件由播放器负责关闭; 其他:失败,文件由调用者关闭
+ */
+static esp_err_t engine_start(FILE *fp, FILE *index_fp, uint32_t position_ms, const char *path)
+{
+    ESP_RETURN_ON_ERROR(audio_engine_init(), TAG, "engine init failed");
+
+    engine_clear_list();
+    xEventGroupClearBits(s_events, ENGINE_IDLE_BIT);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_starting = true;
+    strcpy(s_start_path, path ? path : "");
+    esp_err_t ret = audio_player_play_at(fp, index_fp, position_ms);
+    if (ret != ESP_OK)
+    {
+        s_starting = false;
+        xEventGroupSetBits(s_events, ENGINE_IDLE_BIT);
+    }
+    xSemaphoreGive(s_lock);
+
+    return ret;
+}
+
+/**
+ * @brief       立即播放已打开的文件,清空播放列表
+ * @param       fp : 文件指针,返回ESP_OK后由播放器负责关闭
+ * @retval      ESP_OK:成功; 其他:失败,文件由调用者关闭
+ */
+esp_err_t audio_engine_play_fp(FILE *fp)
+{
+    engine_latency_request();
+    return engine_start(fp, NULL, 0, NULL);
+}
+
+/**
+ * @brief       立即播放某个文件,清空播放列表
+ * @param       path : 文件路径或http://URL
+ * @retval      ESP_OK:成功; 其他:失败
+ */
+esp_err_t audio_engine_play(const char *path)
+{
+    return audio_engine_play_at(path, 0);
+}
+
+/**
+ * @brief       后台建立定位索引的任务,属于I/O级,完成后删除自己
+ */
+static void engine_index_task(void *pvParameters)
+{
+    char *path = (char *)pvParameters;
+    esp_err_t ret = audio_engine_index(path);
+
+    if (ret != ESP_OK && ret != ESP_ERR_NOT_SUPPORTED)
+    {
+        ESP_LOGW(TAG, "background index of %s failed: %s", path, esp_err_to_name(ret));
+    }
+
+    free(path);
+    s_indexing = false;
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief       在I/O级核心上以低优先级为本地MP3文件建立定位索引,下次定位时使用
+ * @note        同一时间只建立一个索引,正在建立时忽略
+ */
+static void engine_index_later(const char *path)
+{
+    if (s_indexing)
+    {
+        return;
+    }
+
+    char *copy = strdup(path);
+    if (!copy)
+    {
+        return;
+    }
+
+    s_indexing = true;
+
+    if (xTaskCreatePinnedToCore(engine_index_task, "mp3_index", AUDIO_ENGINE_INDEX_STACK, copy,
+                                AUDIO_ENGINE_INDEX_PRIO, NULL, s_place.io_core) != pdPASS)
+    {
+        free(copy);
+        s_indexing = false;
+    }
+}
+
+/**
+ * @brief       从指定位置开始播放某个文件,清空播放列表
+ * @note        本地MP3文件还没有定位索引时,播放器按Xing目录或码率估算位置
+ *              (CBR: 数据起点 + position_ms * 码率 / 8000),不在调用者的任务中扫描文件;
+ *              索引在后台建立,之后的定位使用索引
+ * @param       path        : 文件路径或http://URL
+ * @param       position_ms : 开始播放的位置(ms)
+ * @retval      ESP_OK:成功; 其他:失败
+ */
+esp_err_t audio_engine_play_at(const char *path, uint32_t position_ms)
+{
+    ESP_RETURN_ON_FALSE(strlen(path) < AUDIO_ENGINE_PATH_LEN, ESP_ERR_INVALID_ARG, TAG, "path too long");
+
+    engine_latency_request();
+
+    FILE *index_fp;
+    FILE *fp = engine_open(path, &index_fp);
+    if (!fp)
+    {
+        ESP_LOGE(TAG, "Failed to open file %s", path);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    if (position_ms && !index_fp && strncmp(path, "http://", 7) != 0)
+    {
+        engine_index_later(path);
+    }
+
+    esp_err_t ret = engine_start(fp, index_fp, position_ms, path);
+    if (ret != ESP_OK)
+    {
+        fclose(fp);
+
+        if (index_fp)
+        {
+            fclose(index_fp);
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * @brief       追加曲目到播放列表
+ * @note        当前曲目结束后无缝播放;播放器空闲时立即开始
+ * @param       path : 文件路径或http://URL
+ * @retval      ESP_OK:成功; ESP_ERR_NO_MEM:播放列表已满
+ */
+esp_err_t audio_engine_enqueue(const char *path)
+{
+    ESP_RETURN_ON_ERROR(audio_engine_init(), TAG, "engine init failed");
+    ESP_RETURN_ON_FALSE(strlen(path) < AUDIO_ENGINE_PATH_LEN, ESP_ERR_INVALID_ARG, TAG, "path too long");
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    if (s_list_next >= s_list_num)
+    {
+        s_list_num = 0;             /* 已播完的列表,从头开始 */
+        s_list_next = 0;
+    }
+
+    if (s_list_num >= AUDIO_ENGINE_PLAYLIST_MAX)
+    {
+        xSemaphoreGive(s_lock);
+        return ESP_ERR_NO_MEM;
+    }
+
+    strcpy(s_playlist[s_list_num++], path);
+
+    xEventGroupClearBits(s_events, ENGINE_IDLE_BIT);
+    engine_feed();                  /* 没有预备曲目时交给播放器,空闲时直接开始播放 */
+
+    xSemaphoreGive(s_lock);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief       替换播放列表并从第一首开始播放
+ * @param       paths : 文件路径数组
+ * @param       num   : 曲目数
+ * @retval      ESP_OK:成功; 其他:失败
+ */
+esp_err_t audio_engine_playlist(const char *const *paths, uint16_t num)
+{
+    ESP_RETURN_ON_FALSE(paths && num, ESP_ERR_INVALID_ARG, TAG, "empty playlist");
+
+    for (uint16_t i = 0; i < num; i++)
+    {
+        if (audio_engine_play(paths[i]) == ESP_OK)
+        {
+            /* 第一首已开始,剩余曲目由播放器回调逐首预备 */
+            for (i++; i < num; i++)
+            {
+                if (audio_engine_enqueue(paths[i]) != ESP_OK)
+                {
+                    ESP_LOGW(TAG, "playlist full, %d tracks dropped", num - i);
+                    break;
+                }
+            }
+
+            return ESP_OK;
+        }
+    }
+
+    return ESP_ERR_NOT_FOUND;
+}
+
+/**
+ * @brief       停止播放并清空播放列表
+ * @param       无
+ * @retval      ESP_OK:成功; 其他:失败
+ */
+esp_err_t audio_engine_stop(void)
+{
+    if (!s_running)
+    {
+        return ESP_OK;
+    }
+
+    engine_clear_list();
+    audio_mixer_input_flush(s_music);   /* 丢弃混音器中尚未播放的音乐 */
+    return audio_player_stop();
+}
+
+/**
+ * @brief       等待播放列表播放完成
+ * @param       timeout_ms : 超时时间(ms)
+ * @retval      ESP_OK:已空闲; ESP_ERR_TIMEOUT:超时
+ */
+esp_err_t audio_engine_wait_idle(uint32_t timeout_ms)
+{
+    if (!s_running)
+    {
+        return ESP_OK;
+    }
+
+    TickType_t ticks = (timeout_ms == portMAX_DELAY) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+    EventBits_t bits = xEventGroupWaitBits(s_events, ENGINE_IDLE_BIT, pdFALSE, pdTRUE, ticks);
+
+    return (bits & ENGINE_IDLE_BIT) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+/**
+ * @brief       停止MP3播放,由调用者直接向音乐输入写入16位PCM(WAV播放)
+ * @note        数据与MP3一样经过混音器,提示音、压低和音量照常生效;
+ *              采样率与输出不同时按AUDIO_ENGINE_FIXED_RATE的设置重采样或修改I2S时钟
+ * @param       rate     : 采样率
+ * @param       channels : 声道数,1或2
+ * @retval      ESP_OK:成功; 其他:失败
+ */
+esp_err_t audio_engine_music_open(uint32_t rate, uint8_t channels)
+{
+    ESP_RETURN_ON_ERROR(audio_engine_init(), TAG, "engine init failed");
+
+    audio_engine_stop();
+    ESP_RETURN_ON_ERROR(audio_engine_wait_idle(AUDIO_ENGINE_STOP_MS), TAG, "player did not stop");
+
+    return engine_player_format(rate, 16, channels == 1 ? I2S_SLOT_MODE_MONO : I2S_SLOT_MODE_STEREO);
+}
+
+/**
+ * @brief       向音乐输入写入PCM,缓冲区满时阻塞
+ * @param       pcm : 数据,格式由audio_engine_music_open设置
+ * @param       len : 字节数,只写入整帧
+ * @retval      ESP_OK:成功; 其他:失败(引擎已释放)
+ */
+esp_err_t audio_engine_music_write(const void *pcm, size_t len)
+{
+    return audio_mixer_write(s_music, pcm, len, NULL, portMAX_DELAY);
+}
+
+/**
+ * @brief       音乐输入暂时或全部写完
+ * @param       discard : true:丢弃尚未播放的数据(停止); false:播完已写入的数据(暂停或结束)
+ * @retval      无
+ */
+void audio_engine_music_end(bool discard)
+{
+    if (!s_running)
+    {
+        return;
+    }
+
+    if (discard)
+    {
+        audio_mixer_input_flush(s_music);
+    }
+    else
+    {
+        audio_mixer_input_drain(s_music);   /* 最后不满一块不算欠载 */
+    }
+}
+
+/**
+ * @brief       为本地MP3文件建立定位索引,保存为曲目旁的"<path>.idx"
+ * @note        有Xing/VBRI目录的文件立即完成,否则需读一遍整个文件的帧头,
+ *              长文件可在后台任务中提前调用;文件大小变化后索引自动失效,需重新建立;
+ *              先写入"<path>.idx~",完成后改名,建立期间打开曲目不会读到不完整的索引
+ * @param       path : 文件路径
+ * @retval      ESP_OK:成功; ESP_ERR_NOT_SUPPORTED:不是MP3文件; 其他:失败
+ */
+esp_err_t audio_engine_index(const char *path)
+{
+    ESP_RETURN_ON_FALSE(strlen(path) < AUDIO_ENGINE_PATH_LEN, ESP_ERR_INVALID_ARG, TAG, "path too long");
+
+    char idx[AUDIO_ENGINE_PATH_LEN + sizeof(AUDIO_ENGINE_INDEX_EXT)];
+    char tmp[sizeof(idx) + 1];
+    engine_index_path(path, idx);
+    snprintf(tmp, sizeof(tmp), "%s~", idx);
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    FILE *index_fp = fopen(tmp, "wb");
+    if (!index_fp)
+    {
+        fclose(fp);
+        return ESP_FAIL;
+    }
+
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = audio_player_mp3_index(fp, index_fp);
+
+    fclose(fp);
+    if (fclose(index_fp) != 0 && ret == ESP_OK)
+    {
+        ret = ESP_FAIL;
+    }
+
+    if (ret != ESP_OK)
+    {
+        unlink(tmp);                /* 不留下不完整的索引 */
+        return ret;
+    }
+
+    unlink(idx);                    /* FatFs改名时目标不能存在 */
+
+    if (rename(tmp, idx) != 0)
+    {
+        unlink(tmp);
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "indexed %s in %lu ms", path, (uint32_t)((esp_timer_get_time() - start) / 1000));
+    return ESP_OK;
+}
+
+/**
+ * @brief       移动当前曲目的播放位置
+ * @note        暂停时也可使用,仍保持暂停;混音器中尚未播放的旧数据被丢弃
+ * @param       position_ms : 位置(ms)
+ * @retval      ESP_OK:成功; 其他:失败
+ */
+esp_err_t audio_engine_seek(uint32_t position_ms)
+{
+    ESP_RETURN_ON_FALSE(s_running, ESP_ERR_INVALID_STATE, TAG, "engine not running");
+    ESP_RETURN_ON_ERROR(audio_player_seek(position_ms), TAG, "seek request failed");
+
+    audio_mixer_input_flush(s_music);
+    return ESP_OK;
+}
+
+/**
+ * @brief       得到当前曲目的播放位置
+ * @param       无
+ * @retval      位置(ms),空闲时为0
+ */
+uint32_t audio_engine_get_position(void)
+{
+    return s_running ? audio_player_get_position_ms() : 0;
+}
+
+/**
+ * @brief       得到当前曲目的时长
+ * @param       无
+ * @retval      时长(ms),未知时为0
+ */
+uint32_t audio_engine_get_duration(void)
+{
+    return s_running ? audio_player_get_duration_ms() : 0;
+}
+
+/**
+ * @brief       最近一次立即播放从请求到第一块数据写入I2S DMA的时间
+ * @note        包括打开文件、(引擎未初始化时)初始化I2S和ES8388、识别格式和解码第一帧
+ * @param       无
+ * @retval      延迟(us); 0:还没有测得
+ */
+uint32_t audio_engine_get_start_latency(void)
+{
+    return s_lat_us;
+}
+
+/**
+ * @brief       把正在播放的曲目和位置保存到NVS,供重启后续播
+ * @note        播放长音频时可定时调用,或在暂停、关机前调用
+ * @param       无
+ * @retval      ESP_OK:成功; ESP_ERR_INVALID_STATE:没有正在播放的本地曲目; 其他:失败
+ */
+esp_err_t audio_engine_bookmark_save(void)
+{
+    char path[AUDIO_ENGINE_PATH_LEN];
+    nvs_handle_t nvs;
+
+    ESP_RETURN_ON_FALSE(s_running, ESP_ERR_INVALID_STATE, TAG, "engine not running");
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    strcpy(path, s_now_path);
+    xSemaphoreGive(s_lock);
+
+    uint32_t position = audio_player_get_position_ms();
+    ESP_RETURN_ON_FALSE(path[0] && strncmp(path, "http://", 7) != 0, ESP_ERR_INVALID_STATE, TAG, "nothing to bookmark");
+
+    ESP_RETURN_ON_ERROR(nvs_open(AUDIO_ENGINE_NVS_NAMESPACE, NVS_READWRITE, &nvs), TAG, "nvs open failed");
+    esp_err_t ret = nvs_set_str(nvs, "path", path);
+
+    if (ret == ESP_OK)
+    {
+        ret = nvs_set_u32(nvs, "pos", position);
+    }
+
+    if (ret == ESP_OK)
+    {
+        ret = nvs_commit(nvs);
+    }
+
+    nvs_close(nvs);
+    return ret;
+}
+
+/**
+ * @brief       从NVS中保存的曲目和位置继续播放
+ * @param       无
+ * @retval      ESP_OK:成功; ESP_ERR_NOT_FOUND:没有保存的位置; 其他:失败
+ */
+esp_err_t audio_engine_resume(void)
+{
+    char path[AUDIO_ENGINE_PATH_LEN];
+    size_t len = sizeof(path);
+    uint32_t position = 0;
+    nvs_handle_t nvs;
+
+    if (nvs_open(AUDIO_ENGINE_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    esp_err_t ret = nvs_get_str(nvs, "path", path, &len);
+
+    if (ret == ESP_OK)
+    {
+        ret = nvs_get_u32(nvs, "pos", &position);
+    }
+
+    nvs_close(nvs);
+
+    if (ret != ESP_OK)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    ESP_LOGI(TAG, "resume %s at %lu ms", path, position);
+    return audio_engine_play_at(path, position);
+}
+
+/**
+ * @brief       设置音乐音量
+ * @note        在混音器中渐变生效,不影响提示音;ES8388的输出音量保持不变
+ * @param       volume : 音量,0~100
+ * @retval      ESP_OK:成功; 其他:失败
+ */
+esp_err_t audio_engine_set_volume(uint8_t volume)
+{
+    ESP_RETURN_ON_ERROR(audio_engine_init(), TAG, "engine init failed");
+
+    if (volume > 100)
+    {
+        volume = 100;
+    }
+
+    audio_mixer_set_gain(s_music, (uint32_t)volume * AUDIO_MIXER_GAIN_UNITY / 100);
+    return ESP_OK;
+}
+
+/**
+ * @brief       播放提示音,叠加在音乐上,音乐在提示音期间自动压低
+ * @note        数据写入混音器后返回,不等待播放完成;提示音输入同一时间只能由一个任务写入
+ * @param       freq_hz     : 频率(Hz)
+ * @param       duration_ms : 时长(ms)
+ * @retval      ESP_OK:成功; 其他:失败
+ */
+esp_err_t audio_engine_beep(uint16_t freq_hz, uint16_t duration_ms)
+{
+    ESP_RETURN_ON_ERROR(audio_engine_init(), TAG, "engine init failed");
+    ESP_RETURN_ON_ERROR(audio_mixer_input_set_format(s_prompt, 16, 2), TAG, "invalid prompt format");
+    ESP_RETURN_ON_ERROR(audio_mixer_input_set_rate(s_prompt, 0), TAG, "invalid prompt rate");
+
+    int16_t buf[AUDIO_ENGINE_BEEP_CHUNK * 2];
+    uint32_t rate = audio_mixer_get_rate();
+    uint32_t frames = (uint32_t)duration_ms * rate / 1000;
+    uint32_t fade = AUDIO_ENGINE_BEEP_FADE_MS * rate / 1000;   /* 首尾淡入淡出,避免爆音 */
+    float step = 2.0f * (float)M_PI * freq_hz / rate;
+
+    if (fade > frames / 2)
+    {
+        fade = frames / 2;
+    }
+
+    for (uint32_t done = 0; done < frames; )
+    {
+        uint32_t n = frames - done;
+
+        if (n > AUDIO_ENGINE_BEEP_CHUNK)
+        {
+            n = AUDIO_ENGINE_BEEP_CHUNK;
+        }
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            uint32_t pos = done + i;
+            uint32_t edge = (pos < frames - pos) ? pos : frames - pos;
+            float amp = AUDIO_ENGINE_BEEP_AMP * ((edge < fade) ? (float)edge / fade : 1.0f);
+            int16_t v = (int16_t)(amp * sinf(step * pos));
+
+            buf[2 * i] = v;
+            buf[2 * i + 1] = v;
+        }
+
+        ESP_RETURN_ON_ERROR(audio_mixer_write(s_prompt, buf, n * 4, NULL, portMAX_DELAY), TAG, "beep write failed");
+        done += n;
+    }
+
+    audio_mixer_input_drain(s_prompt);
+    return ESP_OK;
+}
+
+/**
+ * @brief       写入提示音PCM数据,叠加在音乐上播放
+ * @note        采样率与混音器输出不同时自动重采样;缓冲区满时阻塞
+ * @param       pcm      : 16位PCM数据
+ * @param       frames   : 帧数
+ * @param       channels : 声道数,1或2
+ * @param       rate     : 采样率
+ * @retval      ESP_OK:成功; 其他:失败
+ */
+esp_err_t audio_engine_prompt_pcm(const int16_t *pcm, size_t frames, uint8_t channels, uint32_t rate)
+{
+    ESP_RETURN_ON_ERROR(audio_engine_init(), TAG, "engine init failed");
+    ESP_RETURN_ON_ERROR(audio_mixer_input_set_format(s_prompt, 16, channels), TAG, "invalid prompt format");
+    ESP_RETURN_ON_ERROR(audio_mixer_input_set_rate(s_prompt, rate), TAG, "invalid prompt rate");
+
+    return audio_mixer_write(s_prompt, pcm, frames * channels * sizeof(int16_t), NULL, portMAX_DELAY);
+}
+
+/* 一次提示音播放 */
+typedef struct
+{
+    int64_t request_us;             /* 播放请求的时间 */
+    int64_t start_us;               /* 第一块数据写入混音器的时间,0:尚未写入 */
+} engine_prompt_t;
+
+/**
+ * @brief       把提示音PCM写入混音器,记录第一块的写入时间
+ */
+static esp_err_t engine_prompt_write(const int16_t *pcm, size_t frames, uint8_t channels, uint32_t sample_rate, void *ctx)
+{
+    engine_prompt_t *prompt = (engine_prompt_t *)ctx;
+    esp_err_t ret = audio_engine_prompt_pcm(pcm, frames, channels, sample_rate);
+
+    if (prompt->start_us == 0)
+    {
+        prompt->start_us = esp_timer_get_time();
+    }
+
+    return ret;
+}
+
+/**
+ * @brief       播放语音提示文件
+ * @param       path       : 文件路径
+ * @param       latency_us : 返回从请求到第一块数据写入混音器的时间,可为NULL
+ * @retval      ESP_OK:成功; 其他:失败
+ */
+static esp_err_t engine_prompt_play(const char *path, int64_t *latency_us)
+{
+    engine_prompt_t prompt = {
+        .request_us = esp_timer_get_time(),
+    };
+    esp_err_t ret = ESP_OK;
+    prompt_clip_t *clip = prompt_cache_lookup(path);
+
+    if (clip)
+    {
+        /* 按混音块写入,第一块不用等缓冲区中的数据被混音 */
+        for (size_t done = 0, n; done < clip->frames && ret == ESP_OK; done += n)
+        {
+            n = clip->frames - done;
+
+            if (n > AUDIO_MIXER_BLOCK_FRAMES)
+            {
+                n = AUDIO_MIXER_BLOCK_FRAMES;
+            }
+
+            ret = engine_prompt_write(clip->pcm + done * clip->channels, n, clip->channels, clip->rate, &prompt);
+        }
+
+        prompt_cache_release(clip);
+    }
+    else
+    {
+        ret = prompt_cache_load(path, engine_prompt_write, &prompt, NULL);  /* 边解码边播放,同时填充缓存 */
+    }
+
+    audio_mixer_input_drain(s_prompt);      /* 提示音结尾不满一块不算欠载 */
+
+    if (latency_us)
+    {
+        *latency_us = prompt.start_us ? prompt.start_us - prompt.request_us : -1;
+    }
+
+    return ret;
+}
+
+/**
+ * @brief       播放语音提示文件,叠加在音乐上,音乐在提示音期间自动压低
+ * @note        第一次播放时边解码边播放,短于PROMPT_CACHE_CLIP_MAX的文件解码后的PCM保存在PSRAM中,
+ *              之后直接从缓存写入混音器,不再打开文件;可用prompt_cache_preload在开机时预先解码.
+ *              数据全部写入混音器后返回,提示音输入同一时间只能由一个任务写入
+ * @param       path : 文件路径(如"/spiffs/test.mp3")
+ * @retval      ESP_OK:成功; 其他:失败
+ */
+esp_err_t audio_engine_prompt(const char *path)
+{
+    ESP_RETURN_ON_ERROR(audio_engine_init(), TAG, "engine init failed");
+
+    return engine_prompt_play(path, NULL);
+}
+
+/* 压力测试的后台下载 */
+typedef struct
+{
+    const char *url;
+    volatile bool stop;
+    uint32_t bytes;
+    SemaphoreHandle_t done;
+} engine_load_t;
+
+/**
+ * @brief       压力测试的下载任务,循环下载url直到被停止
+ */
+static void engine_load_task(void *pvParameters)
+{
+    engine_load_t *load = (engine_load_t *)pvParameters;
+    uint8_t *buf = malloc(HTTP_STREAM_CHUNK);
+
+    while (buf && !load->stop)
+    {
+        http_stream_t *stream = http_stream_open(load->url);
+        if (!stream)
+        {
+            vTaskDelay(pdMS_TO_TICKS(500));
+            continue;
+        }
+
+        int len;
+        while (!load->stop && (len = http_stream_read(stream, buf, HTTP_STREAM_CHUNK)) > 0)
+        {
+            load->bytes += len;
+        }
+
+        http_stream_close(stream);
+    }
+
+    free(buf);
+    xSemaphoreGive(load->done);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief       核心分配压力测试
+ * @note        依次按几种核心分配播放path,同时在后台循环下载url并每100ms发送一帧红外码,
+ *              打印每种分配下的欠载次数:I2S DMA欠载(可听见的断音,需打开CONFIG_AUDIO_PROF_ENABLE)、
+ *              混音器音乐输入欠载(解码跟不上)和SD卡预读欠载(读卡跟不上).
+ *              需先初始化WiFi、SD卡和红外发送;测试结束后恢复默认分配
+ * @param       path        : 本地曲目
+ * @param       url         : 下载地址,可配合PC上的"python3 -m http.server 8000"使用
+ * @param       duration_ms : 每种分配的测试时间
+ * @retval      ESP_OK:成功; 其他:失败
+ */
+esp_err_t audio_engine_stress_test(const char *path, const char *url, uint32_t duration_ms)
+{
+    static const struct
+    {
+        const char *name;
+        audio_engine_placement_t place;
+    } cases[] = {
+        {"all core 0", {0, AUDIO_ENGINE_IO_PRIO, 0, AUDIO_ENGINE_DECODE_PRIO, 0, AUDIO_ENGINE_OUTPUT_PRIO}},
+        {"all core 1", {1, AUDIO_ENGINE_IO_PRIO, 1, AUDIO_ENGINE_DECODE_PRIO, 1, AUDIO_ENGINE_OUTPUT_PRIO}},
+        {"unpinned", {tskNO_AFFINITY, AUDIO_ENGINE_IO_PRIO, tskNO_AFFINITY, AUDIO_ENGINE_DECODE_PRIO,
+                      tskNO_AFFINITY, AUDIO_ENGINE_OUTPUT_PRIO}},
+        {"split", {AUDIO_ENGINE_IO_CORE, AUDIO_ENGINE_IO_PRIO, AUDIO_ENGINE_DECODE_CORE, AUDIO_ENGINE_DECODE_PRIO,
+                   AUDIO_ENGINE_OUTPUT_CORE, AUDIO_ENGINE_OUTPUT_PRIO}},
+    };
+    esp_err_t ret = ESP_OK;
+
+    for (int i = 0; i < sizeof(cases) / sizeof(cases[0]) && ret == ESP_OK; i++)
+    {
+        audio_mixer_stats_t stats;
+        engine_load_t load = {
+            .url = url,
+            .done = xSemaphoreCreateBinary(),
+        };
+
+        ESP_RETURN_ON_FALSE(load.done, ESP_ERR_NO_MEM, TAG, "no memory");
+        audio_engine_set_placement(&cases[i].place);
+
+        ret = audio_engine_play(path);
+        if (ret != ESP_OK)
+        {
+            vSemaphoreDelete(load.done);
+            break;
+        }
+
+        audio_prof_reset();
+        s_io_underruns = 0;
+
+        if (xTaskCreate(engine_load_task, "engine_load", 4096, &load, 5, NULL) != pdPASS)
+        {
+            vSemaphoreDelete(load.done);
+            ret = ESP_ERR_NO_MEM;
+            break;
+        }
+
+        uint32_t ir_frames = 0;
+
+        for (uint32_t t = 0; t < duration_ms; t += 100)
+        {
+            vTaskDelay(pdMS_TO_TICKS(100));
+            rmt_send_nec(0x00FF, ir_frames++ & 0xFF);
+
+            if (audio_engine_wait_idle(0) == ESP_OK)
+            {
+                audio_engine_play(path);    /* 曲目短于测试时间时重新播放 */
+            }
+        }
+
+        audio_mixer_get_stats(&stats);
+        audio_engine_stop();
+        audio_engine_wait_idle(1000);       /* 文件关闭后才能统计预读欠载 */
+
+        load.stop = true;
+        xSemaphoreTake(load.done, portMAX_DELAY);
+        vSemaphoreDelete(load.done);
+
+        ESP_LOGI(TAG, "%-10s dma underruns %lu, decode underruns %lu, sd underruns %lu, downloaded %lu KB, ir frames %lu",
+                 cases[i].name, audio_prof_get_count(AUDIO_PROF_UNDERRUNS), stats.underruns, s_io_underruns,
+                 load.bytes / 1024, ir_frames);
+    }
+
+    audio_engine_placement_t defaults = {
+        AUDIO_ENGINE_IO_CORE, AUDIO_ENGINE_IO_PRIO, AUDIO_ENGINE_DECODE_CORE, AUDIO_ENGINE_DECODE_PRIO,
+        AUDIO_ENGINE_OUTPUT_CORE, AUDIO_ENGINE_OUTPUT_PRIO,
+    };
+    audio_engine_set_placement(&defaults);
+
+    return ret;
+}
+
+/**
+ * @brief       提示音延迟测试
+ * @note        清空提示音缓存后播放path一次(解码并填充缓存),再从缓存播放几次,
+ *              打印从请求到第一块数据写入混音器的时间
+ * @param       path : 提示音文件
+ * @retval      ESP_OK:已缓存的提示音在AUDIO_ENGINE_PROMPT_START_US内开始; ESP_ERR_TIMEOUT:超过;
+ *              其他:失败
+ */
+esp_err_t audio_engine_prompt_test(const char *path)
+{
+    int64_t cold_us, warm_us, worst_us = 0;
+    prompt_cache_stats_t stats;
+
+    ESP_RETURN_ON_ERROR(audio_engine_init(), TAG, "engine init failed");
+
+    prompt_cache_clear();
+    ESP_RETURN_ON_ERROR(engine_prompt_play(path, &cold_us), TAG, "prompt failed");
+
+    for (int i = 0; i < 5; i++)
+    {
+        while (audio_mixer_input_busy(s_prompt))    /* 上一次播完,不用等缓冲区 */
+        {
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+
+        ESP_RETURN_ON_ERROR(engine_prompt_play(path, &warm_us), TAG, "prompt failed");
+
+        if (warm_us > worst_us)
+        {
+            worst_us = warm_us;
+        }
+    }
+
+    prompt_cache_get_stats(&stats);
+    ESP_LOGI(TAG, "prompt %s: first play %lld us, cached %lld us (worst of 5), cache %u clips %u/%u bytes",
+             path, cold_us, worst_us, stats.clips, (unsigned)stats.bytes, (unsigned)stats.budget);
+
+    if (stats.clips == 0)
+    {
+        ESP_LOGW(TAG, "%s was not cached", path);
+    }
+
+    return (worst_us <= AUDIO_ENGINE_PROMPT_START_US) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+/**
+ * @brief       测量一次立即播放的启动延迟
+ */
+static esp_err_t engine_measure_start(const char *path, uint32_t *latency_us, uint32_t *reg_writes)
+{
+    uint32_t writes_before, writes_after;
+
+    s_lat_us = 0;
+    es8388_get_reg_stats(&writes_before, NULL);
+    ESP_RETURN_ON_ERROR(audio_engine_play(path), TAG, "play failed");
+
+    for (int i = 0; i < 200 && s_lat_us == 0; i++)
+    {
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+
+    es8388_get_reg_stats(&writes_after, NULL);
+    *latency_us = s_lat_us;
+    *reg_writes = writes_after - writes_before;
+
+    audio_engine_stop();
+    audio_engine_wait_idle(1000);
+
+    return (*latency_us) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+/**
+ * @brief       启动延迟测试
+ * @note        先按原来的方式播放一次:释放引擎并使ES8388寄存器缓存失效,播放时重新初始化I2S、
+ *              混音器、播放器任务并写入全部编解码器配置;再在常驻的引擎上播放几次.
+ *              打印两种情况下从请求到第一块数据写入I2S DMA的时间和ES8388寄存器写次数
+ * @param       path : 测试曲目
+ * @retval      ESP_OK:成功; 其他:失败
+ */
+esp_err_t audio_engine_latency_test(const char *path)
+{
+    uint32_t cold_us, cold_writes, warm_us, warm_writes, worst_us = 0, total_us = 0;
+
+    audio_engine_deinit();
+    es8388_cache_invalidate();
+    ESP_RETURN_ON_ERROR(engine_measure_start(path, &cold_us, &cold_writes), TAG, "cold start failed");
+
+    for (int i = 0; i < 5; i++)
+    {
+        ESP_RETURN_ON_ERROR(engine_measure_start(path, &warm_us, &warm_writes), TAG, "warm start failed");
+        total_us += warm_us;
+
+        if (warm_us > worst_us)
+        {
+            worst_us = warm_us;
+        }
+    }
+
+    ESP_LOGI(TAG, "start latency %s: cold %lu us (%lu codec writes), warm avg %lu us worst %lu us (%lu codec writes)",
+             path, cold_us, cold_writes, total_us / 5, worst_us, warm_writes);
+
+    return ESP_OK;
+}
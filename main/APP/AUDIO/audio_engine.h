@@ -0,0 +1,92 @@
+/**
+ ****************************************************************************************************
+ * @file        audio_engine.h
+ ****************************************************************************************************
+ */
+
+#ifndef __AUDIO_ENGINE_H
+#define __AUDIO_ENGINE_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "audio_player.h"
+#include "audio_mixer.h"
+#include "myi2s.h"
+#include "es8388.h"
+#include "xl9555.h"
+
+/* 流水线各级的默认核心和优先级:I/O级与WiFi/LwIP同在核心0,解码和输出在核心1 */
+#define AUDIO_ENGINE_IO_CORE        0       /* I/O级(SD卡预读,HTTP下载)所在核心 */
+#define AUDIO_ENGINE_IO_PRIO        6       /* I/O级优先级,高于解码,读卡和收包都很快让出CPU */
+#define AUDIO_ENGINE_DECODE_CORE    1       /* 解码级(播放器任务)所在核心 */
+#define AUDIO_ENGINE_DECODE_PRIO    5       /* 解码级优先级 */
+#define AUDIO_ENGINE_OUTPUT_CORE    1       /* 输出级(混音,写I2S)所在核心 */
+#define AUDIO_ENGINE_OUTPUT_PRIO    6       /* 输出级优先级,高于解码 */
+#define AUDIO_ENGINE_PLAYLIST_MAX   32      /* 播放列表最大曲目数 */
+#define AUDIO_ENGINE_PATH_LEN       128     /* 曲目路径最大长度 */
+#define AUDIO_ENGINE_FIXED_RATE     48000   /* I2S和ES8388固定的采样率,曲目采样率不同时重采样;
+                                               与录音(REC_SAMPLE_RATE)和麦克风实时流(MIC_STREAM_RATE)相同,
+                                               开始采集时不用停止播放引擎;
+                                               0:每首曲目按其采样率重新配置I2S时钟,采集时播放引擎要让出I2S */
+#define AUDIO_ENGINE_RESAMPLE_QUALITY   RESAMPLER_QUALITY_MEDIUM    /* 重采样质量 */
+#define AUDIO_ENGINE_MUSIC_BUF      (16 * 1024)     /* 混音器音乐输入缓冲区,48kHz约85ms */
+#define AUDIO_ENGINE_PROMPT_BUF     (8 * 1024)      /* 混音器提示音输入缓冲区 */
+#define AUDIO_ENGINE_RAMP_MS        30      /* 音量和压低的渐变时间 */
+#define AUDIO_ENGINE_DUCK_GAIN      6554    /* 提示音播放时音乐的增益(Q15,0.2约-14dB) */
+#define AUDIO_ENGINE_BEEP_CHUNK     128     /* 生成提示音时每次写入的帧数 */
+#define AUDIO_ENGINE_BEEP_FADE_MS   5       /* 提示音淡入淡出时间 */
+#define AUDIO_ENGINE_BEEP_AMP       12000   /* 提示音幅度 */
+#define AUDIO_ENGINE_PROMPT_START_US    5000    /* 已缓存的提示音从请求到写入混音器的目标时间 */
+#define AUDIO_ENGINE_STOP_MS        500     /* 交出音乐输入前等待MP3播放器停止的最长时间 */
+#define AUDIO_ENGINE_INDEX_EXT      ".idx"  /* MP3定位索引文件的扩展名,保存在曲目旁 */
+#define AUDIO_ENGINE_INDEX_PRIO     1       /* 后台建立定位索引的任务优先级,低于预读,只用空闲的读卡时间 */
+#define AUDIO_ENGINE_INDEX_STACK    4096    /* 后台建立定位索引的任务堆栈大小 */
+#define AUDIO_ENGINE_NVS_NAMESPACE  "audio" /* 断点续播保存在NVS中的命名空间 */
+
+/* 流水线各级任务的核心和优先级,各级之间是有界缓冲区:
+ * I/O级 -> 预读/抖动缓冲区 -> 解码级 -> 混音器输入缓冲区 -> 输出级 -> I2S DMA */
+typedef struct
+{
+    BaseType_t io_core;             /* I/O级所在核心 */
+    UBaseType_t io_prio;            /* I/O级优先级 */
+    BaseType_t decode_core;         /* 解码级所在核心 */
+    UBaseType_t decode_prio;        /* 解码级优先级 */
+    BaseType_t output_core;         /* 输出级所在核心 */
+    UBaseType_t output_prio;        /* 输出级优先级 */
+} audio_engine_placement_t;
+
+/* 函数声明 */
+esp_err_t audio_engine_init(void);                                      /* 初始化常驻音频引擎(I2S + ES8388 + 播放器) */
+void audio_engine_deinit(void);                                         /* 释放音频引擎,归还I2S */
+bool audio_engine_is_running(void);                                     /* 音频引擎是否已初始化 */
+esp_err_t audio_engine_set_placement(const audio_engine_placement_t *placement);  /* 设置各级核心和优先级,下次初始化时生效 */
+void audio_engine_get_placement(audio_engine_placement_t *placement);   /* 获取各级核心和优先级 */
+esp_err_t audio_engine_play_fp(FILE *fp);                               /* 立即播放已打开的文件 */
+esp_err_t audio_engine_play(const char *path);                          /* 立即播放,清空播放列表(path可为http://URL) */
+esp_err_t audio_engine_play_at(const char *path, uint32_t position_ms); /* 从指定位置开始播放 */
+esp_err_t audio_engine_enqueue(const char *path);                       /* 追加到播放列表,无缝衔接(path可为http://URL) */
+esp_err_t audio_engine_playlist(const char *const *paths, uint16_t num);/* 替换播放列表并开始播放 */
+esp_err_t audio_engine_stop(void);                                      /* 停止播放并清空播放列表 */
+esp_err_t audio_engine_wait_idle(uint32_t timeout_ms);                  /* 等待播放列表播完 */
+esp_err_t audio_engine_music_open(uint32_t rate, uint8_t channels);     /* 停止MP3,由调用者写入音乐输入(16位PCM) */
+esp_err_t audio_engine_music_write(const void *pcm, size_t len);        /* 写入音乐输入,缓冲区满时阻塞 */
+void audio_engine_music_end(bool discard);                              /* 音乐输入写完,discard:丢弃未播放的数据 */
+esp_err_t audio_engine_index(const char *path);                         /* 为MP3文件建立定位索引"<path>.idx" */
+esp_err_t audio_engine_seek(uint32_t position_ms);                      /* 移动当前曲目的播放位置 */
+uint32_t audio_engine_get_position(void);                               /* 当前曲目的播放位置(ms) */
+uint32_t audio_engine_get_duration(void);                               /* 当前曲目的时长(ms),未知时为0 */
+uint32_t audio_engine_get_start_latency(void);                          /* 最近一次播放请求到第一块数据写入DMA的时间(us) */
+esp_err_t audio_engine_bookmark_save(void);                             /* 保存播放位置到NVS */
+esp_err_t audio_engine_resume(void);                                    /* 从NVS保存的位置继续播放 */
+esp_err_t audio_engine_set_volume(uint8_t volume);                      /* 设置音乐音量(0~100) */
+esp_err_t audio_engine_beep(uint16_t freq_hz, uint16_t duration_ms);    /* 播放提示音,音乐自动压低 */
+esp_err_t audio_engine_prompt_pcm(const int16_t *pcm, size_t frames, uint8_t channels, uint32_t rate); /* 播放语音提示PCM,音乐自动压低 */
+esp_err_t audio_engine_prompt(const char *path);                        /* 播放语音提示文件,解码后的PCM缓存在PSRAM中 */
+
+/* 测试 */
+esp_err_t audio_engine_stress_test(const char *path, const char *url, uint32_t duration_ms); /* 各种核心分配下边下载边播放的欠载次数 */
+esp_err_t audio_engine_latency_test(const char *path);                  /* 每次初始化和常驻引擎两种情况下的启动延迟 */
+esp_err_t audio_engine_prompt_test(const char *path);                   /* 未缓存和已缓存的提示音开始播放的延迟 */
+
+#endif
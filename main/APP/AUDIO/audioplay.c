@@ -5,19 +5,20 @@
  */
 
 #include "audioplay.h"
+#include "audio_engine.h"
 
 
 __audiodev g_audiodev;          /* ֲſ */
 
 /**
  * @brief       ʼƵ
+ * @note        I2SڴTXڼһֱ,¼ͬʱʹ
  * @param       
  * @retval      
  */
 void audio_start(void)
 {
     g_audiodev.status = 3 << 0;
-    i2s_trx_start();
 }
 
 /**
@@ -28,7 +29,6 @@ void audio_start(void)
 void audio_stop(void)
 {
     g_audiodev.status = 0;
-    i2s_trx_stop();
 }
 
 /**
@@ -292,6 +292,41 @@ void audio_play(void)
     free(wavoffsettbl);
 }
 
+/**
+ * @brief       Ƶ沥MP3/FLACļ
+ * @note        ڲн,ֻɨ谴ˢ²ʱ
+ * @param       fname : ļ·+ļ(FatFs·,"0:/MP3/xxx.flac")
+ * @retval      KEY0_PRES : һ
+ *              KEY1_PRES : һ
+ */
+static uint8_t audio_engine_play_song(uint8_t *fname)
+{
+    char path[AUDIO_ENGINE_PATH_LEN];
+    uint8_t key;
+
+    snprintf(path, sizeof(path), "/%s", (char *)fname);         /* FatFs·תΪVFS· */
+
+    if (audio_engine_play(path) != ESP_OK)
+    {
+        return KEY0_PRES;                                       /* ʧ,һ */
+    }
+
+    while (audio_engine_wait_idle(10) != ESP_OK)                /* ÿ10msɨһΰ */
+    {
+        key = xl9555_key_scan(0);
+
+        if (key == KEY0_PRES || key == KEY1_PRES)               /* һ/һ */
+        {
+            audio_engine_stop();
+            return key;
+        }
+
+        audio_msg_show(audio_engine_get_duration() / 1000, audio_engine_get_position() / 1000, 0);
+    }
+
+    return KEY0_PRES;                                           /* Ž,һ */
+}
+
 /**
  * @brief       ĳƵļ
  * @param       fname : ļ
@@ -312,9 +347,9 @@ uint8_t audio_play_song(uint8_t *fname)
             res = wav_play_song(fname);
             break;
         case T_MP3:
-        {
+        case T_FLAC:
+            res = audio_engine_play_song(fname);
             break;
-        }
 
         default:            /* ļ,Զתһ */
             ESP_LOGE("Audioplay","can't play:%s\r\n", fname);
@@ -0,0 +1,494 @@
+/**
+ ****************************************************************************************************
+ * @file        file_stream.c
+ * @brief       SD卡预读数据源
+ * @note        读卡放在I/O级任务中,和WiFi/LwIP在同一核心上,解码任务只从环形缓冲区取数据,
+ *              不会被SPI传输阻塞.数据通路用spsc_ring的reserve/commit,I/O任务直接把文件
+ *              读进缓冲区;lock只在I/O任务读文件和读者重新定位时持有,保证重新定位时
+ *              文件位置和缓冲区内容一致.
+ *              SD卡上的文件不经过VFS和stdio缓冲,f_read直接读进缓冲区.缓冲区索引和文件偏移
+ *              对齐(ring的索引就是文件偏移),每次读到FILE_STREAM_READ_MAX的边界,这样除了定位后
+ *              的第一块,每次读的起点和长度都是整扇区,落在同一簇或若干整簇内,FatFs对整扇区
+ *              直接发多块读命令.缓冲区放在可DMA的内部RAM中,SPI驱动不用逐扇区经过中转缓冲区.
+ *              打开时建立FastSeek簇链表,定位和跨簇读取都不用沿FAT表查找
+ ****************************************************************************************************
+ */
+
+#include "file_stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "ff.h"
+#include "spi_sd.h"
+#include "spsc_ring.h"
+
+static const char *TAG = "file_stream";
+
+struct file_stream
+{
+    FIL *fil;                       /* SD卡上的文件,NULL时用fp */
+    DWORD *clmt;                    /* FastSeek簇链表 */
+    FILE *fp;                       /* 其它文件系统上的文件 */
+    uint32_t chunk;                 /* 每次读文件的字节数,2的幂 */
+    spsc_ring_t ring;               /* 预读缓冲区,索引就是文件偏移,读索引对应pos */
+    uint32_t pos;                   /* 读位置(仅读者修改) */
+    int64_t size;                   /* 文件长度 */
+    bool started;                   /* 打开或重新定位后已读到过数据 */
+    uint32_t underruns;             /* 欠载次数 */
+    atomic_bool eof;                /* 已读到文件末尾,failed在此之前写入 */
+    bool failed;                    /* 读文件出错 */
+    volatile bool abort;            /* 请求停止预读 */
+    SemaphoreHandle_t lock;         /* 保护fil/fp和缓冲区写入端 */
+    SemaphoreHandle_t data_sem;     /* 有新数据或读到文件末尾 */
+    SemaphoreHandle_t space_sem;    /* 读者释放了空间或重新定位 */
+    SemaphoreHandle_t exit_sem;     /* I/O任务已退出 */
+};
+
+/**
+ * @brief       释放数据源占用的资源
+ */
+static void file_stream_free(file_stream_t *s)
+{
+    if (s->lock) vSemaphoreDelete(s->lock);
+    if (s->data_sem) vSemaphoreDelete(s->data_sem);
+    if (s->space_sem) vSemaphoreDelete(s->space_sem);
+    if (s->exit_sem) vSemaphoreDelete(s->exit_sem);
+    if (s->fp) fclose(s->fp);
+
+    if (s->fil)
+    {
+        f_close(s->fil);
+        heap_caps_free(s->fil);
+    }
+
+    heap_caps_free(s->clmt);
+    spsc_ring_delete(&s->ring);
+    free(s);
+}
+
+/**
+ * @brief       从当前位置读文件
+ * @param       s   : 数据源
+ * @param       dst : 目标地址
+ * @param       len : 读取长度
+ * @param       err : 返回是否出错
+ * @retval      读到的字节数
+ */
+static size_t file_stream_fill(file_stream_t *s, void *dst, uint32_t len, bool *err)
+{
+    if (s->fil)
+    {
+        UINT n = 0;
+        *err = f_read(s->fil, dst, len, &n) != FR_OK;
+        return n;
+    }
+
+    size_t n = fread(dst, 1, len, s->fp);
+    *err = ferror(s->fp);
+    return n;
+}
+
+/**
+ * @brief       定位文件
+ * @param       s      : 数据源
+ * @param       offset : 文件偏移
+ * @retval      true:成功
+ */
+static bool file_stream_lseek(file_stream_t *s, uint32_t offset)
+{
+    if (s->fil)
+    {
+        return f_lseek(s->fil, offset) == FR_OK;
+    }
+
+    return fseek(s->fp, offset, SEEK_SET) == 0;
+}
+
+#if FF_USE_FASTSEEK
+/**
+ * @brief       建立FastSeek簇链表
+ * @note        链表不够长时f_lseek返回FR_NOT_ENOUGH_CORE并在tbl[0]给出需要的长度,
+ *              按需要的长度再建一次.建立失败时仍可读,定位时沿FAT表查找
+ * @param       s : 数据源
+ * @retval      无
+ */
+static void file_stream_linkmap(file_stream_t *s)
+{
+    DWORD len = FILE_STREAM_CLMT_LEN;
+
+    for (int i = 0; i < 2 && !s->clmt; i++)
+    {
+        DWORD *tbl = heap_caps_malloc(len * sizeof(DWORD), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!tbl)
+        {
+            tbl = heap_caps_malloc(len * sizeof(DWORD), MALLOC_CAP_8BIT);
+        }
+
+        if (!tbl)
+        {
+            break;
+        }
+
+        tbl[0] = len;
+        s->fil->cltbl = tbl;
+
+        FRESULT res = f_lseek(s->fil, CREATE_LINKMAP);
+        if (res == FR_OK)
+        {
+            s->clmt = tbl;
+            break;
+        }
+
+        s->fil->cltbl = NULL;
+        len = tbl[0];
+        heap_caps_free(tbl);
+
+        if (res != FR_NOT_ENOUGH_CORE)
+        {
+            break;
+        }
+    }
+
+    if (!s->clmt)
+    {
+        ESP_LOGW(TAG, "no link map, seeking follows the FAT chain");
+    }
+}
+#endif
+
+/**
+ * @brief       获取SD卡上文件的FatFs路径
+ * @note        挂载点MOUNT_POINT是"/0:",去掉开头的'/'就是FatFs的"0:/..."路径
+ * @param       path : VFS路径
+ * @retval      FatFs路径,指向path内部; NULL:不在SD卡上
+ */
+const char *file_stream_fatfs_path(const char *path)
+{
+    size_t len = strlen(MOUNT_POINT);
+
+    if (strncmp(path, MOUNT_POINT, len) != 0 || path[len] != '/')
+    {
+        return NULL;
+    }
+
+    return path + 1;
+}
+
+/**
+ * @brief       用FatFs打开SD卡上的文件
+ * @param       s    : 数据源
+ * @param       path : FatFs路径
+ * @retval      ESP_OK:成功; ESP_ERR_NO_MEM:内存不足; ESP_FAIL:打开失败
+ */
+static esp_err_t file_stream_open_fatfs(file_stream_t *s, const char *path)
+{
+    /* FIL内有扇区缓冲区,放在可DMA的内存中,不足一扇区的读取也不用中转 */
+    s->fil = heap_caps_calloc(1, sizeof(FIL), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (!s->fil)
+    {
+        s->fil = heap_caps_calloc(1, sizeof(FIL), MALLOC_CAP_8BIT);
+    }
+
+    if (!s->fil)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (f_open(s->fil, path, FA_READ) != FR_OK)
+    {
+        heap_caps_free(s->fil);
+        s->fil = NULL;
+        return ESP_FAIL;
+    }
+
+    s->size = f_size(s->fil);
+    s->chunk = FILE_STREAM_READ_MAX;
+#if FF_USE_FASTSEEK
+    file_stream_linkmap(s);
+#endif
+
+    /* 缓冲区不可DMA时SPI驱动逐扇区经中转缓冲区读取,仍能工作但慢很多 */
+    if (spsc_ring_create(&s->ring, FILE_STREAM_BUF_SIZE, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "no internal DMA memory, buffering in PSRAM");
+
+        if (spsc_ring_create(&s->ring, FILE_STREAM_BUF_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) != ESP_OK)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief       用stdio打开其它文件系统上的文件
+ * @param       s    : 数据源
+ * @param       path : VFS路径
+ * @retval      ESP_OK:成功; ESP_ERR_NO_MEM:内存不足; ESP_FAIL:打开失败
+ */
+static esp_err_t file_stream_open_stdio(file_stream_t *s, const char *path)
+{
+    s->fp = fopen(path, "rb");
+    if (!s->fp)
+    {
+        return ESP_FAIL;
+    }
+
+    fseek(s->fp, 0, SEEK_END);
+    s->size = ftell(s->fp);
+    fseek(s->fp, 0, SEEK_SET);
+    s->chunk = FILE_STREAM_CHUNK;
+
+    if (spsc_ring_create(&s->ring, FILE_STREAM_BUF_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) != ESP_OK &&
+        spsc_ring_create(&s->ring, FILE_STREAM_BUF_SIZE, MALLOC_CAP_8BIT) != ESP_OK)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief       I/O任务,缓冲区空闲一块以上时读到下一个块边界
+ * @note        缓冲区索引就是文件偏移,容量是块的整数倍,读到块边界的区域在缓冲区内总是连续的
+ */
+static void file_stream_task(void *pvParameters)
+{
+    file_stream_t *s = (file_stream_t *)pvParameters;
+
+    while (!s->abort)
+    {
+        if (atomic_load_explicit(&s->eof, memory_order_acquire) || spsc_ring_free(&s->ring) < s->chunk)
+        {
+            xSemaphoreTake(s->space_sem, pdMS_TO_TICKS(100));   /* 等待读者消费或重新定位 */
+            continue;
+        }
+
+        xSemaphoreTake(s->lock, portMAX_DELAY);
+
+        uint32_t pos = atomic_load_explicit(&s->ring.head, memory_order_relaxed);
+        uint32_t chunk = s->chunk - (pos & (s->chunk - 1));     /* 定位后先读到块边界,之后每次读整块 */
+        void *dst = spsc_ring_reserve(&s->ring, &chunk);
+        bool err;
+        size_t len = file_stream_fill(s, dst, chunk, &err);
+
+        if (len)
+        {
+            spsc_ring_commit(&s->ring, len);
+        }
+
+        if (len < chunk)
+        {
+            s->failed = err;
+            atomic_store_explicit(&s->eof, true, memory_order_release);
+        }
+
+        xSemaphoreGive(s->lock);
+        xSemaphoreGive(s->data_sem);
+    }
+
+    xSemaphoreGive(s->exit_sem);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief       打开文件,在I/O任务中开始预读
+ * @param       path : 文件路径
+ * @param       core : I/O任务所在核心
+ * @param       prio : I/O任务优先级
+ * @retval      数据源句柄; NULL:失败
+ */
+file_stream_t *file_stream_open(const char *path, BaseType_t core, UBaseType_t prio)
+{
+    file_stream_t *s = calloc(1, sizeof(file_stream_t));
+    if (!s)
+    {
+        return NULL;
+    }
+
+    atomic_init(&s->eof, false);
+    const char *fatfs_path = file_stream_fatfs_path(path);
+    esp_err_t ret = fatfs_path ? file_stream_open_fatfs(s, fatfs_path) : file_stream_open_stdio(s, path);
+    s->lock = xSemaphoreCreateMutex();
+    s->data_sem = xSemaphoreCreateBinary();
+    s->space_sem = xSemaphoreCreateBinary();
+    s->exit_sem = xSemaphoreCreateBinary();
+
+    if (ret != ESP_OK || !s->lock || !s->data_sem || !s->space_sem || !s->exit_sem)
+    {
+        file_stream_free(s);
+        return NULL;
+    }
+
+    if (xTaskCreatePinnedToCore(file_stream_task, "file_stream", FILE_STREAM_TASK_STACK, s, prio, NULL, core) != pdPASS)
+    {
+        file_stream_free(s);
+        return NULL;
+    }
+
+    return s;
+}
+
+/**
+ * @brief       读取数据
+ * @note        缓冲区为空时等待I/O任务,首次读取和重新定位后的等待不计为欠载
+ * @param       stream : 数据源句柄
+ * @param       buf    : 数据缓冲区
+ * @param       len    : 最大读取长度
+ * @retval      读取的字节数; 0:已读完; -1:读文件出错
+ */
+int file_stream_read(file_stream_t *stream, void *buf, size_t len)
+{
+    file_stream_t *s = stream;
+    TickType_t start = xTaskGetTickCount();
+    bool counted = !s->started;
+
+    while (spsc_ring_used(&s->ring) == 0)
+    {
+        if (atomic_load_explicit(&s->eof, memory_order_acquire))
+        {
+            if (spsc_ring_used(&s->ring) == 0)      /* eof之前提交的数据要读完 */
+            {
+                return s->failed ? -1 : 0;
+            }
+
+            break;
+        }
+
+        if (!counted)
+        {
+            s->underruns++;
+            counted = true;
+        }
+
+        if (xTaskGetTickCount() - start >= pdMS_TO_TICKS(FILE_STREAM_STALL_MS))
+        {
+            ESP_LOGE(TAG, "read stalled");
+            return -1;
+        }
+
+        xSemaphoreTake(s->data_sem, pdMS_TO_TICKS(50));
+    }
+
+    uint32_t n = spsc_ring_read(&s->ring, buf, len);
+    s->pos += n;
+    s->started = true;
+    xSemaphoreGive(s->space_sem);
+
+    return n;
+}
+
+/**
+ * @brief       定位读位置
+ * @note        目标在已预读的数据中时直接跳过,否则清空缓冲区从新位置重新预读
+ * @param       stream : 数据源句柄
+ * @param       offset : 偏移,返回新的读位置
+ * @param       whence : SEEK_SET/SEEK_CUR/SEEK_END
+ * @retval      0:成功; -1:失败
+ */
+int file_stream_seek(file_stream_t *stream, int64_t *offset, int whence)
+{
+    file_stream_t *s = stream;
+    int64_t target;
+
+    switch (whence)
+    {
+        case SEEK_SET:
+            target = *offset;
+            break;
+
+        case SEEK_CUR:
+            target = s->pos + *offset;
+            break;
+
+        case SEEK_END:
+            target = s->size + *offset;
+            break;
+
+        default:
+            target = -1;
+            break;
+    }
+
+    if (target < 0 || target > UINT32_MAX)
+    {
+        return -1;
+    }
+
+    uint32_t used = spsc_ring_used(&s->ring);
+
+    if (target >= s->pos && target - s->pos <= used)
+    {
+        spsc_ring_release(&s->ring, target - s->pos);
+        s->pos = target;
+    }
+    else
+    {
+        xSemaphoreTake(s->lock, portMAX_DELAY);
+
+        if (!file_stream_lseek(s, target))
+        {
+            xSemaphoreGive(s->lock);
+            return -1;
+        }
+
+        spsc_ring_reset_at(&s->ring, target);   /* I/O任务等待lock,读者就是自己 */
+        s->pos = target;
+        s->started = false;
+        s->failed = false;
+        atomic_store_explicit(&s->eof, false, memory_order_release);
+        xSemaphoreGive(s->lock);
+    }
+
+    *offset = target;
+    xSemaphoreGive(s->space_sem);
+
+    return 0;
+}
+
+/**
+ * @brief       获取文件长度
+ * @param       stream : 数据源句柄
+ * @retval      字节数
+ */
+int64_t file_stream_size(file_stream_t *stream)
+{
+    return stream->size;
+}
+
+/**
+ * @brief       获取欠载次数
+ * @param       stream : 数据源句柄
+ * @retval      读取时缓冲区为空、需要等待I/O任务的次数
+ */
+uint32_t file_stream_underruns(file_stream_t *stream)
+{
+    return stream->underruns;
+}
+
+/**
+ * @brief       停止预读并关闭文件
+ * @note        最长等待I/O任务读完一块
+ * @param       stream : 数据源句柄
+ * @retval      无
+ */
+void file_stream_close(file_stream_t *stream)
+{
+    if (!stream)
+    {
+        return;
+    }
+
+    stream->abort = true;
+    xSemaphoreGive(stream->space_sem);
+    xSemaphoreTake(stream->exit_sem, portMAX_DELAY);
+
+    file_stream_free(stream);
+}
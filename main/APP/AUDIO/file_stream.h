@@ -0,0 +1,36 @@
+/**
+ ****************************************************************************************************
+ * @file        file_stream.h
+ * @brief       SD卡预读数据源:I/O任务在指定核心上提前读文件到环形缓冲区,播放器按需读取.
+ *              SD卡上的文件直接用FatFs读,其它文件系统(SPIFFS)上的文件用stdio读
+ ****************************************************************************************************
+ */
+
+#ifndef __FILE_STREAM_H
+#define __FILE_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#define FILE_STREAM_BUF_SIZE        (32 * 1024)     /* 预读缓冲区大小,320kbps约0.8s */
+#define FILE_STREAM_CHUNK           (4 * 1024)      /* stdio每次读文件的字节数,缓冲区空闲不足时I/O任务等待 */
+#define FILE_STREAM_READ_MAX        (8 * 1024)      /* FatFs每次读文件的字节数,2的幂,是扇区的整数倍 */
+#define FILE_STREAM_CLMT_LEN        64              /* FastSeek簇链表初始长度(DWORD),碎片多时按需加大 */
+#define FILE_STREAM_TASK_STACK      3072            /* I/O任务堆栈大小 */
+#define FILE_STREAM_STALL_MS        2000            /* 读者等待数据超过该时间视为读卡出错 */
+
+typedef struct file_stream file_stream_t;
+
+/* 函数声明 */
+const char *file_stream_fatfs_path(const char *path);                   /* SD卡上文件的FatFs路径,不在SD卡上返回NULL */
+file_stream_t *file_stream_open(const char *path, BaseType_t core, UBaseType_t prio);  /* 打开文件,I/O任务开始预读 */
+int file_stream_read(file_stream_t *stream, void *buf, size_t len);     /* 读取数据,缓冲区为空时阻塞 */
+int file_stream_seek(file_stream_t *stream, int64_t *offset, int whence);/* 定位,超出已预读范围时重新预读 */
+int64_t file_stream_size(file_stream_t *stream);                        /* 获取文件长度 */
+uint32_t file_stream_underruns(file_stream_t *stream);                  /* 读取时缓冲区为空的次数 */
+void file_stream_close(file_stream_t *stream);                          /* 停止预读并释放资源 */
+void file_stream_bench(const char *path);                               /* 对比stdio和FatFs直读的吞吐量和定位耗时 */
+
+#endif
@@ -0,0 +1,181 @@
+/**
+ ****************************************************************************************************
+ * @file        file_stream_bench.c
+ * @brief       SD卡读取吞吐量和定位耗时测试
+ * @note        对比原来的读法(fopen/fread,经过VFS和stdio缓冲,每次4KB)、f_read直接按块读进
+ *              可DMA的缓冲区,以及完整的预读数据源(I/O任务+环形缓冲区).
+ *              三种读法读同一个文件并校验数据一致,之后各做BENCH_SEEKS次随机定位并读一小段
+ ****************************************************************************************************
+ */
+
+#include "file_stream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "ff.h"
+
+static const char *TAG = "file_stream";
+
+#define BENCH_SEEKS         64          /* 随机定位次数 */
+#define BENCH_SEEK_READ     512         /* 每次定位后读取的字节数 */
+
+/**
+ * @brief       累加数据校验值(FNV-1a)
+ */
+static uint32_t bench_hash(uint32_t hash, const uint8_t *data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief       第i次随机定位的目标,三种读法使用相同的序列
+ */
+static uint32_t bench_seek_target(uint32_t i, uint32_t size)
+{
+    return (uint32_t)(((uint64_t)(i * 2654435761u) * size) >> 32);
+}
+
+/**
+ * @brief       打印吞吐量和平均定位耗时
+ */
+static void bench_report(const char *name, uint32_t bytes, int64_t us, int64_t seek_us, bool ok)
+{
+    uint32_t milli = (uint32_t)((int64_t)bytes * 1000 / (us ? us : 1));    /* 字节/微秒即MB/s */
+    ESP_LOGI(TAG, "%-12s %4lu.%02lu MB/s, seek+read %5lu us %s", name, milli / 1000, (milli % 1000) / 10,
+             (uint32_t)(seek_us / BENCH_SEEKS), ok ? "" : "DATA ERROR");
+}
+
+/**
+ * @brief       吞吐量和定位耗时测试
+ * @note        应在播放停止时调用,SD卡上的其它访问会影响结果
+ * @param       path : SD卡上的文件路径,如"/0:/MP3/xxx.mp3"
+ * @retval      无
+ */
+void file_stream_bench(const char *path)
+{
+    const char *fatfs_path = file_stream_fatfs_path(path);
+    uint8_t *buf = heap_caps_malloc(FILE_STREAM_READ_MAX, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    FIL *fil = heap_caps_calloc(1, sizeof(FIL), MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    FILE *fp = NULL;
+    file_stream_t *stream = NULL;
+
+    if (!fatfs_path || !buf || !fil)
+    {
+        ESP_LOGE(TAG, "bench: %s", fatfs_path ? "no memory" : "not on the SD card");
+        goto out;
+    }
+
+    /* 原来的读法 */
+    fp = fopen(path, "rb");
+    if (!fp)
+    {
+        ESP_LOGE(TAG, "bench: can't open %s", path);
+        goto out;
+    }
+
+    uint32_t ref = 2166136261u;
+    uint32_t size = 0;
+    size_t n;
+    int64_t start = esp_timer_get_time();
+
+    while ((n = fread(buf, 1, FILE_STREAM_CHUNK, fp)) > 0)
+    {
+        ref = bench_hash(ref, buf, n);
+        size += n;
+    }
+
+    int64_t us = esp_timer_get_time() - start;
+    start = esp_timer_get_time();
+
+    for (uint32_t i = 0; i < BENCH_SEEKS; i++)
+    {
+        fseek(fp, bench_seek_target(i, size), SEEK_SET);
+        fread(buf, 1, BENCH_SEEK_READ, fp);
+    }
+
+    bench_report("fread", size, us, esp_timer_get_time() - start, true);
+    fclose(fp);
+
+    /* f_read直接读整块 */
+    if (f_open(fil, fatfs_path, FA_READ) != FR_OK)
+    {
+        ESP_LOGE(TAG, "bench: f_open failed");
+        goto out;
+    }
+
+#if FF_USE_FASTSEEK
+    DWORD clmt[FILE_STREAM_CLMT_LEN] = { FILE_STREAM_CLMT_LEN };
+    fil->cltbl = clmt;
+    if (f_lseek(fil, CREATE_LINKMAP) != FR_OK)
+    {
+        fil->cltbl = NULL;
+    }
+#endif
+
+    uint32_t hash = 2166136261u;
+    uint32_t total = 0;
+    UINT got;
+    start = esp_timer_get_time();
+
+    while (f_read(fil, buf, FILE_STREAM_READ_MAX, &got) == FR_OK && got > 0)
+    {
+        hash = bench_hash(hash, buf, got);
+        total += got;
+    }
+
+    us = esp_timer_get_time() - start;
+    start = esp_timer_get_time();
+
+    for (uint32_t i = 0; i < BENCH_SEEKS; i++)
+    {
+        f_lseek(fil, bench_seek_target(i, size));
+        f_read(fil, buf, BENCH_SEEK_READ, &got);
+    }
+
+    bench_report("f_read", total, us, esp_timer_get_time() - start, hash == ref && total == size);
+    f_close(fil);
+
+    /* 完整的预读数据源 */
+    stream = file_stream_open(path, tskNO_AFFINITY, uxTaskPriorityGet(NULL));
+    if (!stream)
+    {
+        ESP_LOGE(TAG, "bench: file_stream_open failed");
+        goto out;
+    }
+
+    int len;
+    hash = 2166136261u;
+    total = 0;
+    start = esp_timer_get_time();
+
+    while ((len = file_stream_read(stream, buf, FILE_STREAM_READ_MAX)) > 0)
+    {
+        hash = bench_hash(hash, buf, len);
+        total += len;
+    }
+
+    us = esp_timer_get_time() - start;
+    start = esp_timer_get_time();
+
+    for (uint32_t i = 0; i < BENCH_SEEKS; i++)
+    {
+        int64_t offset = bench_seek_target(i, size);
+        file_stream_seek(stream, &offset, SEEK_SET);
+        file_stream_read(stream, buf, BENCH_SEEK_READ);
+    }
+
+    bench_report("file_stream", total, us, esp_timer_get_time() - start, len == 0 && hash == ref && total == size);
+
+out:
+    file_stream_close(stream);
+    heap_caps_free(fil);
+    heap_caps_free(buf);
+}
@@ -0,0 +1,381 @@
+/**
+ ****************************************************************************************************
+ * @file        rec_upload_test.c
+ * @brief       边录边传的主机测试:rec_upload.c对tools/upload_server.py上传
+ * @note        用法: rec_upload_test <python3> <upload_server.py> <fast|slow|drop|slow_drop>
+ *              启动upload_server.py(slow加--rate,drop加--drop-every),本程序代替写卡任务:
+ *              按record.c的方式写入占位文件头和预分配,按录音的速度每次写REC_WRITE_SIZE,
+ *              rec_upload_feed返回true后最多每REC_UPLOAD_SYNC_MS同步一次,停止时截断、重写文件头、关闭,
+ *              然后等待上传完成,用rec_upload_verify比较CRC32,再逐字节比较服务器和本地的文件.
+ *              主机上的FatFs(stubs/ff_host.c)和FatFs一样,没有同步的数据其它文件对象读不到,
+ *              上传任务读了没有同步的数据时内容就是错的.
+ *              每项另外检查: fast 除占位文件头外不从SD卡读取、不额外同步、没有失败; slow 从SD卡读取,同步次数不超过每秒一次;
+ *              drop 有失败的请求并且续传成功.出错时返回非零
+ ****************************************************************************************************
+ */
+
+#define _GNU_SOURCE 1
+#include "rec_upload.h"
+#include "ff.h"
+#include "esp_timer.h"
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TEST_BYTE_RATE      192000              /* 48kHz 16位立体声 */
+#define TEST_WRITE_SIZE     (32 * 1024)         /* 与record.h的REC_WRITE_SIZE相同 */
+#define TEST_HEADER_SIZE    44                  /* WAV文件头 */
+#define TEST_PREALLOC       (4 * 1024 * 1024)   /* 预分配,停止时截掉没有用到的部分 */
+#define TEST_WAIT_MS        60000               /* 停止后等待上传完成的最长时间 */
+
+typedef struct
+{
+    const char *name;
+    int record_ms;                              /* 录音时长 */
+    const char *rate;                           /* upload_server.py --rate */
+    const char *drop_every;                     /* upload_server.py --drop-every */
+} scenario_t;
+
+static const scenario_t s_scenarios[] = {
+    { "fast",      4000, NULL,    NULL },
+    { "slow",      6000, "96000", NULL },
+    { "drop",      4000, NULL,    "2"  },
+    { "slow_drop", 6000, "96000", "2"  },
+};
+
+static int s_errors;
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) \
+        { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            s_errors++; \
+        } \
+    } while (0)
+
+/**
+ * @brief       录音数据中第pos个字节的值
+ */
+static inline uint8_t pattern(uint32_t pos)
+{
+    uint32_t x = pos * 2654435761u;
+    return (uint8_t)(x >> 24 ^ pos >> 9);
+}
+
+/**
+ * @brief       系统分配的空闲TCP端口
+ */
+static int free_port(void)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        getsockname(fd, (struct sockaddr *)&addr, &len) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+/**
+ * @brief       等待服务器开始监听
+ */
+static bool wait_listening(int port)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port),
+                                .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+
+    for (int t = 0; t < 100; t++)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        bool ok = connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        close(fd);
+
+        if (ok)
+        {
+            return true;
+        }
+
+        usleep(50000);
+    }
+
+    return false;
+}
+
+/**
+ * @brief       启动upload_server.py
+ * @retval      进程号,-1:失败
+ */
+static pid_t start_server(const char *python, const char *script, const char *dir, int port, const scenario_t *sc)
+{
+    char port_str[16];
+    const char *argv[12];
+    int argc = 0;
+
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    argv[argc++] = python;
+    argv[argc++] = script;
+    argv[argc++] = "-d";
+    argv[argc++] = dir;
+    argv[argc++] = "--port";
+    argv[argc++] = port_str;
+
+    if (sc->rate)
+    {
+        argv[argc++] = "--rate";
+        argv[argc++] = sc->rate;
+    }
+
+    if (sc->drop_every)
+    {
+        argv[argc++] = "--drop-every";
+        argv[argc++] = sc->drop_every;
+    }
+
+    argv[argc] = NULL;
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        setenv("PYTHONUNBUFFERED", "1", 1);
+        execvp(python, (char *const *)argv);
+        _exit(127);
+    }
+
+    if (pid < 0 || !wait_listening(port))
+    {
+        return -1;
+    }
+
+    return pid;
+}
+
+/**
+ * @brief       逐字节比较服务器目录中唯一的文件和本地文件
+ */
+static bool same_file(const char *dir, const char *local)
+{
+    char path[512] = "";
+    DIR *d = opendir(dir);
+    struct dirent *e;
+
+    while (d && (e = readdir(d)) != NULL)
+    {
+        if (e->d_name[0] != '.')
+        {
+            snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        }
+    }
+
+    if (d)
+    {
+        closedir(d);
+    }
+
+    FILE *a = fopen(path, "rb");
+    FILE *b = fopen(local, "rb");
+    bool same = a && b;
+
+    while (same)
+    {
+        int ca = fgetc(a);
+        int cb = fgetc(b);
+        same = (ca == cb);
+
+        if (ca == EOF || cb == EOF)
+        {
+            break;
+        }
+    }
+
+    if (a)
+    {
+        fclose(a);
+    }
+
+    if (b)
+    {
+        fclose(b);
+    }
+
+    return same;
+}
+
+/**
+ * @brief       代替record.c录音一次,返回同步的次数(不含开始时的一次)
+ */
+static int record(const char *path, const char *url, int record_ms, uint32_t *size)
+{
+    static uint8_t block[TEST_WRITE_SIZE];
+    uint8_t header[TEST_HEADER_SIZE] = { 0 };
+    FIL file;
+    UINT bw;
+    int syncs = 0;
+
+    /* start_recording: 预分配,占位文件头,同步后启动上传 */
+    CHECK(f_open(&file, path, FA_CREATE_ALWAYS | FA_WRITE) == FR_OK, "f_open %s", path);
+    CHECK(f_expand(&file, TEST_PREALLOC, 1) == FR_OK, "f_expand");
+    f_write(&file, header, sizeof(header), &bw);
+    f_sync(&file);
+    CHECK(rec_upload_start(url, path, "REC.WAV") == ESP_OK, "rec_upload_start");
+    rec_upload_synced(f_tell(&file));
+
+    bool pending = false;
+    int64_t start = esp_timer_get_time();
+    int64_t sync_us = start;
+    uint32_t data = 0;
+
+    /* rec_write: 按录音的速度写入,上传缓冲区放不下时隔REC_UPLOAD_SYNC_MS同步一次 */
+    while (esp_timer_get_time() - start < (int64_t)record_ms * 1000)
+    {
+        int64_t due = start + (int64_t)(data + TEST_WRITE_SIZE) * 1000000 / TEST_BYTE_RATE;
+        int64_t now = esp_timer_get_time();
+        if (due > now)
+        {
+            usleep(due - now);
+        }
+
+        for (uint32_t i = 0; i < TEST_WRITE_SIZE; i++)
+        {
+            block[i] = pattern(data + i);
+        }
+
+        CHECK(f_write(&file, block, TEST_WRITE_SIZE, &bw) == FR_OK && bw == TEST_WRITE_SIZE, "f_write");
+        data += bw;
+
+        if (rec_upload_feed(f_tell(&file) - bw, block, bw))
+        {
+            pending = true;
+        }
+
+        now = esp_timer_get_time();
+        if (pending && now - sync_us >= REC_UPLOAD_SYNC_MS * 1000LL)
+        {
+            f_sync(&file);
+            rec_upload_synced(f_tell(&file));
+            pending = false;
+            sync_us = now;
+            syncs++;
+        }
+    }
+
+    /* stop_recording: 截掉预分配的部分,重写文件头,关闭 */
+    f_truncate(&file);
+    memcpy(header, "RIFF", 4);
+    memcpy(header + 40, &data, 4);
+    f_lseek(&file, 0);
+    f_write(&file, header, sizeof(header), &bw);
+    f_close(&file);
+
+    *size = TEST_HEADER_SIZE + data;
+    rec_upload_finish(*size);
+    return syncs;
+}
+
+int main(int argc, char **argv)
+{
+    const scenario_t *sc = NULL;
+
+    for (size_t i = 0; argc == 4 && i < sizeof(s_scenarios) / sizeof(s_scenarios[0]); i++)
+    {
+        if (strcmp(argv[3], s_scenarios[i].name) == 0)
+        {
+            sc = &s_scenarios[i];
+        }
+    }
+
+    if (!sc)
+    {
+        fprintf(stderr, "usage: %s <python3> <upload_server.py> <fast|slow|drop|slow_drop>\n", argv[0]);
+        return 2;
+    }
+
+    char root[] = "/tmp/rec_upload_XXXXXX";
+    char srv[64], path[64], url[64];
+    int port = free_port();
+
+    if (!mkdtemp(root) || port < 0)
+    {
+        fprintf(stderr, "no temp dir or port\n");
+        return 1;
+    }
+
+    snprintf(srv, sizeof(srv), "%s/srv", root);
+    snprintf(path, sizeof(path), "%s/REC.WAV", root);
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/upload", port);
+
+    pid_t server = start_server(argv[1], argv[2], srv, port, sc);
+    if (server < 0)
+    {
+        fprintf(stderr, "cannot start %s\n", argv[2]);
+        return 1;
+    }
+
+    uint32_t size;
+    int64_t start = esp_timer_get_time();
+    int syncs = record(path, url, sc->record_ms, &size);
+    int64_t stop = esp_timer_get_time();
+    bool done = rec_upload_wait(TEST_WAIT_MS);
+    int64_t end = esp_timer_get_time();
+
+    rec_upload_stats_t stats;
+    rec_upload_get_stats(&stats);
+
+    printf("%s: %lu bytes in %lld ms, uploaded %lld ms after stop; %lu requests, %lu failures, "
+           "%lu sent, %lu from SD, lag peak %lu KB, %d syncs\n",
+           sc->name, (unsigned long)size, (long long)(stop - start) / 1000, (long long)(end - stop) / 1000,
+           (unsigned long)stats.requests, (unsigned long)stats.failures, (unsigned long)stats.sent,
+           (unsigned long)stats.spilled, (unsigned long)stats.lag_peak / 1024, syncs);
+
+    CHECK(done && stats.complete, "upload not complete");
+    CHECK(rec_upload_verify() == ESP_OK, "rec_upload_verify");
+    CHECK(same_file(srv, path), "server file differs from %s", path);
+
+    int seconds = sc->record_ms / 1000;
+    if (!sc->rate && !sc->drop_every)
+    {
+        CHECK(stats.spilled <= TEST_HEADER_SIZE && syncs == 0 && stats.failures == 0,
+              "fast network: %lu bytes from SD, %d syncs, %lu failures",
+              (unsigned long)stats.spilled, syncs, (unsigned long)stats.failures);
+    }
+
+    if (sc->rate)
+    {
+        CHECK(stats.spilled > 0, "slow network: nothing read from SD");
+    }
+
+    if (sc->drop_every)
+    {
+        CHECK(stats.failures > 0, "no request was dropped");
+    }
+
+    CHECK(syncs <= seconds * 1000 / REC_UPLOAD_SYNC_MS + 1, "%d syncs in %d s", syncs, seconds);
+
+    rec_upload_cancel();
+    kill(server, SIGINT);
+    waitpid(server, NULL, 0);
+
+    if (s_errors)
+    {
+        printf("%d checks failed, files kept in %s\n", s_errors, root);
+        return 1;
+    }
+
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+    return system(cmd) == 0 ? 0 : 1;
+}
@@ -0,0 +1,292 @@
+/**
+ ****************************************************************************************************
+ * @file        esp_http_client_host.c
+ * @brief       主机构建用的esp_http_client,见esp_http_client.h
+ ****************************************************************************************************
+ */
+
+#define _GNU_SOURCE 1
+#include "esp_http_client.h"
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define HOST_HTTP_SNDBUF    (16 * 1024)
+
+struct esp_http_client
+{
+    char url[256];
+    esp_http_client_method_t method;
+    int timeout_ms;
+    int fd;                         /* -1:没有连接 */
+    int status;
+    int body_left;                  /* 回复中还没有读取的字节数 */
+    bool close_after;               /* 服务器回复了Connection: close */
+};
+
+/**
+ * @brief       拆分"http://host:port/path?query"
+ */
+static bool split_url(const char *url, char *host, size_t host_len, char *port, size_t port_len, const char **path)
+{
+    if (strncmp(url, "http://", 7) != 0)
+    {
+        return false;
+    }
+
+    const char *h = url + 7;
+    const char *slash = strchr(h, '/');
+    const char *colon = strchr(h, ':');
+    *path = slash ? slash : "/";
+
+    size_t end = slash ? (size_t)(slash - h) : strlen(h);
+    size_t hl = (colon && colon < h + end) ? (size_t)(colon - h) : end;
+
+    if (hl >= host_len)
+    {
+        return false;
+    }
+
+    memcpy(host, h, hl);
+    host[hl] = '\0';
+    snprintf(port, port_len, "%.*s", (int)(hl < end ? end - hl - 1 : 0), h + hl + 1);
+
+    if (!port[0])
+    {
+        snprintf(port, port_len, "80");
+    }
+
+    return true;
+}
+
+static bool send_all(int fd, const char *buf, int len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            return false;
+        }
+
+        buf += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+static bool connect_to(esp_http_client_handle_t client)
+{
+    char host[128], port[16];
+    const char *path;
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM }, *ai;
+
+    if (!split_url(client->url, host, sizeof(host), port, sizeof(port), &path) ||
+        getaddrinfo(host, port, &hints, &ai) != 0)
+    {
+        return false;
+    }
+
+    client->fd = socket(ai->ai_family, ai->ai_socktype, 0);
+    struct timeval tv = { client->timeout_ms / 1000, (client->timeout_ms % 1000) * 1000 };
+    setsockopt(client->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(client->fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    /* 与lwIP的发送窗口相当;主机默认的几MB会让限速的服务器在请求结束后很久才回复 */
+    int sndbuf = HOST_HTTP_SNDBUF;
+    setsockopt(client->fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    bool ok = connect(client->fd, ai->ai_addr, ai->ai_addrlen) == 0;
+    freeaddrinfo(ai);
+
+    if (!ok)
+    {
+        esp_http_client_close(client);
+    }
+
+    return ok;
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config)
+{
+    esp_http_client_handle_t client = calloc(1, sizeof(*client));
+    if (client)
+    {
+        client->fd = -1;
+        client->timeout_ms = config->timeout_ms ? config->timeout_ms : 5000;
+        esp_http_client_set_url(client, config->url);
+    }
+
+    return client;
+}
+
+esp_err_t esp_http_client_set_url(esp_http_client_handle_t client, const char *url)
+{
+    snprintf(client->url, sizeof(client->url), "%s", url);
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client, esp_http_client_method_t method)
+{
+    client->method = method;
+    return ESP_OK;
+}
+
+/**
+ * @brief       没有连接时先连接,发出请求行和请求头
+ * @param       write_len : 请求体长度,-1为分块传输
+ */
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len)
+{
+    char host[128], port[16], head[512];
+    const char *path;
+
+    if (!split_url(client->url, host, sizeof(host), port, sizeof(port), &path) ||
+        (client->fd < 0 && !connect_to(client)))
+    {
+        return ESP_FAIL;
+    }
+
+    int n = snprintf(head, sizeof(head), "%s %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: ESP32 HTTP Client/1.0\r\n",
+                     client->method == HTTP_METHOD_POST ? "POST" : "GET", path, host);
+
+    if (write_len < 0)
+    {
+        n += snprintf(head + n, sizeof(head) - n, "Transfer-Encoding: chunked\r\n");
+    }
+    else if (write_len > 0)
+    {
+        n += snprintf(head + n, sizeof(head) - n, "Content-Length: %d\r\n", write_len);
+    }
+
+    n += snprintf(head + n, sizeof(head) - n, "\r\n");
+    client->status = -1;
+    client->body_left = 0;
+    client->close_after = false;
+
+    return send_all(client->fd, head, n) ? ESP_OK : ESP_FAIL;
+}
+
+int esp_http_client_write(esp_http_client_handle_t client, const char *buffer, int len)
+{
+    return (client->fd >= 0 && send_all(client->fd, buffer, len)) ? len : -1;
+}
+
+/**
+ * @brief       逐字节读到空行为止,取出状态码、Content-Length和Connection
+ * @retval      回复体长度,-1:网络错误
+ */
+int esp_http_client_fetch_headers(esp_http_client_handle_t client)
+{
+    char line[512];
+    size_t len = 0;
+    bool first = true;
+
+    if (client->fd < 0)
+    {
+        return -1;
+    }
+
+    while (1)
+    {
+        char c;
+        if (recv(client->fd, &c, 1, 0) != 1)
+        {
+            return -1;
+        }
+
+        if (c != '\n')
+        {
+            if (c != '\r' && len < sizeof(line) - 1)
+            {
+                line[len++] = c;
+            }
+
+            continue;
+        }
+
+        line[len] = '\0';
+
+        if (len == 0)
+        {
+            return client->body_left;
+        }
+
+        if (first)
+        {
+            client->status = atoi(strchr(line, ' ') ? strchr(line, ' ') + 1 : "0");
+            first = false;
+        }
+        else if (strncasecmp(line, "Content-Length:", 15) == 0)
+        {
+            client->body_left = atoi(line + 15);
+        }
+        else if (strncasecmp(line, "Connection:", 11) == 0 && strcasestr(line + 11, "close"))
+        {
+            client->close_after = true;
+        }
+
+        len = 0;
+    }
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+    return client->status;
+}
+
+/**
+ * @brief       读取回复体,放不下的部分丢弃,连接可以接着用
+ */
+int esp_http_client_read_response(esp_http_client_handle_t client, char *buffer, int len)
+{
+    int total = 0;
+
+    while (client->body_left > 0)
+    {
+        char scratch[256];
+        char *dst = total < len ? buffer + total : scratch;
+        int want = total < len ? len - total : (int)sizeof(scratch);
+        want = want < client->body_left ? want : client->body_left;
+
+        ssize_t n = recv(client->fd, dst, want, 0);
+        if (n <= 0)
+        {
+            return -1;
+        }
+
+        client->body_left -= n;
+        total += (dst == scratch) ? 0 : n;
+    }
+
+    if (client->close_after)
+    {
+        esp_http_client_close(client);
+    }
+
+    return total;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client)
+{
+    if (client->fd >= 0)
+    {
+        close(client->fd);
+        client->fd = -1;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+    esp_http_client_close(client);
+    free(client);
+    return ESP_OK;
+}
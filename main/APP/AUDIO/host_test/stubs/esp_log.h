@@ -0,0 +1,13 @@
+#pragma once
+
+/* 主机构建用的 esp_log.h, 打印到标准输出 */
+#include <stdio.h>
+#include "esp_timer.h"
+
+#define ESP_LOG_HOST(level, tag, fmt, ...) \
+    printf("%c (%lld) %s: " fmt "\n", level, (long long)(esp_timer_get_time() / 1000), tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, fmt, ...)     ESP_LOG_HOST('E', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)     ESP_LOG_HOST('W', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)     ESP_LOG_HOST('I', tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...)     do { } while (0)
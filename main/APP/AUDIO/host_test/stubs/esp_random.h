@@ -0,0 +1,10 @@
+#pragma once
+
+/* 主机构建用的 esp_random.h */
+#include <stdint.h>
+#include <stdlib.h>
+
+static inline uint32_t esp_random(void)
+{
+    return ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+/* 主机构建用的 FatFs, 文件就是主机上的文件, 只有 rec_upload 和测试用到的函数.
+ * 写入的数据留在文件对象的缓冲区中, f_sync/f_close/f_lseek 之后其它文件对象才能读到,
+ * 与 FatFs 中目录项的大小要同步后才更新一样; f_expand 预分配的部分读出来是 0 */
+#include <stdint.h>
+
+typedef unsigned int UINT;
+typedef uint8_t BYTE;
+typedef uint64_t FSIZE_t;
+typedef char TCHAR;
+
+typedef enum
+{
+    FR_OK = 0,
+    FR_DISK_ERR,
+    FR_NO_FILE = 4,
+    FR_DENIED = 7,
+    FR_INVALID_OBJECT = 9,
+    FR_NOT_ENOUGH_CORE = 17,
+} FRESULT;
+
+#define FA_READ             0x01
+#define FA_WRITE            0x02
+#define FA_CREATE_ALWAYS    0x08
+
+typedef struct
+{
+    struct
+    {
+        void *fs;                   /* 非NULL:已打开 */
+    } obj;
+    FSIZE_t fptr;                   /* 读写位置 */
+    int fd;
+    BYTE *dirty;                    /* 没有同步的数据 */
+    FSIZE_t dirty_off;              /* 没有同步的数据在文件中的偏移 */
+    UINT dirty_len;
+    UINT dirty_cap;
+} FIL;
+
+#define f_tell(fp)  ((fp)->fptr)
+
+FRESULT f_open(FIL *fp, const TCHAR *path, BYTE mode);
+FRESULT f_close(FIL *fp);
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br);
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw);
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs);
+FRESULT f_sync(FIL *fp);
+FRESULT f_expand(FIL *fp, FSIZE_t fsz, BYTE opt);
+FRESULT f_truncate(FIL *fp);
@@ -0,0 +1,135 @@
+/**
+ ****************************************************************************************************
+ * @file        ff_host.c
+ * @brief       主机构建用的FatFs,见ff.h
+ ****************************************************************************************************
+ */
+
+#define _GNU_SOURCE 1
+#include "ff.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int s_fs;                    /* obj.fs指向这里 */
+
+FRESULT f_open(FIL *fp, const TCHAR *path, BYTE mode)
+{
+    int flags = (mode & FA_WRITE) ? O_RDWR : O_RDONLY;
+    flags |= (mode & FA_CREATE_ALWAYS) ? O_CREAT | O_TRUNC : 0;
+
+    memset(fp, 0, sizeof(*fp));
+    fp->fd = open(path, flags, 0644);
+    if (fp->fd < 0)
+    {
+        return FR_NO_FILE;
+    }
+
+    fp->obj.fs = &s_fs;
+    return FR_OK;
+}
+
+FRESULT f_sync(FIL *fp)
+{
+    if (!fp->obj.fs)
+    {
+        return FR_INVALID_OBJECT;
+    }
+
+    if (fp->dirty_len && pwrite(fp->fd, fp->dirty, fp->dirty_len, fp->dirty_off) != (ssize_t)fp->dirty_len)
+    {
+        return FR_DISK_ERR;
+    }
+
+    fp->dirty_len = 0;
+    return FR_OK;
+}
+
+FRESULT f_close(FIL *fp)
+{
+    FRESULT res = f_sync(fp);
+
+    if (fp->obj.fs)
+    {
+        close(fp->fd);
+        free(fp->dirty);
+        fp->dirty = NULL;
+        fp->obj.fs = NULL;
+    }
+
+    return res;
+}
+
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br)
+{
+    ssize_t n = pread(fp->fd, buff, btr, fp->fptr);
+    if (n < 0)
+    {
+        *br = 0;
+        return FR_DISK_ERR;
+    }
+
+    *br = n;
+    fp->fptr += n;
+    return FR_OK;
+}
+
+/**
+ * @brief       写入追加到没有同步的数据后面,不连续时先同步
+ */
+FRESULT f_write(FIL *fp, const void *buff, UINT btw, UINT *bw)
+{
+    *bw = 0;
+
+    if (fp->dirty_len && fp->dirty_off + fp->dirty_len != fp->fptr && f_sync(fp) != FR_OK)
+    {
+        return FR_DISK_ERR;
+    }
+
+    if (fp->dirty_len + btw > fp->dirty_cap)
+    {
+        UINT cap = (fp->dirty_len + btw) * 2;
+        BYTE *p = realloc(fp->dirty, cap);
+        if (!p)
+        {
+            return FR_NOT_ENOUGH_CORE;
+        }
+
+        fp->dirty = p;
+        fp->dirty_cap = cap;
+    }
+
+    if (fp->dirty_len == 0)
+    {
+        fp->dirty_off = fp->fptr;
+    }
+
+    memcpy(fp->dirty + fp->dirty_len, buff, btw);
+    fp->dirty_len += btw;
+    fp->fptr += btw;
+    *bw = btw;
+    return FR_OK;
+}
+
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs)
+{
+    fp->fptr = ofs;
+    return FR_OK;
+}
+
+FRESULT f_expand(FIL *fp, FSIZE_t fsz, BYTE opt)
+{
+    (void)opt;
+    return ftruncate(fp->fd, fsz) == 0 ? FR_OK : FR_DENIED;
+}
+
+FRESULT f_truncate(FIL *fp)
+{
+    if (f_sync(fp) != FR_OK || ftruncate(fp->fd, fp->fptr) != 0)
+    {
+        return FR_DISK_ERR;
+    }
+
+    return FR_OK;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+/* 主机构建用的 FreeRTOS, 任务是 pthread 线程, 一个节拍为 1ms, 只有 rec_upload 用到的部分 */
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE                      1
+#define pdFALSE                     0
+#define pdPASS                      1
+#define portMAX_DELAY               0xffffffffu
+#define pdMS_TO_TICKS(ms)           ((TickType_t)(ms))
+
+/* 临界区用互斥锁代替,不嵌套使用 */
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED    PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux)     pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux)      pthread_mutex_unlock(mux)
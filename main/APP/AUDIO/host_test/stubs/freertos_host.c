@@ -0,0 +1,190 @@
+/**
+ ****************************************************************************************************
+ * @file        freertos_host.c
+ * @brief       主机构建用的FreeRTOS任务、任务通知和二值信号量,用pthread实现
+ ****************************************************************************************************
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct host_task
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;                /* 任务通知计数 */
+    TaskFunction_t fn;
+    void *param;
+};
+
+struct host_sem
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool given;
+};
+
+static __thread struct host_task *s_self;
+
+/**
+ * @brief       ticks之后的绝对时间,用于pthread_cond_timedwait
+ */
+static struct timespec deadline(TickType_t ticks)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ticks / 1000;
+    ts.tv_nsec += (long)(ticks % 1000) * 1000000;
+
+    if (ts.tv_nsec >= 1000000000)
+    {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    return ts;
+}
+
+/**
+ * @brief       等待条件,ticks为portMAX_DELAY时一直等
+ * @retval      false:超时
+ */
+static bool wait_cond(pthread_cond_t *cond, pthread_mutex_t *lock, const struct timespec *until, TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+
+    return pthread_cond_timedwait(cond, lock, until) != ETIMEDOUT;
+}
+
+static void *task_entry(void *arg)
+{
+    s_self = arg;
+    s_self->fn(s_self->param);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *param,
+                                   UBaseType_t prio, TaskHandle_t *handle, BaseType_t core)
+{
+    (void)name;
+    (void)stack;
+    (void)prio;
+    (void)core;
+
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (!task)
+    {
+        return pdFALSE;
+    }
+
+    pthread_mutex_init(&task->lock, NULL);
+    pthread_cond_init(&task->cond, NULL);
+    task->fn = fn;
+    task->param = param;
+
+    if (handle)
+    {
+        *handle = task;             /* 任务开始运行前句柄已可用,与FreeRTOS相同 */
+    }
+
+    if (pthread_create(&task->thread, NULL, task_entry, task) != 0)
+    {
+        free(task);
+        return pdFALSE;
+    }
+
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+/**
+ * @brief       只支持删除自己;句柄之后可能还会被通知,不释放
+ */
+void vTaskDelete(TaskHandle_t task)
+{
+    (void)task;
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = { ticks / 1000, (long)(ticks % 1000) * 1000000 };
+    nanosleep(&ts, NULL);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    struct host_task *task = s_self;
+    struct timespec until = deadline(ticks);
+
+    pthread_mutex_lock(&task->lock);
+
+    while (task->notify == 0 && wait_cond(&task->cond, &task->lock, &until, ticks))
+    {
+    }
+
+    uint32_t value = task->notify;
+    if (value)
+    {
+        task->notify = clear ? 0 : value - 1;
+    }
+
+    pthread_mutex_unlock(&task->lock);
+    return value;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    struct host_sem *sem = calloc(1, sizeof(*sem));
+    if (sem)
+    {
+        pthread_mutex_init(&sem->lock, NULL);
+        pthread_cond_init(&sem->cond, NULL);
+    }
+
+    return sem;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    pthread_mutex_lock(&sem->lock);
+    BaseType_t ret = sem->given ? pdFALSE : pdTRUE;
+    sem->given = true;
+    pthread_cond_signal(&sem->cond);
+    pthread_mutex_unlock(&sem->lock);
+    return ret;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    struct timespec until = deadline(ticks);
+
+    pthread_mutex_lock(&sem->lock);
+
+    while (!sem->given && wait_cond(&sem->cond, &sem->lock, &until, ticks))
+    {
+    }
+
+    BaseType_t ret = sem->given ? pdTRUE : pdFALSE;
+    sem->given = false;
+    pthread_mutex_unlock(&sem->lock);
+    return ret;
+}
@@ -0,0 +1,494 @@
+/**
+ ****************************************************************************************************
+ * @file        mic_stream.c
+ * @brief       麦克风WebSocket实时流
+ *              采集任务每次从I2S读取10ms,连同采集时刻打包成一条消息放进PSRAM环形缓冲区;
+ *              发送任务取出消息通过WebSocket发给客户端.两级之间只有这个缓冲区,
+ *              网络停顿时缓冲区满就丢弃最新的消息,恢复后排队超过MIC_STREAM_MAX_LAG_MS的消息
+ *              直接丢弃,客户端听到的始终是最近的声音.
+ *              同一时间只有一个客户端,新的客户端连接后旧的不再接收
+ ****************************************************************************************************
+ */
+
+#include "mic_stream.h"
+#include "audio_engine.h"
+#include "myi2s.h"
+#include "es8388.h"
+#include "spsc_ring.h"
+#include "audio_adpcm.h"
+#include "esp_http_server.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <unistd.h>
+
+#if AUDIO_ENGINE_FIXED_RATE != MIC_STREAM_RATE
+#warning "AUDIO_ENGINE_FIXED_RATE differs from MIC_STREAM_RATE, the audio engine is stopped every time the stream starts"
+#endif
+
+static const char *TAG = "mic_stream";
+
+#define MIC_PCM_BYTES       (MIC_STREAM_FRAMES * MIC_STREAM_CHANNELS * 2)  /* 每条消息的PCM字节数 */
+
+static volatile bool s_running;                                         /* 清零后采集和发送任务退出 */
+static mic_stream_format_t s_format;                                    /* 消息格式 */
+static uint32_t s_msg_bytes;                                            /* 每条消息的字节数,含消息头 */
+static httpd_handle_t s_server;                                         /* WebSocket服务 */
+static volatile int s_fd = -1;                                          /* 当前客户端的套接字,-1:没有客户端 */
+static volatile bool s_new_client;                                      /* 新客户端连接,发送任务先发格式描述 */
+static spsc_ring_t s_ring;                                              /* 采集 -> 发送的环形缓冲区 */
+static TaskHandle_t s_sender;                                           /* 发送任务,有新消息时通知 */
+static SemaphoreHandle_t s_done;                                        /* 采集和发送任务已退出(计数) */
+static uint8_t *s_msg;                                                  /* 采集任务打包消息用(内部RAM) */
+static uint8_t *s_out;                                                  /* 发送任务取出消息用(内部RAM) */
+static int16_t *s_pcm;                                                  /* ADPCM时的PCM(内部RAM) */
+
+static mic_stream_stats_t s_stats;                                      /* 统计 */
+static uint64_t s_latency_sum;                                          /* 延迟之和 */
+static uint64_t s_rtt_sum;                                              /* 网络往返之和 */
+static int64_t s_sent_us[MIC_STREAM_SENT_LOG];                          /* 最近的消息发出的时刻,按序号取模 */
+static uint32_t s_sent_seq[MIC_STREAM_SENT_LOG];                        /* 对应的序号 */
+
+/**
+ * @brief       客户端发回的消息头前12字节:采集时刻和序号,算出端到端延迟
+ * @note        往返 = 现在 - 采集时刻,网络往返 = 现在 - 发出时刻,
+ *              采集到客户端收到 = 往返 - 网络往返的一半
+ */
+static void mic_stream_ack(const uint8_t *ack)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t ts;
+    uint32_t seq;
+
+    memcpy(&ts, ack, sizeof(ts));
+    memcpy(&seq, ack + 8, sizeof(seq));
+
+    uint32_t slot = seq % MIC_STREAM_SENT_LOG;
+    if (s_sent_seq[slot] != seq || ts > now)
+    {
+        return;                                                         /* 太旧或不是本设备发出的 */
+    }
+
+    int64_t rtt = now - s_sent_us[slot];
+    int64_t latency = (now - ts) - rtt / 2;
+
+    s_stats.acks++;
+    s_rtt_sum += rtt;
+    s_latency_sum += latency;
+    s_stats.rtt_avg_us = s_rtt_sum / s_stats.acks;
+    s_stats.latency_avg_us = s_latency_sum / s_stats.acks;
+
+    if (latency > s_stats.latency_max_us)
+    {
+        s_stats.latency_max_us = latency;
+    }
+}
+
+/**
+ * @brief       WebSocket处理函数
+ * @note        握手时记下客户端,之后只接收回执;格式描述由发送任务发出,同一套接字只有一个任务在写
+ */
+static esp_err_t mic_ws_handler(httpd_req_t *req)
+{
+    if (req->method == HTTP_GET)
+    {
+        s_fd = httpd_req_to_sockfd(req);
+        s_new_client = true;
+        ESP_LOGI(TAG, "client connected, fd %d", s_fd);
+        return ESP_OK;
+    }
+
+    uint8_t buf[16];
+    httpd_ws_frame_t pkt = { 0 };
+
+    esp_err_t ret = httpd_ws_recv_frame(req, &pkt, 0);                  /* 先取长度 */
+    if (ret != ESP_OK || pkt.len > sizeof(buf))
+    {
+        return ret;
+    }
+
+    pkt.payload = buf;
+    ret = httpd_ws_recv_frame(req, &pkt, pkt.len);
+
+    if (ret == ESP_OK && pkt.type == HTTPD_WS_TYPE_BINARY && pkt.len >= 12)
+    {
+        mic_stream_ack(buf);
+    }
+
+    return ret;
+}
+
+/**
+ * @brief       客户端断开,httpd关闭套接字前调用
+ */
+static void mic_ws_close(httpd_handle_t hd, int sockfd)
+{
+    if (sockfd == s_fd)
+    {
+        s_fd = -1;
+        ESP_LOGI(TAG, "client disconnected");
+    }
+
+    close(sockfd);
+}
+
+/**
+ * @brief       采集任务:每次读取10ms打包成一条消息,没有客户端时丢弃
+ */
+static void mic_capture_task(void *param)
+{
+    audio_adpcm_state_t adpcm = { 0 };
+    uint32_t seq = 0;
+
+    while (s_running)
+    {
+        int64_t ts;
+        uint8_t *payload = s_msg + MIC_STREAM_HEADER;
+
+        uint8_t *pcm = (s_format == MIC_STREAM_ADPCM) ? (uint8_t *)s_pcm : payload;
+
+        if (i2s_rx_read_ts(pcm, MIC_PCM_BYTES, &ts) != MIC_PCM_BYTES)
+        {
+            continue;                                   /* 读取出错(已记录日志),不发送不完整的数据 */
+        }
+
+        if (s_format == MIC_STREAM_ADPCM)
+        {
+            audio_adpcm_encode_block(&adpcm, s_pcm, MIC_STREAM_FRAMES, MIC_STREAM_CHANNELS, payload, MIC_STREAM_ADPCM_BLOCK);
+        }
+
+        if (s_fd < 0)
+        {
+            continue;
+        }
+
+        uint16_t frames = MIC_STREAM_FRAMES;
+        memcpy(s_msg, &ts, 8);
+        memcpy(s_msg + 8, &seq, 4);
+        memcpy(s_msg + 12, &frames, 2);
+        s_msg[14] = s_format;
+        s_msg[15] = MIC_STREAM_CHANNELS;
+        seq++;
+        s_stats.frames++;
+
+        if (spsc_ring_free(&s_ring) < s_msg_bytes)
+        {
+            s_stats.dropped++;                                          /* 网络跟不上,丢弃最新的一条 */
+        }
+        else
+        {
+            spsc_ring_write(&s_ring, s_msg, s_msg_bytes);
+        }
+
+        xTaskNotifyGive(s_sender);
+    }
+
+    xSemaphoreGive(s_done);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief       发送任务:取出消息发给客户端,排队太久的直接丢弃
+ */
+static void mic_send_task(void *param)
+{
+    const uint32_t max_queued = MIC_STREAM_MAX_LAG_MS / MIC_STREAM_FRAME_MS;
+    char info[128];
+
+    while (s_running)
+    {
+        int fd = s_fd;
+
+        if (fd >= 0 && s_new_client)
+        {
+            s_new_client = false;
+            int len = snprintf(info, sizeof(info),
+                               "{\"rate\":%d,\"channels\":%d,\"frame_ms\":%d,\"format\":\"%s\",\"block\":%d}",
+                               MIC_STREAM_RATE, MIC_STREAM_CHANNELS, MIC_STREAM_FRAME_MS,
+                               s_format == MIC_STREAM_ADPCM ? "ima_adpcm" : "pcm", MIC_STREAM_ADPCM_BLOCK);
+            httpd_ws_frame_t text = {
+                .type = HTTPD_WS_TYPE_TEXT,
+                .payload = (uint8_t *)info,
+                .len = len,
+                .final = true,
+            };
+            spsc_ring_release(&s_ring, spsc_ring_used(&s_ring));       /* 之前的消息不发给新客户端 */
+            httpd_ws_send_frame_async(s_server, fd, &text);
+        }
+
+        if (spsc_ring_used(&s_ring) < s_msg_bytes)
+        {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+            continue;
+        }
+
+        /* 网络恢复后先丢弃排队太久的消息,延迟回到MIC_STREAM_MAX_LAG_MS以内 */
+        while (spsc_ring_used(&s_ring) / s_msg_bytes > max_queued)
+        {
+            spsc_ring_release(&s_ring, s_msg_bytes);
+            s_stats.stale++;
+        }
+
+        spsc_ring_read(&s_ring, s_out, s_msg_bytes);
+
+        if (fd < 0)
+        {
+            continue;
+        }
+
+        httpd_ws_frame_t frame = {
+            .type = HTTPD_WS_TYPE_BINARY,
+            .payload = s_out,
+            .len = s_msg_bytes,
+            .final = true,
+        };
+
+        uint32_t seq;
+        memcpy(&seq, s_out + 8, 4);
+        s_sent_seq[seq % MIC_STREAM_SENT_LOG] = seq;
+        s_sent_us[seq % MIC_STREAM_SENT_LOG] = esp_timer_get_time();
+
+        if (httpd_ws_send_frame_async(s_server, fd, &frame) != ESP_OK)
+        {
+            ESP_LOGW(TAG, "send failed, dropping client");
+            if (s_fd == fd)
+            {
+                s_fd = -1;
+            }
+            continue;
+        }
+
+        s_stats.sent++;
+
+        if (s_stats.sent % 500 == 0)
+        {
+            ESP_LOGI(TAG, "sent %lu, dropped %lu, stale %lu, latency avg %lu us max %lu us, rtt avg %lu us",
+                     s_stats.sent, s_stats.dropped, s_stats.stale,
+                     s_stats.latency_avg_us, s_stats.latency_max_us, s_stats.rtt_avg_us);
+        }
+    }
+
+    xSemaphoreGive(s_done);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief       释放缓冲区
+ */
+static void mic_stream_free(void)
+{
+    spsc_ring_delete(&s_ring);
+    heap_caps_free(s_msg);
+    heap_caps_free(s_out);
+    heap_caps_free(s_pcm);
+    s_msg = NULL;
+    s_out = NULL;
+    s_pcm = NULL;
+}
+
+/**
+ * @brief       打开I2S RX,初始化ES8388的ADC
+ * @note        与录音相同:正在播放时不打断,采样率不同时常驻的播放引擎让出I2S
+ */
+static esp_err_t mic_stream_open_i2s(void)
+{
+    if (i2s_is_open(I2S_DIR_RX))
+    {
+        ESP_LOGE(TAG, "I2S RX is used by the recorder");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t ret = i2s_open(I2S_DIR_RX);
+
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "I2S RX open failed: %s", esp_err_to_name(ret));
+        return ret;                                                     /* 没有打开,不能i2s_close,也不配置ES8388 */
+    }
+
+    if (i2s_set_format(I2S_DIR_RX, MIC_STREAM_RATE, I2S_DATA_BIT_WIDTH_16BIT) != ESP_OK)
+    {
+        audio_engine_deinit();
+
+        if (i2s_set_format(I2S_DIR_RX, MIC_STREAM_RATE, I2S_DATA_BIT_WIDTH_16BIT) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "I2S TX is playing another format");
+            i2s_close(I2S_DIR_RX);
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+
+    bool playing = i2s_is_open(I2S_DIR_TX);
+    es8388_adda_cfg(playing, 1);                                        /* 启用ADC,正在播放时保留DAC */
+    es8388_input_cfg(0);                                                /* 输入通道设置为MIC */
+    es8388_mic_gain(8);                                                 /* 设置麦克风增益 */
+    es8388_alc_ctrl(3, 4, 4);                                           /* 自动增益控制 */
+
+    if (!playing)
+    {
+        es8388_output_cfg(0, 0);                                        /* 禁止输出通道 */
+        es8388_spkvol_set(0);                                           /* 静音输出 */
+        es8388_i2s_cfg(0, 3);                                           /* I2S配置为标准模式 */
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief       启动麦克风WebSocket流
+ * @note        需要WiFi已连接,sdkconfig中CONFIG_HTTPD_WS_SUPPORT=y
+ * @param       format : 消息格式
+ * @retval      ESP_OK:成功;ESP_ERR_INVALID_STATE:I2S RX正在录音;其他:失败
+ */
+esp_err_t mic_stream_start(mic_stream_format_t format)
+{
+    if (s_running)
+    {
+        return ESP_OK;
+    }
+
+    if (!s_done)
+    {
+        s_done = xSemaphoreCreateCounting(2, 0);
+        if (!s_done)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    s_format = format;
+    s_msg_bytes = MIC_STREAM_HEADER + (format == MIC_STREAM_ADPCM ? MIC_STREAM_ADPCM_BLOCK : MIC_PCM_BYTES);
+    memset(&s_stats, 0, sizeof(s_stats));
+    memset(s_sent_seq, 0xFF, sizeof(s_sent_seq));
+    s_latency_sum = 0;
+    s_rtt_sum = 0;
+    s_fd = -1;
+    s_new_client = false;
+
+    memset(&s_ring, 0, sizeof(s_ring));
+    s_msg = heap_caps_malloc(s_msg_bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    s_out = heap_caps_malloc(s_msg_bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    s_pcm = (format == MIC_STREAM_ADPCM) ? heap_caps_malloc(MIC_PCM_BYTES, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) : NULL;
+
+    if (!s_msg || !s_out || (format == MIC_STREAM_ADPCM && !s_pcm) ||
+        spsc_ring_create(&s_ring, MIC_STREAM_RING_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) != ESP_OK)
+    {
+        mic_stream_free();
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = mic_stream_open_i2s();
+    if (ret != ESP_OK)
+    {
+        mic_stream_free();
+        return ret;
+    }
+
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = MIC_STREAM_PORT;
+    config.ctrl_port = MIC_STREAM_PORT + 1;
+    config.close_fn = mic_ws_close;
+    config.core_id = MIC_STREAM_SEND_CORE;
+
+    httpd_uri_t ws = {
+        .uri = "/mic",
+        .method = HTTP_GET,
+        .handler = mic_ws_handler,
+        .is_websocket = true,
+    };
+
+    ret = httpd_start(&s_server, &config);
+    if (ret == ESP_OK)
+    {
+        ret = httpd_register_uri_handler(s_server, &ws);
+    }
+
+    uint32_t started = 0;
+    s_running = true;
+
+    if (ret == ESP_OK &&
+        xTaskCreatePinnedToCore(mic_send_task, "mic_send", 4096, NULL,
+                                MIC_STREAM_SEND_PRIO, &s_sender, MIC_STREAM_SEND_CORE) == pdPASS)
+    {
+        started++;
+
+        if (xTaskCreatePinnedToCore(mic_capture_task, "mic_capture", 4096, NULL,
+                                    MIC_STREAM_CAPTURE_PRIO, NULL, MIC_STREAM_CAPTURE_CORE) == pdPASS)
+        {
+            started++;
+        }
+    }
+
+    if (started < 2)
+    {
+        s_running = false;
+
+        while (started--)
+        {
+            xSemaphoreTake(s_done, portMAX_DELAY);
+        }
+
+        ESP_LOGE(TAG, "start failed: %s", esp_err_to_name(ret == ESP_OK ? ESP_ERR_NO_MEM : ret));
+
+        if (s_server)
+        {
+            httpd_stop(s_server);
+            s_server = NULL;
+        }
+
+        i2s_close(I2S_DIR_RX);
+        es8388_adda_cfg(i2s_is_open(I2S_DIR_TX), 0);
+        mic_stream_free();
+        return ret == ESP_OK ? ESP_ERR_NO_MEM : ret;
+    }
+
+    ESP_LOGI(TAG, "ws://<ip>:%d/mic, %s, %d Hz, %d ms frames of %lu bytes",
+             MIC_STREAM_PORT, format == MIC_STREAM_ADPCM ? "IMA ADPCM" : "PCM",
+             MIC_STREAM_RATE, MIC_STREAM_FRAME_MS, s_msg_bytes);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief       停止麦克风WebSocket流
+ * @param       无
+ * @retval      无
+ */
+void mic_stream_stop(void)
+{
+    if (!s_running)
+    {
+        return;
+    }
+
+    s_running = false;
+    xSemaphoreTake(s_done, portMAX_DELAY);
+    xSemaphoreTake(s_done, portMAX_DELAY);
+
+    httpd_stop(s_server);                                               /* 关闭客户端,close_fn清除s_fd */
+    s_server = NULL;
+    s_fd = -1;
+
+    i2s_close(I2S_DIR_RX);
+    es8388_adda_cfg(i2s_is_open(I2S_DIR_TX), 0);                        /* 关闭ADC,播放不受影响 */
+    mic_stream_free();
+
+    ESP_LOGI(TAG, "stopped: %lu frames, sent %lu, dropped %lu, stale %lu, %lu acks, latency avg %lu us max %lu us",
+             s_stats.frames, s_stats.sent, s_stats.dropped, s_stats.stale, s_stats.acks,
+             s_stats.latency_avg_us, s_stats.latency_max_us);
+}
+
+/**
+ * @brief       获取统计信息
+ * @param       stats : 统计信息
+ * @retval      无
+ */
+void mic_stream_get_stats(mic_stream_stats_t *stats)
+{
+    *stats = s_stats;
+    stats->connected = s_fd >= 0;
+}
@@ -0,0 +1,61 @@
+/**
+ ****************************************************************************************************
+ * @file        mic_stream.h
+ * @brief       麦克风WebSocket实时流:I2S采集的数据经环形缓冲区直接发给客户端,不经过SD卡
+ * @note        客户端连接ws://<IP>:MIC_STREAM_PORT/mic,先收到一条描述格式的文本消息,
+ *              之后每10ms一条二进制消息:16字节消息头 + PCM或一块IMA ADPCM.
+ *              消息头(小端): 第一帧采集时刻(int64,us,设备时间) 序号(uint32) 帧数(uint16) 格式(uint8) 声道数(uint8)
+ *              客户端把消息头的前12字节原样发回(二进制),设备据此统计端到端延迟.
+ *              网络跟不上时:缓冲区满丢弃最新的消息,排队超过MIC_STREAM_MAX_LAG_MS丢弃最早的消息,
+ *              序号连续递增,客户端据此发现丢帧
+ ****************************************************************************************************
+ */
+
+#ifndef __MIC_STREAM_H
+#define __MIC_STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define MIC_STREAM_PORT             8080                /* WebSocket服务端口 */
+#define MIC_STREAM_RATE             48000               /* 采样率 */
+#define MIC_STREAM_CHANNELS         2                   /* 声道数,I2S为立体声 */
+#define MIC_STREAM_FRAME_MS         10                  /* 每条消息的时长 */
+#define MIC_STREAM_FRAMES           (MIC_STREAM_RATE * MIC_STREAM_FRAME_MS / 1000)          /* 每条消息的帧数 */
+#define MIC_STREAM_ADPCM_BLOCK      (MIC_STREAM_FRAMES * MIC_STREAM_CHANNELS / 2 + 4 * MIC_STREAM_CHANNELS)  /* 一块ADPCM的字节数,可放MIC_STREAM_FRAMES+1帧,最后一帧是补齐的 */
+#define MIC_STREAM_HEADER           16                  /* 消息头字节数 */
+#define MIC_STREAM_RING_SIZE        (64 * 1024)         /* 采集 -> 发送的环形缓冲区(2的幂),PCM约330ms */
+#define MIC_STREAM_MAX_LAG_MS       100                 /* 排队超过这个时长时丢弃最早的消息,延迟不会一直累积 */
+#define MIC_STREAM_CAPTURE_CORE     1                   /* 采集任务所在核心,与录音相同 */
+#define MIC_STREAM_CAPTURE_PRIO     7                   /* 采集任务优先级 */
+#define MIC_STREAM_SEND_CORE        0                   /* 发送任务所在核心,与WiFi相同 */
+#define MIC_STREAM_SEND_PRIO        5                   /* 发送任务优先级 */
+#define MIC_STREAM_SENT_LOG         64                  /* 记录最近多少条消息的发送时刻,用于计算网络往返 */
+
+/* 消息格式 */
+typedef enum
+{
+    MIC_STREAM_PCM = 0,                                 /* 16位交错PCM */
+    MIC_STREAM_ADPCM = 1,                               /* 每条一块IMA ADPCM,块头带完整的解码状态 */
+} mic_stream_format_t;
+
+typedef struct
+{
+    uint32_t frames;                    /* 采集的消息数 */
+    uint32_t sent;                      /* 发出的消息数 */
+    uint32_t dropped;                   /* 缓冲区满丢弃的消息数 */
+    uint32_t stale;                     /* 排队太久丢弃的消息数 */
+    uint32_t acks;                      /* 收到的回执数 */
+    uint32_t latency_avg_us;            /* 采集到客户端收到的平均延迟(回执往返减去网络往返的一半) */
+    uint32_t latency_max_us;            /* 最大延迟 */
+    uint32_t rtt_avg_us;                /* 网络平均往返(发出到收到回执) */
+    bool connected;                     /* 是否有客户端 */
+} mic_stream_stats_t;
+
+/* 函数声明 */
+esp_err_t mic_stream_start(mic_stream_format_t format);                 /* 打开I2S RX,启动WebSocket服务和采集发送任务 */
+void mic_stream_stop(void);                                             /* 停止 */
+void mic_stream_get_stats(mic_stream_stats_t *stats);                   /* 获取统计信息 */
+
+#endif
@@ -0,0 +1,473 @@
+/**
+ ****************************************************************************************************
+ * @file        prompt_cache.c
+ * @brief       提示音PCM缓存
+ * @note        提示音第一次播放(或开机预加载)时用audio_player_decode整段解码到PSRAM,之后按路径
+ *              直接取出PCM写入混音器,省去打开文件、识别格式和初始化解码器的时间.
+ *              缓存按总大小限制,超出时淘汰最久未使用且没有被引用的提示音;解码后超过单个上限的
+ *              文件不缓存.lock只保护链表和统计,解码在调用者任务中进行,不持有lock
+ ****************************************************************************************************
+ */
+
+#include "prompt_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_check.h"
+
+static const char *TAG = "prompt_cache";
+
+static SemaphoreHandle_t s_lock;                /* 保护链表和统计 */
+static prompt_clip_t *s_head;                   /* LRU链表表头,最近使用 */
+static prompt_clip_t *s_tail;                   /* LRU链表表尾,最先淘汰 */
+static prompt_cache_stats_t s_stats = {
+    .budget = PROMPT_CACHE_BUDGET,
+    .clip_max = PROMPT_CACHE_CLIP_MAX,
+};
+
+/* 解码过程中的PCM缓冲区 */
+typedef struct
+{
+    int16_t *pcm;
+    size_t frames;
+    size_t capacity;                /* 缓冲区字节数 */
+    size_t limit;                   /* 单个提示音PCM上限 */
+    uint8_t channels;
+    uint32_t rate;
+    bool overflow;                  /* 超过上限或格式中途改变,不再缓存 */
+    audio_player_pcm_fn tee;        /* 同时接收解码数据,可为NULL */
+    void *ctx;
+} prompt_fill_t;
+
+/**
+ * @brief       创建lock
+ */
+static esp_err_t cache_lock_init(void)
+{
+    if (!s_lock)
+    {
+        s_lock = xSemaphoreCreateMutex();
+        ESP_RETURN_ON_FALSE(s_lock, ESP_ERR_NO_MEM, TAG, "Failed to create cache lock");
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief       提示音PCM占用的字节数
+ */
+static size_t clip_bytes(const prompt_clip_t *clip)
+{
+    return clip->frames * clip->channels * sizeof(int16_t);
+}
+
+/**
+ * @brief       释放提示音
+ */
+static void clip_free(prompt_clip_t *clip)
+{
+    heap_caps_free(clip->pcm);
+    free(clip);
+}
+
+/**
+ * @brief       从链表中移除(持有lock)
+ */
+static void cache_unlink(prompt_clip_t *clip)
+{
+    if (clip->prev) clip->prev->next = clip->next;
+    else s_head = clip->next;
+
+    if (clip->next) clip->next->prev = clip->prev;
+    else s_tail = clip->prev;
+
+    clip->prev = NULL;
+    clip->next = NULL;
+    s_stats.clips--;
+    s_stats.bytes -= clip_bytes(clip);
+}
+
+/**
+ * @brief       加到链表表头(持有lock)
+ */
+static void cache_push_front(prompt_clip_t *clip)
+{
+    clip->prev = NULL;
+    clip->next = s_head;
+
+    if (s_head) s_head->prev = clip;
+    else s_tail = clip;
+
+    s_head = clip;
+    s_stats.clips++;
+    s_stats.bytes += clip_bytes(clip);
+}
+
+/**
+ * @brief       按路径查找(持有lock)
+ */
+static prompt_clip_t *cache_find(const char *path)
+{
+    for (prompt_clip_t *clip = s_head; clip; clip = clip->next)
+    {
+        if (strcmp(clip->path, path) == 0)
+        {
+            return clip;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief       从表尾淘汰没有引用的提示音,直到再放入need字节不超过总大小(持有lock)
+ * @retval      true:空间足够
+ */
+static bool cache_make_room(size_t need)
+{
+    prompt_clip_t *clip = s_tail;
+
+    while (clip && s_stats.bytes + need > s_stats.budget)
+    {
+        prompt_clip_t *prev = clip->prev;
+
+        if (clip->refs == 0)
+        {
+            ESP_LOGI(TAG, "evict %s", clip->path);
+            cache_unlink(clip);
+            clip_free(clip);
+            s_stats.evictions++;
+        }
+
+        clip = prev;
+    }
+
+    return s_stats.bytes + need <= s_stats.budget;
+}
+
+/**
+ * @brief       设置缓存总大小和单个提示音PCM上限
+ * @note        总大小减小时立即淘汰,正在播放的提示音播完后才能被淘汰
+ * @param       budget   : 缓存总大小(字节)
+ * @param       clip_max : 单个提示音PCM上限(字节),不超过budget
+ * @retval      ESP_OK:成功; 其他:失败
+ */
+esp_err_t prompt_cache_set_limits(size_t budget, size_t clip_max)
+{
+    ESP_RETURN_ON_FALSE(clip_max <= budget, ESP_ERR_INVALID_ARG, TAG, "clip_max exceeds budget");
+    ESP_RETURN_ON_ERROR(cache_lock_init(), TAG, "cache init failed");
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.budget = budget;
+    s_stats.clip_max = clip_max;
+    cache_make_room(0);
+    xSemaphoreGive(s_lock);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief       查找已缓存的提示音
+ * @note        只做一次链表查找,不访问文件系统;命中的提示音移到表头并增加引用,
+ *              用完后调用prompt_cache_release
+ * @param       path : 文件路径
+ * @retval      提示音; NULL:未缓存
+ */
+prompt_clip_t *prompt_cache_lookup(const char *path)
+{
+    if (cache_lock_init() != ESP_OK)
+    {
+        return NULL;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    prompt_clip_t *clip = cache_find(path);
+
+    if (clip)
+    {
+        cache_unlink(clip);
+        cache_push_front(clip);
+        clip->refs++;
+        s_stats.hits++;
+    }
+    else
+    {
+        s_stats.misses++;
+    }
+
+    xSemaphoreGive(s_lock);
+
+    return clip;
+}
+
+/**
+ * @brief       解码回调,把PCM追加到缓冲区并转给tee
+ */
+static esp_err_t cache_fill(const int16_t *pcm, size_t frames, uint8_t channels, uint32_t sample_rate, void *ctx)
+{
+    prompt_fill_t *fill = (prompt_fill_t *)ctx;
+    size_t bytes = frames * channels * sizeof(int16_t);
+
+    if (!fill->overflow && fill->frames && (channels != fill->channels || sample_rate != fill->rate))
+    {
+        fill->overflow = true;                  /* 格式中途改变,整段PCM无法用一种格式播放 */
+    }
+
+    size_t used = fill->frames * channels * sizeof(int16_t);
+
+    if (!fill->overflow && used + bytes > fill->limit)
+    {
+        ESP_LOGW(TAG, "clip exceeds %u bytes, not cached", (unsigned)fill->limit);
+        fill->overflow = true;
+    }
+
+    if (!fill->overflow && used + bytes > fill->capacity)
+    {
+        size_t capacity = fill->capacity ? fill->capacity : PROMPT_CACHE_GROW;
+
+        while (capacity < used + bytes)
+        {
+            capacity *= 2;
+        }
+
+        if (capacity > fill->limit)
+        {
+            capacity = fill->limit;
+        }
+
+        int16_t *buf = heap_caps_realloc(fill->pcm, capacity, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (buf)
+        {
+            fill->pcm = buf;
+            fill->capacity = capacity;
+        }
+        else
+        {
+            ESP_LOGW(TAG, "no PSRAM for %u bytes, not cached", (unsigned)capacity);
+            fill->overflow = true;
+        }
+    }
+
+    if (fill->overflow)
+    {
+        heap_caps_free(fill->pcm);
+        fill->pcm = NULL;
+        fill->capacity = 0;
+
+        if (!fill->tee)
+        {
+            return ESP_ERR_INVALID_SIZE;        /* 只为缓存而解码,不用再继续 */
+        }
+    }
+    else
+    {
+        memcpy((uint8_t *)fill->pcm + used, pcm, bytes);
+        fill->frames += frames;
+        fill->channels = channels;
+        fill->rate = sample_rate;
+    }
+
+    return fill->tee ? fill->tee(pcm, frames, channels, sample_rate, fill->ctx) : ESP_OK;
+}
+
+/**
+ * @brief       解码文件并加入缓存
+ * @note        在调用者任务中解码整个文件;tee不为NULL时每块解码数据同时交给tee,
+ *              未命中时可以边解码边播放.文件超过单个上限或缓存放不下时只交给tee,不缓存
+ * @param       path : 文件路径
+ * @param       tee  : 同时接收解码数据,返回非ESP_OK时停止解码,可为NULL
+ * @param       ctx  : 传给tee
+ * @param       clip : 返回加入缓存的提示音并增加引用,没有缓存时为NULL;可为NULL
+ * @retval      ESP_OK:整个文件已解码; 其他:失败
+ */
+esp_err_t prompt_cache_load(const char *path, audio_player_pcm_fn tee, void *ctx, prompt_clip_t **clip)
+{
+    if (clip)
+    {
+        *clip = NULL;
+    }
+
+    ESP_RETURN_ON_FALSE(strlen(path) < PROMPT_CACHE_PATH_LEN, ESP_ERR_INVALID_ARG, TAG, "path too long");
+    ESP_RETURN_ON_ERROR(cache_lock_init(), TAG, "cache init failed");
+
+    FILE *fp = fopen(path, "rb");
+    ESP_RETURN_ON_FALSE(fp, ESP_ERR_NOT_FOUND, TAG, "Failed to open file %s", path);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    prompt_fill_t fill = {
+        .limit = s_stats.clip_max,
+        .tee = tee,
+        .ctx = ctx,
+    };
+    xSemaphoreGive(s_lock);
+
+    esp_err_t ret = audio_player_decode(fp, cache_fill, &fill);
+    fclose(fp);
+
+    if (ret == ESP_ERR_INVALID_SIZE && fill.overflow && !tee)
+    {
+        return ESP_OK;                          /* 太大不缓存,不是错误 */
+    }
+
+    if (ret != ESP_OK || fill.overflow || fill.frames == 0)
+    {
+        heap_caps_free(fill.pcm);
+        return ret;
+    }
+
+    prompt_clip_t *entry = calloc(1, sizeof(prompt_clip_t));
+    if (!entry)
+    {
+        heap_caps_free(fill.pcm);
+        return ESP_OK;                          /* 已经交给tee,只是没有缓存 */
+    }
+
+    size_t bytes = fill.frames * fill.channels * sizeof(int16_t);
+    int16_t *pcm = heap_caps_realloc(fill.pcm, bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);   /* 去掉多余的容量 */
+
+    strcpy(entry->path, path);
+    entry->pcm = pcm ? pcm : fill.pcm;
+    entry->frames = fill.frames;
+    entry->channels = fill.channels;
+    entry->rate = fill.rate;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    prompt_clip_t *existing = cache_find(path);
+
+    if (existing)
+    {
+        clip_free(entry);                       /* 其他任务同时加载了同一个文件 */
+        entry = existing;
+    }
+    else if (cache_make_room(bytes))
+    {
+        cache_push_front(entry);
+        ESP_LOGI(TAG, "cached %s, %u frames %u ch %lu Hz, %u/%u bytes", path, (unsigned)entry->frames,
+                 entry->channels, entry->rate, (unsigned)s_stats.bytes, (unsigned)s_stats.budget);
+    }
+    else
+    {
+        ESP_LOGW(TAG, "no room for %s, not cached", path);
+        clip_free(entry);
+        entry = NULL;
+    }
+
+    if (entry && clip)
+    {
+        entry->refs++;
+        *clip = entry;
+    }
+
+    xSemaphoreGive(s_lock);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief       释放提示音的引用
+ * @param       clip : prompt_cache_lookup或prompt_cache_load得到的提示音
+ * @retval      无
+ */
+void prompt_cache_release(prompt_clip_t *clip)
+{
+    if (!clip)
+    {
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    bool free_clip = (--clip->refs == 0) && clip->removed;
+    xSemaphoreGive(s_lock);
+
+    if (free_clip)
+    {
+        clip_free(clip);
+    }
+}
+
+/**
+ * @brief       预先解码一组提示音
+ * @note        开机时调用,之后第一次播放也能立即开始;已缓存的提示音跳过
+ * @param       paths : 文件路径
+ * @param       num   : 文件数
+ * @retval      ESP_OK:全部已解码; 其他:最后一个失败的错误码
+ */
+esp_err_t prompt_cache_preload(const char *const *paths, uint16_t num)
+{
+    esp_err_t ret = ESP_OK;
+
+    for (uint16_t i = 0; i < num; i++)
+    {
+        prompt_clip_t *clip = prompt_cache_lookup(paths[i]);
+
+        if (clip)
+        {
+            prompt_cache_release(clip);
+            continue;
+        }
+
+        esp_err_t err = prompt_cache_load(paths[i], NULL, NULL, NULL);
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "preload %s failed: %s", paths[i], esp_err_to_name(err));
+            ret = err;
+        }
+    }
+
+    return ret;
+}
+
+/**
+ * @brief       清空缓存
+ * @note        正在播放的提示音在引用释放后删除
+ * @param       无
+ * @retval      无
+ */
+void prompt_cache_clear(void)
+{
+    if (cache_lock_init() != ESP_OK)
+    {
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+
+    while (s_head)
+    {
+        prompt_clip_t *clip = s_head;
+        cache_unlink(clip);
+
+        if (clip->refs)
+        {
+            clip->removed = true;
+        }
+        else
+        {
+            clip_free(clip);
+        }
+    }
+
+    xSemaphoreGive(s_lock);
+}
+
+/**
+ * @brief       获取统计信息
+ * @param       stats : 统计信息
+ * @retval      无
+ */
+void prompt_cache_get_stats(prompt_cache_stats_t *stats)
+{
+    if (cache_lock_init() != ESP_OK)
+    {
+        memset(stats, 0, sizeof(prompt_cache_stats_t));
+        return;
+    }
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    *stats = s_stats;
+    xSemaphoreGive(s_lock);
+}
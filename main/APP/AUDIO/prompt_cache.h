@@ -0,0 +1,58 @@
+/**
+ ****************************************************************************************************
+ * @file        prompt_cache.h
+ * @brief       提示音PCM缓存:短提示音解码一次后整段PCM保存在PSRAM中,按LRU淘汰,
+ *              再次播放时不用打开文件和初始化解码器
+ ****************************************************************************************************
+ */
+
+#ifndef __PROMPT_CACHE_H
+#define __PROMPT_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "audio_player.h"
+
+#define PROMPT_CACHE_BUDGET         (3 * 1024 * 1024)   /* 默认缓存总大小(字节),在8MB PSRAM中 */
+#define PROMPT_CACHE_CLIP_MAX       (1536 * 1024)       /* 默认单个提示音PCM上限,44.1kHz 16位单声道约17.8s */
+#define PROMPT_CACHE_PATH_LEN       128                 /* 提示音路径最大长度 */
+#define PROMPT_CACHE_GROW           (32 * 1024)         /* 解码时PCM缓冲区的初始大小,不够时加倍 */
+
+/* 缓存的提示音,pcm等字段在持有引用期间不变 */
+typedef struct prompt_clip
+{
+    struct prompt_clip *prev;           /* LRU链表,表头最近使用 */
+    struct prompt_clip *next;
+    char path[PROMPT_CACHE_PATH_LEN];   /* 文件路径 */
+    int16_t *pcm;                       /* 16位交错PCM,在PSRAM中 */
+    size_t frames;                      /* 帧数 */
+    uint8_t channels;                   /* 声道数,1或2 */
+    uint32_t rate;                      /* 采样率 */
+    uint16_t refs;                      /* 引用数,不为0时不会被淘汰 */
+    bool removed;                       /* 已移出缓存,最后一个引用释放时删除 */
+} prompt_clip_t;
+
+typedef struct
+{
+    uint32_t hits;                      /* 命中次数 */
+    uint32_t misses;                    /* 未命中次数 */
+    uint32_t evictions;                 /* 淘汰次数 */
+    uint16_t clips;                     /* 缓存的提示音数 */
+    size_t bytes;                       /* 缓存占用的PCM字节数 */
+    size_t budget;                      /* 缓存总大小 */
+    size_t clip_max;                    /* 单个提示音PCM上限 */
+} prompt_cache_stats_t;
+
+/* 函数声明 */
+esp_err_t prompt_cache_set_limits(size_t budget, size_t clip_max);     /* 设置缓存总大小和单个提示音上限 */
+prompt_clip_t *prompt_cache_lookup(const char *path);                   /* 查找已缓存的提示音,命中时增加引用 */
+esp_err_t prompt_cache_load(const char *path, audio_player_pcm_fn tee, void *ctx,
+                            prompt_clip_t **clip);                      /* 解码文件并加入缓存 */
+void prompt_cache_release(prompt_clip_t *clip);                         /* 释放lookup/load得到的引用 */
+esp_err_t prompt_cache_preload(const char *const *paths, uint16_t num); /* 预先解码一组提示音(开机时调用) */
+void prompt_cache_clear(void);                                          /* 清空缓存 */
+void prompt_cache_get_stats(prompt_cache_stats_t *stats);              /* 获取统计信息 */
+
+#endif
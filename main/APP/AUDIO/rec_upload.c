@@ -0,0 +1,738 @@
+/**
+ ****************************************************************************************************
+ * @file        rec_upload.c
+ * @brief       边录边传
+ *              写卡任务每写入一块,把这块数据连同它在文件中的偏移放进PSRAM环形缓冲区,不用f_sync;
+ *              缓冲区放不下时只更新已写入的大小,写卡任务稍后f_sync并告诉这里已同步的大小;
+ *              请求失败后要重传的数据已经不在缓冲区中时,上传任务也通过rec_upload_feed的返回值要求同步.
+ *              上传任务按文件偏移顺序发送:缓冲区中下一段正好接在发送位置上时直接取用,
+ *              中间缺的部分(缓冲区溢出,或请求失败后回到确认的偏移重传)从SD卡上的文件读取,
+ *              只读到已同步的大小为止.每个请求都从服务器确认的偏移开始,结束时服务器回复已保存的大小;
+ *              请求中途失败时服务器已保存的数据也算数,重试前先查询服务器的大小再续传.
+ *              录音结束后文件头在开头重写,最后一个请求重传文件开头并告诉服务器最终大小.
+ *              上传任务在录音结束后继续运行直到完成,下一次录音覆盖文件之前停止
+ ****************************************************************************************************
+ */
+
+#include "rec_upload.h"
+#include "spsc_ring.h"
+#include "ff.h"
+#include "esp_http_client.h"
+#include "esp_heap_caps.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "rec_upload";
+
+#define REC_UPLOAD_SEG_HEAD     8                                       /* 缓冲区中每段数据前的偏移和长度 */
+#define REC_UPLOAD_CHUNK_HEAD   8                                       /* 分块头"xxxxxx\r\n",定长,数据紧接其后 */
+#define REC_UPLOAD_BUF_SIZE     (REC_UPLOAD_CHUNK_HEAD + REC_UPLOAD_CHUNK + 2)  /* 分块头 + 数据 + "\r\n" */
+
+static TaskHandle_t s_task;                                             /* 上传任务,退出后由rec_upload_cancel回收 */
+static SemaphoreHandle_t s_done;                                        /* 上传任务已退出 */
+static volatile bool s_active;                                          /* 上传任务在运行,rec_upload_feed才放入数据 */
+static volatile bool s_abort;                                           /* 要求上传任务退出 */
+static volatile bool s_finished;                                        /* 录音已结束,文件已关闭 */
+static volatile uint32_t s_written;                                     /* SD卡上已写入的字节数,可能还没有同步 */
+static volatile uint32_t s_durable;                                     /* SD卡上已同步的字节数,只从卡上读取这之前的数据 */
+static volatile bool s_want_sync;                                       /* 上传任务要读取还没有同步的数据 */
+static volatile uint32_t s_final;                                       /* 录音结束后的文件大小 */
+static bool s_synced;                                                   /* 确认的偏移与服务器一致,请求失败后为false */
+
+static spsc_ring_t s_ring;                                              /* 写卡 -> 上传的环形缓冲区 */
+static uint32_t s_seg_off;                                              /* 缓冲区中当前段的文件偏移(仅上传任务) */
+static uint32_t s_seg_left;                                             /* 当前段在缓冲区中剩余的字节数 */
+static FIL s_file;                                                      /* 只读打开的录音文件,溢出和重传时读取 */
+static uint8_t *s_buf;                                                  /* 一个分块(可DMA的内部RAM) */
+static esp_http_client_handle_t s_client;                               /* 请求之间复用连接 */
+
+static char s_url[96];                                                  /* 上传地址 */
+static char s_path[48];                                                 /* SD卡上的录音文件 */
+static char s_name[48];                                                 /* 服务器上的文件名,每次录音不同 */
+static char s_req_url[192];                                             /* 当前请求的地址 */
+
+/* 统计:确认的偏移由上传任务写、写卡任务读,写卡领先的峰值由写卡任务写,各自是独立的字;
+ * 其余计数只由上传任务更新.所有更新和rec_upload_get_stats的读取都持s_stats_lock,读到的是一致的快照 */
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static volatile uint32_t s_acked;                                       /* 服务器确认的字节数 */
+static volatile uint32_t s_lag_peak;                                    /* 写卡领先确认偏移的最大字节数 */
+static volatile bool s_complete;                                        /* 整个文件(含最终文件头)已确认 */
+static rec_upload_stats_t s_stats;                                      /* requests/failures/sent/spilled */
+
+#define REC_UPLOAD_STAT_ADD(field, n)   do { \
+        portENTER_CRITICAL(&s_stats_lock); \
+        s_stats.field += (n); \
+        portEXIT_CRITICAL(&s_stats_lock); \
+    } while (0)
+
+/**
+ * @brief       从服务器回复中取出一个无符号整数字段
+ * @retval      true:找到
+ */
+static bool rec_upload_json_u32(const char *body, const char *key, uint32_t *val)
+{
+    char pattern[24];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+
+    const char *p = strstr(body, pattern);
+    if (!p)
+    {
+        return false;
+    }
+
+    *val = strtoul(p + strlen(pattern), NULL, 10);
+    return true;
+}
+
+/**
+ * @brief       从SD卡读取录音文件
+ * @note        打开只读文件时目录项中的大小可能还没有包括之后写入的数据,读不够时重新打开一次
+ */
+static uint32_t rec_upload_read_file(uint32_t pos, uint8_t *dst, uint32_t len)
+{
+    UINT br = 0;
+
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        if (attempt > 0 || s_file.obj.fs == NULL)
+        {
+            if (s_file.obj.fs != NULL)
+            {
+                f_close(&s_file);
+            }
+
+            if (f_open(&s_file, s_path, FA_READ) != FR_OK)
+            {
+                return 0;
+            }
+        }
+
+        if ((f_tell(&s_file) == pos || f_lseek(&s_file, pos) == FR_OK) &&
+            f_read(&s_file, dst, len, &br) == FR_OK && br == len)
+        {
+            break;
+        }
+    }
+
+    return br;
+}
+
+/**
+ * @brief       取出文件偏移pos开始的数据,最多max字节
+ * @note        缓冲区中的段在pos之前的部分已经发过,直接丢弃;下一段在pos之后时中间的数据从SD卡读取
+ * @retval      取出的字节数,0:暂时没有新数据
+ */
+static uint32_t rec_upload_fetch(uint32_t pos, uint8_t *dst, uint32_t max)
+{
+    uint32_t durable = s_durable;
+
+    while (1)
+    {
+        if (s_seg_left == 0)
+        {
+            uint32_t head[2];
+
+            if (spsc_ring_used(&s_ring) < REC_UPLOAD_SEG_HEAD)
+            {
+                break;
+            }
+
+            spsc_ring_read(&s_ring, head, sizeof(head));
+            s_seg_off = head[0];
+            s_seg_left = head[1];
+        }
+
+        if (s_seg_off > pos)
+        {
+            break;                                                      /* 中间有缓冲区中没有的数据 */
+        }
+
+        /* 写卡任务先写段头再写数据,数据可能还没有全部放进来 */
+        uint32_t avail = spsc_ring_used(&s_ring);
+        avail = avail < s_seg_left ? avail : s_seg_left;
+
+        if (s_seg_off < pos)
+        {
+            uint32_t skip = pos - s_seg_off;
+            skip = skip < avail ? skip : avail;
+            if (skip == 0)
+            {
+                break;
+            }
+
+            spsc_ring_release(&s_ring, skip);
+            s_seg_off += skip;
+            s_seg_left -= skip;
+            continue;
+        }
+
+        uint32_t n = max < avail ? max : avail;
+        if (n == 0)
+        {
+            break;
+        }
+
+        spsc_ring_read(&s_ring, dst, n);
+        s_seg_off += n;
+        s_seg_left -= n;
+        return n;
+    }
+
+    /* 从SD卡读到缓冲区中下一段的起点为止,之后再从缓冲区取;还没有同步的数据等写卡任务同步 */
+    uint32_t end = durable;
+    if (s_seg_left > 0 && s_seg_off > pos && s_seg_off < end)
+    {
+        end = s_seg_off;
+    }
+
+    if (end <= pos)
+    {
+        if (pos < s_written)
+        {
+            s_want_sync = true;                                         /* 缓冲区中没有,卡上还没有同步 */
+        }
+
+        return 0;
+    }
+
+    uint32_t n = rec_upload_read_file(pos, dst, max < end - pos ? max : end - pos);
+    REC_UPLOAD_STAT_ADD(spilled, n);
+    return n;
+}
+
+/**
+ * @brief       开始一个请求
+ * @param       len : 请求体长度,-1为分块传输
+ */
+static esp_err_t rec_upload_open(esp_http_client_method_t method, const char *query, int len)
+{
+    snprintf(s_req_url, sizeof(s_req_url), "%s/%s%s", s_url, s_name, query);
+    esp_http_client_set_url(s_client, s_req_url);
+    esp_http_client_set_method(s_client, method);
+    REC_UPLOAD_STAT_ADD(requests, 1);
+
+    return esp_http_client_open(s_client, len);
+}
+
+/**
+ * @brief       读取回复
+ * @retval      HTTP状态码,-1:网络错误
+ */
+static int rec_upload_response(char *body, int max)
+{
+    if (esp_http_client_fetch_headers(s_client) < 0)
+    {
+        return -1;
+    }
+
+    int status = esp_http_client_get_status_code(s_client);
+    int n = esp_http_client_read_response(s_client, body, max - 1);
+    if (n < 0)
+    {
+        return -1;
+    }
+
+    body[n] = '\0';
+    return status;
+}
+
+/**
+ * @brief       处理服务器回复中的大小
+ * @note        200:已保存到这里;409:请求的偏移超过了服务器已有的大小(服务器丢了数据),从它的大小重传
+ * @retval      true:得到了服务器的大小
+ */
+static bool rec_upload_ack(int status, const char *body)
+{
+    uint32_t size;
+
+    if ((status != 200 && status != 409) || !rec_upload_json_u32(body, "size", &size))
+    {
+        ESP_LOGW(TAG, "%s: status %d", s_req_url, status);
+        return false;
+    }
+
+    if (status == 409)
+    {
+        ESP_LOGW(TAG, "server has %lu bytes, resending from there", size);
+    }
+
+    portENTER_CRITICAL(&s_stats_lock);
+    s_acked = size < s_written ? size : s_written;
+    portEXIT_CRITICAL(&s_stats_lock);
+    return true;
+}
+
+/**
+ * @brief       查询服务器已保存的大小,请求失败后从这里续传
+ */
+static bool rec_upload_sync(void)
+{
+    char body[96];
+
+    if (rec_upload_open(HTTP_METHOD_GET, "", 0) != ESP_OK)
+    {
+        return false;
+    }
+
+    int status = rec_upload_response(body, sizeof(body));
+    if (status == 404)
+    {
+        strcpy(body, "{\"size\":0}");                                   /* 服务器上还没有这个文件 */
+        status = 200;
+    }
+
+    if (!rec_upload_ack(status, body))
+    {
+        return false;
+    }
+
+    ESP_LOGI(TAG, "resuming at %lu", s_acked);
+    return true;
+}
+
+/**
+ * @brief       从确认的偏移开始分块上传,直到REC_UPLOAD_REQUEST_MS或REC_UPLOAD_REQUEST_BYTES,
+ *              或者录音结束后文件已全部发出
+ */
+static bool rec_upload_request(void)
+{
+    char query[48];
+    uint32_t pos = s_acked;
+    uint32_t limit = pos + REC_UPLOAD_REQUEST_BYTES;
+    int64_t end = esp_timer_get_time() + (int64_t)REC_UPLOAD_REQUEST_MS * 1000;
+
+    snprintf(query, sizeof(query), "?offset=%lu", pos);
+    if (rec_upload_open(HTTP_METHOD_POST, query, -1) != ESP_OK)
+    {
+        return false;
+    }
+
+    while (!s_abort && pos < limit && esp_timer_get_time() < end)
+    {
+        uint32_t max = limit - pos < REC_UPLOAD_CHUNK ? limit - pos : REC_UPLOAD_CHUNK;
+        uint32_t n = rec_upload_fetch(pos, s_buf + REC_UPLOAD_CHUNK_HEAD, max);
+
+        if (n == 0)
+        {
+            if (s_finished && pos >= s_final)
+            {
+                break;                                                  /* 整个文件已发出 */
+            }
+
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+            continue;
+        }
+
+        char head[REC_UPLOAD_CHUNK_HEAD + 1];
+        snprintf(head, sizeof(head), "%06lx\r\n", n);
+        memcpy(s_buf, head, REC_UPLOAD_CHUNK_HEAD);
+        memcpy(s_buf + REC_UPLOAD_CHUNK_HEAD + n, "\r\n", 2);
+
+        int len = REC_UPLOAD_CHUNK_HEAD + n + 2;
+        if (esp_http_client_write(s_client, (const char *)s_buf, len) != len)
+        {
+            return false;
+        }
+
+        pos += n;
+        REC_UPLOAD_STAT_ADD(sent, n);
+    }
+
+    if (s_abort || esp_http_client_write(s_client, "0\r\n\r\n", 5) != 5)
+    {
+        return false;
+    }
+
+    char body[64];
+    return rec_upload_ack(rec_upload_response(body, sizeof(body)), body);
+}
+
+/**
+ * @brief       重传文件开头(停止录音时重写了文件头)并告诉服务器最终大小
+ * @note        重新打开文件,不用只读文件中缓存的旧扇区
+ */
+static bool rec_upload_head(void)
+{
+    char query[48];
+    char body[96];
+    uint32_t len = s_final < REC_UPLOAD_CHUNK ? s_final : REC_UPLOAD_CHUNK;
+
+    if (s_file.obj.fs != NULL)
+    {
+        f_close(&s_file);
+    }
+
+    if (rec_upload_read_file(0, s_buf, len) != len)
+    {
+        ESP_LOGE(TAG, "cannot read %s", s_path);
+        return false;
+    }
+
+    snprintf(query, sizeof(query), "?offset=0&final=%lu", s_final);
+    if (rec_upload_open(HTTP_METHOD_POST, query, len) != ESP_OK ||
+        esp_http_client_write(s_client, (const char *)s_buf, len) != (int)len)
+    {
+        return false;
+    }
+
+    int status = rec_upload_response(body, sizeof(body));
+    if (!rec_upload_ack(status, body))
+    {
+        return false;
+    }
+
+    uint32_t complete = 0;
+    rec_upload_json_u32(body, "complete", &complete);
+    s_complete = (status == 200 && complete && s_acked == s_final);
+    return true;
+}
+
+/**
+ * @brief       上传任务:一直续传到服务器确认了整个文件,失败后退避重试
+ * @param       param : 传入参数(未用到,状态都在本文件的静态变量中)
+ */
+static void rec_upload_task(void *param)
+{
+    uint32_t retry_ms = REC_UPLOAD_RETRY_MS;
+
+    param = param;
+
+    while (!s_abort && !s_complete)
+    {
+        bool ok;
+
+        if (!s_synced)
+        {
+            ok = s_synced = rec_upload_sync();
+        }
+        else if (s_finished && s_acked >= s_final)
+        {
+            ok = rec_upload_head();
+        }
+        else if (s_acked >= s_written)
+        {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));               /* 等待写卡 */
+            continue;
+        }
+        else
+        {
+            ok = rec_upload_request();
+        }
+
+        if (ok)
+        {
+            retry_ms = REC_UPLOAD_RETRY_MS;
+            continue;
+        }
+
+        /* 连接可能还留着半个请求,关闭后重新连接;服务器已保存了多少要重新查询 */
+        esp_http_client_close(s_client);
+        s_synced = false;
+        REC_UPLOAD_STAT_ADD(failures, 1);
+
+        if (s_abort)
+        {
+            break;
+        }
+
+        ESP_LOGW(TAG, "upload failed at %lu, retry in %lu ms", s_acked, retry_ms);
+
+        for (uint32_t t = 0; t < retry_ms && !s_abort; t += 100)
+        {
+            vTaskDelay(pdMS_TO_TICKS(100));
+        }
+
+        retry_ms = retry_ms * 2 < REC_UPLOAD_RETRY_MAX_MS ? retry_ms * 2 : REC_UPLOAD_RETRY_MAX_MS;
+    }
+
+    s_active = false;
+
+    if (s_complete)
+    {
+        ESP_LOGI(TAG, "%s: %lu bytes uploaded, %lu sent, %lu from SD, %lu requests, %lu failures",
+                 s_name, s_final, s_stats.sent, s_stats.spilled, s_stats.requests, s_stats.failures);
+    }
+
+    xSemaphoreGive(s_done);
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief       释放上传任务的资源,任务已退出或没有创建
+ */
+static void rec_upload_free(void)
+{
+    if (s_client)
+    {
+        esp_http_client_cleanup(s_client);
+        s_client = NULL;
+    }
+
+    if (s_file.obj.fs != NULL)
+    {
+        f_close(&s_file);
+    }
+
+    spsc_ring_delete(&s_ring);
+    heap_caps_free(s_buf);
+    s_buf = NULL;
+}
+
+/**
+ * @brief       启动上传任务
+ * @note        录音文件已创建并写入占位文件头,之前的上传已用rec_upload_cancel停止;
+ *              服务器上的文件名为"<随机数>-<name>",每次录音不同,不会续传到上一次的文件上
+ * @param       url  : 上传地址,如"http://192.168.0.25:8090/upload"
+ * @param       path : SD卡上的录音文件
+ * @param       name : 文件名
+ * @retval      ESP_OK:成功;其他:失败,只保存到SD卡
+ */
+esp_err_t rec_upload_start(const char *url, const char *path, const char *name)
+{
+    if (s_task)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (!s_done)
+    {
+        s_done = xSemaphoreCreateBinary();
+        if (!s_done)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    snprintf(s_url, sizeof(s_url), "%s", url);
+    snprintf(s_path, sizeof(s_path), "%s", path);
+    snprintf(s_name, sizeof(s_name), "%08lx-%s", esp_random(), name);
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_acked = 0;
+    s_lag_peak = 0;
+    s_complete = false;
+    memset(&s_file, 0, sizeof(s_file));
+    memset(&s_ring, 0, sizeof(s_ring));
+    s_seg_left = 0;
+    s_written = 0;
+    s_durable = 0;
+    s_want_sync = false;
+    s_final = 0;
+    s_finished = false;
+    s_abort = false;
+    s_synced = true;                                                    /* 新文件,服务器上还没有数据 */
+
+    esp_http_client_config_t config = {
+        .url = s_url,
+        .timeout_ms = REC_UPLOAD_TIMEOUT_MS,
+        .keep_alive_enable = true,
+    };
+
+    s_client = esp_http_client_init(&config);
+    s_buf = heap_caps_malloc(REC_UPLOAD_BUF_SIZE, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+
+    if (!s_client || !s_buf ||
+        spsc_ring_create(&s_ring, REC_UPLOAD_RING_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) != ESP_OK)
+    {
+        rec_upload_free();
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_active = true;
+
+    if (xTaskCreatePinnedToCore(rec_upload_task, "rec_upload", REC_UPLOAD_STACK, NULL,
+                                REC_UPLOAD_PRIO, &s_task, REC_UPLOAD_CORE) != pdPASS)
+    {
+        s_active = false;
+        s_task = NULL;
+        rec_upload_free();
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(TAG, "uploading to %s/%s", s_url, s_name);
+    return ESP_OK;
+}
+
+/**
+ * @brief       写卡任务写入一块之后调用,不需要先f_sync
+ * @note        缓冲区放不下时不再放入,上传任务追到这里时从SD卡读取;请求失败后重传也可能要从SD卡读取.
+ *              返回true后写卡任务要f_sync并调用rec_upload_synced,间隔不短于REC_UPLOAD_SYNC_MS
+ * @param       offset : 这块数据在文件中的偏移
+ * @retval      true:上传任务要从SD卡读取还没有同步的数据;false:不需要同步,或者没有在上传
+ */
+bool rec_upload_feed(uint32_t offset, const void *data, uint32_t len)
+{
+    if (!s_active)
+    {
+        return false;
+    }
+
+    bool spill = spsc_ring_free(&s_ring) < REC_UPLOAD_SEG_HEAD + len;
+
+    if (!spill)
+    {
+        uint32_t head[2] = { offset, len };
+        spsc_ring_write(&s_ring, head, sizeof(head));
+        spsc_ring_write(&s_ring, data, len);
+    }
+
+    s_written = offset + len;
+
+    uint32_t lag = s_written - s_acked;
+    if (lag > s_lag_peak)
+    {
+        portENTER_CRITICAL(&s_stats_lock);
+        s_lag_peak = lag;
+        portEXIT_CRITICAL(&s_stats_lock);
+    }
+
+    xTaskNotifyGive(s_task);
+    return spill || s_want_sync;
+}
+
+/**
+ * @brief       写卡任务f_sync之后调用,上传任务可以从SD卡读取size之前的数据
+ * @param       size : 已同步的文件大小
+ */
+void rec_upload_synced(uint32_t size)
+{
+    if (!s_active)
+    {
+        return;
+    }
+
+    s_durable = size;
+    s_want_sync = false;
+    xTaskNotifyGive(s_task);
+}
+
+/**
+ * @brief       录音文件已关闭后调用,上传任务发完剩余数据后重传文件头
+ * @param       size : 文件大小
+ */
+void rec_upload_finish(uint32_t size)
+{
+    if (!s_task)
+    {
+        return;
+    }
+
+    s_written = size;
+    s_durable = size;
+    s_final = size;
+    s_finished = true;
+    xTaskNotifyGive(s_task);
+
+    ESP_LOGI(TAG, "recording closed at %lu bytes, %lu acknowledged", size, s_acked);
+}
+
+/**
+ * @brief       停止上传并回收任务
+ * @note        没有上传完的文件仍在SD卡上,服务器上保留已确认的部分
+ */
+void rec_upload_cancel(void)
+{
+    if (!s_task)
+    {
+        return;
+    }
+
+    s_abort = true;
+    xTaskNotifyGive(s_task);
+    xSemaphoreTake(s_done, portMAX_DELAY);
+    s_task = NULL;
+
+    if (!s_complete)
+    {
+        ESP_LOGW(TAG, "%s: stopped with %lu of %lu bytes acknowledged", s_name, s_acked, s_written);
+    }
+
+    rec_upload_free();
+}
+
+/**
+ * @brief       等待上传完成
+ * @retval      true:服务器已确认整个文件
+ */
+bool rec_upload_wait(uint32_t timeout_ms)
+{
+    if (s_task && xSemaphoreTake(s_done, pdMS_TO_TICKS(timeout_ms)) == pdTRUE)
+    {
+        xSemaphoreGive(s_done);                                         /* 留给rec_upload_cancel回收任务 */
+    }
+
+    return s_complete;
+}
+
+/**
+ * @brief       上传完成后比较服务器上的文件和SD卡上的文件
+ * @retval      ESP_OK:大小和CRC32都相同
+ */
+esp_err_t rec_upload_verify(void)
+{
+    if (!s_complete || s_active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    char body[96];
+    uint32_t size = 0;
+    uint32_t crc = 0;
+    int status = -1;
+
+    if (rec_upload_open(HTTP_METHOD_GET, "", 0) == ESP_OK)
+    {
+        status = rec_upload_response(body, sizeof(body));
+    }
+
+    if (status != 200 || !rec_upload_json_u32(body, "size", &size) || !rec_upload_json_u32(body, "crc32", &crc))
+    {
+        ESP_LOGE(TAG, "%s: status %d", s_req_url, status);
+        return ESP_FAIL;
+    }
+
+    uint32_t local = 0;
+    uint32_t total = 0;
+    UINT br;
+    FIL file;
+
+    if (f_open(&file, s_path, FA_READ) != FR_OK)
+    {
+        return ESP_FAIL;
+    }
+
+    while (f_read(&file, s_buf, REC_UPLOAD_CHUNK, &br) == FR_OK && br > 0)
+    {
+        local = esp_rom_crc32_le(local, s_buf, br);
+        total += br;
+    }
+
+    f_close(&file);
+
+    bool ok = (size == total && crc == local);
+    ESP_LOGI(TAG, "verify %s: server %lu bytes crc32 %08lx, SD %lu bytes crc32 %08lx",
+             ok ? "ok" : "MISMATCH", size, crc, total, local);
+
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * @brief       获取统计信息
+ * @note        可以在任何任务中调用,上传和写卡任务同时在更新,这里取一次一致的快照
+ */
+void rec_upload_get_stats(rec_upload_stats_t *stats)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    *stats = s_stats;
+    stats->acked = s_acked;
+    stats->lag_peak = s_lag_peak;
+    stats->complete = s_complete;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
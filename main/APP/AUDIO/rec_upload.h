@@ -0,0 +1,58 @@
+/**
+ ****************************************************************************************************
+ * @file        rec_upload.h
+ * @brief       边录边传:录音文件写卡的同时用HTTP分块传输(chunked)上传到服务器
+ * @note        写卡任务每写一块就把同样的数据交给上传任务,网络跟得上时上传的数据直接来自内存,不用f_sync;
+ *              网络慢于录音时内存放不下的数据不再排队,上传任务追赶时从SD卡上的文件读取,
+ *              SD卡上的文件同时就是溢出缓冲区;请求失败后重传的数据也从SD卡读取.
+ *              上传任务只读取已同步的部分,要读取的数据还没有同步时写卡任务最多每REC_UPLOAD_SYNC_MS同步一次.
+ *              协议(服务器见tools/upload_server.py):
+ *              POST <url>/<name>?offset=N      请求体(分块传输)写到文件偏移N处,N不能大于服务器已有的大小;
+ *                                              回复 {"size":S},S为服务器已保存的大小,即确认的偏移
+ *              POST <url>/<name>?offset=0&final=S  录音结束后的最终文件头,服务器截断到S并标记完成
+ *              GET  <url>/<name>               回复 {"size":S,"complete":0/1,"crc32":C},请求失败后据此续传
+ *              每个请求最长REC_UPLOAD_REQUEST_MS,结束时得到一次确认;请求失败后从服务器确认的偏移重传
+ ****************************************************************************************************
+ */
+
+#ifndef __REC_UPLOAD_H
+#define __REC_UPLOAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+#define REC_UPLOAD_RING_SIZE        (256 * 1024)        /* 写卡 -> 上传的环形缓冲区(2的幂,PSRAM),放不下时从SD卡读取 */
+#define REC_UPLOAD_CHUNK            (8 * 1024)          /* 每个分块的最大数据字节数 */
+#define REC_UPLOAD_REQUEST_MS       2000                /* 每个请求最长时长,结束时服务器确认一次 */
+#define REC_UPLOAD_REQUEST_BYTES    (2 * 1024 * 1024)   /* 每个请求最多上传的字节数 */
+#define REC_UPLOAD_TIMEOUT_MS       5000                /* 网络读写超时 */
+#define REC_UPLOAD_RETRY_MS         500                 /* 失败后首次重试的间隔,之后加倍 */
+#define REC_UPLOAD_RETRY_MAX_MS     8000                /* 重试间隔上限 */
+#define REC_UPLOAD_SYNC_MS          1000                /* 有数据要从SD卡读取时,写卡任务f_sync的最小间隔 */
+#define REC_UPLOAD_CORE             0                   /* 上传任务所在核心,与WiFi和写卡相同 */
+#define REC_UPLOAD_PRIO             4                   /* 上传任务优先级,低于写卡 */
+#define REC_UPLOAD_STACK            6144                /* 上传任务堆栈大小 */
+
+typedef struct
+{
+    uint32_t requests;                  /* 发出的请求数 */
+    uint32_t failures;                  /* 失败的请求数 */
+    uint32_t sent;                      /* 发出的字节数,含重传 */
+    uint32_t acked;                     /* 服务器确认的字节数 */
+    uint32_t spilled;                   /* 内存放不下、从SD卡读取后上传的字节数 */
+    uint32_t lag_peak;                  /* 写卡领先确认偏移的最大字节数 */
+    bool complete;                      /* 整个文件(含最终文件头)已确认 */
+} rec_upload_stats_t;
+
+/* 函数声明 */
+esp_err_t rec_upload_start(const char *url, const char *path, const char *name);   /* 文件已写入占位文件头后启动上传任务 */
+bool rec_upload_feed(uint32_t offset, const void *data, uint32_t len);              /* 写卡任务写入后交给上传任务,返回true时要同步 */
+void rec_upload_synced(uint32_t size);                                              /* 写卡任务f_sync之后调用,SD卡上已同步的大小 */
+void rec_upload_finish(uint32_t size);                                              /* 文件已关闭,上传剩余数据和最终文件头,不等待 */
+void rec_upload_cancel(void);                                                       /* 停止上传,覆盖录音文件之前调用 */
+bool rec_upload_wait(uint32_t timeout_ms);                                          /* 等待上传完成 */
+esp_err_t rec_upload_verify(void);                                                  /* 服务器上文件的大小和CRC32与SD卡上的相同 */
+void rec_upload_get_stats(rec_upload_stats_t *stats);                               /* 获取统计信息 */
+
+#endif
@@ -1,87 +1,738 @@
 // recorder.c
+//
+// 采集和写卡分开: 采集任务阻塞在 I2S 读取上, 把数据放进 PSRAM 环形缓冲区;
+// 写卡任务每次从缓冲区取 REC_WRITE_SIZE 字节, 拷贝到可 DMA 的内部 RAM 后 f_write.
+// 文件开始录音时用 f_expand 预分配连续的簇, 写卡时不用逐簇查找空闲簇和更新 FAT,
+// 每次写到文件偏移的 REC_WRITE_SIZE 边界, FatFs 直接发多块写命令.
+// 写卡偶尔停顿几百毫秒时数据留在缓冲区中, 不会丢失.
+// REC_FORMAT 为 ADPCM 时采集任务攒够一块 PCM 后编码为 IMA ADPCM, 直接编码进环形缓冲区,
+// 只保存整块, 缓冲区写索引总在块边界上, 预留的区域不会在回绕处被截断.
+// REC_FORMAT 为 FLAC 时采集任务只把 PCM 放进另一个 PSRAM 环形缓冲区, 编码任务和采集任务在同一个核心上,
+// 优先级低于采集, 采集阻塞在 I2S 读取时每次取一块 PCM 编码为一个 FLAC 帧, 放进写卡的环形缓冲区.
+// PCM 缓冲区大小是整块的整数倍, 每块在缓冲区中都是连续的. 写卡缓冲区放不下一帧时编码任务等待写卡,
+// PCM 缓冲区满时由采集任务丢弃数据.
+// REC_PRE_ROLL_MS 大于 0 时不录音也一直采集, 采集写入的缓冲区加大预录的大小, 采集任务自己丢弃最早的整块,
+// 只保留最近 REC_PRE_ROLL_MS 的数据. 开始录音时采集任务不再丢弃, 编码和写卡任务先按整块取完这些数据,
+// 文件从按键之前开始, 和之后采集的数据之间没有间断.
+// REC_VAD 为 1 时采集任务先把数据交给语音活动检测, 只有语音段内的数据才交给编码或写卡;
+// 每段结束时检测器把段的位置放进队列, 写卡任务把它追加到索引文件.
+// REC_UPLOAD 为 1 时写卡任务每写入一块就把这块交给上传任务, 边录边传, 网络跟得上时不用 f_sync;
+// 上传任务来不及或请求失败后重传时从 SD 卡上的文件读取, 这些数据还没有同步时写卡任务最多每 REC_UPLOAD_SYNC_MS 同步一次,
+// 停止录音后继续上传, 下一次录音覆盖文件之前停止.
 #include "record.h"
+#include "audio_engine.h"
 #include "driver/i2s.h"
 #include "es8388.h"
 #include "audioplay.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "spsc_ring.h"
+#include "audio_adpcm.h"
+#include "audio_flac_enc.h"
+#include "vad.h"
+#include "rec_upload.h"
 #include "ff.h"   // 文件系统 API（必须）
 
+#if AUDIO_ENGINE_FIXED_RATE != REC_SAMPLE_RATE
+#warning "AUDIO_ENGINE_FIXED_RATE 与 REC_SAMPLE_RATE 不同, 每次开始录音都要停止播放引擎"
+#endif
+
 
 #define TAG "recorder"
 
+#if REC_FORMAT == REC_FORMAT_FLAC
+#define REC_HEADER_SIZE FLAC_ENC_HEADER_SIZE  // "fLaC" 和 STREAMINFO
+#elif REC_FORMAT == REC_FORMAT_ADPCM
+#define REC_HEADER_SIZE 60                 // WAV 文件头大小, fmt 块带 cbSize 和每块帧数, 另有 fact 块
+#else
+#define REC_HEADER_SIZE 44                 // WAV 文件头大小
+#endif
+#define REC_FRAME_BYTES (REC_CHANNELS * REC_BITS / 8)  // 每帧字节数
+#if REC_FORMAT == REC_FORMAT_FLAC
+#define REC_FORMAT_NAME "FLAC"
+#elif REC_FORMAT == REC_FORMAT_ADPCM
+#define REC_FORMAT_NAME "IMA ADPCM"
+#else
+#define REC_FORMAT_NAME "PCM"
+#endif
+#define REC_FLAC_BLOCK_BYTES (REC_FLAC_BLOCK * REC_FRAME_BYTES)  // 一块 PCM 的字节数
+
+// 采集任务写入的环形缓冲区: FLAC 时是 PCM 缓冲区, 否则直接写入写卡缓冲区; 预录时丢弃数据的单位是整块
+#if REC_FORMAT == REC_FORMAT_FLAC
+#define REC_CAPTURE_RING (&rec_pcm_ring)
+#define REC_CAPTURE_RING_SIZE REC_PCM_RING_SIZE
+#define REC_TRIM_UNIT REC_FLAC_BLOCK_BYTES
+#elif REC_FORMAT == REC_FORMAT_ADPCM
+#define REC_CAPTURE_RING (&rec_ring)
+#define REC_CAPTURE_RING_SIZE REC_RING_SIZE
+#define REC_TRIM_UNIT REC_ADPCM_BLOCK
+#else
+#define REC_CAPTURE_RING (&rec_ring)
+#define REC_CAPTURE_RING_SIZE REC_RING_SIZE
+#define REC_TRIM_UNIT BUF_SIZE
+#endif
+#define REC_PRE_ROLL_BYTES ((uint32_t)((uint64_t)REC_DATA_RATE * REC_PRE_ROLL_MS / 1000))  // 预录保留的字节数
+
+#if REC_VAD && REC_PRE_ROLL_MS > 0
+#error "语音活动检测自带预录, REC_VAD 和 REC_PRE_ROLL_MS 不能同时使用"
+#endif
+
 static FIL f_rec;                          // 文件对象
-static uint8_t audio_buf[BUF_SIZE];       // 音频数据缓冲区
-static uint8_t recording = 0;             // 录音标志位
+static uint8_t audio_buf[BUF_SIZE] __attribute__((aligned(4)));  // 缓冲区满时丢弃数据用的缓冲区, 语音活动检测时的采集缓冲区
+static volatile uint8_t capturing = 0;    // 采集标志位, 清零后采集任务退出
+static volatile uint8_t recording = 0;    // 录音标志位, 预录时为 0 表示采集的数据只保留最近的一段
+static volatile uint8_t rec_consumers = 0;  // 编码和写卡任务已创建, 采集任务可以通知它们
+static volatile uint8_t encoding = 0;     // 编码标志位, 采集任务退出后清零, 编码任务随后退出
+static volatile uint8_t writing = 0;      // 写卡标志位, 采集和编码任务退出后清零, 写卡任务随后退出
 static uint32_t g_wav_size = 0;           // 已录制的字节总数
 
 static QueueHandle_t rec_cmd_queue;       // 控制命令队列
-static SemaphoreHandle_t rec_mutex;       // 录音互斥锁
+static SemaphoreHandle_t rec_mutex;       // 串行执行录音命令
+static SemaphoreHandle_t rec_done;        // 采集, 编码和写卡任务已退出(计数)
+#if REC_PRE_ROLL_MS > 0
+static SemaphoreHandle_t rec_ack;         // 采集任务已看到开始录音, 不再丢弃数据
+static volatile uint8_t rec_keeping;      // 采集任务已确认开始录音
+static uint8_t listening;                 // 正在预录(I2S 和采集任务在运行)
+#endif
+
+static spsc_ring_t rec_ring;              // 采集 -> 写卡的环形缓冲区(PSRAM)
+static uint8_t *rec_wbuf;                 // 写卡缓冲区(可 DMA 的内部 RAM)
+static TaskHandle_t rec_writer;           // 写卡任务, 有新数据时通知
+static recorder_stats_t rec_stats;        // 录音统计
+static uint32_t rec_dma_ovf_start;        // 开始录音时的 I2S 接收溢出次数
 
+#if REC_FORMAT == REC_FORMAT_ADPCM
+static int16_t *rec_pcm;                  // 正在攒的一块 PCM(内部 RAM)
+static uint32_t rec_pcm_frames;           // rec_pcm 中的帧数
+static audio_adpcm_state_t rec_adpcm;     // 编码器在块之间保持的状态
+#elif REC_FORMAT == REC_FORMAT_FLAC
+static spsc_ring_t rec_pcm_ring;          // 采集 -> 编码的 PCM 环形缓冲区(PSRAM)
+static uint8_t *rec_frame;                // 编码输出的一帧(内部 RAM)
+static uint32_t rec_frame_max;            // 一帧的最大字节数
+static flac_enc_t rec_flac;               // FLAC 编码器
+static TaskHandle_t rec_encoder;          // 编码任务, 有整块 PCM 时通知
+static SemaphoreHandle_t rec_space;       // 写卡任务每写完一块释放, 写卡缓冲区满时编码任务等待它
+#endif
 
+#if REC_UPLOAD
+static bool rec_upload_pending;           // 上传任务要从卡上读取还没有同步的数据
+static int64_t rec_upload_sync_us;        // 上一次为上传同步的时间
+#endif
 
-static void write_wav_header_placeholder(FIL *file)
+#if REC_VAD
+static vad_t *rec_vad;                    // 语音活动检测
+static QueueHandle_t rec_seg_queue;       // 已结束的段, 采集 -> 写卡
+static FIL f_idx;                         // 段索引文件
+#endif
+
+
+
+// 写入 WAV 文件头, 开始录音时大小都填 0, 停止录音后用实际大小重写
+static void write_wav_header(FIL *file, uint32_t data_size, uint32_t frames)
 {
-    uint8_t wav_header[44] = {0};
+    uint8_t wav_header[REC_HEADER_SIZE] = {0};
+    uint8_t *data = &wav_header[REC_HEADER_SIZE - 8];
 
     // "RIFF" chunk descriptor
     memcpy(&wav_header[0], "RIFF", 4);
-    *(uint32_t *)&wav_header[4] = 0;  // Placeholder for file size
+    *(uint32_t *)&wav_header[4] = REC_HEADER_SIZE - 8 + data_size;   // ChunkSize
     memcpy(&wav_header[8], "WAVE", 4);
 
     // "fmt " sub-chunk
     memcpy(&wav_header[12], "fmt ", 4);
+    *(uint16_t *)&wav_header[22] = REC_CHANNELS;      // NumChannels
+    *(uint32_t *)&wav_header[24] = REC_SAMPLE_RATE;   // SampleRate
+#if REC_FORMAT == REC_FORMAT_ADPCM
+    *(uint32_t *)&wav_header[16] = 20;                // Subchunk1Size, 带 cbSize 和 wSamplesPerBlock
+    *(uint16_t *)&wav_header[20] = AUDIO_ADPCM_FORMAT_IMA;  // AudioFormat: IMA ADPCM = 0x11
+    *(uint32_t *)&wav_header[28] = REC_DATA_RATE;     // ByteRate, 平均值
+    *(uint16_t *)&wav_header[32] = REC_ADPCM_BLOCK;   // BlockAlign = 块大小
+    *(uint16_t *)&wav_header[34] = 4;                 // BitsPerSample
+    *(uint16_t *)&wav_header[36] = 2;                 // cbSize
+    *(uint16_t *)&wav_header[38] = REC_ADPCM_SPB;     // wSamplesPerBlock
+
+    // "fact" sub-chunk, 最后一块补齐的帧不算在内
+    memcpy(&wav_header[40], "fact", 4);
+    *(uint32_t *)&wav_header[44] = 4;
+    *(uint32_t *)&wav_header[48] = frames;
+#else
     *(uint32_t *)&wav_header[16] = 16;                // Subchunk1Size for PCM
     *(uint16_t *)&wav_header[20] = 1;                 // AudioFormat: PCM = 1
-    *(uint16_t *)&wav_header[22] = 1;                 // NumChannels: Mono = 1
-    *(uint32_t *)&wav_header[24] = 16000;             // SampleRate
-    *(uint32_t *)&wav_header[28] = 16000 * 2;         // ByteRate = SampleRate * NumChannels * BitsPerSample/8
-    *(uint16_t *)&wav_header[32] = 2;                 // BlockAlign = NumChannels * BitsPerSample/8
-    *(uint16_t *)&wav_header[34] = 16;                // BitsPerSample
+    *(uint32_t *)&wav_header[28] = REC_BYTE_RATE;     // ByteRate = SampleRate * NumChannels * BitsPerSample/8
+    *(uint16_t *)&wav_header[32] = REC_FRAME_BYTES;   // BlockAlign = NumChannels * BitsPerSample/8
+    *(uint16_t *)&wav_header[34] = REC_BITS;          // BitsPerSample
+    (void)frames;
+#endif
 
     // "data" sub-chunk
-    memcpy(&wav_header[36], "data", 4);
-    *(uint32_t *)&wav_header[40] = 0;  // Placeholder for data size
+    memcpy(&data[0], "data", 4);
+    *(uint32_t *)&data[4] = data_size;                // Subchunk2Size
 
     UINT bw;
+    f_lseek(file, 0);
     f_write(file, wav_header, sizeof(wav_header), &bw);
 }
 
 
-// 在停止录音后修复 WAV 文件头
-static void fix_wav_header(FIL *file, uint32_t data_size)
+// 写入文件头, FLAC 开始录音时帧数和帧大小未知, 停止录音后用编码器统计的值重写
+static void write_rec_header(FIL *file, uint32_t data_size, uint32_t frames)
+{
+#if REC_FORMAT == REC_FORMAT_FLAC
+    uint8_t header[REC_HEADER_SIZE];
+    UINT bw;
+
+    flac_enc_header(&rec_flac, header);
+    f_lseek(file, 0);
+    f_write(file, header, sizeof(header), &bw);
+    (void)data_size;
+    (void)frames;
+#else
+    write_wav_header(file, data_size, frames);
+#endif
+}
+
+
+// 从环形缓冲区取 len 字节写入文件
+static void rec_write(uint32_t len)
+{
+    uint32_t n = spsc_ring_read(&rec_ring, rec_wbuf, len);
+    if (n == 0) {
+        return;
+    }
+
+    UINT bw = 0;
+    int64_t start = esp_timer_get_time();
+    FRESULT res = f_write(&f_rec, rec_wbuf, n, &bw);
+    uint32_t us = esp_timer_get_time() - start;
+
+    if (us > rec_stats.write_max_us) {
+        rec_stats.write_max_us = us;
+    }
+
+    if (res != FR_OK || bw < n) {
+        if (rec_stats.write_errors++ == 0) {
+            ESP_LOGE(TAG, "写入录音文件失败: %d", res);
+        }
+    }
+
+    g_wav_size += bw;
+
+#if REC_UPLOAD
+    // 上传任务的缓冲区放得下时直接从内存上传; 放不下的块和失败后重传的数据要从卡上读取, 隔一段时间同步一次数据和目录项中的大小
+    if (rec_upload_feed(f_tell(&f_rec) - bw, rec_wbuf, bw)) {
+        rec_upload_pending = true;
+    }
+    int64_t now = esp_timer_get_time();
+    if (rec_upload_pending && now - rec_upload_sync_us >= REC_UPLOAD_SYNC_MS * 1000LL) {
+        f_sync(&f_rec);
+        rec_upload_synced(f_tell(&f_rec));
+        rec_upload_pending = false;
+        rec_upload_sync_us = now;
+    }
+#endif
+}
+
+
+#if REC_FORMAT == REC_FORMAT_ADPCM
+// 把 rec_pcm 中攒的 PCM 编码为一块放进环形缓冲区, 不满一块时重复最后一帧补齐
+// 缓冲区放不下时丢弃这一块, 下一块的块头带有完整的解码状态, 之后的数据不受影响
+static void rec_encode_block(void)
+{
+    uint32_t len = REC_ADPCM_BLOCK;
+    uint8_t *dst = spsc_ring_reserve(&rec_ring, &len);
+
+    if (len < REC_ADPCM_BLOCK) {
+        rec_stats.overflows++;
+        rec_stats.dropped += REC_ADPCM_BLOCK;
+    } else {
+        int64_t start = esp_timer_get_time();
+        audio_adpcm_encode_block(&rec_adpcm, rec_pcm, rec_pcm_frames, REC_CHANNELS, dst, REC_ADPCM_BLOCK);
+        rec_stats.encode_us += esp_timer_get_time() - start;
+        spsc_ring_commit(&rec_ring, REC_ADPCM_BLOCK);
+        rec_stats.frames += rec_pcm_frames;
+    }
+
+    rec_pcm_frames = 0;
+}
+#elif REC_FORMAT == REC_FORMAT_FLAC
+// 从 PCM 缓冲区取 frames 帧编码为一个 FLAC 帧放进写卡缓冲区, 放不下时丢弃这些 PCM
+static void rec_encode_frame(uint32_t frames)
+{
+    uint32_t len = frames * REC_FRAME_BYTES;
+    const int16_t *pcm = spsc_ring_peek(&rec_pcm_ring, 0, &len);   // 块从缓冲区的块边界开始, 不会回绕
+
+    if (spsc_ring_free(&rec_ring) < rec_frame_max) {
+        rec_stats.overflows++;
+        rec_stats.dropped += len;
+    } else {
+        int64_t start = esp_timer_get_time();
+        size_t n = flac_enc_frame(&rec_flac, pcm, len / REC_FRAME_BYTES, rec_frame);
+        rec_stats.encode_us += esp_timer_get_time() - start;
+        spsc_ring_write(&rec_ring, rec_frame, n);
+        rec_stats.frames += len / REC_FRAME_BYTES;
+    }
+
+    spsc_ring_release(&rec_pcm_ring, len);
+}
+#endif
+
+
+#if REC_VAD
+// 语音段内的数据, 检测器在采集任务中调用, 按录音格式交给下一级
+static void rec_vad_commit(const int16_t *pcm, size_t frames, void *arg)
 {
-    uint32_t file_size = data_size + 36;
+#if REC_FORMAT == REC_FORMAT_ADPCM
+    while (frames > 0) {
+        uint32_t n = REC_ADPCM_SPB - rec_pcm_frames;
+        if (n > frames) {
+            n = frames;
+        }
 
-    f_lseek(file, 4);  // ChunkSize
+        memcpy(&rec_pcm[rec_pcm_frames * REC_CHANNELS], pcm, n * REC_FRAME_BYTES);
+        rec_pcm_frames += n;
+        pcm += n * REC_CHANNELS;
+        frames -= n;
+
+        if (rec_pcm_frames == REC_ADPCM_SPB) {
+            rec_encode_block();
+        }
+    }
+#else
+#if REC_FORMAT == REC_FORMAT_FLAC
+    spsc_ring_t *ring = &rec_pcm_ring;
+#else
+    spsc_ring_t *ring = &rec_ring;
+#endif
+    uint32_t len = frames * REC_FRAME_BYTES;
+
+    // 放不下时整次丢弃, 声道不会错位
+    if (spsc_ring_free(ring) < len) {
+        rec_stats.overflows++;
+        rec_stats.dropped += len;
+    } else {
+        spsc_ring_write(ring, pcm, len);
+    }
+#endif
+}
+
+// 一段结束, 交给写卡任务追加到索引文件
+static void rec_vad_segment(const vad_segment_t *segment, void *arg)
+{
+    xQueueSend(rec_seg_queue, segment, 0);
+}
+
+// 把队列中已结束的段追加到索引文件
+static void rec_write_segments(void)
+{
+    vad_segment_t seg;
     UINT bw;
-    f_write(file, &file_size, 4, &bw);
 
-    f_lseek(file, 40);  // Subchunk2Size
-    f_write(file, &data_size, 4, &bw);
+    while (xQueueReceive(rec_seg_queue, &seg, 0) == pdTRUE) {
+        if (f_write(&f_idx, &seg, sizeof(seg), &bw) != FR_OK || bw < sizeof(seg)) {
+            rec_stats.write_errors++;
+        }
+    }
+}
+
+// 创建检测器, 打开索引文件并写入文件头
+static bool rec_vad_open(void)
+{
+    vad_config_t cfg = VAD_DEFAULT_CONFIG();
+    cfg.sample_rate = REC_SAMPLE_RATE;
+    cfg.channels = REC_CHANNELS;
+    cfg.threshold_db = REC_VAD_THRESHOLD_DB;
+    cfg.hangover_ms = REC_VAD_HANGOVER_MS;
+    cfg.pre_roll_ms = REC_VAD_PRE_ROLL_MS;
+    cfg.commit_fn = rec_vad_commit;
+    cfg.segment_fn = rec_vad_segment;
+
+    rec_vad = vad_create(&cfg);
+    if (!rec_vad) {
+        return false;
+    }
+
+    if (f_open(&f_idx, REC_INDEX_PATH, FA_CREATE_ALWAYS | FA_WRITE) != FR_OK) {
+        vad_delete(rec_vad);
+        rec_vad = NULL;
+        return false;
+    }
+
+    uint8_t header[12];
+    UINT bw;
+    memcpy(&header[0], "RVAD", 4);
+    *(uint16_t *)&header[4] = 1;                    // 版本
+    *(uint16_t *)&header[6] = REC_CHANNELS;
+    *(uint32_t *)&header[8] = REC_SAMPLE_RATE;
+    f_write(&f_idx, header, sizeof(header), &bw);
+
+    xQueueReset(rec_seg_queue);
+    return true;
+}
+
+// 关闭索引文件, 删除检测器
+static void rec_vad_close(void)
+{
+    if (f_idx.obj.fs != NULL) {
+        f_close(&f_idx);
+    }
+    vad_delete(rec_vad);
+    rec_vad = NULL;
+}
+#endif
+
+
+#if REC_PRE_ROLL_MS > 0
+// 预录时采集任务自己丢弃最早的数据, 只保留 REC_PRE_ROLL_BYTES; 整块丢弃, 读索引仍在块边界上
+static void rec_trim_pre_roll(spsc_ring_t *ring)
+{
+    uint32_t used = spsc_ring_used(ring);
+
+    if (used > REC_PRE_ROLL_BYTES) {
+        uint32_t len = (used - REC_PRE_ROLL_BYTES + REC_TRIM_UNIT - 1) / REC_TRIM_UNIT * REC_TRIM_UNIT;
+        spsc_ring_release(ring, len);
+    }
+}
+#endif
+
+
+// 采集任务: 从 I2S 读取数据放进环形缓冲区, 缓冲区满时读出后丢弃, 保证 I2S 不溢出
+// 预录时不录音也一直运行, 开始录音后不再丢弃最早的数据, 确认后编码和写卡任务才开始取数据
+static void recorder_capture_task(void *param)
+{
+    spsc_ring_t *ring = REC_CAPTURE_RING;
+
+    while (capturing) {
+#if REC_VAD
+        // 检测器只把语音段内的数据交给下一级, 每次读取的数据不必是整块
+        size_t bytes_read = i2s_rx_read(audio_buf, BUF_SIZE);
+        vad_write(rec_vad, (const int16_t *)audio_buf, bytes_read / REC_FRAME_BYTES);
+#elif REC_FORMAT == REC_FORMAT_ADPCM
+        // 先读进内部 RAM 攒够一块, 每次最多 BUF_SIZE 字节
+        uint32_t len = (REC_ADPCM_SPB - rec_pcm_frames) * REC_FRAME_BYTES;
+        if (len > BUF_SIZE) {
+            len = BUF_SIZE;
+        }
+
+        size_t bytes_read = i2s_rx_read((uint8_t *)&rec_pcm[rec_pcm_frames * REC_CHANNELS], len);
+        rec_pcm_frames += bytes_read / REC_FRAME_BYTES;
+
+        if (rec_pcm_frames == REC_ADPCM_SPB) {
+            rec_encode_block();
+        }
+#else
+        uint32_t len = BUF_SIZE;
+        uint8_t *dst = spsc_ring_reserve(ring, &len);         // 回绕处只读到缓冲区末尾
+        len -= len % REC_FRAME_BYTES;                         // 只读整帧, 丢弃数据后声道不会错位
+
+        if (len == 0) {
+            size_t bytes_read = i2s_rx_read(audio_buf, BUF_SIZE);
+            rec_stats.overflows++;
+            rec_stats.dropped += bytes_read;
+        } else {
+            size_t bytes_read = i2s_rx_read(dst, len);  // 从 I2S 读取数据
+            spsc_ring_commit(ring, bytes_read);
+        }
+#endif
+
+#if REC_PRE_ROLL_MS > 0
+        if (!recording) {
+            rec_trim_pre_roll(ring);
+            continue;
+        }
+
+        if (!rec_keeping) {
+            // 从这里开始缓冲区中的数据都写进文件, 之前编码的块都算在录音中
+            rec_keeping = 1;
+#if REC_FORMAT == REC_FORMAT_ADPCM
+            rec_stats.frames = spsc_ring_used(ring) / REC_ADPCM_BLOCK * REC_ADPCM_SPB;
+            rec_stats.encode_us = 0;
+#endif
+            xSemaphoreGive(rec_ack);
+        }
+#endif
+
+        if (!rec_consumers) {
+            continue;
+        }
+
+#if REC_FORMAT == REC_FORMAT_FLAC
+        if (spsc_ring_used(ring) >= REC_FLAC_BLOCK_BYTES) {
+            xTaskNotifyGive(rec_encoder);
+        }
+#else
+        uint32_t used = spsc_ring_used(ring);
+        if (used > rec_stats.ring_peak) {
+            rec_stats.ring_peak = used;
+        }
+
+        if (used >= REC_WRITE_SIZE) {
+            xTaskNotifyGive(rec_writer);
+        }
+#endif
+    }
+
+    xSemaphoreGive(rec_done);
+    vTaskDelete(NULL);
+}
+
+
+#if REC_FORMAT == REC_FORMAT_FLAC
+// 编码任务: PCM 缓冲区有整块时编码, 最后不满一块的数据由停止录音时编码
+// 写卡缓冲区放不下一帧时等待写卡, 预录的几秒数据一次编码完时也不会丢帧
+static void recorder_encode_task(void *param)
+{
+    while (encoding) {
+        if (spsc_ring_used(&rec_pcm_ring) < REC_FLAC_BLOCK_BYTES) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+            continue;
+        }
+
+        if (spsc_ring_free(&rec_ring) < rec_frame_max) {
+            xTaskNotifyGive(rec_writer);
+            xSemaphoreTake(rec_space, pdMS_TO_TICKS(100));
+            continue;
+        }
+
+        rec_encode_frame(REC_FLAC_BLOCK);
+
+        uint32_t used = spsc_ring_used(&rec_ring);
+        if (used > rec_stats.ring_peak) {
+            rec_stats.ring_peak = used;
+        }
+
+        if (used >= REC_WRITE_SIZE) {
+            xTaskNotifyGive(rec_writer);
+        }
+    }
+
+    xSemaphoreGive(rec_done);
+    vTaskDelete(NULL);
+}
+#endif
+
+
+// 写卡任务: 缓冲区攒够一块时写到下一个块边界, 文件头之后的每次写入都是对齐的整块
+static void recorder_writer_task(void *param)
+{
+    while (writing) {
+#if REC_VAD
+        rec_write_segments();
+#endif
+        uint32_t len = REC_WRITE_SIZE - f_tell(&f_rec) % REC_WRITE_SIZE;
+
+        if (spsc_ring_used(&rec_ring) < len) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+            continue;
+        }
+
+        rec_write(len);
+#if REC_FORMAT == REC_FORMAT_FLAC
+        // 停止录音时编码任务先退出, 不能再通知它; 信号量一直存在, 没有人等待时释放也没关系
+        xSemaphoreGive(rec_space);
+#endif
+    }
+
+    xSemaphoreGive(rec_done);
+    vTaskDelete(NULL);
+}
+
+
+// 采集一侧的缓冲区: 采集任务写入的环形缓冲区, 预录时加上预录的大小; ADPCM 正在攒的一块
+static bool rec_alloc_capture(void)
+{
+    uint32_t size = REC_CAPTURE_RING_SIZE;
+    while (size < REC_CAPTURE_RING_SIZE + REC_PRE_ROLL_BYTES) {
+        size *= 2;                           // 环形缓冲区大小必须是 2 的幂
+    }
+
+    memset(REC_CAPTURE_RING, 0, sizeof(spsc_ring_t));
+    if (spsc_ring_create(REC_CAPTURE_RING, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) != ESP_OK) {
+        return false;
+    }
+
+#if REC_FORMAT == REC_FORMAT_ADPCM
+    rec_pcm = heap_caps_malloc(REC_ADPCM_SPB * REC_FRAME_BYTES, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!rec_pcm) {
+        spsc_ring_delete(REC_CAPTURE_RING);
+        return false;
+    }
+#endif
+    return true;
+}
+
+// 释放采集一侧的缓冲区
+static void rec_free_capture(void)
+{
+    spsc_ring_delete(REC_CAPTURE_RING);
+#if REC_FORMAT == REC_FORMAT_ADPCM
+    heap_caps_free(rec_pcm);
+    rec_pcm = NULL;
+#endif
+}
+
+// 释放写卡一侧的缓冲区
+static void rec_free_output(void)
+{
+    heap_caps_free(rec_wbuf);
+    rec_wbuf = NULL;
+#if REC_FORMAT == REC_FORMAT_FLAC
+    heap_caps_free(rec_frame);
+    rec_frame = NULL;
+    flac_enc_free(&rec_flac);
+    spsc_ring_delete(&rec_ring);
+#endif
+}
+
+// 写卡一侧的缓冲区, 只在录音期间占用: 写卡缓冲区; FLAC 时还有编码器和写卡环形缓冲区
+static bool rec_alloc_output(void)
+{
+    rec_wbuf = heap_caps_malloc(REC_WRITE_SIZE, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (!rec_wbuf) {
+        return false;
+    }
+
+#if REC_FORMAT == REC_FORMAT_FLAC
+    flac_enc_config_t flac_cfg = {
+        .sample_rate = REC_SAMPLE_RATE,
+        .channels = REC_CHANNELS,
+        .blocksize = REC_FLAC_BLOCK,
+        .lpc_order = REC_FLAC_LPC_ORDER,
+        .partition_order = 6,
+    };
+    memset(&rec_flac, 0, sizeof(rec_flac));
+    memset(&rec_ring, 0, sizeof(rec_ring));
+    if (flac_enc_init(&rec_flac, &flac_cfg)) {
+        rec_frame_max = flac_enc_max_frame_bytes(&rec_flac);
+        rec_frame = heap_caps_malloc(rec_frame_max, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    if (!rec_frame || spsc_ring_create(&rec_ring, REC_RING_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT) != ESP_OK) {
+        rec_free_output();
+        return false;
+    }
+#endif
+    return true;
 }
 
 
 // 初始化录音用的 I2S 和 ES8388
-static void init_rec_mode(void)
+// 只打开 I2S RX, 正在播放时不打断; 播放的采样率或位宽不同时, 常驻的播放引擎让出 I2S, WAV 播放时失败
+static bool init_rec_mode(void)
 {
-    myi2s_init();  // 初始化 I2S 外设
-    es8388_adda_cfg(0, 1);  // 启用 ADC
+    if (i2s_is_open(I2S_DIR_RX)) {
+        ESP_LOGE(TAG, "I2S RX 正在被麦克风实时流使用, 无法录音");
+        return false;
+    }
+
+    esp_err_t ret = i2s_open(I2S_DIR_RX);  // 打开 I2S RX
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "I2S RX 打开失败: %s", esp_err_to_name(ret));
+        return false;  // 没有打开, 不能 i2s_close, 也不配置 ES8388
+    }
+    if (i2s_set_format(I2S_DIR_RX, REC_SAMPLE_RATE, I2S_DATA_BIT_WIDTH_16BIT) != ESP_OK) { // 设置采样率和位宽
+        ESP_LOGW(TAG, "播放的采样率与录音不同, 停止播放引擎");
+        audio_engine_deinit();  // 释放MP3引擎占用的I2S TX
+        if (i2s_set_format(I2S_DIR_RX, REC_SAMPLE_RATE, I2S_DATA_BIT_WIDTH_16BIT) != ESP_OK) {
+            ESP_LOGE(TAG, "正在播放其它格式, 无法录音");
+            i2s_close(I2S_DIR_RX);
+            return false;
+        }
+    }
+
+    bool playing = i2s_is_open(I2S_DIR_TX);
+    es8388_adda_cfg(playing, 1);  // 启用 ADC, 正在播放时保留 DAC
     es8388_input_cfg(0);   // 输入通道设置为 MIC
     es8388_mic_gain(8);    // 设置麦克风增益
     es8388_alc_ctrl(3, 4, 4);  // 自动增益控制
-    es8388_output_cfg(0, 0);   // 禁止输出通道
-    es8388_spkvol_set(0);      // 静音输出
-    es8388_i2s_cfg(0, 3);      // I2S 配置为标准模式
-    i2s_set_samplerate_bits_sample(16000, I2S_BITS_PER_SAMPLE_16BIT); // 设置采样率和位宽
-    i2s_trx_start();           // 启动 I2S
+    if (!playing) {
+        es8388_output_cfg(0, 0);   // 禁止输出通道
+        es8388_spkvol_set(0);      // 静音输出
+        es8388_i2s_cfg(0, 3);      // I2S 配置为标准模式
+    }
+    return true;
+}
+
+// 关闭 I2S RX 和 ES8388 的 ADC, 播放不受影响
+static void close_rec_mode(void)
+{
+    i2s_close(I2S_DIR_RX);
+    es8388_adda_cfg(i2s_is_open(I2S_DIR_TX), 0);
+}
+
+// 清空采集一侧的缓冲区并创建采集任务, 调用时 I2S 已经启动
+static bool rec_capture_start(void)
+{
+    spsc_ring_reset(REC_CAPTURE_RING);
+#if REC_FORMAT == REC_FORMAT_ADPCM
+    memset(&rec_adpcm, 0, sizeof(rec_adpcm));
+    rec_pcm_frames = 0;
+#endif
+    capturing = 1;
+
+    if (xTaskCreatePinnedToCore(recorder_capture_task, "rec_capture", REC_TASK_STACK, NULL,
+                                REC_CAPTURE_PRIO, NULL, REC_CAPTURE_CORE) != pdPASS) {
+        capturing = 0;
+        return false;
+    }
+    return true;
+}
+
+#if REC_PRE_ROLL_MS > 0
+// 开始预录: 启动 I2S 和采集任务, 一直保留最近 REC_PRE_ROLL_MS 的数据
+static void rec_listen_start(void)
+{
+    if (listening) {
+        return;
+    }
+
+    if (!rec_alloc_capture()) {
+        ESP_LOGE(TAG, "预录缓冲区内存不足");
+        return;
+    }
+
+    if (!init_rec_mode()) {
+        rec_free_capture();
+        return;
+    }
+
+    rec_keeping = 0;
+    if (!rec_capture_start()) {
+        ESP_LOGE(TAG, "创建采集任务失败");
+        close_rec_mode();
+        rec_free_capture();
+        return;
+    }
+
+    listening = 1;
+    ESP_LOGI(TAG, "预录已开始, 保留最近 %d ms", REC_PRE_ROLL_MS);
 }
 
+// 停止预录, 关闭 I2S RX
+static void rec_listen_stop(void)
+{
+    if (!listening) {
+        return;
+    }
+
+    capturing = 0;
+    xSemaphoreTake(rec_done, portMAX_DELAY);
+    close_rec_mode();
+    rec_free_capture();
+    listening = 0;
+}
+#endif
+
 // 开始录音
 static void start_recording(void)
 {
     FRESULT res;
     FF_DIR rec_dir;
 
+    if (recording) {
+        ESP_LOGW(TAG, "正在录音，忽略开始操作");
+        return;
+    }
+
     // 尝试打开录音目录，如果不存在则创建
     res = f_opendir(&rec_dir, "0:/RECORDER");
     if (res != FR_OK) {
@@ -90,29 +741,150 @@ static void start_recording(void)
             ESP_LOGE(TAG, "创建录音目录失败: %d", res);
             return;
         }
+    } else {
+        f_closedir(&rec_dir);
     }
 
-    // 初始化录音硬件（I2S + ES8388）
-    init_rec_mode();
+    // 预录时采集一侧已在运行(之前启动失败时现在重试), 否则 I2S RX 和缓冲区只在录音期间占用
+#if REC_PRE_ROLL_MS > 0
+    rec_listen_start();
+    bool capture_ok = listening;
+#else
+    if (!init_rec_mode()) {
+        return;
+    }
+
+    bool capture_ok = rec_alloc_capture();
+#endif
+    if (!capture_ok || !rec_alloc_output()) {
+        ESP_LOGE(TAG, "录音缓冲区内存不足");
+#if !REC_PRE_ROLL_MS
+        if (capture_ok) {
+            rec_free_capture();
+        }
+        close_rec_mode();
+#endif
+        return;
+    }
+
+#if REC_UPLOAD
+    rec_upload_cancel();                     // 上一次录音还没有上传完时停止, 文件即将被覆盖
+#endif
 
     // 打开文件，准备写入
-    res = f_open(&f_rec, "0:/RECORDER/REC00001.wav", FA_CREATE_ALWAYS | FA_WRITE);
+    res = f_open(&f_rec, REC_FILE_PATH, FA_CREATE_ALWAYS | FA_WRITE);
     if (res != FR_OK) {
         ESP_LOGE(TAG, "无法打开录音文件: %d", res);
+        rec_free_output();
+#if !REC_PRE_ROLL_MS
+        rec_free_capture();
+        close_rec_mode();
+#endif
         return;
     }
 
-    // 可选：写入WAV文件头（占位，停止录音后补充大小）
-    // UINT bw;
-    // f_write(&f_rec, &wavhead, sizeof(wavhead), &bw);
-    // 写入 WAV 占位头
-    write_wav_header_placeholder(&f_rec);
+    // 预分配连续的簇, 停止录音时截掉没有用到的部分
+    FSIZE_t prealloc = (FSIZE_t)REC_DATA_RATE * REC_PREALLOC_SEC;
+    while (prealloc >= REC_WRITE_SIZE && f_expand(&f_rec, prealloc, 1) != FR_OK) {
+        prealloc /= 2;
+    }
+    if (prealloc < REC_WRITE_SIZE) {
+        ESP_LOGW(TAG, "没有连续空间可预分配，录音时逐簇扩展文件");
+    }
+
+#if REC_VAD
+    if (!rec_vad_open()) {
+        ESP_LOGE(TAG, "无法创建语音活动检测或打开索引文件");
+        f_close(&f_rec);
+        rec_free_output();
+        rec_free_capture();
+        close_rec_mode();
+        return;
+    }
+#endif
+
+    // 写入占位文件头
+    write_rec_header(&f_rec, 0, 0);
+
+#if REC_UPLOAD
+    f_sync(&f_rec);                          // 上传任务只读打开文件时能看到预分配后的大小和占位文件头
+    if (rec_upload_start(REC_UPLOAD_URL, REC_FILE_PATH, REC_FILE_NAME) != ESP_OK) {
+        ESP_LOGW(TAG, "无法启动上传, 只保存到 SD 卡");
+    }
+    rec_upload_synced(f_tell(&f_rec));
+    rec_upload_pending = false;
+    rec_upload_sync_us = esp_timer_get_time();
+#endif
 
     // 设置标志位
-    recording = 1;
+    memset(&rec_stats, 0, sizeof(rec_stats));
+    rec_dma_ovf_start = i2s_rx_overflows();
+    rec_consumers = 0;
+    encoding = 1;
+    writing = 1;
     g_wav_size = 0;
+    recording = 1;
+
+    // 预录时等采集任务确认不再丢弃数据, 之后缓冲区中的数据才归编码和写卡任务
+    uint32_t pre_roll_ms = 0;
+#if REC_PRE_ROLL_MS > 0
+    xSemaphoreTake(rec_ack, portMAX_DELAY);
+    pre_roll_ms = (uint64_t)spsc_ring_used(REC_CAPTURE_RING) * 1000 / REC_DATA_RATE;
+#endif
+
+    // 从后往前创建, 每个任务通知下一级时下一级一定已经在运行
+    uint32_t started = 0;
+    if (xTaskCreatePinnedToCore(recorder_writer_task, "rec_write", REC_TASK_STACK, NULL,
+                                REC_WRITER_PRIO, &rec_writer, REC_WRITER_CORE) == pdPASS) {
+        started++;
+#if REC_FORMAT == REC_FORMAT_FLAC
+        if (xTaskCreatePinnedToCore(recorder_encode_task, "rec_encode", REC_TASK_STACK, NULL,
+                                    REC_ENCODE_PRIO, &rec_encoder, REC_ENCODE_CORE) == pdPASS) {
+            started++;
+        } else {
+            recording = 0;
+        }
+#endif
+        rec_consumers = recording;
+#if !REC_PRE_ROLL_MS
+        if (recording && !rec_capture_start()) {
+            recording = 0;
+        }
+#endif
+    } else {
+        recording = 0;
+    }
+
+    if (!recording) {
+        rec_consumers = 0;
+        encoding = 0;
+        writing = 0;
+        while (started--) {
+            xSemaphoreTake(rec_done, portMAX_DELAY);   // 等待已创建的任务退出
+        }
+
+        ESP_LOGE(TAG, "创建录音任务失败");
+#if REC_UPLOAD
+        rec_upload_cancel();
+#endif
+        f_close(&f_rec);
+#if REC_VAD
+        rec_vad_close();
+#endif
+        rec_free_output();
+#if REC_PRE_ROLL_MS > 0
+        rec_listen_stop();                   // 缓冲区已不再丢弃数据, 重新开始预录
+        rec_listen_start();
+#else
+        close_rec_mode();
+        rec_free_capture();
+#endif
+        return;
+    }
 
-    ESP_LOGI(TAG, "开始录音: REC00001.wav");
+    ESP_LOGI(TAG, "开始录音: " REC_FILE_NAME " (%d Hz, %d 声道, %s%s, 预录 %lu ms, 预分配 %lu KB)",
+             REC_SAMPLE_RATE, REC_CHANNELS, REC_FORMAT_NAME, REC_VAD ? ", 只保存语音段" : "",
+             pre_roll_ms, (uint32_t)(prealloc / 1024));
 }
 
 
@@ -124,19 +896,100 @@ static void stop_recording(void)
         return;
     }
 
+    // 按数据流向依次停止, 每个任务通知下一级时下一级一定还在运行;
+    // 编码和写卡任务最多等待 100ms 后退出, 之后由本任务编码和写完缓冲区中剩余的数据
+    capturing = 0;
+    xSemaphoreTake(rec_done, portMAX_DELAY);
+    rec_consumers = 0;
     recording = 0;
+#if REC_VAD
+    vad_flush(rec_vad);                      // 结束正在进行的段, 采集任务已退出, 由本任务交给下一级
+#endif
+#if REC_FORMAT == REC_FORMAT_FLAC
+    encoding = 0;
+    xSemaphoreTake(rec_done, portMAX_DELAY);
+#endif
+    writing = 0;
+    xSemaphoreTake(rec_done, portMAX_DELAY);
+
+#if REC_FORMAT == REC_FORMAT_ADPCM
+    if (rec_pcm_frames > 0) {
+        rec_encode_block();                  // 最后不满一块的数据
+    }
+#elif REC_FORMAT == REC_FORMAT_FLAC
+    uint32_t pcm_left;
+    while ((pcm_left = spsc_ring_used(&rec_pcm_ring) / REC_FRAME_BYTES) > 0) {
+        while (spsc_ring_free(&rec_ring) < rec_frame_max) {
+            rec_write(REC_WRITE_SIZE);       // 写卡任务已退出, 先腾出一帧的空间
+        }
+        rec_encode_frame(pcm_left < REC_FLAC_BLOCK ? pcm_left : REC_FLAC_BLOCK);
+    }
+#else
+    rec_stats.frames = (g_wav_size + spsc_ring_used(&rec_ring)) / REC_FRAME_BYTES;
+#endif
+
+    while (spsc_ring_used(&rec_ring) > 0) {
+        rec_write(REC_WRITE_SIZE);
+    }
+
+    rec_stats.bytes = g_wav_size;
+    rec_stats.dma_overflows = i2s_rx_overflows() - rec_dma_ovf_start;
+
+#if REC_VAD
+    vad_stats_t vad_stats;
+    vad_get_stats(rec_vad, &vad_stats);
+    rec_stats.vad_segments = vad_stats.segments;
+    rec_stats.vad_skipped = vad_stats.frames - vad_stats.committed;
+    rec_write_segments();
+    rec_vad_close();
+#endif
 
     // 判断文件是否已经打开
     if (f_rec.obj.fs != NULL) {
-        fix_wav_header(&f_rec, g_wav_size);  // 修复 WAV 头
+        f_truncate(&f_rec);                  // 截掉预分配但没有用到的部分
+        write_rec_header(&f_rec, g_wav_size, rec_stats.frames);  // 修复文件头
         f_close(&f_rec);
+#if REC_UPLOAD
+        rec_upload_finish(REC_HEADER_SIZE + g_wav_size);  // 上传任务发完剩余数据后重传文件头
+#endif
     }
 
-    // 停止 I2S 硬件
-    i2s_trx_stop();
-    i2s_deinit();  // 卸载 I2S 驱动
+    rec_free_output();
 
-    ESP_LOGI(TAG, "录音已停止");
+#if REC_PRE_ROLL_MS > 0
+    // I2S RX 继续运行, 重新开始预录
+    rec_keeping = 0;
+    if (!rec_capture_start()) {
+        ESP_LOGE(TAG, "创建采集任务失败, 预录停止");
+        close_rec_mode();
+        rec_free_capture();
+        listening = 0;
+    }
+#else
+    close_rec_mode();  // 关闭 I2S RX, 正在播放时不受影响
+    rec_free_capture();
+#endif
+
+    ESP_LOGI(TAG, "录音已停止: %lu 字节, I2S溢出 %lu, 缓冲区溢出 %lu (丢弃 %lu 字节), 写入错误 %lu, 最高水位 %lu KB, 最长写入 %lu us",
+             rec_stats.bytes, rec_stats.dma_overflows, rec_stats.overflows, rec_stats.dropped,
+             rec_stats.write_errors, rec_stats.ring_peak / 1024, rec_stats.write_max_us);
+
+#if REC_FORMAT != REC_FORMAT_PCM
+    // 编码耗时占录音时长的千分比, 以及文件大小占 PCM 的千分比
+    uint64_t audio_us = (uint64_t)rec_stats.frames * 1000000 / REC_SAMPLE_RATE;
+    uint32_t permille = audio_us ? (uint64_t)rec_stats.encode_us * 1000 / audio_us : 0;
+    uint64_t pcm_bytes = (uint64_t)rec_stats.frames * REC_FRAME_BYTES;
+    uint32_t size_permille = pcm_bytes ? (uint64_t)rec_stats.bytes * 1000 / pcm_bytes : 0;
+    ESP_LOGI(TAG, REC_FORMAT_NAME " 编码 %lu 帧, 耗时 %lu ms, 占 CPU %lu.%lu%%, 文件为 PCM 的 %lu.%lu%%",
+             rec_stats.frames, rec_stats.encode_us / 1000, permille / 10, permille % 10,
+             size_permille / 10, size_permille % 10);
+#endif
+
+#if REC_VAD
+    uint32_t skipped_permille = vad_stats.frames ? (uint64_t)rec_stats.vad_skipped * 1000 / vad_stats.frames : 0;
+    ESP_LOGI(TAG, "语音活动检测: %lu 段, 跳过 %lu.%lu%% 的静音, 噪声基底 %lu",
+             rec_stats.vad_segments, skipped_permille / 10, skipped_permille % 10, vad_stats.noise_floor);
+#endif
 }
 
 // 播放录音文件
@@ -146,16 +999,16 @@ static void play_recording(void)
     FIL test_file;
 
     // 播放前检查文件是否存在
-    res = f_open(&test_file, "0:/RECORDER/REC00001.wav", FA_READ);
+    res = f_open(&test_file, REC_FILE_PATH, FA_READ);
     if (res != FR_OK) {
         ESP_LOGW(TAG, "播放失败，录音文件不存在");
         return;
     }
     f_close(&test_file);
 
-    // 调用播放接口
-    ESP_LOGI(TAG, "开始播放 REC00001.wav");
-    audio_play_song((uint8_t *)"0:/RECORDER/REC00001.wav");
+    // 调用播放接口, 播放只用 I2S TX, 预录不用停止
+    ESP_LOGI(TAG, "开始播放 " REC_FILE_NAME);
+    audio_play_song((uint8_t *)REC_FILE_PATH);
     ESP_LOGI(TAG, "播放完成");
 }
 
@@ -193,6 +1046,13 @@ static void key_task(void *param)
 static void recorder_main_task(void *param)
 {
     recorder_cmd_t cmd;
+
+#if REC_PRE_ROLL_MS > 0
+    xSemaphoreTake(rec_mutex, portMAX_DELAY);
+    rec_listen_start();                      // 一直预录, 开始录音时文件从按键之前开始
+    xSemaphoreGive(rec_mutex);
+#endif
+
     while (1) {
         if (xQueueReceive(rec_cmd_queue, &cmd, portMAX_DELAY) == pdTRUE) {
             xSemaphoreTake(rec_mutex, portMAX_DELAY);  // 互斥访问
@@ -215,32 +1075,161 @@ static void recorder_main_task(void *param)
     }
 }
 
-// 后台录音任务，将音频缓冲写入文件
-static void recorder_data_task(void *param)
-{
-    while (1) {
-        if (recording) {
-            xSemaphoreTake(rec_mutex, portMAX_DELAY);
-            size_t bytes_read = i2s_rx_read(audio_buf, BUF_SIZE);  // 从 I2S 读取数据
-            if (bytes_read > 0) {
-                UINT bw;
-                f_write(&f_rec, audio_buf, bytes_read, &bw);  // 写入文件
-                g_wav_size += bytes_read;
-            }
-            xSemaphoreGive(rec_mutex);
-        }
-        vTaskDelay(pdMS_TO_TICKS(10));
-    }
-}
-
 // 初始化录音系统，创建任务、信号量等
 void my_recorder_init(void)
 {
     rec_cmd_queue = xQueueCreate(10, sizeof(recorder_cmd_t));
     rec_mutex = xSemaphoreCreateMutex();
+    rec_done = xSemaphoreCreateCounting(3, 0);
+#if REC_FORMAT == REC_FORMAT_FLAC
+    rec_space = xSemaphoreCreateBinary();
+#endif
+#if REC_PRE_ROLL_MS > 0
+    rec_ack = xSemaphoreCreateBinary();
+#endif
+#if REC_VAD
+    rec_seg_queue = xQueueCreate(REC_VAD_QUEUE_LEN, sizeof(vad_segment_t));
+#endif
 
     xTaskCreate(key_task, "key_task", 4096, NULL, 5, NULL);
     xTaskCreate(recorder_main_task, "rec_main", 4096*2, NULL, 6, NULL);
-    xTaskCreate(recorder_data_task, "rec_data", 4096, NULL, 4, NULL);
 }
 
+// 获取最近一次录音的统计, 录音过程中调用时 bytes 和 dma_overflows 还没有更新
+void recorder_get_stats(recorder_stats_t *stats)
+{
+    *stats = rec_stats;
+}
+
+// 测试: 录音 duration_ms 后停止, 检查 I2S 和缓冲区都没有溢出
+// 在 WiFi 下载或播放网络音频时运行, 检查写卡和网络同时进行时是否丢数据
+esp_err_t recorder_test(uint32_t duration_ms)
+{
+    xSemaphoreTake(rec_mutex, portMAX_DELAY);
+    start_recording();
+    bool started = recording;
+    xSemaphoreGive(rec_mutex);
+
+    if (!started) {
+        return ESP_FAIL;
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(duration_ms));
+
+    xSemaphoreTake(rec_mutex, portMAX_DELAY);
+    stop_recording();
+    xSemaphoreGive(rec_mutex);
+
+    // FLAC 的文件大小随内容变化, 按帧数比较; 预录时文件还包括最多 REC_PRE_ROLL_MS 的预录
+    uint32_t expected = (uint64_t)REC_SAMPLE_RATE * (duration_ms + REC_PRE_ROLL_MS) / 1000;
+    bool ok = rec_stats.dma_overflows == 0 && rec_stats.overflows == 0 && rec_stats.write_errors == 0;
+
+    ESP_LOGI(TAG, "录音测试 %s: 期望约 %lu 帧, 写入 %lu 帧, %lu 字节",
+             ok ? "通过" : "丢数据", expected, rec_stats.frames, rec_stats.bytes);
+
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+// 测试: 双工打开 I2S(低延迟 DMA), 麦克风每次读到的数据立即写到耳机, 像对讲一样
+// 往返延迟为每块第一帧播出和采集时刻之差, 两个时刻在同一时间线上, 不含 ES8388 的 ADC/DAC 延迟;
+// 喇叭保持关闭, 避免啸叫. 录音时不能运行, 播放会被停止
+esp_err_t recorder_loopback_test(uint32_t duration_ms)
+{
+    static int16_t buf[REC_LOOPBACK_FRAMES * 2];
+
+    xSemaphoreTake(rec_mutex, portMAX_DELAY);
+    if (recording) {
+        xSemaphoreGive(rec_mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+#if REC_PRE_ROLL_MS > 0
+    rec_listen_stop();
+#endif
+    audio_engine_deinit();  // 两个方向都关闭后才能用低延迟的 DMA 配置重新创建
+
+    esp_err_t ret = i2s_open(I2S_DIR_DUPLEX);
+    if (ret == ESP_OK) {
+        ret = i2s_set_format(I2S_DIR_DUPLEX, REC_SAMPLE_RATE, I2S_DATA_BIT_WIDTH_16BIT);
+    }
+
+    uint32_t blocks = 0;
+    int64_t sum_us = 0;
+    int64_t max_us = 0;
+    int64_t min_us = INT64_MAX;
+
+    if (ret == ESP_OK) {
+        xl9555_pin_write(SPK_EN_IO, 1);  // 关闭喇叭
+        es8388_adda_cfg(1, 1);     // 同时启用 DAC 和 ADC
+        es8388_input_cfg(0);       // 输入通道设置为 MIC
+        es8388_mic_gain(8);        // 设置麦克风增益
+        es8388_alc_ctrl(3, 4, 4);  // 自动增益控制
+        es8388_output_cfg(1, 1);   // 打开输出通道
+        es8388_hpvol_set(10);      // 设置耳机
+        es8388_spkvol_set(0);      // 喇叭静音
+        es8388_i2s_cfg(0, 3);      // I2S 配置为标准模式
+
+        int64_t end = esp_timer_get_time() + (int64_t)duration_ms * 1000;
+        int64_t warmup = esp_timer_get_time() + 200000;  // 前 200ms 发送队列还没有填满, 不计入
+
+        while (esp_timer_get_time() < end) {
+            int64_t rx_ts, tx_ts;
+            size_t len = i2s_rx_read_ts((uint8_t *)buf, sizeof(buf), &rx_ts);
+            i2s_tx_write_ts((uint8_t *)buf, len, &tx_ts);
+
+            if (esp_timer_get_time() < warmup) {
+                continue;
+            }
+
+            int64_t lat = tx_ts - rx_ts;
+            sum_us += lat;
+            max_us = lat > max_us ? lat : max_us;
+            min_us = lat < min_us ? lat : min_us;
+            blocks++;
+        }
+
+        es8388_adda_cfg(0, 0);
+        i2s_close(I2S_DIR_DUPLEX);
+    }
+
+#if REC_PRE_ROLL_MS > 0
+    rec_listen_start();
+#endif
+    xSemaphoreGive(rec_mutex);
+
+    if (ret != ESP_OK || blocks == 0) {
+        ESP_LOGE(TAG, "直通测试无法运行: %s", esp_err_to_name(ret));
+        return ret != ESP_OK ? ret : ESP_FAIL;
+    }
+
+    bool ok = max_us < REC_LOOPBACK_MAX_US;
+    ESP_LOGI(TAG, "直通测试 %s: %lu 块, 往返延迟 平均 %lld us, 最小 %lld us, 最大 %lld us (DMA %d x %d 帧)",
+             ok ? "通过" : "延迟过大", blocks, sum_us / blocks, min_us, max_us,
+             I2S_DUPLEX_DMA_DESC, I2S_DUPLEX_DMA_FRAME);
+
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+// 测试: 边录边传 duration_ms, 停止后等待上传完成, 比较服务器和 SD 卡上文件的大小和 CRC32
+// PC 上运行 tools/upload_server.py, 用 --rate 限速或 --drop-every 断开连接可以测试溢出到 SD 卡和续传
+esp_err_t recorder_upload_test(uint32_t duration_ms)
+{
+#if REC_UPLOAD
+    esp_err_t ret = recorder_test(duration_ms);
+    bool done = rec_upload_wait(REC_UPLOAD_TEST_MS);
+
+    rec_upload_stats_t stats;
+    rec_upload_get_stats(&stats);
+    ESP_LOGI(TAG, "上传测试: %s, 请求 %lu 次, 失败 %lu 次, 发出 %lu 字节, 从 SD 卡读取 %lu 字节, 最多落后 %lu KB",
+             done ? "已完成" : "未完成", stats.requests, stats.failures, stats.sent, stats.spilled,
+             stats.lag_peak / 1024);
+
+    if (!done || rec_upload_verify() != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    return ret;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
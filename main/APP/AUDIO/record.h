@@ -7,6 +7,7 @@
 #ifndef __RECORD_H
 #define __RECORD_H
 
+#include "sdkconfig.h"
 #include "es8388.h"
 #include "myi2s.h"
 #include "xl9555.h"
@@ -16,7 +17,92 @@
 #include "freertos/queue.h"
 #include "freertos/semphr.h"
 
-#define BUF_SIZE 4096  // 音频缓冲区大小
+#define BUF_SIZE 4096  // 每次从 I2S 读取的字节数, 48kHz 立体声约 21ms
+
+// 录音格式
+#define REC_SAMPLE_RATE     48000               // 采样率
+#define REC_CHANNELS        2                   // 声道数
+#define REC_BITS            16                  // 位宽
+#define REC_BYTE_RATE       (REC_SAMPLE_RATE * REC_CHANNELS * REC_BITS / 8)
+
+// 文件格式
+#define REC_FORMAT_PCM      0                   // WAV, 16 位 PCM
+#define REC_FORMAT_ADPCM    1                   // WAV, IMA ADPCM(4 位), 采集任务编码, 文件大小约为 PCM 的 1/4, 有损
+#define REC_FORMAT_FLAC     2                   // FLAC, 无损, 编码任务编码, 语音和音乐通常为 PCM 的 40%~60%
+#if CONFIG_REC_FORMAT_ADPCM                     // 在 menuconfig 的 "Recorder" 中选择, 默认 PCM, 文件为 REC00001.wav
+#define REC_FORMAT          REC_FORMAT_ADPCM
+#elif CONFIG_REC_FORMAT_FLAC
+#define REC_FORMAT          REC_FORMAT_FLAC
+#else
+#define REC_FORMAT          REC_FORMAT_PCM
+#endif
+
+#define REC_ADPCM_BLOCK     2048                // ADPCM 块大小(字节), 整除 REC_RING_SIZE, 立体声每块 2041 帧, 48kHz 约 42ms
+#define REC_ADPCM_SPB       ((REC_ADPCM_BLOCK - 4 * REC_CHANNELS) * 2 / REC_CHANNELS + 1)  // 每块帧数
+
+#define REC_FLAC_BLOCK      4096                // FLAC 每帧的帧数(每声道采样数), 48kHz 约 85ms
+#define REC_FLAC_LPC_ORDER  8                   // 尝试的最高 LPC 阶数, 0 时只用固定预测
+#define REC_PCM_RING_SIZE   (128 * 1024)        // 采集 -> 编码的 PCM 环形缓冲区大小(2的幂), 是整块的整数倍, 48kHz 立体声约 0.68s
+#define REC_ENCODE_CORE     1                   // 编码任务所在核心, 与采集任务相同, 采集阻塞在 I2S 读取时编码
+#define REC_ENCODE_PRIO     5                   // 编码任务优先级, 低于采集和写卡
+
+#if REC_FORMAT == REC_FORMAT_ADPCM
+#define REC_DATA_RATE       ((uint64_t)REC_SAMPLE_RATE * REC_ADPCM_BLOCK / REC_ADPCM_SPB)  // 文件中每秒的数据字节数
+#else
+#define REC_DATA_RATE       REC_BYTE_RATE       // FLAC 按最坏情况(不压缩)估计
+#endif
+
+#if REC_FORMAT == REC_FORMAT_FLAC
+#define REC_FILE_NAME       "REC00001.flac"
+#else
+#define REC_FILE_NAME       "REC00001.wav"
+#endif
+#define REC_FILE_PATH       "0:/RECORDER/" REC_FILE_NAME
+
+// 语音活动检测: 1 时只保存有语音的段(含预录和拖尾), 静音不写卡, 文件大小和写卡量随静音比例减少;
+// 各段的位置写入同名的 .vad 索引文件: 12 字节文件头 "RVAD", 版本(uint16), 声道数(uint16), 采样率(uint32),
+// 之后每段 12 字节 vad_segment_t: 在录音中的起点, 在文件中的起点, 长度, 单位都是帧, 小端
+#ifdef CONFIG_REC_VAD                           // menuconfig "Recorder"
+#define REC_VAD             1
+#else
+#define REC_VAD             0
+#endif
+#define REC_VAD_THRESHOLD_DB 9                  // 语音帧能量至少高于噪声基底的分贝数
+#define REC_VAD_HANGOVER_MS 400                 // 最后一个语音帧之后继续保存的时长
+#define REC_VAD_PRE_ROLL_MS 300                 // 每段开始前预录的时长, 不会截掉起始的辅音
+#define REC_VAD_QUEUE_LEN   16                  // 采集 -> 写卡的段队列长度, 每段至少约 0.4s, 写卡任务每 100ms 内取一次
+#define REC_INDEX_PATH      "0:/RECORDER/REC00001.vad"
+
+// 预录: 大于 0 时不录音也一直采集, 保留最近这么长的数据放在 PSRAM 中, 开始录音时先写进文件,
+// 录音从按键之前开始, 没有间断. 预录期间一直占用 I2S RX; 语音活动检测自带预录, 不能同时使用
+#ifdef CONFIG_REC_PRE_ROLL_MS                   // menuconfig "Recorder", 例如 5000, 48kHz 立体声 PCM 约 1MB, 缓冲区按 2 的幂分配
+#define REC_PRE_ROLL_MS     CONFIG_REC_PRE_ROLL_MS
+#else
+#define REC_PRE_ROLL_MS     0
+#endif
+
+// 边录边传: 1 时录音的同时把文件用 HTTP 分块传输上传到 REC_UPLOAD_URL, 失败后从服务器确认的偏移续传;
+// 网络慢于录音时数据留在 SD 卡上, 上传任务追赶时从文件读取, 停止录音后继续上传直到完成(见 rec_upload.h).
+// 每次写卡后多一次 f_sync, 上传任务才能从文件读到刚写入的数据. PC 上用 tools/upload_server.py 接收
+#ifdef CONFIG_REC_UPLOAD                        // menuconfig "Recorder", 地址默认值只是示例, 需要改成 PC 的地址
+#define REC_UPLOAD          1
+#define REC_UPLOAD_URL      CONFIG_REC_UPLOAD_URL
+#else
+#define REC_UPLOAD          0
+#endif
+#define REC_UPLOAD_TEST_MS  30000               // 上传测试在停止录音后等待上传完成的最长时间
+
+// 采集和写卡分开在两个任务中, 中间是 PSRAM 环形缓冲区
+#define REC_RING_SIZE       (256 * 1024)        // 环形缓冲区大小(2的幂), 48kHz 立体声约 1.3s, 写卡停顿不超过它就不丢数据
+#define REC_WRITE_SIZE      (32 * 1024)         // 每次 f_write 的字节数, 写到文件偏移的整块边界, 都是整扇区
+#define REC_PREALLOC_SEC    300                 // 开始录音时用 f_expand 预分配的时长(秒), 空间不够时减半
+#define REC_CAPTURE_CORE    1                   // 采集任务所在核心, 避开 WiFi 所在的核心0
+#define REC_CAPTURE_PRIO    7                   // 采集任务优先级, 高于写卡, 只在 I2S 读取上阻塞
+#define REC_WRITER_CORE     0                   // 写卡任务所在核心, 与其它 SD 卡 I/O 相同
+#define REC_WRITER_PRIO     6                   // 写卡任务优先级
+#define REC_TASK_STACK      4096                // 采集, 编码和写卡任务堆栈大小
+#define REC_LOOPBACK_FRAMES (2 * I2S_DUPLEX_DMA_FRAME)  // 直通测试每次读写的帧数, 48kHz 为 5ms
+#define REC_LOOPBACK_MAX_US 20000               // 直通测试允许的最大往返延迟
 
 // 控制命令类型枚举
 typedef enum {
@@ -25,9 +111,36 @@ typedef enum {
     REC_CMD_PLAY    // 播放录音
 } recorder_cmd_t;
 
+// 录音统计, 每次开始录音时清零
+typedef struct {
+    uint32_t bytes;             // 写入文件的音频字节数
+    uint32_t frames;            // 写入文件的帧数(每声道采样数)
+    uint32_t dma_overflows;     // I2S 接收 DMA 溢出次数, 采集任务来不及读取, 丢失数据
+    uint32_t overflows;         // 环形缓冲区满而丢弃的数据块数, 编码或写卡来不及
+    uint32_t dropped;           // 丢弃的字节数
+    uint32_t write_errors;      // f_write 出错次数
+    uint32_t ring_peak;         // 写卡环形缓冲区最高水位(字节)
+    uint32_t write_max_us;      // 单次 f_write 最长耗时(us)
+    uint32_t encode_us;         // ADPCM 或 FLAC 编码总耗时(us), 与录音时长相比即编码占用的 CPU
+    uint32_t vad_segments;      // 语音活动检测保存的段数
+    uint32_t vad_skipped;       // 语音活动检测跳过的帧数
+} recorder_stats_t;
+
 // 初始化录音模块
 void my_recorder_init(void);
 
+// 获取最近一次录音的统计
+void recorder_get_stats(recorder_stats_t *stats);
+
+// 测试: 录音指定时长并检查是否丢数据
+esp_err_t recorder_test(uint32_t duration_ms);
+
+// 测试: 双工打开 I2S, 麦克风直通耳机, 测量往返延迟
+esp_err_t recorder_loopback_test(uint32_t duration_ms);
+
+// 测试: 边录边传指定时长, 等待上传完成后比较服务器和 SD 卡上的文件
+esp_err_t recorder_upload_test(uint32_t duration_ms);
+
 #endif // __RECORDER_H__
 
 
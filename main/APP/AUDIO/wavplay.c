@@ -4,363 +4,811 @@
  */
 
 #include "wavplay.h"
+#include "audio_engine.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_heap_caps.h"
+#include "audio_pcm.h"
+#include "audio_adpcm.h"
+#include "audio_prof.h"
 
 /******************************************************************************************************/
 /*FreeRTOS配置*/
 
-/* MUSIC 任务 配置
- * 包括: 任务句柄 任务优先级 堆栈大小 创建任务
+/* MUSIC 任务 配置(I2S写入) 与 WAVREAD 任务 配置(读文件)
+ * 两个任务常驻,歌曲之间阻塞在任务通知上
  */
-#define MUSIC_PRIO      4                   /* 任务优先级 */
-#define MUSIC_STK_SIZE  5*1024              /* 任务堆栈大小 */
-TaskHandle_t            MUSICTask_Handler;  /* 任务句柄 */
+#define MUSIC_PRIO      5                   /* I2S写入任务优先级 */
+#define MUSIC_STK_SIZE  3*1024              /* I2S写入任务堆栈大小 */
+#define WAVREAD_PRIO    4                   /* 读文件任务优先级 */
+#define WAVREAD_STK_SIZE 4*1024             /* 读文件任务堆栈大小 */
+TaskHandle_t            MUSICTask_Handler;  /* I2S写入任务句柄 */
+static TaskHandle_t     s_read_task;        /* 读文件任务句柄 */
 void music(void *pvParameters);             /* 任务函数 */
 
-static portMUX_TYPE my_spinlock = portMUX_INITIALIZER_UNLOCKED;
-
 /******************************************************************************************************/
 
+typedef struct
+{
+    uint8_t idx;                            /* 缓冲区编号 */
+    uint8_t lead;                           /* 数据在缓冲区中的起始偏移,使帧对齐到AUDIO_PCM_ALIGN */
+    uint32_t len;                           /* 有效数据长度,0表示文件结束 */
+} wav_block_t;
+
+/* 把frames帧输入转换为立体声I2S数据,返回输出字节数 */
+typedef uint32_t (*wav_convert_t)(const uint8_t *in, uint32_t frames);
+
 __wavctrl wavctrl;                          /* WAV音频文件解码参数结构体 */
-UINT bytes_write = 0;                       /* 写一次I2S大小 */
-volatile long long int i2s_table_size = 0;  /* 积累每次发送音频数据总大小 */
-esp_err_t i2s_play_end = ESP_FAIL;          /* 播放结束标志位 */
-esp_err_t i2s_play_next_prev = ESP_FAIL;    /* 下一首或者上一首标志位 */
-FSIZE_t file_read_pos = 0;                  /* 记录当前WAV读取位置 */
+static uint8_t *s_buf[WAV_BUF_NUM];         /* 扇区对齐,可DMA访问的双缓冲区 */
+static QueueHandle_t s_free_q;              /* 空闲缓冲区编号 */
+static QueueHandle_t s_full_q;              /* 已读入数据的缓冲区 */
+static TaskHandle_t s_owner;                /* 等待播放结束的任务 */
+static volatile bool s_abort;               /* 通知读文件任务提前结束 */
+static volatile uint32_t s_played;          /* 已写入I2S的数据量(按文件中的字节计) */
+static bool s_wide;                         /* 24/32位和浮点:独占I2S TX按32位输出;否则写入音频引擎的音乐输入 */
+static wav_convert_t s_convert;             /* 格式转换函数,NULL表示直接写入 */
+static uint8_t s_carry[WAV_FRAME_MAX] __attribute__((aligned(AUDIO_PCM_ALIGN)));   /* 跨缓冲区的不完整帧 */
+static uint8_t s_carry_len;                 /* s_carry中的字节数 */
+static int32_t s_render[WAV_RENDER_FRAMES * 2] __attribute__((aligned(AUDIO_PCM_ALIGN)));  /* 转换后的I2S数据 */
+static int32_t s_scratch[WAV_RENDER_FRAMES] __attribute__((aligned(AUDIO_PCM_ALIGN)));     /* 单声道转换的中间结果 */
+static uint8_t *s_adpcm_carry;              /* IMA ADPCM跨缓冲区的不完整块,播放ADPCM时分配 */
+static int16_t *s_adpcm_pcm;                /* IMA ADPCM一块解码后的PCM,播放ADPCM时分配 */
 
 /**
- * @brief       WAV 文件解析初始化
- * @param       fname : 文件路径+文件名
- * @param       wavx  : WAV 文件信息存放结构体指针
- * @retval      0, 打开文件成功且解析正确
- *              1, 打开文件失败
- *              2, 非WAV文件
- *              3, DATA区域未找到
- *              4, 内存分配失败
+ * @brief       单声道32位,复制为立体声
  */
-uint8_t wav_decode_init(uint8_t *fname, __wavctrl *wavx)
+static uint32_t wav_convert_mono32(const uint8_t *in, uint32_t frames)
 {
-    FIL *ftemp = NULL;
-    uint8_t *buf = NULL;
-    uint32_t br = 0;
-    uint8_t res = 0;
+    audio_pcm_mono32_to_stereo32(s_render, (const int32_t *)in, frames);
+    return frames * 8;
+}
 
-    ChunkRIFF *riff = NULL;
-    ChunkFMT *fmt = NULL;
-    ChunkFACT *fact = NULL;
-    ChunkDATA *data = NULL;
-
-    // 打印开始解析信息
-    printf("[WAV Parser] Starting to parse file: %s\n", fname);
-
-    // 分配内存
-    ftemp = (FIL*)malloc(sizeof(FIL));
-    buf = malloc(512);
-
-    if (!ftemp || !buf) {
-        printf("[WAV Parser] Error: Memory allocation failed\n");
-        res = 4;
-        goto cleanup;
-    }
-
-    // 打开文件
-    res = f_open(ftemp, (TCHAR*)fname, FA_READ);
-    if (res != FR_OK) {
-        printf("[WAV Parser] Error: Failed to open file (Error code: %d)\n", res);
-        res = 1;
-        goto cleanup;
-    }
-
-    // 读取文件头部
-    res = f_read(ftemp, buf, 512, (UINT *)&br);
-    if (res != FR_OK || br < 512) {
-        printf("[WAV Parser] Error: Failed to read file header (Read: %lu bytes)\n", br);
-        res = 1;
-        goto cleanup;
-    }
-
-    riff = (ChunkRIFF *)buf;
-
-    // 检查是否是WAV文件 (RIFF格式和WAVE标识)
-    if (riff->Format != 0x45564157) {  // "WAVE"的十六进制表示
-        printf("[WAV Parser] Error: Not a valid WAV file (Format: 0x%ld)\n", riff->Format);
-        res = 2;
-        goto cleanup;
-    }
-
-    printf("[WAV Parser] Valid WAV file detected\n");
-
-    // 解析FMT块
-    fmt = (ChunkFMT *)(buf + 12);  // RIFF头之后是FMT块
-    printf("[WAV Parser] FMT Chunk Size: %lu\n", fmt->ChunkSize);
-
-    // 检查FACT块是否存在 (某些WAV文件可能有)
-    fact = (ChunkFACT *)(buf + 12 + 8 + fmt->ChunkSize);
-    if (fact->ChunkID == 0x74636166 ||  // "fact"
-        fact->ChunkID == 0x5453494C) {  // "LIST"
-        printf("[WAV Parser] FACT/LIST Chunk found (Size: %lu)\n", fact->ChunkSize);
-        wavx->datastart = 12 + 8 + fmt->ChunkSize + 8 + fact->ChunkSize;
-    } else {
-        printf("[WAV Parser] No FACT/LIST Chunk found\n");
-        wavx->datastart = 12 + 8 + fmt->ChunkSize;
-    }
-
-    // 查找DATA块
-    data = (ChunkDATA *)(buf + wavx->datastart);
-    if (data->ChunkID != 0x61746164) {  // "data"
-        printf("[WAV Parser] Error: DATA Chunk not found at offset %lu\n", wavx->datastart);
-        res = 3;
-        goto cleanup;
-    }
-
-    // 填充WAV文件信息结构体
-    wavx->audioformat = fmt->AudioFormat;
-    wavx->nchannels = fmt->NumOfChannels;
-    wavx->samplerate = fmt->SampleRate;
-    wavx->bitrate = fmt->ByteRate * 8;
-    wavx->blockalign = fmt->BlockAlign;
-    wavx->bps = fmt->BitsPerSample;
-    wavx->datasize = data->ChunkSize;
-    wavx->datastart += 8;  // 跳过DATA块的头部
-
-    // 打印详细的WAV文件信息
-    printf("\n[WAV Parser] File Information:\n");
-    printf("  Audio Format:    %s (%d)\n",
-           wavx->audioformat == 1 ? "PCM" : "Non-PCM",
-           wavx->audioformat);
-    printf("  Channels:        %d\n", wavx->nchannels);
-    printf("  Sample Rate:     %lu Hz\n", wavx->samplerate);
-    printf("  Bit Rate:        %lu bps\n", wavx->bitrate);
-    printf("  Block Align:     %d bytes\n", wavx->blockalign);
-    printf("  Bits Per Sample: %d\n", wavx->bps);
-    printf("  Data Size:       %lu bytes\n", wavx->datasize);
-    printf("  Data Start:      at offset %lu\n", wavx->datastart);
-    printf("\n[WAV Parser] WAV file parsed successfully\n");
-
-    res = 0;
-
-cleanup:
-    // 资源清理
-    if (ftemp) {
-        f_close(ftemp);
-        free(ftemp);
-    }
-    if (buf) {
-        free(buf);
+/**
+ * @brief       立体声24位紧凑格式,展开为左对齐的32位
+ */
+static uint32_t wav_convert_s24(const uint8_t *in, uint32_t frames)
+{
+    audio_pcm_s24_to_s32(s_render, in, frames * 2);
+    return frames * 8;
+}
+
+/**
+ * @brief       单声道24位紧凑格式,展开为左对齐的32位立体声
+ */
+static uint32_t wav_convert_mono24(const uint8_t *in, uint32_t frames)
+{
+    audio_pcm_s24_to_s32(s_scratch, in, frames);
+    audio_pcm_mono32_to_stereo32(s_render, s_scratch, frames);
+    return frames * 8;
+}
+
+/**
+ * @brief       立体声32位浮点,转换为32位整数
+ */
+static uint32_t wav_convert_f32(const uint8_t *in, uint32_t frames)
+{
+    audio_pcm_f32_to_s32(s_render, (const float *)in, frames * 2);
+    return frames * 8;
+}
+
+/**
+ * @brief       单声道32位浮点,转换为32位整数立体声
+ */
+static uint32_t wav_convert_mono_f32(const uint8_t *in, uint32_t frames)
+{
+    audio_pcm_f32_to_s32(s_scratch, (const float *)in, frames);
+    audio_pcm_mono32_to_stereo32(s_render, s_scratch, frames);
+    return frames * 8;
+}
+
+/**
+ * @brief       选择WAV格式对应的转换函数
+ * @param       wavx : WAV 文件信息
+ * @retval      转换函数; NULL:文件数据可直接写入(16位由混音器转换声道,32位整数立体声直接写入I2S)
+ */
+static wav_convert_t wav_select_convert(const __wavctrl *wavx)
+{
+    bool mono = (wavx->nchannels == 1);
+
+    if (wavx->audioformat == WAV_FORMAT_IMA_ADPCM)
+    {
+        return NULL;                                                /* 由wav_render_adpcm解码 */
     }
 
-    return res;
+    if (wavx->audioformat == WAV_FORMAT_FLOAT)
+    {
+        return mono ? wav_convert_mono_f32 : wav_convert_f32;
+    }
+
+    switch (wavx->bps)
+    {
+        case 16:
+            return NULL;
+        case 24:
+            return mono ? wav_convert_mono24 : wav_convert_s24;
+        default:
+            return mono ? wav_convert_mono32 : NULL;
+    }
 }
 
+/**
+ * @brief       写入输出,统计阻塞时间
+ * @note        宽路径直接写入I2S;16位数据写入音频引擎的音乐输入,由混音器与提示音一起输出
+ * @param       buf : 数据
+ * @param       len : 字节数
+ * @retval      写入的字节数
+ */
+static uint32_t wav_write(const uint8_t *buf, uint32_t len)
+{
+    uint32_t start = audio_prof_start();
+    uint32_t written = len;
+
+    if (s_wide)
+    {
+        written = i2s_tx_write((uint8_t *)buf, len);
+    }
+    else if (audio_engine_music_write(buf, len) != ESP_OK)
+    {
+        written = 0;
+        s_abort = true;                                 /* 音频引擎已释放,读文件任务提前结束 */
+    }
+
+    audio_prof_stop(AUDIO_PROF_I2S, start);
+
+    if (s_wide)
+    {
+        i2s_tx_watch(true);                             /* DMA中已有数据,开始统计欠载 */
+    }
+
+    return written;
+}
 
 /**
- * @brief       获取当前播放时间
- * @param       fx    : 文件指针
- * @param       wavx  : wavx播放控制器
+ * @brief       转换整帧数据并写入输出
+ * @note        没有转换函数时(16位)原样写入音乐输入,混音器只接收整帧
+ * @param       in     : 输入数据,需对齐到AUDIO_PCM_ALIGN才使用SIMD
+ * @param       frames : 帧数
  * @retval      无
  */
-void wav_get_curtime(FIL *fx, __wavctrl *wavx)
+static void wav_render(const uint8_t *in, uint32_t frames)
 {
-    long long fpos = 0;
+    if (!s_convert)
+    {
+        wav_write(in, frames * wavctrl.blockalign);
+        s_played += frames * wavctrl.blockalign;
+        return;
+    }
 
-    wavx->totsec = wavx->datasize / (wavx->bitrate / 8);    /* 歌曲总长度(单位:秒) */
-    fpos = fx->fptr-wavx->datastart;                        /* 得到当前文件播放到的地方 */
-    wavx->cursec = fpos * wavx->totsec / wavx->datasize;    /* 当前播放到第多少秒了? */
+    while (frames)
+    {
+        uint32_t n = (frames > WAV_RENDER_FRAMES) ? WAV_RENDER_FRAMES : frames;
+        uint32_t start = audio_prof_start();
+        uint32_t bytes = s_convert(in, n);
+
+        audio_prof_stop(AUDIO_PROF_CONVERT, start);
+        wav_write((const uint8_t *)s_render, bytes);
+        s_played += n * wavctrl.blockalign;
+        in += n * wavctrl.blockalign;
+        frames -= n;
+    }
+}
+
+/**
+ * @brief       解码IMA ADPCM块并写入音乐输入
+ * @note        解码结果是16位PCM,单声道由混音器复制为立体声
+ * @param       in     : 数据
+ * @param       blocks : 块数
+ * @retval      无
+ */
+static void wav_render_adpcm(const uint8_t *in, uint32_t blocks)
+{
+    uint32_t ch = wavctrl.nchannels;
+
+    while (blocks--)
+    {
+        uint32_t start = audio_prof_start();
+        uint32_t frames = audio_adpcm_decode_block(in, wavctrl.blockalign, ch, s_adpcm_pcm);
+
+        audio_prof_stop(AUDIO_PROF_CONVERT, start);
+        wav_write((const uint8_t *)s_adpcm_pcm, frames * ch * sizeof(int16_t));
+
+        s_played += wavctrl.blockalign;
+        in += wavctrl.blockalign;
+    }
 }
 
 /**
- * @brief       music任务
+ * @brief       把一个缓冲区的数据写入输出,需要时转换格式
+ * @note        块长度不一定是帧长的整数倍,不完整的帧暂存在s_carry,与下一块的开头拼成一帧;
+ *              IMA ADPCM以整块为单位解码,不完整的块暂存在s_adpcm_carry
+ * @param       in  : 数据
+ * @param       len : 字节数
+ * @retval      无
+ */
+static void wav_output(const uint8_t *in, uint32_t len)
+{
+    uint32_t ba = wavctrl.blockalign;
+    uint8_t *carry = s_adpcm_pcm ? s_adpcm_carry : s_carry;
+    void (*render)(const uint8_t *, uint32_t) = s_adpcm_pcm ? wav_render_adpcm : wav_render;
+
+    if (s_wide && !s_convert)
+    {
+        s_played += wav_write(in, len);                 /* I2S按字节流发送,帧可以跨块 */
+        return;
+    }
+
+    if (s_carry_len)
+    {
+        uint32_t n = (ba - s_carry_len > len) ? len : ba - s_carry_len;
+
+        memcpy(carry + s_carry_len, in, n);
+        s_carry_len += n;
+        in += n;
+        len -= n;
+
+        if (s_carry_len < ba)
+        {
+            return;
+        }
+
+        render(carry, 1);
+        s_carry_len = 0;
+    }
+
+    uint32_t frames = len / ba;
+
+    render(in, frames);
+    s_carry_len = len - frames * ba;
+    memcpy(carry, in + frames * ba, s_carry_len);
+}
+
+/**
+ * @brief       读文件任务,把WAV数据块依次读入空闲缓冲区
+ * @note        第一次读取把文件位置补齐到扇区边界,之后每次读WAV_TX_BUFSIZE(扇区整数倍),
+ *              FatFs直接把整扇区读入缓冲区,不经过win[]中转;
+ *              读取与I2S写入另一个缓冲区同时进行;
+ *              需要转换格式时,数据存放在缓冲区中偏移lead处,使块中第一个完整帧对齐到AUDIO_PCM_ALIGN
+ * @param       pvParameters : 传入参数(未用到)
+ * @retval      无
+ */
+static void wav_read_task(void *pvParameters)
+{
+    wav_block_t blk;
+    UINT br;
+
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);                    /* 等待开始播放 */
+
+        uint32_t remain = wavctrl.datasize;
+        uint32_t len = WAV_SECTOR_SIZE - wavctrl.datastart % WAV_SECTOR_SIZE;   /* 补齐到扇区边界 */
+
+        if (f_lseek(g_audiodev.file, wavctrl.datastart) != FR_OK)
+        {
+            remain = 0;
+        }
+
+        while (remain)
+        {
+            xQueueReceive(s_free_q, &blk.idx, portMAX_DELAY);
+
+            if (s_abort)
+            {
+                xQueueSend(s_free_q, &blk.idx, 0);
+                break;
+            }
+
+            len = (len > remain) ? remain : len;
+
+            if (s_convert)
+            {
+                uint32_t ba = wavctrl.blockalign;
+                uint32_t first = (ba - (wavctrl.datasize - remain) % ba) % ba;     /* 块中第一个完整帧的位置 */
+
+                blk.lead = (AUDIO_PCM_ALIGN - first % AUDIO_PCM_ALIGN) % AUDIO_PCM_ALIGN;
+            }
+            else
+            {
+                blk.lead = 0;
+            }
+
+            uint32_t start = audio_prof_start();
+            FRESULT res = f_read(g_audiodev.file, s_buf[blk.idx] + blk.lead, len, &br);
+
+            audio_prof_stop(AUDIO_PROF_READ, start);
+            audio_prof_count(AUDIO_PROF_BYTES_READ, br);
+
+            if (res != FR_OK || br == 0)
+            {
+                xQueueSend(s_free_q, &blk.idx, 0);
+                break;
+            }
+
+            blk.len = br;
+            remain -= br;
+            xQueueSend(s_full_q, &blk, portMAX_DELAY);
+            len = WAV_TX_BUFSIZE;
+        }
+
+        blk.len = 0;                                                /* 结束标记,不占用缓冲区 */
+        xQueueSend(s_full_q, &blk, portMAX_DELAY);
+    }
+}
+
+/**
+ * @brief       music任务,把读好的缓冲区写入I2S或音频引擎的音乐输入
+ * @note        暂停时阻塞在任务通知上,不占用CPU;每写完一块检查一次暂停/停止通知
  * @param       pvParameters : 传入参数(未用到)
  * @retval      无
  */
 void music(void *pvParameters)
 {
-    pvParameters = pvParameters;
+    wav_block_t blk;
+    uint32_t bits;
 
-    /* ES8388初始化配置，有效降低启动时发出沙沙声 */
-    es8388_adda_cfg(1,0);                           /* 打开DAC，关闭ADC */
-    es8388_input_cfg(0);                            /* 录音关闭 */
-    es8388_output_cfg(1,1);                         /* 喇叭通道和耳机通道打开 */
-    es8388_hpvol_set(10);                           /* 设置耳机 */
-    es8388_spkvol_set(0);                          /* 设置喇叭 */
-    xl9555_pin_write(SPK_EN_IO,0);                  /* 打开喇叭 */
-    vTaskDelay(pdMS_TO_TICKS(20));
-    i2s_tx_write(g_audiodev.tbuf, WAV_TX_BUFSIZE);  /* 先发送一段无声音的数据 */
+    pvParameters = pvParameters;
 
-    while(1)
+    while (1)
     {
-        if ((g_audiodev.status & 0x0F) == 0x03)     /* 打开了音频 */
+        xTaskNotifyWait(0, WAV_NOTIFY_ALL, &bits, portMAX_DELAY);
+
+        if (!(bits & WAV_NOTIFY_PLAY))
+        {
+            continue;                                               /* 空闲时收到的暂停/停止 */
+        }
+
+        bool stop = false;
+        xTaskNotifyGive(s_read_task);
+
+        while (1)
         {
-            for(uint16_t readTimes = 0; readTimes < (wavctrl.datasize / WAV_TX_BUFSIZE); readTimes++)
+            if (!stop && xTaskNotifyWait(0, WAV_NOTIFY_ALL, &bits, 0) == pdTRUE)
             {
-                if ((g_audiodev.status & 0x0F) == 0x00)             /* 暂停播放 */
+                if (bits & WAV_NOTIFY_PAUSE)
                 {
-                    file_read_pos = f_tell(g_audiodev.file);        /* 记录暂停位置 */
-
-                    while(1)
+                    if (s_wide)
+                    {
+                        i2s_tx_watch(false);
+                        audio_stop();                               /* 暂停 */
+                    }
+                    else
                     {
-                        if ((g_audiodev.status & 0x0F) == 0x03)     /* 重新打开了 */
-                        {
-                            break;
-                        }
+                        audio_engine_music_end(false);              /* 已写入的数据播完,提示音照常输出 */
+                    }
 
-                        vTaskDelay(pdMS_TO_TICKS(5));               /* 死等 */
+                    while (!(bits & (WAV_NOTIFY_RESUME | WAV_NOTIFY_STOP)))
+                    {
+                        xTaskNotifyWait(0, WAV_NOTIFY_ALL, &bits, portMAX_DELAY);
                     }
 
-                    f_lseek(g_audiodev.file, file_read_pos);        /* 跳过到之前停止的位置 */
+                    if (s_wide && !(bits & WAV_NOTIFY_STOP))
+                    {
+                        audio_start();                              /* 继续播放 */
+                    }
                 }
 
-                /* 判断是否播放完成 */
-                if (i2s_table_size >= wavctrl.datasize || i2s_play_next_prev == ESP_OK)
+                if (bits & WAV_NOTIFY_STOP)
                 {
-                    audio_stop();                   /* 先停止播放 */
-                    i2s_deinit();                   /* 卸载I2S */
-                    i2s_table_size = 0;             /* 总大小清零 */
-                    i2s_play_end = ESP_OK;          /* 已播放完成标志位 */
-                    vTaskDelete(NULL);              /* 删除当前任务 */
-                    vTaskDelay(pdMS_TO_TICKS(5));   /* 适当延时（为了删除这个任务） */
-                    break;                          /* 防止延时5ms未能删除音频任务 */
+                    stop = true;
+                    s_abort = true;                                 /* 读文件任务收到空闲缓冲区后结束 */
                 }
+            }
+
+            UBaseType_t ready = uxQueueMessagesWaiting(s_full_q);  /* 可能包含结束标记 */
+
+            audio_prof_record(AUDIO_PROF_FILL, (ready > WAV_BUF_NUM ? WAV_BUF_NUM : ready) * 100 / WAV_BUF_NUM);
+            xQueueReceive(s_full_q, &blk, portMAX_DELAY);
+
+            if (blk.len == 0)
+            {
+                break;                                              /* 播放完成,或读文件任务已结束 */
+            }
 
-                f_read(g_audiodev.file,g_audiodev.tbuf, WAV_TX_BUFSIZE, (UINT*)&bytes_write);
-                i2s_table_size = i2s_table_size + i2s_tx_write(g_audiodev.tbuf, WAV_TX_BUFSIZE);
+            if (!stop)
+            {
+                wav_output(s_buf[blk.idx] + blk.lead, blk.len);
             }
+
+            xQueueSend(s_free_q, &blk.idx, 0);
+        }
+
+        if (s_wide)
+        {
+            i2s_tx_watch(false);                                    /* 停止写入,DMA播完后不算欠载 */
+        }
+        else
+        {
+            audio_engine_music_end(stop);                           /* 停止时丢弃混音器中的数据,播完时结尾不算欠载 */
         }
 
-        vTaskDelay(pdMS_TO_TICKS(1));
+        xTaskNotifyGive(s_owner);                                   /* 通知wav_play_song播放结束 */
     }
+}
 
-    vTaskDelete(NULL);
+/**
+ * @brief       创建常驻的WAV播放任务和双缓冲区
+ * @param       无
+ * @retval      ESP_OK:成功; ESP_ERR_NO_MEM:内存不足
+ */
+static esp_err_t wav_stream_init(void)
+{
+    if (MUSICTask_Handler)
+    {
+        return ESP_OK;
+    }
+
+    for (uint8_t i = 0; i < WAV_BUF_NUM; i++)
+    {
+        s_buf[i] = heap_caps_aligned_alloc(WAV_BUF_ALIGN, WAV_TX_BUFSIZE + AUDIO_PCM_ALIGN, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+
+        if (!s_buf[i])
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    s_free_q = xQueueCreate(WAV_BUF_NUM, sizeof(uint8_t));
+    s_full_q = xQueueCreate(WAV_BUF_NUM + 1, sizeof(wav_block_t));   /* 两个数据块加结束标记 */
+
+    if (!s_free_q || !s_full_q)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (uint8_t i = 0; i < WAV_BUF_NUM; i++)
+    {
+        xQueueSend(s_free_q, &i, 0);
+    }
+
+    /* 读文件属于I/O级,写I2S属于输出级;任务固定在核心上,各阶段耗时用所在核心的周期计数器测量 */
+    audio_engine_placement_t place;
+    audio_engine_get_placement(&place);
+
+    if (xTaskCreatePinnedToCore(wav_read_task, "wavread", WAVREAD_STK_SIZE, NULL, WAVREAD_PRIO, &s_read_task, place.io_core) != pdPASS ||
+        xTaskCreatePinnedToCore(music, "music", MUSIC_STK_SIZE, NULL, MUSIC_PRIO, &MUSICTask_Handler, place.output_core) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
 }
 
 /**
- * @brief       播放某个wav文件
- * @param       fname : 文件路径+文件名
- * @retval      KEY0_PRES : 下一首
- *              KEY1_PRES : 上一首
- *              KEY2_PRES : 停止/启动
- *              其他,非WAV文件
+ * @brief       WAV 文件解析初始化
+ * @note        依次读取各chunk的头部,跳过不认识的chunk,不要求fmt、fact、LIST、data的顺序;
+ *              支持WAVE_FORMAT_EXTENSIBLE,16/24/32位整数和32位浮点PCM,以及IMA ADPCM
+ * @param       file  : 已打开的WAV文件
+ * @param       wavx  : WAV 文件信息存放结构体指针
+ * @retval      0, 解析正确
+ *              1, 读取文件失败
+ *              2, 非WAV文件或不支持的格式
+ *              3, DATA区域未找到
  */
-uint8_t wav_play_song(uint8_t *fname)
+uint8_t wav_decode_init(FIL *file, __wavctrl *wavx)
 {
-    uint8_t key = 0;
-    uint8_t res = 0;
+    ChunkRIFF riff;
+    ChunkHDR hdr;
+    ChunkFMT fmt = {0};
+    ChunkFMTEXT ext;
+    uint16_t adpcm[2] = {0};                                        /* IMA ADPCM的cbSize和每块帧数 */
+    UINT br = 0;
+    uint16_t format = 0;
+    FSIZE_t pos;
+
+    if (f_lseek(file, 0) != FR_OK || f_read(file, &riff, sizeof(riff), &br) != FR_OK || br != sizeof(riff))
+    {
+        printf("[WAV Parser] Error: Failed to read RIFF header\n");
+        return 1;
+    }
+
+    if (riff.ChunkID != WAV_ID_RIFF || riff.Format != WAV_ID_WAVE)
+    {
+        printf("[WAV Parser] Error: Not a valid WAV file (Format: 0x%lx)\n", riff.Format);
+        return 2;
+    }
 
-    i2s_play_end = ESP_FAIL;
-    i2s_play_next_prev = ESP_FAIL;
-    g_audiodev.file = (FIL*)heap_caps_malloc(sizeof(FIL),MALLOC_CAP_DMA);
-    g_audiodev.tbuf = heap_caps_malloc(WAV_TX_BUFSIZE, MALLOC_CAP_DMA);       /* 音频数据 */
-
-    myi2s_init();                                   /* I2S初始化 */
-    vTaskDelay(pdMS_TO_TICKS(50));                  /* 适当延时 */
-
-    if (g_audiodev.file || g_audiodev.tbuf)
-    {
-        memset(g_audiodev.file,0,sizeof(FIL));      /* 文件指针清零 */
-        memset(g_audiodev.tbuf,0,WAV_TX_BUFSIZE);   /* buf清零 */
-        memset(&wavctrl,0,sizeof(__wavctrl));       /* 对WAV结构体相关参数清零 */
-        res = wav_decode_init(fname, &wavctrl);     /* 对wav音频文件解码 */
-        /*如果解析失败，可以在这里添加退出或错误处理逻辑*/
-        if(res != 0) {
-            // 例如：返回错误、显示错误界面、记录日志等
-            audio_stop();                   /* 先停止播放 */
-            i2s_deinit();                   /* 卸载I2S */
-            return KEY0_PRES;  // 或者其他适当的错误处理
+    wavx->datastart = 0;
+    pos = sizeof(riff);
+
+    while (format == 0 || wavx->datastart == 0)
+    {
+        if (f_lseek(file, pos) != FR_OK || f_read(file, &hdr, sizeof(hdr), &br) != FR_OK || br != sizeof(hdr))
+        {
+            break;                                                  /* 文件结束 */
         }
 
-        if (res == 0)                               /* 解码成功 */
+        if (hdr.ChunkID == WAV_ID_FMT && hdr.ChunkSize >= 16)
         {
-            if (wavctrl.bps == 16)                  /* 根据解码文件重新配置采样率和位宽 */
-            {
-                i2s_set_samplerate_bits_sample(wavctrl.samplerate,I2S_BITS_PER_SAMPLE_16BIT);
-            }
-            else if (wavctrl.bps == 24)
+            if (f_lseek(file, pos) != FR_OK || f_read(file, &fmt, sizeof(fmt), &br) != FR_OK || br != sizeof(fmt))
             {
-                i2s_set_samplerate_bits_sample(wavctrl.samplerate,I2S_BITS_PER_SAMPLE_24BIT);
+                return 1;
             }
 
-            res = f_open(g_audiodev.file, (TCHAR*)fname, FA_READ);      /* 打开WAV音频文件 */
+            format = fmt.AudioFormat;
 
-            if (res == FR_OK)
+            if (format == WAV_FORMAT_EXTENSIBLE)                    /* 实际格式在SubFormat GUID的前两个字节 */
             {
-                audio_start();  /* 开启I2S */
-                /* 打开成功后，才创建音频任务 */
-                if (MUSICTask_Handler == NULL && res == FR_OK)
+                if (hdr.ChunkSize < 16 + sizeof(ext) ||
+                    f_read(file, &ext, sizeof(ext), &br) != FR_OK || br != sizeof(ext))
                 {
-                    taskENTER_CRITICAL(&my_spinlock);
-                    xTaskCreate(music, "music", 4096, &MUSICTask_Handler, 5, NULL);
-                    taskEXIT_CRITICAL(&my_spinlock);
+                    return 2;
                 }
 
-                while (res == FR_OK)
+                format = ext.SubFormat[0] | (ext.SubFormat[1] << 8);
+            }
+            else if (format == WAV_FORMAT_IMA_ADPCM)
+            {
+                if (hdr.ChunkSize < 16 + sizeof(adpcm) ||
+                    f_read(file, adpcm, sizeof(adpcm), &br) != FR_OK || br != sizeof(adpcm))
                 {
-                    while (1)
-                    {
-                        /* 播放结束，下一首 */
-                        if (i2s_play_end == ESP_OK)
-                        {
-                            res = KEY0_PRES;
-                            break;
-                        }
-
-                        key = xl9555_key_scan(0);
-
-                        switch (key)
-                        {
-                            /* 下一首/上一首 */
-                            case KEY0_PRES:
-                            case KEY1_PRES:
-                                i2s_play_next_prev = ESP_OK;
-                                break;
-                            /* 暂停/开启 */
-                            case KEY2_PRES:
-                                if ((g_audiodev.status & 0x0F) == 0x03)
-                                {
-                                    audio_stop();
-                                }
-                                else if ((g_audiodev.status & 0x0F) == 0x00)
-                                {
-                                    audio_start();
-                                }
-                                break;
-                        }
-
-                        if ((g_audiodev.status & 0x0F) == 0x03)                 /* 暂停不刷新时间 */
-                        {
-                            wav_get_curtime(g_audiodev.file, &wavctrl);         /* 得到总时间和当前播放的时间 */
-                            audio_msg_show(wavctrl.totsec, wavctrl.cursec, wavctrl.bitrate);
-                        }
-
-                        vTaskDelay(pdMS_TO_TICKS(10));
-                    }
-
-                    if (key == KEY1_PRES || key == KEY0_PRES)                   /* 退出切换歌曲 */
-                    {
-                        res = key;
-                        break;
-                    }
+                    return 2;
                 }
             }
-            else
+        }
+        else if (hdr.ChunkID == WAV_ID_DATA)
+        {
+            wavx->datastart = pos + sizeof(hdr);
+            wavx->datasize = hdr.ChunkSize;
+
+            if (wavx->datasize > f_size(file) - wavx->datastart)
             {
-                res = 0xFF;
+                wavx->datasize = f_size(file) - wavx->datastart;    /* 未写完长度的录音文件 */
             }
         }
         else
         {
-            res = 0xFF;
+            printf("[WAV Parser] Skip chunk %.4s (Size: %lu)\n", (char *)&hdr.ChunkID, hdr.ChunkSize);
+        }
+
+        if (hdr.ChunkSize >= f_size(file) - pos - sizeof(hdr))
+        {
+            break;                                                  /* 最后一个chunk */
+        }
+
+        pos += sizeof(hdr) + hdr.ChunkSize + (hdr.ChunkSize & 1);   /* chunk按2字节对齐 */
+    }
+
+    if (wavx->datastart == 0)
+    {
+        printf("[WAV Parser] Error: DATA Chunk not found\n");
+        return 3;
+    }
+
+    bool ima = (format == WAV_FORMAT_IMA_ADPCM && fmt.BitsPerSample == 4 && adpcm[1] != 0 &&
+                adpcm[1] == audio_adpcm_samples_per_block(fmt.BlockAlign, fmt.NumOfChannels));
+
+    if (!((format == WAV_FORMAT_PCM && (fmt.BitsPerSample == 16 || fmt.BitsPerSample == 24 || fmt.BitsPerSample == 32)) ||
+          (format == WAV_FORMAT_FLOAT && fmt.BitsPerSample == 32) || ima) ||
+        (fmt.NumOfChannels != 1 && fmt.NumOfChannels != 2) ||
+        (!ima && fmt.BlockAlign != fmt.NumOfChannels * fmt.BitsPerSample / 8))
+    {
+        printf("[WAV Parser] Error: Unsupported format %d, %d bits, %d channels\n",
+               format, format ? fmt.BitsPerSample : 0, format ? fmt.NumOfChannels : 0);
+        return 2;
+    }
+
+    /* 填充WAV文件信息结构体 */
+    wavx->audioformat = format;
+    wavx->nchannels = fmt.NumOfChannels;
+    wavx->samplerate = fmt.SampleRate;
+    wavx->bitrate = fmt.ByteRate * 8;
+    wavx->blockalign = fmt.BlockAlign;
+    wavx->bps = fmt.BitsPerSample;
+    wavx->samplesperblock = ima ? adpcm[1] : 1;
+    wavx->datasize -= wavx->datasize % wavx->blockalign;           /* 只播放完整的帧(ADPCM为完整的块) */
+
+    printf("[WAV Parser] %s %d bits, %d channels, %lu Hz, data %lu bytes at offset %lu\n",
+           format == WAV_FORMAT_FLOAT ? "Float" : (ima ? "IMA ADPCM" : "PCM"), wavx->bps, wavx->nchannels,
+           wavx->samplerate, wavx->datasize, wavx->datastart);
+
+    return 0;
+}
+
+/**
+ * @brief       获取当前播放时间
+ * @param       fx    : 文件指针(未用到)
+ * @param       wavx  : wavx播放控制器
+ * @retval      无
+ */
+void wav_get_curtime(FIL *fx, __wavctrl *wavx)
+{
+    long long fpos = 0;
+
+    fx = fx;
+    wavx->totsec = wavx->datasize / (wavx->bitrate / 8);    /* 歌曲总长度(单位:秒) */
+    fpos = s_played;                                        /* 已写入I2S的数据,文件读取位置会提前两个缓冲区 */
+    wavx->cursec = fpos * wavx->totsec / wavx->datasize;    /* 当前播放到第多少秒了? */
+}
+
+/**
+ * @brief       宽路径:释放音频引擎,独占I2S TX按32位输出
+ * @note        混音器只输出16位,24/32位和浮点数据要保留低位就不能经过混音器,
+ *              这是WAV播放中唯一停止音频引擎的情况,播放期间没有提示音和压低;
+ *              下次MP3播放或提示音时音频引擎重新初始化
+ * @param       无
+ * @retval      ESP_OK:成功; 其他:失败,I2S TX没有打开
+ */
+static esp_err_t wav_wide_open(void)
+{
+    audio_engine_deinit();                                          /* 释放音频引擎占用的I2S TX */
+    esp_err_t ret = i2s_open(I2S_DIR_TX);                           /* 打开I2S TX,录音可能同时在使用RX */
+
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE("wavplay", "I2S打开失败: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    if (i2s_set_format(I2S_DIR_TX, wavctrl.samplerate, I2S_DATA_BIT_WIDTH_32BIT) != ESP_OK)
+    {
+        ESP_LOGW("wavplay", "正在录音,格式不同,跳过 %lu Hz %u 位", wavctrl.samplerate, wavctrl.bps);
+        i2s_close(I2S_DIR_TX);                                      /* 没有打开I2S时不能关闭,否则会减掉录音的引用 */
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    es8388_i2s_cfg(0, 0);                                           /* 24bit,接收32位左对齐数据的高24位 */
+
+    /* ES8388初始化配置，有效降低启动时发出沙沙声 */
+    es8388_adda_cfg(1, i2s_is_open(I2S_DIR_RX));                    /* 打开DAC，正在录音时保留ADC */
+    es8388_input_cfg(0);                                            /* 录音关闭 */
+    es8388_output_cfg(1, 1);                                        /* 喇叭通道和耳机通道打开 */
+    es8388_hpvol_set(10);                                           /* 设置耳机 */
+    es8388_spkvol_set(0);                                           /* 设置喇叭 */
+    xl9555_pin_write(SPK_EN_IO, 0);                                 /* 打开喇叭 */
+    audio_start();                                                  /* 开启I2S */
+    vTaskDelay(pdMS_TO_TICKS(20));
+
+    memset(s_buf[0], 0, WAV_TX_BUFSIZE);
+    i2s_tx_write(s_buf[0], WAV_TX_BUFSIZE);                         /* 先发送一段无声音的数据 */
+
+    return ESP_OK;
+}
+
+/**
+ * @brief       宽路径结束,关闭I2S TX并恢复ES8388的16位接口
+ * @param       无
+ * @retval      无
+ */
+static void wav_wide_close(void)
+{
+    if ((g_audiodev.status & 0x0F) == 0x03)
+    {
+        audio_stop();                                               /* 先停止播放 */
+    }
+
+    i2s_close(I2S_DIR_TX);                                          /* 关闭I2S TX,都关闭后卸载 */
+    es8388_i2s_cfg(0, 3);                                           /* 恢复16bit,与es8388_init一致 */
+}
+
+/**
+ * @brief       播放某个wav文件
+ * @param       fname : 文件路径+文件名
+ * @retval      KEY0_PRES : 下一首
+ *              KEY1_PRES : 上一首
+ *              KEY2_PRES : 停止/启动
+ *              其他,非WAV文件
+ */
+uint8_t wav_play_song(uint8_t *fname)
+{
+    uint8_t key = 0;
+    uint8_t res = 0;
+    bool paused = false;
+
+    if (wav_stream_init() != ESP_OK)
+    {
+        ESP_LOGE("wavplay", "stream init failed");
+        return 0xFF;
+    }
+
+    g_audiodev.file = (FIL *)malloc(sizeof(FIL));
+
+    if (!g_audiodev.file || f_open(g_audiodev.file, (TCHAR *)fname, FA_READ) != FR_OK)
+    {
+        free(g_audiodev.file);
+        g_audiodev.file = NULL;
+        return 0xFF;
+    }
+
+    memset(&wavctrl, 0, sizeof(__wavctrl));                         /* 对WAV结构体相关参数清零 */
+    res = wav_decode_init(g_audiodev.file, &wavctrl);               /* 对wav音频文件解码 */
+
+    if (res != 0)
+    {
+        f_close(g_audiodev.file);
+        free(g_audiodev.file);
+        g_audiodev.file = NULL;
+        return KEY0_PRES;                                           /* 解析失败,跳到下一首 */
+    }
+
+    s_convert = wav_select_convert(&wavctrl);
+    s_carry_len = 0;
+
+    if (wavctrl.audioformat == WAV_FORMAT_IMA_ADPCM)
+    {
+        s_adpcm_carry = heap_caps_malloc(wavctrl.blockalign, MALLOC_CAP_INTERNAL);
+        s_adpcm_pcm = heap_caps_aligned_alloc(AUDIO_PCM_ALIGN, wavctrl.samplesperblock * wavctrl.nchannels * sizeof(int16_t),
+                                              MALLOC_CAP_INTERNAL);
+
+        if (!s_adpcm_carry || !s_adpcm_pcm)
+        {
+            heap_caps_free(s_adpcm_carry);
+            heap_caps_free(s_adpcm_pcm);
+            s_adpcm_carry = NULL;
+            s_adpcm_pcm = NULL;
+            f_close(g_audiodev.file);
+            free(g_audiodev.file);
+            g_audiodev.file = NULL;
+            return KEY0_PRES;                                       /* 内存不足,跳到下一首 */
+        }
+    }
+
+    /* 16位数据和IMA ADPCM与MP3一样写入音频引擎的音乐输入,提示音和压低照常工作,采样率由引擎处理;
+     * 24/32位和浮点统一转换为左对齐的32位走宽路径,见wav_wide_open */
+    s_wide = !(wavctrl.bps == 16 || wavctrl.audioformat == WAV_FORMAT_IMA_ADPCM);
+
+    esp_err_t ret = s_wide ? wav_wide_open() : audio_engine_music_open(wavctrl.samplerate, wavctrl.nchannels);
+
+    if (ret != ESP_OK)
+    {
+        ESP_LOGW("wavplay", "无法播放 %lu Hz %u 位: %s", wavctrl.samplerate, wavctrl.bps, esp_err_to_name(ret));
+        f_close(g_audiodev.file);
+        free(g_audiodev.file);
+        g_audiodev.file = NULL;
+        heap_caps_free(s_adpcm_carry);
+        heap_caps_free(s_adpcm_pcm);
+        s_adpcm_carry = NULL;
+        s_adpcm_pcm = NULL;
+        return KEY0_PRES;                                           /* 跳到下一首 */
+    }
+
+    s_owner = xTaskGetCurrentTaskHandle();
+    s_abort = false;
+    s_played = 0;
+    xTaskNotify(MUSICTask_Handler, WAV_NOTIFY_PLAY, eSetBits);
+
+    while (1)
+    {
+        /* 播放结束时music任务通知本任务,否则每10ms扫描一次按键 */
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10)))
+        {
+            res = KEY0_PRES;                                        /* 播放结束，下一首 */
+            break;
+        }
+
+        key = xl9555_key_scan(0);
+
+        if (key == KEY0_PRES || key == KEY1_PRES)                   /* 下一首/上一首 */
+        {
+            xTaskNotify(MUSICTask_Handler, WAV_NOTIFY_STOP, eSetBits);
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);                /* 等待music任务停止 */
+            res = key;
+            break;
+        }
+        else if (key == KEY2_PRES)                                  /* 暂停/开启 */
+        {
+            paused = !paused;
+            xTaskNotify(MUSICTask_Handler, paused ? WAV_NOTIFY_PAUSE : WAV_NOTIFY_RESUME, eSetBits);
+        }
+
+        if (!paused)                                                /* 暂停不刷新时间 */
+        {
+            wav_get_curtime(g_audiodev.file, &wavctrl);             /* 得到总时间和当前播放的时间 */
+            audio_msg_show(wavctrl.totsec, wavctrl.cursec, wavctrl.bitrate);
         }
     }
-    else
+
+    if (s_wide)
     {
-        res = 0xFF;
+        wav_wide_close();
     }
 
-    heap_caps_free(g_audiodev.file);
-    heap_caps_free(g_audiodev.tbuf);
-    g_audiodev.tbuf = NULL;
+    f_close(g_audiodev.file);
+    free(g_audiodev.file);
     g_audiodev.file = NULL;
-    MUSICTask_Handler = NULL;
+    heap_caps_free(s_adpcm_carry);
+    heap_caps_free(s_adpcm_pcm);
+    s_adpcm_carry = NULL;
+    s_adpcm_pcm = NULL;
     return res;
 }
@@ -16,7 +16,29 @@
 #include "xl9555.h"
 
 
-#define WAV_TX_BUFSIZE    4096  /* 定义WAV TX数组大小 */
+#define WAV_SECTOR_SIZE   512   /* FatFs扇区大小 */
+#define WAV_TX_BUFSIZE    4096  /* 每个缓冲区的大小,须为WAV_SECTOR_SIZE的整数倍 */
+#define WAV_BUF_NUM       2     /* 缓冲区个数,一个读文件时另一个写入I2S */
+#define WAV_BUF_ALIGN     64    /* 缓冲区地址对齐 */
+#define WAV_RENDER_FRAMES 256   /* 格式转换时每次写入I2S的帧数 */
+#define WAV_FRAME_MAX     8     /* 最大帧长(立体声32位) */
+
+#define WAV_ID_RIFF       0x46464952    /* "RIFF" */
+#define WAV_ID_WAVE       0x45564157    /* "WAVE" */
+#define WAV_ID_FMT        0x20746D66    /* "fmt " */
+#define WAV_ID_DATA       0x61746164    /* "data" */
+
+#define WAV_FORMAT_PCM        0x0001    /* 线性PCM */
+#define WAV_FORMAT_FLOAT      0x0003    /* IEEE浮点 */
+#define WAV_FORMAT_IMA_ADPCM  0x0011    /* IMA ADPCM,4位 */
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE    /* 实际格式在SubFormat中 */
+
+/* music任务的通知位 */
+#define WAV_NOTIFY_PLAY   (1 << 0)  /* 开始播放 */
+#define WAV_NOTIFY_PAUSE  (1 << 1)  /* 暂停 */
+#define WAV_NOTIFY_RESUME (1 << 2)  /* 继续 */
+#define WAV_NOTIFY_STOP   (1 << 3)  /* 停止 */
+#define WAV_NOTIFY_ALL    (WAV_NOTIFY_PLAY | WAV_NOTIFY_PAUSE | WAV_NOTIFY_RESUME | WAV_NOTIFY_STOP)
 
 typedef struct
 {
@@ -38,6 +60,20 @@ typedef struct
 //    uint16_t ByteExtraData;   /* 附加的数据字节;2个; 线性PCM,没有这个参数 */
 } ChunkFMT;                     /* fmt块 */
 
+typedef struct
+{
+    uint16_t cbSize;            /* 扩展部分大小;这里为22 */
+    uint16_t ValidBitsPerSample;/* 有效位数 */
+    uint32_t ChannelMask;       /* 声道位置 */
+    uint8_t SubFormat[16];      /* 格式GUID,前两个字节为格式代码 */
+} ChunkFMTEXT;                  /* WAVE_FORMAT_EXTENSIBLE的fmt扩展部分,紧跟在ChunkFMT之后 */
+
+typedef struct
+{
+    uint32_t ChunkID;           /* chunk id */
+    uint32_t ChunkSize;         /* 子集合大小(不包括ID和Size) */
+} ChunkHDR;                     /* chunk头 */
+
 typedef struct
 {
     uint32_t ChunkID;           /* chunk id;这里固定为"fact",即0X74636166 */
@@ -67,7 +103,7 @@ typedef struct
 
 typedef struct
 {
-    uint16_t audioformat;       /* 音频格式;0X01,表示线性PCM;0X11表示IMA ADPCM */
+    uint16_t audioformat;       /* 音频格式;0X01,表示线性PCM;0X03表示浮点(EXTENSIBLE已换成实际格式) */
     uint16_t nchannels;         /* 通道数量;1,表示单声道;2,表示双声道; */
     uint16_t blockalign;        /* 块对齐(字节); */
     uint32_t datasize;          /* WAV数据大小 */
@@ -77,14 +113,15 @@ typedef struct
 
     uint32_t bitrate;           /* 比特率(位速) */
     uint32_t samplerate;        /* 采样率 */
-    uint16_t bps;               /* 位数,比如16bit,24bit,32bit */
+    uint16_t bps;               /* 位数,比如16bit,24bit,32bit;IMA ADPCM为4 */
+    uint16_t samplesperblock;   /* IMA ADPCM每块的帧数,块长为blockalign */
 
     uint32_t datastart;         /* 数据帧开始的位置(在文件里面的偏移) */
 } __wavctrl;                    /* wav 播放控制结构体 */
 
 
 /* 函数声明 */
-uint8_t wav_decode_init(uint8_t *fname, __wavctrl *wavx);   /* WAV解码初始化 */
+uint8_t wav_decode_init(FIL *file, __wavctrl *wavx);        /* WAV解码初始化 */
 uint8_t wav_play_song(uint8_t *fname);                      /* 播放歌曲 */
 
 #endif
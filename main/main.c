@@ -10,6 +10,7 @@
 #include "esp_log.h"
 
 #include "record.h"
+#include "mic_stream.h"
 #include "http.h"
 #include "wifi.h"
 #include "led.h"
@@ -31,9 +32,20 @@
 #include "../components/Middlewares/MYFATFS/exfuns.h"
 #include "audioplay.h"
 #include "mp3_decoder.h"
+#include "audio_engine.h"
+#include "prompt_cache.h"
+#include "file_stream.h"
+#include "spsc_ring.h"
+#include "audio_mixer.h"
+#include "resampler.h"
+#include "vad.h"
 
 #define TAG "MAIN"
 
+static const char *const s_prompts[] = {    /* 开机时解码到PSRAM的提示音 */
+    "/spiffs/test.mp3",
+};
+
 static void ledc_init_example(void);
 static void timer_init_example(void);
 static void printf_chip_info(void);
@@ -58,21 +70,40 @@ void app_main(void)
     printf_chip_info();             //打印板载信息
     ESP_ERROR_CHECK(spiffs_init("storage", DEFAULT_MOUNT_POINT, DEFAULT_FD_NUM));    /* SPIFFS初始化 */
     spiffs_test();
+    prompt_cache_preload(s_prompts, sizeof(s_prompts) / sizeof(s_prompts[0]));  /* 提示音第一次播放也能立即开始 */
+    // audio_mixer_bench();        /* 混音CPU占用测试 */
+    // resampler_bench();          /* 各质量等级重采样CPU占用测试 */
+    // vad_bench();                /* 语音活动检测CPU占用测试 */
 
 
     my_wifi_init();
-    xTaskCreate(http_get_task, "http_get_task", 8192, NULL, 5, NULL);
-    xTaskCreate(decode_mp3_task, "print_task", 4096, NULL, 4, NULL);
     my_hardware_init();             //初始化板级设备信息
+    audio_engine_init();            /* 预先初始化常驻音频引擎,第一次播放不用等待I2S和ES8388配置 */
+    xTaskCreate(http_get_task, "http_get_task", 8192, NULL, 5, NULL);
+    // file_stream_bench("/0:/MP3/renjianyanhuo.mp3");        /* fread和f_read直读的吞吐量与定位耗时 */
+    // audio_engine_latency_test("/0:/MP3/renjianyanhuo.mp3");  /* 每次初始化和常驻引擎的启动延迟 */
+    // audio_engine_prompt_test("/spiffs/test.mp3");   /* 提示音开始播放的延迟 */
+    // audio_engine_stress_test("/0:/MP3/renjianyanhuo.mp3", "http://192.168.0.25:8000/a.mp3", 30000);  /* 各种核心分配下的欠载次数 */
     // wav_play_song("0:/MUSIC/2.wav");      //单独播放某一个特定文件的音乐  wav格式
 
     // const char *mp3_path = "/spiffs/test.mp3"; // 请确保路径正确且已挂载
     // const char *mp3_path = "/0:/MP3/renjianyanhuo.mp3"; // 请确保路径正确且已挂载
     // my_mp3_play("/0:/MP3/renjianyanhuo.mp3");
     my_recorder_init();
+    // recorder_test(60000);           /* 录音60s,WiFi下载同时进行时检查是否丢数据 */
+    // recorder_loopback_test(10000);  /* 双工直通10s,往返延迟应小于20ms */
+    // recorder_upload_test(60000);  /* 边录边传60s,需要REC_UPLOAD为1,PC上运行tools/upload_server.py */
+    // mic_stream_start(MIC_STREAM_ADPCM);  /* 麦克风实时流 ws://<IP>:8080/mic,PC上用tools/mic_stream_client.py接收并测量延迟 */
     while(1) {
         // audio_play();       /* 循环播放音乐 */
-        vTaskDelay(pdMS_TO_TICKS(10)); /* 延时 */
+        char url[HTTP_MP3_URL_LEN];
+        /* 服务器上的MP3边下载边播放;在这里加入播放,不在HTTP客户端的回调中初始化音频引擎.等待兼作延时 */
+        if (http_take_mp3_url(url, sizeof(url), pdMS_TO_TICKS(10))) {
+            ESP_LOGI(TAG, "加入播放: %s", url);
+            if (audio_engine_enqueue(url) != ESP_OK) {
+                ESP_LOGE(TAG, "加入播放失败: %s", url);
+            }
+        }
     }
 }
 
@@ -0,0 +1,215 @@
+#!/usr/bin/env python3
+"""
+麦克风实时流的 Linux 客户端 (只用标准库)
+
+    python3 tools/mic_stream_client.py ws://192.168.0.50:8080/mic -t 30 -o mic.wav
+
+连接设备上的 mic_stream, 把收到的每条消息的消息头前 12 字节 (采集时刻和序号) 原样发回,
+设备据此统计采集到客户端收到的延迟并打印在日志中. 本端统计收到的消息数, 按序号发现的丢帧
+和到达间隔的抖动, 可以把音频保存为 WAV (PCM 或 IMA ADPCM), 丢掉的帧补静音.
+"""
+
+import argparse
+import base64
+import json
+import os
+import socket
+import struct
+import sys
+import time
+import urllib.parse
+
+HEADER = struct.Struct("<qIHBB")        # 采集时刻(us), 序号, 帧数, 格式, 声道数
+
+
+class WebSocket:
+    """最小的 WebSocket 客户端, 只支持本工具用到的帧"""
+
+    def __init__(self, url, timeout=5.0):
+        u = urllib.parse.urlparse(url)
+        if u.scheme != "ws":
+            raise ValueError("only ws:// is supported")
+        self.sock = socket.create_connection((u.hostname, u.port or 80), timeout=timeout)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        key = base64.b64encode(os.urandom(16)).decode()
+        request = (f"GET {u.path or '/'} HTTP/1.1\r\nHost: {u.netloc}\r\nUpgrade: websocket\r\n"
+                   f"Connection: Upgrade\r\nSec-WebSocket-Key: {key}\r\nSec-WebSocket-Version: 13\r\n\r\n")
+        self.sock.sendall(request.encode())
+        self.buf = b""
+        while b"\r\n\r\n" not in self.buf:
+            data = self.sock.recv(4096)
+            if not data:
+                raise ConnectionError("handshake: connection closed")
+            self.buf += data
+        head, self.buf = self.buf.split(b"\r\n\r\n", 1)
+        if b" 101 " not in head.split(b"\r\n", 1)[0]:
+            raise ConnectionError("handshake failed: " + head.decode(errors="replace"))
+
+    def _read(self, n):
+        while len(self.buf) < n:
+            data = self.sock.recv(65536)
+            if not data:
+                raise ConnectionError("connection closed")
+            self.buf += data
+        out, self.buf = self.buf[:n], self.buf[n:]
+        return out
+
+    def recv(self):
+        """返回 (opcode, payload), 自动回复 ping"""
+        while True:
+            b0, b1 = self._read(2)
+            opcode, n = b0 & 0x0F, b1 & 0x7F
+            if n == 126:
+                n = struct.unpack(">H", self._read(2))[0]
+            elif n == 127:
+                n = struct.unpack(">Q", self._read(8))[0]
+            mask = self._read(4) if b1 & 0x80 else None
+            payload = self._read(n)
+            if mask:
+                payload = bytes(c ^ mask[i & 3] for i, c in enumerate(payload))
+            if opcode == 0x9:
+                self.send(payload, 0xA)
+                continue
+            return opcode, payload
+
+    def send(self, payload, opcode=0x2):
+        """客户端发出的帧必须加掩码"""
+        mask = os.urandom(4)
+        n = len(payload)
+        head = bytes([0x80 | opcode])
+        if n < 126:
+            head += bytes([0x80 | n])
+        elif n < 65536:
+            head += bytes([0x80 | 126]) + struct.pack(">H", n)
+        else:
+            head += bytes([0x80 | 127]) + struct.pack(">Q", n)
+        self.sock.sendall(head + mask + bytes(c ^ mask[i & 3] for i, c in enumerate(payload)))
+
+    def close(self):
+        try:
+            self.send(struct.pack(">H", 1000), 0x8)
+        except OSError:
+            pass
+        self.sock.close()
+
+
+class WavWriter:
+    """PCM 或 IMA ADPCM WAV, 关闭时补写长度"""
+
+    def __init__(self, path, info):
+        self.f = open(path, "wb")
+        self.adpcm = info["format"] == "ima_adpcm"
+        self.channels = info["channels"]
+        self.rate = info["rate"]
+        self.block = info["block"]
+        self.frames = 0
+        self.data = 0
+        self.f.write(b"\0" * (60 if self.adpcm else 44))
+
+    def write(self, payload, frames):
+        self.f.write(payload)
+        self.data += len(payload)
+        # ADPCM 每块解码出 spb 帧, 最后一帧是设备补齐的
+        self.frames += self.spb() if self.adpcm else frames
+
+    def silence(self, frames):
+        if self.adpcm:
+            self.write(b"\0" * self.block, 0)   # 全零的块解码为静音
+        else:
+            self.write(b"\0" * frames * self.channels * 2, frames)
+
+    def spb(self):
+        return (self.block - 4 * self.channels) * 2 // self.channels + 1
+
+    def close(self):
+        ch, rate = self.channels, self.rate
+        self.f.seek(0)
+        if self.adpcm:
+            spb = self.spb()
+            fmt = struct.pack("<HHIIHHHH", 0x11, ch, rate, rate * self.block // spb, self.block, 4, 2, spb)
+            self.f.write(b"RIFF" + struct.pack("<I", 52 + self.data) + b"WAVE" +
+                         b"fmt " + struct.pack("<I", len(fmt)) + fmt +
+                         b"fact" + struct.pack("<II", 4, self.frames) +
+                         b"data" + struct.pack("<I", self.data))
+        else:
+            fmt = struct.pack("<HHIIHH", 1, ch, rate, rate * ch * 2, ch * 2, 16)
+            self.f.write(b"RIFF" + struct.pack("<I", 36 + self.data) + b"WAVE" +
+                         b"fmt " + struct.pack("<I", len(fmt)) + fmt +
+                         b"data" + struct.pack("<I", self.data))
+        self.f.close()
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    ap.add_argument("url", help="ws://<设备IP>:8080/mic")
+    ap.add_argument("-t", "--seconds", type=float, default=10, help="接收时长")
+    ap.add_argument("-o", "--out", help="保存为 WAV")
+    ap.add_argument("--no-ack", action="store_true", help="不发回执, 设备不统计延迟")
+    args = ap.parse_args()
+
+    ws = WebSocket(args.url)
+    opcode, payload = ws.recv()
+    if opcode != 0x1:
+        sys.exit("expected the format description first")
+    info = json.loads(payload)
+    print("format:", info)
+
+    wav = WavWriter(args.out, info) if args.out else None
+    frame_s = info["frame_ms"] / 1000
+    received = lost = 0
+    next_seq = None
+    last_arrival = None
+    jitter_max = jitter_sum = 0.0
+    start = report = time.monotonic()
+
+    try:
+        while time.monotonic() - start < args.seconds:
+            opcode, payload = ws.recv()
+            if opcode == 0x8:
+                print("closed by the device")
+                break
+            if opcode != 0x2 or len(payload) < HEADER.size:
+                continue
+
+            now = time.monotonic()
+            if not args.no_ack:
+                ws.send(payload[:12])
+
+            ts, seq, frames, fmt, ch = HEADER.unpack_from(payload)
+            if next_seq is not None and seq != next_seq:
+                gap = (seq - next_seq) & 0xFFFFFFFF
+                lost += gap
+                for _ in range(min(gap, 1000)):
+                    if wav:
+                        wav.silence(frames)
+            next_seq = (seq + 1) & 0xFFFFFFFF
+            received += 1
+            if wav:
+                wav.write(payload[HEADER.size:], frames)
+
+            if last_arrival is not None:
+                jitter = abs((now - last_arrival) - frame_s)
+                jitter_sum += jitter
+                jitter_max = max(jitter_max, jitter)
+            last_arrival = now
+
+            if now - report >= 1:
+                report = now
+                avg = jitter_sum / max(received - 1, 1)
+                print(f"{received} frames, {lost} lost, arrival jitter avg {avg * 1e3:.2f} ms "
+                      f"max {jitter_max * 1e3:.2f} ms")
+    except KeyboardInterrupt:
+        pass
+    except ConnectionError as e:
+        print(e)
+    finally:
+        ws.close()
+        if wav:
+            wav.close()
+
+    print(f"done: {received} frames, {lost} lost ({lost * 100 / max(received + lost, 1):.2f}%), "
+          f"jitter max {jitter_max * 1e3:.2f} ms; the device logs the end-to-end latency")
+
+
+if __name__ == "__main__":
+    main()
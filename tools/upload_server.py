@@ -0,0 +1,202 @@
+#!/usr/bin/env python3
+"""
+边录边传的接收端 (只用标准库)
+
+    python3 tools/upload_server.py -d uploads --port 8090
+    python3 tools/upload_server.py -d uploads --rate 64000 --drop-every 5
+
+设备 (REC_UPLOAD 为 1) 把录音文件分块传输到 http://<PC>:8090/upload/<名字>?offset=N,
+本端收到多少就写多少, 回复已保存的大小作为确认; 连接中途断开时已写入的数据保留,
+设备用 GET 查询大小后从这里续传. 录音结束后设备重传文件开头并带上 final=<大小>,
+本端截断到这个大小并标记完成. GET 返回大小, 是否完成和 CRC32, 设备据此校验.
+--rate 限制接收速度, 模拟网络慢于录音 (设备从 SD 卡读取落后的数据);
+--drop-every 每隔几个请求在收到 16KB 后断开连接, 测试续传.
+"""
+
+import argparse
+import json
+import os
+import threading
+import time
+import urllib.parse
+import zlib
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+DROP_AFTER = 16 * 1024                  # --drop-every 时每个被断开的请求收到的字节数
+
+
+class Store:
+    """上传目录中的文件, 每个文件一把锁, 完成标记只保存在内存中"""
+
+    def __init__(self, directory):
+        self.dir = directory
+        self.lock = threading.Lock()
+        self.locks = {}
+        self.complete = set()
+        self.requests = 0
+        os.makedirs(directory, exist_ok=True)
+
+    def path(self, name):
+        return os.path.join(self.dir, os.path.basename(name))
+
+    def file_lock(self, name):
+        with self.lock:
+            return self.locks.setdefault(name, threading.Lock())
+
+    def size(self, name):
+        try:
+            return os.path.getsize(self.path(name))
+        except FileNotFoundError:
+            return None
+
+    def crc32(self, name):
+        crc = 0
+        with open(self.path(name), "rb") as f:
+            while data := f.read(65536):
+                crc = zlib.crc32(data, crc)
+        return crc
+
+    def next_request(self):
+        with self.lock:
+            self.requests += 1
+            return self.requests
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"       # 设备在请求之间复用连接
+    store = None
+    rate = 0
+    drop_every = 0
+
+    def reply(self, status, obj):
+        body = json.dumps(obj).encode()
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def target(self):
+        u = urllib.parse.urlparse(self.path)
+        if not u.path.startswith("/upload/"):
+            return None, {}
+        q = {k: v[0] for k, v in urllib.parse.parse_qs(u.query).items()}
+        return u.path[len("/upload/"):], q
+
+    def body(self):
+        """逐段产生请求体, 支持分块传输和 Content-Length"""
+        if self.headers.get("Transfer-Encoding", "").lower() == "chunked":
+            while True:
+                line = self.rfile.readline()
+                if not line:
+                    raise ConnectionError("connection closed in chunk header")
+                n = int(line.split(b";")[0].strip(), 16)
+                if n == 0:
+                    while self.rfile.readline() not in (b"\r\n", b"\n", b""):
+                        pass                        # 分块结尾的 trailer
+                    return
+                data = self.rfile.read(n)
+                if len(data) < n or self.rfile.read(2) != b"\r\n":
+                    raise ConnectionError("connection closed in chunk data")
+                yield data
+        else:
+            left = int(self.headers.get("Content-Length", 0))
+            while left > 0:
+                data = self.rfile.read(min(left, 65536))
+                if not data:
+                    raise ConnectionError("connection closed in body")
+                left -= len(data)
+                yield data
+
+    def do_GET(self):
+        name, _ = self.target()
+        size = self.store.size(name) if name else None
+        if size is None:
+            self.reply(404, {"size": 0})
+            return
+        with self.store.file_lock(name):
+            self.reply(200, {"size": size, "complete": int(name in self.store.complete),
+                             "crc32": self.store.crc32(name)})
+
+    def do_POST(self):
+        name, q = self.target()
+        if not name or "offset" not in q:
+            self.reply(400, {"error": "expected /upload/<name>?offset=N"})
+            return
+
+        offset = int(q["offset"])
+        final = int(q["final"]) if "final" in q else None
+        drop = self.drop_every and self.store.next_request() % self.drop_every == 0
+
+        with self.store.file_lock(name):
+            size = self.store.size(name) or 0
+            if offset > size:
+                # 中间缺了数据, 告诉设备从哪里重传; 请求体不读了, 关闭连接
+                self.close_connection = True
+                self.reply(409, {"size": size})
+                return
+
+            received = 0
+            start = time.monotonic()
+            path = self.store.path(name)
+            with open(path, "r+b" if os.path.exists(path) else "w+b") as f:
+                f.seek(offset)
+                try:
+                    for data in self.body():
+                        f.write(data)
+                        f.flush()                       # 收到的都算已保存, 断开后从这里续传
+                        received += len(data)
+                        if drop and received >= DROP_AFTER:
+                            print(f"{name}: dropping the connection at {offset + received}")
+                            self.close_connection = True
+                            return
+                        if self.rate:
+                            ahead = received / self.rate - (time.monotonic() - start)
+                            if ahead > 0:
+                                time.sleep(ahead)
+                except (ConnectionError, ValueError) as e:
+                    print(f"{name}: {e} at {offset + received}")
+                    self.close_connection = True
+                    return
+
+                size = max(size, offset + received)
+                if final is not None:
+                    if size < final:
+                        self.reply(409, {"size": size})
+                        return
+                    f.truncate(final)
+                    size = final
+                    self.store.complete.add(name)
+
+        if final is not None:
+            print(f"{name}: complete, {size} bytes, crc32 {self.store.crc32(name):08x}")
+        self.reply(200, {"size": size, "complete": int(name in self.store.complete)})
+
+    def log_message(self, fmt, *args):
+        if self.server.verbose:
+            super().log_message(fmt, *args)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    ap.add_argument("-d", "--dir", default="uploads", help="保存目录")
+    ap.add_argument("--port", type=int, default=8090)
+    ap.add_argument("--rate", type=int, default=0, help="每个请求的接收速度上限(字节/秒), 0 不限")
+    ap.add_argument("--drop-every", type=int, default=0, help="每隔几个请求断开一次连接")
+    ap.add_argument("-v", "--verbose", action="store_true", help="打印每个请求")
+    args = ap.parse_args()
+
+    Handler.store = Store(args.dir)
+    Handler.rate = args.rate
+    Handler.drop_every = args.drop_every
+    server = ThreadingHTTPServer(("", args.port), Handler)
+    server.verbose = args.verbose
+    print(f"http://<this host>:{args.port}/upload -> {os.path.abspath(args.dir)}")
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()